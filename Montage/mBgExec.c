@@ -38,6 +38,7 @@ Version         Developer          Date           Change
 #include <sys/stat.h>
 #include <math.h>
 #include <mtbl.h>
+#include <svc.h>
 
 #ifdef MPI
 #include <mpi.h>
@@ -47,8 +48,6 @@ Version         Developer          Date           Change
 
 #define MAXSTR  4096
 
-char *svc_value();
-int   svc_run  (char *cmd);
 char *filePath (char *path, char *fname);
 char *fileName (char *filename);
 
@@ -81,8 +80,12 @@ char *mktemp(char *template);
 int nextImg();
 int nextCorr();
 
+void bgDone(int slot);
+
 int debug;
 
+int count, failed;
+
 
 /*******************************************************************/
 /*                                                                 */
@@ -96,7 +99,7 @@ int debug;
 int main(int argc, char **argv)
 {
    int  ch, istat, ncols;
-   int  count, nocorrection, failed, noAreas;
+   int  nocorrection, noAreas, njobs;
 
    char path      [MAXSTR];
    char tblfile   [MAXSTR];
@@ -140,12 +143,13 @@ int main(int argc, char **argv)
    debug   = 0;
    fstatus = stdout;
    noAreas = 0;
+   njobs   = 1;
 
    strcpy(path, "");
 
    opterr = 0;
 
-   while ((ch = getopt(argc, argv, "np:s:d")) != EOF) 
+   while ((ch = getopt(argc, argv, "np:s:dj:")) != EOF) 
    {
         switch (ch) 
         {
@@ -161,6 +165,13 @@ int main(int argc, char **argv)
                 noAreas = 1;
                 break;
 
+           case 'j':
+                njobs = atoi(optarg);
+
+                if(njobs < 1)
+                   njobs = 1;
+                break;
+
            case 's':
                 if((fstatus = fopen(optarg, "w+")) == (FILE *)NULL)
                 {
@@ -175,7 +186,7 @@ int main(int argc, char **argv)
                 break;
 
            default:
-            printf ("[struct stat=\"ERROR\", msg=\"Usage: %s [-p projdir] [-s statusfile] [-d] [-n(o-areas)] images.tbl corrections.tbl corrdir\"]\n", argv[0]);
+            printf ("[struct stat=\"ERROR\", msg=\"Usage: %s [-p projdir] [-s statusfile] [-d] [-n(o-areas)] [-j njobs] images.tbl corrections.tbl corrdir\"]\n", argv[0]);
                 exit(1);
                 break;
         }
@@ -188,7 +199,7 @@ int main(int argc, char **argv)
 
    if (argc - optind < 3) 
    {
-        fprintf (fstatus, "[struct stat=\"ERROR\", msg=\"Usage: %s [-p projdir] [-s statusfile] [-d] [-n(o-areas)] images.tbl corrections.tbl corrdir\"]\n", argv[0]);
+        fprintf (fstatus, "[struct stat=\"ERROR\", msg=\"Usage: %s [-p projdir] [-s statusfile] [-d] [-n(o-areas)] [-j njobs] images.tbl corrections.tbl corrdir\"]\n", argv[0]);
 #ifdef MPI
         exit_flag = 1;
 #else
@@ -453,6 +464,8 @@ int main(int argc, char **argv)
    nocorrection = 0;
    failed       = 0;
 
+   svc_pool_init(njobs);
+
    if(nextImg())
    {
       fprintf (fstatus, "[struct stat=\"ERROR\", msg=\"No images in list\"]\n");
@@ -512,28 +525,19 @@ int main(int argc, char **argv)
           fflush(stdout);
          }
 
-         svc_run(cmd);
-
-         strcpy( status, svc_value( "stat" ));
+         if(svc_pool_full())
+            bgDone(svc_pool_wait());
 
-         if(strcmp( status, "ABORT") == 0)
+         if(svc_pool_submit(cmd) < 0)
          {
-            strcpy( msg, svc_value( "msg" ));
-         
-            fprintf(fstatus, "[struct stat=\"ERROR\", msg=\"%s\"]\n", msg);
+            svc_pool_close();
+
+            fprintf(fstatus, "[struct stat=\"ERROR\", msg=\"Cannot start mBackground\"]\n");
             fflush(fstatus);
-         
-#ifdef MPI
-            exit_flag = 1;
-#else
+
             exit(1);
-#endif
          }
 
-         ++count;
-         if(strcmp( status, "ERROR") == 0)
-            ++failed;
-
 #ifdef MPI
          }
 #endif
@@ -580,6 +584,9 @@ int main(int argc, char **argv)
       }
    }
 
+   while(svc_pool_active())
+      bgDone(svc_pool_wait());
+
    unlink(imgsort);
    unlink(corrsort);
 
@@ -604,6 +611,41 @@ int main(int argc, char **argv)
 }
 
 
+/***********************************************/
+/*                                             */
+/*  Check the return structure of a finished   */
+/*  mBackground job and update the counts.     */
+/*                                             */
+/***********************************************/
+
+void bgDone(int slot)
+{
+   char msg   [MAXSTR];
+   char status[32];
+
+   if(slot < 0)
+      return;
+
+   strcpy( status, svc_value( "stat" ));
+
+   if(strcmp( status, "ABORT") == 0)
+   {
+      strcpy( msg, svc_value( "msg" ));
+
+      svc_pool_close();
+
+      fprintf(fstatus, "[struct stat=\"ERROR\", msg=\"%s\"]\n", msg);
+      fflush(fstatus);
+
+      exit(1);
+   }
+
+   ++count;
+   if(strcmp( status, "ERROR") == 0)
+      ++failed;
+}
+
+
 int nextImg()
 {
    int istat;
@@ -24,6 +24,7 @@ Version  Developer        Date     Change
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <mtbl.h>
+#include <svc.h>
 
 #ifdef MPI
 #include <mpi.h>
@@ -33,9 +34,6 @@ Version  Developer        Date     Change
 
 #define MAXSTR 4096
 
-char *svc_value();
-char *svc_run  (char *cmd);
-
 char *filePath (char *path, char *fname);
 int   checkFile(char *filename);
 int   checkHdr (char *infile, int hdrflag, int hdu);
@@ -47,6 +45,10 @@ extern int getopt(int argc, char *const *argv, const char *options);
 
 int debug;
 
+int count, failed;
+
+void diffDone(int slot);
+
 
 /*******************************************************************/
 /*                                                                 */
@@ -59,7 +61,7 @@ int debug;
 
 int main(int argc, char **argv)
 {
-   int    c, istat, ncols, count, failed, noAreas;
+   int    c, istat, ncols, noAreas, njobs;
 
    int    icntr1;
    int    icntr2;
@@ -80,8 +82,6 @@ int main(int argc, char **argv)
    char   template[MAXSTR];
 
    char   cmd     [MAXSTR];
-   char   msg     [MAXSTR];
-   char   status  [32];
 
    struct stat type;
 
@@ -112,6 +112,7 @@ int main(int argc, char **argv)
 
    debug   = 0;
    noAreas = 0;
+   njobs   = 1;
 
    strcpy(path, "");
 
@@ -119,7 +120,7 @@ int main(int argc, char **argv)
 
    fstatus = stdout;
 
-   while ((c = getopt(argc, argv, "np:ds:")) != EOF) 
+   while ((c = getopt(argc, argv, "np:ds:j:")) != EOF) 
    {
       switch (c) 
       {
@@ -135,6 +136,13 @@ int main(int argc, char **argv)
             noAreas = 1;
             break;
 
+         case 'j':
+            njobs = atoi(optarg);
+
+            if(njobs < 1)
+               njobs = 1;
+            break;
+
          case 's':
             if((fstatus = fopen(optarg, "w+")) == (FILE *)NULL)
             {
@@ -149,7 +157,7 @@ int main(int argc, char **argv)
             break;
 
          default:
-	    printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-p projdir] [-d] [-n(o-areas)] [-s statusfile] diffs.tbl template.hdr diffdir\"]\n", argv[0]);
+	    printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-p projdir] [-d] [-n(o-areas)] [-j njobs] [-s statusfile] diffs.tbl template.hdr diffdir\"]\n", argv[0]);
 #ifdef MPI
             exit_flag = 1;
 #else
@@ -167,7 +175,7 @@ int main(int argc, char **argv)
 
    if (argc - optind < 3) 
    {
-      printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-p projdir] [-d] [-n(o-areas)] [-s statusfile] diffs.tbl template.hdr diffdir\"]\n", argv[0]);
+      printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-p projdir] [-d] [-n(o-areas)] [-j njobs] [-s statusfile] diffs.tbl template.hdr diffdir\"]\n", argv[0]);
 #ifdef MPI
       exit_flag = 1;
 #else
@@ -278,6 +286,8 @@ int main(int argc, char **argv)
    count  = 0;
    failed = 0;
 
+   svc_pool_init(njobs);
+
    while(1)
    {
       istat = tread();
@@ -309,25 +319,18 @@ int main(int argc, char **argv)
 	 fflush(stdout);
       }
 
-      svc_run(cmd);
+      if(svc_pool_full())
+	 diffDone(svc_pool_wait());
 
-      strcpy( status, svc_value( "stat" ));
-
-      if(strcmp( status, "ABORT") == 0)
+      if(svc_pool_submit(cmd) < 0)
       {
-	 strcpy( msg, svc_value( "msg" ));
+	 svc_pool_close();
 
-	 fprintf(fstatus, "[struct stat=\"ERROR\", msg=\"%s\"]\n", msg);
+	 fprintf(fstatus, "[struct stat=\"ERROR\", msg=\"Cannot start mDiff\"]\n");
 	 fflush(stdout);
 
 	 exit(1);
       }
-
-      ++count;
-
-      if(strcmp( status, "ERROR"  ) == 0
-      || strcmp( status, "WARNING") == 0)
-	 ++failed;
 #ifdef MPI
     } // end if (row_number % MPI_size == MPI_rank)
     row_number++;
@@ -335,6 +338,9 @@ int main(int argc, char **argv)
 
    }
 
+   while(svc_pool_active())
+      diffDone(svc_pool_wait());
+
 #ifdef MPI
    MPI_err = MPI_Allreduce(&count, &sum_tmp, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);   
    count = sum_tmp;
@@ -353,3 +359,41 @@ int main(int argc, char **argv)
 
    exit(0);
 }
+
+
+
+/***********************************************/
+/*                                             */
+/*  Check the return structure of a finished   */
+/*  mDiff job and update the counts.           */
+/*                                             */
+/***********************************************/
+
+void diffDone(int slot)
+{
+   char msg   [MAXSTR];
+   char status[32];
+
+   if(slot < 0)
+      return;
+
+   strcpy( status, svc_value( "stat" ));
+
+   if(strcmp( status, "ABORT") == 0)
+   {
+      strcpy( msg, svc_value( "msg" ));
+
+      svc_pool_close();
+
+      fprintf(fstatus, "[struct stat=\"ERROR\", msg=\"%s\"]\n", msg);
+      fflush(stdout);
+
+      exit(1);
+   }
+
+   ++count;
+
+   if(strcmp( status, "ERROR"  ) == 0
+   || strcmp( status, "WARNING") == 0)
+      ++failed;
+}
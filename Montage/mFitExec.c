@@ -29,6 +29,7 @@ Version  Developer        Date     Change
 #include <string.h>
 #include <math.h>
 #include <mtbl.h>
+#include <svc.h>
 
 #ifdef MPI
 #include <mpi.h>
@@ -38,9 +39,6 @@ Version  Developer        Date     Change
 
 #define MAXSTR 4096
 
-char *svc_value();
-char *svc_run  (char *cmd);
-
 #ifdef MPI
 int   i;
 #endif
@@ -55,6 +53,21 @@ extern int getopt(int argc, char *const *argv, const char *options);
 
 int debug;
 
+int    count, failed, warning;
+
+int   *jobSeq;          /* Submission order of the job in each pool slot */
+int   *jobCntr1;
+int   *jobCntr2;
+
+char **fitLine;         /* Finished fit records, by submission order,    */
+int    nfitLine;        /* waiting for the earlier ones to finish        */
+int    maxfitLine;
+int    nextLine;
+
+FILE  *fout;
+
+void fitDone(int slot);
+
 
 /*******************************************************************/
 /*                                                                 */
@@ -69,8 +82,8 @@ int debug;
 
 int main(int argc, char **argv)
 {
-   int    ch, stat, ncols, count, failed;
-   int    levelOnly, warning, missing;
+   int    ch, stat, ncols, slot, njobs;
+   int    levelOnly, missing;
 
    int    icntr1;
    int    icntr2;
@@ -90,29 +103,6 @@ int main(int argc, char **argv)
    char   diffdir [MAXSTR];
 
    char   cmd     [MAXSTR];
-   char   msg     [MAXSTR];
-   char   status  [32];
-
-   double a;
-   double b;
-   double c;
-   double crpix1;
-   double crpix2;
-   int    xmin;
-   int    xmax;
-   int    ymin;
-   int    ymax;
-   double xcenter;
-   double ycenter;
-   double npixel;
-   double rms;
-   double boxx;
-   double boxy;
-   double boxwidth;
-   double boxheight;
-   double boxangle;
-
-   FILE   *fout;
 
 #ifdef MPI
    FILE   *fin;
@@ -146,11 +136,13 @@ int main(int argc, char **argv)
 
    levelOnly = 0;
 
+   njobs = 1;
+
    opterr = 0;
 
    fstatus = stdout;
 
-   while ((ch = getopt(argc, argv, "dls:")) != EOF) 
+   while ((ch = getopt(argc, argv, "dls:j:")) != EOF) 
    {
       switch (ch) 
       {
@@ -162,6 +154,13 @@ int main(int argc, char **argv)
             levelOnly = 1;
             break;
 
+         case 'j':
+            njobs = atoi(optarg);
+
+            if(njobs < 1)
+               njobs = 1;
+            break;
+
          case 's':
             if((fstatus = fopen(optarg, "w+")) == (FILE *)NULL)
             {
@@ -176,7 +175,7 @@ int main(int argc, char **argv)
             break;
 
          default:
-	    printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-d] [-l(evel-only)] [-s statusfile] diffs.tbl fits.tbl diffdir\"]\n", argv[0]);
+	    printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-d] [-l(evel-only)] [-j njobs] [-s statusfile] diffs.tbl fits.tbl diffdir\"]\n", argv[0]);
 #ifdef MPI
             exit_flag = 1;
 #else
@@ -194,7 +193,7 @@ int main(int argc, char **argv)
 
    if (argc - optind < 3) 
    {
-      printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-d] [-l(evel-only)] [-s statusfile] diffs.tbl fits.tbl diffdir\"]\n", argv[0]);
+      printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-d] [-l(evel-only)] [-j njobs] [-s statusfile] diffs.tbl fits.tbl diffdir\"]\n", argv[0]);
 #ifdef MPI
       exit_flag = 1;
 #else
@@ -287,6 +286,18 @@ int main(int argc, char **argv)
    warning = 0;
    missing = 0;
 
+   svc_pool_init(njobs);
+
+   jobSeq   = (int *)malloc(njobs * sizeof(int));
+   jobCntr1 = (int *)malloc(njobs * sizeof(int));
+   jobCntr2 = (int *)malloc(njobs * sizeof(int));
+
+   nfitLine   = 0;
+   nextLine   = 0;
+   maxfitLine = 1024;
+
+   fitLine = (char **)malloc(maxfitLine * sizeof(char *));
+
 #ifndef MPI
    fprintf(fout, "|  plus  |  minus |       a    |      b     |      c     | crpix1  | crpix2  | xmin | xmax | ymin | ymax | xcenter | ycenter |  npixel |    rms     |    boxx    |    boxy    |  boxwidth  | boxheight  |   boxang   |\n");
    fflush(fout);
@@ -330,73 +341,45 @@ int main(int argc, char **argv)
 	 fflush(stdout);
       }
 
-      svc_run(cmd);
+      if(svc_pool_full())
+	 fitDone(svc_pool_wait());
 
-      strcpy( status, svc_value( "stat" ));
+      slot = svc_pool_submit(cmd);
 
-      if(strcmp( status, "ABORT") == 0)
+      if(slot < 0)
       {
-	 strcpy( msg, svc_value( "msg" ));
+	 svc_pool_close();
 
-	 fprintf(fstatus, "[struct stat=\"ERROR\", msg=\"%s\"]\n", msg);
+	 fprintf(fstatus, "[struct stat=\"ERROR\", msg=\"Cannot start mFitplane\"]\n");
 	 fflush(stdout);
 
 	 exit(1);
       }
 
-      ++count;
-      if(strcmp( status, "ERROR") == 0)
+      if(nfitLine >= maxfitLine)
       {
-	 ++failed;
+	 maxfitLine += 1024;
 
-	 if(debug)
-	 {
-	    printf("ERROR: %s\n", svc_value( "msg" ));
-	    fflush(stdout);
-	 }
+	 fitLine = (char **)realloc(fitLine, maxfitLine * sizeof(char *));
       }
-      else if(strcmp( status, "WARNING") == 0)
-      {
-	 ++warning;
 
-	 if(debug)
-	 {
-	    printf("WARNING: %s\n", svc_value( "msg" ));
-	    fflush(stdout);
-	 }
-      }
-      else
-      {
-	 a         = atof(svc_value("a"));
-	 b         = atof(svc_value("b"));
-	 c         = atof(svc_value("c"));
-	 crpix1    = atof(svc_value("crpix1"));
-	 crpix2    = atof(svc_value("crpix2"));
-	 xmin      = atoi(svc_value("xmin"));
-	 xmax      = atoi(svc_value("xmax"));
-	 ymin      = atoi(svc_value("ymin"));
-	 ymax      = atoi(svc_value("ymax"));
-	 xcenter   = atof(svc_value("xcenter"));
-	 ycenter   = atof(svc_value("ycenter"));
-	 npixel    = atof(svc_value("npixel"));
-	 rms       = atof(svc_value("rms"));
-	 boxx      = atof(svc_value("boxx"));
-	 boxy      = atof(svc_value("boxy"));
-	 boxwidth  = atof(svc_value("boxwidth"));
-	 boxheight = atof(svc_value("boxheight"));
-	 boxangle  = atof(svc_value("boxang"));
-
-	 fprintf(fout, " %8d %8d %12.5e %12.5e %12.5e %9.2f %9.2f %6d %6d %6d %6d %9.2f %9.2f %9.0f %12.5e %12.1f %12.1f %12.1f %12.1f %12.1f\n",
-	    cntr1, cntr2, a, b, c, crpix1, crpix2, xmin, xmax, ymin, ymax, 
-	    xcenter, ycenter, npixel, rms, boxx, boxy, boxwidth, boxheight, boxangle);
-	 fflush(fout);
-      }
+      fitLine[nfitLine] = (char *)NULL;
+
+      jobSeq  [slot] = nfitLine;
+      jobCntr1[slot] = cntr1;
+      jobCntr2[slot] = cntr2;
+
+      ++nfitLine;
+
 #ifdef MPI
     } // end if (row_number % MPI_size == MPI_rank)
     row_number++;
 #endif
    }
 
+   while(svc_pool_active())
+      fitDone(svc_pool_wait());
+
 #ifdef MPI
    MPI_err = MPI_Allreduce(&count, &sum_tmp, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
    count = sum_tmp;
@@ -449,3 +432,130 @@ int main(int argc, char **argv)
 
    exit(0);
 }
+
+
+
+/***********************************************/
+/*                                             */
+/*  Check the return structure of a finished   */
+/*  mFitplane job, then write out any fits     */
+/*  that are now complete in table order.      */
+/*                                             */
+/***********************************************/
+
+void fitDone(int slot)
+{
+   char   msg   [MAXSTR];
+   char   line  [MAXSTR];
+   char   status[32];
+
+   double a;
+   double b;
+   double c;
+   double crpix1;
+   double crpix2;
+   int    xmin;
+   int    xmax;
+   int    ymin;
+   int    ymax;
+   double xcenter;
+   double ycenter;
+   double npixel;
+   double rms;
+   double boxx;
+   double boxy;
+   double boxwidth;
+   double boxheight;
+   double boxangle;
+
+   if(slot < 0)
+      return;
+
+   strcpy( status, svc_value( "stat" ));
+
+   if(strcmp( status, "ABORT") == 0)
+   {
+      strcpy( msg, svc_value( "msg" ));
+
+      svc_pool_close();
+
+      fprintf(fstatus, "[struct stat=\"ERROR\", msg=\"%s\"]\n", msg);
+      fflush(stdout);
+
+      exit(1);
+   }
+
+   ++count;
+
+   strcpy(line, "");
+
+   if(strcmp( status, "ERROR") == 0)
+   {
+      ++failed;
+
+      if(debug)
+      {
+	 printf("ERROR: %s\n", svc_value( "msg" ));
+	 fflush(stdout);
+      }
+   }
+
+   else if(strcmp( status, "WARNING") == 0)
+   {
+      ++warning;
+
+      if(debug)
+      {
+	 printf("WARNING: %s\n", svc_value( "msg" ));
+	 fflush(stdout);
+      }
+   }
+
+   else
+   {
+      a         = atof(svc_value("a"));
+      b         = atof(svc_value("b"));
+      c         = atof(svc_value("c"));
+      crpix1    = atof(svc_value("crpix1"));
+      crpix2    = atof(svc_value("crpix2"));
+      xmin      = atoi(svc_value("xmin"));
+      xmax      = atoi(svc_value("xmax"));
+      ymin      = atoi(svc_value("ymin"));
+      ymax      = atoi(svc_value("ymax"));
+      xcenter   = atof(svc_value("xcenter"));
+      ycenter   = atof(svc_value("ycenter"));
+      npixel    = atof(svc_value("npixel"));
+      rms       = atof(svc_value("rms"));
+      boxx      = atof(svc_value("boxx"));
+      boxy      = atof(svc_value("boxy"));
+      boxwidth  = atof(svc_value("boxwidth"));
+      boxheight = atof(svc_value("boxheight"));
+      boxangle  = atof(svc_value("boxang"));
+
+      sprintf(line, " %8d %8d %12.5e %12.5e %12.5e %9.2f %9.2f %6d %6d %6d %6d %9.2f %9.2f %9.0f %12.5e %12.1f %12.1f %12.1f %12.1f %12.1f\n",
+	 jobCntr1[slot], jobCntr2[slot], a, b, c, crpix1, crpix2, xmin, xmax, ymin, ymax, 
+	 xcenter, ycenter, npixel, rms, boxx, boxy, boxwidth, boxheight, boxangle);
+   }
+
+   fitLine[jobSeq[slot]] = (char *)malloc(strlen(line) + 1);
+
+   strcpy(fitLine[jobSeq[slot]], line);
+
+
+   /* Write out everything that is now in order */
+
+   while(nextLine < nfitLine && fitLine[nextLine] != (char *)NULL)
+   {
+      if(strlen(fitLine[nextLine]) > 0)
+      {
+	 fputs(fitLine[nextLine], fout);
+	 fflush(fout);
+      }
+
+      free(fitLine[nextLine]);
+
+      fitLine[nextLine] = (char *)NULL;
+
+      ++nextLine;
+   }
+}
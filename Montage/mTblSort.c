@@ -13,10 +13,17 @@ Version  Developer        Date     Change
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
 #include <mtbl.h>
 
 #define MAXDATA  4096
 #define MAXSTR  16384
+#define MAXKEY     16
+#define MAXRUN    256
+#define MAXFAN     64
+#define MAXLEVEL    4
 
 int    *recno;
 double *data;
@@ -27,6 +34,8 @@ int     flip  = 1;
 
 void    qksort(int ilo, int ihi);
 
+int     extSort(char *tblname, char *keystr, FILE *fout, char *outname, long budget, int nthread);
+
 
 /*******************************************************************/
 /*                                                                 */
@@ -50,41 +59,79 @@ int main(int argc, char **argv)
    int     i, ncols, icol;
    int     foundHdr, irec;
 
+   int     external, nthread;
+   long    budget;
+   char   *end;
+
+   struct stat tblstat;
+
 
    /* Process command-line arguments */
 
+   external = 0;
+   budget   = 256;
+   nthread  = 4;
+
    if(argc < 4)
    {
-      printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-d] in.tbl colname out.tbl\"]\n",
+      printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-d][-r][-M memMB][-n threads] in.tbl colname[:s|:n][:r][,colname...] out.tbl\"]\n",
          argv[0]);
       fflush(stdout);
       exit(0);
    }
 
-   for(i=1; i<argc; ++i)
+   while(argc > 1 && argv[1][0] == '-')
    {
-      if(strcmp(argv[i], "-d") == 0)
+      if(strcmp(argv[1], "-d") == 0)
          debug = 1;
 
-      if(strcmp(argv[i], "-r") == 0)
+      else if(strcmp(argv[1], "-r") == 0)
          flip = -1;
-   }
 
-   if(debug)
-   {
-      ++argv;
-      --argc;
-   }
+      else if(argc > 2 && strcmp(argv[1], "-M") == 0)
+      {
+         budget = strtol(argv[2], &end, 10);
+
+         if(end < argv[2] + strlen(argv[2]) || budget < 1)
+         {
+            printf("[struct stat=\"ERROR\", msg=\"Memory budget (-M, in MB) must be a positive integer\"]\n");
+            fflush(stdout);
+            exit(0);
+         }
+
+         external = 1;
+
+         ++argv;
+         --argc;
+      }
+
+      else if(argc > 2 && strcmp(argv[1], "-n") == 0)
+      {
+         nthread = strtol(argv[2], &end, 10);
+
+         if(end < argv[2] + strlen(argv[2]) || nthread < 1)
+         {
+            printf("[struct stat=\"ERROR\", msg=\"Thread count (-n) must be a positive integer\"]\n");
+            fflush(stdout);
+            exit(0);
+         }
+
+         external = 1;
+
+         ++argv;
+         --argc;
+      }
+
+      else
+         break;
 
-   if(flip == -1)
-   {
       ++argv;
       --argc;
    }
 
    if(argc < 4)
    {
-      printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-d] in.tbl colname out.tbl\"]\n",
+      printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-d][-r][-M memMB][-n threads] in.tbl colname[:s|:n][:r][,colname...] out.tbl\"]\n",
          argv[0]);
       fflush(stdout);
       exit(0);
@@ -95,6 +142,12 @@ int main(int argc, char **argv)
    strcpy(colname, argv[2]);
    strcpy(outname, argv[3]);
 
+   if(strchr(colname, ',') || strchr(colname, ':'))
+      external = 1;
+
+   if(stat(tblname, &tblstat) == 0 && (long)tblstat.st_size > budget * 1024L * 1024L)
+      external = 1;
+
 
    /* Allocate memory */
 
@@ -137,10 +190,7 @@ int main(int argc, char **argv)
    while(1)
    {
       if(fgets(line, MAXSTR, fin) == (char *)NULL)
-      {
-         fclose(fout);
          break;
-      }
 
       while(line[strlen(line) - 1] == '\n'
          || line[strlen(line) - 1] == '\r')
@@ -159,6 +209,27 @@ int main(int argc, char **argv)
    fclose(fin);
 
 
+   /* Multiple keys, string keys, an explicit memory  */
+   /* budget or thread count, or a table bigger than  */
+   /* the budget go to the external merge sort.  It   */
+   /* is stable (ties stay in table order); the       */
+   /* in-memory qksort used for a plain single        */
+   /* numeric key on a small table is not.            */
+
+   if(external)
+   {
+      ndata = extSort(tblname, colname, fout, outname, budget * 1024L * 1024L, nthread);
+
+      fflush(fout);
+      fclose(fout);
+
+      printf("[struct stat=\"OK\", count=%d]\n", ndata);
+      fflush(stdout);
+
+      exit(0);
+   }
+
+
    /* Read through the table file,       */
    /* collecting the values to be sorted */
 
@@ -376,3 +447,761 @@ void qksort(int ilo, int ihi)
 
    return;
 }
+
+
+
+/*******************************************************************/
+/*                                                                 */
+/*  External merge sort                                            */
+/*                                                                 */
+/*  Records are packed into an arena (up to half the memory        */
+/*  budget) along with their sort keys.  When the arena fills,     */
+/*  it is sorted in parallel (one slice per thread, then merged)   */
+/*  and written out as a run.  The runs are then k-way merged      */
+/*  into the output.  So as not to have too many runs open at      */
+/*  once, they are kept in a merge tree: when MAXFAN runs have     */
+/*  built up on one level they are merged into a single run on     */
+/*  the next, so each record is only merged a few times however    */
+/*  big the table is.                                              */
+/*                                                                 */
+/*  Ties on all the keys are broken by record number, so the sort  */
+/*  is stable.                                                     */
+/*                                                                 */
+/*  Each record in the arena / run files is:                       */
+/*                                                                 */
+/*     long  recno                                                 */
+/*     int   size    (bytes, multiple of 8)                        */
+/*     int   line    (offset of the record text)                   */
+/*     union SortKey key[nkey]                                     */
+/*     string key values and the record text (null-terminated)     */
+/*                                                                 */
+/*******************************************************************/
+
+#define RECHDR   (sizeof(long) + 2*sizeof(int))
+
+#define NUMERIC  0
+#define STRING   1
+
+union SortKey
+{
+   double num;
+   int    off;
+};
+
+int     nkey;
+int     keycol [MAXKEY];
+int     keytype[MAXKEY];
+int     keyflip[MAXKEY];
+
+struct SortSlice
+{
+   char **rec;
+   long   n;
+};
+
+int    extCompare   (char *a, char *b);
+int    extComparePtr(const void *a, const void *b);
+void  *extSortSlice (void *arg);
+FILE  *extRunFile   (char *outname, char **buf, long bufsize);
+int    extReadRec   (FILE *fp, char **buf, int *maxbuf);
+void   extMerge     (FILE **runs, char **runbuf, int nrun, FILE *fout, int final);
+
+#define RECNO(r)  (*(long *)(r))
+#define RECSIZE(r)(*(int  *)((r) + sizeof(long)))
+#define RECLINE(r)(*(int  *)((r) + sizeof(long) + sizeof(int)))
+#define RECKEY(r) ((union SortKey *)((r) + RECHDR))
+
+
+int extSort(char *tblname, char *keystr, FILE *fout, char *outname, long budget, int nthread)
+{
+   int     i, j, l, up, ncols, nrun, nslice, len, size;
+   long    nrec, maxrec, nalloc, used, arenasize, bufsize, recno, n;
+   char   *arena, *rec, *ptr, *end;
+   char  **recs, **sorted;
+   char    keys[MAXSTR];
+   char    name[MAXSTR];
+   char   *keyname[MAXKEY];
+
+   FILE   *runs  [MAXLEVEL][MAXFAN];
+   char   *runbuf[MAXLEVEL][MAXFAN];
+   int     nlevel[MAXLEVEL];
+
+   FILE   *fmerged;
+   char   *mergedbuf;
+
+   FILE   *allruns  [MAXRUN];
+   char   *allrunbuf[MAXRUN];
+
+   struct SortSlice slice[MAXRUN];
+   long    pos[MAXRUN];
+
+   pthread_t thread[MAXRUN];
+
+
+   /* Parse the key list: name[:s|:n][:r],... */
+
+   strcpy(keys, keystr);
+
+   nkey = 0;
+
+   ptr = keys;
+
+   while(1)
+   {
+      end = strchr(ptr, ',');
+
+      if(end)
+         *end = '\0';
+
+      if(nkey >= MAXKEY)
+      {
+         printf("[struct stat=\"ERROR\", msg=\"Too many sort keys (max %d)\"]\n", MAXKEY);
+         fflush(stdout);
+         exit(0);
+      }
+
+      keyname[nkey] = ptr;
+      keytype[nkey] = NUMERIC;
+      keyflip[nkey] = flip;
+
+      for(i=0; i<(int)strlen(ptr); ++i)
+      {
+         if(ptr[i] == ':')
+         {
+            ptr[i] = '\0';
+
+            for(j=i+1; j<(int)strlen(ptr+i+1)+i+1; ++j)
+            {
+                    if(ptr[j] == 's') keytype[nkey] = STRING;
+               else if(ptr[j] == 'n') keytype[nkey] = NUMERIC;
+               else if(ptr[j] == 'r') keyflip[nkey] = -keyflip[nkey];
+               else if(ptr[j] != ':')
+               {
+                  printf("[struct stat=\"ERROR\", msg=\"Invalid sort key qualifier in [%s]\"]\n", keystr);
+                  fflush(stdout);
+                  exit(0);
+               }
+            }
+
+            break;
+         }
+      }
+
+      ++nkey;
+
+      if(!end)
+         break;
+
+      ptr = end + 1;
+   }
+
+
+   /* Open the table and find the key columns */
+
+   ncols = topen(tblname);
+
+   if(ncols <= 0)
+   {
+      printf("[struct stat=\"ERROR\", msg=\"Table file open failed for [%s]\"]\n",
+         tblname);
+      fflush(stdout);
+      exit(0);
+   }
+
+   for(i=0; i<nkey; ++i)
+   {
+      strcpy(name, keyname[i]);
+
+      keycol[i] = tcol(name);
+
+      if(keycol[i] < 0)
+      {
+         printf("[struct stat=\"ERROR\", msg=\"Table does not contain column [%s]\"]\n",
+            name);
+         fflush(stdout);
+         exit(0);
+      }
+
+      if(debug)
+      {
+         printf("DEBUG> key %d: [%s] column %d, %s%s\n", i, name, keycol[i],
+            keytype[i] == STRING ? "string" : "numeric", keyflip[i] < 0 ? ", reversed" : "");
+         fflush(stdout);
+      }
+   }
+
+
+   /* Fill the arena, sorting and spilling runs as it fills */
+
+   arenasize = budget / 2;
+
+
+   /* The other half is for the buffers of the */
+   /* run files, as many as can be open at once */
+
+   bufsize = budget / 2 / (MAXLEVEL * MAXFAN);
+
+   if(bufsize < 65536)
+      bufsize = 65536;
+
+   for(l=0; l<MAXLEVEL; ++l)
+      nlevel[l] = 0;
+
+   arena = (char *)malloc(arenasize);
+
+   maxrec = MAXDATA;
+
+   recs   = (char **)malloc(maxrec * sizeof(char *));
+   sorted = (char **)malloc(maxrec * sizeof(char *));
+
+   if(arena == (char *)NULL || recs == (char **)NULL || sorted == (char **)NULL)
+   {
+      printf("[struct stat=\"ERROR\", msg=\"Cannot allocate memory for data\"]\n");
+      fflush(stdout);
+      exit(0);
+   }
+
+   recno  = 0;
+   nrec   = 0;
+   used   = 0;
+   nrun   = 0;
+
+   while(1)
+   {
+      if(tread() == 0)
+      {
+         size = RECHDR + nkey * sizeof(union SortKey);
+
+         for(i=0; i<nkey; ++i)
+            if(keytype[i] == STRING)
+               size += strlen(tval(keycol[i])) + 1;
+
+         size += strlen(tbl_rec_string) + 1;
+
+         size = (size + 7) / 8 * 8;
+      }
+      else
+         size = -1;
+
+
+      /* Sort and write a run when the arena is full */
+      /* (and at the end, if there are other runs)   */
+
+      if(nrec > 0 
+      && ((size > 0 && used + size > arenasize) || (size < 0 && nrun > 0)))
+      {
+         nslice = nthread;
+
+         if(nslice > MAXRUN)
+            nslice = MAXRUN;
+
+         if(nslice > nrec / 1024 + 1)
+            nslice = nrec / 1024 + 1;
+
+         for(i=0; i<nslice; ++i)
+         {
+            slice[i].rec = recs + nrec * i / nslice;
+            slice[i].n   = nrec * (i+1) / nslice - nrec * i / nslice;
+
+            pthread_create(&thread[i], NULL, extSortSlice, (void *)&slice[i]);
+         }
+
+         for(i=0; i<nslice; ++i)
+         {
+            pthread_join(thread[i], NULL);
+            pos[i] = 0;
+         }
+
+
+         /* Merge the sorted slices */
+
+         for(n=0; n<nrec; ++n)
+         {
+            j = -1;
+
+            for(i=0; i<nslice; ++i)
+            {
+               if(pos[i] >= slice[i].n)
+                  continue;
+
+               if(j < 0 || extCompare(slice[i].rec[pos[i]], slice[j].rec[pos[j]]) < 0)
+                  j = i;
+            }
+
+            sorted[n] = slice[j].rec[pos[j]];
+
+            ++pos[j];
+         }
+
+
+         /* Write the run at the bottom of the merge tree */
+
+         runs[0][nlevel[0]] = extRunFile(outname, &runbuf[0][nlevel[0]], bufsize);
+
+         for(n=0; n<nrec; ++n)
+         {
+            if(fwrite(sorted[n], RECSIZE(sorted[n]), 1, runs[0][nlevel[0]]) != 1)
+            {
+               printf("[struct stat=\"ERROR\", msg=\"Error writing sort run file\"]\n");
+               fflush(stdout);
+               exit(0);
+            }
+         }
+
+         rewind(runs[0][nlevel[0]]);
+
+         ++nlevel[0];
+
+
+         /* A full level is merged into one run on the next */
+         /* (the top level just merges into itself)         */
+
+         for(l=0; l<MAXLEVEL && nlevel[l] >= MAXFAN; ++l)
+         {
+            up = l + 1;
+
+            if(up >= MAXLEVEL)
+               up = l;
+
+            fmerged = extRunFile(outname, &mergedbuf, bufsize);
+
+            extMerge(runs[l], runbuf[l], nlevel[l], fmerged, 0);
+
+            rewind(fmerged);
+
+            nlevel[l] = 0;
+
+            runs  [up][nlevel[up]] = fmerged;
+            runbuf[up][nlevel[up]] = mergedbuf;
+
+            ++nlevel[up];
+
+            if(debug)
+            {
+               printf("DEBUG> merged level %d into level %d\n", l, up);
+               fflush(stdout);
+            }
+         }
+
+         if(debug)
+         {
+            printf("DEBUG> run %d: %ld records\n", nrun, nrec);
+            fflush(stdout);
+         }
+
+         ++nrun;
+
+         nrec = 0;
+         used = 0;
+      }
+
+      if(size < 0)
+         break;
+
+
+      /* Add the record to the arena */
+
+      if(size > arenasize)
+      {
+         arenasize = size;
+
+         arena = (char *)realloc(arena, arenasize);
+
+         if(arena == (char *)NULL)
+         {
+            printf("[struct stat=\"ERROR\", msg=\"Cannot allocate memory for data\"]\n");
+            fflush(stdout);
+            exit(0);
+         }
+      }
+
+      rec = arena + used;
+
+      RECNO(rec)   = recno;
+      RECSIZE(rec) = size;
+
+      nalloc = RECHDR + nkey * sizeof(union SortKey);
+
+      for(i=0; i<nkey; ++i)
+      {
+         if(keytype[i] == STRING)
+         {
+            RECKEY(rec)[i].off = nalloc;
+
+            len = strlen(tval(keycol[i]));
+
+            memcpy(rec + nalloc, tval(keycol[i]), len + 1);
+
+            nalloc += len + 1;
+         }
+         else
+            RECKEY(rec)[i].num = atof(tval(keycol[i]));
+      }
+
+      RECLINE(rec) = nalloc;
+
+      strcpy(rec + nalloc, tbl_rec_string);
+
+      recs[nrec] = rec;
+
+      ++nrec;
+      ++recno;
+
+      used += size;
+
+      if(nrec >= maxrec)
+      {
+         maxrec += maxrec;
+
+         recs   = (char **)realloc(recs,   maxrec * sizeof(char *));
+         sorted = (char **)realloc(sorted, maxrec * sizeof(char *));
+
+         if(recs == (char **)NULL || sorted == (char **)NULL)
+         {
+            printf("[struct stat=\"ERROR\", msg=\"Cannot allocate memory for data\"]\n");
+            fflush(stdout);
+            exit(0);
+         }
+      }
+   }
+
+   if(recno == 0)
+   {
+      printf("[struct stat=\"ERROR\", msg=\"Table has no data records\"]\n");
+      fflush(stdout);
+      exit(0);
+   }
+
+   if(debug)
+   {
+      printf("DEBUG> %ld records read, %d runs\n", recno, nrun);
+      fflush(stdout);
+   }
+
+
+   /* Everything fit in memory: one parallel sort */
+
+   if(nrun == 0)
+   {
+      nslice = nthread;
+
+      if(nslice > MAXRUN)
+         nslice = MAXRUN;
+
+      if(nslice > nrec / 1024 + 1)
+         nslice = nrec / 1024 + 1;
+
+      for(i=0; i<nslice; ++i)
+      {
+         slice[i].rec = recs + nrec * i / nslice;
+         slice[i].n   = nrec * (i+1) / nslice - nrec * i / nslice;
+
+         pthread_create(&thread[i], NULL, extSortSlice, (void *)&slice[i]);
+      }
+
+      for(i=0; i<nslice; ++i)
+      {
+         pthread_join(thread[i], NULL);
+         pos[i] = 0;
+      }
+
+      for(n=0; n<nrec; ++n)
+      {
+         j = -1;
+
+         for(i=0; i<nslice; ++i)
+         {
+            if(pos[i] >= slice[i].n)
+               continue;
+
+            if(j < 0 || extCompare(slice[i].rec[pos[i]], slice[j].rec[pos[j]]) < 0)
+               j = i;
+         }
+
+         fprintf(fout, "%s\n", slice[j].rec[pos[j]] + RECLINE(slice[j].rec[pos[j]]));
+
+         ++pos[j];
+      }
+
+      free(arena);
+      free(recs);
+      free(sorted);
+
+      return (int)recno;
+   }
+
+
+   /* Otherwise, merge the runs (at all levels) */
+
+   free(arena);
+   free(recs);
+   free(sorted);
+
+   nrun = 0;
+
+   for(l=0; l<MAXLEVEL; ++l)
+   {
+      for(i=0; i<nlevel[l]; ++i)
+      {
+         allruns  [nrun] = runs  [l][i];
+         allrunbuf[nrun] = runbuf[l][i];
+
+         ++nrun;
+      }
+   }
+
+   extMerge(allruns, allrunbuf, nrun, fout, 1);
+
+   return (int)recno;
+}
+
+
+
+/*******************************************************************/
+/*                                                                 */
+/*  extCompare                                                     */
+/*                                                                 */
+/*  Compare two records on the sort keys, then on record number.   */
+/*                                                                 */
+/*******************************************************************/
+
+int extCompare(char *a, char *b)
+{
+   int    k, c;
+   double da, db;
+
+   for(k=0; k<nkey; ++k)
+   {
+      if(keytype[k] == STRING)
+         c = strcmp(a + RECKEY(a)[k].off, b + RECKEY(b)[k].off);
+      else
+      {
+         da = RECKEY(a)[k].num;
+         db = RECKEY(b)[k].num;
+
+         c = 0;
+
+              if(da < db) c = -1;
+         else if(da > db) c =  1;
+      }
+
+      if(c)
+         return c * keyflip[k];
+   }
+
+   if(RECNO(a) < RECNO(b))
+      return -1;
+
+   if(RECNO(a) > RECNO(b))
+      return 1;
+
+   return 0;
+}
+
+
+int extComparePtr(const void *a, const void *b)
+{
+   return extCompare(*(char **)a, *(char **)b);
+}
+
+
+void *extSortSlice(void *arg)
+{
+   struct SortSlice *slice;
+
+   slice = (struct SortSlice *)arg;
+
+   qsort(slice->rec, slice->n, sizeof(char *), extComparePtr);
+
+   return (void *)NULL;
+}
+
+
+
+/*******************************************************************/
+/*                                                                 */
+/*  extRunFile                                                     */
+/*                                                                 */
+/*  Scratch file for a run, next to the output (which is where     */
+/*  there should be room for a copy of the table).  It is          */
+/*  unlinked right away so it goes away when closed.  Its stdio    */
+/*  buffer ('bufsize' bytes, returned in 'buf' to be freed after   */
+/*  the file is closed) is set before any I/O is done.             */
+/*                                                                 */
+/*******************************************************************/
+
+FILE *extRunFile(char *outname, char **buf, long bufsize)
+{
+   static int irun = 0;
+
+   char  runname[1024];
+   FILE *fp;
+
+   sprintf(runname, "%.1000s.run%d", outname, irun);
+
+   ++irun;
+
+   fp = fopen(runname, "w+");
+
+   if(fp == (FILE *)NULL)
+   {
+      printf("[struct stat=\"ERROR\", msg=\"Cannot open sort run file\"]\n");
+      fflush(stdout);
+      exit(0);
+   }
+
+   unlink(runname);
+
+   *buf = (char *)malloc(bufsize);
+
+   if(*buf)
+      setvbuf(fp, *buf, _IOFBF, (size_t)bufsize);
+
+   return fp;
+}
+
+
+
+/*******************************************************************/
+/*                                                                 */
+/*  extReadRec                                                     */
+/*                                                                 */
+/*  Read the next record from a run.  Returns 0 at end of run.     */
+/*                                                                 */
+/*******************************************************************/
+
+int extReadRec(FILE *fp, char **buf, int *maxbuf)
+{
+   int size;
+
+   if(fread(*buf, RECHDR, 1, fp) != 1)
+      return 0;
+
+   size = RECSIZE(*buf);
+
+   if(size > *maxbuf)
+   {
+      *maxbuf = size;
+      *buf    = (char *)realloc(*buf, *maxbuf);
+
+      if(*buf == (char *)NULL)
+      {
+         printf("[struct stat=\"ERROR\", msg=\"Cannot allocate memory for data\"]\n");
+         fflush(stdout);
+         exit(0);
+      }
+   }
+
+   if(fread(*buf + RECHDR, size - RECHDR, 1, fp) != 1)
+   {
+      printf("[struct stat=\"ERROR\", msg=\"Error reading sort run file\"]\n");
+      fflush(stdout);
+      exit(0);
+   }
+
+   return 1;
+}
+
+
+
+/*******************************************************************/
+/*                                                                 */
+/*  extMerge                                                       */
+/*                                                                 */
+/*  K-way merge of the runs (through a heap of the current run     */
+/*  heads) either into the output table ('final') or into another  */
+/*  run file.  The runs are closed and their buffers freed.        */
+/*                                                                 */
+/*******************************************************************/
+
+void extMerge(FILE **runs, char **runbuf, int nrun, FILE *fout, int final)
+{
+   int    i, j, c, nheap, tmp;
+   int    heap  [MAXRUN];
+   int    maxbuf[MAXRUN];
+   char  *head  [MAXRUN];
+   char  *rec;
+
+   nheap = 0;
+
+   for(i=0; i<nrun; ++i)
+   {
+      maxbuf[i] = 4096;
+      head  [i] = (char *)malloc(maxbuf[i]);
+
+      if(!extReadRec(runs[i], &head[i], &maxbuf[i]))
+         continue;
+
+
+      /* Sift up */
+
+      j = nheap;
+
+      heap[nheap] = i;
+      ++nheap;
+
+      while(j > 0 && extCompare(head[heap[j]], head[heap[(j-1)/2]]) < 0)
+      {
+         tmp             = heap[j];
+         heap[j]         = heap[(j-1)/2];
+         heap[(j-1)/2]   = tmp;
+
+         j = (j-1)/2;
+      }
+   }
+
+   while(nheap > 0)
+   {
+      i   = heap[0];
+      rec = head[i];
+
+      if(final)
+         fprintf(fout, "%s\n", rec + RECLINE(rec));
+
+      else if(fwrite(rec, RECSIZE(rec), 1, fout) != 1)
+      {
+         printf("[struct stat=\"ERROR\", msg=\"Error writing sort run file\"]\n");
+         fflush(stdout);
+         exit(0);
+      }
+
+      if(!extReadRec(runs[i], &head[i], &maxbuf[i]))
+      {
+         --nheap;
+         heap[0] = heap[nheap];
+      }
+
+
+      /* Sift down */
+
+      j = 0;
+
+      while(1)
+      {
+         c = 2*j + 1;
+
+         if(c >= nheap)
+            break;
+
+         if(c+1 < nheap && extCompare(head[heap[c+1]], head[heap[c]]) < 0)
+            ++c;
+
+         if(extCompare(head[heap[c]], head[heap[j]]) >= 0)
+            break;
+
+         tmp     = heap[j];
+         heap[j] = heap[c];
+         heap[c] = tmp;
+
+         j = c;
+      }
+   }
+
+   for(i=0; i<nrun; ++i)
+   {
+      fclose(runs[i]);
+
+      free(runbuf[i]);
+      free(head  [i]);
+   }
+}
@@ -49,7 +49,7 @@ int main(int argc, char **argv)
 
    montage_status = stdout;
 
-   while ((c = getopt(argc, argv, "enp:s:d:a:")) != EOF) 
+   while ((c = getopt(argc, argv, "enp:s:d:a:FC:")) != EOF) 
    {
       switch (c) 
       {
@@ -109,6 +109,30 @@ int main(int argc, char **argv)
             break;
 
 
+         /****************************************/
+         /* Single precision (BITPIX -32) output */
+         /****************************************/
+
+         case 'F':
+
+            montage_setBitpix(-32);
+            break;
+
+
+         /****************************/
+         /* Tile-compressed output   */
+         /****************************/
+
+         case 'C':
+
+            if(montage_setCompress(optarg))
+            {
+               printf("[struct stat=\"ERROR\", msg=\"Invalid compression (%s); use rice, gzip or none, optionally followed by :qlevel\"]\n", optarg);
+               exit(1);
+            }
+            break;
+
+
          /*************************/
          /* Get path to image dir */
          /*************************/
@@ -139,7 +163,7 @@ int main(int argc, char **argv)
 
          default:
 
-             printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-d level] [-p imgdir] [-n(o-areas)] [-a mean|median|count] [-e(xact-size)] [-s statusfile] images.tbl template.hdr out.fits\"]\n", argv[0]);
+             printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-d level] [-p imgdir] [-n(o-areas)] [-a mean|median|count] [-e(xact-size)] [-F(loat-output)] [-C rice|gzip[:qlevel]] [-s statusfile] images.tbl template.hdr out.fits\"]\n", argv[0]);
              exit(1);
              break;
       }
@@ -152,7 +176,7 @@ int main(int argc, char **argv)
 
    if (argc - optind < 3) 
    {
-      printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-d level] [-p imgdir] [-n(o-areas)] [-a mean|median|count] [-e(xact-size)] [-s statusfile] images.tbl template.hdr out.fits\"]\n", argv[0]);
+      printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-d level] [-p imgdir] [-n(o-areas)] [-a mean|median|count] [-e(xact-size)] [-F(loat-output)] [-C rice|gzip[:qlevel]] [-s statusfile] images.tbl template.hdr out.fits\"]\n", argv[0]);
       exit(1);
    }
 
@@ -187,11 +187,12 @@ static int listMax;
 
 struct fileinfo
 {
-   int       isopen;
-   fitsfile *fptr;
-   int       start;
-   int       offset;
-   int       end;
+   int            isopen;
+   fitsfile      *fptr;
+   struct mImage *image;
+   int            start;
+   int            offset;
+   int            end;
 };
 
 static struct fileinfo *input, *input_area;
@@ -208,8 +209,22 @@ struct outfile
 static struct outfile output, output_area;
 
 
+/*****************************************************/
+/* Images in memory (mAddMem() rather than mAdd())   */
+/*****************************************************/
+
+static int             inMemory;
+static char           *templateHdr;
+static int             nInput;
+static struct mImage **inImage, **inArea;
+static struct mImage  *outImage, *outArea;
+
+
 static char montage_msgstr[1024];
 
+static struct mAddReturn *mAdd_run(char *path, char *tblfile, char *template_file, char *outfile,
+                                   int shrink, int haveAreas, int coadd, int debugin);
+
 
 /*-***********************************************************************/
 /*                                                                       */
@@ -245,9 +260,97 @@ static char montage_msgstr[1024];
 
 struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *outfile,
                         int shrink, int haveAreas, int coadd, int debugin)
+{
+   inMemory    = 0;
+   templateHdr = (char *)NULL;
+
+   outImage = (struct mImage *)NULL;
+   outArea  = (struct mImage *)NULL;
+
+   return mAdd_run(path, tblfile, template_file, outfile, shrink, haveAreas, coadd, debugin);
+}
+
+
+
+/*-***********************************************************************/
+/*                                                                       */
+/*  mAddMem                                                              */
+/*                                                                       */
+/*  The same, for images in memory.  Instead of a table, the inputs are  */
+/*  an array of images (whose headers give what the table would); their  */
+/*  pixels are read in place.  The mosaic (and its area image, if asked  */
+/*  for) is returned in memory, to be freed with montage_imageFree().    */
+/*  The template is a header string.  Areas are used only if an area     */
+/*  image is given for every input.                                      */
+/*                                                                       */
+/*   int             nimage        Number of input images                */
+/*   struct mImage **input         Input (reprojected) images            */
+/*   struct mImage **inarea        Their area images (or NULL)           */
+/*   char           *template_hdr  Output header template                */
+/*   struct mImage **output        Returned mosaic                       */
+/*   struct mImage **area          Returned area image (or NULL)         */
+/*                                                                       */
+/*   int    shrink         Shrink-wrap to remove blank border areas      */
+/*   int    coadd          Image stacking: 0 (MEAN), 1 (MEDIAN)          */
+/*                         2 (COUNT)                                     */
+/*   int    debug          Debugging output level                        */
+/*                                                                       */
+/*************************************************************************/
+
+struct mAddReturn *mAddMem(int nimage, struct mImage **input_image, struct mImage **input_area_image,
+                           char *template_hdr, struct mImage **outimage, struct mImage **outarea,
+                           int shrink, int coadd, int debugin)
+{
+   int i, haveAreas;
+
+   struct mAddReturn *returnStruct;
+
+   haveAreas = (input_area_image != (struct mImage **)NULL);
+
+   for(i=0; i<nimage && haveAreas; ++i)
+      if(input_area_image[i] == (struct mImage *)NULL)
+         haveAreas = 0;
+
+   inMemory    = 1;
+   templateHdr = template_hdr;
+
+   nInput  = nimage;
+   inImage = input_image;
+   inArea  = input_area_image;
+
+   outImage = (struct mImage *)NULL;
+   outArea  = (struct mImage *)NULL;
+
+   returnStruct = mAdd_run("", "(memory)", "(memory)", "(memory)", shrink, haveAreas, coadd, debugin);
+
+   if(returnStruct->status)
+   {
+      montage_imageFree(outImage);
+      montage_imageFree(outArea);
+
+      outImage = (struct mImage *)NULL;
+      outArea  = (struct mImage *)NULL;
+   }
+
+   *outimage = outImage;
+
+   if(outarea)
+      *outarea = outArea;
+   else
+      montage_imageFree(outArea);
+
+   return returnStruct;
+}
+
+
+
+/* The coaddition, for files or (inMemory) images in memory */
+
+static struct mAddReturn *mAdd_run(char *path, char *tblfile, char *template_file, char *outfile,
+                                   int shrink, int haveAreas, int coadd, int debugin)
 {
    int       i, j, ncols, namelen, imgcount;
-   int       lineout, itemp, pixdepth, ipix, jcnt;
+   int       lineout, itemp, pixdepth, ipix, jcnt, iout;
    int       inbuflen;
    int       currentstart, currentend;
    int       showwarning = 0;
@@ -271,8 +374,16 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
    double    imin, imax;
    double    jmin, jmax;
 
+   int       floatstack;
+
    double  **dataline;
    double  **arealine;
+   float   **fdataline;
+   float   **farealine;
+   double   *stackdata;
+   double   *stackarea;
+   double   *pixdata;
+   double   *pixarea;
    int      *datacount;
    double   *input_buffer;
    double   *input_buffer_area;
@@ -311,6 +422,9 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
 
    double    valOffset;
 
+   fitsfile         *fptr;
+   struct WorldCoor *wcs;
+
    struct mAddReturn *returnStruct;
 
 
@@ -364,6 +478,8 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
    time(&currtime);
    start = currtime;
 
+   montage_statsStart("mAdd");
+
    debug = debugin;
 
 
@@ -373,7 +489,10 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
 
    strcpy(output_file, outfile);
 
-   checkHdr = montage_checkHdr(template_file, 1, 0);
+   checkHdr = (char *)NULL;
+
+   if(!inMemory)
+      checkHdr = montage_checkHdr(template_file, 1, 0);
 
    if(checkHdr)
    {
@@ -431,62 +550,69 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
    /*****************************/ 
    /* Open the image list table */
    /* to get metadata for input */
-   /* files                     */
+   /* files (images in memory   */
+   /* have it in their headers) */
    /*****************************/ 
 
-   ncols = topen(tblfile);
+   if(inMemory)
+      namelen = 64;
 
-   if(ncols <= 0)
+   else
    {
-      sprintf(returnStruct->msg, "Invalid image metadata file: %s", tblfile);
-      return returnStruct;
-   }
+      ncols = topen(tblfile);
 
+      if(ncols <= 0)
+      {
+         sprintf(returnStruct->msg, "Invalid image metadata file: %s", tblfile);
+         return returnStruct;
+      }
 
-   /**************************/
-   /* Get indices of columns */
-   /**************************/
 
-   icntr   = tcol("cntr");
-   ifname  = tcol("fname");
-   ictype1 = tcol("ctype1");
-   ictype2 = tcol("ctype2");
-   icdelt1 = tcol("cdelt1");
-   icdelt2 = tcol("cdelt2");
-   icrval1 = tcol("crval1");
-   icrval2 = tcol("crval2");
-   icrpix1 = tcol("crpix1");
-   icrpix2 = tcol("crpix2");
-   inaxis1 = tcol("naxis1");
-   inaxis2 = tcol("naxis2");
+      /**************************/
+      /* Get indices of columns */
+      /**************************/
 
-   namelen = strlen(path) + tbl_rec[ifname].colwd + 16;
+      icntr   = tcol("cntr");
+      ifname  = tcol("fname");
+      ictype1 = tcol("ctype1");
+      ictype2 = tcol("ctype2");
+      icdelt1 = tcol("cdelt1");
+      icdelt2 = tcol("cdelt2");
+      icrval1 = tcol("crval1");
+      icrval2 = tcol("crval2");
+      icrpix1 = tcol("crpix1");
+      icrpix2 = tcol("crpix2");
+      inaxis1 = tcol("naxis1");
+      inaxis2 = tcol("naxis2");
 
+      namelen = strlen(path) + tbl_rec[ifname].colwd + 16;
 
-   /***********************************/
-   /* Look for alternate column names */
-   /***********************************/
 
-   if(ifname < 0)
-      ifname = tcol( "file");
+      /***********************************/
+      /* Look for alternate column names */
+      /***********************************/
 
-   if (inaxis1 < 0)
-     inaxis1 = tcol("ns");
+      if(ifname < 0)
+         ifname = tcol( "file");
 
-   if (inaxis2 < 0)
-     inaxis2 = tcol("nl");
+      if (inaxis1 < 0)
+        inaxis1 = tcol("ns");
 
+      if (inaxis2 < 0)
+        inaxis2 = tcol("nl");
 
-   /**************************************/
-   /* Were all required columns present? */
-   /**************************************/
 
-   if(icntr   < 0 || ifname  < 0 || icdelt1 < 0 || icdelt2 < 0 || icrpix1 < 0 
-   || icrpix2 < 0 || inaxis1 < 0 || inaxis2 < 0 || icrval1 < 0 || icrval2 < 0
-   || ictype1 < 0 || ictype2 < 0)
-   {
-      sprintf(returnStruct->msg, "Need columns: cntr,fname, crpix1, crpix2, cdelt1, cdelt2, naxis1, naxis2, crval1, crval2 ctype1, ctype2 in image list");
-      return returnStruct;
+      /**************************************/
+      /* Were all required columns present? */
+      /**************************************/
+
+      if(icntr   < 0 || ifname  < 0 || icdelt1 < 0 || icdelt2 < 0 || icrpix1 < 0 
+      || icrpix2 < 0 || inaxis1 < 0 || inaxis2 < 0 || icrval1 < 0 || icrval2 < 0
+      || ictype1 < 0 || ictype2 < 0)
+      {
+         sprintf(returnStruct->msg, "Need columns: cntr,fname, crpix1, crpix2, cdelt1, cdelt2, naxis1, naxis2, crval1, crval2 ctype1, ctype2 in image list");
+         return returnStruct;
+      }
    }
 
 
@@ -536,24 +662,72 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
 
    while(1)
    {
-      status = tread();
+      if(inMemory)
+      {
+         if(nfile == nInput)
+            break;
 
-      if(status < 0)
-         break;
+         status = 0;
 
-      cntr[nfile] = atoi(tval(icntr));
+         montage_memOpen(&fptr, inImage[nfile], &status);
 
-      incdelt1[nfile] = atof(tval(icdelt1));
-      incdelt2[nfile] = atof(tval(icdelt2));
-      incrval1[nfile] = atof(tval(icrval1));
-      incrval2[nfile] = atof(tval(icrval2));
-      incrpix1[nfile] = atof(tval(icrpix1));
-      incrpix2[nfile] = atof(tval(icrpix2));
-      innaxis1[nfile] = atoi(tval(inaxis1));
-      innaxis2[nfile] = atoi(tval(inaxis2));
+         montage_imageHdr(fptr, &inputHeader, &status);
 
-      strcpy(inctype1[nfile], tval(ictype1));
-      strcpy(inctype2[nfile], tval(ictype2));
+         montage_closeInput(fptr, inImage[nfile], &status);
+
+         if(status)
+         {
+            sprintf(returnStruct->msg, "Cannot read header of input image %d", nfile);
+            return returnStruct;
+         }
+
+         wcs = wcsinit(inputHeader);
+
+         free(inputHeader);
+
+         if(wcs == (struct WorldCoor *)NULL)
+         {
+            sprintf(returnStruct->msg, "Input image %d has invalid WCS", nfile);
+            return returnStruct;
+         }
+
+         cntr[nfile] = nfile;
+
+         incdelt1[nfile] = wcs->xinc;
+         incdelt2[nfile] = wcs->yinc;
+         incrval1[nfile] = wcs->xref;
+         incrval2[nfile] = wcs->yref;
+         incrpix1[nfile] = wcs->xrefpix;
+         incrpix2[nfile] = wcs->yrefpix;
+         innaxis1[nfile] = wcs->nxpix;
+         innaxis2[nfile] = wcs->nypix;
+
+         strcpy(inctype1[nfile], wcs->ctype[0]);
+         strcpy(inctype2[nfile], wcs->ctype[1]);
+
+         wcsfree(wcs);
+      }
+      else
+      {
+         status = tread();
+
+         if(status < 0)
+            break;
+
+         cntr[nfile] = atoi(tval(icntr));
+
+         incdelt1[nfile] = atof(tval(icdelt1));
+         incdelt2[nfile] = atof(tval(icdelt2));
+         incrval1[nfile] = atof(tval(icrval1));
+         incrval2[nfile] = atof(tval(icrval2));
+         incrpix1[nfile] = atof(tval(icrpix1));
+         incrpix2[nfile] = atof(tval(icrpix2));
+         innaxis1[nfile] = atoi(tval(inaxis1));
+         innaxis2[nfile] = atoi(tval(inaxis2));
+
+         strcpy(inctype1[nfile], tval(ictype1));
+         strcpy(inctype2[nfile], tval(ictype2));
+      }
 
 
       /********************************/
@@ -622,7 +796,10 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
 
       /* Get filename */
 
-      strcpy(filename, montage_filePath(path, tval(ifname)));
+      if(inMemory)
+         sprintf(filename, "(memory %d).fits", nfile);
+      else
+         strcpy(filename, montage_filePath(path, tval(ifname)));
 
 
       /* Need to build _area filenames if we have area images */
@@ -684,7 +861,8 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
       }
    }
 
-   tclose();
+   if(!inMemory)
+      tclose();
 
    if(debug >= 3)
    {
@@ -929,9 +1107,13 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
       /**************************************/
 
       input[ifile].isopen = 0;
+      input[ifile].image  = inMemory ? inImage[ifile] : (struct mImage *)NULL;
 
       if (haveAreas)
+      {
          input_area[ifile].isopen = 0;
+         input_area[ifile].image  = inMemory ? inArea[ifile] : (struct mImage *)NULL;
+      }
    }
 
 
@@ -1032,51 +1214,102 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
    /*************************************************************/ 
    /* Allocate memory for pixdepth lines of output image pixels */ 
    /* We will modify pixel depth dynamically if need be         */ 
+   /*                                                           */ 
+   /* These stacks are most of mAdd's memory.  When the output  */ 
+   /* is single precision (BITPIX -32) they hold float values;  */ 
+   /* each stack is copied to double for the averaging.         */ 
    /*************************************************************/ 
 
    pixdepth = PIXDEPTH;
 
-   dataline = (double **)malloc(output.naxes[0] * sizeof(double *));
+   floatstack = (montage_outBitpix() == -32);
 
-   if(!dataline)
-   {
-      mAdd_allocError("data line pointers");
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
+   dataline  = (double **)NULL;
+   arealine  = (double **)NULL;
+   fdataline = (float  **)NULL;
+   farealine = (float  **)NULL;
+   stackdata = (double  *)NULL;
+   stackarea = (double  *)NULL;
 
-   for (i = 0; i < output.naxes[0]; ++i)
+   if(floatstack)
    {
-      dataline[i] = (double *)malloc(pixdepth * sizeof(double));
+      fdataline = (float **)malloc(output.naxes[0] * sizeof(float *));
+      farealine = (float **)malloc(output.naxes[0] * sizeof(float *));
 
-      if(!dataline[i])
+      if(!fdataline || !farealine)
       {
-         mAdd_allocError("data line");
+         mAdd_allocError("data line pointers");
          strcpy(returnStruct->msg, montage_msgstr);
          return returnStruct;
       }
-   }
 
+      for (i = 0; i < output.naxes[0]; ++i)
+      {
+         fdataline[i] = (float *)malloc(pixdepth * sizeof(float));
+         farealine[i] = (float *)malloc(pixdepth * sizeof(float));
+
+         if(!fdataline[i] || !farealine[i])
+         {
+            mAdd_allocError("data line");
+            strcpy(returnStruct->msg, montage_msgstr);
+            return returnStruct;
+         }
+      }
 
-   arealine = (double **)malloc(output.naxes[0] * sizeof(double *));
+      stackdata = (double *)malloc(pixdepth * sizeof(double));
+      stackarea = (double *)malloc(pixdepth * sizeof(double));
 
-   if(!arealine)
-   {
-      mAdd_allocError("area line pointers");
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
+      if(!stackdata || !stackarea)
+      {
+         mAdd_allocError("pixel stack");
+         strcpy(returnStruct->msg, montage_msgstr);
+         return returnStruct;
+      }
    }
-
-   for (i = 0; i < output.naxes[0]; ++i)
+   else
    {
-      arealine[i] = (double *)malloc(pixdepth * sizeof(double));
+      dataline = (double **)malloc(output.naxes[0] * sizeof(double *));
+
+      if(!dataline)
+      {
+         mAdd_allocError("data line pointers");
+         strcpy(returnStruct->msg, montage_msgstr);
+         return returnStruct;
+      }
+
+      for (i = 0; i < output.naxes[0]; ++i)
+      {
+         dataline[i] = (double *)malloc(pixdepth * sizeof(double));
+
+         if(!dataline[i])
+         {
+            mAdd_allocError("data line");
+            strcpy(returnStruct->msg, montage_msgstr);
+            return returnStruct;
+         }
+      }
+
 
-      if(!arealine[i])
+      arealine = (double **)malloc(output.naxes[0] * sizeof(double *));
+
+      if(!arealine)
       {
-         mAdd_allocError("area line");
+         mAdd_allocError("area line pointers");
          strcpy(returnStruct->msg, montage_msgstr);
          return returnStruct;
       }
+
+      for (i = 0; i < output.naxes[0]; ++i)
+      {
+         arealine[i] = (double *)malloc(pixdepth * sizeof(double));
+
+         if(!arealine[i])
+         {
+            mAdd_allocError("area line");
+            strcpy(returnStruct->msg, montage_msgstr);
+            return returnStruct;
+         }
+      }
    }
 
    datacount = (int *)malloc(output.naxes[0] * sizeof(int));
@@ -1130,8 +1363,11 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
    /* Delete pre-existing output files */
    /************************************/
 
-   remove(output_file);               
-   remove(output_area_file);               
+   if(!inMemory)
+   {
+      remove(output_file);               
+      remove(output_area_file);               
+   }
  
 
    /***********************/
@@ -1139,7 +1375,7 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
    /***********************/
 
    status = 0;
-   if(fits_create_file(&output.fptr, output_file, &status)) 
+   if(fits_create_file(&output.fptr, inMemory ? "mem://" : montage_outName(output_file), &status)) 
    {
       mAdd_printFitsError(status);           
       strcpy(returnStruct->msg, montage_msgstr);
@@ -1147,7 +1383,7 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
    }
 
    status = 0;
-   if(fits_create_file(&output_area.fptr, output_area_file, &status)) 
+   if(fits_create_file(&output_area.fptr, inMemory ? "mem://" : montage_outName(output_area_file), &status)) 
    {
       mAdd_printFitsError(status);           
       strcpy(returnStruct->msg, montage_msgstr);
@@ -1160,9 +1396,12 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
 
    /*********************************************************/
    /* Create the FITS image.  All the required keywords are */
-   /* handled automatically.                                */
+   /* handled automatically.  The output is double unless   */
+   /* single precision (BITPIX -32) has been requested.     */
    /*********************************************************/
 
+   bitpix = montage_outBitpix();
+
    status = 0;
    if (fits_create_img(output.fptr, bitpix, naxis, output.naxes, &status))
    {
@@ -1205,7 +1444,7 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
    /****************************************/
 
    status = 0;
-   if(fits_write_key_template(output.fptr, template_file, &status))
+   if(montage_writeTemplate(output.fptr, template_file, templateHdr, &status))
    {
       mAdd_printFitsError(status);           
       strcpy(returnStruct->msg, montage_msgstr);
@@ -1219,7 +1458,7 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
    }
 
    status = 0;
-   if(fits_write_key_template(output_area.fptr, template_file, &status))
+   if(montage_writeTemplate(output_area.fptr, template_file, templateHdr, &status))
    {
       mAdd_printFitsError(status);           
       strcpy(returnStruct->msg, montage_msgstr);
@@ -1233,12 +1472,12 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
    }
 
 
-   /**********************************/
-   /* Modify BITPIX to be DOUBLE_IMG */
-   /**********************************/
+   /*************************************************/
+   /* Modify BITPIX to be DOUBLE_IMG (or FLOAT_IMG) */
+   /*************************************************/
 
    status = 0;
-   if(fits_update_key_lng(output.fptr, "BITPIX", DOUBLE_IMG,
+   if(fits_update_key_lng(output.fptr, "BITPIX", bitpix,
                                   (char *)NULL, &status))
    {
       mAdd_printFitsError(status);           
@@ -1247,7 +1486,7 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
    }
 
    status = 0;
-   if(fits_update_key_lng(output_area.fptr, "BITPIX", DOUBLE_IMG,
+   if(fits_update_key_lng(output_area.fptr, "BITPIX", bitpix,
                                   (char *)NULL, &status))
    {
       mAdd_printFitsError(status);           
@@ -1366,6 +1605,33 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
    }
 
 
+   /************************************************/
+   /* If the output is to be tile-compressed, the  */
+   /* headers so far are in memory; now create the */
+   /* real files.                                  */
+   /************************************************/
+
+   status = 0;
+
+   if(inMemory)
+   {
+      montage_memOutput(output.fptr,      &outImage, &status);
+      montage_memOutput(output_area.fptr, &outArea,  &status);
+   }
+   else
+   {
+      montage_compressImage(&output.fptr,      output_file,      &status);
+      montage_compressArea (&output_area.fptr, output_area_file, &status);
+   }
+
+   if(status)
+   {
+      mAdd_printFitsError(status);
+      strcpy(returnStruct->msg, montage_msgstr);
+      return returnStruct;
+   }
+
+
    /********************************************/
    /* Build/write one line of output at a time */
    /********************************************/
@@ -1435,7 +1701,7 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
          if(input[ifile].isopen)
          {
             status = 0;
-            if(fits_close_file(input[ifile].fptr, &status))
+            if(montage_closeInput(input[ifile].fptr, input[ifile].image, &status))
             {
                mAdd_printFitsError(status);           
                strcpy(returnStruct->msg, montage_msgstr);
@@ -1451,7 +1717,7 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
          && input_area[ifile].isopen)
          {
             status = 0;
-            if(fits_close_file(input_area[ifile].fptr, &status))
+            if(montage_closeInput(input_area[ifile].fptr, input_area[ifile].image, &status))
             {
                mAdd_printFitsError(status);           
                strcpy(returnStruct->msg, montage_msgstr);
@@ -1505,7 +1771,13 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
             }
  
             status = 0;
-            if(fits_open_file(&input[ifile].fptr, infile[ifile], READONLY, &status))
+
+            if(input[ifile].image)
+               montage_memOpen(&input[ifile].fptr, input[ifile].image, &status);
+            else
+               fits_open_image(&input[ifile].fptr, infile[ifile], READONLY, &status);
+
+            if(status)
             {
                sprintf(errstr, "Image file %s missing or invalid FITS", infile[ifile]);
                 
@@ -1535,7 +1807,13 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
                }
 
                status = 0;
-               if(fits_open_file(&input_area[ifile].fptr, inarea[ifile], READONLY, &status))
+
+               if(input_area[ifile].image)
+                  montage_memOpen(&input_area[ifile].fptr, input_area[ifile].image, &status);
+               else
+                  fits_open_image(&input_area[ifile].fptr, inarea[ifile], READONLY, &status);
+
+               if(status)
                {
                   sprintf(errstr, "Area file %s missing or invalid FITS", inarea[ifile]);
                   mAdd_printError(errstr);
@@ -1549,7 +1827,7 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
             /* the one for the header template  */
 
             status = 0;
-            if(fits_get_image_wcs_keys(input[ifile].fptr, &inputHeader, &status))
+            if(montage_imageHdr(input[ifile].fptr, &inputHeader, &status))
             {
                mAdd_printFitsError(status);
                strcpy(returnStruct->msg, montage_msgstr);
@@ -1640,8 +1918,10 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
             /* Read the line */
             /*****************/
 
+            montage_phaseBegin("read");
+
             status = 0;
-            if(fits_read_pix(input[ifile].fptr, TDOUBLE, fpixel, nelements, &nan,
+            if(montage_readPix(input[ifile].fptr, input[ifile].image, TDOUBLE, fpixel, nelements, &nan,
                                input_buffer, &nullcnt, &status))
             {
               mAdd_printFitsError(status);
@@ -1649,16 +1929,20 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
               return returnStruct;
             }
 
+            montage_countRead(input[ifile].fptr, nelements);
+
             if(haveAreas)
             {
                status = 0;
-               if(fits_read_pix(input_area[ifile].fptr, TDOUBLE, fpixel, nelements, &nan,
+               if(montage_readPix(input_area[ifile].fptr, input_area[ifile].image, TDOUBLE, fpixel, nelements, &nan,
                                   input_buffer_area, &nullcnt, &status))
                {
                  mAdd_printFitsError(status);
                  strcpy(returnStruct->msg, montage_msgstr);
                  return returnStruct;
                }
+
+               montage_countRead(input_area[ifile].fptr, nelements);
             }
             else
             {
@@ -1666,11 +1950,17 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
                   input_buffer_area[i] = 1.000;
             }
 
+            montage_phaseEnd("read");
+
+            montage_countPixels(nelements);
+
 
             /**********************/
             /* Process the pixels */
             /**********************/
 
+            montage_phaseBegin("stack");
+
             for (i = 0; i<nelements; ++i)
             {
                /***********************************/
@@ -1707,22 +1997,41 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
                      fflush(stdout);
                   }
 
-                  for (i=0; i<output.naxes[0]; ++i)
+                  for (iout=0; iout<output.naxes[0]; ++iout)
                   {
-                     dataline[i] = (double *)realloc(dataline[i],
+                     if(floatstack)
+                     {
+                        fdataline[iout] = (float *)realloc(fdataline[iout],
+                           pixdepth * sizeof(float));
+
+                        farealine[iout] = (float *)realloc(farealine[iout],
+                           pixdepth * sizeof(float));
+
+                        if(fdataline[iout] == (float *)NULL
+                        || farealine[iout] == (float *)NULL)
+                        {
+                           mAdd_allocError("data line (realloc)");
+                           strcpy(returnStruct->msg, montage_msgstr);
+                           return returnStruct;
+                        }
+
+                        continue;
+                     }
+
+                     dataline[iout] = (double *)realloc(dataline[iout],
                         pixdepth * sizeof(double));
 
-                     if(dataline[i] == (double *)NULL)
+                     if(dataline[iout] == (double *)NULL)
                      {
                         mAdd_allocError("data line (realloc)");
                         strcpy(returnStruct->msg, montage_msgstr);
                         return returnStruct;
                      }
 
-                     arealine[i] = (double *)realloc(arealine[i],
+                     arealine[iout] = (double *)realloc(arealine[iout],
                         pixdepth * sizeof(double));
 
-                     if(arealine[i] == (double *)NULL)
+                     if(arealine[iout] == (double *)NULL)
                      {
                         mAdd_allocError("area line (realloc)");
                         strcpy(returnStruct->msg, montage_msgstr);
@@ -1730,18 +2039,42 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
                      }
                   }
 
+                  if(floatstack)
+                  {
+                     stackdata = (double *)realloc(stackdata, pixdepth * sizeof(double));
+                     stackarea = (double *)realloc(stackarea, pixdepth * sizeof(double));
+
+                     if(!stackdata || !stackarea)
+                     {
+                        mAdd_allocError("pixel stack (realloc)");
+                        strcpy(returnStruct->msg, montage_msgstr);
+                        return returnStruct;
+                     }
+                  }
+
                   if(debug >= 1)
                   {
                      printf("Memory reallocation complete\n");
                      fflush(stdout);
                   }
                }
-               dataline[ipix][jcnt] = input_buffer[i];
+               if(floatstack)
+               {
+                  fdataline[ipix][jcnt] = input_buffer[i];
 
-               arealine[ipix][jcnt] = input_buffer_area[i];
+                  farealine[ipix][jcnt] = input_buffer_area[i];
+               }
+               else
+               {
+                  dataline[ipix][jcnt] = input_buffer[i];
+
+                  arealine[ipix][jcnt] = input_buffer_area[i];
+               }
 
                ++datacount[ipix];
             }
+
+            montage_phaseEnd("stack");
          }
          else
          {
@@ -1777,7 +2110,7 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
          if (open_files >= MAXFITS) 
          {
             status = 0;
-            if(fits_close_file(input[ifile].fptr, &status))
+            if(montage_closeInput(input[ifile].fptr, input[ifile].image, &status))
             {
                mAdd_printFitsError(status);           
                strcpy(returnStruct->msg, montage_msgstr);
@@ -1797,7 +2130,7 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
             if(haveAreas)
             {
                status = 0;
-               if(fits_close_file(input_area[ifile].fptr, &status))
+               if(montage_closeInput(input_area[ifile].fptr, input_area[ifile].image, &status))
                {
                   mAdd_printFitsError(status);           
                   strcpy(returnStruct->msg, montage_msgstr);
@@ -1818,6 +2151,8 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
       /* Now to average each pixel and prepare the output pixels:    */
       /***************************************************************/
 
+      montage_phaseBegin("coadd");
+
       for (i = 0; i<output.naxes[0]; ++i)
       {
          outdataline[i] = 0;
@@ -1834,16 +2169,33 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
 
          if(datacount[i] > 0)
          {
+            if(floatstack)
+            {
+               for(j=0; j<datacount[i]; ++j)
+               {
+                  stackdata[j] = fdataline[i][j];
+                  stackarea[j] = farealine[i][j];
+               }
+
+               pixdata = stackdata;
+               pixarea = stackarea;
+            }
+            else
+            {
+               pixdata = dataline[i];
+               pixarea = arealine[i];
+            }
+
             if (coadd == MEAN)
-               avg_status = mAdd_avg_mean(dataline[i], arealine[i], 
+               avg_status = mAdd_avg_mean(pixdata, pixarea, 
                   &outdataline[i], &outarealine[i], datacount[i]);
 
             else if (coadd == MEDIAN)
-               avg_status = mAdd_avg_median(dataline[i], arealine[i], 
+               avg_status = mAdd_avg_median(pixdata, pixarea, 
                   &outdataline[i], &outarealine[i], datacount[i], nominal_area);
 
             else if (coadd == COUNT)
-               avg_status = mAdd_avg_count(dataline[i], arealine[i], 
+               avg_status = mAdd_avg_count(pixdata, pixarea, 
                   &outdataline[i], &outarealine[i], datacount[i]);
 
             if (avg_status)
@@ -1866,6 +2218,9 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
       /* nothing overlapped it.               */
       /* Write this line to output FITS files */   
       /****************************************/
+
+      montage_phaseEnd("coadd");
+      montage_phaseBegin("write");
     
       fpixel[0] = 1;
       fpixel[1] = lineout; 
@@ -1874,22 +2229,28 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
       nelements = output.naxes[0];
 
       status = 0;
-      if (fits_write_pix(output.fptr, TDOUBLE, fpixel, nelements,
-                         (void *)(&outdataline[0]), &status))
+      if (montage_putPix(output.fptr, outImage, TDOUBLE, fpixel, nelements,
+                           (void *)(&outdataline[0]), &status))
       {
          mAdd_printFitsError(status);
          strcpy(returnStruct->msg, montage_msgstr);
          return returnStruct;
       }
 
+      montage_countWrite(output.fptr, nelements);
+
       status = 0;
-      if (fits_write_pix(output_area.fptr, TDOUBLE, fpixel, nelements,
-                         (void *)(&outarealine[0]), &status))
+      if (montage_putPix(output_area.fptr, outArea, TDOUBLE, fpixel, nelements,
+                           (void *)(&outarealine[0]), &status))
       {
          mAdd_printFitsError(status);
          strcpy(returnStruct->msg, montage_msgstr);
          return returnStruct;
       }
+
+      montage_countWrite(output_area.fptr, nelements);
+
+      montage_phaseEnd("write");
    }
 
 
@@ -1897,8 +2258,10 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
    /* Close the output FITS files */
    /*******************************/
 
+   montage_phaseBegin("write");
+
    status = 0;
-   if(fits_close_file(output.fptr, &status))
+   if(montage_closeOutput(output.fptr, outImage, &status))
    {
       mAdd_printFitsError(status);           
       strcpy(returnStruct->msg, montage_msgstr);
@@ -1906,7 +2269,7 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
    }
 
    status = 0;
-   if(fits_close_file(output_area.fptr, &status))
+   if(montage_closeOutput(output_area.fptr, outArea, &status))
    {
       mAdd_printFitsError(status);           
       strcpy(returnStruct->msg, montage_msgstr);
@@ -1919,12 +2282,14 @@ struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *ou
       fflush(stdout);
    }
 
+   montage_phaseEnd("write");
+
    time(&currtime);
 
    returnStruct->status = 0;
 
-   sprintf(returnStruct->msg,    "time=%.0f",    (double)(currtime - start)); 
-   sprintf(returnStruct->json, "{\"time\":%.1f}", (double)(currtime - start));
+   sprintf(returnStruct->msg,    "time=%.0f",        (double)(currtime - start)); 
+   sprintf(returnStruct->json, "{\"time\":%.1f, %s}", (double)(currtime - start), montage_statsEnd());
 
    returnStruct->time = (double)(currtime - start);
 
@@ -1951,7 +2316,10 @@ int mAdd_readTemplate(char *filename)
    /* Open the template file, read and parse all the lines */
    /********************************************************/
 
-   fp = fopen(filename, "r");
+   if(templateHdr)
+      fp = montage_memText(templateHdr);
+   else
+      fp = fopen(filename, "r");
 
    if(fp == (FILE *)NULL)
       mAdd_printError("Template file not found.");
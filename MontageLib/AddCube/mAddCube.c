@@ -30,6 +30,8 @@ int main(int argc, char **argv)
    int  haveAreas = 1;
    int  coadd     = MEAN;
 
+   char *end;
+
    char path    [MAXSTR];
    char tblfile [MAXSTR];
    char template[MAXSTR];
@@ -49,7 +51,7 @@ int main(int argc, char **argv)
 
    montage_status = stdout;
 
-   while ((c = getopt(argc, argv, "enp:s:d:a:")) != EOF) 
+   while ((c = getopt(argc, argv, "enp:s:d:a:t:")) != EOF) 
    {
       switch (c) 
       {
@@ -133,13 +135,27 @@ int main(int argc, char **argv)
             break;
 
 
+         /*****************************************/
+         /* Number of threads coadding the planes */
+         /*****************************************/
+
+         case 't':
+
+            if(montage_setThreads(strtol(optarg, &end, 10)) || end < optarg + strlen(optarg))
+            {
+               printf("[struct stat=\"ERROR\", msg=\"Thread count (%s) must be a non-negative integer\"]\n", optarg);
+               exit(1);
+            }
+            break;
+
+
          /*********************************************/
          /* Unknown directive: Usage message and exit */
          /*********************************************/
 
          default:
 
-            printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-p imgdir] [-n(o-areas)] [-a mean|median|count] [-e(xact-size)] [-d level] [-s statusfile] images.tbl template.hdr out.fits\"]\n", argv[0]);
+            printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-p imgdir] [-n(o-areas)] [-a mean|median|count] [-e(xact-size)] [-t nthread] [-d level] [-s statusfile] images.tbl template.hdr out.fits\"]\n", argv[0]);
             exit(1);
             break;
       }
@@ -152,7 +168,7 @@ int main(int argc, char **argv)
 
    if (argc - optind < 3) 
    {
-            printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-p imgdir] [-n(o-areas)] [-a mean|median|count] [-e(xact-size)] [-d level] [-s statusfile] images.tbl template.hdr out.fits\"]\n", argv[0]);
+            printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-p imgdir] [-n(o-areas)] [-a mean|median|count] [-e(xact-size)] [-t nthread] [-d level] [-s statusfile] images.tbl template.hdr out.fits\"]\n", argv[0]);
       exit(1);
    }
 
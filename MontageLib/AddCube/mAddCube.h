@@ -29,6 +29,12 @@ int  mAddCube_avg_mean       (double data[], double area[], double *outdata,
                               double *outarea, int count);
 int  mAddCube_avg_median     (double data[], double area[], double *outdata, 
                               double *outarea, int n, double nom_area);
+int  mAddCube_median         (double data[], double area[], double *outdata, 
+                              double *outarea, int n, double nom_area,
+                              double *sorted, double *sortedarea);
+int  mAddCube_openFile       (int ifile, char *infile, char *inarea, int haveAreas);
+int  mAddCube_closeFile      (int ifile, int haveAreas);
+void *mAddCube_planes        (void *ptr);
 void mAddCube_printFitsError (int);
 void mAddCube_printError     (char *);
 int  mAddCube_allocError     (char *);
@@ -16,6 +16,7 @@ Version  Developer        Date     Change
 #include <sys/types.h>
 #include <time.h>
 #include <math.h>
+#include <pthread.h>
 
 #include <fitsio.h>
 #include <wcs.h>
@@ -28,10 +29,14 @@ Version  Developer        Date     Change
 #define MAXFILE     50
 #define MAXFITS    200
 #define MAXLIST    500
-#define PIXDEPTH    50
 #define HDRLEN   80000
 
 
+/* Memory budget for one chunk of planes (input slabs plus output) */
+
+#define CHUNKMEM 268435456
+
+
 
 /* Fractional area minumum for median-type averaging */
 
@@ -106,6 +111,7 @@ struct fileinfo
    int       j3start;
    int       j3offset;
    int       j3end;
+   int       checked;
 };
 
 static struct fileinfo *input, *input_area;
@@ -124,6 +130,42 @@ static struct outfile output;
 static struct outfile output_area;
 
 
+/********************************************************/
+/* Work for one thread: a share of the planes in the    */
+/* current chunk, for the current output line.  The     */
+/* pixel stacks and median work space are private; the  */
+/* input slabs and output rows are shared.              */
+/********************************************************/
+
+struct cubeWork
+{
+   int       nplane;       /* Planes in this chunk                 */
+   int       start;        /* This thread does planes start,       */
+   int       stride;       /* start+stride, ...                    */
+
+   int       ncontrib;     /* Files contributing to this line      */
+   double  **slab;         /* Per file: nz rows of nelem pixels    */
+   double  **arearow;      /* Per file: one row of area            */
+   int      *nz;
+   int      *nelem;
+   int      *offset;
+
+   int       naxis1;
+   int       coadd;
+   double    nominal_area;
+
+   double  **dataline;     /* Pixel stacks                         */
+   double  **arealine;
+   int      *datacount;
+   double   *sorted;       /* Median work space                    */
+   double   *sortedarea;
+
+   double   *outdata;      /* nplane output rows (and area)        */
+   double   *outarea;
+   double    nan;
+};
+
+
 static char montage_msgstr[1024];
 static char montage_json  [1024];
 
@@ -163,9 +205,10 @@ static char montage_json  [1024];
 struct mAddCubeReturn *mAddCube(char *path, char *tblfile, char *template_file, char *outfile,
                                 int shrink, int haveAreas, int coadd, int debugin)
 {
-   int       i, j, j3, j4, ncols, namelen, imgcount;
-   int       lineout, itemp, pixdepth, ipix, jcnt;
-   int       inbuflen;
+   int       i, j, j4, z0, ncols, namelen, imgcount;
+   int       lineout, itemp, row;
+   int       nchunk, nplane, maxContrib, maxlen;
+   int       t, nthread, nthr;
    int       currentstart, currentend;
    int       showwarning = 0;
 
@@ -173,14 +216,13 @@ struct mAddCubeReturn *mAddCube(char *path, char *tblfile, char *template_file,
 
    double    tryval;
 
-   char     *inputHeader;
    char     *ptr;
    int       wrap = 0;
 
    int       haveMinMax;
-   int       avg_status = 0;
 
-   long      fpixel[4], nelements;
+   long      fpixel[4], lpixel[4];
+   long      inc[4] = {1, 1, 1, 1};
    int       nullcnt;
 
    double    nominal_area = 0;
@@ -188,13 +230,19 @@ struct mAddCubeReturn *mAddCube(char *path, char *tblfile, char *template_file,
    double    imin, imax;
    double    jmin, jmax;
 
-   double  **dataline;
-   double  **arealine;
-   int      *datacount;
-   double   *input_buffer;
-   double   *input_buffer_area;
-   double   *outdataline;
-   double   *outarealine;
+   int      *lineCount;
+   int     **lineFiles;
+
+   double  **slab;
+   double  **arearow;
+   int      *nz;
+   int      *nelem;
+   int      *offset;
+   double   *outdata;
+   double   *outarea;
+
+   pthread_t       *threads;
+   struct cubeWork *work;
 
    char      filename     [MAXSTR];
    char      errstr       [MAXSTR];
@@ -770,46 +818,6 @@ struct mAddCubeReturn *mAddCube(char *path, char *tblfile, char *template_file,
    }
 
 
-   /*************************************/
-   /* Allocate memory for input buffers */
-   /*************************************/
-
-   inbuflen = labs(imax-imin);
-
-   if( output.naxes[0] > inbuflen)
-      inbuflen = output.naxes[0];
-
-   if (debug >= 1)
-   {
-     printf("Input buffer length = %d\n", inbuflen);
-     fflush(stdout);
-   }
-
-   input_buffer      = (double *)malloc(inbuflen * sizeof(double));
-   input_buffer_area = (double *)malloc(inbuflen * sizeof(double));
-
-   if(!input_buffer)     
-   {
-      mAddCube_allocError("input buffer");
-      strcpy(returnStruct->msg,  montage_msgstr);
-      return returnStruct;
-   }
-   if(!input_buffer_area)
-   {
-      mAddCube_allocError("input area buffer");
-      strcpy(returnStruct->msg,  montage_msgstr);
-      return returnStruct;
-   }
-
-   if(debug >= 1)
-   {
-      time(&currtime);
-      printf("Memory allocated for input buffers [time: %.0f]\n", 
-         (double)(currtime - start));
-      fflush(stdout);
-   }
-     
-
    /*****************************************************/
    /* Build array of fileinfo structures on input files */
    /*****************************************************/
@@ -1013,99 +1021,223 @@ struct mAddCubeReturn *mAddCube(char *path, char *tblfile, char *template_file,
    nominal_area = fabs(nominal_area) * dtr * dtr / nfile;
 
 
-   /*************************************************************/ 
-   /* Allocate memory for pixdepth lines of output image pixels */ 
-   /* We will modify pixel depth dynamically if need be         */ 
-   /*************************************************************/ 
+   /*******************************************************/
+   /* Build the list of contributing files for each line */
+   /* of output.  This used to be updated as the lines    */
+   /* were written but we now sweep the lines once per    */
+   /* chunk of planes, so build it once up front (in the  */
+   /* same order the linked list gives, so the stacks are */
+   /* filled the same way).                               */
+   /*******************************************************/
 
-   pixdepth = PIXDEPTH;
+   if(mAddCube_listInit() > 0)
+   {
+      strcpy(returnStruct->msg,  montage_msgstr);
+      return returnStruct;
+   }
 
-   dataline = (double **)malloc(output.naxes[0] * sizeof(double *));
+   lineCount = (int * )malloc(output.naxes[1] * sizeof(int  ));
+   lineFiles = (int **)malloc(output.naxes[1] * sizeof(int *));
 
-   if(!dataline)
+   if(!lineFiles)
    {
-      mAddCube_allocError("data line pointers");
+      mAddCube_allocError("contributor lists");
       strcpy(returnStruct->msg,  montage_msgstr);
       return returnStruct;
    }
 
-   for (i = 0; i < output.naxes[0]; ++i)
+   currentstart = 0;
+   currentend   = 0;
+
+   maxContrib = 1;
+
+   for (lineout=1; lineout<=output.naxes[1]; ++lineout)
    {
-      dataline[i] = (double *)malloc(pixdepth * sizeof(double));
+      while(1)
+      {
+         if(currentstart >= nfile)
+            break;
+
+         if(startline[currentstart] > lineout)
+            break;
+
+         if(mAddCube_listAdd(startfile[currentstart]) > 0)
+         {
+            strcpy(returnStruct->msg,  montage_msgstr);
+            return returnStruct;
+         }
+
+         ++currentstart;
+      }
+      
+      while(1)
+      {
+         if(currentend >= nfile)
+            break;
+
+         if(endline[currentend] > lineout - 1)
+            break;
+
+         mAddCube_listDelete(endfile[currentend]);
+
+         ++currentend;
+      }
+
+      imgcount = mAddCube_listCount();
 
-      if(!dataline[i])
+      lineCount[lineout-1] = imgcount;
+      lineFiles[lineout-1] = (int *)malloc((imgcount+1) * sizeof(int));
+
+      if(!lineFiles[lineout-1])
       {
-         mAddCube_allocError("data line");
+         mAddCube_allocError("contributor list");
          strcpy(returnStruct->msg,  montage_msgstr);
          return returnStruct;
       }
+
+      for(j=0; j<imgcount; ++j)
+         lineFiles[lineout-1][j] = mAddCube_listIndex(j);
+
+      if(imgcount > maxContrib)
+         maxContrib = imgcount;
+   }
+
+   maxlen = 1;
+
+   for(ifile=0; ifile<nfile; ++ifile)
+   {
+      if(innaxis1[ifile] > maxlen)
+         maxlen = innaxis1[ifile];
+
+      input[ifile].checked = 0;
+   }
+
+   if(debug >= 1)
+   {
+      time(&currtime);
+      printf("Contributor lists built; at most %d files per line [time: %.0f]\n", 
+         maxContrib, (double)(currtime - start));
+      fflush(stdout);
+   }
+
+
+   /*******************************************************/
+   /* Decide how many planes to handle at once: as many   */
+   /* as fit in the memory budget with a slab from every  */
+   /* contributing file and the output rows.              */
+   /*******************************************************/
+
+   nchunk = CHUNKMEM / (sizeof(double) * ((long)maxContrib * maxlen + 2 * output.naxes[0]));
+
+   if(nchunk < 1)
+      nchunk = 1;
+
+   if(nchunk > output.naxes[2])
+      nchunk = output.naxes[2];
+
+   nthread = montage_outThreads();
+
+   if(nthread > nchunk)
+      nthread = nchunk;
+
+   if(debug >= 1)
+   {
+      printf("Coadding %d plane(s) at a time with %d thread(s)\n", nchunk, nthread);
+      fflush(stdout);
    }
 
 
-   arealine = (double **)malloc(output.naxes[0] * sizeof(double *));
+   /************************************************/
+   /* Allocate the input slabs and the output rows */
+   /************************************************/
+
+   slab    = (double **)malloc(maxContrib * sizeof(double *));
+   arearow = (double **)malloc(maxContrib * sizeof(double *));
+   nz      = (int *)    malloc(maxContrib * sizeof(int));
+   nelem   = (int *)    malloc(maxContrib * sizeof(int));
+   offset  = (int *)    malloc(maxContrib * sizeof(int));
 
-   if(!arealine)
+   if(!slab || !arearow || !nz || !nelem || !offset)
    {
-      mAddCube_allocError("area line pointers");
+      mAddCube_allocError("input slab pointers");
       strcpy(returnStruct->msg,  montage_msgstr);
       return returnStruct;
    }
 
-   for (i = 0; i < output.naxes[0]; ++i)
+   for(j=0; j<maxContrib; ++j)
    {
-      arealine[i] = (double *)malloc(pixdepth * sizeof(double));
+      slab   [j] = (double *)malloc((long)nchunk * maxlen * sizeof(double));
+      arearow[j] = (double *)malloc(maxlen * sizeof(double));
 
-      if(!arealine[i])
+      if(!slab[j] || !arearow[j])
       {
-         mAddCube_allocError("area line");
+         mAddCube_allocError("input slabs");
          strcpy(returnStruct->msg,  montage_msgstr);
          return returnStruct;
       }
    }
 
-   datacount = (int *)malloc(output.naxes[0] * sizeof(int));
+   outdata = (double *)malloc((long)nchunk * output.naxes[0] * sizeof(double));
+   outarea = (double *)malloc((long)nchunk * output.naxes[0] * sizeof(double));
 
-   if(!datacount)
+   if(!outdata || !outarea)
    {
-      mAddCube_allocError("data counts");
+      mAddCube_allocError("output rows");
       strcpy(returnStruct->msg,  montage_msgstr);
       return returnStruct;
    }
 
 
-   if(debug >= 1)
-   {
-      time(&currtime);
-      printf("Memory allocated for input data buffer [time: %.0f]\n", 
-         (double)(currtime - start));
-      fflush(stdout);
-   }
-
-
-   /***********************************/
-   /* Allocate memory for output line */
-   /***********************************/
+   /*******************************************************/
+   /* Each thread gets its own pixel stacks.  A file adds */
+   /* at most one value to a stack so they never need to  */
+   /* be deeper than the most files on any line.          */
+   /*******************************************************/
 
-   outdataline = (double *)malloc(output.naxes[0] * sizeof(double));
-   outarealine = (double *)malloc(output.naxes[0] * sizeof(double));
+   threads = (pthread_t *)      malloc(nthread * sizeof(pthread_t));
+   work    = (struct cubeWork *)malloc(nthread * sizeof(struct cubeWork));
 
-   if(!outdataline)
+   if(!threads || !work)
    {
-      mAddCube_allocError("output data line");
+      mAddCube_allocError("thread info");
       strcpy(returnStruct->msg,  montage_msgstr);
       return returnStruct;
    }
-   if(!outarealine)
+
+   for(t=0; t<nthread; ++t)
    {
-      mAddCube_allocError("output area line");
-      strcpy(returnStruct->msg,  montage_msgstr);
-      return returnStruct;
+      work[t].dataline   = (double **)malloc(output.naxes[0] * sizeof(double *));
+      work[t].arealine   = (double **)malloc(output.naxes[0] * sizeof(double *));
+      work[t].datacount  = (int *)    malloc(output.naxes[0] * sizeof(int));
+      work[t].sorted     = (double *) malloc(maxContrib * sizeof(double));
+      work[t].sortedarea = (double *) malloc(maxContrib * sizeof(double));
+
+      if(!work[t].dataline || !work[t].arealine || !work[t].datacount
+      || !work[t].sorted   || !work[t].sortedarea)
+      {
+         mAddCube_allocError("data lines");
+         strcpy(returnStruct->msg,  montage_msgstr);
+         return returnStruct;
+      }
+
+      for (i = 0; i < output.naxes[0]; ++i)
+      {
+         work[t].dataline[i] = (double *)malloc(maxContrib * sizeof(double));
+         work[t].arealine[i] = (double *)malloc(maxContrib * sizeof(double));
+
+         if(!work[t].dataline[i] || !work[t].arealine[i])
+         {
+            mAddCube_allocError("data line");
+            strcpy(returnStruct->msg,  montage_msgstr);
+            return returnStruct;
+         }
+      }
    }
-     
+
    if(debug >= 1)
    {
       time(&currtime);
-      printf("Memory allocated for output data buffers [time: %.0f]\n", 
+      printf("Memory allocated for input slabs and output rows [time: %.0f]\n", 
          (double)(currtime - start));
       fflush(stdout);
    }
@@ -1375,324 +1507,108 @@ struct mAddCubeReturn *mAddCube(char *path, char *tblfile, char *template_file,
 
 
    /*******************************************************************************/
-   /* Build/write one line of output at a time.                                   */
-   /* In this cube case, that 'line' refers to a horizontal line (e.g. Dec-like)  */
-   /* in the output.  Once we have figured out which input images are involved,   */
-   /* we will invoke a loop over the third dimension (or loops over the third and */
-   /* fourth) to create that same line for each plane and write it out.           */
+   /* Build/write the output a chunk of planes at a time.  For each chunk we      */
+   /* sweep the output lines; for a line the contributing files are read as       */
+   /* slabs (that row of every plane in the chunk, one call per file) and the     */
+   /* planes are then divided among the threads, each averaging its own planes'   */
+   /* pixel stacks.  The whole chunk of the line is then written in one call.     */
    /*******************************************************************************/
 
-   haveMinMax = 0;
-
-   currentstart = 0;
-   currentend   = 0;
-
-   if(mAddCube_listInit() > 0)
-   {
-      strcpy(returnStruct->msg,  montage_msgstr);
-      return returnStruct;
-   }
-
-   for (lineout=1; lineout<=output.naxes[1]; ++lineout)
+   for(j4=1; j4<output.naxes[3]+1; ++j4)
    {
-      if (debug >= 2)
-      {
-        printf("\nOUTPUT LINE %d\n",lineout);
-        fflush(stdout);
-      }
-
-      if (debug == 1)
-      {
-         printf("\r Processing line: %d", lineout);
-         fflush(stdout);
-      }
-
-
-      /*********************************/
-      /* Update the "contributor" list */
-      /*********************************/
-
-      while(1)
-      {
-         if(currentstart >= nfile)
-            break;
-
-         if(startline[currentstart] > lineout)
-            break;
-
-         if(mAddCube_listAdd(startfile[currentstart]) > 0)
-         {
-            strcpy(returnStruct->msg,  montage_msgstr);
-            return returnStruct;
-         }
-
-         ++currentstart;
-      }
-      
-      while(1)
-      {
-         if(currentend >= nfile)
-            break;
-
-         if(endline[currentend] > lineout - 1)
-            break;
-
-         ifile = endfile[currentend];
-
-         mAddCube_listDelete(ifile);
-
-         if(input[ifile].isopen)
-         {
-            status = 0;
-            if(fits_close_file(input[ifile].fptr, &status))
-            {
-               mAddCube_printFitsError(status);
-               strcpy(returnStruct->msg,  montage_msgstr);
-               return returnStruct;
-            }
-
-            input[ifile].isopen = 0;
-
-            --open_files;
-         }
-        
-         if(haveAreas
-         && input_area[ifile].isopen)
-         {
-            status = 0;
-            if(fits_close_file(input_area[ifile].fptr, &status))
-            {
-               mAddCube_printFitsError(status);
-               strcpy(returnStruct->msg,  montage_msgstr);
-               return returnStruct;
-            }
-
-            input_area[ifile].isopen = 0;
-
-            --open_files;
-         }
-
-         ++currentend;
-      }
-
-
-      imgcount = mAddCube_listCount();
-
-
-      /******************************************/
-      /* Check the files that overlap this line */
-      /******************************************/
-     
-      if (debug >= 2) 
+      for(z0=1; z0<output.naxes[2]+1; z0+=nchunk)
       {
-         printf("\nContributing files (%d):\n\n", imgcount);
-         printf(" i   isopen   open/max      infile[i]       \n");
-         printf("---- ------ ------------ -------------------\n");
-         fflush(stdout);
-      }
+         nplane = nchunk;
 
-      for(j=0; j<imgcount; ++j)
-      {
-         ifile = mAddCube_listIndex(j);
+         if(z0 + nplane - 1 > output.naxes[2])
+            nplane = output.naxes[2] - z0 + 1;
 
-         if(debug >= 2)
+         if (debug == 1)
          {
-            printf("%4d %4d %6d/%6d %s  ",
-               ifile, input[ifile].isopen, open_files, MAXFITS, infile[ifile]);
+            printf("\r Processing planes: %d-%d", z0, z0+nplane-1);
             fflush(stdout);
          }
 
-         if (input[ifile].isopen == 0)
+         for (lineout=1; lineout<=output.naxes[1]; ++lineout)
          {
-            /* Open files that aren't already open */
-
-            ++open_files;
- 
-            if (open_files > MAXFITS)
+            if (debug >= 2)
             {
-               sprintf(montage_msgstr, "Too many open files");
+              printf("\nOUTPUT LINE %d (planes %d-%d)\n", lineout, z0, z0+nplane-1);
+              fflush(stdout);
+            }
 
-               remove(output_file);               
-               remove(output_area_file);               
+            imgcount = lineCount[lineout-1];
 
-               strcpy(returnStruct->msg,  montage_msgstr);
-               return returnStruct;
-            }
- 
-            if(fits_open_file(&input[ifile].fptr, infile[ifile], READONLY, &status))
-            {
-               sprintf(errstr, "Image file %s missing or invalid FITS", infile[ifile]);
-                
-               mAddCube_printError(errstr);
-               strcpy(returnStruct->msg,  montage_msgstr);
-               return returnStruct;
-            }
 
-            if(debug >= 2)
+            /*****************************************/
+            /* Read the slabs from the files that    */
+            /* overlap this line                     */
+            /*****************************************/
+           
+            if (debug >= 2) 
             {
-               printf("Open:  %4d\n", ifile); 
+               printf("\nContributing files (%d):\n\n", imgcount);
+               printf(" i   isopen   open/max      infile[i]       \n");
+               printf("---- ------ ------------ -------------------\n");
                fflush(stdout);
             }
 
-
-            input[ifile].isopen = 1;
- 
-            if(haveAreas)
+            for(j=0; j<imgcount; ++j)
             {
-               ++open_files;
+               ifile = lineFiles[lineout-1][j];
 
-               if (open_files > MAXFITS)
+               if(debug >= 2)
                {
-                  sprintf(montage_msgstr, "Too many open files");
-
-                  remove(output_file);               
-                  remove(output_area_file);               
-
-                  strcpy(returnStruct->msg,  montage_msgstr);
-                  return returnStruct;
+                  printf("%4d %4d %6d/%6d %s\n",
+                     ifile, input[ifile].isopen, open_files, MAXFITS, infile[ifile]);
+                  fflush(stdout);
                }
 
-               if(fits_open_file(&input_area[ifile].fptr, inarea[ifile], READONLY, &status))
+               if (input[ifile].isopen == 0)
                {
-                  sprintf(errstr, "Area file %s missing or invalid FITS", inarea[ifile]);
-                  mAddCube_printError(errstr);
-                  strcpy(returnStruct->msg,  montage_msgstr);
-                  return returnStruct;
+                  if(mAddCube_openFile(ifile, infile[ifile], inarea[ifile], haveAreas))
+                  {
+                     strcpy(returnStruct->msg,  montage_msgstr);
+                     return returnStruct;
+                  }
                }
 
-               input_area[ifile].isopen = 1;
-            }
+               row = (lineout - input[ifile].start) + 1;
 
+               nelem [j] = innaxis1[ifile];
+               offset[j] = input[ifile].offset;
+               nz    [j] = 0;
 
-            /* Get the WCS and check it against */
-            /* the one for the header template  */
+               if(j4  >= 1 && j4  <= innaxis4[ifile]
+               && z0  >= 1 && z0  <= innaxis3[ifile]
+               && row >= 1 && row <= innaxis2[ifile])
+               {
+                  nz[j] = nplane;
 
-            if(fits_get_image_wcs_keys(input[ifile].fptr, &inputHeader, &status))
-            {
-               mAddCube_printFitsError(status);
-               strcpy(returnStruct->msg,  montage_msgstr);
-               return returnStruct;
-            }
+                  if(z0 + nz[j] - 1 > innaxis3[ifile])
+                     nz[j] = innaxis3[ifile] - z0 + 1;
 
-            if(debug >= 3)
-            {
-               printf("Input header to wcsinit() [imgWCS]:\n%s\n", inputHeader);
-               fflush(stdout);
-            }
+                  fpixel[0] = 1;
+                  fpixel[1] = row;
+                  fpixel[2] = z0;
+                  fpixel[3] = j4;
 
-            imgWCS = wcsinit(inputHeader);
+                  lpixel[0] = innaxis1[ifile];
+                  lpixel[1] = row;
+                  lpixel[2] = z0 + nz[j] - 1;
+                  lpixel[3] = j4;
 
-            if(imgWCS == (struct WorldCoor *)NULL)
-            {
-               sprintf(montage_msgstr, "Input wcsinit() failed.");
-               strcpy(returnStruct->msg,  montage_msgstr);
-               return returnStruct;
-            }
-
-            if(strcmp(imgWCS->c1type, hdrWCS->c1type) != 0)
-            {
-               sprintf(errstr, "Image %s header CTYPE1 does not match template", infile[ifile]);
-               mAddCube_printError(errstr);
-               strcpy(returnStruct->msg,  montage_msgstr);
-               return returnStruct;
-            }
-
-            if(strcmp(imgWCS->c2type, hdrWCS->c2type) != 0)
-            {
-               sprintf(errstr, "Image %s header CTYPE2 does not match template", infile[ifile]);
-               mAddCube_printError(errstr);
-               strcpy(returnStruct->msg,  montage_msgstr);
-               return returnStruct;
-            }
-
-            if(fabs(imgWCS->xref - hdrWCS->xref) > 1.e-8)
-            {
-               sprintf(errstr, "Image %s header CRVAL1 does not match template", infile[ifile]);
-               mAddCube_printError(errstr);
-               strcpy(returnStruct->msg,  montage_msgstr);
-               return returnStruct;
-            }
-
-            if(fabs(imgWCS->yref - hdrWCS->yref) > 1.e-8)
-            {
-               sprintf(errstr, "Image %s header CRVAL2 does not match template", infile[ifile]);
-               mAddCube_printError(errstr);
-               strcpy(returnStruct->msg,  montage_msgstr);
-               return returnStruct;
-            }
-
-            if(fabs(imgWCS->cd[0] - hdrWCS->cd[0]) > 1.e-8
-            || fabs(imgWCS->cd[1] - hdrWCS->cd[1]) > 1.e-8
-            || fabs(imgWCS->cd[2] - hdrWCS->cd[2]) > 1.e-8
-            || fabs(imgWCS->cd[3] - hdrWCS->cd[3]) > 1.e-8)
-            {
-               sprintf(errstr, "Image %s header CD/CDELT does not match template", infile[ifile]);
-               mAddCube_printError(errstr);
-               strcpy(returnStruct->msg,  montage_msgstr);
-               return returnStruct;
-            }
-
-            if(imgWCS->equinox != hdrWCS->equinox)
-            {
-               sprintf(errstr, "Image %s header EQUINOX does not match template", infile[ifile]);
-               mAddCube_printError(errstr);
-               strcpy(returnStruct->msg,  montage_msgstr);
-               return returnStruct;
-            }
-         } 
-         else
-         {
-            if(debug >= 2)
-            {
-               printf("Already open\n"); 
-               fflush(stdout);
-            }
-         }
-      } 
-
-
-      /*****************************************************************/ 
-      /* For lines from input files corresponding to this output line, */
-      /* looping over the third (and fourth) dimensions of the cube    */
-      /*****************************************************************/ 
-
-      for(j4=1; j4<output.naxes[3]+1; ++j4)
-      {
-         for(j3=1; j3<output.naxes[2]+1; ++j3)
-         {
-            for(i=0; i<output.naxes[0]; ++i)
-               datacount[i] = 0;
-
-            for(j=0; j<imgcount; ++j)
-            {
-               ifile = mAddCube_listIndex(j);
-
-               fpixel[0] = 1;
-               fpixel[1] = (lineout - input[ifile].start) + 1;
-               fpixel[2] = j3;
-               fpixel[3] = j4;
-
-               nelements = innaxis1[ifile];
-
-               if (debug >= 4)
-               {
-                  printf("Reading %ld pixels from file %d at (%6ld, %6ld, %6ld)\n", 
-                     nelements, ifile, fpixel[3], fpixel[2], fpixel[1]);
-                  fflush(stdout);
-               }
-
-               if(fpixel[3] >= 1 && fpixel[3] <= innaxis4[ifile]
-               && fpixel[2] >= 1 && fpixel[2] <= innaxis3[ifile]
-               && fpixel[1] >= 1 && fpixel[1] <= innaxis2[ifile])
-               {
-                  /*****************/
-                  /* Read the line */
-                  /*****************/
+                  if (debug >= 4)
+                  {
+                     printf("Reading %d x %d pixels from file %d at (%6ld, %6ld, %6ld)\n", 
+                        nz[j], nelem[j], ifile, fpixel[3], fpixel[2], fpixel[1]);
+                     fflush(stdout);
+                  }
 
                   status = 0;
 
-                  if(fits_read_pix(input[ifile].fptr, TDOUBLE, fpixel, nelements, &nan,
-                                     input_buffer, &nullcnt, &status))
+                  if(fits_read_subset(input[ifile].fptr, TDOUBLE, fpixel, lpixel, inc, &nan,
+                                      slab[j], &nullcnt, &status))
                   {
                      mAddCube_printFitsError(status);
                      strcpy(returnStruct->msg,  montage_msgstr);
@@ -1701,8 +1617,8 @@ struct mAddCubeReturn *mAddCube(char *path, char *tblfile, char *template_file,
 
                   if(haveAreas)
                   {
-                     if(fits_read_pix(input_area[ifile].fptr, TDOUBLE, fpixel, nelements, &nan,
-                                        input_buffer_area, &nullcnt, &status))
+                     if(fits_read_pix(input_area[ifile].fptr, TDOUBLE, fpixel, nelem[j], &nan,
+                                        arearow[j], &nullcnt, &status))
                      {
                         mAddCube_printFitsError(status);
                         strcpy(returnStruct->msg,  montage_msgstr);
@@ -1711,91 +1627,8 @@ struct mAddCubeReturn *mAddCube(char *path, char *tblfile, char *template_file,
                   }
                   else
                   {
-                     for(i=0; i<nelements; ++i)
-                        input_buffer_area[i] = 1.000;
-                  }
-
-
-                  /**********************/
-                  /* Process the pixels */
-                  /**********************/
-
-                  for (i = 0; i<nelements; ++i)
-                  {
-                     /***********************************/
-                     /* If there's not a value here, we */
-                     /* won't add anything to dataline  */
-                     /***********************************/
-          
-                     if (mNaN(input_buffer[i]) || input_buffer_area[i] <= 0.)
-                        continue;
-                   
-                     /* Are we off the image? */
-                    
-                     ipix = i + input[ifile].offset;
-
-                     if (ipix <               0 ) continue;
-                     if (ipix >= output.naxes[0]) continue;
-                   
-
-                     /****************************************************/
-                     /* Not off the image, and not NaNs; add to dataline */
-                     /* corresponding to ifile                           */
-                     /****************************************************/
-                   
-                     jcnt = datacount[ipix];
-
-                     if(jcnt >= pixdepth)
-                     {
-                        pixdepth += PIXDEPTH;
-
-                        if(debug >= 1)
-                        {
-                           printf("\nReallocating input data buffers; new depth = %d\n",
-                              pixdepth);
-                           fflush(stdout);
-                        }
-
-                        for (i=0; i<output.naxes[0]; ++i)
-                        {
-                           dataline[i] = (double *)realloc(dataline[i],
-                              pixdepth * sizeof(double));
-
-                           if(dataline[i] == (double *)NULL)
-                           {
-                              remove(output_file);               
-                              remove(output_area_file);               
-
-                              mAddCube_allocError("data line (realloc)");
-                              strcpy(returnStruct->msg,  montage_msgstr);
-                              return returnStruct;
-                           }
-
-                           arealine[i] = (double *)realloc(arealine[i],
-                              pixdepth * sizeof(double));
-
-                           if(arealine[i] == (double *)NULL)
-                           {
-                              remove(output_file);               
-                              remove(output_area_file);               
-
-                              mAddCube_allocError("area line (realloc)");
-                              strcpy(returnStruct->msg,  montage_msgstr);
-                              return returnStruct;
-                           }
-                        }
-
-                        if(debug >= 1)
-                        {
-                           printf("Memory reallocation complete\n");
-                           fflush(stdout);
-                        }
-                     }
-                     dataline[ipix][jcnt] = input_buffer[i];
-
-                     arealine[ipix][jcnt] = input_buffer_area[i];
-
-                     ++datacount[ipix];
+                     for(i=0; i<nelem[j]; ++i)
+                        arearow[j][i] = 1.000;
                   }
                }
                else
@@ -1809,13 +1642,10 @@ struct mAddCubeReturn *mAddCube(char *path, char *tblfile, char *template_file,
 
 
                /*****************************************/
-               /* Done adding pixels to dataline stacks */
-               /*                                       */
                /* Is it time to close this file?        */
-               /* Either because we're at the           */
-               /* bottom of it, or because we're        */
-               /* running out of available file         */
-               /* pointers?                             */
+               /* Either because this is the last line  */
+               /* it covers, or because we're running   */
+               /* out of available file pointers?       */
                /*****************************************/
 
                if (!showwarning && open_files >= MAXFITS) 
@@ -1829,87 +1659,63 @@ struct mAddCubeReturn *mAddCube(char *path, char *tblfile, char *template_file,
                   }
                }
 
-               if (open_files >= MAXFITS) 
+               if (open_files >= MAXFITS || lineout >= input[ifile].end) 
                {
-                  if(fits_close_file(input[ifile].fptr, &status))
+                  if(mAddCube_closeFile(ifile, haveAreas))
                   {
-                     mAddCube_printFitsError(status);
                      strcpy(returnStruct->msg,  montage_msgstr);
                      return returnStruct;
                   }
-
-                  if(debug >= 2)
-                  {
-                     printf("Close: %4d\n", ifile); 
-                     fflush(stdout);
-                  }
-
-                  input[ifile].isopen = 0;
-
-                  --open_files;
-                 
-                  if(haveAreas)
-                  {
-                     if(fits_close_file(input_area[ifile].fptr, &status))
-                     {
-                        mAddCube_printFitsError(status);
-                        strcpy(returnStruct->msg,  montage_msgstr);
-                        return returnStruct;
-                     }
-
-                     input_area[ifile].isopen = 0;
-
-                     --open_files;
-                  }
                }
             } 
 
-           
+
             /***************************************************************/
             /* Done reading all the files that overlap this line of output */
             /*                                                             */
-            /* Now to average each pixel and prepare the output pixels:    */
+            /* Now to average each pixel of each plane in parallel:        */
             /***************************************************************/
 
-            for (i = 0; i<output.naxes[0]; ++i)
-            {
-               outdataline[i] = 0;
-               outarealine[i] = 0;
+            nthr = nthread;
 
-               avg_status=0;
+            if(nthr > nplane)
+               nthr = nplane;
 
+            for(t=0; t<nthr; ++t)
+            {
+               work[t].nplane       = nplane;
+               work[t].start        = t;
+               work[t].stride       = nthr;
+               work[t].ncontrib     = imgcount;
+               work[t].slab         = slab;
+               work[t].arearow      = arearow;
+               work[t].nz           = nz;
+               work[t].nelem        = nelem;
+               work[t].offset       = offset;
+               work[t].naxis1       = output.naxes[0];
+               work[t].coadd        = coadd;
+               work[t].nominal_area = nominal_area;
+               work[t].outdata      = outdata;
+               work[t].outarea      = outarea;
+               work[t].nan          = nan;
+            }
 
-               /**********************************/
-               /* Average this "stack" of pixels */
-               /* according to the user-chosen   */
-               /* averaging method               */
-               /**********************************/
-
-               if(datacount[i] > 0)
+            for(t=1; t<nthr; ++t)
+            {
+               if(pthread_create(&threads[t], NULL, mAddCube_planes, &work[t]))
                {
-                  if (coadd == MEAN)
-                     avg_status = mAddCube_avg_mean(dataline[i], arealine[i], 
-                        &outdataline[i], &outarealine[i], datacount[i]);
+                  mAddCube_planes(&work[t]);
 
-                  else if (coadd == MEDIAN)
-                     avg_status = mAddCube_avg_median(dataline[i], arealine[i], 
-                        &outdataline[i], &outarealine[i], datacount[i], nominal_area);
+                  work[t].nplane = -1;
+               }
+            }
 
-                  else if (coadd == COUNT)
-                     avg_status = mAddCube_avg_count(dataline[i], arealine[i], 
-                        &outdataline[i], &outarealine[i], datacount[i]);
+            mAddCube_planes(&work[0]);
 
-                  if (avg_status)
-                  {
-                     outdataline[i] = nan;
-                     outarealine[i] = 0;
-                  }
-               }
-               else
-               {
-                  outdataline[i] = nan;
-                  outarealine[i] = 0;
-               }
+            for(t=1; t<nthr; ++t)
+            {
+               if(work[t].nplane >= 0)
+                  pthread_join(threads[t], NULL);
             }
 
 
@@ -1922,39 +1728,86 @@ struct mAddCubeReturn *mAddCube(char *path, char *tblfile, char *template_file,
           
             fpixel[0] = 1;
             fpixel[1] = lineout; 
-            fpixel[2] = j3;
+            fpixel[2] = z0;
             fpixel[3] = j4;
-            nelements = output.naxes[0];
+
+            lpixel[0] = output.naxes[0];
+            lpixel[1] = lineout; 
+            lpixel[2] = z0 + nplane - 1;
+            lpixel[3] = j4;
 
             if(debug >= 3)
             {
-               printf("Writing %ld pixels at (%6d, %6d, %6d) of (%6ld, %6ld %6ld)\n",
-                  nelements, j4, j3, lineout, output.naxes[3], output.naxes[2], output.naxes[1]);
+               printf("Writing %d x %ld pixels at (%6d, %6d, %6d) of (%6ld, %6ld %6ld)\n",
+                  nplane, output.naxes[0], j4, z0, lineout, output.naxes[3], output.naxes[2], output.naxes[1]);
                fflush(stdout);
             }
 
-            if (fits_write_pix(output.fptr, TDOUBLE, fpixel, nelements,
-                               (void *)(&outdataline[0]), &status))
+            if (fits_write_subset(output.fptr, TDOUBLE, fpixel, lpixel, outdata, &status))
             {
                mAddCube_printFitsError(status);
                strcpy(returnStruct->msg,  montage_msgstr);
                return returnStruct;
             }
+
+
+            /*********************************************/
+            /* The area image is 2D and gets the area of */
+            /* the last plane                            */
+            /*********************************************/
+
+            if(j4 == output.naxes[3] && z0 + nplane - 1 == output.naxes[2])
+            {
+               fpixel[2] = 1;
+               fpixel[3] = 1;
+
+               if (fits_write_pix(output_area.fptr, TDOUBLE, fpixel, output.naxes[0],
+                                  (void *)(outarea + (nplane-1) * output.naxes[0]), &status))
+               {
+                  mAddCube_printFitsError(status);
+                  strcpy(returnStruct->msg,  montage_msgstr);
+                  return returnStruct;
+               }
+            }
          }
       }
+   }
 
-      fpixel[2] = 1;
-      fpixel[3] = 1;
-
-      if (fits_write_pix(output_area.fptr, TDOUBLE, fpixel, nelements,
-                         (void *)(&outarealine[0]), &status))
+   for(t=0; t<nthread; ++t)
+   {
+      for (i = 0; i < output.naxes[0]; ++i)
       {
-         mAddCube_printFitsError(status);
-         strcpy(returnStruct->msg,  montage_msgstr);
-         return returnStruct;
+         free(work[t].dataline[i]);
+         free(work[t].arealine[i]);
       }
+
+      free(work[t].dataline);
+      free(work[t].arealine);
+      free(work[t].datacount);
+      free(work[t].sorted);
+      free(work[t].sortedarea);
+   }
+
+   for(j=0; j<maxContrib; ++j)
+   {
+      free(slab[j]);
+      free(arearow[j]);
    }
 
+   for (lineout=1; lineout<=output.naxes[1]; ++lineout)
+      free(lineFiles[lineout-1]);
+
+   free(threads);
+   free(work);
+   free(slab);
+   free(arearow);
+   free(nz);
+   free(nelem);
+   free(offset);
+   free(outdata);
+   free(outarea);
+   free(lineCount);
+   free(lineFiles);
    if(debug >= 1)
    {
       time(&currtime);
@@ -2004,6 +1857,310 @@ struct mAddCubeReturn *mAddCube(char *path, char *tblfile, char *template_file,
 }
 
 
+/*******************************************************/
+/*                                                     */
+/*  Open an input file (and its area file) and, the    */
+/*  first time, check its WCS against the template.    */
+/*                                                     */
+/*******************************************************/
+
+int mAddCube_openFile(int ifile, char *infile, char *inarea, int haveAreas)
+{
+   char  errstr[MAXSTR];
+   char *inputHeader;
+
+   ++open_files;
+
+   if (open_files > MAXFITS)
+   {
+      sprintf(montage_msgstr, "Too many open files");
+
+      remove(output_file);               
+      remove(output_area_file);               
+
+      return 1;
+   }
+
+   status = 0;
+   if(fits_open_file(&input[ifile].fptr, infile, READONLY, &status))
+   {
+      sprintf(errstr, "Image file %s missing or invalid FITS", infile);
+      mAddCube_printError(errstr);
+      return 1;
+   }
+
+   if(debug >= 2)
+   {
+      printf("Open:  %4d\n", ifile); 
+      fflush(stdout);
+   }
+
+   input[ifile].isopen = 1;
+
+   if(haveAreas)
+   {
+      ++open_files;
+
+      if (open_files > MAXFITS)
+      {
+         sprintf(montage_msgstr, "Too many open files");
+
+         remove(output_file);               
+         remove(output_area_file);               
+
+         return 1;
+      }
+
+      if(fits_open_file(&input_area[ifile].fptr, inarea, READONLY, &status))
+      {
+         sprintf(errstr, "Area file %s missing or invalid FITS", inarea);
+         mAddCube_printError(errstr);
+         return 1;
+      }
+
+      input_area[ifile].isopen = 1;
+   }
+
+   if(input[ifile].checked)
+      return 0;
+
+
+   /* Get the WCS and check it against */
+   /* the one for the header template  */
+
+   if(fits_get_image_wcs_keys(input[ifile].fptr, &inputHeader, &status))
+   {
+      mAddCube_printFitsError(status);
+      return 1;
+   }
+
+   if(debug >= 3)
+   {
+      printf("Input header to wcsinit() [imgWCS]:\n%s\n", inputHeader);
+      fflush(stdout);
+   }
+
+   imgWCS = wcsinit(inputHeader);
+
+   free(inputHeader);
+
+   if(imgWCS == (struct WorldCoor *)NULL)
+   {
+      sprintf(montage_msgstr, "Input wcsinit() failed.");
+      return 1;
+   }
+
+   if(strcmp(imgWCS->c1type, hdrWCS->c1type) != 0)
+   {
+      sprintf(errstr, "Image %s header CTYPE1 does not match template", infile);
+      mAddCube_printError(errstr);
+      return 1;
+   }
+
+   if(strcmp(imgWCS->c2type, hdrWCS->c2type) != 0)
+   {
+      sprintf(errstr, "Image %s header CTYPE2 does not match template", infile);
+      mAddCube_printError(errstr);
+      return 1;
+   }
+
+   if(fabs(imgWCS->xref - hdrWCS->xref) > 1.e-8)
+   {
+      sprintf(errstr, "Image %s header CRVAL1 does not match template", infile);
+      mAddCube_printError(errstr);
+      return 1;
+   }
+
+   if(fabs(imgWCS->yref - hdrWCS->yref) > 1.e-8)
+   {
+      sprintf(errstr, "Image %s header CRVAL2 does not match template", infile);
+      mAddCube_printError(errstr);
+      return 1;
+   }
+
+   if(fabs(imgWCS->cd[0] - hdrWCS->cd[0]) > 1.e-8
+   || fabs(imgWCS->cd[1] - hdrWCS->cd[1]) > 1.e-8
+   || fabs(imgWCS->cd[2] - hdrWCS->cd[2]) > 1.e-8
+   || fabs(imgWCS->cd[3] - hdrWCS->cd[3]) > 1.e-8)
+   {
+      sprintf(errstr, "Image %s header CD/CDELT does not match template", infile);
+      mAddCube_printError(errstr);
+      return 1;
+   }
+
+   if(imgWCS->equinox != hdrWCS->equinox)
+   {
+      sprintf(errstr, "Image %s header EQUINOX does not match template", infile);
+      mAddCube_printError(errstr);
+      return 1;
+   }
+
+   wcsfree(imgWCS);
+
+   input[ifile].checked = 1;
+
+   return 0;
+}
+
+
+/*******************************************************/
+/*                                                     */
+/*  Close an input file (and its area file).           */
+/*                                                     */
+/*******************************************************/
+
+int mAddCube_closeFile(int ifile, int haveAreas)
+{
+   status = 0;
+
+   if(input[ifile].isopen)
+   {
+      if(fits_close_file(input[ifile].fptr, &status))
+      {
+         mAddCube_printFitsError(status);
+         return 1;
+      }
+
+      if(debug >= 2)
+      {
+         printf("Close: %4d\n", ifile); 
+         fflush(stdout);
+      }
+
+      input[ifile].isopen = 0;
+
+      --open_files;
+   }
+  
+   if(haveAreas && input_area[ifile].isopen)
+   {
+      if(fits_close_file(input_area[ifile].fptr, &status))
+      {
+         mAddCube_printFitsError(status);
+         return 1;
+      }
+
+      input_area[ifile].isopen = 0;
+
+      --open_files;
+   }
+
+   return 0;
+}
+
+
+/*******************************************************/
+/*                                                     */
+/*  Thread body: stack and average the pixels of this  */
+/*  thread's share of the planes in the current chunk  */
+/*  for the current output line.  The files are added  */
+/*  to the stacks in contributor order, so the result  */
+/*  does not depend on the number of threads.          */
+/*                                                     */
+/*******************************************************/
+
+void *mAddCube_planes(void *ptr)
+{
+   int     i, j, k, ipix, jcnt, naxis1;
+   int     avg_status;
+   double *data, *area;
+   double *outdata, *outarea;
+
+   struct cubeWork *work;
+
+   work = (struct cubeWork *)ptr;
+
+   naxis1 = work->naxis1;
+
+   for(k=work->start; k<work->nplane; k+=work->stride)
+   {
+      for(i=0; i<naxis1; ++i)
+         work->datacount[i] = 0;
+
+      for(j=0; j<work->ncontrib; ++j)
+      {
+         if(k >= work->nz[j])
+            continue;
+
+         data = work->slab[j] + (long)k * work->nelem[j];
+         area = work->arearow[j];
+
+         for (i = 0; i<work->nelem[j]; ++i)
+         {
+            /***********************************/
+            /* If there's not a value here, we */
+            /* won't add anything to dataline  */
+            /***********************************/
+    
+            if (mNaN(data[i]) || area[i] <= 0.)
+               continue;
+             
+            /* Are we off the image? */
+              
+            ipix = i + work->offset[j];
+
+            if (ipix <      0) continue;
+            if (ipix >= naxis1) continue;
+
+            jcnt = work->datacount[ipix];
+
+            work->dataline[ipix][jcnt] = data[i];
+            work->arealine[ipix][jcnt] = area[i];
+
+            ++work->datacount[ipix];
+         }
+      }
+
+
+      /**********************************/
+      /* Average each "stack" of pixels */
+      /* according to the user-chosen   */
+      /* averaging method               */
+      /**********************************/
+
+      outdata = work->outdata + (long)k * naxis1;
+      outarea = work->outarea + (long)k * naxis1;
+
+      for (i = 0; i<naxis1; ++i)
+      {
+         outdata[i] = 0;
+         outarea[i] = 0;
+
+         avg_status = 0;
+
+         if(work->datacount[i] > 0)
+         {
+            if (work->coadd == MEAN)
+               avg_status = mAddCube_avg_mean(work->dataline[i], work->arealine[i], 
+                  &outdata[i], &outarea[i], work->datacount[i]);
+
+            else if (work->coadd == MEDIAN)
+               avg_status = mAddCube_median(work->dataline[i], work->arealine[i], 
+                  &outdata[i], &outarea[i], work->datacount[i], work->nominal_area,
+                  work->sorted, work->sortedarea);
+
+            else if (work->coadd == COUNT)
+               avg_status = mAddCube_avg_count(work->dataline[i], work->arealine[i], 
+                  &outdata[i], &outarea[i], work->datacount[i]);
+
+            if (avg_status)
+            {
+               outdata[i] = work->nan;
+               outarea[i] = 0;
+            }
+         }
+         else
+         {
+            outdata[i] = work->nan;
+            outarea[i] = 0;
+         }
+      }
+   }
+
+   return NULL;
+}
+
+
 /**************************************************/
 /*                                                */
 /*  Read the output header template file.         */
@@ -2305,8 +2462,6 @@ int mAddCube_avg_median(double data[], double area[], double *outdata, double *o
    static double *sorted;
    static double *sortedarea;
 
-   int i, nsort;
-
    if(nalloc == 0)
    {
       nalloc = 1024;
@@ -2334,6 +2489,20 @@ int mAddCube_avg_median(double data[], double area[], double *outdata, double *o
       }
    }
 
+   return mAddCube_median(data, area, outdata, outarea, n, nom_area, sorted, sortedarea);
+}
+
+
+/**********************************************************/
+/* Median, with the caller supplying the work space (at   */
+/* least n values each); safe to use from the threads.    */
+/**********************************************************/
+
+int mAddCube_median(double data[], double area[], double *outdata, double *outarea, int n, double nom_area,
+                    double *sorted, double *sortedarea)
+{
+   int i, nsort;
+
 
    /**********************************************/
    /* Pick out the pixels that cover the defined */
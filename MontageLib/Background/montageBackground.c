@@ -45,12 +45,14 @@ Version  Developer        Date     Change
 #define MAXSTR  256
 
 static int  noAreas;
+static int  inMemory;
 
 static struct
 {
-   fitsfile *fptr;
-   long      naxes[2];
-   double    crpix1, crpix2;
+   fitsfile      *fptr;
+   struct mImage *image;
+   long           naxes[2];
+   double         crpix1, crpix2;
 }
 input, input_area, output, output_area;
 
@@ -58,6 +60,10 @@ static time_t currtime, start;
 
 static char montage_msgstr[1024];
 
+static struct mBackgroundReturn *mBackground_run(char *input_file, char *ofile,
+                                                 double A, double B, double C,
+                                                 int noAreasin, int debug);
+
 
 /*-***********************************************************************/
 /*                                                                       */
@@ -89,6 +95,80 @@ static char montage_msgstr[1024];
 /*************************************************************************/
 
 struct mBackgroundReturn *mBackground(char *input_file, char *ofile, double A, double B, double C, int noAreasin, int debug)
+{
+   inMemory = 0;
+
+   input.image       = (struct mImage *)NULL;
+   input_area.image  = (struct mImage *)NULL;
+   output.image      = (struct mImage *)NULL;
+   output_area.image = (struct mImage *)NULL;
+
+   return mBackground_run(input_file, ofile, A, B, C, noAreasin, debug);
+}
+
+
+
+/*-***********************************************************************/
+/*                                                                       */
+/*  mBackgroundMem                                                       */
+/*                                                                       */
+/*  The same, for images in memory.  The input pixels are read in place; */
+/*  the output image (and area image, if asked for) is returned in       */
+/*  memory, to be freed with montage_imageFree().  Areas are processed   */
+/*  only if the input area image is given.                               */
+/*                                                                       */
+/*   struct mImage  *input     Input image                               */
+/*   struct mImage  *inarea    Input area image (or NULL)                */
+/*   struct mImage **output    Returned background-removed image         */
+/*   struct mImage **area      Returned area image (NULL if not wanted)  */
+/*                                                                       */
+/*   double A, B, C            Background plane (A*x + B*y + C)          */
+/*   int    debug              Debugging output level                    */
+/*                                                                       */
+/*************************************************************************/
+
+struct mBackgroundReturn *mBackgroundMem(struct mImage *input_image, struct mImage *inarea,
+                                         struct mImage **outimage, struct mImage **outarea,
+                                         double A, double B, double C, int debug)
+{
+   struct mBackgroundReturn *returnStruct;
+
+   inMemory = 1;
+
+   input.image       = input_image;
+   input_area.image  = inarea;
+   output.image      = (struct mImage *)NULL;
+   output_area.image = (struct mImage *)NULL;
+
+   returnStruct = mBackground_run("(memory)", "(memory)", A, B, C,
+                                  inarea == (struct mImage *)NULL, debug);
+
+   if(returnStruct->status)
+   {
+      montage_imageFree(output.image);
+      montage_imageFree(output_area.image);
+
+      output.image      = (struct mImage *)NULL;
+      output_area.image = (struct mImage *)NULL;
+   }
+
+   *outimage = output.image;
+
+   if(outarea)
+      *outarea = output_area.image;
+   else
+      montage_imageFree(output_area.image);
+
+   return returnStruct;
+}
+
+
+
+/* The processing, for files or (inMemory) images in memory */
+
+static struct mBackgroundReturn *mBackground_run(char *input_file, char *ofile,
+                                                 double A, double B, double C,
+                                                 int noAreasin, int debug)
 {
    int       i, j, status;
    long      fpixel[4], nelements;
@@ -199,6 +279,8 @@ struct mBackgroundReturn *mBackground(char *input_file, char *ofile, double A, d
    time(&currtime);
    start = currtime;
 
+   montage_statsStart("mBackground");
+
    if(mBackground_readFits(infile, inarea) > 0)
    {
       strcpy(returnStruct->msg, montage_msgstr);
@@ -349,13 +431,17 @@ struct mBackgroundReturn *mBackground(char *input_file, char *ofile, double A, d
       /* Read a line from the input file */
       /***********************************/
 
-      if(fits_read_pix(input.fptr, TDOUBLE, fpixel, nelements, &nan,
-                       buffer, &nullcnt, &status))
+      montage_phaseBegin("read");
+
+      if(montage_readPix(input.fptr, input.image, TDOUBLE, fpixel, nelements, &nan,
+                         buffer, &nullcnt, &status))
       {
          mBackground_printFitsError(status);
          strcpy(returnStruct->msg, montage_msgstr);
          return returnStruct;
       }
+
+      montage_countRead(input.fptr, nelements);
       
       if(noAreas)
       {
@@ -364,22 +450,30 @@ struct mBackgroundReturn *mBackground(char *input_file, char *ofile, double A, d
       }
       else
       {
-         if(fits_read_pix(input_area.fptr, TDOUBLE, fpixel, nelements, &nan,
-                          abuffer, &nullcnt, &status))
+         if(montage_readPix(input_area.fptr, input_area.image, TDOUBLE, fpixel, nelements, &nan,
+                            abuffer, &nullcnt, &status))
          {
             mBackground_printFitsError(status);
             strcpy(returnStruct->msg, montage_msgstr);
             return returnStruct;
          }
+
+         montage_countRead(input_area.fptr, nelements);
       }
       
       ++fpixel[1];
 
+      montage_phaseEnd("read");
+
+      montage_countPixels(nelements);
+
 
       /************************/
       /* For each input pixel */
       /************************/
 
+      montage_phaseBegin("correct");
+
       for (i=0; i<input.naxes[0]; ++i)
       {
          x = i - input.crpix1;
@@ -408,6 +502,8 @@ struct mBackgroundReturn *mBackground(char *input_file, char *ofile, double A, d
             fflush(stdout);
          }
       }
+
+      montage_phaseEnd("correct");
    }
 
    free(buffer);
@@ -426,9 +522,16 @@ struct mBackgroundReturn *mBackground(char *input_file, char *ofile, double A, d
    /* Create the output FITS files */
    /********************************/
 
-   remove(output_file);               
+   if(inMemory)
+      fits_create_file(&output.fptr, "mem://", &status);
+   else
+   {
+      remove(output_file);               
+
+      fits_create_file(&output.fptr, output_file, &status);
+   }
 
-   if(fits_create_file(&output.fptr, output_file, &status)) 
+   if(status)
    {
       mBackground_printFitsError(status);           
       strcpy(returnStruct->msg, montage_msgstr);
@@ -437,9 +540,16 @@ struct mBackgroundReturn *mBackground(char *input_file, char *ofile, double A, d
 
    if(!noAreas)
    {
-      remove(output_area_file);               
+      if(inMemory)
+         fits_create_file(&output_area.fptr, "mem://", &status);
+      else
+      {
+         remove(output_area_file);               
+
+         fits_create_file(&output_area.fptr, output_area_file, &status);
+      }
 
-      if(fits_create_file(&output_area.fptr, output_area_file, &status)) 
+      if(status)
       {
          mBackground_printFitsError(status);           
          strcpy(returnStruct->msg, montage_msgstr);
@@ -459,7 +569,7 @@ struct mBackgroundReturn *mBackground(char *input_file, char *ofile, double A, d
    /* from the input to the output */
    /********************************/
 
-   if(fits_copy_header(input.fptr, output.fptr, &status))
+   if(montage_copyHeader(input.fptr, output.fptr, &status))
    {
       mBackground_printFitsError(status);           
       strcpy(returnStruct->msg, montage_msgstr);
@@ -468,7 +578,7 @@ struct mBackgroundReturn *mBackground(char *input_file, char *ofile, double A, d
 
    if(!noAreas)
    {
-      if(fits_copy_header(input.fptr, output_area.fptr, &status))
+      if(montage_copyHeader(input.fptr, output_area.fptr, &status))
       {
          mBackground_printFitsError(status);           
          strcpy(returnStruct->msg, montage_msgstr);
@@ -482,7 +592,7 @@ struct mBackgroundReturn *mBackground(char *input_file, char *ofile, double A, d
       fflush(stdout);
    }
 
-   if(fits_close_file(input.fptr, &status))
+   if(montage_closeInput(input.fptr, input.image, &status))
    {
       mBackground_printFitsError(status);
       strcpy(returnStruct->msg, montage_msgstr);
@@ -490,7 +600,7 @@ struct mBackgroundReturn *mBackground(char *input_file, char *ofile, double A, d
    }
 
    if(!noAreas)
-      if(fits_close_file(input_area.fptr, &status))
+      if(montage_closeInput(input_area.fptr, input_area.image, &status))
       {
          mBackground_printFitsError(status);
          strcpy(returnStruct->msg, montage_msgstr);
@@ -521,18 +631,35 @@ struct mBackgroundReturn *mBackground(char *input_file, char *ofile, double A, d
       }
    }
 
+   if(inMemory)
+   {
+      montage_memOutput(output.fptr, &output.image, &status);
+
+      if(!noAreas)
+         montage_memOutput(output_area.fptr, &output_area.image, &status);
+
+      if(status)
+      {
+         mBackground_printFitsError(status);
+         strcpy(returnStruct->msg, montage_msgstr);
+         return returnStruct;
+      }
+   }
+
 
    /************************/
    /* Write the image data */
    /************************/
 
+   montage_phaseBegin("write");
+
    fpixel[0] = 1;
    fpixel[1] = 1;
    nelements = output.naxes[0];
 
    for(j=0; j<output.naxes[1]; ++j)
    {
-      if (fits_write_pix(output.fptr, TDOUBLE, fpixel, nelements, 
+      if (montage_putPix(output.fptr, output.image, TDOUBLE, fpixel, nelements, 
                          (void *)(&data[j][0]), &status))
       {
          mBackground_printFitsError(status);
@@ -540,6 +667,8 @@ struct mBackgroundReturn *mBackground(char *input_file, char *ofile, double A, d
          return returnStruct;
       }
 
+      montage_countWrite(output.fptr, nelements);
+
       ++fpixel[1];
    }
 
@@ -564,7 +693,7 @@ struct mBackgroundReturn *mBackground(char *input_file, char *ofile, double A, d
 
       for(j=0; j<output.naxes[1]; ++j)
       {
-         if (fits_write_pix(output_area.fptr, TDOUBLE, fpixel, nelements,
+         if (montage_putPix(output_area.fptr, output_area.image, TDOUBLE, fpixel, nelements,
                             (void *)(&area[j][0]), &status))
          {
             mBackground_printFitsError(status);
@@ -572,6 +701,8 @@ struct mBackgroundReturn *mBackground(char *input_file, char *ofile, double A, d
             return returnStruct;
          }
 
+         montage_countWrite(output_area.fptr, nelements);
+
          ++fpixel[1];
       }
 
@@ -589,7 +720,7 @@ struct mBackgroundReturn *mBackground(char *input_file, char *ofile, double A, d
    /* Close the FITS file */
    /***********************/
 
-   if(fits_close_file(output.fptr, &status))
+   if(montage_closeOutput(output.fptr, output.image, &status))
    {
       mBackground_printFitsError(status);           
       strcpy(returnStruct->msg, montage_msgstr);
@@ -604,7 +735,7 @@ struct mBackgroundReturn *mBackground(char *input_file, char *ofile, double A, d
 
    if(!noAreas)
    {
-      if(fits_close_file(output_area.fptr, &status))
+      if(montage_closeOutput(output_area.fptr, output_area.image, &status))
       {
          mBackground_printFitsError(status);           
          strcpy(returnStruct->msg, montage_msgstr);
@@ -618,12 +749,14 @@ struct mBackgroundReturn *mBackground(char *input_file, char *ofile, double A, d
       }
    }
 
+   montage_phaseEnd("write");
+
    time(&currtime);
 
    returnStruct->status = 0;
 
-   sprintf(returnStruct->msg,    "time=%.1f",    (double)(currtime - start));
-   sprintf(returnStruct->json, "{\"time\":%.1f}", (double)(currtime - start));
+   sprintf(returnStruct->msg,    "time=%.1f",        (double)(currtime - start));
+   sprintf(returnStruct->json, "{\"time\":%.1f, %s}", (double)(currtime - start), montage_statsEnd());
 
    returnStruct->time  = (double)(currtime - start);
 
@@ -649,17 +782,23 @@ int mBackground_readFits(char *fluxfile, char *areafile)
 
    status = 0;
 
-   checkHdr =montage_checkHdr(fluxfile, 0, 0);
-
-   if(checkHdr)
+   if(inMemory)
    {
-      strcpy(montage_msgstr, checkHdr);
-      return 1;
-   }
+      if(!noAreas && montage_memOpen(&input_area.fptr, input_area.image, &status))
+      {
+         mBackground_printError("Invalid input area image");
+         return 1;
+      }
 
-   if(!noAreas)
+      if(montage_memOpen(&input.fptr, input.image, &status))
+      {
+         mBackground_printError("Invalid input image");
+         return 1;
+      }
+   }
+   else
    {
-      checkHdr = montage_checkHdr(areafile, 0, 0);
+      checkHdr = montage_checkHdr(fluxfile, 0, 0);
 
       if(checkHdr)
       {
@@ -667,22 +806,33 @@ int mBackground_readFits(char *fluxfile, char *areafile)
          return 1;
       }
 
-      if(fits_open_file(&input_area.fptr, areafile, READONLY, &status))
+      if(!noAreas)
+      {
+         checkHdr = montage_checkHdr(areafile, 0, 0);
+
+         if(checkHdr)
+         {
+            strcpy(montage_msgstr, checkHdr);
+            return 1;
+         }
+
+         if(fits_open_image(&input_area.fptr, areafile, READONLY, &status))
+         {
+            sprintf(errstr, "Area file %s missing or invalid FITS", areafile);
+            mBackground_printError(errstr);
+            return 1;
+         }
+      }
+
+      if(fits_open_image(&input.fptr, fluxfile, READONLY, &status))
       {
-         sprintf(errstr, "Area file %s missing or invalid FITS", areafile);
+         sprintf(errstr, "Image file %s missing or invalid FITS", fluxfile);
          mBackground_printError(errstr);
          return 1;
       }
    }
 
-   if(fits_open_file(&input.fptr, fluxfile, READONLY, &status))
-   {
-      sprintf(errstr, "Image file %s missing or invalid FITS", fluxfile);
-      mBackground_printError(errstr);
-      return 1;
-   }
-
-   if(fits_read_keys_lng(input.fptr, "NAXIS", 1, 2, naxes, &nfound, &status))
+   if(fits_get_img_size(input.fptr, 2, naxes, &status))
    {
       mBackground_printFitsError(status);
       return 1;
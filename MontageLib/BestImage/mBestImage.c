@@ -71,9 +71,28 @@ int main(int argc, char **argv)
       }
    }
 
-   if (argc < 3) 
+   /* Build a spatial index for the table, to be */
+   /* used by later runs against the same table  */
+
+   if(argc == 3 && strcmp(argv[1], "-index") == 0)
+   {
+      returnStruct = mBestImageIndex(argv[2], debug);
+
+      if(returnStruct->status == 1)
+      {
+         fprintf(montage_status, "[struct stat=\"ERROR\", msg=\"%s\"]\n", returnStruct->msg);
+         exit(1);
+      }
+      else
+      {
+         fprintf(montage_status, "[struct stat=\"OK\", %s]\n", returnStruct->msg);
+         exit(0);
+      }
+   }
+
+   if (argc < 4) 
    {
-      printf("[struct stat=\"ERROR\", msg=\"Usage: mBestImages [-d] images.tbl ra dec\"]\n");
+      printf("[struct stat=\"ERROR\", msg=\"Usage: mBestImages [-d] images.tbl ra dec | mBestImage -index images.tbl\"]\n");
       exit(1);
    }
 
@@ -29,8 +29,7 @@ Version  Developer        Date     Change
 
 int debugCheck(char *debugStr);
 
-static char montage_msgstr[1024];
-static char montage_json  [1024];
+static struct montage_tableIndex *mBestImage_buildIndex = (struct montage_tableIndex *)NULL;
 
 
 /*-***********************************************************************/
@@ -64,6 +63,12 @@ struct mBestImageReturn *mBestImage(char *tblfile, double ra, double dec, int de
    double ra4, dec4;
    int    index[4];
 
+   long   recoff, ncand, icand;
+   long  *cand, *candoff;
+   char   idxfile[1024];
+
+   struct montage_tableIndex *tblindex;
+
    char   bestURL [MAXSTR];
    char   bestName[MAXSTR];
 
@@ -162,7 +167,7 @@ struct mBestImageReturn *mBestImage(char *tblfile, double ra, double dec, int de
 
    if(ncols <= 0)
    {
-      sprintf(montage_msgstr, "Invalid image metadata file: %s", tblfile);
+      sprintf(returnStruct->msg, "Invalid image metadata file: %s", tblfile);
       return returnStruct;
    }
 
@@ -256,17 +261,66 @@ struct mBestImageReturn *mBestImage(char *tblfile, double ra, double dec, int de
 
 
 
+   /****************************************************/ 
+   /* If there is an up-to-date spatial index for the  */
+   /* table, we only need to look at the records whose */
+   /* bounding circles contain the point, in table     */
+   /* order (so ties are resolved as in a full scan).  */
+   /****************************************************/ 
+
+   ncand   = -1;
+   icand   =  0;
+   cand    = (long *)NULL;
+   candoff = (long *)NULL;
+
+   if(mBestImage_buildIndex == (struct montage_tableIndex *)NULL)
+   {
+      sprintf(idxfile, "%s.bestidx", tblfile);
+
+      tblindex = montage_indexOpen(idxfile, tblfile, "mBestImage");
+
+      if(tblindex)
+      {
+         ncand = montage_indexSearch(tblindex, point.x, point.y, point.z, 0., &cand, &candoff);
+
+         montage_indexClose(tblindex);
+
+         if(debug)
+         {
+            printf("\nIndex %s: %ld candidate records\n\n", idxfile, ncand);
+            fflush(stdout);
+         }
+      }
+   }
+
+
    /***********************************/ 
    /* Read the projection information */ 
    /***********************************/ 
 
    nimages = 0;
 
+   bestdist = -1.;
+
    strcpy(bestName, "No name");
    strcpy(bestURL,  "No URL");
 
    while(1)
    {
+      if(ncand >= 0)
+      {
+         if(icand >= ncand)
+            break;
+
+         tseekpos(candoff[icand]);
+
+         nimages = cand[icand];
+
+         ++icand;
+      }
+
+      recoff = ttell();
+
       stat = tread();
 
       if(stat < 0)
@@ -555,6 +609,21 @@ struct mBestImageReturn *mBestImage(char *tblfile, double ra, double dec, int de
       }
 
 
+      /* If we are building an index, all we need */
+      /* is the bounding circle                   */
+
+      if(mBestImage_buildIndex)
+      {
+         if(montage_indexAdd(mBestImage_buildIndex, recoff, center.x, center.y, center.z, maxRadius))
+         {
+            sprintf(returnStruct->msg, "Cannot allocate memory for index.");
+            return returnStruct;
+         }
+
+         continue;
+      }
+
+
       /* Normals to the image "sides" */
 
       for(i=0; i<4; ++i)
@@ -681,6 +750,15 @@ struct mBestImageReturn *mBestImage(char *tblfile, double ra, double dec, int de
       }
    }
 
+   free(cand);
+   free(candoff);
+
+   if(mBestImage_buildIndex)
+   {
+      returnStruct->status = 0;
+      return returnStruct;
+   }
+
    if(strcmp(bestName, "No name") == 0)
    {
       sprintf(returnStruct->msg, "No image covers this point");
@@ -694,8 +772,10 @@ struct mBestImageReturn *mBestImage(char *tblfile, double ra, double dec, int de
    if(iurl < 0)
       strcpy(bestURL, "");
 
-   sprintf(montage_msgstr, "file=\"%s\", hdu=%d, url=\"%s\", edgedist=%.6f", bestName, bestHDU, bestURL, bestdist);
-   sprintf(montage_json, "{\"file\":\"%s\", \"hdu\":%d, \"url\":\"%s\", \"edgedist\":%.6f}", bestName, bestHDU, bestURL, bestdist);
+   returnStruct->status = 0;
+
+   sprintf(returnStruct->msg, "file=\"%s\", hdu=%d, url=\"%s\", edgedist=%.6f", bestName, bestHDU, bestURL, bestdist);
+   sprintf(returnStruct->json, "{\"file\":\"%s\", \"hdu\":%d, \"url\":\"%s\", \"edgedist\":%.6f}", bestName, bestHDU, bestURL, bestdist);
 
    strcpy(returnStruct->file, bestName);
 
@@ -709,6 +789,88 @@ struct mBestImageReturn *mBestImage(char *tblfile, double ra, double dec, int de
 }
 
 
+
+/*-***********************************************************************/
+/*                                                                       */
+/*  mBestImageIndex                                                      */
+/*                                                                       */
+/*  Build the spatial index for an image metadata table, so that later   */
+/*  mBestImage calls on the same (unchanged) table read only the records */
+/*  whose bounding circles contain the point.  The index is written      */
+/*  next to the table as <tblfile>.bestidx and is ignored if the table   */
+/*  is changed.                                                          */
+/*                                                                       */
+/*   char   *tblfile    Input image metadata file                        */
+/*   int     debug      Debugging flag                                   */
+/*                                                                       */
+/*************************************************************************/
+
+struct mBestImageReturn *mBestImageIndex(char *tblfile, int debug)
+{
+   long  nrec;
+   char  idxfile[1024];
+
+   struct mBestImageReturn *returnStruct;
+
+
+   /* Run through the table once, collecting the */
+   /* same bounding circles the check above uses */
+
+   mBestImage_buildIndex = montage_indexNew();
+
+   if(mBestImage_buildIndex == (struct montage_tableIndex *)NULL)
+   {
+      returnStruct = (struct mBestImageReturn *)malloc(sizeof(struct mBestImageReturn));
+
+      bzero((void *)returnStruct, sizeof(struct mBestImageReturn));
+
+      returnStruct->status = 1;
+
+      strcpy(returnStruct->msg, "Cannot allocate memory for index.");
+
+      return returnStruct;
+   }
+
+   returnStruct = mBestImage(tblfile, 0., 0., debug);
+
+   if(returnStruct->status)
+   {
+      montage_indexClose(mBestImage_buildIndex);
+
+      mBestImage_buildIndex = (struct montage_tableIndex *)NULL;
+
+      return returnStruct;
+   }
+
+
+   /* Pack the tree and write it out */
+
+   sprintf(idxfile, "%s.bestidx", tblfile);
+
+   nrec = montage_indexCount(mBestImage_buildIndex);
+
+   if(montage_indexWrite(mBestImage_buildIndex, idxfile, tblfile, "mBestImage"))
+   {
+      montage_indexClose(mBestImage_buildIndex);
+
+      mBestImage_buildIndex = (struct montage_tableIndex *)NULL;
+
+      returnStruct->status = 1;
+
+      strcpy(returnStruct->msg, "Cannot write index file.");
+
+      return returnStruct;
+   }
+
+   mBestImage_buildIndex = (struct montage_tableIndex *)NULL;
+
+   sprintf(returnStruct->msg,  "count=%ld",       nrec);
+   sprintf(returnStruct->json, "{\"count\":%ld}", nrec);
+
+   return returnStruct;
+}
+
+
 int mBestImage_stradd(char *header, char *card)
 {
    int i;
@@ -24,6 +24,7 @@ int main(int argc, char **argv)
    char    imgfile[MAXSTR];
    char    fitfile[MAXSTR];
    char    corrtbl[MAXSTR];
+   char    initfile[MAXSTR];
 
    char   *end;
 
@@ -41,11 +42,13 @@ int main(int argc, char **argv)
    useall     = 0;
    niteration = 10000;
 
+   strcpy(initfile, "");
+
    opterr = 0;
 
    montage_status = stdout;
 
-   while ((c = getopt(argc, argv, "ai:r:s:ld:")) != EOF) 
+   while ((c = getopt(argc, argv, "ai:r:s:w:ld:")) != EOF) 
    {
       switch (c) 
       {
@@ -84,6 +87,10 @@ int main(int argc, char **argv)
             noslope = 1;
             break;
 
+         case 'w':
+            strcpy(initfile, optarg);
+            break;
+
          case 'd':
             debug = montage_debugCheck(optarg);
 
@@ -95,7 +102,7 @@ int main(int argc, char **argv)
             break;
 
          default:
-            printf ("[struct stat=\"ERROR\", msg=\"Usage: %s [-i niter] [-l(evel-only)] [-d level] [-a(ll-overlaps)] [-s statusfile] images.tbl fits.tbl corrections.tbl\"]\n", argv[0]);
+            printf ("[struct stat=\"ERROR\", msg=\"Usage: %s [-i niter] [-l(evel-only)] [-d level] [-a(ll-overlaps)] [-w initcorrs.tbl] [-s statusfile] images.tbl fits.tbl corrections.tbl\"]\n", argv[0]);
             exit(1);
             break;
       }
@@ -103,7 +110,7 @@ int main(int argc, char **argv)
 
    if (argc - optind < 3) 
    {
-      printf ("[struct stat=\"ERROR\", msg=\"Usage: %s [-i niter] [-l(evel-only)] [-d level] [-a(ll-overlaps)] [-s statusfile] images.tbl fits.tbl corrections.tbl\"]\n", argv[0]);
+      printf ("[struct stat=\"ERROR\", msg=\"Usage: %s [-i niter] [-l(evel-only)] [-d level] [-a(ll-overlaps)] [-w initcorrs.tbl] [-s statusfile] images.tbl fits.tbl corrections.tbl\"]\n", argv[0]);
       exit(1);
    }
 
@@ -111,7 +118,7 @@ int main(int argc, char **argv)
    strcpy(fitfile, argv[optind + 1]);
    strcpy(corrtbl, argv[optind + 2]);
 
-   returnStruct = mBgModel(imgfile, fitfile, corrtbl, noslope, useall, niteration, debug);
+   returnStruct = mBgModelWarm(imgfile, fitfile, corrtbl, initfile, noslope, useall, niteration, debug);
 
    if(returnStruct->status == 1)
    {
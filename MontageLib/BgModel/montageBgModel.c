@@ -65,6 +65,8 @@ Version  Developer        Date     Change
 #define SLOPE 1
 #define BOTH  2
 
+#define CONVERGE 1.e-6
+
 #define SWAP(a,b) {temp=(a);(a)=(b);(b)=temp;}
 
 
@@ -142,6 +144,11 @@ static struct CorrInfo
    double bcorrection;
    double ccorrection;
 
+   int    init;              /* Initial correction given (warm start) */
+   double a0;
+   double b0;
+   double c0;
+
    struct FitInfo **neighbors;
 
    int nneighbors;
@@ -177,6 +184,35 @@ static int ncorrs, maxcorrs;
 /*************************************************************************/
 
 struct mBgModelReturn *mBgModel(char *imgfile, char *fitfile, char *corrtbl, int noslope, int useall, int niter, int debug)
+{
+   return mBgModelWarm(imgfile, fitfile, corrtbl, (char *)NULL, noslope, useall, niter, debug);
+}
+
+
+
+/*-***********************************************************************/
+/*                                                                       */
+/*  mBgModelWarm                                                         */
+/*                                                                       */
+/*  The same model, but starting from a set of corrections (normally     */
+/*  the output of an earlier run on mostly the same images).  The        */
+/*  initial corrections are applied to the fits before iterating and,    */
+/*  since the levels have already been found, the level-only phase is    */
+/*  skipped.  Rather than always running the full iteration count we    */
+/*  stop as soon as the largest change to any image's plane over one     */
+/*  iteration is negligible compared to the noise in the fits.           */
+/*                                                                       */
+/*  Images missing from the initial table start at zero.                 */
+/*                                                                       */
+/*   char  *initfile       Initial corrections table (id, a, b, c).      */
+/*                         If NULL, this is just mBgModel().             */
+/*                                                                       */
+/*  (the other arguments are as for mBgModel)                            */
+/*                                                                       */
+/*************************************************************************/
+
+struct mBgModelReturn *mBgModelWarm(char *imgfile, char *fitfile, char *corrtbl, char *initfile, int noslope, 
+                                    int useall, int niter, int debug)
 {
    int     i, j, k, index, stat;
    int     ncols, iteration, istatus;
@@ -229,6 +265,9 @@ struct mBgModelReturn *mBgModel(char *imgfile, char *fitfile, char *corrtbl, int
    double  xisize1, yisize1;
    double  xisize2, yisize2;
 
+   double  change, maxchange, imgsize;
+   int     warm, iid, iinita, iinitb, iinitc;
+
    double  linearLimit = 0.25;
    double  sigmaLimit  = 2.00;
    double  areaLimit   = 0.002;
@@ -264,6 +303,9 @@ struct mBgModelReturn *mBgModel(char *imgfile, char *fitfile, char *corrtbl, int
 
    strcpy(returnStruct->msg, "");
 
+   montage_statsStart("mBgModel");
+   montage_phaseBegin("setup");
+
 
    /***************************************************************/
    /* Allocate matrix space (for solving least-squares equations) */
@@ -652,6 +694,8 @@ struct mBgModelReturn *mBgModel(char *imgfile, char *fitfile, char *corrtbl, int
       corrs[i].b = 0.;
       corrs[i].c = 0.;
 
+      corrs[i].init = 0;
+
       corrs[i].nneighbors = 0;
       corrs[i].maxneighbors = MAXCNT;
 
@@ -722,6 +766,8 @@ struct mBgModelReturn *mBgModel(char *imgfile, char *fitfile, char *corrtbl, int
                corrs[i].b = 0.;
                corrs[i].c = 0.;
 
+               corrs[i].init = 0;
+
                corrs[i].nneighbors = 0;
                corrs[i].maxneighbors = MAXCNT;
 
@@ -969,6 +1015,99 @@ struct mBgModelReturn *mBgModel(char *imgfile, char *fitfile, char *corrtbl, int
    }
 
 
+   montage_phaseEnd("setup");
+
+   montage_countOverlaps(nfits);
+
+   montage_phaseBegin("solve");
+
+
+   /***********************************************/
+   /* If we were given a starting set of          */
+   /* corrections, apply them to the images and   */
+   /* to the fits (just as an iteration would)    */
+   /***********************************************/
+
+   warm = 0;
+
+   if(initfile != (char *)NULL && strlen(initfile) > 0)
+   {
+      ncols = topen(initfile);
+
+      if(ncols <= 0)
+      {
+         sprintf(returnStruct->msg, "Invalid initial corrections file: %s", initfile);
+         return returnStruct;
+      }
+
+      iid    = tcol("id");
+      iinita = tcol("a");
+      iinitb = tcol("b");
+      iinitc = tcol("c");
+
+      if(iid    < 0
+      || iinita < 0
+      || iinitb < 0
+      || iinitc < 0)
+      {
+         sprintf(returnStruct->msg, "Need columns: id a b c in initial corrections file");
+         return returnStruct;
+      }
+
+      while(1)
+      {
+         stat = tread();
+
+         if(stat < 0)
+            break;
+
+         index = atoi(tval(iid));
+
+         for(i=0; i<ncorrs; ++i)
+         {
+            if(corrs[i].id == index)
+            {
+               corrs[i].a = atof(tval(iinita));
+               corrs[i].b = atof(tval(iinitb));
+               corrs[i].c = atof(tval(iinitc));
+
+               if(noslope)
+               {
+                  corrs[i].a = 0.;
+                  corrs[i].b = 0.;
+               }
+
+               corrs[i].init = 1;
+
+               corrs[i].a0 = corrs[i].a;
+               corrs[i].b0 = corrs[i].b;
+               corrs[i].c0 = corrs[i].c;
+
+               break;
+            }
+         }
+      }
+
+      tclose();
+
+      for(k=0; k<nfits; ++k)
+      {
+         fits[k].a += fits[k].minusimg->a - fits[k].plusimg->a;
+         fits[k].b += fits[k].minusimg->b - fits[k].plusimg->b;
+         fits[k].c += fits[k].minusimg->c - fits[k].plusimg->c;
+      }
+
+      warm = 1;
+
+      if(debug >= 1)
+      {
+         printf("Starting from corrections in %s\n", initfile);
+         fflush(stdout);
+      }
+   }
+
+   imgsize = sqrt(avearea);
+
    iteration = 0;
 
    while(1)
@@ -977,7 +1116,7 @@ struct mBgModelReturn *mBgModel(char *imgfile, char *fitfile, char *corrtbl, int
          fittype = LEVEL;
       else
       {
-         if(iteration < maxlevel)
+         if(iteration < maxlevel && !warm)
             fittype = LEVEL;
          else
             fittype = BOTH;
@@ -1334,9 +1473,86 @@ struct mBgModelReturn *mBgModel(char *imgfile, char *fitfile, char *corrtbl, int
 
       if(iteration >= niteration)
          break;
+
+
+      /*****************************************/
+      /* When warm-started, stop once nothing  */
+      /* is changing (the largest change to a  */
+      /* plane across a typical image is tiny  */
+      /* compared to the fit noise)            */
+      /*****************************************/
+
+      if(warm)
+      {
+         maxchange = 0.;
+
+         for(i=0; i<ncorrs; ++i)
+         {
+            change = (fabs(corrs[i].acorrection) + fabs(corrs[i].bcorrection)) * imgsize
+                    + fabs(corrs[i].ccorrection);
+
+            if(change > maxchange)
+               maxchange = change;
+         }
+
+         if(maxchange <= CONVERGE * averms)
+         {
+            if(debug >= 1)
+            {
+               printf("Converged after %d iterations (max change %-g)\n", iteration, maxchange);
+               fflush(stdout);
+            }
+
+            break;
+         }
+      }
+   }
+
+
+   /**************************************************/
+   /* The fits only constrain the corrections up to  */
+   /* a plane common to all the images (the planes   */
+   /* are in the shared projected pixel frame).  A   */
+   /* warm start can settle on a slightly different  */
+   /* one, so remove the average drift of the images */
+   /* that had initial corrections; that way images  */
+   /* away from any change keep their corrections.   */
+   /**************************************************/
+
+   if(warm)
+   {
+      sumn = 0.;
+      A    = 0.;
+      B    = 0.;
+      C    = 0.;
+
+      for(i=0; i<ncorrs; ++i)
+      {
+         if(corrs[i].init)
+         {
+            A += corrs[i].a - corrs[i].a0;
+            B += corrs[i].b - corrs[i].b0;
+            C += corrs[i].c - corrs[i].c0;
+
+            sumn += 1.;
+         }
+      }
+
+      if(sumn > 0.)
+      {
+         for(i=0; i<ncorrs; ++i)
+         {
+            corrs[i].a -= A / sumn;
+            corrs[i].b -= B / sumn;
+            corrs[i].c -= C / sumn;
+         }
+      }
    }
 
 
+   montage_phaseEnd("solve");
+
+
    /*********************************************/
    /* For each image, print out the final plane */
    /*********************************************/
@@ -1354,7 +1570,7 @@ struct mBgModelReturn *mBgModel(char *imgfile, char *fitfile, char *corrtbl, int
    returnStruct->status = 0;
 
    strcpy(returnStruct->msg,  "");
-   strcpy(returnStruct->json, "{}");
+   sprintf(returnStruct->json, "{%s}", montage_statsEnd());
 
    return returnStruct;
 }
@@ -25,6 +25,11 @@
 /*  mCoverageCheck swire.tbl region.tbl -header region.hdr               */
 /*  mCoverageCheck swire.tbl region.tbl -cutout 33. 25. 2.               */
 /*                                                                       */
+/*  For large tables that are searched repeatedly, a spatial index can   */
+/*  be built once (as swire.tbl.covidx) and is then used automatically:  */
+/*                                                                       */
+/*  mCoverageCheck -index swire.tbl                                      */
+/*                                                                       */
 /*************************************************************************/
 
 int main(int argc, char **argv) 
@@ -53,6 +58,28 @@ int main(int argc, char **argv)
 
    debug = 0;
 
+   strcpy(path, "");
+
+
+   /* Build a spatial index for the table, to be */
+   /* used by later runs against the same table  */
+
+   if(argc == 3 && strcmp(argv[1], "-index") == 0)
+   {
+      returnStruct = mCoverageCheckIndex(argv[2], debug);
+
+      if(returnStruct->status == 1)
+      {
+          fprintf(montage_status, "[struct stat=\"ERROR\", msg=\"%s\"]\n", returnStruct->msg);
+          exit(1);
+      }
+      else
+      {
+          fprintf(montage_status, "[struct stat=\"OK\", %s]\n", returnStruct->msg);
+          exit(0);
+      }
+   }
+
 
    /* Process basic command-line arguments */
 
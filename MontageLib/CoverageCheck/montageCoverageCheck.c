@@ -58,6 +58,9 @@ Version  Developer        Date     Change
 #define NO_INTERSECTION   3
 
 
+static struct montage_tableIndex *mCoverageCheck_buildIndex = (struct montage_tableIndex *)NULL;
+
+
 /*-***********************************************************************/
 /*                                                                       */
 /*  mCoverageCheck                                                       */
@@ -119,6 +122,13 @@ struct mCoverageCheckReturn *mCoverageCheck(char *path, char *infile, char *outf
 
    int    nimages;
 
+   long   recoff, ncand, icand;
+   long  *cand, *candoff;
+   double search_radius;
+   char   idxfile[1024];
+
+   struct montage_tableIndex *index;
+
    double lon, lat;
    double loni, lati;
    double xmin, xmax, ymin, ymax;
@@ -896,6 +906,45 @@ struct mCoverageCheckReturn *mCoverageCheck(char *path, char *infile, char *outf
 
 
 
+   /* If there is an up-to-date spatial index for the  */
+   /* table, we only need to look at the records whose */
+   /* bounding caps come near the region.  These are   */
+   /* visited in table order so the output is the same */
+   /* as for a full scan.                              */
+
+   ncand   = -1;
+   icand   =  0;
+   cand    = (long *)NULL;
+   candoff = (long *)NULL;
+
+   if(mCoverageCheck_buildIndex == (struct montage_tableIndex *)NULL)
+   {
+      sprintf(idxfile, "%s.covidx", infile);
+
+      index = montage_indexOpen(idxfile, infile, "mCoverageCheck");
+
+      if(index)
+      {
+         if(imode == POINT)
+            search_radius = 0.;
+         else if(imode == CIRCLE)
+            search_radius = circle_radius;
+         else
+            search_radius = box_radius;
+
+         ncand = montage_indexSearch(index, center.x, center.y, center.z, search_radius, &cand, &candoff);
+
+         montage_indexClose(index);
+
+         if(debug)
+         {
+            printf("\nIndex %s: %ld candidate records\n\n", idxfile, ncand);
+            fflush(stdout);
+         }
+      }
+   }
+
+
    /* Read the table file and process each record */
 
    nrow    = 0;
@@ -905,6 +954,20 @@ struct mCoverageCheckReturn *mCoverageCheck(char *path, char *infile, char *outf
    {
       blankRec = 0;
 
+      if(ncand >= 0)
+      {
+         if(icand >= ncand)
+            break;
+
+         tseekpos(candoff[icand]);
+
+         nrow = cand[icand];
+
+         ++icand;
+      }
+
+      recoff = ttell();
+
       stat = tread();
 
       if(stat < 0)
@@ -1197,6 +1260,22 @@ struct mCoverageCheckReturn *mCoverageCheck(char *path, char *infile, char *outf
       }
 
 
+      /* If we are building an index, all we need */
+      /* is the bounding cap                      */
+
+      if(mCoverageCheck_buildIndex)
+      {
+         if(montage_indexAdd(mCoverageCheck_buildIndex, recoff,
+                             image_center.x, image_center.y, image_center.z, image_box_radius))
+         {
+            sprintf(returnStruct->msg, "Cannot allocate memory for index.");
+            return returnStruct;
+         }
+
+         continue;
+      }
+
+
       
       /***********************************************/
       /* The checks are specific to the region shape */
@@ -2195,6 +2274,9 @@ struct mCoverageCheckReturn *mCoverageCheck(char *path, char *infile, char *outf
    fflush(fout);
    fclose(fout);
 
+   free(cand);
+   free(candoff);
+
 
    returnStruct->status = 0;
 
@@ -2207,6 +2289,93 @@ struct mCoverageCheckReturn *mCoverageCheck(char *path, char *infile, char *outf
 }
 
 
+
+/*-***********************************************************************/
+/*                                                                       */
+/*  mCoverageCheckIndex                                                  */
+/*                                                                       */
+/*  Build the spatial index for an image metadata table, so that later   */
+/*  mCoverageCheck calls on the same (unchanged) table read only the     */
+/*  records near the region of interest.  The index is written next to   */
+/*  the table as <infile>.covidx and is ignored if the table is changed. */
+/*                                                                       */
+/*   char  *infile         Table of image metadata                       */
+/*   int    debug          Debugging output level                        */
+/*                                                                       */
+/*************************************************************************/
+
+struct mCoverageCheckReturn *mCoverageCheckIndex(char *infile, int debug)
+{
+   int    nrec;
+   double array[2];
+   char   idxfile[1024];
+
+   struct mCoverageCheckReturn *returnStruct;
+
+
+   /* Run through the table once, collecting the */
+   /* same bounding caps the checks above use    */
+
+   mCoverageCheck_buildIndex = montage_indexNew();
+
+   if(mCoverageCheck_buildIndex == (struct montage_tableIndex *)NULL)
+   {
+      returnStruct = (struct mCoverageCheckReturn *)malloc(sizeof(struct mCoverageCheckReturn));
+
+      bzero((void *)returnStruct, sizeof(struct mCoverageCheckReturn));
+
+      returnStruct->status = 1;
+
+      strcpy(returnStruct->msg, "Cannot allocate memory for index.");
+
+      return returnStruct;
+   }
+
+   array[0] = 0.;
+   array[1] = 0.;
+
+   returnStruct = mCoverageCheck("", infile, "/dev/null", POINT, "", 2, array, debug);
+
+   if(returnStruct->status)
+   {
+      montage_indexClose(mCoverageCheck_buildIndex);
+
+      mCoverageCheck_buildIndex = (struct montage_tableIndex *)NULL;
+
+      return returnStruct;
+   }
+
+
+   /* Pack the tree and write it out */
+
+   sprintf(idxfile, "%s.covidx", infile);
+
+   nrec = montage_indexCount(mCoverageCheck_buildIndex);
+
+   if(montage_indexWrite(mCoverageCheck_buildIndex, idxfile, infile, "mCoverageCheck"))
+   {
+      montage_indexClose(mCoverageCheck_buildIndex);
+
+      mCoverageCheck_buildIndex = (struct montage_tableIndex *)NULL;
+
+      returnStruct->status = 1;
+
+      strcpy(returnStruct->msg, "Cannot write index file.");
+
+      return returnStruct;
+   }
+
+   mCoverageCheck_buildIndex = (struct montage_tableIndex *)NULL;
+
+   sprintf(returnStruct->msg,  "count=%d",       nrec);
+   sprintf(returnStruct->json, "{\"count\":%d}", nrec);
+
+   returnStruct->count = nrec;
+
+   return returnStruct;
+}
+
+
 /****************************************************************************/
 /*                                                                          */
 /* SegSegIntersect()                                                        */
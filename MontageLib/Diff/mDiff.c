@@ -17,15 +17,27 @@ extern int optind, opterr;
 extern int getopt(int argc, char *const *argv, const char *options);
 
 
-int main(int argc, char **argv)
+/* Close the status file (if -s gave one) and pass the return value on */
+
+static int finishCommand(FILE *montage_status, int istatus)
+{
+   if(montage_status != stdout)
+      fclose(montage_status);
+
+   return istatus;
+}
+
+
+static int processCommand(int argc, char **argv)
 {
-   int    c, debug;
-   int    noAreas;
+   int    c, debug, istatus;
+   int    noAreas, floatOut;
 
    char   input_file1 [MAXSTR];
    char   input_file2 [MAXSTR];
    char   template_file[MAXSTR];
    char   output_file [MAXSTR];
+   char   compress    [MAXSTR];
 
    double factor;
 
@@ -38,8 +50,11 @@ int main(int argc, char **argv)
    /* Process the command-line parameters */
    /***************************************/
 
-   debug   = 0;
-   noAreas = 0;
+   debug    = 0;
+   noAreas  = 0;
+   floatOut = 0;
+
+   strcpy(compress, "");
 
    opterr =  0;
 
@@ -47,7 +62,7 @@ int main(int argc, char **argv)
 
    montage_status = stdout;
 
-   while ((c = getopt(argc, argv, "nd:s:z:")) != EOF) 
+   while ((c = getopt(argc, argv, "nd:s:z:FC:")) != EOF) 
    {
       switch (c) 
       {
@@ -61,16 +76,19 @@ int main(int argc, char **argv)
             if(debug < 0)
             {
                 fprintf(montage_status, "[struct stat=\"ERROR\", msg=\"Invalid debug level.\"]\n");
-                exit(1);
+                return finishCommand(montage_status, 1);
             }
             break;
 
          case 's':
+            if(montage_status != stdout)
+               fclose(montage_status);
+
             if((montage_status = fopen(optarg, "w+")) == (FILE *)NULL)
             {
                printf("[struct stat=\"ERROR\", msg=\"Cannot open status file: %s\"]\n",
                   optarg);
-               exit(1);
+               return 1;
             }
             break;
 
@@ -78,17 +96,25 @@ int main(int argc, char **argv)
             factor = atof(optarg);
             break;
 
+         case 'F':
+            floatOut = 1;
+            break;
+
+         case 'C':
+            strcpy(compress, optarg);
+            break;
+
          default:
-            printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-d level] [-n(o-areas)] [-z factor] [-s statusfile] in1.fits in2.fits out.fits hdr.template\"]\n", argv[0]);
-            exit(1);
+            printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-d level] [-n(o-areas)] [-z factor] [-s statusfile] [-F(loat-output)] [-C rice|gzip[:qlevel]] in1.fits in2.fits out.fits hdr.template\"]\n", argv[0]);
+            return finishCommand(montage_status, 1);
             break;
       }
    }
 
    if (argc - optind < 4) 
    {
-      printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-d level] [-n(o-areas)] [-z factor] [-s statusfile] in1.fits in2.fits out.fits hdr.template\"]\n", argv[0]);
-      exit(1);
+      printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-d level] [-n(o-areas)] [-z factor] [-s statusfile] [-F(loat-output)] [-C rice|gzip[:qlevel]] in1.fits in2.fits out.fits hdr.template\"]\n", argv[0]);
+      return finishCommand(montage_status, 1);
    }
 
    strcpy(input_file1,   argv[optind]);
@@ -96,16 +122,51 @@ int main(int argc, char **argv)
    strcpy(output_file,   argv[optind + 2]);
    strcpy(template_file, argv[optind + 3]);
 
+   montage_setBitpix(floatOut ? -32 : 0);
+
+   if(montage_setCompress(compress))
+   {
+      printf("[struct stat=\"ERROR\", msg=\"Invalid compression (%s); use rice, gzip or none, optionally followed by :qlevel\"]\n", 
+         compress);
+      return finishCommand(montage_status, 1);
+   }
+
    returnStruct = mDiff(input_file1, input_file2, output_file, template_file, noAreas, factor, debug);
 
    if(returnStruct->status == 1)
    {
        fprintf(montage_status, "[struct stat=\"ERROR\", msg=\"%s\"]\n", returnStruct->msg);
-       exit(1);
+       istatus = 1;
    }
    else
    {
        fprintf(montage_status, "[struct stat=\"OK\", %s]\n", returnStruct->msg);
-       exit(0);
+       istatus = 0;
+   }
+
+   free(returnStruct);
+
+   return finishCommand(montage_status, istatus);
+}
+
+
+
+/*************************************************************************/
+/*                                                                       */
+/*  With the single argument "-server", read command lines from stdin    */
+/*  and process them one at a time in this process (so things like the   */
+/*  parsed header template can be reused).  Otherwise process the        */
+/*  command line as usual.                                               */
+/*                                                                       */
+/*************************************************************************/
+
+int main(int argc, char **argv)
+{
+   if(argc == 2 && strcmp(argv[1], "-server") == 0)
+   {
+      montage_serverMode(argv[0], processCommand);
+      exit(0);
    }
+
+   exit(processCommand(argc, argv));
 }
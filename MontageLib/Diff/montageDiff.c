@@ -56,17 +56,27 @@ int  noAreas;
 
 struct
 {
-   fitsfile *fptr;
-   long      naxes[2];
-   double    crpix1, crpix2;
+   fitsfile      *fptr;
+   struct mImage *image;
+   long           naxes[2];
+   double         crpix1, crpix2;
 }
    input, input_area, output, output_area;
 
+static int            inMemory;
+static char          *templateHdr;
+static struct mImage *inImage[2], *inArea[2];
+
 static time_t currtime, start;
 
+static struct montage_templateCache templateCache;
+
 
 static char montage_msgstr[1024];
-static char montage_json  [1024];
+static char montage_json  [4096];
+
+static struct mDiffReturn *mDiff_run(char *input_file1, char *input_file2, char *ofile, char *template_file, 
+                                     int noAreasin, double fact, int debugin);
 
 
 /*-***********************************************************************/
@@ -107,6 +117,91 @@ static char montage_json  [1024];
 
 struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, char *template_file, 
                           int noAreasin, double fact, int debugin)
+{
+   inMemory    = 0;
+   templateHdr = (char *)NULL;
+
+   inImage[0] = inImage[1] = (struct mImage *)NULL;
+   inArea [0] = inArea [1] = (struct mImage *)NULL;
+
+   output.image      = (struct mImage *)NULL;
+   output_area.image = (struct mImage *)NULL;
+
+   return mDiff_run(input_file1, input_file2, ofile, template_file, noAreasin, fact, debugin);
+}
+
+
+
+/*-***********************************************************************/
+/*                                                                       */
+/*  mDiffMem                                                             */
+/*                                                                       */
+/*  The same, for images in memory.  The input pixels are read in place; */
+/*  the difference image (and area image, if asked for) is returned in   */
+/*  memory, to be freed with montage_imageFree().  The template is a     */
+/*  header string.  Areas are used only if both input area images are   */
+/*  given.                                                               */
+/*                                                                       */
+/*   struct mImage  *input1, *area1   First input image and its area     */
+/*   struct mImage  *input2, *area2   Second input image and its area    */
+/*   char           *template_hdr     Output header template             */
+/*   struct mImage **output           Returned difference image          */
+/*   struct mImage **area             Returned area image (or NULL)      */
+/*                                                                       */
+/*   double factor         Optional scale factor for the second image    */
+/*   int    debug          Debugging output level                        */
+/*                                                                       */
+/*************************************************************************/
+
+struct mDiffReturn *mDiffMem(struct mImage *input1, struct mImage *area1,
+                             struct mImage *input2, struct mImage *area2,
+                             char *template_hdr, struct mImage **outimage, struct mImage **outarea,
+                             double fact, int debugin)
+{
+   int noAreasin;
+
+   struct mDiffReturn *returnStruct;
+
+   noAreasin = (area1 == (struct mImage *)NULL || area2 == (struct mImage *)NULL);
+
+   inMemory    = 1;
+   templateHdr = template_hdr;
+
+   inImage[0] = input1;
+   inImage[1] = input2;
+   inArea [0] = area1;
+   inArea [1] = area2;
+
+   output.image      = (struct mImage *)NULL;
+   output_area.image = (struct mImage *)NULL;
+
+   returnStruct = mDiff_run("(memory)", "(memory)", "(memory)", "(memory)", noAreasin, fact, debugin);
+
+   if(returnStruct->status)
+   {
+      montage_imageFree(output.image);
+      montage_imageFree(output_area.image);
+
+      output.image      = (struct mImage *)NULL;
+      output_area.image = (struct mImage *)NULL;
+   }
+
+   *outimage = output.image;
+
+   if(outarea)
+      *outarea = output_area.image;
+   else
+      montage_imageFree(output_area.image);
+
+   return returnStruct;
+}
+
+
+
+/* The differencing, for files or (inMemory) images in memory */
+
+static struct mDiffReturn *mDiff_run(char *input_file1, char *input_file2, char *ofile, char *template_file, 
+                                     int noAreasin, double fact, int debugin)
 {
    int       i, j, ifile, status;
    long      fpixel[4], nelements;
@@ -197,12 +292,35 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
    if(factor == 0.)
       factor = 1.;
 
-   checkHdr = montage_checkHdr(template_file, 1, 0);
+   if(inMemory)
+   {
+      montage_templateClear(&templateCache);
 
-   if(checkHdr)
+      if(mDiff_readTemplate(template_file) > 0)
+      {
+         strcpy(returnStruct->msg, montage_msgstr);
+         return returnStruct;
+      }
+   }
+   else if(!montage_templateSame(&templateCache, template_file, 0, 0.))
    {
-      strcpy(returnStruct->msg, checkHdr);
-      return returnStruct;
+      montage_templateClear(&templateCache);
+
+      checkHdr = montage_checkHdr(template_file, 1, 0);
+
+      if(checkHdr)
+      {
+         strcpy(returnStruct->msg, checkHdr);
+         return returnStruct;
+      }
+
+      if(mDiff_readTemplate(template_file) > 0)
+      {
+         strcpy(returnStruct->msg, montage_msgstr);
+         return returnStruct;
+      }
+
+      montage_templateKeep(&templateCache, template_file, 0, 0.);
    }
 
    if(strlen(output_file) > 5 &&
@@ -281,12 +399,10 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
 
 
    /*************************************************/ 
-   /* Process the output header template to get the */ 
-   /* image size, coordinate system and projection  */ 
+   /* The output header template (image size and    */ 
+   /* reference pixel) was processed above          */ 
    /*************************************************/ 
 
-   mDiff_readTemplate(template_file);
-
    if(debug >= 1)
    {
       printf("output.naxes[0] =  %ld\n", output.naxes[0]);
@@ -303,7 +419,14 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
    /* (for memory allocation purposes)                  */
    /*****************************************************/
 
-   mDiff_readFits(infile[0], inarea[0]);
+   input.image      = inImage[0];
+   input_area.image = inArea [0];
+
+   if(mDiff_readFits(infile[0], inarea[0]) > 0)
+   {
+      strcpy(returnStruct->msg, montage_msgstr);
+      return returnStruct;
+   }
 
    imin = output.crpix1 - input.crpix1;
    jmin = output.crpix2 - input.crpix2;
@@ -338,7 +461,7 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
 
    status = 0;
 
-   if(fits_close_file(input.fptr, &status))
+   if(montage_closeInput(input.fptr, input.image, &status))
    {
       mDiff_printFitsError(status);
       strcpy(returnStruct->msg, montage_msgstr);
@@ -347,7 +470,7 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
 
    if(!noAreas)
    {
-      if(fits_close_file(input_area.fptr, &status))
+      if(montage_closeInput(input_area.fptr, input_area.image, &status))
       {
          mDiff_printFitsError(status);
          strcpy(returnStruct->msg, montage_msgstr);
@@ -355,7 +478,14 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
       }
    }
 
-   mDiff_readFits(infile[1], inarea[1]);
+   input.image      = inImage[1];
+   input_area.image = inArea [1];
+
+   if(mDiff_readFits(infile[1], inarea[1]) > 0)
+   {
+      strcpy(returnStruct->msg, montage_msgstr);
+      return returnStruct;
+   }
 
    imin = output.crpix1 - input.crpix1;
    jmin = output.crpix2 - input.crpix2;
@@ -416,7 +546,7 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
       fflush(stdout);
    }
 
-   if(fits_close_file(input.fptr, &status))
+   if(montage_closeInput(input.fptr, input.image, &status))
    {
       mDiff_printFitsError(status);
       strcpy(returnStruct->msg, montage_msgstr);
@@ -425,7 +555,7 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
 
    if(!noAreas)
    {
-      if(fits_close_file(input_area.fptr, &status))
+      if(montage_closeInput(input_area.fptr, input_area.image, &status))
       {
          mDiff_printFitsError(status);
          strcpy(returnStruct->msg, montage_msgstr);
@@ -512,6 +642,8 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
    time(&currtime);
    start = currtime;
 
+   montage_statsStart("mDiff");
+
    avearea1 = 0.;
    avearea2 = 0.;
    narea1   = 0.;
@@ -523,7 +655,14 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
       /* Read the input image */
       /************************/
 
-      mDiff_readFits(infile[ifile], inarea[ifile]);
+      input.image      = inImage[ifile];
+      input_area.image = inArea [ifile];
+
+      if(mDiff_readFits(infile[ifile], inarea[ifile]) > 0)
+      {
+         strcpy(returnStruct->msg, montage_msgstr);
+         return returnStruct;
+      }
 
       imin = output.crpix1 - input.crpix1;
       jmin = output.crpix2 - input.crpix2;
@@ -581,8 +720,10 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
          /* Read a line from the input file */
          /***********************************/
 
-         if(fits_read_pix(input.fptr, TDOUBLE, fpixel, nelements, &nan,
-                          buffer, &nullcnt, &status))
+         montage_phaseBegin("read");
+
+         if(montage_readPix(input.fptr, input.image, TDOUBLE, fpixel, nelements, &nan,
+                            buffer, &nullcnt, &status))
          {
             free(buffer);
             free(abuffer);
@@ -600,6 +741,8 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
             strcpy(returnStruct->msg, montage_msgstr);
             return returnStruct;
          }
+
+         montage_countRead(input.fptr, nelements);
          
          
          if(noAreas)
@@ -609,8 +752,8 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
          }
          else
          {
-         if(fits_read_pix(input_area.fptr, TDOUBLE, fpixel, nelements, &nan,
-                          abuffer, &nullcnt, &status))
+         if(montage_readPix(input_area.fptr, input_area.image, TDOUBLE, fpixel, nelements, &nan,
+                            abuffer, &nullcnt, &status))
          {
             free(buffer);
             free(abuffer);
@@ -628,15 +771,23 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
             strcpy(returnStruct->msg, montage_msgstr);
             return returnStruct;
          }
+
+         montage_countRead(input_area.fptr, nelements);
          }
          
          ++fpixel[1];
 
+         montage_phaseEnd("read");
+
+         montage_countPixels(nelements);
+
 
          /************************/
          /* For each input pixel */
          /************************/
 
+         montage_phaseBegin("diff");
+
          for (i=0; i<input.naxes[0]; ++i)
          {
             pixel_value = buffer[i] * abuffer[i];
@@ -745,12 +896,14 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
                }
             }
          }
+
+         montage_phaseEnd("diff");
       }
 
       free(buffer);
       free(abuffer);
 
-      if(fits_close_file(input.fptr, &status))
+      if(montage_closeInput(input.fptr, input.image, &status))
       {
          for(j=0; j<jlength; ++j)
          {
@@ -768,7 +921,7 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
 
       if(!noAreas)
       {
-         if(fits_close_file(input_area.fptr, &status))
+         if(montage_closeInput(input_area.fptr, input_area.image, &status))
          {
             for(j=0; j<jlength; ++j)
             {
@@ -916,10 +1069,13 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
    /* Create the output FITS files */
    /********************************/
 
-   remove(output_file);               
-   remove(output_area_file);               
+   if(!inMemory)
+   {
+      remove(output_file);               
+      remove(output_area_file);               
+   }
 
-   if(fits_create_file(&output.fptr, output_file, &status)) 
+   if(fits_create_file(&output.fptr, inMemory ? "mem://" : montage_outName(output_file), &status)) 
    {
       for(j=0; j<jlength; ++j)
       {
@@ -935,7 +1091,7 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
       return returnStruct;
    }
 
-   if(fits_create_file(&output_area.fptr, output_area_file, &status)) 
+   if(fits_create_file(&output_area.fptr, inMemory ? "mem://" : montage_outName(output_area_file), &status)) 
    {
       for(j=0; j<jlength; ++j)
       {
@@ -954,9 +1110,12 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
 
    /*********************************************************/
    /* Create the FITS image.  All the required keywords are */
-   /* handled automatically.                                */
+   /* handled automatically.  The output is double unless   */
+   /* single precision (BITPIX -32) has been requested.     */
    /*********************************************************/
 
+   bitpix = montage_outBitpix();
+
    if (fits_create_img(output.fptr, bitpix, naxis, output.naxes, &status))
    {
       for(j=0; j<jlength; ++j)
@@ -1006,7 +1165,7 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
    /* Set FITS header from a template file */
    /****************************************/
 
-   if(fits_write_key_template(output.fptr, template_file, &status))
+   if(montage_writeTemplate(output.fptr, template_file, templateHdr, &status))
    {
       for(j=0; j<jlength; ++j)
       {
@@ -1028,7 +1187,7 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
       fflush(stdout);
    }
 
-   if(fits_write_key_template(output_area.fptr, template_file, &status))
+   if(montage_writeTemplate(output_area.fptr, template_file, templateHdr, &status))
    {
       for(j=0; j<jlength; ++j)
       {
@@ -1051,11 +1210,11 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
    }
 
 
-   /***************************/
-   /* Modify BITPIX to be -64 */
-   /***************************/
+   /**********************************/
+   /* Modify BITPIX to be -64 or -32 */
+   /**********************************/
 
-   if(fits_update_key_lng(output.fptr, "BITPIX", -64,
+   if(fits_update_key_lng(output.fptr, "BITPIX", bitpix,
                                   (char *)NULL, &status))
    {
       for(j=0; j<jlength; ++j)
@@ -1072,7 +1231,7 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
       return returnStruct;
    }
 
-   if(fits_update_key_lng(output_area.fptr, "BITPIX", -64,
+   if(fits_update_key_lng(output_area.fptr, "BITPIX", bitpix,
                                   (char *)NULL, &status))
    {
       for(j=0; j<jlength; ++j)
@@ -1271,18 +1430,54 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
    }
 
 
+   /************************************************/
+   /* If the output is to be tile-compressed, the  */
+   /* headers so far are in memory; now create the */
+   /* real files.                                  */
+   /************************************************/
+
+   if(inMemory)
+   {
+      montage_memOutput(output.fptr,      &output.image,      &status);
+      montage_memOutput(output_area.fptr, &output_area.image, &status);
+   }
+   else
+   {
+      montage_compressImage(&output.fptr,      output_file,      &status);
+      montage_compressArea (&output_area.fptr, output_area_file, &status);
+   }
+
+   if(status)
+   {
+      for(j=0; j<jlength; ++j)
+      {
+         free(data[j]);
+         free(area[j]);
+      }
+
+      free(data);
+      free(area);
+
+      mDiff_printFitsError(status);
+      strcpy(returnStruct->msg, montage_msgstr);
+      return returnStruct;
+   }
+
+
    /************************/
    /* Write the image data */
    /************************/
 
+   montage_phaseBegin("write");
+
    fpixel[0] = 1;
    fpixel[1] = 1;
    nelements = imax - imin + 1;
 
    for(j=jmin; j<=jmax; ++j)
    {
-      if (fits_write_pix(output.fptr, TDOUBLE, fpixel, nelements, 
-                         (void *)(&data[j-jstart][imin-istart]), &status))
+      if (montage_putPix(output.fptr, output.image, TDOUBLE, fpixel, nelements, 
+                           (void *)(&data[j-jstart][imin-istart]), &status))
       {
          for(i=0; i<jlength; ++i)
          {
@@ -1298,6 +1493,8 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
          return returnStruct;
       }
 
+      montage_countWrite(output.fptr, nelements);
+
       ++fpixel[1];
    }
 
@@ -1318,8 +1515,8 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
 
    for(j=jmin; j<=jmax; ++j)
    {
-      if (fits_write_pix(output_area.fptr, TDOUBLE, fpixel, nelements,
-                         (void *)(&area[j-jstart][imin-istart]), &status))
+      if (montage_putPix(output_area.fptr, output_area.image, TDOUBLE, fpixel, nelements,
+                           (void *)(&area[j-jstart][imin-istart]), &status))
       {
          for(i=0; i<jlength; ++i)
          {
@@ -1335,6 +1532,8 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
          return returnStruct;
       }
 
+      montage_countWrite(output_area.fptr, nelements);
+
       ++fpixel[1];
    }
 
@@ -1349,7 +1548,7 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
    /* Close the FITS file */
    /***********************/
 
-   if(fits_close_file(output.fptr, &status))
+   if(montage_closeOutput(output.fptr, output.image, &status))
    {
       for(j=0; j<jlength; ++j)
       {
@@ -1371,7 +1570,7 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
       fflush(stdout);
    }
 
-   if(fits_close_file(output_area.fptr, &status))
+   if(montage_closeOutput(output_area.fptr, output_area.image, &status))
    {
       for(j=0; j<jlength; ++j)
       {
@@ -1393,6 +1592,8 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
       fflush(stdout);
    }
 
+   montage_phaseEnd("write");
+
    time(&currtime);
 
    for(j=0; j<jlength; ++j)
@@ -1405,7 +1606,7 @@ struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *ofile, cha
    free(area);
 
    sprintf(montage_msgstr, "time=%.1f",       (double)(currtime - start));
-   sprintf(montage_json,   "{\"time\":%.1f}", (double)(currtime - start));
+   sprintf(montage_json,   "{\"time\":%.1f, %s}", (double)(currtime - start), montage_statsEnd());
 
    returnStruct->status = 0;
 
@@ -1436,7 +1637,10 @@ int mDiff_readTemplate(char *filename)
    /* Open the template file, read and parse all the lines */
    /********************************************************/
 
-   fp = fopen(filename, "r");
+   if(templateHdr)
+      fp = montage_memText(templateHdr);
+   else
+      fp = fopen(filename, "r");
 
    if(fp == (FILE *)NULL)
    {
@@ -1469,6 +1673,8 @@ int mDiff_readTemplate(char *filename)
       mDiff_parseLine(line);
    }
 
+   fclose(fp);
+
    return 0;
 }
 
@@ -1570,7 +1776,12 @@ int mDiff_readFits(char *fluxfile, char *areafile)
 
    if(!noAreas)
    {
-      if(fits_open_file(&input_area.fptr, areafile, READONLY, &status))
+      if(input_area.image)
+         montage_memOpen(&input_area.fptr, input_area.image, &status);
+      else
+         fits_open_image(&input_area.fptr, areafile, READONLY, &status);
+
+      if(status)
       {
          sprintf(errstr, "Area file %s missing or invalid FITS", areafile);
          mDiff_printError(errstr);
@@ -1578,14 +1789,19 @@ int mDiff_readFits(char *fluxfile, char *areafile)
       }
    }
 
-   if(fits_open_file(&input.fptr, fluxfile, READONLY, &status))
+   if(input.image)
+      montage_memOpen(&input.fptr, input.image, &status);
+   else
+      fits_open_image(&input.fptr, fluxfile, READONLY, &status);
+
+   if(status)
    {
       sprintf(errstr, "Image file %s missing or invalid FITS", fluxfile);
       mDiff_printError(errstr);
       return 1;
    }
 
-   if(fits_read_keys_lng(input.fptr, "NAXIS", 1, 2, naxes, &nfound, &status))
+   if(fits_get_img_size(input.fptr, 2, naxes, &status))
    {
       mDiff_printFitsError(status);
       return 1;
@@ -16,6 +16,29 @@
 
 #define APRAD  30
 
+extern char *optarg;
+extern int optind, opterr;
+
+extern int getopt(int argc, char *const *argv, const char *options);
+
+int batchMain(int argc, char **argv);
+
+
+/**************************************************************************************/
+/*                                                                                    */
+/*  mExamine gives image information, region statistics or aperture photometry:     */
+/*                                                                                    */
+/*  mExamine [-d]                  image.fits                                         */
+/*  mExamine [-d] -p ra dec radius image.fits                                         */
+/*  mExamine [-d] -a ra dec        image.fits                                         */
+/*                                                                                    */
+/*  There is also a batch mode, where a whole table of sources is measured in a       */
+/*  single pass over the image (see batchMain() below):                               */
+/*                                                                                    */
+/*  mExamine -b [-a][-r radius][-d][-n threads] image.fits sources.tbl out.tbl        */
+/*                                                                                    */
+/**************************************************************************************/
+
 int main(int argc, char **argv) 
 {
    int    i,debug, areaMode;
@@ -47,6 +70,12 @@ int main(int argc, char **argv)
 
    montage_status = stdout;
 
+   for(i=0; i<argc; ++i)
+   {
+      if(strcmp(argv[i], "-b") == 0)
+         exit(batchMain(argc, argv));
+   }
+
    for(i=0; i<argc; ++i)
    {
       if(strncmp(argv[i], "-s", 2) == 0)
@@ -180,3 +209,153 @@ int main(int argc, char **argv)
        exit(0);
    }
 }
+
+
+
+/**************************************************************************************/
+/*                                                                                    */
+/*  Batch mode.  The locations come from a table; the only numeric argument is the    */
+/*  radius, which is positive, so we can safely use getopt().  A radius ending in     */
+/*  'p' is in pixels, otherwise degrees.  Aperture photometry (-a) defaults to the    */
+/*  same 30 pixel radius as the single-source mode.                                   */
+/*                                                                                    */
+/**************************************************************************************/
+
+int batchMain(int argc, char **argv)
+{
+   int       c, debug, areaMode, radinpix, nthread;
+
+   int       planeCount;
+   int       planes[256];
+
+   int       hdu, plane3, plane4;
+
+   double    radius;
+
+   char      infile [1024];
+   char      tblfile[1024];
+   char      outtbl [1024];
+
+   char     *end;
+
+   struct mExamineBatchReturn *returnStruct;
+
+   FILE *montage_status;
+
+
+   debug    = 0;
+   areaMode = REGION;
+   radius   = 0.;
+   radinpix = 0;
+   nthread  = 4;
+
+   montage_status = stdout;
+
+   opterr = 0;
+
+   while ((c = getopt(argc, argv, "badr:n:s:")) != EOF)
+   {
+      switch (c)
+      {
+         case 'b':
+            break;
+
+         case 'a':
+            areaMode = APPHOT;
+            break;
+
+         case 'd':
+            debug = 1;
+            break;
+
+         case 'r':
+            radius = strtod(optarg, &end);
+
+            if(*end == 'p')
+            {
+               radinpix = 1;
+               ++end;
+            }
+
+            if(end < optarg + strlen(optarg) || radius <= 0.)
+            {
+               printf("[struct stat=\"ERROR\", msg=\"Radius (%s) must be a positive number\"]\n",
+                  optarg);
+               return 1;
+            }
+            break;
+
+         case 'n':
+            nthread = strtol(optarg, &end, 10);
+
+            if(end < optarg + strlen(optarg) || nthread < 1)
+            {
+               printf("[struct stat=\"ERROR\", msg=\"Thread count (%s) must be a positive integer\"]\n",
+                  optarg);
+               return 1;
+            }
+            break;
+
+         case 's':
+            if((montage_status = fopen(optarg, "w+")) == (FILE *)NULL)
+            {
+               printf("[struct stat=\"ERROR\", msg=\"Cannot open status file: %s\"]\n",
+                  optarg);
+               return 1;
+            }
+            break;
+
+         default:
+            printf("[struct stat=\"ERROR\", msg=\"Usage: %s -b [-a][-r radius][-d][-n threads][-s statusfile] image.fits sources.tbl out.tbl\"]\n", argv[0]);
+            return 1;
+      }
+   }
+
+   if(argc - optind < 3)
+   {
+      printf("[struct stat=\"ERROR\", msg=\"Usage: %s -b [-a][-r radius][-d][-n threads][-s statusfile] image.fits sources.tbl out.tbl\"]\n", argv[0]);
+      return 1;
+   }
+
+   if(areaMode == REGION && radius <= 0.)
+   {
+      printf("[struct stat=\"ERROR\", msg=\"Region statistics need a radius (-r)\"]\n");
+      return 1;
+   }
+
+   strcpy(infile,  argv[optind]);
+   strcpy(tblfile, argv[optind + 1]);
+   strcpy(outtbl,  argv[optind + 2]);
+
+
+   // Parse the HDU from the file name
+
+   planeCount = mExamine_getPlanes(infile, planes);
+
+   hdu    = 0;
+   plane3 = 1;
+   plane4 = 1;
+
+   if(planeCount > 0)
+      hdu = planes[0];
+
+   if(planeCount > 1)
+      plane3 = planes[1];
+
+   if(planeCount > 2)
+      plane4 = planes[2];
+
+   returnStruct = mExamineBatch(areaMode, infile, hdu, plane3, plane4, tblfile, outtbl,
+                                radius, radinpix, nthread, debug);
+
+   if(returnStruct->status == 1)
+   {
+       fprintf(montage_status, "[struct stat=\"ERROR\", msg=\"%s\"]\n", returnStruct->msg);
+       return 1;
+   }
+   else
+   {
+       fprintf(montage_status, "[struct stat=\"OK\", %s]\n", returnStruct->msg);
+       return 0;
+   }
+}
@@ -6,11 +6,52 @@
 #define APPHOT  2
 
 
+struct apPhoto
+{
+   double rad;
+   double flux;
+   double fit;
+   double sum;
+};
+
+
+/*************************************/
+/* One source (aperture) in a batch  */
+/* mExamine run.                     */
+/*************************************/
+
+struct mExamineSource
+{
+   int    id;           /* cntr from the source table */
+   double xref, yref;   /* location as given (ra,dec or pixel) */
+   double xpix, ypix;
+   int    ixpix, iypix; /* reference pixel */
+   double x0, y0, z0;   /* center direction, image coordinates */
+   int    ibegin, iend; /* region statistics box */
+   int    jbegin, jend;
+   int    ilo, ihi;     /* all the pixels needed, including */
+   int    jlo, jhi;     /* the photometry box               */
+   int    npix;
+   int    nnull;
+   double mean;
+   double rms;
+   double val;
+   double min;
+   double max;
+   int    minx, miny;
+   int    maxx, maxy;
+   double totalflux;
+   int    status;
+   char   msg[64];
+};
+
+
 /***************************************/
 /* Define mExamine function prototypes */
 /***************************************/
 
-int mExamine_getPlanes(char *, int *);
-int mExamine_radCompare(const void *p1, const void *p2);
+int    mExamine_getPlanes(char *, int *);
+int    mExamine_radCompare(const void *p1, const void *p2);
+double mExamine_apphot(struct apPhoto *ap, int nflux);
 
 #endif
@@ -29,15 +29,6 @@ Version  Developer        Date     Change
 #define STRLEN  1024
 #define MAXFLUX 1024
 
-struct apPhoto 
-{
-   double rad;
-   double flux;
-   double fit;
-   double sum;
-};
-
-
 static char montage_msgstr[1024];
 static char montage_json  [1024];
 
@@ -125,14 +116,14 @@ struct mExamineReturn * mExamine(int areaMode, char *infile, int hdu, int plane3
    double rot, beta, dtr;
    double r;
 
-   double sumflux, sumflux2, sumn, mean, background, oldbackground, rms, dot;
+   double sumflux, sumflux2, mean, rms, dot;
    double sigmaref, sigmamax, sigmamin;
    double val, valx, valy, valra, valdec;
    double min, minx, miny, minra, mindec;
    double max, maxx, maxy, maxra, maxdec;
    double x0, y0, z0;
 
-   double  fluxMin, fluxMax, fluxRef, sigma;
+   double  totalflux;
 
    struct WorldCoor *wcs;
 
@@ -162,6 +153,8 @@ struct mExamineReturn * mExamine(int areaMode, char *infile, int hdu, int plane3
    nflux   = 0;
    maxflux = MAXFLUX;
 
+   totalflux = 0.;
+
 
    /************************************************/
    /* Make a NaN value to use setting blank pixels */
@@ -498,7 +491,7 @@ struct mExamineReturn * mExamine(int areaMode, char *infile, int hdu, int plane3
    nelements = iend - ibegin + 1;
 
    if(jbegin < 1         ) jbegin = 1;
-   if(jend   > wcs->nypix) jend   = wcs->nxpix;
+   if(jend   > wcs->nypix) jend   = wcs->nypix;
 
    fpixel[0] = ibegin;
    fpixel[1] = jbegin;
@@ -894,7 +887,15 @@ struct mExamineReturn * mExamine(int areaMode, char *infile, int hdu, int plane3
    
    else if(areaMode == APPHOT)
    {
-      rap = radius;
+      if(first)
+      {
+         if(ap) free(ap);
+         free(data);
+         sprintf(returnStruct->msg, "No valid pixels in aperture.");
+         return returnStruct;
+      }
+
+      rap = rpix;
 
       jbegin = maxj - rap - 1;
       jend   = maxj + rap + 1;
@@ -902,12 +903,32 @@ struct mExamineReturn * mExamine(int areaMode, char *infile, int hdu, int plane3
       ibegin = maxi - rap - 1;
       iend   = maxi + rap + 1;
 
+      if(ibegin < 1         ) ibegin = 1;
+      if(iend   > wcs->nxpix) iend   = wcs->nxpix;
+      if(jbegin < 1         ) jbegin = 1;
+      if(jend   > wcs->nypix) jend   = wcs->nypix;
+
       nelements = iend - ibegin + 1;
 
+
+      // The photometry box is centered on the peak
+      // and can be wider than the region read above
+
+      free(data);
+
+      data = (double *)malloc(nelements * sizeof(double));
+
+      if(data == (double *)NULL)
+      {
+         if(ap) free(ap);
+         sprintf(returnStruct->msg, "Cannot allocate photometry row.");
+         return returnStruct;
+      }
+
       fpixel[0] = ibegin;
       fpixel[1] = jbegin;
-      fpixel[2] = 1;
-      fpixel[3] = 1;
+      fpixel[2] = plane3;
+      fpixel[3] = plane4;
 
       for (j=jbegin; j<=jend; ++j)
       {
@@ -948,82 +969,9 @@ struct mExamineReturn * mExamine(int areaMode, char *infile, int hdu, int plane3
       }
 
 
-      // Sort the data by radius
-
-      qsort(ap, (size_t)nflux, sizeof(struct apPhoto), mExamine_radCompare);
-
-
-      // Find the peak flux and the minimum flux.
-
-      // The max is constrained to be in the first quarter of the
-      // data, just to be careful.
-
-      fluxMax = -1.e99;
-      fluxMin =  1.e99;
-
-      for(i=0; i<nflux; ++i)
-      {
-         if(i < nflux/4 && ap[i].flux > fluxMax)
-            fluxMax = ap[i].flux;
-
-         if(ap[i].flux < fluxMin)
-            fluxMin = ap[i].flux;
-      }
-
-
-      // Fit the minimum a little more carefully, iterating
-      // and excluding points more than 3 sigma above the 
-      // minimum.
-
-      background = fluxMin;
-      sigma      = fluxMax - fluxMin;
-
-      for(j=0; j<1000; ++j)
-      {
-         oldbackground = background;
-
-         sumn     = 0.;
-         sumflux  = 0.;
-         sumflux2 = 0.;
+      // Fit the radial profile and integrate the flux
 
-         for(i=0; i<nflux; ++i)
-         {
-            if(fabs(ap[i].flux - background) > 3.*sigma)
-               continue;
-
-            sumn     += 1.;
-            sumflux  += ap[i].flux;
-            sumflux2 += ap[i].flux * ap[i].flux;
-         }
-
-         background = sumflux / sumn;
-         sigma      = sqrt(sumflux2/sumn - background*background);
-
-         if(fabs((background - oldbackground) / oldbackground) < 1.e-3)
-            break;
-      }
-
-
-      fluxRef = (fluxMax-fluxMin) / exp(1.);
-
-      for(i=0; i<nflux; ++i)
-      {
-         if(ap[i].flux < fluxRef)
-         {
-            sigma = ap[i].rad;
-            break;
-         }
-      }
-
-      for(i=0; i<nflux; ++i)
-      {
-         ap[i].fit = (fluxMax-background) * exp(-(ap[i].rad * ap[i].rad) / (sigma * sigma)) + background;
-
-         if(i == 0)
-            ap[i].sum = ap[i].flux - background;
-         else
-            ap[i].sum = ap[i-1].sum + (ap[i].flux - background);
-      }
+      totalflux = mExamine_apphot(ap, nflux);
 
 
       if(debug)
@@ -1073,7 +1021,7 @@ struct mExamineReturn * mExamine(int areaMode, char *infile, int hdu, int plane3
       sprintf(tmpstr, " \"dec3\":%.7f,",      dec3);                strcat(montage_json, tmpstr);
       sprintf(tmpstr, " \"ra4\":%.7f,",       ra4);                 strcat(montage_json, tmpstr);
       sprintf(tmpstr, " \"dec4\":%.7f,",      dec4);                strcat(montage_json, tmpstr);
-      sprintf(tmpstr, " \"totalflux\":%.7e",  ap[nflux/2].sum);     strcat(montage_json, tmpstr);
+      sprintf(tmpstr, " \"totalflux\":%.7e",  totalflux);           strcat(montage_json, tmpstr);
 
 
       sprintf(tmpstr, "proj:\"%s\",",    proj);                 strcat(montage_msgstr, tmpstr);
@@ -1111,7 +1059,7 @@ struct mExamineReturn * mExamine(int areaMode, char *infile, int hdu, int plane3
       sprintf(tmpstr, " dec3:%.7f,",      dec3);                strcat(montage_msgstr, tmpstr);
       sprintf(tmpstr, " ra4:%.7f,",       ra4);                 strcat(montage_msgstr, tmpstr);
       sprintf(tmpstr, " dec4:%.7f,",      dec4);                strcat(montage_msgstr, tmpstr);
-      sprintf(tmpstr, " totalflux:%.7e",  ap[nflux/2].sum);     strcat(montage_msgstr, tmpstr);
+      sprintf(tmpstr, " totalflux:%.7e",  totalflux);           strcat(montage_msgstr, tmpstr);
    }
 
    strcat(montage_json, "}");
@@ -1179,15 +1127,113 @@ struct mExamineReturn * mExamine(int areaMode, char *infile, int hdu, int plane3
    returnStruct->ramax     = maxra;
    returnStruct->decmax    = maxdec;
 
-   if(areaMode == APPHOT)
-      returnStruct->totalflux = ap[nflux/2].sum;
-   else
-      returnStruct->totalflux = 0.;
+   returnStruct->totalflux = totalflux;
 
    return returnStruct;
 }
 
 
+/**************************************************/
+/*                                                */
+/*  Aperture photometry from the flux vs. radius  */
+/*  data:  fit the background and a Gaussian      */
+/*  profile and return the integrated flux.  The  */
+/*  array is sorted by radius in the process.     */
+/*                                                */
+/**************************************************/
+
+double mExamine_apphot(struct apPhoto *ap, int nflux)
+{
+   int    i, j;
+   double sumn, sumflux, sumflux2;
+   double background, oldbackground;
+   double fluxMin, fluxMax, fluxRef, sigma;
+
+   if(nflux <= 0)
+      return 0.;
+
+   // Sort the data by radius
+
+   qsort(ap, (size_t)nflux, sizeof(struct apPhoto), mExamine_radCompare);
+
+
+   // Find the peak flux and the minimum flux.
+
+   // The max is constrained to be in the first quarter of the
+   // data, just to be careful.
+
+   fluxMax = -1.e99;
+   fluxMin =  1.e99;
+
+   for(i=0; i<nflux; ++i)
+   {
+      if(i < nflux/4 && ap[i].flux > fluxMax)
+         fluxMax = ap[i].flux;
+
+      if(ap[i].flux < fluxMin)
+         fluxMin = ap[i].flux;
+   }
+
+
+   // Fit the minimum a little more carefully, iterating
+   // and excluding points more than 3 sigma above the 
+   // minimum.
+
+   background = fluxMin;
+   sigma      = fluxMax - fluxMin;
+
+   for(j=0; j<1000; ++j)
+   {
+      oldbackground = background;
+
+      sumn     = 0.;
+      sumflux  = 0.;
+      sumflux2 = 0.;
+
+      for(i=0; i<nflux; ++i)
+      {
+         if(fabs(ap[i].flux - background) > 3.*sigma)
+            continue;
+
+         sumn     += 1.;
+         sumflux  += ap[i].flux;
+         sumflux2 += ap[i].flux * ap[i].flux;
+      }
+
+      background = sumflux / sumn;
+      sigma      = sqrt(sumflux2/sumn - background*background);
+
+      if(fabs((background - oldbackground) / oldbackground) < 1.e-3)
+         break;
+   }
+
+
+   fluxRef = (fluxMax-fluxMin) / exp(1.);
+
+   for(i=0; i<nflux; ++i)
+   {
+      if(ap[i].flux < fluxRef)
+      {
+         sigma = ap[i].rad;
+         break;
+      }
+   }
+
+   for(i=0; i<nflux; ++i)
+   {
+      ap[i].fit = (fluxMax-background) * exp(-(ap[i].rad * ap[i].rad) / (sigma * sigma)) + background;
+
+      if(i == 0)
+         ap[i].sum = ap[i].flux - background;
+      else
+         ap[i].sum = ap[i-1].sum + (ap[i].flux - background);
+   }
+
+   return ap[nflux/2].sum;
+}
+
+
+
 /**************************************************/
 /*                                                */
 /*  Parse the HDU / plane info from the file name */
@@ -0,0 +1,984 @@
+/* Module: montageExamineBatch.c
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <fitsio.h>
+#include <wcs.h>
+#include <coord.h>
+#include <mtbl.h>
+
+#include <mExamine.h>
+#include <montage.h>
+
+#define APRAD 30
+
+static int debug;
+
+static char montage_msgstr[1024];
+
+
+/*********************************************/
+/* The rows needed by the sources currently  */
+/* being measured are kept in a ring buffer  */
+/* (indexed by row number modulo the ring    */
+/* size), along with the sky direction of    */
+/* each pixel (in the image's own coordinate */
+/* system) where it is needed.               */
+/*********************************************/
+
+static double **ring;
+static double **ringxyz;
+static int      nring;
+
+static int    mode;
+static double rpix, rap;
+static double cdelt2;
+static double dtr;
+
+
+struct mExamineBatchWork
+{
+   struct mExamineSource **list;
+   int    n;
+   int    start;
+   int    stride;
+};
+
+
+static int   mExamineBatch_compare(const void *a, const void *b);
+static void  mExamineBatch_measure(struct mExamineSource *src);
+static void *mExamineBatch_worker (void *arg);
+static void  mExamineBatch_printFitsError(int status);
+
+
+/*-***********************************************************************/
+/*                                                                       */
+/*  mExamineBatch                                                        */
+/*                                                                       */
+/*  Region statistics (as mExamine -p) or aperture photometry (as        */
+/*  mExamine -a) for a whole table of sources on one image.  The source  */
+/*  table has columns ra and dec (Equatorial J2000) or, failing those,   */
+/*  x and y (pixels), plus an optional cntr.                             */
+/*                                                                       */
+/*  Rather than opening the image and reading the rows around each       */
+/*  source separately, the sources are sorted by the first row they      */
+/*  need and the image is swept once.  The rows (and pixel directions)   */
+/*  are kept only as long as some source still needs them and each       */
+/*  source is measured as soon as its last row has been read, with the   */
+/*  sources that finish on the same row shared out over a number of      */
+/*  threads.  The results are written to a table in the original source  */
+/*  order.                                                               */
+/*                                                                       */
+/*   int    areaMode       Region statistics (1:AREA) or aperture        */
+/*                         photometry (2:APPHOT)                         */
+/*                                                                       */
+/*   char  *infile         FITS file to examine                          */
+/*   int    hdu            Optional HDU offset for input file            */
+/*                                                                       */
+/*   int    plane3         If datacube, the plane index for dimension 3  */
+/*   int    plane4         If datacube, the plane index for dimension 4  */
+/*                                                                       */
+/*   char  *tblfile        Table of source locations                     */
+/*   char  *outtbl         Output table of results                       */
+/*                                                                       */
+/*   double radius         Radius for region statistics (for aperture    */
+/*                         photometry, 0 gives the default 30 pixels)    */
+/*   int    radinpix       The radius is actually in pixels              */
+/*                                                                       */
+/*   int    nthread        Number of threads measuring sources           */
+/*                                                                       */
+/*   int    debug          Debugging output level                        */
+/*                                                                       */
+/*************************************************************************/
+
+struct mExamineBatchReturn *mExamineBatch(int areaMode, char *infile, int hdu, int plane3, int plane4,
+                                          char *tblfile, char *outtbl, double radius, int radinpix,
+                                          int nthread, int debugin)
+{
+   fitsfile *fptr;
+
+   int       i, j, k, n, ncols, stat, offscl, nullcnt, nfound;
+   int       icntr, ixref, iyref, pixMode;
+   int       nsource, maxsource, nvalid, nactive, next, ndone, nuse;
+   int       imin, imax, xmin, xmax, nread, height;
+   int       count, nfailed;
+
+   long      naxis;
+   long      naxes[10];
+   long      fpixel[4];
+
+   int       csys;
+   double    equinox;
+   double    lon, lat, ra, dec;
+   double    ramax, decmax;
+   double   *row, *xyz;
+
+   char     *header;
+   char      ctype1[256];
+
+   int       status = 0;
+
+   time_t    currtime, start;
+
+   FILE     *fout;
+
+   pthread_t *threads;
+
+   struct mExamineBatchWork *work;
+
+   struct WorldCoor *wcs;
+
+   struct mExamineSource  *sources;
+   struct mExamineSource **sorted;
+   struct mExamineSource **active;
+   struct mExamineSource **done;
+   struct mExamineSource  *src;
+
+   struct mExamineBatchReturn *returnStruct;
+
+
+   /************************************************/
+   /* Make a NaN value to use setting blank pixels */
+   /************************************************/
+
+   union
+   {
+      double d;
+      char   c[8];
+   }
+   value;
+
+   double nan;
+
+   for(i=0; i<8; ++i)
+      value.c[i] = 255;
+
+   nan = value.d;
+
+
+   dtr = atan(1.)/45.;
+
+   debug = debugin;
+   mode  = areaMode;
+
+   time(&currtime);
+   start = currtime;
+
+   if(nthread < 1)
+      nthread = 1;
+
+
+   /*******************************/
+   /* Initialize return structure */
+   /*******************************/
+
+   returnStruct = (struct mExamineBatchReturn *)malloc(sizeof(struct mExamineBatchReturn));
+
+   bzero((void *)returnStruct, sizeof(struct mExamineBatchReturn));
+
+
+   returnStruct->status = 1;
+
+   strcpy(returnStruct->msg, "");
+
+   if(areaMode != REGION && areaMode != APPHOT)
+   {
+      strcpy(returnStruct->msg, "Batch mode is for region statistics or aperture photometry.");
+      return returnStruct;
+   }
+
+   if(areaMode == APPHOT && radius <= 0.)
+   {
+      radius   = APRAD;
+      radinpix = 1;
+   }
+
+   if(radius <= 0.)
+   {
+      strcpy(returnStruct->msg, "Region statistics need a positive radius.");
+      return returnStruct;
+   }
+
+
+   /*************************************************/
+   /* Open the FITS file and initialize the WCS     */
+   /*************************************************/
+
+   if(fits_open_file(&fptr, infile, READONLY, &status))
+   {
+      sprintf(returnStruct->msg, "Cannot open FITS file %s", infile);
+      return returnStruct;
+   }
+
+   if(hdu > 0)
+   {
+      if(fits_movabs_hdu(fptr, hdu+1, NULL, &status))
+      {
+         sprintf(returnStruct->msg, "Can't find HDU %d", hdu);
+         return returnStruct;
+      }
+   }
+
+   status = 0;
+   if(fits_get_image_wcs_keys(fptr, &header, &status))
+   {
+      sprintf(returnStruct->msg, "Cannot find WCS keys in FITS file %s", infile);
+      return returnStruct;
+   }
+
+   status = 0;
+   if(fits_read_key_lng(fptr, "NAXIS", &naxis, (char *)NULL, &status))
+   {
+      sprintf(returnStruct->msg, "Cannot find NAXIS keyword in FITS file %s", infile);
+      return returnStruct;
+   }
+
+   status = 0;
+   if(fits_read_keys_lng(fptr, "NAXIS", 1, naxis, naxes, &nfound, &status))
+   {
+      sprintf(returnStruct->msg, "Cannot find NAXIS1,2 keywords in FITS file %s", infile);
+      return returnStruct;
+   }
+
+   wcs = wcsinit(header);
+
+   free(header);
+
+   if(wcs == (struct WorldCoor *)NULL)
+   {
+      sprintf(returnStruct->msg, "WCS initialization failed.");
+      return returnStruct;
+   }
+
+   cdelt2 = wcs->yinc;
+
+   strcpy(ctype1, wcs->ctype[0]);
+
+
+   /* Coordinate system, inferred as mExamine does */
+
+   equinox = wcs->equinox;
+
+   csys = EQUJ;
+
+   if(strncmp(ctype1, "RA--", 4) == 0 && equinox < 1975.)
+      csys = EQUB;
+
+   if(strncmp(ctype1, "LON-", 4) == 0
+   || strncmp(ctype1, "GLON", 4) == 0)
+      csys = GAL;
+
+   if(strncmp(ctype1, "ELON", 4) == 0)
+   {
+      csys = ECLJ;
+
+      if(equinox < 1975.)
+         csys = ECLB;
+   }
+
+   if(radinpix)
+      rpix = radius;
+   else
+      rpix = radius / fabs(cdelt2);
+
+   rap = rpix;
+
+   if(debug)
+   {
+      printf("DEBUG> csys = %d, equinox = %-g, radius = %-g pixels\n", csys, equinox, rpix);
+      fflush(stdout);
+   }
+
+
+   /*****************************************/
+   /* Read the source table and work out    */
+   /* the pixel ranges each source needs    */
+   /*****************************************/
+
+   ncols = topen(tblfile);
+
+   if(ncols <= 0)
+   {
+      sprintf(returnStruct->msg, "Invalid source table: %s", tblfile);
+      return returnStruct;
+   }
+
+   icntr = tcol("cntr");
+   ixref = tcol("ra");
+   iyref = tcol("dec");
+
+   pixMode = 0;
+
+   if(ixref < 0 || iyref < 0)
+   {
+      ixref = tcol("x");
+      iyref = tcol("y");
+
+      pixMode = 1;
+   }
+
+   if(ixref < 0 || iyref < 0)
+   {
+      tclose();
+      strcpy(returnStruct->msg, "Source table needs columns 'ra' and 'dec' (or 'x' and 'y')");
+      return returnStruct;
+   }
+
+   nsource   = 0;
+   maxsource = 1024;
+
+   sources = (struct mExamineSource *)malloc(maxsource * sizeof(struct mExamineSource));
+
+   height = 1;
+
+   while(1)
+   {
+      stat = tread();
+
+      if(stat < 0)
+         break;
+
+      if(nsource >= maxsource)
+      {
+         maxsource += maxsource;
+
+         sources = (struct mExamineSource *)realloc(sources, maxsource * sizeof(struct mExamineSource));
+      }
+
+      src = &sources[nsource];
+
+      bzero((void *)src, sizeof(struct mExamineSource));
+
+      src->id = nsource;
+
+      if(icntr >= 0)
+         src->id = atoi(tval(icntr));
+
+      ++nsource;
+
+      if(tnull(ixref) || tnull(iyref))
+      {
+         src->status = 1;
+         strcpy(src->msg, "No location.");
+         continue;
+      }
+
+      src->xref = atof(tval(ixref));
+      src->yref = atof(tval(iyref));
+
+      if(pixMode)
+      {
+         src->xpix = src->xref;
+         src->ypix = src->yref;
+
+         pix2wcs(wcs, src->xpix, src->ypix, &lon, &lat);
+
+         offscl = wcs->offscl;
+      }
+      else
+      {
+         convertCoordinates(EQUJ, 2000., src->xref, src->yref,
+                            csys, equinox, &lon, &lat, 0.);
+
+         wcs2pix(wcs, lon, lat, &src->xpix, &src->ypix, &offscl);
+      }
+
+      if(offscl)
+      {
+         src->status = 1;
+         strcpy(src->msg, "Location off the image.");
+         continue;
+      }
+
+      src->x0 = cos(lon*dtr) * cos(lat*dtr);
+      src->y0 = sin(lon*dtr) * cos(lat*dtr);
+      src->z0 = sin(lat*dtr);
+
+      src->ixpix = (int)(src->xpix+0.5);
+      src->iypix = (int)(src->ypix+0.5);
+
+      src->jbegin = src->iypix - rpix - 1;
+      src->jend   = src->iypix + rpix + 1;
+
+      src->ibegin = src->ixpix - rpix - 1;
+      src->iend   = src->ixpix + rpix + 1;
+
+      if(src->ibegin < 1         ) src->ibegin = 1;
+      if(src->iend   > wcs->nxpix) src->iend   = wcs->nxpix;
+      if(src->jbegin < 1         ) src->jbegin = 1;
+      if(src->jend   > wcs->nypix) src->jend   = wcs->nypix;
+
+      if(src->ibegin > src->iend || src->jbegin > src->jend)
+      {
+         src->status = 1;
+         strcpy(src->msg, "Location off the image.");
+         continue;
+      }
+
+
+      /* The photometry box is centered on the brightest */
+      /* pixel in the region, which can be anywhere in   */
+      /* the region box                                  */
+
+      src->ilo = src->ibegin;
+      src->ihi = src->iend;
+      src->jlo = src->jbegin;
+      src->jhi = src->jend;
+
+      if(areaMode == APPHOT)
+      {
+         src->ilo = floor(src->ibegin - rap - 1);
+         src->ihi = floor(src->iend   + rap + 1);
+         src->jlo = floor(src->jbegin - rap - 1);
+         src->jhi = floor(src->jend   + rap + 1);
+
+         if(src->ilo < 1         ) src->ilo = 1;
+         if(src->ihi > wcs->nxpix) src->ihi = wcs->nxpix;
+         if(src->jlo < 1         ) src->jlo = 1;
+         if(src->jhi > wcs->nypix) src->jhi = wcs->nypix;
+      }
+
+      if(src->jhi - src->jlo + 1 > height)
+         height = src->jhi - src->jlo + 1;
+
+      if(debug >= 2)
+      {
+         printf("source %d: (%.2f,%.2f) region [%d,%d] x [%d,%d], rows %d to %d\n", src->id,
+            src->xpix, src->ypix, src->ibegin, src->iend, src->jbegin, src->jend, src->jlo, src->jhi);
+         fflush(stdout);
+      }
+   }
+
+   tclose();
+
+
+   /***************************************/
+   /* Sort the good sources by first row  */
+   /***************************************/
+
+   sorted = (struct mExamineSource **)malloc((nsource+1) * sizeof(struct mExamineSource *));
+   active = (struct mExamineSource **)malloc((nsource+1) * sizeof(struct mExamineSource *));
+   done   = (struct mExamineSource **)malloc((nsource+1) * sizeof(struct mExamineSource *));
+
+   nvalid = 0;
+
+   for(k=0; k<nsource; ++k)
+   {
+      if(sources[k].status == 0)
+      {
+         sorted[nvalid] = &sources[k];
+         ++nvalid;
+      }
+   }
+
+   qsort(sorted, nvalid, sizeof(struct mExamineSource *), mExamineBatch_compare);
+
+
+   /*************************************/
+   /* The row ring buffer only has to   */
+   /* be as tall as the tallest source  */
+   /*************************************/
+
+   nring = height;
+
+   ring    = (double **)malloc(nring * sizeof(double *));
+   ringxyz = (double **)malloc(nring * sizeof(double *));
+
+   for(k=0; k<nring; ++k)
+   {
+      ring   [k] = (double *)malloc(    wcs->nxpix * sizeof(double));
+      ringxyz[k] = (double *)malloc(3 * wcs->nxpix * sizeof(double));
+
+      if(ring[k] == (double *)NULL || ringxyz[k] == (double *)NULL)
+      {
+         strcpy(returnStruct->msg, "Cannot allocate memory for image rows.");
+         return returnStruct;
+      }
+   }
+
+   threads = (pthread_t *)malloc(nthread * sizeof(pthread_t));
+
+   work = (struct mExamineBatchWork *)malloc(nthread * sizeof(struct mExamineBatchWork));
+
+
+   /*****************************************/
+   /* Sweep the image rows.  Each row is    */
+   /* read once, over the span covering all */
+   /* the sources that need it.             */
+   /*****************************************/
+
+   fpixel[2] = plane3;
+   fpixel[3] = plane4;
+
+   nactive = 0;
+   next    = 0;
+   nread   = 0;
+
+   j = 1;
+
+   if(nvalid > 0)
+      j = sorted[0]->jlo;
+
+   while(next < nvalid || nactive > 0)
+   {
+      if(nactive == 0 && sorted[next]->jlo > j)
+         j = sorted[next]->jlo;
+
+      while(next < nvalid && sorted[next]->jlo == j)
+      {
+         active[nactive] = sorted[next];
+         ++nactive;
+         ++next;
+      }
+
+      imin = wcs->nxpix;
+      imax = 1;
+
+      xmin = wcs->nxpix;
+      xmax = 0;
+
+      for(k=0; k<nactive; ++k)
+      {
+         if(active[k]->ilo < imin) imin = active[k]->ilo;
+         if(active[k]->ihi > imax) imax = active[k]->ihi;
+
+         if(j >= active[k]->jbegin && j <= active[k]->jend)
+         {
+            if(active[k]->ibegin < xmin) xmin = active[k]->ibegin;
+            if(active[k]->iend   > xmax) xmax = active[k]->iend;
+         }
+      }
+
+      row = ring   [j % nring];
+      xyz = ringxyz[j % nring];
+
+      fpixel[0] = imin;
+      fpixel[1] = j;
+
+      if(debug >= 2)
+      {
+         printf("Processing input image row %5d [%d-%d], %d active\n", j, imin, imax, nactive);
+         fflush(stdout);
+      }
+
+      status = 0;
+
+      if(fits_read_pix(fptr, TDOUBLE, fpixel, imax-imin+1, &nan,
+                       row + imin - 1, &nullcnt, &status))
+      {
+         mExamineBatch_printFitsError(status);
+         strcpy(returnStruct->msg, montage_msgstr);
+         return returnStruct;
+      }
+
+      ++nread;
+
+
+      /* Sky directions for the pixels that fall */
+      /* in some source's region box             */
+
+      for(i=xmin; i<=xmax; ++i)
+      {
+         pix2wcs(wcs, (double)i, (double)j, &lon, &lat);
+
+         if(wcs->offscl)
+         {
+            xyz[3*(i-1)  ] = 0.;
+            xyz[3*(i-1)+1] = 0.;
+            xyz[3*(i-1)+2] = 0.;
+
+            continue;
+         }
+
+         xyz[3*(i-1)  ] = cos(lon*dtr) * cos(lat*dtr);
+         xyz[3*(i-1)+1] = sin(lon*dtr) * cos(lat*dtr);
+         xyz[3*(i-1)+2] = sin(lat*dtr);
+      }
+
+
+      /* Measure the sources whose last row this is */
+
+      ndone = 0;
+
+      for(k=0; k<nactive; ++k)
+      {
+         if(active[k]->jhi == j)
+         {
+            done[ndone] = active[k];
+            ++ndone;
+
+            active[k] = active[nactive-1];
+            --nactive;
+            --k;
+         }
+      }
+
+      if(ndone > 0)
+      {
+         nuse = nthread;
+
+         if(nuse > ndone)
+            nuse = ndone;
+
+         for(n=0; n<nuse; ++n)
+         {
+            work[n].list   = done;
+            work[n].n      = ndone;
+            work[n].start  = n;
+            work[n].stride = nuse;
+         }
+
+         for(n=1; n<nuse; ++n)
+         {
+            if(pthread_create(&threads[n], (pthread_attr_t *)NULL, mExamineBatch_worker, (void *)&work[n]))
+            {
+               sprintf(returnStruct->msg, "Cannot start worker thread %d", n);
+               return returnStruct;
+            }
+         }
+
+         mExamineBatch_worker((void *)&work[0]);
+
+         for(n=1; n<nuse; ++n)
+            pthread_join(threads[n], (void **)NULL);
+      }
+
+      ++j;
+   }
+
+   free(threads);
+   free(work);
+   free(sorted);
+   free(active);
+   free(done);
+
+   for(k=0; k<nring; ++k)
+   {
+      free(ring   [k]);
+      free(ringxyz[k]);
+   }
+
+   free(ring);
+   free(ringxyz);
+
+   status = 0;
+
+   if(fits_close_file(fptr, &status))
+   {
+      mExamineBatch_printFitsError(status);
+      strcpy(returnStruct->msg, montage_msgstr);
+      return returnStruct;
+   }
+
+
+   /*******************************************/
+   /* Write the results, in the source order  */
+   /*******************************************/
+
+   fout = fopen(outtbl, "w+");
+
+   if(fout == (FILE *)NULL)
+   {
+      sprintf(returnStruct->msg, "Can't open output table %s", outtbl);
+      return returnStruct;
+   }
+
+   fprintf(fout, "|  cntr  |     ra      |     dec     |    x     |    y     |npixel| nnull|    aveflux     |    rmsflux     |    fluxref     |    fluxmin     | xmin | ymin |    fluxmax     | xmax | ymax |    ramax    |   decmax    |");
+
+   if(areaMode == APPHOT)
+      fprintf(fout, "   totalflux    |");
+
+   fprintf(fout, " stat | msg\n");
+
+   fprintf(fout, "|  int   |   double    |   double    |  double  |  double  | int  | int  |     double     |     double     |     double     |     double     | int  | int  |     double     | int  | int  |   double    |   double    |");
+
+   if(areaMode == APPHOT)
+      fprintf(fout, "     double     |");
+
+   fprintf(fout, " int  | char\n");
+
+   count   = 0;
+   nfailed = 0;
+
+   for(k=0; k<nsource; ++k)
+   {
+      src = &sources[k];
+
+      ra     = src->xref;
+      dec    = src->yref;
+      ramax  = 0.;
+      decmax = 0.;
+
+      if(src->status == 0)
+      {
+         ++count;
+
+         if(pixMode)
+         {
+            pix2wcs(wcs, src->xpix, src->ypix, &lon, &lat);
+            convertCoordinates(csys, equinox, lon, lat, EQUJ, 2000., &ra, &dec, 0.);
+         }
+
+         pix2wcs(wcs, (double)src->maxx, (double)src->maxy, &lon, &lat);
+         convertCoordinates(csys, equinox, lon, lat, EQUJ, 2000., &ramax, &decmax, 0.);
+      }
+      else
+         ++nfailed;
+
+      fprintf(fout, " %8d %13.7f %13.7f %10.2f %10.2f %6d %6d %16.8e %16.8e %16.8e %16.8e %6d %6d %16.8e %6d %6d %13.7f %13.7f ",
+         src->id, ra, dec, src->xpix, src->ypix, src->npix, src->nnull,
+         src->mean, src->rms, src->val, src->min, src->minx, src->miny,
+         src->max, src->maxx, src->maxy, ramax, decmax);
+
+      if(areaMode == APPHOT)
+         fprintf(fout, "%16.8e ", src->totalflux);
+
+      fprintf(fout, "%6d   %s\n", src->status, src->msg);
+   }
+
+   fclose(fout);
+
+   free(sources);
+
+   wcsfree(wcs);
+
+   time(&currtime);
+
+   returnStruct->status = 0;
+
+   sprintf(returnStruct->msg,  "count=%d, failed=%d, nread=%d, time=%.0f",
+      count, nfailed, nread, (double)(currtime - start));
+
+   sprintf(returnStruct->json, "{\"count\":%d, \"failed\":%d, \"nread\":%d, \"time\":%.1f}",
+      count, nfailed, nread, (double)(currtime - start));
+
+   returnStruct->count  = count;
+   returnStruct->failed = nfailed;
+   returnStruct->nread  = nread;
+   returnStruct->time   = (double)(currtime - start);
+
+   return returnStruct;
+}
+
+
+/**************************************************/
+/*                                                */
+/*  Measure one source, entirely from the rows    */
+/*  in the ring buffer.  This is the same         */
+/*  arithmetic as mExamine() and, like it, counts */
+/*  every pixel in the region box towards the     */
+/*  mean and RMS and only those inside the radius */
+/*  for the reference/min/max values.             */
+/*                                                */
+/**************************************************/
+
+static void mExamineBatch_measure(struct mExamineSource *src)
+{
+   int     i, j, first, nflux, maxflux;
+   int     ibegin, iend, jbegin, jend;
+   double  sumflux, sumflux2, dot, r, val;
+   double *row, *xyz;
+
+   struct apPhoto *ap;
+
+   sumflux  = 0.;
+   sumflux2 = 0.;
+
+   first = 1;
+
+   for(j=src->jbegin; j<=src->jend; ++j)
+   {
+      row = ring   [j % nring];
+      xyz = ringxyz[j % nring];
+
+      for(i=src->ibegin; i<=src->iend; ++i)
+      {
+         val = row[i-1];
+
+         if(mNaN(val))
+         {
+            ++src->nnull;
+            continue;
+         }
+
+         sumflux  += val;
+         sumflux2 += val*val;
+         ++src->npix;
+
+         dot = xyz[3*(i-1)]*src->x0 + xyz[3*(i-1)+1]*src->y0 + xyz[3*(i-1)+2]*src->z0;
+
+         if(dot > 1.)
+            dot = 1.;
+
+         r = acos(dot)/dtr / fabs(cdelt2);
+
+         if(r > rpix)
+            continue;
+
+         if(i == src->ixpix && j == src->iypix)
+            src->val = val;
+
+         if(first)
+         {
+            first = 0;
+
+            src->min  = val;
+            src->minx = i;
+            src->miny = j;
+
+            src->max  = val;
+            src->maxx = i;
+            src->maxy = j;
+         }
+
+         if(val > src->max)
+         {
+            src->max  = val;
+            src->maxx = i;
+            src->maxy = j;
+         }
+
+         if(val < src->min)
+         {
+            src->min  = val;
+            src->minx = i;
+            src->miny = j;
+         }
+      }
+   }
+
+   if(src->npix > 0)
+   {
+      src->mean = sumflux / src->npix;
+      src->rms  = sqrt(sumflux2/src->npix - src->mean*src->mean);
+   }
+
+   if(mode != APPHOT)
+      return;
+
+   if(first)
+   {
+      src->status = 1;
+      strcpy(src->msg, "No valid pixels in aperture.");
+      return;
+   }
+
+
+   /* Flux vs. radius around the brightest pixel */
+
+   jbegin = src->maxy - rap - 1;
+   jend   = src->maxy + rap + 1;
+
+   ibegin = src->maxx - rap - 1;
+   iend   = src->maxx + rap + 1;
+
+   if(ibegin < src->ilo) ibegin = src->ilo;
+   if(iend   > src->ihi) iend   = src->ihi;
+   if(jbegin < src->jlo) jbegin = src->jlo;
+   if(jend   > src->jhi) jend   = src->jhi;
+
+   maxflux = (iend - ibegin + 1) * (jend - jbegin + 1);
+
+   ap = (struct apPhoto *)malloc(maxflux * sizeof(struct apPhoto));
+
+   if(ap == (struct apPhoto *)NULL)
+   {
+      src->status = 1;
+      strcpy(src->msg, "Cannot allocate memory.");
+      return;
+   }
+
+   nflux = 0;
+
+   for(j=jbegin; j<=jend; ++j)
+   {
+      row = ring[j % nring];
+
+      for(i=ibegin; i<=iend; ++i)
+      {
+         if(mNaN(row[i-1]))
+            continue;
+
+         r = sqrt(((double)i-src->maxx)*((double)i-src->maxx) + ((double)j-src->maxy)*((double)j-src->maxy));
+
+         if(r > rap)
+            continue;
+
+         ap[nflux].rad  = r;
+         ap[nflux].flux = row[i-1];
+         ap[nflux].fit  = 0.;
+
+         ++nflux;
+      }
+   }
+
+   src->totalflux = mExamine_apphot(ap, nflux);
+
+   free(ap);
+}
+
+
+/***************************************/
+/* Each worker takes every stride'th   */
+/* source from the list of those ready */
+/***************************************/
+
+static void *mExamineBatch_worker(void *arg)
+{
+   int k;
+
+   struct mExamineBatchWork *work;
+
+   work = (struct mExamineBatchWork *)arg;
+
+   for(k=work->start; k<work->n; k+=work->stride)
+      mExamineBatch_measure(work->list[k]);
+
+   return (void *)NULL;
+}
+
+
+/*******************************/
+/* Sort sources by first row   */
+/* (and by column within row)  */
+/*******************************/
+
+static int mExamineBatch_compare(const void *a, const void *b)
+{
+   struct mExamineSource *sa, *sb;
+
+   sa = *(struct mExamineSource **)a;
+   sb = *(struct mExamineSource **)b;
+
+   if(sa->jlo < sb->jlo) return -1;
+   if(sa->jlo > sb->jlo) return  1;
+
+   if(sa->ilo < sb->ilo) return -1;
+   if(sa->ilo > sb->ilo) return  1;
+
+   return 0;
+}
+
+
+/***********************************/
+/*                                 */
+/*  Print out FITS library errors  */
+/*                                 */
+/***********************************/
+
+static void mExamineBatch_printFitsError(int status)
+{
+   char status_str[FLEN_STATUS];
+
+   fits_get_errstatus(status, status_str);
+
+   strcpy(montage_msgstr, status_str);
+}
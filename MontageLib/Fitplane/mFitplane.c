@@ -38,9 +38,20 @@ extern int getopt(int argc, char *const *argv, const char *options);
 /*                                                                       */
 /*************************************************************************/
 
-int main(int argc, char **argv)
+/* Close the status file (if -s gave one) and pass the return value on */
+
+static int finishCommand(FILE *montage_status, int istatus)
+{
+   if(montage_status != stdout)
+      fclose(montage_status);
+
+   return istatus;
+}
+
+
+static int processCommand(int argc, char **argv)
 {
-   int   c, levelOnly, border, debug;
+   int   c, levelOnly, border, debug, istatus;
 
    char  input_file[MAXSTR];
 
@@ -74,14 +85,14 @@ int main(int argc, char **argv)
             {
                printf("[struct stat=\"ERROR\", msg=\"Argument to -b (%s) cannot be interpreted as an integer\"]\n", 
                   optarg);
-               exit(1);
+               return finishCommand(montage_status, 1);
             }
 
             if(border < 0)
             {
                printf("[struct stat=\"ERROR\", msg=\"Argument to -b (%s) must be a positive integer\"]\n", 
                   optarg);
-               exit(1);
+               return finishCommand(montage_status, 1);
             }
 
             break;
@@ -92,7 +103,7 @@ int main(int argc, char **argv)
             if(debug < 0)
             {
                 fprintf(montage_status, "[struct stat=\"ERROR\", msg=\"Invalid debug level.\"]\n");
-                exit(1);
+                return finishCommand(montage_status, 1);
             }
             break;
 
@@ -101,17 +112,20 @@ int main(int argc, char **argv)
             break;
 
          case 's':
+            if(montage_status != stdout)
+               fclose(montage_status);
+
             if((montage_status = fopen(optarg, "w+")) == (FILE *)NULL)
             {
                printf("[struct stat=\"ERROR\", msg=\"Cannot open status file: %s\"]\n",
                   optarg);
-               exit(1);
+               return 1;
             }
             break;
 
          default:
             printf("[struct stat=\"ERROR\", msg=\"Usage: mFitplane [-b border] [-d level] [-s statusfile] [-l(evel-only)] in.fits\"]\n");
-            exit(1);
+            return finishCommand(montage_status, 1);
             break;
       }
    }
@@ -119,7 +133,7 @@ int main(int argc, char **argv)
    if (argc - optind < 1) 
    {
       printf("[struct stat=\"ERROR\", msg=\"Usage: mFitplane [-b border] [-d level] [-s statusfile] [-l(evel-only)] in.fits\"]\n");
-      exit(1);
+      return finishCommand(montage_status, 1);
    }
 
    strcpy(input_file, argv[optind]);
@@ -129,11 +143,37 @@ int main(int argc, char **argv)
    if(returnStruct->status == 1)
    {
        fprintf(montage_status, "[struct stat=\"ERROR\", msg=\"%s\"]\n", returnStruct->msg);
-       exit(1);
+       istatus = 1;
    }
    else
    {
        fprintf(montage_status, "[struct stat=\"OK\", %s]\n", returnStruct->msg);
-       exit(0);
+       istatus = 0;
+   }
+
+   free(returnStruct);
+
+   return finishCommand(montage_status, istatus);
+}
+
+
+
+/*************************************************************************/
+/*                                                                       */
+/*  With the single argument "-server", read command lines from stdin    */
+/*  and process them one at a time in this process (so things like the   */
+/*  parsed header template can be reused).  Otherwise process the        */
+/*  command line as usual.                                               */
+/*                                                                       */
+/*************************************************************************/
+
+int main(int argc, char **argv)
+{
+   if(argc == 2 && strcmp(argv[1], "-server") == 0)
+   {
+      montage_serverMode(argv[0], processCommand);
+      exit(0);
    }
+
+   exit(processCommand(argc, argv));
 }
@@ -48,7 +48,10 @@ Version  Developer        Date     Change
 
 
 static char montage_msgstr[1024];
-static char montage_json  [1024];
+static char montage_json  [4096];
+
+static struct mFitplaneReturn *mFitplane_run(char *input_file, struct mImage *image,
+                                             int levelOnly, int border, int debug);
 
 
 /*-***********************************************************************/
@@ -78,6 +81,38 @@ static char montage_json  [1024];
 /*************************************************************************/
 
 struct mFitplaneReturn *mFitplane(char *input_file, int levelOnly, int border, int debug)
+{
+   return mFitplane_run(input_file, (struct mImage *)NULL, levelOnly, border, debug);
+}
+
+
+
+/*-***********************************************************************/
+/*                                                                       */
+/*  mFitplaneMem                                                         */
+/*                                                                       */
+/*  The same, for an image in memory (header string plus float or double */
+/*  pixel array, read in place).                                         */
+/*                                                                       */
+/*   struct mImage *input  Image for plane fitting                       */
+/*   int    levelOnly      Only fit for level difference                 */
+/*   int    border         Exclude a pixel border from the fitting       */
+/*   int    debug          Debugging output level                        */
+/*                                                                       */
+/*************************************************************************/
+
+struct mFitplaneReturn *mFitplaneMem(struct mImage *input, int levelOnly, int border, int debug)
+{
+   return mFitplane_run("(memory)", input, levelOnly, border, debug);
+}
+
+
+
+/* The fit itself, of an image file or (if image is */
+/* not NULL) an image in memory                     */
+
+static struct mFitplaneReturn *mFitplane_run(char *input_file, struct mImage *image,
+                                             int levelOnly, int border, int debug)
 {
    fitsfile *fptr;
    int       i, j, nfound;
@@ -150,18 +185,25 @@ struct mFitplaneReturn *mFitplane(char *input_file, int levelOnly, int border, i
 
    strcpy(returnStruct->msg, "");
 
+   montage_statsStart("mFitplane");
+
 
    /******************/
    /* Open the image */
    /******************/
 
-   if(fits_open_file(&fptr, input_file, READONLY, &status))
+   if(image)
+      montage_memOpen(&fptr, image, &status);
+   else
+      fits_open_image(&fptr, input_file, READONLY, &status);
+
+   if(status)
    {
       sprintf(returnStruct->msg, "Image file %s missing or invalid FITS\"]\n", input_file);
       return returnStruct;
    }
 
-   if(fits_read_keys_lng(fptr, "NAXIS", 1, 2, naxes, &nfound, &status))
+   if(fits_get_img_size(fptr, 2, naxes, &status))
    {
       mFitplane_printFitsError(status);
       strcpy(returnStruct->msg, montage_msgstr);
@@ -223,16 +265,20 @@ struct mFitplaneReturn *mFitplane(char *input_file, int levelOnly, int border, i
    xbound = (double *)malloc(2 * naxes[1] * sizeof(double));
    ybound = (double *)malloc(2 * naxes[1] * sizeof(double));
 
+   montage_phaseBegin("read");
+
    for (j=0; j<naxes[1]; ++j)
    {
-      if(fits_read_pix(fptr, TDOUBLE, fpixel, nelements, &nan,
-                       data[j], &nullcnt, &status))
+      if(montage_readPix(fptr, image, TDOUBLE, fpixel, nelements, &nan,
+                         data[j], &nullcnt, &status))
       {
          mFitplane_printFitsError(status);
          strcpy(returnStruct->msg, montage_msgstr);
          return returnStruct;
       }
 
+      montage_countRead(fptr, nelements);
+
       ++fpixel[1];
 
       mini = naxes[0];
@@ -259,6 +305,12 @@ struct mFitplaneReturn *mFitplane(char *input_file, int levelOnly, int border, i
       }
    }
 
+   montage_phaseEnd("read");
+
+   montage_countPixels((long long)naxes[0] * naxes[1]);
+
+   montage_phaseBegin("fit");
+
    if(debug >= 1)
    {
       printf("%d pixels in bounding set\n", nbound);
@@ -555,7 +607,7 @@ struct mFitplaneReturn *mFitplane(char *input_file, int levelOnly, int border, i
    /* Close things up */
    /*******************/
 
-   fits_close_file(fptr, &status);
+   montage_closeInput(fptr, image, &status);
 
 
    /**************/
@@ -576,15 +628,17 @@ struct mFitplaneReturn *mFitplane(char *input_file, int levelOnly, int border, i
       boxang    = 0.;
    }
 
+   montage_phaseEnd("fit");
+
    sprintf(montage_msgstr, "a=%-g, b=%-g, c=%-g, crpix1=%-g, crpix2=%-g, xmin=%-g, xmax=%-g, ymin=%-g, ymax=%-g, xcenter=%-g, ycenter=%-g, npixel=%-g, rms=%-g, boxx=%-g, boxy=%-g, boxwidth=%-g, boxheight=%-g, boxang=%-g", 
       b[0][0], b[1][0], b[2][0], crpix[0], crpix[1], xmin, xmax, 
       ymin, ymax, xcenter, ycenter, sumn, rms,
       boxx, boxy, boxwidth, boxheight, boxang);
 
-   sprintf(montage_json, "{\"a\":%-g, \"b\":%-g, \"c\":%-g, \"crpix1\":%-g, \"crpix2\":%-g, \"xmin\":%-g, \"xmax\":%-g, \"ymin\":%-g, \"ymax\":%-g, \"xcenter\":%-g, \"ycenter\":%-g, \"npixel\":%-g, \"rms\":%-g, \"boxx\":%-g, \"boxy\":%-g, \"boxwidth\":%-g, \"boxheight\":%-g, \"boxang\":%-g}", 
+   sprintf(montage_json, "{\"a\":%-g, \"b\":%-g, \"c\":%-g, \"crpix1\":%-g, \"crpix2\":%-g, \"xmin\":%-g, \"xmax\":%-g, \"ymin\":%-g, \"ymax\":%-g, \"xcenter\":%-g, \"ycenter\":%-g, \"npixel\":%-g, \"rms\":%-g, \"boxx\":%-g, \"boxy\":%-g, \"boxwidth\":%-g, \"boxheight\":%-g, \"boxang\":%-g, %s}", 
       b[0][0], b[1][0], b[2][0], crpix[0], crpix[1], xmin, xmax, 
       ymin, ymax, xcenter, ycenter, sumn, rms,
-      boxx, boxy, boxwidth, boxheight, boxang);
+      boxx, boxy, boxwidth, boxheight, boxang, montage_statsEnd());
 
    returnStruct->status = 0;
 
@@ -756,6 +756,62 @@ int mImgtbl_get_files (char *pathname)
 /* the values into a structure more easily handled by Montage    */
 /* modules (Hdr_rec)                                             */
 
+/* Reads the default values of the extra */
+/* table fields from HDU 1 (keywords     */
+/* there are meant to be global)         */
+
+static void mImgtbl_global_fields(fitsfile *fptr)
+{
+   int   i, status;
+   char  value[1024], comment[1024], *ptr;
+
+   for(i=0; i<nfields; ++i)
+   {
+      status = 0;
+      if(fits_read_keyword(fptr, fields[i].name, value, comment, &status))
+         strcpy(fields[i].defval, "");
+
+      else
+      {
+         ptr = value;
+
+         if(*ptr == '\'' && value[strlen(value)-1] == '\'')
+         {
+            value[strlen(value)-1] = '\0';
+            ++ptr;
+         }
+
+         strcpy(fields[i].defval, ptr);
+      }
+   }
+}
+
+
+/* A tile-compressed image is stored in a  */
+/* binary table behind an empty primary    */
+/* HDU; returns 1 if the current (primary) */
+/* HDU is that placeholder                 */
+
+static int mImgtbl_compressed_primary(fitsfile *fptr)
+{
+   int naxis, compressed, status;
+
+   status = 0;
+   if(fits_get_img_dim(fptr, &naxis, &status) || naxis != 0)
+      return 0;
+
+   if(fits_movabs_hdu(fptr, 2, NULL, &status))
+      return 0;
+
+   compressed = fits_is_compressed_image(fptr, &status);
+
+   status = 0;
+   fits_movabs_hdu(fptr, 1, NULL, &status);
+
+   return compressed;
+}
+
+
 int mImgtbl_get_hdr (char *fname, struct Hdr_rec *hdr_rec, char *msg)
 {
    char     *header;
@@ -831,6 +887,17 @@ int mImgtbl_get_hdr (char *fname, struct Hdr_rec *hdr_rec, char *msg)
          fflush(stdout);
       }
 
+
+      /* The empty primary HDU of a tile-compressed */
+      /* file is not an image with a bad WCS; just  */
+      /* pick up any global keywords from it        */
+
+      if(hdr_rec->hdu == 1 && mImgtbl_compressed_primary(fptr))
+      {
+         mImgtbl_global_fields(fptr);
+         continue;
+      }
+
       ++nhdu;
 
 
@@ -1046,27 +1113,7 @@ int mImgtbl_get_hdr (char *fname, struct Hdr_rec *hdr_rec, char *msg)
       /* global (i.e. not in the others)  */
 
       if(hdr_rec->hdu == 1)
-      {
-         for(i=0; i<nfields; ++i)
-         {
-            status = 0;
-            if(fits_read_keyword(fptr, fields[i].name, value, comment, &status))
-               strcpy(fields[i].defval, "");
-
-            else
-            {
-               ptr = value;
-
-               if(*ptr == '\'' && value[strlen(value)-1] == '\'')
-               {
-                  value[strlen(value)-1] = '\0';
-                  ++ptr;
-               }
-
-               strcpy(fields[i].defval, ptr);
-            }
-         }
-      }
+         mImgtbl_global_fields(fptr);
 
       if(hdr_rec->hdu == 2 && first_failed)
          --nfailed;
@@ -1076,7 +1123,7 @@ int mImgtbl_get_hdr (char *fname, struct Hdr_rec *hdr_rec, char *msg)
       if(!badhdr)
       {
          status = 0;
-         if(fits_get_image_wcs_keys(fptr, &header, &status)) 
+         if(montage_imageHdr(fptr, &header, &status)) 
          {
             badhdr = 1;
 
@@ -209,9 +209,8 @@ struct mMakeImgReturn  *mMakeImg(char *template_file, char *output_file, double
 
       if(farray == (FILE *)NULL)
       {
-         printf("[struct stat=\"ERROR\", msg=\"Image array file [%s] not found.\"]\n",
-            arrayfile);
-         exit(1);
+         sprintf(returnStruct->msg, "Image array file [%s] not found.", arrayfile);
+         return returnStruct;
       }
    }
 
@@ -220,7 +219,11 @@ struct mMakeImgReturn  *mMakeImg(char *template_file, char *output_file, double
    /* image size, coordinate system and projection  */ 
    /*************************************************/ 
 
-   mMakeImg_readTemplate(template_file);
+   if(mMakeImg_readTemplate(template_file))
+   {
+      strcpy(returnStruct->msg, montage_msgstr);
+      return returnStruct;
+   }
 
    if(debug >= 1)
    {
@@ -408,9 +411,8 @@ struct mMakeImgReturn  *mMakeImg(char *template_file, char *output_file, double
 
       if(ncol <= 0)
       {
-         printf("[struct stat=\"ERROR\", msg=\"Can't open table table %s\"]\n",
-            cat_file[ifile]);
-         exit(1);
+         sprintf(returnStruct->msg, "Can't open table table %s", cat_file[ifile]);
+         return returnStruct;
       }
 
       tblSys = EQUJ;
@@ -434,9 +436,8 @@ struct mMakeImgReturn  *mMakeImg(char *template_file, char *output_file, double
 
             if(loncol <  0 || latcol <  0)
             {
-               printf("[struct stat=\"ERROR\", msg=\"Can't find lon, lat columns\"]\n");
-
-               exit(1);
+               strcpy(returnStruct->msg, "Can't find lon, lat columns");
+               return returnStruct;
             }
          }
       }
@@ -582,9 +583,8 @@ struct mMakeImgReturn  *mMakeImg(char *template_file, char *output_file, double
 
       if(ncol <= 0)
       {
-         printf("[struct stat=\"ERROR\", msg=\"Can't open table table %s\"]\n",
-            cat_file[ifile]);
-         exit(1);
+         sprintf(returnStruct->msg, "Can't open table table %s", cat_file[ifile]);
+         return returnStruct;
       }
 
       ira [0] = tcol("ra");
@@ -608,10 +608,8 @@ struct mMakeImgReturn  *mMakeImg(char *template_file, char *output_file, double
       || ira[3] <  0 || idec[3] <  0
       || ira[4] <  0 || idec[4] <  0)
       {
-         printf("[struct stat=\"ERROR\", msg=\"Can't find image center or four corners\"]\n");
-         fflush(stdout);
-
-         exit(1);
+         strcpy(returnStruct->msg, "Can't find image center or four corners");
+         return returnStruct;
       }
 
 
@@ -1175,10 +1173,6 @@ struct mMakeImgReturn  *mMakeImg(char *template_file, char *output_file, double
       fflush(stdout);
    }
 
-   printf("[struct stat=\"OK\"]\n");
-   exit(0);
-
-
    strcpy(montage_msgstr, "");
    strcpy(montage_json,   "{}");
 
@@ -1243,6 +1237,8 @@ int mMakeImg_readTemplate(char *filename)
    header[0] = malloc(32768);
    header[1] = (char *)NULL;
 
+   strcpy(header[0], "");
+
 
    /********************************************************/
    /* Open the template file, read and parse all the lines */
@@ -1252,9 +1248,9 @@ int mMakeImg_readTemplate(char *filename)
 
    if(fp == (FILE *)NULL)
    {
-      printf("[struct stat=\"ERROR\", msg=\"Template file [%s] not found.\"]\n",
-         filename);
-      exit(1);
+      sprintf(montage_msgstr, "Template file [%s] not found.", filename);
+      free(header[0]);
+      return 1;
    }
 
    while(1)
@@ -1293,12 +1289,15 @@ int mMakeImg_readTemplate(char *filename)
    /* Initialize the WCS transform library */
    /****************************************/
 
+   fclose(fp);
+
    output.wcs = wcsinit(header[0]);
 
    if(output.wcs == (struct WorldCoor *)NULL)
    {
-      printf("[struct stat=\"ERROR\", msg=\"Output wcsinit() failed. Exiting.\"]\n");
-      exit(1);
+      strcpy(montage_msgstr, "Output wcsinit() failed.");
+      free(header[0]);
+      return 1;
    }
 
    pixscale = fabs(output.wcs->xinc);
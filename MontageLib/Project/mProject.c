@@ -15,10 +15,22 @@ extern int optind, opterr;
 extern int getopt(int argc, char *const *argv, const char *options);
 
 
-int main(int argc, char **argv)
+/* Close the status file (if -s gave one) and pass the return value on */
+
+static int finishCommand(FILE *montage_status, int istatus)
+{
+   if(montage_status != stdout)
+      fclose(montage_status);
+
+   return istatus;
+}
+
+
+static int processCommand(int argc, char **argv)
 {
-   int       c, hdu, expand;
+   int       c, hdu, expand, istatus;
    int       debug, fullRegion, energyMode;
+   int       floatOut;
 
    double    threshold, fluxScale;
    double    drizzle, fixedWeight;
@@ -28,6 +40,7 @@ int main(int argc, char **argv)
    char      output_file  [MAXSTR];
    char      template_file[MAXSTR];
    char      borderstr    [MAXSTR];
+   char      compress     [MAXSTR];
 
    char     *end;
 
@@ -50,15 +63,17 @@ int main(int argc, char **argv)
    expand      = 0;
    fullRegion  = 0;
    energyMode  = 0;
+   floatOut    = 0;
 
    opterr = 0;
 
    strcpy(weight_file, "");
    strcpy(borderstr,   "");
+   strcpy(compress,    "");
 
    montage_status = stdout;
 
-   while ((c = getopt(argc, argv, "ez:d:s:b:h:w:W:t:x:Xf")) != EOF) 
+   while ((c = getopt(argc, argv, "ez:d:s:b:h:w:W:t:x:XfFC:")) != EOF) 
    {
       switch (c) 
       {
@@ -69,7 +84,7 @@ int main(int argc, char **argv)
             {
                printf("[struct stat=\"ERROR\", msg=\"Drizzle factor string (%s) cannot be interpreted as a real number\"]\n", 
                   optarg);
-               exit(1);
+               return finishCommand(montage_status, 1);
             }
 
             break;
@@ -80,7 +95,7 @@ int main(int argc, char **argv)
             if(debug < 0)
             {
                 fprintf(montage_status, "[struct stat=\"ERROR\", msg=\"Invalid debug level.\"]\n");
-                exit(1);
+                return finishCommand(montage_status, 1);
             }
             break;
 
@@ -95,7 +110,7 @@ int main(int argc, char **argv)
             {
                printf("[struct stat=\"ERROR\", msg=\"Fixed weight value (%s) cannot be interpreted as a real number\"]\n",
                   optarg);
-               exit(1);
+               return finishCommand(montage_status, 1);
             }
 
             break;
@@ -107,7 +122,7 @@ int main(int argc, char **argv)
             {
                printf("[struct stat=\"ERROR\", msg=\"Weight threshold string (%s) cannot be interpreted as a real number\"]\n", 
                   optarg);
-               exit(1);
+               return finishCommand(montage_status, 1);
             }
 
             break;
@@ -119,7 +134,7 @@ int main(int argc, char **argv)
             {
                printf("[struct stat=\"ERROR\", msg=\"Flux scale string (%s) cannot be interpreted as a real number\"]\n", 
                   optarg);
-               exit(1);
+               return finishCommand(montage_status, 1);
             }
 
             break;
@@ -133,11 +148,14 @@ int main(int argc, char **argv)
             break;
 
          case 's':
+            if(montage_status != stdout)
+               fclose(montage_status);
+
             if((montage_status = fopen(optarg, "w+")) == (FILE *)NULL)
             {
                printf("[struct stat=\"ERROR\", msg=\"Cannot open status file: %s\"]\n",
                   optarg);
-               exit(1);
+               return 1;
             }
             break;
 
@@ -148,7 +166,7 @@ int main(int argc, char **argv)
             {
                printf("[struct stat=\"ERROR\", msg=\"HDU value (%s) must be a non-negative integer\"]\n",
                   optarg);
-               exit(1);
+               return finishCommand(montage_status, 1);
             }
             break;
 
@@ -160,17 +178,25 @@ int main(int argc, char **argv)
             fullRegion = 1;
             break;
 
+         case 'F':
+            floatOut = 1;
+            break;
+
+         case 'C':
+            strcpy(compress, optarg);
+            break;
+
          default:
-            printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-z factor][-d level][-s statusfile][-h hdu][-x scale][-w weightfile][W fixed-weight][-t threshold][-X(expand)][-b border-string][-e(nergy-mode)][-f(ull-region)] in.fits out.fits hdr.template\"]\n", argv[0]);
-            exit(1);
+            printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-z factor][-d level][-s statusfile][-h hdu][-x scale][-w weightfile][W fixed-weight][-t threshold][-X(expand)][-b border-string][-e(nergy-mode)][-f(ull-region)][-F(loat-output)][-C rice|gzip[:qlevel]] in.fits out.fits hdr.template\"]\n", argv[0]);
+            return finishCommand(montage_status, 1);
             break;
       }
    }
 
    if (argc - optind < 3) 
    {
-      printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-z factor][-d level][-s statusfile][-h hdu][-x scale][-w weightfile][W fixed-weight][-t threshold][-X(expand)][-b border-string][-e(nergy-mode)][-f(ull-region)] in.fits out.fits hdr.template\"]\n", argv[0]);
-      exit(1);
+      printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-z factor][-d level][-s statusfile][-h hdu][-x scale][-w weightfile][W fixed-weight][-t threshold][-X(expand)][-b border-string][-e(nergy-mode)][-f(ull-region)][-F(loat-output)][-C rice|gzip[:qlevel]] in.fits out.fits hdr.template\"]\n", argv[0]);
+      return finishCommand(montage_status, 1);
    }
 
    strcpy(input_file,    argv[optind]);
@@ -178,18 +204,53 @@ int main(int argc, char **argv)
    strcpy(template_file, argv[optind + 2]);
 
 
+   montage_setBitpix(floatOut ? -32 : 0);
+
+   if(montage_setCompress(compress))
+   {
+      printf("[struct stat=\"ERROR\", msg=\"Invalid compression (%s); use rice, gzip or none, optionally followed by :qlevel\"]\n", 
+         compress);
+      return finishCommand(montage_status, 1);
+   }
+
    returnStruct = mProject(input_file, hdu, output_file, template_file, 
                            weight_file, fixedWeight, threshold, borderstr, 
                            drizzle, fluxScale, energyMode, expand, fullRegion, debug);
 
-  if(returnStruct->status == 1)
+   if(returnStruct->status == 1)
    {
        fprintf(montage_status, "[struct stat=\"ERROR\", msg=\"%s\"]\n", returnStruct->msg);
-       exit(1);
+       istatus = 1;
    }
    else
    {
        fprintf(montage_status, "[struct stat=\"OK\", %s]\n", returnStruct->msg);
-       exit(0);
+       istatus = 0;
+   }
+
+   free(returnStruct);
+
+   return finishCommand(montage_status, istatus);
+}
+
+
+
+/*************************************************************************/
+/*                                                                       */
+/*  With the single argument "-server", read command lines from stdin    */
+/*  and process them one at a time in this process (so things like the   */
+/*  parsed header template can be reused).  Otherwise process the        */
+/*  command line as usual.                                               */
+/*                                                                       */
+/*************************************************************************/
+
+int main(int argc, char **argv)
+{
+   if(argc == 2 && strcmp(argv[1], "-server") == 0)
+   {
+      montage_serverMode(argv[0], processCommand);
+      exit(0);
    }
+
+   exit(processCommand(argc, argv));
 }
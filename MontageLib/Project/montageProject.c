@@ -111,6 +111,9 @@ static int    haveWeights;
 
 static double offset;
 
+static struct montage_templateCache checkCache;
+static struct montage_templateCache templateCache;
+
 static char   area_file[MAXSTR];
 
 
@@ -141,6 +144,7 @@ static int    debug;
 static struct
 {
    fitsfile         *fptr;
+   struct mImage    *image;
    long              naxes[2];
    struct WorldCoor *wcs;
    int               sys;
@@ -203,9 +207,17 @@ static double ycorrectionIn;
 
 static time_t currtime, start;
 
+static int    inMemory;
+static char  *templateHdr;
+
 
 static char montage_msgstr[1024];
 
+static struct mProjectReturn *mProject_run(char *input_file, int hduin, char *ofile, char *template_file,
+                                           char *weight_file, double fixedWeight, double threshold, char *borderstr,
+                                           double drizzle, double fluxScale, int energyMode, int expand, int fullRegion, 
+                                           int debugin);
+
 
 /*-***********************************************************************/
 /*                                                                       */
@@ -268,6 +280,90 @@ struct mProjectReturn *mProject(char *input_file, int hduin, char *ofile, char *
                                 char *weight_file, double fixedWeight, double threshold, char *borderstr,
                                 double drizzle, double fluxScale, int energyMode, int expand, int fullRegion, 
                                 int debugin)
+{
+   inMemory    = 0;
+   templateHdr = (char *)NULL;
+
+   input.image       = (struct mImage *)NULL;
+   output.image      = (struct mImage *)NULL;
+   output_area.image = (struct mImage *)NULL;
+
+   return mProject_run(input_file, hduin, ofile, template_file, weight_file, fixedWeight, threshold, borderstr,
+                       drizzle, fluxScale, energyMode, expand, fullRegion, debugin);
+}
+
+
+
+/*-***********************************************************************/
+/*                                                                       */
+/*  mProjectMem                                                          */
+/*                                                                       */
+/*  The same, for an image in memory.  The input pixels are read in      */
+/*  place; the reprojected image (and area image, if asked for) is       */
+/*  returned in memory, to be freed with montage_imageFree().  The       */
+/*  template is a header string.                                         */
+/*                                                                       */
+/*   struct mImage  *input         Image to reproject                    */
+/*   char           *template_hdr  Output header template                */
+/*   struct mImage **output        Returned reprojected image            */
+/*   struct mImage **area          Returned area image (or NULL)         */
+/*                                                                       */
+/*   double drizzle        Optional pixel area "drizzle" factor          */
+/*   double fluxScale      Scale factor applied to all pixels            */
+/*   int    energyMode     Pixel values are total energy rather than     */
+/*                         energy density                                */
+/*   int    expand         Expand output image area to include all of    */
+/*                         the input pixels                              */
+/*   int    fullRegion     Do not "shrink-wrap" output area to non-blank */
+/*                         pixels                                        */
+/*   int    debug          Debugging output level                        */
+/*                                                                       */
+/*************************************************************************/
+
+struct mProjectReturn *mProjectMem(struct mImage *input_image, char *template_hdr,
+                                   struct mImage **outimage, struct mImage **outarea,
+                                   double drizzle, double fluxScale, int energyMode,
+                                   int expand, int fullRegion, int debugin)
+{
+   struct mProjectReturn *returnStruct;
+
+   inMemory    = 1;
+   templateHdr = template_hdr;
+
+   input.image       = input_image;
+   output.image      = (struct mImage *)NULL;
+   output_area.image = (struct mImage *)NULL;
+
+   returnStruct = mProject_run("(memory)", 0, "(memory)", "(memory)", "", 1., 0., "",
+                               drizzle, fluxScale, energyMode, expand, fullRegion, debugin);
+
+   if(returnStruct->status)
+   {
+      montage_imageFree(output.image);
+      montage_imageFree(output_area.image);
+
+      output.image      = (struct mImage *)NULL;
+      output_area.image = (struct mImage *)NULL;
+   }
+
+   *outimage = output.image;
+
+   if(outarea)
+      *outarea = output_area.image;
+   else
+      montage_imageFree(output_area.image);
+
+   return returnStruct;
+}
+
+
+
+/* The reprojection, for files or (inMemory) an image in memory */
+
+static struct mProjectReturn *mProject_run(char *input_file, int hduin, char *ofile, char *template_file,
+                                           char *weight_file, double fixedWeight, double threshold, char *borderstr,
+                                           double drizzle, double fluxScale, int energyMode, int expand, int fullRegion, 
+                                           int debugin)
 {
    int       i, j, k, l, m;
    int       nullcnt, border, bordertype;
@@ -315,6 +411,7 @@ struct mProjectReturn *mProject(char *input_file, int hduin, char *ofile, char *
    double  **area;
 
    double    overlapArea;
+   long long noverlap;
 
    int       status = 0;
 
@@ -407,6 +504,9 @@ struct mProjectReturn *mProject(char *input_file, int hduin, char *ofile, char *
    time(&currtime);
    start = currtime;
 
+   montage_statsStart("mProject");
+   montage_phaseBegin("setup");
+
    border     = 0;
    bordertype = FIXEDBORDER;
 
@@ -437,7 +537,10 @@ struct mProjectReturn *mProject(char *input_file, int hduin, char *ofile, char *
    if(strlen(weight_file) > 0)
       haveWeights = 1;
 
-   checkHdr = montage_checkHdr(input_file, 0, hdu);
+   checkHdr = (char *)NULL;
+
+   if(!inMemory)
+      checkHdr = montage_checkHdr(input_file, 0, hdu);
 
    if(checkHdr)
    {
@@ -445,12 +548,17 @@ struct mProjectReturn *mProject(char *input_file, int hduin, char *ofile, char *
       return returnStruct;
    }
 
-   checkHdr = montage_checkHdr(template_file, 1, 0);
-
-   if(checkHdr)
+   if(!inMemory && !montage_templateSame(&checkCache, template_file, 0, 0.))
    {
-      strcpy(returnStruct->msg, checkHdr);
-      return returnStruct;
+      checkHdr = montage_checkHdr(template_file, 1, 0);
+
+      if(checkHdr)
+      {
+         strcpy(returnStruct->msg, checkHdr);
+         return returnStruct;
+      }
+
+      montage_templateKeep(&checkCache, template_file, 0, 0.);
    }
 
    if(strlen(output_file) > 5 &&
@@ -950,6 +1058,8 @@ struct mProjectReturn *mProject(char *input_file, int hduin, char *ofile, char *
    /* Loop over the input lines */
    /*****************************/
 
+   haveTop   = 0;
+
    fpixel[0] = 1;
    fpixel[1] = border+1;
    fpixel[2] = 1;
@@ -957,6 +1067,10 @@ struct mProjectReturn *mProject(char *input_file, int hduin, char *ofile, char *
 
    nelements = input.naxes[0];
 
+   noverlap = 0;
+
+   montage_phaseEnd("setup");
+
    for (j=border; j<input.naxes[1]-border; ++j)
    {
       ibmin = border;
@@ -992,13 +1106,17 @@ struct mProjectReturn *mProject(char *input_file, int hduin, char *ofile, char *
       /* Read a line from the input file */
       /***********************************/
 
-      if(fits_read_pix(input.fptr, TDOUBLE, fpixel, nelements, &nan,
-                       buffer, &nullcnt, &status))
+      montage_phaseBegin("read");
+
+      if(montage_readPix(input.fptr, input.image, TDOUBLE, fpixel, nelements, &nan,
+                         buffer, &nullcnt, &status))
       {
          mProject_printFitsError(status);
          return returnStruct;
       }
 
+      montage_countRead(input.fptr, nelements);
+
       if(haveWeights)
       {
          if(fits_read_pix(weight.fptr, TDOUBLE, fpixel, nelements, &nan,
@@ -1007,10 +1125,18 @@ struct mProjectReturn *mProject(char *input_file, int hduin, char *ofile, char *
             mProject_printFitsError(status);
             return returnStruct;
          }
+
+         montage_countRead(weight.fptr, nelements);
       }
 
       ++fpixel[1];
 
+      montage_phaseEnd("read");
+
+      montage_countPixels(ibmax - ibmin);
+
+      montage_phaseBegin("transform");
+
 
       /*************************************************************/
       /*                                                           */
@@ -1374,10 +1500,15 @@ struct mProjectReturn *mProject(char *input_file, int hduin, char *ofile, char *
       }
 
       
+      montage_phaseEnd("transform");
+
+
       /************************/
       /* For each input pixel */
       /************************/
 
+      montage_phaseBegin("overlap");
+
       for (i=0; i<input.naxes[0]; ++i)
       {
          if(haveIn && (j != yrefin || i != xrefin))
@@ -1592,8 +1723,12 @@ struct mProjectReturn *mProject(char *input_file, int hduin, char *ofile, char *
                   if(weight_value > 0)
                   {
                      if(!haveIn && !haveOut)
+                     {
                         overlapArea = mProject_computeOverlap(ilon, ilat, olon, olat, energyMode, refArea, &areaRatio);
 
+                        ++noverlap;
+                     }
+
                      if((haveIn  && j == yrefin  && i == xrefin )
                      || (haveOut && m == yrefout && l == xrefout))
                      {  
@@ -1630,8 +1765,12 @@ struct mProjectReturn *mProject(char *input_file, int hduin, char *ofile, char *
             }
          }
       }
+
+      montage_phaseEnd("overlap");
    }
 
+   montage_countOverlaps(noverlap);
+
    if(debug >= 1)
    {
       time(&currtime);
@@ -1640,7 +1779,7 @@ struct mProjectReturn *mProject(char *input_file, int hduin, char *ofile, char *
       fflush(stdout);
    }
 
-   if(fits_close_file(input.fptr, &status))
+   if(montage_closeInput(input.fptr, input.image, &status))
    {
       mProject_printFitsError(status);
       strcpy(returnStruct->msg, montage_msgstr);
@@ -1745,17 +1884,20 @@ struct mProjectReturn *mProject(char *input_file, int hduin, char *ofile, char *
    /* Create the output FITS files */
    /********************************/
 
-   remove(output_file);               
-   remove(area_file);               
+   if(!inMemory)
+   {
+      remove(output_file);               
+      remove(area_file);               
+   }
 
-   if(fits_create_file(&output.fptr, output_file, &status)) 
+   if(fits_create_file(&output.fptr, inMemory ? "mem://" : montage_outName(output_file), &status)) 
    {
       mProject_printFitsError(status);
       strcpy(returnStruct->msg, montage_msgstr);
       return returnStruct;
    }
 
-   if(fits_create_file(&output_area.fptr, area_file, &status)) 
+   if(fits_create_file(&output_area.fptr, inMemory ? "mem://" : montage_outName(area_file), &status)) 
    {
       mProject_printFitsError(status);
       strcpy(returnStruct->msg, montage_msgstr);
@@ -1765,9 +1907,12 @@ struct mProjectReturn *mProject(char *input_file, int hduin, char *ofile, char *
 
    /*********************************************************/
    /* Create the FITS image.  All the required keywords are */
-   /* handled automatically.                                */
+   /* handled automatically.  The output is double unless   */
+   /* single precision (BITPIX -32) has been requested.     */
    /*********************************************************/
 
+   bitpix = montage_outBitpix();
+
    if (fits_create_img(output.fptr, bitpix, naxis, output.naxes, &status))
    {
       mProject_printFitsError(status);
@@ -1799,7 +1944,7 @@ struct mProjectReturn *mProject(char *input_file, int hduin, char *ofile, char *
    /* Set FITS header from a template file */
    /****************************************/
 
-   if(fits_write_key_template(output.fptr, template_file, &status))
+   if(montage_writeTemplate(output.fptr, template_file, templateHdr, &status))
    {
       mProject_printFitsError(status);
       strcpy(returnStruct->msg, montage_msgstr);
@@ -1812,7 +1957,7 @@ struct mProjectReturn *mProject(char *input_file, int hduin, char *ofile, char *
       fflush(stdout);
    }
 
-   if(fits_write_key_template(output_area.fptr, template_file, &status))
+   if(montage_writeTemplate(output_area.fptr, template_file, templateHdr, &status))
    {
       mProject_printFitsError(status);
       strcpy(returnStruct->msg, montage_msgstr);
@@ -1826,11 +1971,11 @@ struct mProjectReturn *mProject(char *input_file, int hduin, char *ofile, char *
    }
 
 
-   /***************************/
-   /* Modify BITPIX to be -64 */
-   /***************************/
+   /**********************************/
+   /* Modify BITPIX to be -64 or -32 */
+   /**********************************/
 
-   if(fits_update_key_lng(output.fptr, "BITPIX", -64,
+   if(fits_update_key_lng(output.fptr, "BITPIX", bitpix,
                                   (char *)NULL, &status))
    {
       mProject_printFitsError(status);
@@ -1838,7 +1983,7 @@ struct mProjectReturn *mProject(char *input_file, int hduin, char *ofile, char *
       return returnStruct;
    }
 
-   if(fits_update_key_lng(output_area.fptr, "BITPIX", -64,
+   if(fits_update_key_lng(output_area.fptr, "BITPIX", bitpix,
                                   (char *)NULL, &status))
    {
       mProject_printFitsError(status);
@@ -1984,24 +2129,53 @@ struct mProjectReturn *mProject(char *input_file, int hduin, char *ofile, char *
    }
 
 
+   /************************************************/
+   /* If the output is to be tile-compressed, the  */
+   /* headers so far are in memory; now create the */
+   /* real files.                                  */
+   /************************************************/
+
+   if(inMemory)
+   {
+      montage_memOutput(output.fptr,      &output.image,      &status);
+      montage_memOutput(output_area.fptr, &output_area.image, &status);
+   }
+   else
+   {
+      montage_compressImage(&output.fptr,      output_file, &status);
+      montage_compressArea (&output_area.fptr, area_file,   &status);
+   }
+
+   if(status)
+   {
+      mProject_printFitsError(status);
+      strcpy(returnStruct->msg, montage_msgstr);
+      return returnStruct;
+   }
+
+
    /************************/
    /* Write the image data */
    /************************/
 
+   montage_phaseBegin("write");
+
    fpixel[0] = 1;
    fpixel[1] = 1;
    nelements = imax - imin + 1;
 
    for(j=jmin; j<=jmax; ++j)
    {
-      if (fits_write_pix(output.fptr, TDOUBLE, fpixel, nelements, 
-                         (void *)(&data[j-jstart][imin-istart]), &status))
+      if (montage_putPix(output.fptr, output.image, TDOUBLE, fpixel, nelements, 
+                           (void *)(&data[j-jstart][imin-istart]), &status))
       {
          mProject_printFitsError(status);
          strcpy(returnStruct->msg, montage_msgstr);
          return returnStruct;
       }
 
+      montage_countWrite(output.fptr, nelements);
+
       ++fpixel[1];
    }
 
@@ -2024,14 +2198,16 @@ struct mProjectReturn *mProject(char *input_file, int hduin, char *ofile, char *
 
    for(j=jmin; j<=jmax; ++j)
    {
-      if (fits_write_pix(output_area.fptr, TDOUBLE, fpixel, nelements,
-                         (void *)(&area[j-jstart][imin-istart]), &status))
+      if (montage_putPix(output_area.fptr, output_area.image, TDOUBLE, fpixel, nelements,
+                           (void *)(&area[j-jstart][imin-istart]), &status))
       {
          mProject_printFitsError(status);
          strcpy(returnStruct->msg, montage_msgstr);
          return returnStruct;
       }
 
+      montage_countWrite(output_area.fptr, nelements);
+
       ++fpixel[1];
    }
 
@@ -2048,7 +2224,7 @@ struct mProjectReturn *mProject(char *input_file, int hduin, char *ofile, char *
    /* Close the FITS file */
    /***********************/
 
-   if(fits_close_file(output.fptr, &status))
+   if(montage_closeOutput(output.fptr, output.image, &status))
    {
       mProject_printFitsError(status);
       strcpy(returnStruct->msg, montage_msgstr);
@@ -2061,7 +2237,7 @@ struct mProjectReturn *mProject(char *input_file, int hduin, char *ofile, char *
       fflush(stdout);
    }
 
-   if(fits_close_file(output_area.fptr, &status))
+   if(montage_closeOutput(output_area.fptr, output_area.image, &status))
    {
       mProject_printFitsError(status);
       strcpy(returnStruct->msg, montage_msgstr);
@@ -2074,12 +2250,14 @@ struct mProjectReturn *mProject(char *input_file, int hduin, char *ofile, char *
       fflush(stdout);
    }
 
+   montage_phaseEnd("write");
+
    time(&currtime);
 
    returnStruct->status = 0;
 
-   sprintf(returnStruct->msg,  "time=%.1f",       (double)(currtime - start));
-   sprintf(returnStruct->json, "{\"time\":%.1f}", (double)(currtime - start));
+   sprintf(returnStruct->msg,  "time=%.1f",           (double)(currtime - start));
+   sprintf(returnStruct->json, "{\"time\":%.1f, %s}", (double)(currtime - start), montage_statsEnd());
 
    returnStruct->time = (double)(currtime - start);
 
@@ -2137,11 +2315,41 @@ int mProject_readTemplate(char *filename)
    int       offscl;
 
 
+   /*****************************************************/
+   /* If we already have this template (with the same   */
+   /* expansion), the output structures are still good  */
+   /*****************************************************/
+
+   if(!inMemory && montage_templateSame(&templateCache, filename, 0, offset))
+   {
+      if(debug >= 1)
+      {
+         printf("Using cached output template.\n");
+         fflush(stdout);
+      }
+
+      return 0;
+   }
+
+   montage_templateClear(&templateCache);
+
+   if(output.wcs)
+   {
+      wcsfree(output.wcs);
+
+      output.wcs      = (struct WorldCoor *)NULL;
+      output_area.wcs = (struct WorldCoor *)NULL;
+   }
+
+
    /********************************************************/
    /* Open the template file, read and parse all the lines */
    /********************************************************/
 
-   fp = fopen(filename, "r");
+   if(templateHdr)
+      fp = montage_memText(templateHdr);
+   else
+      fp = fopen(filename, "r");
 
    if(fp == (FILE *)NULL)
    {
@@ -2173,6 +2381,8 @@ int mProject_readTemplate(char *filename)
       mProject_stradd(header, line);
    }
 
+   fclose(fp);
+
 
    /****************************************/
    /* Initialize the WCS transform library */
@@ -2298,6 +2508,9 @@ int mProject_readTemplate(char *filename)
          printf("Output pixels are counterclockwise.\n");
    }
 
+   if(!inMemory)
+      montage_templateKeep(&templateCache, filename, 0, offset);
+
    return 0;
 }
 
@@ -2422,7 +2635,12 @@ int mProject_readFits(char *filename, char *weightfile)
    /* for WCS setup                         */
    /*****************************************/
 
-   if(fits_open_file(&input.fptr, filename, READONLY, &status))
+   if(input.image)
+      montage_memOpen(&input.fptr, input.image, &status);
+   else
+      fits_open_file(&input.fptr, filename, READONLY, &status);
+
+   if(status)
    {
       sprintf(errstr, "Image file %s missing or invalid FITS", filename);
       mProject_printError(errstr);
@@ -2471,6 +2689,9 @@ int mProject_readFits(char *filename, char *weightfile)
    /* Initialize the WCS transform library */
    /****************************************/
 
+   if(input.wcs)
+      wcsfree(input.wcs);
+
    input.wcs = wcsinit(header);
 
    if(input.wcs == (struct WorldCoor *)NULL)
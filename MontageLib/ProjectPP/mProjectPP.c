@@ -15,11 +15,23 @@ extern int optind, opterr;
 extern int getopt(int argc, char *const *argv, const char *options);
 
 
-int main(int argc, char **argv)
+/* Close the status file (if -s gave one) and pass the return value on */
+
+static int finishCommand(FILE *montage_status, int istatus)
+{
+   if(montage_status != stdout)
+      fclose(montage_status);
+
+   return istatus;
+}
+
+
+static int processCommand(int argc, char **argv)
 {
-   int       c, hdu;
+   int       c, hdu, istatus;
    int       expand;
    int       debug, fullRegion;
+   int       floatOut;
 
    double    threshold, fluxScale;
    double    drizzle, fixedWeight;
@@ -31,6 +43,7 @@ int main(int argc, char **argv)
    char      borderstr    [MAXSTR];
    char      altout       [MAXSTR];
    char      altin        [MAXSTR];
+   char      compress     [MAXSTR];
 
    char     *end;
 
@@ -52,6 +65,7 @@ int main(int argc, char **argv)
    hdu         = 0;
    expand      = 0;
    fullRegion  = 0;
+   floatOut    = 0;
 
    opterr = 0;
 
@@ -59,10 +73,11 @@ int main(int argc, char **argv)
    strcpy(borderstr,   "");
    strcpy(altout,      "");
    strcpy(altin,       "");
+   strcpy(compress,    "");
 
    montage_status = stdout;
 
-   while ((c = getopt(argc, argv, "z:d:s:b:h:w:W:t:x:Xfi:o:")) != EOF) 
+   while ((c = getopt(argc, argv, "z:d:s:b:h:w:W:t:x:XfFC:i:o:")) != EOF) 
    {
       switch (c) 
       {
@@ -73,7 +88,7 @@ int main(int argc, char **argv)
             {
                printf("[struct stat=\"ERROR\", msg=\"Drizzle factor string (%s) cannot be interpreted as a real number\"]\n", 
                   optarg);
-               exit(1);
+               return finishCommand(montage_status, 1);
             }
 
             break;
@@ -84,7 +99,7 @@ int main(int argc, char **argv)
             if(debug < 0)
             {
                 fprintf(montage_status, "[struct stat=\"ERROR\", msg=\"Invalid debug level.\"]\n");
-                exit(1);
+                return finishCommand(montage_status, 1);
             }
             break;
 
@@ -107,7 +122,7 @@ int main(int argc, char **argv)
             {
                printf("[struct stat=\"ERROR\", msg=\"Fixed weight value (%s) cannot be interpreted as a real number\"]\n", 
                   optarg);
-               exit(1);
+               return finishCommand(montage_status, 1);
             }
 
             break;
@@ -119,7 +134,7 @@ int main(int argc, char **argv)
             {
                printf("[struct stat=\"ERROR\", msg=\"Weight threshold string (%s) cannot be interpreted as a real number\"]\n",
                   optarg);
-               exit(1);
+               return finishCommand(montage_status, 1);
             }
 
             break;
@@ -131,7 +146,7 @@ int main(int argc, char **argv)
             {
                printf("[struct stat=\"ERROR\", msg=\"Flux scale string (%s) cannot be interpreted as a real number\"]\n",
                   optarg);
-               exit(1);
+               return finishCommand(montage_status, 1);
             }
 
             break;
@@ -145,11 +160,14 @@ int main(int argc, char **argv)
             break;
 
          case 's':
+            if(montage_status != stdout)
+               fclose(montage_status);
+
             if((montage_status = fopen(optarg, "w+")) == (FILE *)NULL)
             {
                printf("[struct stat=\"ERROR\", msg=\"Cannot open status file: %s\"]\n",
                   optarg);
-               exit(1);
+               return 1;
             }
             break;
 
@@ -160,7 +178,7 @@ int main(int argc, char **argv)
             {
                printf("[struct stat=\"ERROR\", msg=\"HDU value (%s) must be a non-negative integer\"]\n", 
                   optarg);
-               exit(1);
+               return finishCommand(montage_status, 1);
             }
             break;
 
@@ -168,17 +186,25 @@ int main(int argc, char **argv)
             fullRegion = 1;
             break;
 
+         case 'F':
+            floatOut = 1;
+            break;
+
+         case 'C':
+            strcpy(compress, optarg);
+            break;
+
          default:
-            printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-z factor][-d level][-b border][-s statusfile][-o altout.hdr][-i altin.hdr][-h hdu][-x scale][-w weightfile][-W fixed-weight][-t threshold][-X(expand)][-b border-string] in.fits out.fits template.hdr\"]\n", argv[0]);
-            exit(1);
+            printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-z factor][-d level][-b border][-s statusfile][-o altout.hdr][-i altin.hdr][-h hdu][-x scale][-w weightfile][-W fixed-weight][-t threshold][-X(expand)][-b border-string][-F(loat-output)][-C rice|gzip[:qlevel]] in.fits out.fits template.hdr\"]\n", argv[0]);
+            return finishCommand(montage_status, 1);
             break;
       }
    }
 
    if (argc - optind < 3) 
    {
-      printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-z factor][-d level][-b border][-s statusfile][-o altout.hdr][-i altin.hdr][-h hdu][-x scale][-w weightfile][-W fixed-weight][-t threshold][-X(expand)][-b border-string] in.fits out.fits template.hdr\"]\n", argv[0]);
-      exit(1);
+      printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-z factor][-d level][-b border][-s statusfile][-o altout.hdr][-i altin.hdr][-h hdu][-x scale][-w weightfile][-W fixed-weight][-t threshold][-X(expand)][-b border-string][-F(loat-output)][-C rice|gzip[:qlevel]] in.fits out.fits template.hdr\"]\n", argv[0]);
+      return finishCommand(montage_status, 1);
    }
 
    strcpy(input_file,    argv[optind]);
@@ -186,6 +212,15 @@ int main(int argc, char **argv)
    strcpy(template_file, argv[optind + 2]);
 
 
+   montage_setBitpix(floatOut ? -32 : 0);
+
+   if(montage_setCompress(compress))
+   {
+      printf("[struct stat=\"ERROR\", msg=\"Invalid compression (%s); use rice, gzip or none, optionally followed by :qlevel\"]\n", 
+         compress);
+      return finishCommand(montage_status, 1);
+   }
+
    returnStruct = mProjectPP(input_file, hdu, output_file, template_file,
                              weight_file, fixedWeight, threshold, borderstr,
                              altin, altout, drizzle, fluxScale,
@@ -194,11 +229,37 @@ int main(int argc, char **argv)
    if(returnStruct->status == 1)
    {
        fprintf(montage_status, "[struct stat=\"ERROR\", msg=\"%s\"]\n", returnStruct->msg);
-       exit(1);
+       istatus = 1;
    }
    else
    {
        fprintf(montage_status, "[struct stat=\"OK\", %s]\n", returnStruct->msg);
-       exit(0);
+       istatus = 0;
+   }
+
+   free(returnStruct);
+
+   return finishCommand(montage_status, istatus);
+}
+
+
+
+/*************************************************************************/
+/*                                                                       */
+/*  With the single argument "-server", read command lines from stdin    */
+/*  and process them one at a time in this process (so things like the   */
+/*  parsed header template can be reused).  Otherwise process the        */
+/*  command line as usual.                                               */
+/*                                                                       */
+/*************************************************************************/
+
+int main(int argc, char **argv)
+{
+   if(argc == 2 && strcmp(argv[1], "-server") == 0)
+   {
+      montage_serverMode(argv[0], processCommand);
+      exit(0);
    }
+
+   exit(processCommand(argc, argv));
 }
@@ -78,6 +78,9 @@ static int    haveWeights;
 
 static double offset;
 
+static struct montage_templateCache checkCache;
+static struct montage_templateCache templateCache;
+
 static char  *input_header;
 static char   template_header  [HDRLEN];
 static char   alt_input_header [HDRLEN];
@@ -107,6 +110,7 @@ static int  hdu;
 static struct
 {
    fitsfile         *fptr;
+   struct mImage    *image;
    long              naxes[2];
    struct WorldCoor *wcs;
    int               sys;
@@ -116,6 +120,9 @@ static struct
 input, weight, output, output_area;
 
 
+static int    inMemory;
+static char  *templateHdr;
+
 static double crpix1, crpix2;
 
 static double pixelArea;
@@ -137,6 +144,17 @@ static struct Ipos *topl, *bottoml;
 static struct Ipos *topr, *bottomr;
 static struct Ipos *postmp;
 
+static double *rowx, *rowy;
+static double *rowox, *rowoy;
+static int    *rowstat;
+
+static void mProjectPP_projectRow(int n, struct Ipos *pos);
+
+static struct mProjectPPReturn *mProjectPP_run(char *input_file, int hduin, char *ofile, char *template_file,
+                                               char *weight_file, double fixedWeight, double threshold, char *borderstr, 
+                                               char *altin, char *altout, double drizzle, double fluxScale, 
+                                               int expand, int fullRegion, int debugin);
+
 
 static time_t currtime, start;
 
@@ -211,6 +229,88 @@ struct mProjectPPReturn *mProjectPP(char *input_file, int hduin, char *ofile, ch
                                     char *weight_file, double fixedWeight, double threshold, char *borderstr, 
                                     char *altin, char *altout, double drizzle, double fluxScale, 
                                     int expand, int fullRegion, int debugin)
+{
+   inMemory    = 0;
+   templateHdr = (char *)NULL;
+
+   input.image       = (struct mImage *)NULL;
+   output.image      = (struct mImage *)NULL;
+   output_area.image = (struct mImage *)NULL;
+
+   return mProjectPP_run(input_file, hduin, ofile, template_file, weight_file, fixedWeight, threshold, borderstr,
+                         altin, altout, drizzle, fluxScale, expand, fullRegion, debugin);
+}
+
+
+
+/*-***********************************************************************/
+/*                                                                       */
+/*  mProjectPPMem                                                        */
+/*                                                                       */
+/*  The same, for an image in memory.  The input pixels are read in      */
+/*  place; the reprojected image (and area image, if asked for) is       */
+/*  returned in memory, to be freed with montage_imageFree().  The       */
+/*  template is a header string.                                         */
+/*                                                                       */
+/*   struct mImage  *input         Image to reproject                    */
+/*   char           *template_hdr  Output header template                */
+/*   struct mImage **output        Returned reprojected image            */
+/*   struct mImage **area          Returned area image (or NULL)         */
+/*                                                                       */
+/*   double drizzle        Optional pixel area "drizzle" factor          */
+/*   double fluxScale      Scale factor applied to all pixels            */
+/*   int    expand         Expand output image area to include all of    */
+/*                         the input pixels                              */
+/*   int    fullRegion     Do not "shrink-wrap" output area to non-blank */
+/*                         pixels                                        */
+/*   int    debug          Debugging output level                        */
+/*                                                                       */
+/*************************************************************************/
+
+struct mProjectPPReturn *mProjectPPMem(struct mImage *input_image, char *template_hdr,
+                                       struct mImage **outimage, struct mImage **outarea,
+                                       double drizzle, double fluxScale,
+                                       int expand, int fullRegion, int debugin)
+{
+   struct mProjectPPReturn *returnStruct;
+
+   inMemory    = 1;
+   templateHdr = template_hdr;
+
+   input.image       = input_image;
+   output.image      = (struct mImage *)NULL;
+   output_area.image = (struct mImage *)NULL;
+
+   returnStruct = mProjectPP_run("(memory)", 0, "(memory)", "(memory)", "", 1., 0., "", "", "",
+                                 drizzle, fluxScale, expand, fullRegion, debugin);
+
+   if(returnStruct->status)
+   {
+      montage_imageFree(output.image);
+      montage_imageFree(output_area.image);
+
+      output.image      = (struct mImage *)NULL;
+      output_area.image = (struct mImage *)NULL;
+   }
+
+   *outimage = output.image;
+
+   if(outarea)
+      *outarea = output_area.image;
+   else
+      montage_imageFree(output_area.image);
+
+   return returnStruct;
+}
+
+
+
+/* The reprojection, for files or (inMemory) an image in memory */
+
+static struct mProjectPPReturn *mProjectPP_run(char *input_file, int hduin, char *ofile, char *template_file,
+                                               char *weight_file, double fixedWeight, double threshold, char *borderstr, 
+                                               char *altin, char *altout, double drizzle, double fluxScale, 
+                                               int expand, int fullRegion, int debugin)
 {
    int       i, j, l, m;
    int       nullcnt;
@@ -243,6 +343,7 @@ struct mProjectPPReturn *mProjectPP(char *input_file, int hduin, char *ofile, ch
    double  **area;
 
    double    overlapArea;
+   long long noverlap;
 
    int       status;
 
@@ -317,6 +418,9 @@ struct mProjectPPReturn *mProjectPP(char *input_file, int hduin, char *ofile, ch
    time(&currtime);
    start = currtime;
 
+   montage_statsStart("mProjectPP");
+   montage_phaseBegin("setup");
+
    border     = 0;
    bordertype = FIXEDBORDER;
 
@@ -347,7 +451,10 @@ struct mProjectPPReturn *mProjectPP(char *input_file, int hduin, char *ofile, ch
    if(strlen(weight_file) > 0)
       haveWeights = 1;
 
-   checkHdr = montage_checkHdr(input_file, 0, hdu);
+   checkHdr = (char *)NULL;
+
+   if(!inMemory)
+      checkHdr = montage_checkHdr(input_file, 0, hdu);
 
    if(checkHdr)
    {
@@ -355,12 +462,17 @@ struct mProjectPPReturn *mProjectPP(char *input_file, int hduin, char *ofile, ch
       return returnStruct;
    }
 
-   checkHdr = montage_checkHdr(template_file, 1, 0);
-
-   if(checkHdr)
+   if(!inMemory && !montage_templateSame(&checkCache, template_file, 0, 0.))
    {
-      strcpy(returnStruct->msg, checkHdr);
-      return returnStruct;
+      checkHdr = montage_checkHdr(template_file, 1, 0);
+
+      if(checkHdr)
+      {
+         strcpy(returnStruct->msg, checkHdr);
+         return returnStruct;
+      }
+
+      montage_templateKeep(&checkCache, template_file, 0, 0.);
    }
 
    if(altin[0] != '\0')
@@ -571,6 +683,18 @@ struct mProjectPPReturn *mProjectPP(char *input_file, int hduin, char *ofile, ch
    bottomr = (struct Ipos *)malloc((input.naxes[0]+1) * sizeof(struct Ipos));
 
 
+   /**************************************************/
+   /* Work arrays for projecting a row of corners    */
+   /* with one two-plane library call                */
+   /**************************************************/
+
+   rowx    = (double *)malloc((input.naxes[0]+1) * sizeof(double));
+   rowy    = (double *)malloc((input.naxes[0]+1) * sizeof(double));
+   rowox   = (double *)malloc((input.naxes[0]+1) * sizeof(double));
+   rowoy   = (double *)malloc((input.naxes[0]+1) * sizeof(double));
+   rowstat = (int    *)malloc((input.naxes[0]+1) * sizeof(int));
+
+
    /**************************************************/
    /* Create the buffer for one line of input pixels */
    /**************************************************/
@@ -903,6 +1027,10 @@ struct mProjectPPReturn *mProjectPP(char *input_file, int hduin, char *ofile, ch
 
    nelements = input.naxes[0];
 
+   noverlap = 0;
+
+   montage_phaseEnd("setup");
+
    for (j=border; j<input.naxes[1]-border; ++j)
    {
       ibmin = border;
@@ -937,14 +1065,18 @@ struct mProjectPPReturn *mProjectPP(char *input_file, int hduin, char *ofile, ch
       /* Read a line from the input file */
       /***********************************/
 
-      if(fits_read_pix(input.fptr, TDOUBLE, fpixel, nelements, &nan,
-                       buffer, &nullcnt, &status))
+      montage_phaseBegin("read");
+
+      if(montage_readPix(input.fptr, input.image, TDOUBLE, fpixel, nelements, &nan,
+                         buffer, &nullcnt, &status))
       {
          mProjectPP_printFitsError(status);
          strcpy(returnStruct->msg, montage_msgstr);
          return returnStruct;
       }
 
+      montage_countRead(input.fptr, nelements);
+
       if(haveWeights)
       {
          if(fits_read_pix(weight.fptr, TDOUBLE, fpixel, nelements, &nan,
@@ -954,10 +1086,18 @@ struct mProjectPPReturn *mProjectPP(char *input_file, int hduin, char *ofile, ch
             strcpy(returnStruct->msg, montage_msgstr);
             return returnStruct;
          }
+
+         montage_countRead(weight.fptr, nelements);
       }
 
       ++fpixel[1];
 
+      montage_phaseEnd("read");
+
+      montage_countPixels(ibmax - ibmin);
+
+      montage_phaseBegin("transform");
+
 
       /*************************************************************/
       /*                                                           */
@@ -982,64 +1122,57 @@ struct mProjectPPReturn *mProjectPP(char *input_file, int hduin, char *ofile, ch
 
       if(!haveTop || drizzle != 1.0)
       {
-         for (i=0; i<input.naxes[0]+1; ++i)
-         {
-            /* For the general 'drizzle' algorithm we must       */
-            /* project all four of the pixel corners separately. */
-            /* However, in the default case where the input      */
-            /* pixels are assumed to fill their area, we can     */
-            /* save compute time by reusing the values for the   */
-            /* shared corners of one pixel for the next.         */
+         /* For the general 'drizzle' algorithm we must       */
+         /* project all four of the pixel corners separately. */
+         /* However, in the default case where the input      */
+         /* pixels are assumed to fill their area, we can     */
+         /* save compute time by reusing the values for the   */
+         /* shared corners of one pixel for the next.         */
+         /*                                                   */
+         /* Either way, a whole row of corners goes through   */
+         /* the two-plane transform in one call.              */
 
 
-            /* Project the top corners (if corners are shared) */
+         /* Project the top corners (if corners are shared) */
 
-            if(drizzle == 1.)
+         if(drizzle == 1.)
+         {
+            for (i=0; i<input.naxes[0]+1; ++i)
             {
-               offscl = plane1_to_plane2_transform(i+0.5, j+0.5, 
-                                             &((topl+i)->oxpix), 
-                                             &((topl+i)->oypix),
-                                             &two_plane);
-
-               (topl+i)->offscl = offscl;
+               rowx[i] = i+0.5;
+               rowy[i] = j+0.5;
+            }
 
-               if(i>0)
-               {
-                  (topr+i-1)->oxpix  = (topl+i)->oxpix;
-                  (topr+i-1)->oypix  = (topl+i)->oypix;
-                  (topr+i-1)->offscl = (topl+i)->offscl;
-               }
+            mProjectPP_projectRow(input.naxes[0]+1, topl);
 
-               haveTop = 1;
-            }
+            for (i=1; i<input.naxes[0]+1; ++i)
+               *(topr+i-1) = *(topl+i);
 
+            haveTop = 1;
+         }
 
-            /* Project the top corners (if corners aren't shared) */
 
-            else
-            {
-               /* TOP LEFT */
+         /* Project the top corners (if corners aren't shared) */
 
-               offscl = plane1_to_plane2_transform(
-                                    i+1-0.5*drizzle, j+1-0.5*drizzle,
-                                    &((topl+i)->oxpix), 
-                                    &((topl+i)->oypix), 
-                                    &two_plane);
+         else
+         {
+            /* TOP LEFT */
 
-               (topl+i)->offscl = offscl;
+            for (i=0; i<input.naxes[0]+1; ++i)
+            {
+               rowx[i] = i+1-0.5*drizzle;
+               rowy[i] = j+1-0.5*drizzle;
+            }
 
+            mProjectPP_projectRow(input.naxes[0]+1, topl);
 
 
-               /* TOP RIGHT */
+            /* TOP RIGHT */
 
-               offscl = plane1_to_plane2_transform(
-                                    i+1+0.5*drizzle, j+1-0.5*drizzle,
-                                    &((topr+i)->oxpix), 
-                                    &((topr+i)->oypix), 
-                                    &two_plane);
+            for (i=0; i<input.naxes[0]+1; ++i)
+               rowx[i] = i+1+0.5*drizzle;
 
-               (topr+i)->offscl = offscl;
-            }
+            mProjectPP_projectRow(input.naxes[0]+1, topr);
          }
       }
 
@@ -1063,62 +1196,56 @@ struct mProjectPPReturn *mProjectPP(char *input_file, int hduin, char *ofile, ch
 
       /* 'BOTTOMS' of the pixels */
 
-      for (i=0; i<input.naxes[0]+1; ++i)
-      {
-
-         /* Project the bottom corners (if corners are shared) */
+      /* Project the bottom corners (if corners are shared) */
 
-         if(drizzle == 1.)
+      if(drizzle == 1.)
+      {
+         for (i=0; i<input.naxes[0]+1; ++i)
          {
-            offscl = plane1_to_plane2_transform(i+0.5, j+1.5,
-                                       &((bottoml+i)->oxpix), 
-                                       &((bottoml+i)->oypix), 
-                                       &two_plane);
-
-            (bottoml+i)->offscl = offscl;
-
-            if(i>0)
-            {
-               (bottomr+i-1)->oxpix  = (bottoml+i)->oxpix;
-               (bottomr+i-1)->oypix  = (bottoml+i)->oypix;
-               (bottomr+i-1)->offscl = (bottoml+i)->offscl;
-            }
+            rowx[i] = i+0.5;
+            rowy[i] = j+1.5;
          }
 
+         mProjectPP_projectRow(input.naxes[0]+1, bottoml);
+
+         for (i=1; i<input.naxes[0]+1; ++i)
+            *(bottomr+i-1) = *(bottoml+i);
+      }
 
-         /* Project the bottom corners (if corners aren't shared) */
 
-         else
-         {
-            /* BOTTOM LEFT */
+      /* Project the bottom corners (if corners aren't shared) */
 
-            offscl = plane1_to_plane2_transform(
-                                i+1-0.5*drizzle, j+1+0.5*drizzle,
-                                &((bottoml+i)->oxpix), 
-                                &((bottoml+i)->oypix), 
-                                &two_plane);
+      else
+      {
+         /* BOTTOM LEFT */
 
-            (bottoml+i)->offscl = offscl;
+         for (i=0; i<input.naxes[0]+1; ++i)
+         {
+            rowx[i] = i+1-0.5*drizzle;
+            rowy[i] = j+1+0.5*drizzle;
+         }
 
+         mProjectPP_projectRow(input.naxes[0]+1, bottoml);
 
 
-            /* BOTTOM RIGHT */
+         /* BOTTOM RIGHT */
 
-            offscl = plane1_to_plane2_transform(
-                                   i+1+0.5*drizzle, j+1+0.5*drizzle,
-                                   &((bottomr+i)->oxpix), 
-                                   &((bottomr+i)->oypix), 
-                                   &two_plane);
+         for (i=0; i<input.naxes[0]+1; ++i)
+            rowx[i] = i+1+0.5*drizzle;
 
-            (bottomr+i)->offscl = offscl;
-         }
+         mProjectPP_projectRow(input.naxes[0]+1, bottomr);
       }
 
       
+      montage_phaseEnd("transform");
+
+
       /************************/
       /* For each input pixel */
       /************************/
 
+      montage_phaseBegin("overlap");
+
       for (i=ibmin; i<ibmax; ++i)
       {
          pixel_value = buffer[i];
@@ -1273,6 +1400,8 @@ struct mProjectPPReturn *mProjectPP(char *input_file, int hduin, char *ofile, ch
                                                                minX,  maxX,
                                                                minY,  maxY,
                                                                pixelArea);
+
+                     ++noverlap;
                   }
 
 
@@ -1295,8 +1424,12 @@ struct mProjectPPReturn *mProjectPP(char *input_file, int hduin, char *ofile, ch
             }
          }
       }
+
+      montage_phaseEnd("overlap");
    }
 
+   montage_countOverlaps(noverlap);
+
    if(debug >= 1)
    {
       time(&currtime);
@@ -1305,7 +1438,7 @@ struct mProjectPPReturn *mProjectPP(char *input_file, int hduin, char *ofile, ch
       fflush(stdout);
    }
 
-   if(fits_close_file(input.fptr, &status))
+   if(montage_closeInput(input.fptr, input.image, &status))
    {
       mProjectPP_printFitsError(status);
       strcpy(returnStruct->msg, montage_msgstr);
@@ -1404,17 +1537,20 @@ struct mProjectPPReturn *mProjectPP(char *input_file, int hduin, char *ofile, ch
    /* Create the output FITS files */
    /********************************/
 
-   remove(output_file);               
-   remove(area_file);               
+   if(!inMemory)
+   {
+      remove(output_file);               
+      remove(area_file);               
+   }
 
-   if(fits_create_file(&output.fptr, output_file, &status)) 
+   if(fits_create_file(&output.fptr, inMemory ? "mem://" : montage_outName(output_file), &status)) 
    {
       mProjectPP_printFitsError(status);           
       strcpy(returnStruct->msg, montage_msgstr);
       return returnStruct;
    }
 
-   if(fits_create_file(&output_area.fptr, area_file, &status)) 
+   if(fits_create_file(&output_area.fptr, inMemory ? "mem://" : montage_outName(area_file), &status)) 
    {
       mProjectPP_printFitsError(status);           
       strcpy(returnStruct->msg, montage_msgstr);
@@ -1424,9 +1560,12 @@ struct mProjectPPReturn *mProjectPP(char *input_file, int hduin, char *ofile, ch
 
    /*********************************************************/
    /* Create the FITS image.  All the required keywords are */
-   /* handled automatically.                                */
+   /* handled automatically.  The output is double unless   */
+   /* single precision (BITPIX -32) has been requested.     */
    /*********************************************************/
 
+   bitpix = montage_outBitpix();
+
    if (fits_create_img(output.fptr, bitpix, naxis, output.naxes, &status))
    {
       mProjectPP_printFitsError(status);          
@@ -1458,7 +1597,7 @@ struct mProjectPPReturn *mProjectPP(char *input_file, int hduin, char *ofile, ch
    /* Set FITS header from a template file */
    /****************************************/
 
-   if(fits_write_key_template(output.fptr, template_file, &status))
+   if(montage_writeTemplate(output.fptr, template_file, templateHdr, &status))
    {
       mProjectPP_printFitsError(status);           
       strcpy(returnStruct->msg, montage_msgstr);
@@ -1471,7 +1610,7 @@ struct mProjectPPReturn *mProjectPP(char *input_file, int hduin, char *ofile, ch
       fflush(stdout);
    }
 
-   if(fits_write_key_template(output_area.fptr, template_file, &status))
+   if(montage_writeTemplate(output_area.fptr, template_file, templateHdr, &status))
    {
       mProjectPP_printFitsError(status);           
       strcpy(returnStruct->msg, montage_msgstr);
@@ -1485,11 +1624,11 @@ struct mProjectPPReturn *mProjectPP(char *input_file, int hduin, char *ofile, ch
    }
 
 
-   /***************************/
-   /* Modify BITPIX to be -64 */
-   /***************************/
+   /**********************************/
+   /* Modify BITPIX to be -64 or -32 */
+   /**********************************/
 
-   if(fits_update_key_lng(output.fptr, "BITPIX", -64,
+   if(fits_update_key_lng(output.fptr, "BITPIX", bitpix,
                                   (char *)NULL, &status))
    {
       mProjectPP_printFitsError(status);           
@@ -1497,7 +1636,7 @@ struct mProjectPPReturn *mProjectPP(char *input_file, int hduin, char *ofile, ch
       return returnStruct;
    }
 
-   if(fits_update_key_lng(output_area.fptr, "BITPIX", -64,
+   if(fits_update_key_lng(output_area.fptr, "BITPIX", bitpix,
                                   (char *)NULL, &status))
    {
       mProjectPP_printFitsError(status);           
@@ -1601,27 +1740,62 @@ struct mProjectPPReturn *mProjectPP(char *input_file, int hduin, char *ofile, ch
    }
 
 
+   /************************************************/
+   /* If the output is to be tile-compressed, the  */
+   /* headers so far are in memory; now create the */
+   /* real files.                                  */
+   /************************************************/
+
+   if(inMemory)
+   {
+      montage_memOutput(output.fptr,      &output.image,      &status);
+      montage_memOutput(output_area.fptr, &output_area.image, &status);
+   }
+   else
+   {
+      montage_compressImage(&output.fptr,      output_file, &status);
+      montage_compressArea (&output_area.fptr, area_file,   &status);
+   }
+
+   if(status)
+   {
+      mProjectPP_printFitsError(status);
+      strcpy(returnStruct->msg, montage_msgstr);
+      return returnStruct;
+   }
+
+
    /************************/
    /* Write the image data */
    /************************/
 
+   montage_phaseBegin("write");
+
    fpixel[0] = 1;
    fpixel[1] = 1;
    nelements = imax - imin + 1;
 
    for(j=jmin; j<=jmax; ++j)
    {
-      if (fits_write_pix(output.fptr, TDOUBLE, fpixel, nelements, 
-                         (void *)(&data[j-jstart][imin-istart]), &status))
+      if (montage_putPix(output.fptr, output.image, TDOUBLE, fpixel, nelements, 
+                           (void *)(&data[j-jstart][imin-istart]), &status))
       {
          mProjectPP_printFitsError(status);
          strcpy(returnStruct->msg, montage_msgstr);
          return returnStruct;
       }
 
+      montage_countWrite(output.fptr, nelements);
+
       ++fpixel[1];
    }
 
+   free(rowx);
+   free(rowy);
+   free(rowox);
+   free(rowoy);
+   free(rowstat);
+
    free(data[0]);
 
    if(debug >= 1)
@@ -1641,14 +1815,16 @@ struct mProjectPPReturn *mProjectPP(char *input_file, int hduin, char *ofile, ch
 
    for(j=jmin; j<=jmax; ++j)
    {
-      if (fits_write_pix(output_area.fptr, TDOUBLE, fpixel, nelements,
-                         (void *)(&area[j-jstart][imin-istart]), &status))
+      if (montage_putPix(output_area.fptr, output_area.image, TDOUBLE, fpixel, nelements,
+                           (void *)(&area[j-jstart][imin-istart]), &status))
       {
          mProjectPP_printFitsError(status);
          strcpy(returnStruct->msg, montage_msgstr);
          return returnStruct;
       }
 
+      montage_countWrite(output_area.fptr, nelements);
+
       ++fpixel[1];
    }
 
@@ -1665,7 +1841,7 @@ struct mProjectPPReturn *mProjectPP(char *input_file, int hduin, char *ofile, ch
    /* Close the FITS file */
    /***********************/
 
-   if(fits_close_file(output.fptr, &status))
+   if(montage_closeOutput(output.fptr, output.image, &status))
    {
       mProjectPP_printFitsError(status);           
       strcpy(returnStruct->msg, montage_msgstr);
@@ -1678,7 +1854,7 @@ struct mProjectPPReturn *mProjectPP(char *input_file, int hduin, char *ofile, ch
       fflush(stdout);
    }
 
-   if(fits_close_file(output_area.fptr, &status))
+   if(montage_closeOutput(output_area.fptr, output_area.image, &status))
    {
       mProjectPP_printFitsError(status);           
       strcpy(returnStruct->msg, montage_msgstr);
@@ -1691,12 +1867,14 @@ struct mProjectPPReturn *mProjectPP(char *input_file, int hduin, char *ofile, ch
       fflush(stdout);
    }
 
+   montage_phaseEnd("write");
+
    time(&currtime);
 
    returnStruct->status = 0;
 
-   sprintf(returnStruct->msg,  "time=%.1f",       (double)(currtime - start));
-   sprintf(returnStruct->json, "{\"time\":%.1f}", (double)(currtime - start));
+   sprintf(returnStruct->msg,  "time=%.1f",           (double)(currtime - start));
+   sprintf(returnStruct->json, "{\"time\":%.1f, %s}", (double)(currtime - start), montage_statsEnd());
 
    returnStruct->time = (double)(currtime - start);
 
@@ -1733,12 +1911,38 @@ int mProjectPP_readTemplate(char *filename, int headerType)
    }
 
 
+   /*****************************************************/
+   /* If we already have this output template (with the */
+   /* same expansion), the output structures are still  */
+   /* good.  Alternate input headers are always reread. */
+   /*****************************************************/
+
+   if(headerType != ALTERNATE_INPUT)
+   {
+      if(!inMemory && montage_templateSame(&templateCache, filename, headerType, offset))
+      {
+         if(debug >= 1)
+         {
+            printf("Using cached output template.\n");
+            fflush(stdout);
+         }
+
+         return 0;
+      }
+
+      montage_templateClear(&templateCache);
+   }
+
+
 
    /********************************************************/
    /* Open the template file, read and parse all the lines */
    /********************************************************/
 
-   fp = fopen(filename, "r");
+   if(templateHdr && headerType == NORMAL_TEMPLATE)
+      fp = montage_memText(templateHdr);
+   else
+      fp = fopen(filename, "r");
 
    if(fp == (FILE *)NULL)
    {
@@ -1771,6 +1975,8 @@ int mProjectPP_readTemplate(char *filename, int headerType)
       mProjectPP_stradd(headerStr, line);
    }
 
+   fclose(fp);
+
 
    /****************************************/
    /* Initialize the WCS transform library */
@@ -1786,6 +1992,9 @@ int mProjectPP_readTemplate(char *filename, int headerType)
 
       strcpy(alt_input_header, headerStr);
 
+      if(input.wcs)
+         wcsfree(input.wcs);
+
       input.wcs = wcsinit(headerStr);
 
       if(input.wcs == (struct WorldCoor *)NULL)
@@ -1883,6 +2092,9 @@ int mProjectPP_readTemplate(char *filename, int headerType)
       else
          strcpy(template_header, headerStr);
 
+      if(output.wcs)
+         wcsfree(output.wcs);
+
       output.wcs = wcsinit(headerStr);
 
       if(output.wcs == (struct WorldCoor *)NULL)
@@ -1962,6 +2174,9 @@ int mProjectPP_readTemplate(char *filename, int headerType)
          else
             printf("Output pixels are counterclockwise.\n");
       }
+
+      if(!inMemory)
+         montage_templateKeep(&templateCache, filename, headerType, offset);
    }
 
    return 0;
@@ -2087,7 +2302,12 @@ int mProjectPP_readFits(char *filename, char *weightfile)
    /* for WCS setup                         */
    /*****************************************/
 
-   if(fits_open_file(&input.fptr, filename, READONLY, &status))
+   if(input.image)
+      montage_memOpen(&input.fptr, input.image, &status);
+   else
+      fits_open_file(&input.fptr, filename, READONLY, &status);
+
+   if(status)
    {
       sprintf(errstr, "Image file %s missing or invalid FITS", filename);
       mProjectPP_printError(errstr);
@@ -2103,6 +2323,12 @@ int mProjectPP_readFits(char *filename, char *weightfile)
       }
    }
 
+   if(input_header)
+   {
+      free(input_header);
+      input_header = (char *)NULL;
+   }
+
    if(fits_get_image_wcs_keys(input.fptr, &input_header, &status))
    {
       mProjectPP_printFitsError(status);
@@ -2144,6 +2370,9 @@ int mProjectPP_readFits(char *filename, char *weightfile)
       fflush(stdout);
    }
 
+   if(input.wcs)
+      wcsfree(input.wcs);
+
    input.wcs = wcsinit(input_header);
 
    if(input.wcs == (struct WorldCoor *)NULL)
@@ -2263,6 +2492,30 @@ void mProjectPP_printFitsError(int status)
 
 
 
+/****************************************************/
+/*                                                  */
+/*  Project the row of input corners in rowx/rowy   */
+/*  into output pixel space with one batched        */
+/*  two-plane call and store them in 'pos'.         */
+/*                                                  */
+/****************************************************/
+
+static void mProjectPP_projectRow(int n, struct Ipos *pos)
+{
+   int i;
+
+   plane1_to_plane2_transform_row(n, rowx, rowy, rowox, rowoy, rowstat, &two_plane);
+
+   for(i=0; i<n; ++i)
+   {
+      (pos+i)->oxpix  = rowox[i];
+      (pos+i)->oypix  = rowoy[i];
+      (pos+i)->offscl = rowstat[i];
+   }
+}
+
+
+
 /******************************/
 /*                            */
 /*  Print out general errors  */
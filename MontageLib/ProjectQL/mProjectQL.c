@@ -61,7 +61,7 @@ int main(int argc, char **argv)
 
    montage_status = stdout;
 
-   while ((c = getopt(argc, argv, "ad:Ls:h:w:W:t:x:Xf")) != EOF) 
+   while ((c = getopt(argc, argv, "ad:Ls:h:w:W:t:x:XfC:n:")) != EOF) 
    {
       switch (c) 
       {
@@ -135,6 +135,22 @@ int main(int argc, char **argv)
             fullRegion = 1;
             break;
 
+         case 'C':
+            if(montage_setCompress(optarg))
+            {
+               printf("[struct stat=\"ERROR\", msg=\"Invalid compression (%s); use rice, gzip or none, optionally followed by :qlevel\"]\n", optarg);
+               exit(1);
+            }
+            break;
+
+         case 'n':
+            if(montage_setThreads(strtol(optarg, &end, 10)) || end < optarg + strlen(optarg))
+            {
+               printf("[struct stat=\"ERROR\", msg=\"Thread count (%s) must be a non-negative integer\"]\n", optarg);
+               exit(1);
+            }
+            break;
+
          case 's':
             if((montage_status = fopen(optarg, "w+")) == (FILE *)NULL)
             {
@@ -156,7 +172,7 @@ int main(int argc, char **argv)
             break;
 
          default:
-            printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-d level][-s statusfile][-h hdu][-x scale][-w weightfile][-W fixed-weight][-t threshold][-X(expand)][-b border-string][-f(ull-region)] in.fits out.fits hdr.template\"]\n", argv[0]);
+            printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-d level][-s statusfile][-h hdu][-x scale][-w weightfile][-W fixed-weight][-t threshold][-X(expand)][-b border-string][-f(ull-region)][-C rice|gzip[:qlevel]][-n nthread] in.fits out.fits hdr.template\"]\n", argv[0]);
             exit(1);
             break;
       }
@@ -164,7 +180,7 @@ int main(int argc, char **argv)
 
    if (argc - optind < 3) 
    {
-      printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-d level][-s statusfile][-h hdu][-x scale][-w weightfile][-W fixed-weight][-t threshold][-X(expand)][-b border-string][-f(ull-region)] in.fits out.fits hdr.template\"]\n", argv[0]);
+      printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-d level][-s statusfile][-h hdu][-x scale][-w weightfile][-W fixed-weight][-t threshold][-X(expand)][-b border-string][-f(ull-region)][-C rice|gzip[:qlevel]][-n nthread] in.fits out.fits hdr.template\"]\n", argv[0]);
       exit(1);
    }
 
@@ -23,6 +23,8 @@ int  mProjectQL_readTemplate  (char *filename);
 int  mProjectQL_BorderSetup   (char *strin);
 int  mProjectQL_BorderRange   (int jrow, int maxpix, int *imin, int *imax);
 
+void *mProjectQL_rows         (void *ptr);
+
 void mProjectQL_printFitsError(int);
 void mProjectQL_printError    (char *);
 
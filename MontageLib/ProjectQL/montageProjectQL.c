@@ -17,6 +17,7 @@ Version  Developer        Date     Change
 #include <math.h>
 #include <sys/types.h>
 #include <time.h>
+#include <pthread.h>
 
 #include <fitsio.h>
 #include <wcs.h>
@@ -35,6 +36,9 @@ Version  Developer        Date     Change
 #define FIXEDBORDER 0
 #define POLYBORDER  1
 
+#define QLROWS     64     /* Output rows computed/written at once */
+#define MAXTAPS    16     /* Room for the Lanczos taps in one axis */
+
 #define MIN(x,y) (x < y ? x : y)
 #define MAX(x,y) (x > y ? x : y)
 
@@ -69,6 +73,7 @@ static BorderPoint polygon[256];
 static struct
 {
    fitsfile         *fptr;
+   struct mImage    *image;
    long              naxes[2];
    struct WorldCoor *wcs;
    int               sys;
@@ -91,9 +96,49 @@ static double ycorrectionIn;
 
 static time_t currtime, start;
 
+static char  *inputHeader  = (char *)NULL;
+static char  *outputHeader = (char *)NULL;
+
+static int    inMemory;
+static char  *templateHdr;
+
+
+/* What each thread needs to fill its share of */
+/* a band of output rows                       */
+
+struct qlWork
+{
+   int       jbegin;       /* First output row (array index)       */
+   int       nrow;
+   int       start;        /* This thread does rows start,         */
+   int       stride;       /* start+stride, ...                    */
+
+   int       imin, imax;
+   int       interp;
+   int       noAreas;
+
+   struct WorldCoor *inwcs;   /* Private to the thread: the WCS    */
+   struct WorldCoor *outwcs;  /* library keeps state in these      */
+
+   double  **data;
+
+   double   *lanczos;      /* 1D Lanczos kernel samples            */
+   int       nfilter;
+   int       nsamp;
+   int       ia;
+
+   double   *buffer;       /* nrow rows of output (and area)       */
+   double   *area;
+   double    nan;
+};
+
 
 static char montage_msgstr[1024];
 
+static struct mProjectQLReturn *mProjectQL_run(char *input_file, int hduin, char *ofile, char *template_file, int interp,
+                                               char *weight_file, double fixedWeight, double threshold, char *borderstr,
+                                               double fluxScale, int expand, int fullRegion, int noAreas, int debugin);
+
 
 /*-***********************************************************************/
 /*                                                                       */
@@ -161,19 +206,93 @@ struct mProjectQLReturn *mProjectQL(char *input_file, int hduin, char *ofile, ch
                                     char *weight_file, double fixedWeight, double threshold, char *borderstr,
                                     double fluxScale, int expand, int fullRegion, int noAreas, int debugin)
 {
-   int       i, j;
-   int       imx, jmy;
-   int       imgi, imgj, keri, kerj;
-   int       ix, jy;
+   inMemory    = 0;
+   templateHdr = (char *)NULL;
+
+   input.image       = (struct mImage *)NULL;
+   output.image      = (struct mImage *)NULL;
+   output_area.image = (struct mImage *)NULL;
+
+   return mProjectQL_run(input_file, hduin, ofile, template_file, interp, weight_file, fixedWeight, threshold,
+                         borderstr, fluxScale, expand, fullRegion, noAreas, debugin);
+}
+
+
+
+/*-***********************************************************************/
+/*                                                                       */
+/*  mProjectQLMem                                                        */
+/*                                                                       */
+/*  The same, for an image in memory.  The input pixels are read in      */
+/*  place; the reprojected image is returned in memory, to be freed with */
+/*  montage_imageFree().  The template is a header string.  An area      */
+/*  image is made only if one is asked for.                              */
+/*                                                                       */
+/*   struct mImage  *input         Image to reproject                    */
+/*   char           *template_hdr  Output header template                */
+/*   struct mImage **output        Returned reprojected image            */
+/*   struct mImage **area          Returned area image (or NULL)         */
+/*                                                                       */
+/*   int    interp         Interpolation scheme for value lookup.        */
+/*   double fluxScale      Scale factor applied to all pixels            */
+/*   int    expand         Expand output image area to include all of    */
+/*                         the input pixels                              */
+/*   int    fullRegion     Do not "shrink-wrap" output area to non-blank */
+/*                         pixels                                        */
+/*   int    debug          Debugging output level                        */
+/*                                                                       */
+/*************************************************************************/
+
+struct mProjectQLReturn *mProjectQLMem(struct mImage *input_image, char *template_hdr,
+                                       struct mImage **outimage, struct mImage **outarea,
+                                       int interp, double fluxScale,
+                                       int expand, int fullRegion, int debugin)
+{
+   struct mProjectQLReturn *returnStruct;
+
+   inMemory    = 1;
+   templateHdr = template_hdr;
+
+   input.image       = input_image;
+   output.image      = (struct mImage *)NULL;
+   output_area.image = (struct mImage *)NULL;
+
+   returnStruct = mProjectQL_run("(memory)", 0, "(memory)", "(memory)", interp, "", 1., 0., "",
+                                 fluxScale, expand, fullRegion, outarea == (struct mImage **)NULL, debugin);
+
+   if(returnStruct->status)
+   {
+      montage_imageFree(output.image);
+      montage_imageFree(output_area.image);
+
+      output.image      = (struct mImage *)NULL;
+      output_area.image = (struct mImage *)NULL;
+   }
+
+   *outimage = output.image;
+
+   if(outarea)
+      *outarea = output_area.image;
+
+   return returnStruct;
+}
+
+
+
+/* The reprojection, for files or (inMemory) an image in memory */
+
+static struct mProjectQLReturn *mProjectQL_run(char *input_file, int hduin, char *ofile, char *template_file, int interp,
+                                               char *weight_file, double fixedWeight, double threshold, char *borderstr,
+                                               double fluxScale, int expand, int fullRegion, int noAreas, int debugin)
+{
+   int       i, j, k;
+   int       t, nthread, nthr, nrow;
    int       nullcnt;
    long      fpixel[4], nelements;
    double    lon, lat;
-   double    ixpix, iypix;
    double    oxpix, oypix;
-   double    oxpixTest, oypixTest;
    double    oxpixMin, oypixMin;
    double    oxpixMax, oypixMax;
-   double    xoff, yoff;
    int       imin, imax, jmin, jmax;
    int       istart, ilength;
    int       jstart, jlength;
@@ -196,10 +315,13 @@ struct mProjectQLReturn *mProjectQL(char *input_file, int hduin, char *ofile, ch
    double    pi, x, a;
    int       ia;
 
-   double  **lanczos;
+   double   *lanczos;
 
    int       nfilter, nsamp;
 
+   pthread_t     *threads;
+   struct qlWork *work;
+
    struct mProjectQLReturn *returnStruct;
 
    
@@ -245,9 +367,12 @@ struct mProjectQLReturn *mProjectQL(char *input_file, int hduin, char *ofile, ch
    strcpy(returnStruct->msg, "");
 
 
-   /*********************************/
-   /* Make the Lanczos filter array */
-   /*********************************/
+   /************************************************/
+   /* Make the Lanczos filter array.  The kernel   */
+   /* is separable, so only the 1D function is     */
+   /* tabulated; the weight of a 2D tap is the     */
+   /* product of its x and y values.               */
+   /************************************************/
 
    pi = atan(1.) * 4.;
 
@@ -259,24 +384,16 @@ struct mProjectQLReturn *mProjectQL(char *input_file, int hduin, char *ofile, ch
 
    nfilter = (int) (a * nsamp);
 
-   lanczos = (double **) malloc(nfilter * sizeof(double *));
-
-   for(i=0; i<nfilter; ++i)
-      lanczos[i] = (double *) malloc(nfilter * sizeof(double));
+   lanczos = (double *) malloc(nfilter * sizeof(double));
 
-   lanczos[0][0] = 1.;
+   lanczos[0] = 1.;
 
    for(j=1; j<nfilter; ++j)
    {
       x = a * (double) j / (double) nfilter;
 
-      lanczos[0][j] = sin(pi*x) / (pi*x) * sin(pi*x/a) / (pi*x/a);
+      lanczos[j] = sin(pi*x) / (pi*x) * sin(pi*x/a) / (pi*x/a);
    }
-   
-   
-   for(j=1; j<nfilter; ++j)
-      for(i=0; i<nfilter; ++i)
-         lanczos[j][i] = lanczos[0][j] * lanczos[0][i];
 
    
    /***************************************/
@@ -299,6 +416,9 @@ struct mProjectQLReturn *mProjectQL(char *input_file, int hduin, char *ofile, ch
    time(&currtime);
    start = currtime;
 
+   montage_statsStart("mProjectQL");
+   montage_phaseBegin("setup");
+
    border = strtol(borderstr, &end, 10);
 
    if(end < borderstr + strlen(borderstr))
@@ -323,20 +443,23 @@ struct mProjectQLReturn *mProjectQL(char *input_file, int hduin, char *ofile, ch
    if(strlen(weight_file) > 0)
       haveWeights = 1;
 
-   checkHdr = montage_checkHdr(input_file, 0, hdu);
-
-   if(checkHdr)
+   if(!inMemory)
    {
-      strcpy(returnStruct->msg, checkHdr);
-      return returnStruct;
-   }
+      checkHdr = montage_checkHdr(input_file, 0, hdu);
 
-   checkHdr = montage_checkHdr(template_file, 1, 0);
+      if(checkHdr)
+      {
+         strcpy(returnStruct->msg, checkHdr);
+         return returnStruct;
+      }
 
-   if(checkHdr)
-   {
-      strcpy(returnStruct->msg, checkHdr);
-      return returnStruct;
+      checkHdr = montage_checkHdr(template_file, 1, 0);
+
+      if(checkHdr)
+      {
+         strcpy(returnStruct->msg, checkHdr);
+         return returnStruct;
+      }
    }
 
    if(strlen(output_file) > 5 &&
@@ -466,16 +589,6 @@ struct mProjectQLReturn *mProjectQL(char *input_file, int hduin, char *ofile, ch
    }
 
 
-   /******************************************************************/
-   /* Create the data and area buffers for one line of output pixels */
-   /******************************************************************/
-
-   buffer = (double *)malloc(output.naxes[0] * sizeof(double));
-
-   if(!noAreas)
-      area = (double *)malloc(output.naxes[0] * sizeof(double));
-
-
    /************************************************/
    /* Go around the outside of the INPUT image,    */
    /* finding the range of output pixel locations  */
@@ -756,6 +869,9 @@ struct mProjectQLReturn *mProjectQL(char *input_file, int hduin, char *ofile, ch
 
    nelements = input.naxes[0];
 
+   montage_phaseEnd("setup");
+   montage_phaseBegin("read");
+
    for (j=0; j<input.naxes[1]; ++j)
    {
       if(debug == 2)
@@ -769,14 +885,16 @@ struct mProjectQLReturn *mProjectQL(char *input_file, int hduin, char *ofile, ch
          fflush(stdout);
       }
 
-      if(fits_read_pix(input.fptr, TDOUBLE, fpixel, nelements, &nan,
-                       data[j], &nullcnt, &status))
+      if(montage_readPix(input.fptr, input.image, TDOUBLE, fpixel, nelements, &nan,
+                         data[j], &nullcnt, &status))
       {
          mProjectQL_printFitsError(status);
          strcpy(returnStruct->msg, montage_msgstr);
          return returnStruct;
       }
 
+      montage_countRead(input.fptr, nelements);
+
       if(haveWeights)
       {
          if(fits_read_pix(weight.fptr, TDOUBLE, fpixel, nelements, &nan,
@@ -786,12 +904,17 @@ struct mProjectQLReturn *mProjectQL(char *input_file, int hduin, char *ofile, ch
             strcpy(returnStruct->msg, montage_msgstr);
             return returnStruct;
          }
+
+         montage_countRead(weight.fptr, nelements);
       }
 
       ++fpixel[1];
    }
 
-   if(fits_close_file(input.fptr, &status))
+   montage_phaseEnd("read");
+   montage_phaseBegin("setup");
+
+   if(montage_closeInput(input.fptr, input.image, &status))
    {
       mProjectQL_printFitsError(status);
       strcpy(returnStruct->msg, montage_msgstr);
@@ -813,11 +936,14 @@ struct mProjectQLReturn *mProjectQL(char *input_file, int hduin, char *ofile, ch
    /* Create the output FITS files */
    /********************************/
 
-   remove(output_file);               
+   if(!inMemory)
+   {
+      remove(output_file);               
 
-   remove(area_file);               
+      remove(area_file);               
+   }
 
-   if(fits_create_file(&output.fptr, output_file, &status)) 
+   if(fits_create_file(&output.fptr, inMemory ? "mem://" : montage_outName(output_file), &status)) 
    {
       mProjectQL_printFitsError(status);
       strcpy(returnStruct->msg, montage_msgstr);
@@ -826,7 +952,7 @@ struct mProjectQLReturn *mProjectQL(char *input_file, int hduin, char *ofile, ch
 
    if(!noAreas)
    {
-      if(fits_create_file(&output_area.fptr, area_file, &status)) 
+      if(fits_create_file(&output_area.fptr, inMemory ? "mem://" : montage_outName(area_file), &status)) 
       {
          mProjectQL_printFitsError(status);
          strcpy(returnStruct->msg, montage_msgstr);
@@ -874,7 +1000,7 @@ struct mProjectQLReturn *mProjectQL(char *input_file, int hduin, char *ofile, ch
    /* Set FITS header from a template file */
    /****************************************/
 
-   if(fits_write_key_template(output.fptr, template_file, &status))
+   if(montage_writeTemplate(output.fptr, template_file, templateHdr, &status))
    {
       mProjectQL_printFitsError(status);
       strcpy(returnStruct->msg, montage_msgstr);
@@ -889,7 +1015,7 @@ struct mProjectQLReturn *mProjectQL(char *input_file, int hduin, char *ofile, ch
 
    if(!noAreas)
    {
-      if(fits_write_key_template(output_area.fptr, template_file, &status))
+      if(montage_writeTemplate(output_area.fptr, template_file, templateHdr, &status))
       {
          mProjectQL_printFitsError(status);
          strcpy(returnStruct->msg, montage_msgstr);
@@ -1068,172 +1194,221 @@ struct mProjectQLReturn *mProjectQL(char *input_file, int hduin, char *ofile, ch
 
 
 
-   /* Now we loop over the output image, determining */
-   /* and writing out a row at a time.               */
+   /************************************************/
+   /* If the output is to be tile-compressed, the  */
+   /* headers so far are in memory; now create the */
+   /* real files.                                  */
+   /************************************************/
 
-   fpixel[0] = 1;
-   fpixel[1] = 1;
+   if(inMemory)
+   {
+      montage_memOutput(output.fptr, &output.image, &status);
 
-   nelements = imax - imin;
+      if(!noAreas)
+         montage_memOutput(output_area.fptr, &output_area.image, &status);
+   }
+   else
+   {
+      montage_compressImage(&output.fptr, output_file, &status);
+
+      if(!noAreas)
+         montage_compressArea(&output_area.fptr, area_file, &status);
+   }
 
-   for(j=jmin; j<jmax; ++j)
+   if(status)
    {
-      for(i=0; i<output.naxes[0]; ++i)
-      {
-         buffer[i] = nan;
+      mProjectQL_printFitsError(status);
+      strcpy(returnStruct->msg, montage_msgstr);
+      return returnStruct;
+   }
 
-         if(!noAreas)
-            area[i] = nan;
-      }
 
-      for(i=imin; i<imax; ++i)
-      {
-         oxpix = i+1.0;  // Since the first pixel in a FITS image (index 0)
-         oypix = j+1.0;  // is at coordinate 1 according to the WCS library
+   /************************************************/
+   /* Now we loop over the output image, a band of */
+   /* rows at a time.  The rows of each band are   */
+   /* shared out among the threads; they only read */
+   /* the input so no locking is needed.  Each     */
+   /* thread but the first gets its own copies of  */
+   /* the WCS structures.                          */
+   /************************************************/
 
-         pix2wcs(output.wcs, oxpix, oypix, &xpos, &ypos);
+   nelements = imax - imin;
 
+   buffer = (double *)malloc(QLROWS * nelements * sizeof(double));
 
-         // Convert it back to make sure we weren't off scale
+   area = (double *)NULL;
 
-         offscl = output.wcs->offscl;
+   if(!noAreas)
+      area = (double *)malloc(QLROWS * nelements * sizeof(double));
 
-         oxpixTest = 999.;
-         oypixTest = 999.;
+   if(buffer == (double *)NULL || (!noAreas && area == (double *)NULL))
+   {
+      sprintf(returnStruct->msg, "Not enough memory for output rows");
+      return returnStruct;
+   }
 
-         if(!offscl)
-            wcs2pix(output.wcs, xpos, ypos, &oxpixTest, &oypixTest, &offscl);
+   nthread = montage_outThreads();
 
+   threads = (pthread_t *)    malloc(nthread * sizeof(pthread_t));
+   work    = (struct qlWork *)malloc(nthread * sizeof(struct qlWork));
 
-         // The offscl parameter seems to be too sensitive in some
-         // cases, so we will replace it with the following.
+   work[0].inwcs  = input.wcs;
+   work[0].outwcs = output.wcs;
 
-         offscl = 0;
+   for(t=1; t<nthread; ++t)
+   {
+      work[t].inwcs  = wcsinit(inputHeader);
+      work[t].outwcs = wcsinit(outputHeader);
 
-         if(fabs(oxpixTest - oxpix) > 1.)
-            offscl = 1;
+      if(work[t].inwcs == (struct WorldCoor *)NULL
+      || work[t].outwcs == (struct WorldCoor *)NULL)
+      {
+         if(work[t].inwcs)  wcsfree(work[t].inwcs);
+         if(work[t].outwcs) wcsfree(work[t].outwcs);
 
-         if(fabs(oypixTest - oypix) > 1.)
-            offscl = 1;
+         nthread = t;
+         break;
+      }
+   }
 
-         if(offscl)
-            continue;
+   if(debug >= 1)
+   {
+      printf("Computing output rows with %d thread(s)\n", nthread);
+      fflush(stdout);
+   }
 
 
-         // Convert to the input coordinate system
+   /* The coordinate library initializes some tables */
+   /* on first use; do that before the threads start */
 
-         convertCoordinates(output.sys, output.epoch, xpos, ypos,
-                            input.sys, input.epoch, &lon, &lat, 0.0);
-         
+   convertCoordinates(output.sys, output.epoch, 0., 0.,
+                      input.sys, input.epoch, &lon, &lat, 0.0);
 
-         // Convert to input pixel space
+   fpixel[0] = 1;
+   fpixel[1] = 1;
 
-         offscl = 0;
+   montage_phaseEnd("setup");
 
-         wcs2pix(input.wcs, lon, lat, &ixpix, &iypix, &offscl);
+   for(j=jmin; j<jmax; j+=nrow)
+   {
+      nrow = QLROWS;
 
-         if(offscl)
-            continue;
+      if(j + nrow > jmax)
+         nrow = jmax - j;
 
-         ixpix = ixpix - 1.0;  // Similarly, the input pixel location is 
-         iypix = iypix - 1.0;  // one offset from the array index
+      if(debug >= 2)
+      {
+         printf("\rComputing output rows %5d-%5d  ", j, j+nrow-1);
+         fflush(stdout);
+      }
 
-         ix = (int)(ixpix+0.5);  // The extra 0.5 here is to make it round
-         jy = (int)(iypix+0.5);  // correctly to the nearest integer value
+      montage_phaseBegin("resample");
 
+      nthr = nthread;
 
-         // If using nearest neighbor
+      if(nthr > nrow)
+         nthr = nrow;
 
-         if(ix >= 0 && ix < input.naxes[0]
-         && jy >= 0 && jy < input.naxes[1])
+      for(t=0; t<nthr; ++t)
+      {
+         work[t].jbegin  = j;
+         work[t].nrow    = nrow;
+         work[t].start   = t;
+         work[t].stride  = nthr;
+         work[t].imin    = imin;
+         work[t].imax    = imax;
+         work[t].interp  = interp;
+         work[t].noAreas = noAreas;
+         work[t].data    = data;
+         work[t].lanczos = lanczos;
+         work[t].nfilter = nfilter;
+         work[t].nsamp   = nsamp;
+         work[t].ia      = ia;
+         work[t].buffer  = buffer;
+         work[t].area    = area;
+         work[t].nan     = nan;
+      }
+
+      for(t=1; t<nthr; ++t)
+      {
+         if(pthread_create(&threads[t], NULL, mProjectQL_rows, &work[t]))
          {
-            if(interp == NEAREST)
-            {
-               buffer[i-imin] = data[jy][ix];
+            mProjectQL_rows(&work[t]);
 
-               if(!noAreas)
-                  area[i-imin] = 1.;
-            }
+            work[t].nrow = -1;
+         }
+      }
 
-            else if(interp == LANCZOS)
-            {
-               if(mNaN(data[jy][ix]))
-                  buffer[i-imin] = data[jy][ix];
-               else
-               {
-                  xoff = ixpix - ix;
-                  yoff = iypix - jy;
+      mProjectQL_rows(&work[0]);
 
-                  buffer[i-imin] = 0.;
+      for(t=1; t<nthr; ++t)
+      {
+         if(work[t].nrow >= 0)
+            pthread_join(threads[t], NULL);
+      }
 
-                  for(imx=-ia; imx<=ia; ++imx)
-                  {
-                     imgi = ix + imx;
-                     keri = abs((imx+xoff)*nsamp);
+      montage_phaseEnd("resample");
 
-                     if(imgi < 0 || imgi > input.naxes[0]
-                     || keri < 0 || keri > nfilter)
-                        continue;
-                        
-                     for(jmy=-ia; jmy<=ia; ++jmy)
-                     {
-                        imgj = jy + jmy;
-                        kerj = abs((jmy+yoff)*nsamp);
-
-                        if(imgj < 0 || imgj >= input.naxes[1]
-                        || kerj < 0 || kerj >= nfilter)
-                           continue;
-                           
-                        /*
-                        if(i == (imin+imax)/2 && j == (jmin+jmax)/2)
-                        {
-                           printf("DEBUG> i = %d, j = %d (output image index)\n", i, j);
-                           printf("DEBUG> ixpix = %.3f, iypix = %.3f (input image location)\n", ixpix, iypix);
-                           printf("DEBUG> ix = %d, jy = %d (nearest input pixel)\n", ix, jy);
-                           printf("DEBUG> xoff = %.3f, yoff = %.3f (pixel space offset)\n", xoff, yoff);
-                           printf("DEBUG> imx = %d, jmy = %d (loop over filter offsets)\n", imx, jmy);
-                           printf("DEBUG> imgi = %d, imgj = %d (image pixel for filter sum)\n", imgi, imgj);
-                           printf("DEBUG> keri = %d, kerj = %d (Lanczos filter array index)\n", keri, kerj);
-                           printf("DEBUG> (data = %.3f) * (kernel = %.3f) (buffer update)\n", 
-                              data[imgj][imgi], lanczos[kerj][keri]);
-                           printf("\n");
-                           fflush(stdout);
-                        }
-                        */
-
-                        buffer[i-imin] += data[imgj][imgi] * lanczos[kerj][keri];
-                     }
-                  }
-               }
-            }
-         }
-      }
+      montage_countPixels((long long)nrow * nelements);
 
 
       /*********************************/
       /* Write the image and area data */
       /*********************************/
 
-      if (fits_write_pix(output.fptr, TDOUBLE, fpixel, nelements, 
-                         (void *)buffer, &status))
+      montage_phaseBegin("write");
+
+      if (montage_putPix(output.fptr, output.image, TDOUBLE, fpixel, nrow * nelements, 
+                           (void *)buffer, &status))
       {
          mProjectQL_printFitsError(status);
          strcpy(returnStruct->msg, montage_msgstr);
          return returnStruct;
       }
 
+      montage_countWrite(output.fptr, nrow * nelements);
+
       if(!noAreas)
-         if (fits_write_pix(output_area.fptr, TDOUBLE, fpixel, nelements,
-                            (void *)area, &status))
+      {
+         if (montage_putPix(output_area.fptr, output_area.image, TDOUBLE, fpixel, nrow * nelements,
+                              (void *)area, &status))
          {
             mProjectQL_printFitsError(status);
             strcpy(returnStruct->msg, montage_msgstr);
             return returnStruct;
          }
 
-      ++fpixel[1];
+         montage_countWrite(output_area.fptr, nrow * nelements);
+      }
+
+      montage_phaseEnd("write");
+
+      fpixel[1] += nrow;
+   }
+
+   if(debug >= 2)
+   {
+      printf("\n");
+      fflush(stdout);
    }
 
+   for(t=1; t<nthread; ++t)
+   {
+      wcsfree(work[t].inwcs);
+      wcsfree(work[t].outwcs);
+   }
+
+   free(threads);
+   free(work);
+   free(buffer);
+   free(area);
+   free(lanczos);
+
+   for(k=0; k<input.naxes[1]; ++k)
+      free(data[k]);
+
+   free(data);
+
    if(debug >= 1)
    {
       printf("Data written to FITS data (and area) images\n\n"); 
@@ -1253,7 +1428,9 @@ struct mProjectQLReturn *mProjectQL(char *input_file, int hduin, char *ofile, ch
    /* Close the FITS file */
    /***********************/
 
-   if(fits_close_file(output.fptr, &status))
+   montage_phaseBegin("write");
+
+   if(montage_closeOutput(output.fptr, output.image, &status))
    {
       mProjectQL_printFitsError(status);
       strcpy(returnStruct->msg, montage_msgstr);
@@ -1268,7 +1445,7 @@ struct mProjectQLReturn *mProjectQL(char *input_file, int hduin, char *ofile, ch
 
    if(!noAreas)
    {
-      if(fits_close_file(output_area.fptr, &status))
+      if(montage_closeOutput(output_area.fptr, output_area.image, &status))
       {
          mProjectQL_printFitsError(status);
          strcpy(returnStruct->msg, montage_msgstr);
@@ -1282,12 +1459,14 @@ struct mProjectQLReturn *mProjectQL(char *input_file, int hduin, char *ofile, ch
       }
    }
 
+   montage_phaseEnd("write");
+
    time(&currtime);
 
    returnStruct->status = 0;
 
-   sprintf(returnStruct->msg,  "time=%.1f",       (double)(currtime - start));
-   sprintf(returnStruct->json, "{\"time\":%.1f}", (double)(currtime - start));
+   sprintf(returnStruct->msg,  "time=%.1f",           (double)(currtime - start));
+   sprintf(returnStruct->json, "{\"time\":%.1f, %s}", (double)(currtime - start), montage_statsEnd());
 
    returnStruct->time = (double)(currtime - start);
 
@@ -1295,6 +1474,222 @@ struct mProjectQLReturn *mProjectQL(char *input_file, int hduin, char *ofile, ch
 }
 
 
+/***********************************************************/
+/*                                                         */
+/*  Compute this thread's rows of the current band.  Each  */
+/*  output pixel is taken back to the input; in LANCZOS    */
+/*  mode the x and y kernel weights are looked up once     */
+/*  per pixel and applied as two passes of dot products:   */
+/*  along each input row of the window, then down the      */
+/*  column of row sums.                                    */
+/*                                                         */
+/***********************************************************/
+
+void *mProjectQL_rows(void *ptr)
+{
+   int     i, j, k;
+   int     imx, jmy;
+   int     imgi, imgj, keri, kerj;
+   int     ilo, ihi, jlo, jhi;
+   int     ix, jy, ia, nsamp, nfilter;
+   int     offscl;
+   long    nelements;
+   double  oxpix, oypix;
+   double  oxpixTest, oypixTest;
+   double  ixpix, iypix;
+   double  xpos, ypos;
+   double  lon, lat;
+   double  xoff, yoff;
+   double  sum, rowsum;
+   double  wx[MAXTAPS], wy[MAXTAPS];
+   double *row;
+   double *buffer, *area;
+   double *lanczos;
+   double **data;
+
+   struct qlWork *work;
+
+   work = (struct qlWork *)ptr;
+
+   data      = work->data;
+   lanczos   = work->lanczos;
+   nfilter   = work->nfilter;
+   nsamp     = work->nsamp;
+   ia        = work->ia;
+   nelements = work->imax - work->imin;
+
+   for(k=work->start; k<work->nrow; k+=work->stride)
+   {
+      j = work->jbegin + k;
+
+      buffer = work->buffer + k * nelements;
+      area   = (double *)NULL;
+
+      if(!work->noAreas)
+         area = work->area + k * nelements;
+
+      for(i=0; i<nelements; ++i)
+      {
+         buffer[i] = work->nan;
+
+         if(!work->noAreas)
+            area[i] = work->nan;
+      }
+
+      for(i=work->imin; i<work->imax; ++i)
+      {
+         oxpix = i+1.0;  // Since the first pixel in a FITS image (index 0)
+         oypix = j+1.0;  // is at coordinate 1 according to the WCS library
+
+         pix2wcs(work->outwcs, oxpix, oypix, &xpos, &ypos);
+
+
+         // Convert it back to make sure we weren't off scale
+
+         offscl = work->outwcs->offscl;
+
+         oxpixTest = 999.;
+         oypixTest = 999.;
+
+         if(!offscl)
+            wcs2pix(work->outwcs, xpos, ypos, &oxpixTest, &oypixTest, &offscl);
+
+
+         // The offscl parameter seems to be too sensitive in some
+         // cases, so we will replace it with the following.
+
+         offscl = 0;
+
+         if(fabs(oxpixTest - oxpix) > 1.)
+            offscl = 1;
+
+         if(fabs(oypixTest - oypix) > 1.)
+            offscl = 1;
+
+         if(offscl)
+            continue;
+
+
+         // Convert to the input coordinate system
+
+         convertCoordinates(output.sys, output.epoch, xpos, ypos,
+                            input.sys, input.epoch, &lon, &lat, 0.0);
+         
+
+         // Convert to input pixel space
+
+         offscl = 0;
+
+         wcs2pix(work->inwcs, lon, lat, &ixpix, &iypix, &offscl);
+
+         if(offscl)
+            continue;
+
+         ixpix = ixpix - 1.0;  // Similarly, the input pixel location is 
+         iypix = iypix - 1.0;  // one offset from the array index
+
+         ix = (int)(ixpix+0.5);  // The extra 0.5 here is to make it round
+         jy = (int)(iypix+0.5);  // correctly to the nearest integer value
+
+
+         // If using nearest neighbor
+
+         if(ix >= 0 && ix < input.naxes[0]
+         && jy >= 0 && jy < input.naxes[1])
+         {
+            if(work->interp == NEAREST)
+            {
+               buffer[i-work->imin] = data[jy][ix];
+
+               if(!work->noAreas)
+                  area[i-work->imin] = 1.;
+            }
+
+            else if(work->interp == LANCZOS)
+            {
+               if(mNaN(data[jy][ix]))
+                  buffer[i-work->imin] = data[jy][ix];
+               else
+               {
+                  xoff = ixpix - ix;
+                  yoff = iypix - jy;
+
+
+                  // The 1D weights.  Taps off the image or past the
+                  // end of the kernel are left out; these can only
+                  // be at the ends, so the rest form a contiguous
+                  // range [ilo,ihi] x [jlo,jhi].
+
+                  ilo = ia+1;
+                  ihi = -ia-1;
+
+                  for(imx=-ia; imx<=ia; ++imx)
+                  {
+                     imgi = ix + imx;
+                     keri = abs((imx+xoff)*nsamp);
+
+                     if(imgi < 0 || imgi >= input.naxes[0]
+                     || keri < 0 || keri >= nfilter)
+                        continue;
+
+                     if(imx < ilo)
+                        ilo = imx;
+
+                     ihi = imx;
+
+                     wx[imx+ia] = lanczos[keri];
+                  }
+
+                  jlo = ia+1;
+                  jhi = -ia-1;
+
+                  for(jmy=-ia; jmy<=ia; ++jmy)
+                  {
+                     imgj = jy + jmy;
+                     kerj = abs((jmy+yoff)*nsamp);
+
+                     if(imgj < 0 || imgj >= input.naxes[1]
+                     || kerj < 0 || kerj >= nfilter)
+                        continue;
+
+                     if(jmy < jlo)
+                        jlo = jmy;
+
+                     jhi = jmy;
+
+                     wy[jmy+ia] = lanczos[kerj];
+                  }
+
+
+                  // Two passes: dot each input row of the window
+                  // with the x weights, then the row sums with the
+                  // y weights
+
+                  sum = 0.;
+
+                  for(jmy=jlo; jmy<=jhi; ++jmy)
+                  {
+                     row = data[jy+jmy] + ix;
+
+                     rowsum = 0.;
+
+                     for(imx=ilo; imx<=ihi; ++imx)
+                        rowsum += row[imx] * wx[imx+ia];
+
+                     sum += rowsum * wy[jmy+ia];
+                  }
+
+                  buffer[i-work->imin] = sum;
+               }
+            }
+         }
+      }
+   }
+
+   return NULL;
+}
+
+
 /**************************************************/
 /*  Projections like CAR sometimes add an extra   */
 /*  360 degrees worth of pixels to the return     */
@@ -1349,7 +1744,10 @@ int mProjectQL_readTemplate(char *filename)
    /* Open the template file, read and parse all the lines */
    /********************************************************/
 
-   fp = fopen(filename, "r");
+   if(templateHdr)
+      fp = montage_memText(templateHdr);
+   else
+      fp = fopen(filename, "r");
 
    if(fp == (FILE *)NULL)
    {
@@ -1400,6 +1798,15 @@ int mProjectQL_readTemplate(char *filename)
       return 1;
    }
 
+
+   /* Keep the header for the worker threads' WCS copies */
+
+   free(outputHeader);
+
+   outputHeader = (char *)malloc(strlen(header) + 1);
+
+   strcpy(outputHeader, header);
+
    output_area.wcs = output.wcs;
 
 
@@ -1628,7 +2035,12 @@ int mProjectQL_readFits(char *filename, char *weightfile)
    /* for WCS setup                         */
    /*****************************************/
 
-   if(fits_open_file(&input.fptr, filename, READONLY, &status))
+   if(input.image)
+      montage_memOpen(&input.fptr, input.image, &status);
+   else
+      fits_open_file(&input.fptr, filename, READONLY, &status);
+
+   if(status)
    {
       sprintf(errstr, "Image file %s missing or invalid FITS", filename);
       mProjectQL_printError(errstr);
@@ -1792,6 +2204,15 @@ int mProjectQL_readFits(char *filename, char *weightfile)
    input.sys   = sys;
    input.epoch = epoch;
 
+
+   /* Keep the header for the worker threads' WCS copies */
+
+   free(inputHeader);
+
+   inputHeader = (char *)malloc(strlen(header) + 1);
+
+   strcpy(inputHeader, header);
+
    free(header);
 
    return 0;
@@ -17,7 +17,7 @@ extern int getopt(int argc, char *const *argv, const char *options);
 
 int main(int argc, char **argv)
 {
-   int       c, debug, hdu, fixedSize;
+   int       c, debug, hdu, fixedSize, pyramid;
    double    shrinkFactor;
 
    char      input_file [MAXSTR];
@@ -36,13 +36,14 @@ int main(int argc, char **argv)
 
    debug     = 0;
    fixedSize = 0;
+   pyramid   = 0;
    hdu       = 0;
 
    opterr = 0;
 
    montage_status = stdout;
 
-   while ((c = getopt(argc, argv, "d:h:s:f")) != EOF) 
+   while ((c = getopt(argc, argv, "d:h:s:n:fpF")) != EOF) 
    {
       switch (c) 
       {
@@ -80,8 +81,24 @@ int main(int argc, char **argv)
             fixedSize = 1;
             break;
 
+         case 'F':
+            montage_setBitpix(-32);
+            break;
+
+         case 'p':
+            pyramid = 1;
+            break;
+
+         case 'n':
+            if(montage_setThreads(strtol(optarg, &end, 10)) || end < optarg + strlen(optarg))
+            {
+               printf("[struct stat=\"ERROR\", msg=\"Thread count (%s) must be a non-negative integer\"]\n", optarg);
+               exit(1);
+            }
+            break;
+
          default:
-            printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-f(ixed-size)] [-d level] [-h hdu] [-s statusfile] in.fits out.fits factor\"]\n", argv[0]);
+            printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-f(ixed-size)] [-d level] [-h hdu] [-s statusfile] [-F(loat-output)] [-p(yramid) [-n nthread]] in.fits out.fits factor\"]\n", argv[0]);
             exit(1);
             break;
       }
@@ -89,7 +106,7 @@ int main(int argc, char **argv)
 
    if (argc - optind < 3) 
    {
-      printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-f(ixed-size)] [-d level] [-h hdu] [-s statusfile] in.fits out.fits factor\"]\n", argv[0]);
+      printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-f(ixed-size)] [-d level] [-h hdu] [-s statusfile] [-F(loat-output)] [-p(yramid) [-n nthread]] in.fits out.fits factor\"]\n", argv[0]);
       exit(1);
    }
   
@@ -105,7 +122,28 @@ int main(int argc, char **argv)
       exit(1);
    }
 
-   returnStruct = mShrink(input_file, hdu, output_file, shrinkFactor, fixedSize, debug);
+   /* Pyramid mode: the factor is the largest of the */
+   /* power-of-two levels, written as out_2.fits ... */
+
+   if(pyramid)
+   {
+      if(fixedSize)
+      {
+         printf("[struct stat=\"ERROR\", msg=\"Fixed-size mode cannot be used with a pyramid\"]\n");
+         exit(1);
+      }
+
+      if(shrinkFactor != (int)shrinkFactor)
+      {
+         printf("[struct stat=\"ERROR\", msg=\"Pyramid shrink factor (%s) must be a power of two\"]\n",
+            argv[optind + 2]);
+         exit(1);
+      }
+
+      returnStruct = mShrinkPyramid(input_file, hdu, output_file, (int)shrinkFactor, debug);
+   }
+   else
+      returnStruct = mShrink(input_file, hdu, output_file, shrinkFactor, fixedSize, debug);
 
    if(returnStruct->status == 1)
    {
@@ -6,6 +6,9 @@
 /**************************************/
 
 int  mShrink_readFits      (char *fluxfile);
+int  mShrink_createOutput  (char *output_file, double xfactor, int debug);
+void *mShrink_levelRows    (void *ptr);
+int  mShrink_floatRows     ();
 void mShrink_printFitsError(int);
 void mShrink_printError    (char *);
 
@@ -38,6 +38,7 @@ Version  Developer        Date     Change
 #include <sys/types.h>
 #include <time.h>
 #include <math.h>
+#include <pthread.h>
 
 #include <fitsio.h>
 #include <wcs.h>
@@ -45,7 +46,8 @@ Version  Developer        Date     Change
 #include <mShrink.h>
 #include <montage.h>
 
-#define MAXSTR  256
+#define MAXSTR    256
+#define MAXLEVEL   20
 
 static int  haveCtype;
 static int  haveCrval;
@@ -68,9 +70,12 @@ static int  haveEquinox;
 static int  haveBunit;
 static int  haveBlank;
 
+static int  inMemory;
+
 static struct
 {
    fitsfile *fptr;
+   struct mImage *image;
    long      bitpix;
    long      naxes[2];
    char      ctype1[16];
@@ -99,11 +104,37 @@ input, output;
 
 static int hdu;
 
+
+/********************************************************/
+/* Work for one thread of mShrinkPyramid: a share of    */
+/* the rows of one level in the current band of input.  */
+/********************************************************/
+
+struct shrinkWork
+{
+   int       nrow;         /* Rows of this level in the band       */
+   int       start;        /* This thread does rows start,         */
+   int       stride;       /* start+stride, ...                    */
+
+   long      inwidth;      /* Row length of the level below        */
+   long      width;        /* Row length of this level             */
+
+   double   *insum;        /* Level below: flux sums and pixel     */
+   double   *incount;      /* counts (no counts for the input)     */
+   float    *inpix;        /* Single precision input (or NULL)     */
+
+   double   *sum;          /* This level                           */
+   double   *count;
+};
+
 static time_t currtime, start;
 
 
 static char montage_msgstr[1024];
 
+static struct mShrinkReturn *mShrink_run(char *input_file, int hduin, char *output_file,
+                                         double shrinkFactor, int fixedSize, int debug);
+
 
 /*-***********************************************************************/
 /*                                                                       */
@@ -131,6 +162,64 @@ static char montage_msgstr[1024];
 /*************************************************************************/
 
 struct mShrinkReturn *mShrink(char *input_file, int hduin, char *output_file, double shrinkFactor, int fixedSize, int debug)
+{
+   inMemory = 0;
+
+   input.image  = (struct mImage *)NULL;
+   output.image = (struct mImage *)NULL;
+
+   return mShrink_run(input_file, hduin, output_file, shrinkFactor, fixedSize, debug);
+}
+
+
+
+/*-***********************************************************************/
+/*                                                                       */
+/*  mShrinkMem                                                           */
+/*                                                                       */
+/*  The same, for an image in memory.  The input pixels are read in      */
+/*  place and the shrunken image is returned in memory, to be freed with */
+/*  montage_imageFree().                                                 */
+/*                                                                       */
+/*   struct mImage  *input   Input image                                 */
+/*   struct mImage **output  Returned shrunken image (NULL on error)     */
+/*                                                                       */
+/*   double shrinkFactor   Scale factor for spatial shrinking            */
+/*   int    fixedSize      Alternate mode: shrink to this many pixels    */
+/*   int    debug          Debugging output level                        */
+/*                                                                       */
+/*************************************************************************/
+
+struct mShrinkReturn *mShrinkMem(struct mImage *input_image, struct mImage **output_image,
+                                 double shrinkFactor, int fixedSize, int debug)
+{
+   struct mShrinkReturn *returnStruct;
+
+   inMemory = 1;
+
+   input.image  = input_image;
+   output.image = (struct mImage *)NULL;
+
+   returnStruct = mShrink_run("(memory)", 0, "(memory)", shrinkFactor, fixedSize, debug);
+
+   if(returnStruct->status)
+   {
+      montage_imageFree(output.image);
+
+      output.image = (struct mImage *)NULL;
+   }
+
+   *output_image = output.image;
+
+   return returnStruct;
+}
+
+
+
+/* The shrinking, for files or (inMemory) images in memory */
+
+static struct mShrinkReturn *mShrink_run(char *input_file, int hduin, char *output_file,
+                                         double shrinkFactor, int fixedSize, int debug)
 {
    int       i, j, ii, jj, status, bufrow,  split;
    int       ibuffer, jbuffer, ifactor, nbuf, nullcnt, k, l, imin, imax, jmin, jmax;
@@ -138,10 +227,13 @@ struct mShrinkReturn *mShrink(char *input_file, int hduin, char *output_file, do
    double    obegin, oend;
    double   *colfact, *rowfact;
    double   *buffer;
-   double    xfactor, flux, area;
+   double    xfactor, flux, area, val;
+
+   int       floatrows;
 
    double   *outdata;
    double  **indata;
+   float   **findata;
 
    struct mShrinkReturn *returnStruct;
 
@@ -310,402 +402,113 @@ struct mShrinkReturn *mShrink(char *input_file, int hduin, char *output_file, do
 
    /***********************************************/
    /* Compute all the parameters for the shrunken */
-   /* output file.                                */
+   /* output file, create it and write the header */
    /***********************************************/
 
-   output.naxes[0] = floor((double)input.naxes[0]/xfactor);
-   output.naxes[1] = floor((double)input.naxes[1]/xfactor);
-   
-   if(debug >= 1)
+   if(mShrink_createOutput(output_file, xfactor, debug))
    {
-      printf("output.naxes[0] = %ld\n",  output.naxes[0]);
-      printf("output.naxes[1] = %ld\n",  output.naxes[1]);
-      fflush(stdout);
+      strcpy(returnStruct->msg, montage_msgstr);
+      return returnStruct;
    }
 
-   strcpy(output.ctype1, input.ctype1);
-   strcpy(output.ctype2, input.ctype2);
-
-   output.crval1   = input.crval1;
-   output.crval2   = input.crval2;
-   output.crpix1   = (input.crpix1-0.5)/xfactor + 0.5;
-   output.crpix2   = (input.crpix2-0.5)/xfactor + 0.5;
-   output.cdelt1   = input.cdelt1*xfactor;
-   output.cdelt2   = input.cdelt2*xfactor;
-   output.crota2   = input.crota2;
-   output.cd11     = input.cd11*xfactor;
-   output.cd12     = input.cd12*xfactor;
-   output.cd21     = input.cd21*xfactor;
-   output.cd22     = input.cd22*xfactor;
-   output.pc11     = input.pc11;
-   output.pc12     = input.pc12;
-   output.pc21     = input.pc21;
-   output.pc22     = input.pc22;
-   output.epoch    = input.epoch;
-   output.equinox  = input.equinox;
 
-   strcpy(output.bunit, input.bunit);
+   /****************************************************/
+   /* The buffered input rows are the bulk of memory.  */
+   /* If the output is single precision anyway (asked  */
+   /* for, or inherited from a BITPIX -32 input) they  */
+   /* are kept as float; the sums stay double.         */
+   /****************************************************/
 
-   if(haveCnpix)
-   {
-      input.crpix1    = input.ppo3 / input.xpixelsz - input.cnpix1 + 0.5; 
-      input.crpix2    = input.ppo6 / input.ypixelsz - input.cnpix2 + 0.5; 
+   floatrows = mShrink_floatRows();
 
-      output.crpix1   = (input.crpix1-0.5)/xfactor + 0.5;
-      output.crpix2   = (input.crpix2-0.5)/xfactor + 0.5;
+   indata  = (double **)NULL;
+   findata = (float  **)NULL;
 
-      output.xpixelsz = input.xpixelsz * xfactor;
-      output.ypixelsz = input.ypixelsz * xfactor;
 
-      output.cnpix1   = input.ppo3 / output.xpixelsz - output.crpix1 + 0.5;
-      output.cnpix2   = input.ppo6 / output.ypixelsz - output.crpix2 + 0.5;
-   }
 
+   /***********************************************/ 
+   /* Allocate memory for a line of output pixels */ 
+   /***********************************************/ 
 
-   /********************************/
-   /* Create the output FITS files */
-   /********************************/
+   outdata = (double *)malloc(output.naxes[0] * sizeof(double));
 
-   status = 0;
 
-   remove(output_file);               
+   /*************************************************************************/ 
+   /* We could probably come up with logic that would work for both scale   */
+   /* factors of less than one and greater than one but the it would be too */
+   /* hard to follow.  Instead, we put in a big switch here to deal with    */
+   /* the two cases separately.                                             */
+   /*************************************************************************/ 
 
-   if(fits_create_file(&output.fptr, output_file, &status)) 
+   if(xfactor < 1.)
    {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
+      /************************************************/ 
+      /* Allocate memory for "ifactor" lines of input */ 
+      /************************************************/ 
 
+      nbuf = 2;
 
-   /******************************************************/
-   /* Create the FITS image.  Copy over the whole header */
-   /******************************************************/
+      if(floatrows)
+      {
+         findata = (float **)malloc(nbuf * sizeof(float *));
 
-   if(fits_copy_header(input.fptr, output.fptr, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
+         for(j=0; j<nbuf; ++j)
+            findata[j] = (float *)malloc((input.naxes[0]+1) * sizeof(float));
+      }
+      else
+      {
+         indata = (double **)malloc(nbuf * sizeof(double *));
 
-   if(debug >= 1)
-   {
-      printf("\nFITS header copied to output\n"); 
-      fflush(stdout);
-   }
+         for(j=0; j<nbuf; ++j)
+            indata[j] = (double *)malloc((input.naxes[0]+1) * sizeof(double));
+      }
 
 
-   /************************************/
-   /* Reset all the WCS header kewords */
-   /************************************/
+      /**********************************************************/
+      /* Create the output array by processing the input pixels */
+      /**********************************************************/
 
-   if(fits_update_key_lng(output.fptr, "NAXIS", 2,
-                                  (char *)NULL, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
+      ibuffer = 0;
 
-   if(fits_update_key_lng(output.fptr, "NAXIS1", output.naxes[0],
-                                  (char *)NULL, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
+      buffer  = (double *)malloc(input.naxes[0] * sizeof(double));
+      colfact = (double *)malloc(nbuf * sizeof(double));
+      rowfact = (double *)malloc(nbuf * sizeof(double));
 
-   if(fits_update_key_lng(output.fptr, "NAXIS2", output.naxes[1],
-                                  (char *)NULL, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
+      fpixel[0] = 1;
+      fpixel[1] = 1;
+      fpixel[2] = 1;
+      fpixel[3] = 1;
 
-   if(haveBunit && fits_update_key_str(output.fptr, "BUNIT", output.bunit,
-                                  (char *)NULL, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
+      fpixelo[0] = 1;
+      fpixelo[1] = 1;
 
-   if(haveBlank && fits_update_key_lng(output.fptr, "BLANK", output.blank,
-                                  (char *)NULL, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
+      nelements = input.naxes[0];
 
-   if(haveCtype && fits_update_key_str(output.fptr, "CTYPE1", output.ctype1,
-                                  (char *)NULL, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
+      status = 0;
 
-   if(haveCtype && fits_update_key_str(output.fptr, "CTYPE2", output.ctype2,
-                                  (char *)NULL, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
 
-   if(haveCrval && fits_update_key_dbl(output.fptr, "CRVAL1", output.crval1, -14,
-                                  (char *)NULL, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
+      /******************************/
+      /* Loop over the output lines */
+      /******************************/
 
-   if(haveCrval && fits_update_key_dbl(output.fptr, "CRVAL2", output.crval2, -14,
-                                  (char *)NULL, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
+      split = 0;
 
-   if(haveCrpix && fits_update_key_dbl(output.fptr, "CRPIX1", output.crpix1, -14,
-                                  (char *)NULL, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
+      for(l=0; l<output.naxes[1]; ++l)
+      {
+         obegin = (fpixelo[1] - 1.) * xfactor;
+         oend   =  fpixelo[1] * xfactor;
 
-   if(haveCrpix && fits_update_key_dbl(output.fptr, "CRPIX2", output.crpix2, -14,
-                                  (char *)NULL, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
+         if(floor(oend) == oend)
+            oend = obegin;
 
-   if(haveCnpix && fits_update_key_dbl(output.fptr, "CNPIX1", output.cnpix1, -14,
-                                  (char *)NULL, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
+         if(debug >= 2)
+         {
+            printf("OUTPUT row %d: obegin = %.2f -> oend = %.3f\n\n", l, obegin, oend);
+            fflush(stdout);
+         }
 
-   if(haveCnpix && fits_update_key_dbl(output.fptr, "CNPIX2", output.cnpix2, -14,
-                                  (char *)NULL, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
-
-   if(havePixelsz && fits_update_key_dbl(output.fptr, "XPIXELSZ", output.xpixelsz, -14,
-                                  (char *)NULL, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
-
-   if(havePixelsz && fits_update_key_dbl(output.fptr, "YPIXELSZ", output.ypixelsz, -14,
-                                  (char *)NULL, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
-
-   if(haveCdelt && fits_update_key_dbl(output.fptr, "CDELT1", output.cdelt1, -14,
-                                     (char *)NULL, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
-
-   if(haveCdelt && fits_update_key_dbl(output.fptr, "CDELT2", output.cdelt2, -14,
-                                  (char *)NULL, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
-
-   if(haveCrota2 && fits_update_key_dbl(output.fptr, "CROTA2", output.crota2, -14,
-                                  (char *)NULL, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
-
-   if(haveCD11 && fits_update_key_dbl(output.fptr, "CD1_1", output.cd11, -14,
-                                  (char *)NULL, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
-
-   if(haveCD12 && fits_update_key_dbl(output.fptr, "CD1_2", output.cd12, -14,
-                                  (char *)NULL, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
-
-   if(haveCD21 && fits_update_key_dbl(output.fptr, "CD2_1", output.cd21, -14,
-                                  (char *)NULL, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
-
-   if(haveCD22 && fits_update_key_dbl(output.fptr, "CD2_2", output.cd22, -14,
-                                  (char *)NULL, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
-
-   if(havePC11 && fits_update_key_dbl(output.fptr, "PC1_1", output.pc11, -14,
-                                  (char *)NULL, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
-
-   if(havePC12 && fits_update_key_dbl(output.fptr, "PC1_2", output.pc12, -14,
-                                  (char *)NULL, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
-
-   if(havePC21 && fits_update_key_dbl(output.fptr, "PC2_1", output.pc21, -14,
-                                  (char *)NULL, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
-
-   if(havePC22 && fits_update_key_dbl(output.fptr, "PC2_2", output.pc22, -14,
-                                  (char *)NULL, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
-
-   if(haveEpoch && fits_update_key_dbl(output.fptr, "EPOCH", output.epoch, -14,
-                                  (char *)NULL, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
-
-   if(haveEquinox && fits_update_key_dbl(output.fptr, "EQUINOX", output.equinox, -14,
-                                  (char *)NULL, &status))
-   {
-      mShrink_printFitsError(status);
-      strcpy(returnStruct->msg, montage_msgstr);
-      return returnStruct;
-   }
-
-
-   if(debug >= 1)
-   {
-      printf("Output header keywords set\n\n");
-      fflush(stdout);
-   }
-
-
-
-   /***********************************************/ 
-   /* Allocate memory for a line of output pixels */ 
-   /***********************************************/ 
-
-   outdata = (double *)malloc(output.naxes[0] * sizeof(double));
-
-
-   /*************************************************************************/ 
-   /* We could probably come up with logic that would work for both scale   */
-   /* factors of less than one and greater than one but the it would be too */
-   /* hard to follow.  Instead, we put in a big switch here to deal with    */
-   /* the two cases separately.                                             */
-   /*************************************************************************/ 
-
-   if(xfactor < 1.)
-   {
-      /************************************************/ 
-      /* Allocate memory for "ifactor" lines of input */ 
-      /************************************************/ 
-
-      nbuf = 2;
-
-      indata = (double **)malloc(nbuf * sizeof(double *));
-
-      for(j=0; j<nbuf; ++j)
-         indata[j] = (double *)malloc((input.naxes[0]+1) * sizeof(double));
-
-
-      /**********************************************************/
-      /* Create the output array by processing the input pixels */
-      /**********************************************************/
-
-      ibuffer = 0;
-
-      buffer  = (double *)malloc(input.naxes[0] * sizeof(double));
-      colfact = (double *)malloc(nbuf * sizeof(double));
-      rowfact = (double *)malloc(nbuf * sizeof(double));
-
-      fpixel[0] = 1;
-      fpixel[1] = 1;
-      fpixel[2] = 1;
-      fpixel[3] = 1;
-
-      fpixelo[0] = 1;
-      fpixelo[1] = 1;
-
-      nelements = input.naxes[0];
-
-      status = 0;
-
-
-      /******************************/
-      /* Loop over the output lines */
-      /******************************/
-
-      split = 0;
-
-      for(l=0; l<output.naxes[1]; ++l)
-      {
-         obegin = (fpixelo[1] - 1.) * xfactor;
-         oend   =  fpixelo[1] * xfactor;
-
-         if(floor(oend) == oend)
-            oend = obegin;
-
-         if(debug >= 2)
-         {
-            printf("OUTPUT row %d: obegin = %.2f -> oend = %.3f\n\n", l, obegin, oend);
-            fflush(stdout);
-         }
-
-         rowfact[0] = 1.;
-         rowfact[1] = 0.;
+         rowfact[0] = 1.;
+         rowfact[1] = 0.;
 
 
          /******************************************/
@@ -750,8 +553,8 @@ struct mShrinkReturn *mShrink(char *input_file, int hduin, char *output_file, do
 
             if(fpixel[1] <= input.naxes[1])
             {
-               if(fits_read_pix(input.fptr, TDOUBLE, fpixel, nelements, &nan,
-                                buffer, &nullcnt, &status))
+               if(montage_readPix(input.fptr, input.image, TDOUBLE, fpixel, nelements, &nan,
+                                  buffer, &nullcnt, &status))
                {
                   mShrink_printFitsError(status);
                   strcpy(returnStruct->msg, montage_msgstr);
@@ -766,16 +569,22 @@ struct mShrinkReturn *mShrink(char *input_file, int hduin, char *output_file, do
             /* For each input pixel */
             /************************/
 
-            indata[jbuffer][input.naxes[0]] = nan;
+            if(floatrows)
+               findata[jbuffer][input.naxes[0]] = nan;
+            else
+               indata [jbuffer][input.naxes[0]] = nan;
 
             for (i=0; i<input.naxes[0]; ++i)
             {
-               indata[jbuffer][i] = buffer[i];
+               if(floatrows)
+                  findata[jbuffer][i] = buffer[i];
+               else
+                  indata [jbuffer][i] = buffer[i];
 
                if(debug >= 4)
                {
                   printf("input: line %5ld / pixel %5d: indata[%d][%d] = %10.3e\n",
-                     fpixel[1]-2, i, jbuffer, i, indata[jbuffer][i]);
+                     fpixel[1]-2, i, jbuffer, i, buffer[i]);
                   fflush(stdout);
                }
             }
@@ -832,16 +641,21 @@ struct mShrinkReturn *mShrink(char *input_file, int hduin, char *output_file, do
                {
                   bufrow = (ibuffer + jj) % nbuf;
 
-                  if(!mNaN(indata[bufrow][imin+ii]) && (colfact[ii] > 0.))
+                  if(floatrows)
+                     val = findata[bufrow][imin+ii];
+                  else
+                     val = indata [bufrow][imin+ii];
+
+                  if(!mNaN(val) && (colfact[ii] > 0.))
                   {
-                     flux += indata[bufrow][imin+ii] * colfact[ii] * rowfact[jj];
+                     flux += val * colfact[ii] * rowfact[jj];
                      area += colfact[ii] * rowfact[jj];
 
                      if(debug >= 3)
                      {
                         printf("output[%d][%d] -> %10.2e (area: %10.2e) (using indata[%d][%d] = %10.2e, colfact[%d] = %5.3f, rowfact[%d] = %5.3f)\n", 
                            l, k, flux, area,
-                           bufrow, imin+ii, indata[bufrow][imin+ii], 
+                           bufrow, imin+ii, val, 
                            imin+ii, colfact[ii],
                            jj, rowfact[jj]);
 
@@ -874,7 +688,7 @@ struct mShrinkReturn *mShrink(char *input_file, int hduin, char *output_file, do
                fflush(stdout);
             }
 
-            if (fits_write_pix(output.fptr, TDOUBLE, fpixelo, nelementso, 
+            if (montage_putPix(output.fptr, output.image, TDOUBLE, fpixelo, nelementso, 
                                (void *)(outdata), &status))
             {
                mShrink_printFitsError(status);
@@ -907,8 +721,8 @@ struct mShrinkReturn *mShrink(char *input_file, int hduin, char *output_file, do
                fflush(stdout);
             }
 
-            if(fits_read_pix(input.fptr, TDOUBLE, fpixel, nelements, &nan,
-                             buffer, &nullcnt, &status))
+            if(montage_readPix(input.fptr, input.image, TDOUBLE, fpixel, nelements, &nan,
+                               buffer, &nullcnt, &status))
             {
                mShrink_printFitsError(status);
                strcpy(returnStruct->msg, montage_msgstr);
@@ -917,16 +731,22 @@ struct mShrinkReturn *mShrink(char *input_file, int hduin, char *output_file, do
             
             ++fpixel[1];
 
-            indata[jbuffer][input.naxes[0]] = nan;
+            if(floatrows)
+               findata[jbuffer][input.naxes[0]] = nan;
+            else
+               indata [jbuffer][input.naxes[0]] = nan;
 
             for (i=0; i<input.naxes[0]; ++i)
             {
-               indata[jbuffer][i] = buffer[i];
+               if(floatrows)
+                  findata[jbuffer][i] = buffer[i];
+               else
+                  indata [jbuffer][i] = buffer[i];
 
                if(debug >= 4)
                {
                   printf("input: line %5ld / pixel %5d: indata[%d][%d] = %10.3e\n",
-                     fpixel[1]-2, i, jbuffer, i, indata[jbuffer][i]);
+                     fpixel[1]-2, i, jbuffer, i, buffer[i]);
                   fflush(stdout);
                }
             }
@@ -947,10 +767,20 @@ struct mShrinkReturn *mShrink(char *input_file, int hduin, char *output_file, do
 
       nbuf = ifactor + 1;
 
-      indata = (double **)malloc(nbuf * sizeof(double *));
+      if(floatrows)
+      {
+         findata = (float **)malloc(nbuf * sizeof(float *));
+
+         for(j=0; j<nbuf; ++j)
+            findata[j] = (float *)malloc(input.naxes[0] * sizeof(float));
+      }
+      else
+      {
+         indata = (double **)malloc(nbuf * sizeof(double *));
 
-      for(j=0; j<nbuf; ++j)
-         indata[j] = (double *)malloc(input.naxes[0] * sizeof(double));
+         for(j=0; j<nbuf; ++j)
+            indata[j] = (double *)malloc(input.naxes[0] * sizeof(double));
+      }
 
 
 
@@ -1020,8 +850,8 @@ struct mShrinkReturn *mShrink(char *input_file, int hduin, char *output_file, do
          /* Read a line from the input file */
          /***********************************/
 
-         if(fits_read_pix(input.fptr, TDOUBLE, fpixel, nelements, &nan,
-                          buffer, &nullcnt, &status))
+         if(montage_readPix(input.fptr, input.image, TDOUBLE, fpixel, nelements, &nan,
+                            buffer, &nullcnt, &status))
          {
             mShrink_printFitsError(status);
             strcpy(returnStruct->msg, montage_msgstr);
@@ -1036,12 +866,15 @@ struct mShrinkReturn *mShrink(char *input_file, int hduin, char *output_file, do
 
          for (i=0; i<input.naxes[0]; ++i)
          {
-            indata[ibuffer][i] = buffer[i];
+            if(floatrows)
+               findata[ibuffer][i] = buffer[i];
+            else
+               indata [ibuffer][i] = buffer[i];
 
             if(debug >= 4)
             {
                printf("input: line %5d / pixel %5d: indata[%d][%d] = %10.2e\n",
-                  j, i, ibuffer, i, indata[ibuffer][i]);
+                  j, i, ibuffer, i, buffer[i]);
                fflush(stdout);
             }
          }
@@ -1107,16 +940,21 @@ struct mShrinkReturn *mShrink(char *input_file, int hduin, char *output_file, do
                   {
                      bufrow = (ibuffer - jmax + jj + nbuf) % nbuf;
 
-                     if(!mNaN(indata[bufrow][ii]) && (colfact[ii-imin] > 0.))
+                     if(floatrows)
+                        val = findata[bufrow][ii];
+                     else
+                        val = indata [bufrow][ii];
+
+                     if(!mNaN(val) && (colfact[ii-imin] > 0.))
                      {
-                        flux += indata[bufrow][ii] * colfact[ii-imin] * rowfact[jj-jmin];
+                        flux += val * colfact[ii-imin] * rowfact[jj-jmin];
                         area += colfact[ii-imin] * rowfact[jj-jmin];
 
                         if(debug >= 3)
                         {
                            printf("output[%d][%d] -> %10.2e (area: %10.2e) (using indata[%d][%d] = %10.2e, colfact[%d-%d] = %5.3f, rowfact[%d-%d] = %5.3f)\n", 
                               l, k, flux, area,
-                              bufrow, ii, indata[bufrow][ii], 
+                              bufrow, ii, val, 
                               ii, imin, colfact[ii-imin],
                               jj, jmin, rowfact[jj-jmin]);
 
@@ -1154,7 +992,7 @@ struct mShrinkReturn *mShrink(char *input_file, int hduin, char *output_file, do
                   fflush(stdout);
                }
 
-               if (fits_write_pix(output.fptr, TDOUBLE, fpixelo, nelementso, 
+               if (montage_putPix(output.fptr, output.image, TDOUBLE, fpixelo, nelementso, 
                                   (void *)(outdata), &status))
                {
                   mShrink_printFitsError(status);
@@ -1201,14 +1039,14 @@ struct mShrinkReturn *mShrink(char *input_file, int hduin, char *output_file, do
    /* Close the files */
    /*******************/
 
-   if(fits_close_file(input.fptr, &status))
+   if(montage_closeInput(input.fptr, input.image, &status))
    {
       mShrink_printFitsError(status);
       strcpy(returnStruct->msg, montage_msgstr);
       return returnStruct;
    }
 
-   if(fits_close_file(output.fptr, &status))
+   if(montage_closeOutput(output.fptr, output.image, &status))
    {
       mShrink_printFitsError(status);
       strcpy(returnStruct->msg, montage_msgstr);
@@ -1235,47 +1073,919 @@ struct mShrinkReturn *mShrink(char *input_file, int hduin, char *output_file, do
 
 
 
-/**************************************/
-/*                                    */
-/*  Open a FITS file and extract the  */
-/*  pertinent header information.     */
-/*                                    */
-/**************************************/
+/*-***********************************************************************/
+/*                                                                       */
+/*  mShrinkPyramid                                                       */
+/*                                                                       */
+/*  Makes the 2x, 4x, ... shrunken versions of a FITS file in one pass   */
+/*  through the input.  The input is read in bands of rows as tall as    */
+/*  the largest factor; each level is built from the one before it by    */
+/*  2x2 summing (keeping the flux sum and the count of good pixels, so   */
+/*  every level is the plain average of its block of input pixels, just  */
+/*  as mShrink gives for an integer factor).  The rows of each level     */
+/*  are divided among worker threads.                                    */
+/*                                                                       */
+/*   char  *infile         Input FITS file                               */
+/*   int    hdu            Optional HDU offset for input file            */
+/*   char  *output_base    Output name; level files are <base>_2.fits,   */
+/*                         <base>_4.fits, ... (".fits" is stripped)      */
+/*                                                                       */
+/*   int    maxfactor      Largest shrink factor; a power of two         */
+/*                                                                       */
+/*   int    debug          Debugging output level                        */
+/*                                                                       */
+/*************************************************************************/
 
-int mShrink_readFits(char *fluxfile)
+struct mShrinkReturn *mShrinkPyramid(char *input_file, int hduin, char *output_base, int maxfactor, int debug)
 {
-   int      status;
-   long     naxis1, naxis2, bitpix;
-   char     ctype1[32], ctype2[32];
-   double   crval1, crval2;
-   double   crpix1, crpix2;
-   double   cnpix1, cnpix2;
-   double   xpixelsz, ypixelsz;
-   double   ppo3, ppo6;
-   double   cdelt1, cdelt2;
-   double   crota2;
-   double   cd11;
-   double   cd12;
-   double   cd21;
-   double   cd22;
-   double   pc11;
-   double   pc12;
-   double   pc21;
-   double   pc22;
-   double   epoch;
-   double   equinox;
-   long     blank;
+   int       i, k, t, status, nullcnt;
+   int       nlevel, factor, band, nread, nthread, nthr;
+   long      j0, fpixel[4], fpixelo[4];
+   long      width [MAXLEVEL+1];
+   long      height[MAXLEVEL+1];
 
-   char     bunit[80];
+   char      base[MAXSTR];
+   char      level_file[MAXSTR+32];
 
-   char    msg [1024];
+   fitsfile *fptr[MAXLEVEL+1];
 
-   status = 0;
+   int       floatrows;
 
-   haveCtype   = 1;
-   haveCrval   = 1;
-   haveCrpix   = 1;
-   haveCnpix   = 1;
+   double    val;
+   float     fnan;
+
+   double   *sum  [MAXLEVEL+1];
+   double   *count[MAXLEVEL+1];
+   double   *outbuf;
+   float    *inpix, *foutbuf;
+
+   pthread_t         *threads;
+   struct shrinkWork *work;
+
+   struct mShrinkReturn *returnStruct;
+
+
+   /************************************************/
+   /* Make a NaN value to use setting blank pixels */
+   /************************************************/
+
+   union
+   {
+      double d;
+      char   c[8];
+   }
+   value;
+
+   double nan;
+
+   for(i=0; i<8; ++i)
+      value.c[i] = 255;
+
+   nan = value.d;
+
+   fnan = nan;
+
+
+   /*******************************/
+   /* Initialize return structure */
+   /*******************************/
+
+   returnStruct = (struct mShrinkReturn *)malloc(sizeof(struct mShrinkReturn));
+
+   bzero((void *)returnStruct, sizeof(returnStruct));
+
+   returnStruct->status = 1;
+
+   strcpy(returnStruct->msg, "");
+
+   time(&currtime);
+   start = currtime;
+
+   hdu = hduin;
+
+
+   /***************************************/
+   /* The factors are 2, 4, ... maxfactor */
+   /***************************************/
+
+   nlevel = 0;
+
+   for(factor=1; factor<maxfactor && nlevel<MAXLEVEL; factor*=2)
+      ++nlevel;
+
+   if(maxfactor < 2 || factor != maxfactor)
+   {
+      mShrink_printError("Pyramid shrink factor must be a power of two (2, 4, 8, ...)");
+      strcpy(returnStruct->msg, montage_msgstr);
+      return returnStruct;
+   }
+
+   strcpy(base, output_base);
+
+   if(strlen(base) > 5 && strcmp(base+strlen(base)-5, ".fits") == 0)
+      base[strlen(base)-5] = '\0';
+
+   if(debug >= 1)
+   {
+      printf("input_file       = [%s]\n", input_file);
+      printf("output_base      = [%s]\n", base);
+      printf("maxfactor        = %d\n",   maxfactor);
+      printf("nlevel           = %d\n",   nlevel);
+      fflush(stdout);
+   }
+
+
+   /************************/
+   /* Read the input image */
+   /************************/
+
+   inMemory = 0;
+
+   input.image  = (struct mImage *)NULL;
+   output.image = (struct mImage *)NULL;
+
+   if(mShrink_readFits(input_file))
+   {
+      strcpy(returnStruct->msg, montage_msgstr);
+      return returnStruct;
+   }
+
+   if(maxfactor > input.naxes[0]
+   || maxfactor > input.naxes[1])
+   {
+      mShrink_printError("Trying to shrink image to smaller than one pixel");
+      strcpy(returnStruct->msg, montage_msgstr);
+      return returnStruct;
+   }
+
+
+   /****************************************/
+   /* Create the output files, one a level */
+   /****************************************/
+
+   width [0] = input.naxes[0];
+   height[0] = input.naxes[1];
+
+   for(k=1; k<=nlevel; ++k)
+   {
+      sprintf(level_file, "%s_%d.fits", base, 1<<k);
+
+      if(mShrink_createOutput(level_file, (double)(1<<k), debug))
+      {
+         strcpy(returnStruct->msg, montage_msgstr);
+         return returnStruct;
+      }
+
+      fptr  [k] = output.fptr;
+      width [k] = output.naxes[0];
+      height[k] = output.naxes[1];
+   }
+
+
+   /*****************************************************/
+   /* A band of input is as tall as the largest factor, */
+   /* so every level gets whole rows from each band.    */
+   /* Level 0 is the input itself (no counts).          */
+   /*****************************************************/
+
+   band = maxfactor;
+
+   floatrows = mShrink_floatRows();
+
+   sum  [0] = (double *)NULL;
+   count[0] = (double *)NULL;
+   inpix    = (float  *)NULL;
+
+   if(floatrows)
+      inpix  = (float  *)malloc((long)band * width[0] * sizeof(float));
+   else
+      sum[0] = (double *)malloc((long)band * width[0] * sizeof(double));
+
+   if(sum[0] == (double *)NULL && inpix == (float *)NULL)
+   {
+      mShrink_printError("Not enough memory for input rows");
+      strcpy(returnStruct->msg, montage_msgstr);
+      return returnStruct;
+   }
+
+   for(k=1; k<=nlevel; ++k)
+   {
+      sum  [k] = (double *)malloc((long)(band>>k) * width[k] * sizeof(double));
+      count[k] = (double *)malloc((long)(band>>k) * width[k] * sizeof(double));
+
+      if(sum[k] == (double *)NULL || count[k] == (double *)NULL)
+      {
+         mShrink_printError("Not enough memory for output rows");
+         strcpy(returnStruct->msg, montage_msgstr);
+         return returnStruct;
+      }
+   }
+
+   outbuf  = (double *)NULL;
+   foutbuf = (float  *)NULL;
+
+   if(floatrows)
+      foutbuf = (float  *)malloc((long)(band>>1) * width[1] * sizeof(float));
+   else
+      outbuf  = (double *)malloc((long)(band>>1) * width[1] * sizeof(double));
+
+   if(outbuf == (double *)NULL && foutbuf == (float *)NULL)
+   {
+      mShrink_printError("Not enough memory for output rows");
+      strcpy(returnStruct->msg, montage_msgstr);
+      return returnStruct;
+   }
+
+   nthread = montage_outThreads();
+
+   threads = (pthread_t *)        malloc(nthread * sizeof(pthread_t));
+   work    = (struct shrinkWork *)malloc(nthread * sizeof(struct shrinkWork));
+
+   if(debug >= 1)
+   {
+      printf("Building %d level(s) from %d-row bands with %d thread(s)\n", nlevel, band, nthread);
+      fflush(stdout);
+   }
+
+
+   /*****************************************/
+   /* Stream the input through the levels   */
+   /*****************************************/
+
+   fpixel[0] = 1;
+   fpixel[2] = 1;
+   fpixel[3] = 1;
+
+   fpixelo[0] = 1;
+
+   status = 0;
+
+   for(j0=0; j0<height[0]; j0+=band)
+   {
+      nread = band;
+
+      if(j0 + nread > height[0])
+         nread = height[0] - j0;
+
+      if(debug >= 2)
+      {
+         printf("Reading input image rows %5ld-%5ld\n", j0+1, j0+nread);
+         fflush(stdout);
+      }
+
+      fpixel[1] = j0 + 1;
+
+      if(floatrows)
+         fits_read_pix(input.fptr, TFLOAT,  fpixel, (long)nread * width[0], &fnan,
+                       inpix,  &nullcnt, &status);
+      else
+         fits_read_pix(input.fptr, TDOUBLE, fpixel, (long)nread * width[0], &nan,
+                       sum[0], &nullcnt, &status);
+
+      if(status)
+      {
+         mShrink_printFitsError(status);
+         strcpy(returnStruct->msg, montage_msgstr);
+         return returnStruct;
+      }
+
+      for(k=1; k<=nlevel; ++k)
+      {
+         /* Rows of this level that lie in the band */
+
+         work[0].nrow = nread >> k;
+
+         if(work[0].nrow == 0)
+            break;
+
+         nthr = nthread;
+
+         if(nthr > work[0].nrow)
+            nthr = work[0].nrow;
+
+         for(t=0; t<nthr; ++t)
+         {
+            work[t].nrow    = nread >> k;
+            work[t].start   = t;
+            work[t].stride  = nthr;
+            work[t].inwidth = width[k-1];
+            work[t].width   = width[k];
+            work[t].insum   = sum  [k-1];
+            work[t].incount = count[k-1];
+            work[t].inpix   = (k == 1 ? inpix : (float *)NULL);
+            work[t].sum     = sum  [k];
+            work[t].count   = count[k];
+         }
+
+         for(t=1; t<nthr; ++t)
+         {
+            if(pthread_create(&threads[t], NULL, mShrink_levelRows, &work[t]))
+            {
+               mShrink_levelRows(&work[t]);
+
+               work[t].nrow = -1;
+            }
+         }
+
+         mShrink_levelRows(&work[0]);
+
+         for(t=1; t<nthr; ++t)
+         {
+            if(work[t].nrow >= 0)
+               pthread_join(threads[t], NULL);
+         }
+
+
+         /*******************************************/
+         /* Average and write this level's new rows */
+         /*******************************************/
+
+         for(i=0; i<work[0].nrow * width[k]; ++i)
+         {
+            if(count[k][i] > 0.)
+               val = sum[k][i] / count[k][i];
+            else
+               val = nan;
+
+            if(floatrows)
+               foutbuf[i] = val;
+            else
+               outbuf [i] = val;
+         }
+
+         fpixelo[1] = (j0 >> k) + 1;
+
+         if(debug >= 2)
+         {
+            printf("WRITE %dx image rows %5ld-%5ld\n", 1<<k, fpixelo[1], fpixelo[1]+work[0].nrow-1);
+            fflush(stdout);
+         }
+
+         if(floatrows)
+            fits_write_pix(fptr[k], TFLOAT,  fpixelo, (long)work[0].nrow * width[k], 
+                           (void *)(foutbuf), &status);
+         else
+            fits_write_pix(fptr[k], TDOUBLE, fpixelo, (long)work[0].nrow * width[k], 
+                           (void *)(outbuf), &status);
+
+         if(status)
+         {
+            mShrink_printFitsError(status);
+            strcpy(returnStruct->msg, montage_msgstr);
+            return returnStruct;
+         }
+      }
+   }
+
+
+   /*******************/
+   /* Close the files */
+   /*******************/
+
+   if(fits_close_file(input.fptr, &status))
+   {
+      mShrink_printFitsError(status);
+      strcpy(returnStruct->msg, montage_msgstr);
+      return returnStruct;
+   }
+
+   for(k=1; k<=nlevel; ++k)
+   {
+      if(fits_close_file(fptr[k], &status))
+      {
+         mShrink_printFitsError(status);
+         strcpy(returnStruct->msg, montage_msgstr);
+         return returnStruct;
+      }
+   }
+
+   for(k=0; k<=nlevel; ++k)
+   {
+      free(sum  [k]);
+      free(count[k]);
+   }
+
+   free(inpix);
+   free(outbuf);
+   free(foutbuf);
+   free(threads);
+   free(work);
+
+   if(debug >= 1)
+   {
+      printf("FITS data images finalized\n"); 
+      fflush(stdout);
+   }
+
+   time(&currtime);
+
+   returnStruct->status = 0;
+
+   sprintf(returnStruct->msg,  "levels=%d, time=%.1f",          nlevel, (double)(currtime - start));
+   sprintf(returnStruct->json, "{\"levels\":%d, \"time\":%.1f}", nlevel, (double)(currtime - start));
+
+   returnStruct->time = (double)(currtime - start);
+
+   return returnStruct;
+}
+
+
+
+/***********************************************/
+/*                                             */
+/*  Whether the input pixels can be buffered   */
+/*  as float: the output is BITPIX -32, either */
+/*  because single precision was requested or  */
+/*  because the input is already -32 and the   */
+/*  output keeps its BITPIX.                   */
+/*                                             */
+/***********************************************/
+
+int mShrink_floatRows()
+{
+   if(montage_outBitpix() == -32)
+      return 1;
+
+   if(input.bitpix == FLOAT_IMG)
+      return 1;
+
+   return 0;
+}
+
+
+
+/***********************************************/
+/*                                             */
+/*  Thread body for mShrinkPyramid: this       */
+/*  thread's share of a level's rows in the    */
+/*  current band, each pixel the sum of a 2x2  */
+/*  block of the level below.                  */
+/*                                             */
+/***********************************************/
+
+void *mShrink_levelRows(void *ptr)
+{
+   int     i, ii, jj, j;
+   double  flux, area, val;
+   double *inrow, *incnt;
+   float  *finrow;
+
+   struct shrinkWork *work;
+
+   work = (struct shrinkWork *)ptr;
+
+   for(j=work->start; j<work->nrow; j+=work->stride)
+   {
+      for(i=0; i<work->width; ++i)
+      {
+         flux = 0.;
+         area = 0.;
+
+         for(jj=0; jj<2; ++jj)
+         {
+            if(work->inpix != (float *)NULL)
+            {
+               finrow = work->inpix + (2L*j + jj) * work->inwidth + 2*i;
+
+               for(ii=0; ii<2; ++ii)
+               {
+                  val = finrow[ii];
+
+                  if(!mNaN(val))
+                  {
+                     flux += val;
+                     area += 1.;
+                  }
+               }
+
+               continue;
+            }
+
+            inrow = work->insum + (2L*j + jj) * work->inwidth + 2*i;
+
+            if(work->incount == (double *)NULL)
+            {
+               for(ii=0; ii<2; ++ii)
+               {
+                  val = inrow[ii];
+
+                  if(!mNaN(val))
+                  {
+                     flux += val;
+                     area += 1.;
+                  }
+               }
+            }
+            else
+            {
+               incnt = work->incount + (2L*j + jj) * work->inwidth + 2*i;
+
+               for(ii=0; ii<2; ++ii)
+               {
+                  if(incnt[ii] > 0.)
+                  {
+                     flux += inrow[ii];
+                     area += incnt[ii];
+                  }
+               }
+            }
+         }
+
+         work->sum  [(long)j * work->width + i] = flux;
+         work->count[(long)j * work->width + i] = area;
+      }
+   }
+
+   return NULL;
+}
+
+
+/***********************************************/
+/*                                             */
+/*  Compute the parameters of the output image */
+/*  for a given shrink factor, create the file */
+/*  and write its header (a copy of the input  */
+/*  header with the WCS keywords updated).     */
+/*                                             */
+/***********************************************/
+
+int mShrink_createOutput(char *output_file, double xfactor, int debug)
+{
+   int status;
+
+   output.naxes[0] = floor((double)input.naxes[0]/xfactor);
+   output.naxes[1] = floor((double)input.naxes[1]/xfactor);
+   
+   if(debug >= 1)
+   {
+      printf("output.naxes[0] = %ld\n",  output.naxes[0]);
+      printf("output.naxes[1] = %ld\n",  output.naxes[1]);
+      fflush(stdout);
+   }
+
+   strcpy(output.ctype1, input.ctype1);
+   strcpy(output.ctype2, input.ctype2);
+
+   output.crval1   = input.crval1;
+   output.crval2   = input.crval2;
+   output.crpix1   = (input.crpix1-0.5)/xfactor + 0.5;
+   output.crpix2   = (input.crpix2-0.5)/xfactor + 0.5;
+   output.cdelt1   = input.cdelt1*xfactor;
+   output.cdelt2   = input.cdelt2*xfactor;
+   output.crota2   = input.crota2;
+   output.cd11     = input.cd11*xfactor;
+   output.cd12     = input.cd12*xfactor;
+   output.cd21     = input.cd21*xfactor;
+   output.cd22     = input.cd22*xfactor;
+   output.pc11     = input.pc11;
+   output.pc12     = input.pc12;
+   output.pc21     = input.pc21;
+   output.pc22     = input.pc22;
+   output.epoch    = input.epoch;
+   output.equinox  = input.equinox;
+
+   strcpy(output.bunit, input.bunit);
+
+   if(haveCnpix)
+   {
+      input.crpix1    = input.ppo3 / input.xpixelsz - input.cnpix1 + 0.5; 
+      input.crpix2    = input.ppo6 / input.ypixelsz - input.cnpix2 + 0.5; 
+
+      output.crpix1   = (input.crpix1-0.5)/xfactor + 0.5;
+      output.crpix2   = (input.crpix2-0.5)/xfactor + 0.5;
+
+      output.xpixelsz = input.xpixelsz * xfactor;
+      output.ypixelsz = input.ypixelsz * xfactor;
+
+      output.cnpix1   = input.ppo3 / output.xpixelsz - output.crpix1 + 0.5;
+      output.cnpix2   = input.ppo6 / output.ypixelsz - output.crpix2 + 0.5;
+   }
+
+
+   /********************************/
+   /* Create the output FITS files */
+   /********************************/
+
+   status = 0;
+
+   if(inMemory)
+      fits_create_file(&output.fptr, "mem://", &status);
+   else
+   {
+      remove(output_file);               
+
+      fits_create_file(&output.fptr, output_file, &status);
+   }
+
+   if(status)
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+
+   /******************************************************/
+   /* Create the FITS image.  Copy over the whole header */
+   /******************************************************/
+
+   if(fits_copy_header(input.fptr, output.fptr, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+   if(debug >= 1)
+   {
+      printf("\nFITS header copied to output\n"); 
+      fflush(stdout);
+   }
+
+
+   /************************************/
+   /* Reset all the WCS header kewords */
+   /************************************/
+
+   if(fits_update_key_lng(output.fptr, "NAXIS", 2,
+                                  (char *)NULL, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+   if(fits_update_key_lng(output.fptr, "NAXIS1", output.naxes[0],
+                                  (char *)NULL, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+   if(fits_update_key_lng(output.fptr, "NAXIS2", output.naxes[1],
+                                  (char *)NULL, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+   if(haveBunit && fits_update_key_str(output.fptr, "BUNIT", output.bunit,
+                                  (char *)NULL, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+   if(haveBlank && fits_update_key_lng(output.fptr, "BLANK", output.blank,
+                                  (char *)NULL, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+   if(haveCtype && fits_update_key_str(output.fptr, "CTYPE1", output.ctype1,
+                                  (char *)NULL, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+   if(haveCtype && fits_update_key_str(output.fptr, "CTYPE2", output.ctype2,
+                                  (char *)NULL, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+   if(haveCrval && fits_update_key_dbl(output.fptr, "CRVAL1", output.crval1, -14,
+                                  (char *)NULL, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+   if(haveCrval && fits_update_key_dbl(output.fptr, "CRVAL2", output.crval2, -14,
+                                  (char *)NULL, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+   if(haveCrpix && fits_update_key_dbl(output.fptr, "CRPIX1", output.crpix1, -14,
+                                  (char *)NULL, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+   if(haveCrpix && fits_update_key_dbl(output.fptr, "CRPIX2", output.crpix2, -14,
+                                  (char *)NULL, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+   if(haveCnpix && fits_update_key_dbl(output.fptr, "CNPIX1", output.cnpix1, -14,
+                                  (char *)NULL, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+   if(haveCnpix && fits_update_key_dbl(output.fptr, "CNPIX2", output.cnpix2, -14,
+                                  (char *)NULL, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+   if(havePixelsz && fits_update_key_dbl(output.fptr, "XPIXELSZ", output.xpixelsz, -14,
+                                  (char *)NULL, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+   if(havePixelsz && fits_update_key_dbl(output.fptr, "YPIXELSZ", output.ypixelsz, -14,
+                                  (char *)NULL, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+   if(haveCdelt && fits_update_key_dbl(output.fptr, "CDELT1", output.cdelt1, -14,
+                                     (char *)NULL, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+   if(haveCdelt && fits_update_key_dbl(output.fptr, "CDELT2", output.cdelt2, -14,
+                                  (char *)NULL, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+   if(haveCrota2 && fits_update_key_dbl(output.fptr, "CROTA2", output.crota2, -14,
+                                  (char *)NULL, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+   if(haveCD11 && fits_update_key_dbl(output.fptr, "CD1_1", output.cd11, -14,
+                                  (char *)NULL, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+   if(haveCD12 && fits_update_key_dbl(output.fptr, "CD1_2", output.cd12, -14,
+                                  (char *)NULL, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+   if(haveCD21 && fits_update_key_dbl(output.fptr, "CD2_1", output.cd21, -14,
+                                  (char *)NULL, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+   if(haveCD22 && fits_update_key_dbl(output.fptr, "CD2_2", output.cd22, -14,
+                                  (char *)NULL, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+   if(havePC11 && fits_update_key_dbl(output.fptr, "PC1_1", output.pc11, -14,
+                                  (char *)NULL, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+   if(havePC12 && fits_update_key_dbl(output.fptr, "PC1_2", output.pc12, -14,
+                                  (char *)NULL, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+   if(havePC21 && fits_update_key_dbl(output.fptr, "PC2_1", output.pc21, -14,
+                                  (char *)NULL, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+   if(havePC22 && fits_update_key_dbl(output.fptr, "PC2_2", output.pc22, -14,
+                                  (char *)NULL, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+   if(haveEpoch && fits_update_key_dbl(output.fptr, "EPOCH", output.epoch, -14,
+                                  (char *)NULL, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+   if(haveEquinox && fits_update_key_dbl(output.fptr, "EQUINOX", output.equinox, -14,
+                                  (char *)NULL, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+
+   /*****************************************************/
+   /* The output normally keeps the input BITPIX.  If   */
+   /* single precision output has been requested, we    */
+   /* switch to BITPIX -32 and drop any integer scaling */
+   /* and BLANK keywords, which no longer apply.        */
+   /*****************************************************/
+
+   if(montage_outBitpix() == -32)
+   {
+      if(fits_update_key_lng(output.fptr, "BITPIX", FLOAT_IMG,
+                                     (char *)NULL, &status))
+      {
+         mShrink_printFitsError(status);
+         return 1;
+      }
+
+      fits_delete_key(output.fptr, "BZERO",  &status);
+      status = 0;
+
+      fits_delete_key(output.fptr, "BSCALE", &status);
+      status = 0;
+
+      fits_delete_key(output.fptr, "BLANK",  &status);
+      status = 0;
+   }
+
+   if(inMemory && montage_memOutput(output.fptr, &output.image, &status))
+   {
+      mShrink_printFitsError(status);
+      return 1;
+   }
+
+
+   if(debug >= 1)
+   {
+      printf("Output header keywords set\n\n");
+      fflush(stdout);
+   }
+
+   return 0;
+}
+
+
+/**************************************/
+/*                                    */
+/*  Open a FITS file and extract the  */
+/*  pertinent header information.     */
+/*                                    */
+/**************************************/
+
+int mShrink_readFits(char *fluxfile)
+{
+   int      status;
+   long     naxis1, naxis2, bitpix;
+   char     ctype1[32], ctype2[32];
+   double   crval1, crval2;
+   double   crpix1, crpix2;
+   double   cnpix1, cnpix2;
+   double   xpixelsz, ypixelsz;
+   double   ppo3, ppo6;
+   double   cdelt1, cdelt2;
+   double   crota2;
+   double   cd11;
+   double   cd12;
+   double   cd21;
+   double   cd22;
+   double   pc11;
+   double   pc12;
+   double   pc21;
+   double   pc22;
+   double   epoch;
+   double   equinox;
+   long     blank;
+
+   char     bunit[80];
+
+   char    msg [1024];
+
+   status = 0;
+
+   haveCtype   = 1;
+   haveCrval   = 1;
+   haveCrpix   = 1;
+   haveCnpix   = 1;
    havePixelsz = 1;
    havePP      = 1;
    haveCdelt   = 1;
@@ -1310,7 +2020,12 @@ int mShrink_readFits(char *fluxfile)
 
    strcpy(input.bunit, "");
 
-   if(fits_open_file(&input.fptr, fluxfile, READONLY, &status))
+   if(inMemory)
+      montage_memOpen(&input.fptr, input.image, &status);
+   else
+      fits_open_file(&input.fptr, fluxfile, READONLY, &status);
+
+   if(status)
    {
       sprintf(msg, "Image file %s missing or invalid FITS", fluxfile);
       mShrink_printError(msg);
@@ -6,6 +6,13 @@
 #include <mSubimage.h>
 #include <montage.h>
 
+extern char *optarg;
+extern int optind, opterr;
+
+extern int getopt(int argc, char *const *argv, const char *options);
+
+int batchMain(int argc, char **argv);
+
 
 /**************************************************************************************/
 /*                                                                                    */
@@ -22,6 +29,11 @@
 /*  mode 2 (HDU):    All the pixels; essentially for picking out an HDU               */
 /*  mode 3 (SHRINK): All the pixels with blank edges trimmed off                      */
 /*                                                                                    */
+/*  There is also a batch mode, where many regions are cut from the same image        */
+/*  in a single pass (see batchMain() below):                                         */
+/*                                                                                    */
+/*  mSubimage -b [-p][-d][-h hdu][-n threads][-t outtbl] in.fit regions.tbl outdir    */
+/*                                                                                    */
 /*  HDU and SHRINK are special cases for convenience.  The 'nowcs' flag is a          */
 /*  special case, too, and only makes sense in PIX mode.                              */
 /*                                                                                    */
@@ -57,6 +69,12 @@ int main(int argc, char **argv)
    montage_status = stdout;
 
    strcpy(appname, argv[0]);
+
+   for(i=1; i<argc; ++i)
+   {
+      if(strcmp(argv[i], "-b") == 0)
+         exit(batchMain(argc, argv));
+   }
       
    if(argc < 4)
    {
@@ -273,3 +291,119 @@ int main(int argc, char **argv)
        exit(0);
    }
 }
+
+
+
+/**************************************************************************************/
+/*                                                                                    */
+/*  Batch mode.  There are no numeric arguments on the command line here (the         */
+/*  regions come from a table) so we can safely use getopt().                         */
+/*                                                                                    */
+/**************************************************************************************/
+
+int batchMain(int argc, char **argv)
+{
+   int       c, debug, pixmode, hdu, nthread;
+
+   char      infile [1024];
+   char      tblfile[1024];
+   char      outdir [1024];
+   char      outtbl [1024];
+
+   char     *end;
+
+   struct mSubimageBatchReturn *returnStruct;
+
+   FILE *montage_status;
+
+
+   debug   = 0;
+   pixmode = 0;
+   hdu     = 0;
+   nthread = 4;
+
+   strcpy(outtbl, "");
+
+   montage_status = stdout;
+
+   opterr = 0;
+
+   while ((c = getopt(argc, argv, "bpdh:n:t:s:")) != EOF)
+   {
+      switch (c)
+      {
+         case 'b':
+            break;
+
+         case 'p':
+            pixmode = 1;
+            break;
+
+         case 'd':
+            debug = 1;
+            break;
+
+         case 'h':
+            hdu = strtol(optarg, &end, 10);
+
+            if(end < optarg + strlen(optarg) || hdu < 0)
+            {
+               printf("[struct stat=\"ERROR\", msg=\"HDU value (%s) must be a non-negative integer\"]\n",
+                  optarg);
+               return 1;
+            }
+            break;
+
+         case 'n':
+            nthread = strtol(optarg, &end, 10);
+
+            if(end < optarg + strlen(optarg) || nthread < 1)
+            {
+               printf("[struct stat=\"ERROR\", msg=\"Thread count (%s) must be a positive integer\"]\n",
+                  optarg);
+               return 1;
+            }
+            break;
+
+         case 't':
+            strcpy(outtbl, optarg);
+            break;
+
+         case 's':
+            if((montage_status = fopen(optarg, "w+")) == (FILE *)NULL)
+            {
+               printf("[struct stat=\"ERROR\", msg=\"Cannot open status file: %s\"]\n",
+                  optarg);
+               return 1;
+            }
+            break;
+
+         default:
+            printf("[struct stat=\"ERROR\", msg=\"Usage: %s -b [-p][-d][-h hdu][-n threads][-t outtbl][-s statusfile] in.fit regions.tbl outdir\"]\n", argv[0]);
+            return 1;
+      }
+   }
+
+   if(argc - optind < 3)
+   {
+      printf("[struct stat=\"ERROR\", msg=\"Usage: %s -b [-p][-d][-h hdu][-n threads][-t outtbl][-s statusfile] in.fit regions.tbl outdir\"]\n", argv[0]);
+      return 1;
+   }
+
+   strcpy(infile,  argv[optind]);
+   strcpy(tblfile, argv[optind + 1]);
+   strcpy(outdir,  argv[optind + 2]);
+
+   returnStruct = mSubimageBatch(infile, hdu, tblfile, outdir, outtbl, pixmode, nthread, debug);
+
+   if(returnStruct->status == 1)
+   {
+       fprintf(montage_status, "[struct stat=\"ERROR\", msg=\"%s\"]\n", returnStruct->msg);
+       return 1;
+   }
+   else
+   {
+       fprintf(montage_status, "[struct stat=\"OK\", %s]\n", returnStruct->msg);
+       return 0;
+   }
+}
@@ -23,6 +23,24 @@ struct mSubimageParams
    long naxes[10];
 };
 
+struct mSubimageCutout
+{
+   int    id;           /* cntr from the region table */
+   char   file[1024];   /* output file */
+   double xref, yref;   /* center (ra,dec) or start pixel */
+   double xsize, ysize;
+   int    ibegin, iend; /* column range */
+   int    jbegin, jend; /* row range */
+   long   nelements;    /* row length */
+   int    nrows;
+   int    isflat;
+   double refval;
+   double *data;        /* pixels, filled during the row sweep */
+   int    status;
+   char   content[16];
+   char   msg[256];
+};
+
 
 /****************************************/
 /* Define mSubimage function prototypes */
@@ -91,9 +91,17 @@ static int isflat;
 
 static char content[128];
 
+static int            inMemory;
+static struct mImage *inImage;
+static struct mImage *outImage;
+
 
 static char montage_msgstr[1024];
 
+static struct mSubimageReturn *mSubimage_run(int mode, char *infile, int hdu, char *outfile,
+                                             double ra, double dec, double xsize, double ysize,
+                                             int nowcs, int debugin);
+
 
 /*-***********************************************************************/
 /*                                                                       */
@@ -136,6 +144,68 @@ static char montage_msgstr[1024];
 
 struct mSubimageReturn *mSubimage(int mode, char *infile, int hdu, char *outfile, double ra, double dec, 
                                   double xsize, double ysize, int nowcs, int debugin)
+{
+   inMemory = 0;
+
+   inImage  = (struct mImage *)NULL;
+   outImage = (struct mImage *)NULL;
+
+   return mSubimage_run(mode, infile, hdu, outfile, ra, dec, xsize, ysize, nowcs, debugin);
+}
+
+
+
+/*-***********************************************************************/
+/*                                                                       */
+/*  mSubimageMem                                                         */
+/*                                                                       */
+/*  The same, for an image in memory.  The input pixels are read in      */
+/*  place and the cutout is returned in memory, to be freed with         */
+/*  montage_imageFree().  There is no HDU mode.                          */
+/*                                                                       */
+/*   int    mode           Processing mode (SKY, PIX or SHRINK)          */
+/*   struct mImage  *input   Input image                                 */
+/*   struct mImage **output  Returned cutout (NULL on error)             */
+/*                                                                       */
+/*   double xref, yref     Cutout center or start pixel (as above)       */
+/*   double xsize, ysize   Cutout size (as above)                        */
+/*   int    nowcs          Indicates that the image has no WCS info      */
+/*   int    debug          Debugging output level                        */
+/*                                                                       */
+/*************************************************************************/
+
+struct mSubimageReturn *mSubimageMem(int mode, struct mImage *input, struct mImage **output,
+                                     double xref, double yref, double xsize, double ysize,
+                                     int nowcs, int debugin)
+{
+   struct mSubimageReturn *returnStruct;
+
+   inMemory = 1;
+
+   inImage  = input;
+   outImage = (struct mImage *)NULL;
+
+   returnStruct = mSubimage_run(mode, "(memory)", 0, "(memory)", xref, yref, xsize, ysize, nowcs, debugin);
+
+   if(returnStruct->status)
+   {
+      montage_imageFree(outImage);
+
+      outImage = (struct mImage *)NULL;
+   }
+
+   *output = outImage;
+
+   return returnStruct;
+}
+
+
+
+/* The cutout, for files or (inMemory) images in memory */
+
+static struct mSubimageReturn *mSubimage_run(int mode, char *infile, int hdu, char *outfile,
+                                             double ra, double dec, double xsize, double ysize,
+                                             int nowcs, int debugin)
 {
    fitsfile *infptr, *outfptr;
 
@@ -196,7 +266,7 @@ struct mSubimageReturn *mSubimage(int mode, char *infile, int hdu, char *outfile
    /* to get the WCS info                  */
    /****************************************/
 
-   if (!pixMode && !nowcs) 
+   if (!pixMode && !nowcs && !inMemory) 
    {
       checkHdr = montage_checkHdr(infile, 0, hdu);
 
@@ -210,7 +280,12 @@ struct mSubimageReturn *mSubimage(int mode, char *infile, int hdu, char *outfile
    header[0] = malloc(32768);
    header[1] = (char *)NULL;
 
-   if(fits_open_file(&infptr, infile, READONLY, &status))
+   if(inMemory)
+      montage_memOpen(&infptr, inImage, &status);
+   else
+      fits_open_file(&infptr, infile, READONLY, &status);
+
+   if(status)
    {
       sprintf(returnStruct->msg, "Image file %s missing or invalid FITS", infile);
       return returnStruct;
@@ -539,9 +614,16 @@ struct mSubimageReturn *mSubimage(int mode, char *infile, int hdu, char *outfile
    /* Create the output file */
    /**************************/
 
-   unlink(outfile);
+   if(inMemory)
+      fits_create_file(&outfptr, "mem://", &status);
+   else
+   {
+      unlink(outfile);
+
+      fits_create_file(&outfptr, outfile, &status);
+   }
 
-   if(fits_create_file(&outfptr, outfile, &status))
+   if(status)
    {
       sprintf(returnStruct->msg, "Can't create output file: %s", outfile);
       return returnStruct;
@@ -561,6 +643,13 @@ struct mSubimageReturn *mSubimage(int mode, char *infile, int hdu, char *outfile
 
    mSubimage_copyHeaderInfo(infptr, outfptr, &params);
 
+   if(inMemory && montage_memOutput(outfptr, &outImage, &status))
+   {
+      mSubimage_printFitsError(status);
+      strcpy(returnStruct->msg, montage_msgstr);
+      return returnStruct;
+   }
+
 
    /************************/
    /* Copy the data subset */
@@ -590,14 +679,14 @@ struct mSubimageReturn *mSubimage(int mode, char *infile, int hdu, char *outfile
       fflush(stdout);
    }
 
-   if(fits_close_file(outfptr, &status))
+   if(montage_closeOutput(outfptr, outImage, &status))
    {
       mSubimage_printFitsError(status);
       strcpy(returnStruct->msg, montage_msgstr);
       return returnStruct;
    }
 
-   if(fits_close_file(infptr, &status))
+   if(montage_closeInput(infptr, inImage, &status))
    {
       mSubimage_printFitsError(status);
       strcpy(returnStruct->msg, montage_msgstr);
@@ -863,8 +952,8 @@ int mSubimage_copyData(fitsfile *infptr, fitsfile *outfptr, struct mSubimagePara
          fflush(stdout);
       }
 
-      if(fits_read_pix(infptr, TDOUBLE, fpixel, params->nelements, &nan,
-                       buffer, &nullcnt, &status))
+      if(montage_readPix(infptr, inImage, TDOUBLE, fpixel, params->nelements, &nan,
+                         buffer, &nullcnt, &status))
       {
          mSubimage_printFitsError(status);
          return 1;
@@ -882,7 +971,7 @@ int mSubimage_copyData(fitsfile *infptr, fitsfile *outfptr, struct mSubimagePara
          }
       }
 
-      if (fits_write_pix(outfptr, TDOUBLE, fpixelo, params->nelements,
+      if (montage_putPix(outfptr, outImage, TDOUBLE, fpixelo, params->nelements,
                          (void *)buffer, &status))
       {
          mSubimage_printFitsError(status);
@@ -969,8 +1058,8 @@ int mSubimage_dataRange(fitsfile *infptr, int *imin, int *imax, int *jmin, int *
          fflush(stdout);
       }
 
-      if(fits_read_pix(infptr, TDOUBLE, fpixel, naxes[0], &nan,
-                       buffer, &nullcnt, &status))
+      if(montage_readPix(infptr, inImage, TDOUBLE, fpixel, naxes[0], &nan,
+                         buffer, &nullcnt, &status))
       {
          mSubimage_printFitsError(status);
          return 1;
@@ -0,0 +1,1055 @@
+/* Module: montageSubimageBatch.c
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <wcs.h>
+#include <coord.h>
+#include <mtbl.h>
+
+#include <mSubimage.h>
+#include <montage.h>
+
+#define MAXQUEUE 256
+
+static int debug;
+
+static char montage_msgstr[1024];
+
+
+/*********************************************/
+/* Cutouts that have all their rows are      */
+/* handed to the writer threads through this */
+/* queue.  The reader blocks if the writers  */
+/* fall too far behind, which bounds memory. */
+/*********************************************/
+
+static struct mSubimageCutout **queue;
+
+static int qhead, qtail, qcount, qdone;
+
+static pthread_mutex_t qmutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  qavail = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  qspace = PTHREAD_COND_INITIALIZER;
+
+static char *hdrstr;
+static int   nkeys;
+static int   isDSS;
+
+static double crpix[2];
+static double cnpix[2];
+
+
+static int  mSubimageBatch_compare(const void *a, const void *b);
+static void mSubimageBatch_enqueue(struct mSubimageCutout *cutout);
+static void *mSubimageBatch_writer(void *arg);
+static int  mSubimageBatch_write  (struct mSubimageCutout *cutout);
+static void mSubimageBatch_stop   (pthread_t *threads, int nthread);
+static void mSubimageBatch_printFitsError(int status);
+
+
+/*-***********************************************************************/
+/*                                                                       */
+/*  mSubimageBatch                                                       */
+/*                                                                       */
+/*  Cut many subimages out of one input image.  The cutout regions come  */
+/*  from a table (columns ra, dec and size or xsize/ysize; x and y       */
+/*  instead of ra and dec in pixel mode; optional cntr and file).  Each  */
+/*  region is sized exactly as mSubimage would size it.                  */
+/*                                                                       */
+/*  Rather than opening and reading the image once per cutout, the       */
+/*  regions are sorted by starting row and the image is swept once,      */
+/*  reading each needed row (the span covering all the cutouts active    */
+/*  on that row) a single time and scattering it into those cutouts.     */
+/*  Finished cutouts are written by a pool of writer threads while the   */
+/*  sweep continues.                                                     */
+/*                                                                       */
+/*   char  *infile         Input FITS file                               */
+/*   int    hdu            Optional HDU offset for input file            */
+/*   char  *tblfile        Table of cutout regions                       */
+/*   char  *outdir         Directory for the cutout files                */
+/*   char  *outtbl         Optional output table giving the file and     */
+/*                         content (or error) for each cutout            */
+/*                                                                       */
+/*   int    pixMode        Regions are in pixels (as mSubimage -p)       */
+/*   int    nthread        Number of writer threads                      */
+/*                                                                       */
+/*   int    debug          Debugging output level                        */
+/*                                                                       */
+/*************************************************************************/
+
+struct mSubimageBatchReturn *mSubimageBatch(char *infile, int hdu, char *tblfile, char *outdir, char *outtbl,
+                                            int pixMode, int nthread, int debugin)
+{
+   fitsfile *infptr, *tmplptr;
+
+   int       i, j, k, offscl, ncols, stat;
+   int       icntr, ixref, iyref, isize, ixsize, iysize, ifile;
+   int       ncutout, maxcutout, nvalid, nactive, next;
+   int       imin, imax, nread, nullcnt;
+   int       count, nblank, nflat, nfailed, maxlen;
+
+   long      fpixel[4];
+
+   int       sys;
+   double    epoch;
+   double    lon, lat;
+   double    xpix, ypix;
+   double    xoff, yoff;
+   double    xcorrection, ycorrection;
+   double    rotang, dtr, cdelt[2];
+   double    x, y, xpos, ypos;
+   double   *buffer, *row, val;
+
+   char     *checkHdr;
+   char     *header[2];
+
+   int       status = 0;
+
+   time_t    currtime, start;
+
+   FILE     *fout;
+
+   pthread_t *threads;
+
+   struct mSubimageParams params;
+
+   struct WorldCoor *wcs;
+
+   struct mSubimageCutout  *cutouts;
+   struct mSubimageCutout **sorted;
+   struct mSubimageCutout **active;
+   struct mSubimageCutout  *cutout;
+
+   struct mSubimageBatchReturn *returnStruct;
+
+
+   /*************************************************/
+   /* Make a NaN value to use checking blank pixels */
+   /*************************************************/
+
+   union
+   {
+      double d;
+      char   c[8];
+   }
+   value;
+
+   double nan;
+
+   for(i=0; i<8; ++i)
+      value.c[i] = 255;
+
+   nan = value.d;
+
+
+   dtr = atan(1.)/45.;
+
+   debug = debugin;
+
+   time(&currtime);
+   start = currtime;
+
+   if(nthread < 1)
+      nthread = 1;
+
+
+   /*******************************/
+   /* Initialize return structure */
+   /*******************************/
+
+   returnStruct = (struct mSubimageBatchReturn *)malloc(sizeof(struct mSubimageBatchReturn));
+
+   bzero((void *)returnStruct, sizeof(struct mSubimageBatchReturn));
+
+
+   returnStruct->status = 1;
+
+   strcpy(returnStruct->msg, "");
+
+
+   /**************************************/
+   /* Open the image and get its WCS and */
+   /* dimensions                         */
+   /**************************************/
+
+   if(!pixMode)
+   {
+      checkHdr = montage_checkHdr(infile, 0, hdu);
+
+      if(checkHdr)
+      {
+         strcpy(returnStruct->msg, checkHdr);
+         return returnStruct;
+      }
+   }
+
+   header[0] = malloc(32768);
+   header[1] = (char *)NULL;
+
+   if(fits_open_file(&infptr, infile, READONLY, &status))
+   {
+      sprintf(returnStruct->msg, "Image file %s missing or invalid FITS", infile);
+      return returnStruct;
+   }
+
+   if(hdu > 0)
+   {
+      if(fits_movabs_hdu(infptr, hdu+1, NULL, &status))
+      {
+         sprintf(returnStruct->msg, "Can't find HDU %d", hdu);
+         return returnStruct;
+      }
+   }
+
+   wcs = mSubimage_getFileInfo(infptr, header, &params);
+
+   if(wcs == (struct WorldCoor *)NULL)
+   {
+      strcpy(returnStruct->msg, "Input file invalid WCS.");
+      return returnStruct;
+   }
+
+   isDSS    = params.isDSS;
+   crpix[0] = params.crpix[0];
+   crpix[1] = params.crpix[1];
+   cnpix[0] = params.cnpix[0];
+   cnpix[1] = params.cnpix[1];
+
+   rotang = atan2(wcs->cd[2], wcs->cd[0])/dtr;
+
+   while(rotang <   0.) rotang += 360.;
+   while(rotang > 360.) rotang -= 360.;
+
+   if((rotang >  45. && rotang < 135.) ||
+      (rotang > 225. && rotang < 315.))
+   {
+      cdelt[0] = wcs->cd[2]/sin(rotang*dtr);
+      cdelt[1] = wcs->cd[1]/sin(rotang*dtr);
+   }
+   else
+   {
+      cdelt[0] = wcs->cd[0]/cos(rotang*dtr);
+      cdelt[1] = wcs->cd[3]/cos(rotang*dtr);
+   }
+
+
+   /* Kludge to get around bug in WCS library:   */
+   /* 360 degrees sometimes added to pixel coord */
+
+   pix2wcs(wcs, 0.5, 0.5, &xpos, &ypos);
+
+   offscl = wcs->offscl;
+
+   x = 0.;
+   y = 0.;
+
+   if(!offscl)
+      wcs2pix(wcs, xpos, ypos, &x, &y, &offscl);
+
+   xcorrection = x-0.5;
+   ycorrection = y-0.5;
+
+
+   /* Extract the coordinate system and epoch info */
+
+   if(wcs->syswcs == WCS_J2000)
+   {
+      sys   = EQUJ;
+      epoch = 2000.;
+
+      if(wcs->equinox == 1950.)
+         epoch = 1950;
+   }
+   else if(wcs->syswcs == WCS_B1950)
+   {
+      sys   = EQUB;
+      epoch = 1950.;
+
+      if(wcs->equinox == 2000.)
+         epoch = 2000;
+   }
+   else if(wcs->syswcs == WCS_GALACTIC)
+   {
+      sys   = GAL;
+      epoch = 2000.;
+   }
+   else if(wcs->syswcs == WCS_ECLIPTIC)
+   {
+      sys   = ECLJ;
+      epoch = 2000.;
+
+      if(wcs->equinox == 1950.)
+      {
+         sys   = ECLB;
+         epoch = 1950.;
+      }
+   }
+   else
+   {
+      sys   = EQUJ;
+      epoch = 2000.;
+   }
+
+
+   /*****************************************/
+   /* Read the region table and convert the */
+   /* regions to pixel ranges               */
+   /*****************************************/
+
+   ncols = topen(tblfile);
+
+   if(ncols <= 0)
+   {
+      sprintf(returnStruct->msg, "Invalid cutout table: %s", tblfile);
+      return returnStruct;
+   }
+
+   icntr  = tcol("cntr");
+   ifile  = tcol("file");
+   isize  = tcol("size");
+   ixsize = tcol("xsize");
+   iysize = tcol("ysize");
+
+   if(pixMode)
+   {
+      ixref = tcol("x");
+      iyref = tcol("y");
+   }
+   else
+   {
+      ixref = tcol("ra");
+      iyref = tcol("dec");
+   }
+
+   if(ixref < 0 || iyref < 0)
+   {
+      tclose();
+
+      if(pixMode)
+         strcpy(returnStruct->msg, "Cutout table needs columns 'x' and 'y'");
+      else
+         strcpy(returnStruct->msg, "Cutout table needs columns 'ra' and 'dec'");
+
+      return returnStruct;
+   }
+
+   if(isize < 0 && (ixsize < 0 || iysize < 0))
+   {
+      tclose();
+      strcpy(returnStruct->msg, "Cutout table needs column 'size' or columns 'xsize' and 'ysize'");
+      return returnStruct;
+   }
+
+   ncutout   = 0;
+   maxcutout = 1024;
+
+   cutouts = (struct mSubimageCutout *)malloc(maxcutout * sizeof(struct mSubimageCutout));
+
+   while(1)
+   {
+      stat = tread();
+
+      if(stat < 0)
+         break;
+
+      if(ncutout >= maxcutout)
+      {
+         maxcutout += 1024;
+
+         cutouts = (struct mSubimageCutout *)realloc(cutouts, maxcutout * sizeof(struct mSubimageCutout));
+      }
+
+      cutout = &cutouts[ncutout];
+
+      bzero((void *)cutout, sizeof(struct mSubimageCutout));
+
+      cutout->id = ncutout;
+
+      if(icntr >= 0)
+         cutout->id = atoi(tval(icntr));
+
+      if(ifile >= 0 && !tnull(ifile))
+      {
+         if(tval(ifile)[0] == '/')
+            strcpy(cutout->file, tval(ifile));
+         else
+            sprintf(cutout->file, "%s/%s", outdir, tval(ifile));
+      }
+      else
+         sprintf(cutout->file, "%s/cutout_%d.fits", outdir, cutout->id);
+
+      cutout->xref = atof(tval(ixref));
+      cutout->yref = atof(tval(iyref));
+
+      if(isize >= 0)
+      {
+         cutout->xsize = atof(tval(isize));
+         cutout->ysize = cutout->xsize;
+      }
+      else
+      {
+         cutout->xsize = atof(tval(ixsize));
+         cutout->ysize = atof(tval(iysize));
+      }
+
+      ++ncutout;
+
+      if(cutout->xsize <= 0. || cutout->ysize <= 0.)
+      {
+         cutout->status = 1;
+         strcpy(cutout->msg, "Invalid size");
+         continue;
+      }
+
+      if(pixMode)
+      {
+         cutout->ibegin = (int)cutout->xref;
+         cutout->iend   = (int)(cutout->xref + cutout->xsize + 0.5);
+
+         cutout->jbegin = (int)cutout->yref;
+         cutout->jend   = (int)(cutout->yref + cutout->ysize + 0.5);
+      }
+      else
+      {
+         convertCoordinates(EQUJ, 2000., cutout->xref, cutout->yref, sys, epoch, &lon, &lat, 0.);
+
+         offscl = 0;
+
+         wcs2pix(wcs, lon, lat, &xpix, &ypix, &offscl);
+
+         xpix = xpix - xcorrection;
+         ypix = ypix - ycorrection;
+
+         xoff = fabs(cutout->xsize/2./cdelt[0]);
+         yoff = fabs(cutout->ysize/2./cdelt[1]);
+
+         cutout->ibegin = xpix - xoff;
+         cutout->iend   = cutout->ibegin + floor(2.*xoff + 1.0);
+
+         cutout->jbegin = ypix - yoff;
+         cutout->jend   = cutout->jbegin + floor(2.*yoff + 1.0);
+
+         if((   cutout->ibegin <              1
+             && cutout->iend   <              1 )
+         || (   cutout->ibegin > params.naxes[0]
+             && cutout->iend   > params.naxes[0])
+         || (   cutout->jbegin <              1
+             && cutout->jend   <              1 )
+         || (   cutout->jbegin > params.naxes[1]
+             && cutout->jend   > params.naxes[1]))
+         {
+            cutout->status = 1;
+            strcpy(cutout->msg, "Region outside image.");
+            continue;
+         }
+      }
+
+      if(cutout->ibegin < 1             ) cutout->ibegin = 1;
+      if(cutout->ibegin > params.naxes[0]) cutout->ibegin = params.naxes[0];
+      if(cutout->iend   > params.naxes[0]) cutout->iend   = params.naxes[0];
+      if(cutout->iend   < 1             ) cutout->iend   = 1;
+
+      if(cutout->jbegin < 1             ) cutout->jbegin = 1;
+      if(cutout->jbegin > params.naxes[1]) cutout->jbegin = params.naxes[1];
+      if(cutout->jend   > params.naxes[1]) cutout->jend   = params.naxes[1];
+      if(cutout->jend   < 1             ) cutout->jend   = 1;
+
+      if(!pixMode && (cutout->ibegin >= cutout->iend || cutout->jbegin >= cutout->jend))
+      {
+         cutout->status = 1;
+         strcpy(cutout->msg, "No pixels match area.");
+         continue;
+      }
+
+      cutout->nelements = cutout->iend - cutout->ibegin + 1;
+      cutout->nrows     = cutout->jend - cutout->jbegin + 1;
+
+      if(debug)
+      {
+         printf("cutout %d: [%d,%d] x [%d,%d] -> %s\n", cutout->id,
+            cutout->ibegin, cutout->iend, cutout->jbegin, cutout->jend, cutout->file);
+         fflush(stdout);
+      }
+   }
+
+   tclose();
+
+
+   /**************************************/
+   /* Sort the good regions by start row */
+   /**************************************/
+
+   sorted = (struct mSubimageCutout **)malloc((ncutout+1) * sizeof(struct mSubimageCutout *));
+   active = (struct mSubimageCutout **)malloc((ncutout+1) * sizeof(struct mSubimageCutout *));
+
+   nvalid = 0;
+
+   for(k=0; k<ncutout; ++k)
+   {
+      if(cutouts[k].status == 0)
+      {
+         sorted[nvalid] = &cutouts[k];
+         ++nvalid;
+      }
+   }
+
+   qsort(sorted, nvalid, sizeof(struct mSubimageCutout *), mSubimageBatch_compare);
+
+
+   /*********************************************/
+   /* Every output header starts as a copy of   */
+   /* the input header, made the same way       */
+   /* fits_copy_header() would for mSubimage.   */
+   /* The writers only get the card text, as    */
+   /* they cannot share the input file handle.  */
+   /*********************************************/
+
+   if(fits_create_file(&tmplptr, "mem://", &status))
+   {
+      mSubimageBatch_printFitsError(status);
+      strcpy(returnStruct->msg, montage_msgstr);
+      return returnStruct;
+   }
+
+   if(fits_copy_header(infptr, tmplptr, &status))
+   {
+      mSubimageBatch_printFitsError(status);
+      strcpy(returnStruct->msg, montage_msgstr);
+      return returnStruct;
+   }
+
+   if(fits_hdr2str(tmplptr, 0, (char **)NULL, 0, &hdrstr, &nkeys, &status))
+   {
+      mSubimageBatch_printFitsError(status);
+      strcpy(returnStruct->msg, montage_msgstr);
+      return returnStruct;
+   }
+
+   status = 0;
+   fits_close_file(tmplptr, &status);
+   status = 0;
+
+
+   /**************************/
+   /* Start the writer pool  */
+   /**************************/
+
+   queue = (struct mSubimageCutout **)malloc(MAXQUEUE * sizeof(struct mSubimageCutout *));
+
+   qhead  = 0;
+   qtail  = 0;
+   qcount = 0;
+   qdone  = 0;
+
+   buffer  = (double *)NULL;
+   nactive = 0;
+
+   threads = (pthread_t *)malloc(nthread * sizeof(pthread_t));
+
+   for(i=0; i<nthread; ++i)
+   {
+      if(pthread_create(&threads[i], (pthread_attr_t *)NULL, mSubimageBatch_writer, (void *)NULL))
+      {
+         sprintf(returnStruct->msg, "Cannot start writer thread %d", i);
+
+         nthread = i;
+         goto failed;
+      }
+   }
+
+
+   /*****************************************/
+   /* Sweep the image rows.  Each row is    */
+   /* read once, over the span covering all */
+   /* the cutouts that include it.          */
+   /*****************************************/
+
+   buffer = (double *)malloc(params.naxes[0] * sizeof(double));
+
+   if(buffer == (double *)NULL)
+   {
+      strcpy(returnStruct->msg, "Cannot allocate memory for image row");
+      goto failed;
+   }
+
+   fpixel[2] = 1;
+   fpixel[3] = 1;
+
+   next    = 0;
+   nread   = 0;
+
+   j = 1;
+
+   if(nvalid > 0)
+      j = sorted[0]->jbegin;
+
+   while(next < nvalid || nactive > 0)
+   {
+      if(nactive == 0 && sorted[next]->jbegin > j)
+         j = sorted[next]->jbegin;
+
+      while(next < nvalid && sorted[next]->jbegin == j)
+      {
+         cutout = sorted[next];
+
+         cutout->data = (double *)malloc(cutout->nelements * cutout->nrows * sizeof(double));
+
+         if(cutout->data == (double *)NULL)
+         {
+            sprintf(returnStruct->msg, "Cannot allocate memory for cutout %d", cutout->id);
+            goto failed;
+         }
+
+         cutout->isflat = 1;
+         cutout->refval = nan;
+
+         active[nactive] = cutout;
+         ++nactive;
+         ++next;
+      }
+
+      imin = params.naxes[0];
+      imax = 1;
+
+      for(k=0; k<nactive; ++k)
+      {
+         if(active[k]->ibegin < imin) imin = active[k]->ibegin;
+         if(active[k]->iend   > imax) imax = active[k]->iend;
+      }
+
+      fpixel[0] = imin;
+      fpixel[1] = j;
+
+      if(debug >= 2)
+      {
+         printf("Processing input image row %5d [%d-%d], %d active\n", j, imin, imax, nactive);
+         fflush(stdout);
+      }
+
+      if(fits_read_pix(infptr, TDOUBLE, fpixel, imax-imin+1, &nan,
+                       buffer, &nullcnt, &status))
+      {
+         mSubimageBatch_printFitsError(status);
+         strcpy(returnStruct->msg, montage_msgstr);
+         goto failed;
+      }
+
+      ++nread;
+
+      for(k=0; k<nactive; ++k)
+      {
+         cutout = active[k];
+
+         row = cutout->data + (j - cutout->jbegin) * cutout->nelements;
+
+         memcpy(row, buffer + cutout->ibegin - imin, cutout->nelements * sizeof(double));
+
+         if(cutout->isflat)
+         {
+            for(i=0; i<cutout->nelements; ++i)
+            {
+               val = row[i];
+
+               if(!mNaN(val))
+               {
+                  if(mNaN(cutout->refval))
+                     cutout->refval = val;
+
+                  if(val != cutout->refval)
+                  {
+                     cutout->isflat = 0;
+                     break;
+                  }
+               }
+            }
+         }
+      }
+
+
+      /* Hand finished cutouts to the writers */
+
+      for(k=0; k<nactive; ++k)
+      {
+         if(active[k]->jend == j)
+         {
+            mSubimageBatch_enqueue(active[k]);
+
+            active[k] = active[nactive-1];
+            --nactive;
+            --k;
+         }
+      }
+
+      ++j;
+   }
+
+   free(buffer);
+
+   mSubimageBatch_stop(threads, nthread);
+
+   free(hdrstr);
+   free(sorted);
+   free(active);
+
+   if(fits_close_file(infptr, &status))
+   {
+      mSubimageBatch_printFitsError(status);
+      strcpy(returnStruct->msg, montage_msgstr);
+      return returnStruct;
+   }
+
+
+   /*****************************************/
+   /* Tally the results and (optionally)    */
+   /* write the cutout table                */
+   /*****************************************/
+
+   fout = (FILE *)NULL;
+
+   maxlen = 4;
+
+   for(k=0; k<ncutout; ++k)
+      if((int)strlen(cutouts[k].file) > maxlen)
+         maxlen = strlen(cutouts[k].file);
+
+   if(outtbl != (char *)NULL && strlen(outtbl) > 0)
+   {
+      fout = fopen(outtbl, "w+");
+
+      if(fout == (FILE *)NULL)
+      {
+         sprintf(returnStruct->msg, "Can't open output table %s", outtbl);
+         return returnStruct;
+      }
+
+      fprintf(fout, "|  cntr  |naxis1|naxis2| content | %-*s | msg\n", maxlen, "file");
+      fprintf(fout, "|  int   | int  | int  |  char   | %-*s | char\n", maxlen, "char");
+   }
+
+   count   = 0;
+   nblank  = 0;
+   nflat   = 0;
+   nfailed = 0;
+
+   for(k=0; k<ncutout; ++k)
+   {
+      cutout = &cutouts[k];
+
+      if(cutout->status)
+      {
+         ++nfailed;
+
+         strcpy(cutout->content, "error");
+      }
+      else
+      {
+         ++count;
+
+         if(strcmp(cutout->content, "blank") == 0) ++nblank;
+         if(strcmp(cutout->content, "flat" ) == 0) ++nflat;
+      }
+
+      if(fout)
+         fprintf(fout, " %8d %6ld %6d %9s  %-*s   %s\n", cutout->id, cutout->nelements, cutout->nrows,
+            cutout->content, maxlen, cutout->file, cutout->msg);
+   }
+
+   if(fout)
+      fclose(fout);
+
+   free(cutouts);
+
+   time(&currtime);
+
+   returnStruct->status = 0;
+
+   sprintf(returnStruct->msg,  "count=%d, nblank=%d, nflat=%d, failed=%d, nread=%d, time=%.0f",
+      count, nblank, nflat, nfailed, nread, (double)(currtime - start));
+
+   sprintf(returnStruct->json, "{\"count\":%d, \"nblank\":%d, \"nflat\":%d, \"failed\":%d, \"nread\":%d, \"time\":%.1f}",
+      count, nblank, nflat, nfailed, nread, (double)(currtime - start));
+
+   returnStruct->count   = count;
+   returnStruct->nblank  = nblank;
+   returnStruct->nflat   = nflat;
+   returnStruct->failed  = nfailed;
+   returnStruct->nread   = nread;
+   returnStruct->time    = (double)(currtime - start);
+
+   return returnStruct;
+
+
+   /*****************************************/
+   /* A failure once the writers are going: */
+   /* let them finish the cutouts already   */
+   /* queued, then drop the ones still      */
+   /* being filled                          */
+   /*****************************************/
+
+failed:
+
+   mSubimageBatch_stop(threads, nthread);
+
+   for(k=0; k<nactive; ++k)
+   {
+      free(active[k]->data);
+
+      active[k]->data = (double *)NULL;
+   }
+
+   free(buffer);
+   free(hdrstr);
+   free(sorted);
+   free(active);
+   free(cutouts);
+
+   status = 0;
+   fits_close_file(infptr, &status);
+
+   return returnStruct;
+}
+
+
+/*******************************/
+/* Sort cutouts by first row   */
+/* (and by column within row)  */
+/*******************************/
+
+static int mSubimageBatch_compare(const void *a, const void *b)
+{
+   struct mSubimageCutout *ca = *(struct mSubimageCutout **)a;
+   struct mSubimageCutout *cb = *(struct mSubimageCutout **)b;
+
+   if(ca->jbegin < cb->jbegin) return -1;
+   if(ca->jbegin > cb->jbegin) return  1;
+
+   if(ca->ibegin < cb->ibegin) return -1;
+   if(ca->ibegin > cb->ibegin) return  1;
+
+   return 0;
+}
+
+
+/****************************************/
+/* Add a finished cutout to the queue,  */
+/* waiting if the writers are behind    */
+/****************************************/
+
+static void mSubimageBatch_enqueue(struct mSubimageCutout *cutout)
+{
+   pthread_mutex_lock(&qmutex);
+
+   while(qcount >= MAXQUEUE)
+      pthread_cond_wait(&qspace, &qmutex);
+
+   queue[qtail] = cutout;
+
+   qtail = (qtail + 1) % MAXQUEUE;
+
+   ++qcount;
+
+   pthread_cond_signal(&qavail);
+   pthread_mutex_unlock(&qmutex);
+}
+
+
+/****************************************/
+/* Writer thread: take cutouts off the  */
+/* queue until the sweep is finished    */
+/****************************************/
+
+static void *mSubimageBatch_writer(void *arg)
+{
+   struct mSubimageCutout *cutout;
+
+   while(1)
+   {
+      pthread_mutex_lock(&qmutex);
+
+      while(qcount == 0 && !qdone)
+         pthread_cond_wait(&qavail, &qmutex);
+
+      if(qcount == 0 && qdone)
+      {
+         pthread_mutex_unlock(&qmutex);
+         break;
+      }
+
+      cutout = queue[qhead];
+
+      qhead = (qhead + 1) % MAXQUEUE;
+
+      --qcount;
+
+      pthread_cond_signal(&qspace);
+      pthread_mutex_unlock(&qmutex);
+
+      mSubimageBatch_write(cutout);
+
+      free(cutout->data);
+
+      cutout->data = (double *)NULL;
+   }
+
+   return (void *)NULL;
+}
+
+
+/****************************************/
+/* End the sweep: tell the writers, let */
+/* them empty the queue and reset the   */
+/* queue for the next call              */
+/****************************************/
+
+static void mSubimageBatch_stop(pthread_t *threads, int nthread)
+{
+   int i;
+
+   pthread_mutex_lock(&qmutex);
+
+   qdone = 1;
+
+   pthread_cond_broadcast(&qavail);
+   pthread_mutex_unlock(&qmutex);
+
+   for(i=0; i<nthread; ++i)
+      pthread_join(threads[i], (void **)NULL);
+
+   free(threads);
+   free(queue);
+
+   queue  = (struct mSubimageCutout **)NULL;
+   qhead  = 0;
+   qtail  = 0;
+   qcount = 0;
+   qdone  = 0;
+}
+
+
+/****************************************/
+/* Write one cutout: the template cards */
+/* then the same keyword updates and    */
+/* data mSubimage would write           */
+/****************************************/
+
+static int mSubimageBatch_write(struct mSubimageCutout *cutout)
+{
+   fitsfile *outfptr;
+
+   int       i, naxis2;
+   long      fpixel[4];
+   double    tmp;
+   char     *card;
+   char      card80[81];
+
+   int       status = 0;
+
+
+   unlink(cutout->file);
+
+   if(fits_create_file(&outfptr, cutout->file, &status))
+   {
+      cutout->status = 1;
+      strcpy(cutout->msg, "Can't create output file");
+      return 1;
+   }
+
+   for(i=0; i<nkeys; ++i)
+   {
+      card = hdrstr + 80*i;
+
+      strncpy(card80, card, 80);
+
+      card80[80] = '\0';
+
+      if(strncmp(card80, "END     ", 8) == 0)
+         break;
+
+      fits_write_record(outfptr, card80, &status);
+   }
+
+   fits_set_hdustruc(outfptr, &status);
+
+   fits_update_key_lng(outfptr, "BITPIX", -64, (char *)NULL, &status);
+   fits_update_key_lng(outfptr, "NAXIS",    2, (char *)NULL, &status);
+
+   fits_update_key_lng(outfptr, "NAXIS1", cutout->nelements, (char *)NULL, &status);
+
+   naxis2 = cutout->jend - cutout->jbegin + 1;
+
+   fits_update_key_lng(outfptr, "NAXIS2", naxis2, (char *)NULL, &status);
+
+   if(isDSS)
+   {
+      tmp = cnpix[0] + cutout->ibegin - 1;
+
+      fits_update_key_dbl(outfptr, "CNPIX1", tmp, -14, (char *)NULL, &status);
+
+      tmp = cnpix[1] + cutout->jbegin - 1;
+
+      fits_update_key_dbl(outfptr, "CNPIX2", tmp, -14, (char *)NULL, &status);
+   }
+   else
+   {
+      tmp = crpix[0] - cutout->ibegin + 1;
+
+      fits_update_key_dbl(outfptr, "CRPIX1", tmp, -14, (char *)NULL, &status);
+
+      tmp = crpix[1] - cutout->jbegin + 1;
+
+      fits_update_key_dbl(outfptr, "CRPIX2", tmp, -14, (char *)NULL, &status);
+   }
+
+   fpixel[0] = 1;
+   fpixel[1] = 1;
+   fpixel[2] = 1;
+   fpixel[3] = 1;
+
+   fits_write_pix(outfptr, TDOUBLE, fpixel, cutout->nelements * cutout->nrows,
+                  (void *)cutout->data, &status);
+
+   fits_close_file(outfptr, &status);
+
+   if(status)
+   {
+      cutout->status = 1;
+      fits_get_errstatus(status, cutout->msg);
+      return 1;
+   }
+
+   if(cutout->isflat)
+   {
+      if(mNaN(cutout->refval))
+         strcpy(cutout->content, "blank");
+      else
+         strcpy(cutout->content, "flat");
+   }
+   else
+      strcpy(cutout->content, "normal");
+
+   return 0;
+}
+
+
+/***********************************/
+/*                                 */
+/*  Print out FITS library errors  */
+/*                                 */
+/***********************************/
+
+static void mSubimageBatch_printFitsError(int status)
+{
+   char status_str[FLEN_STATUS];
+
+   fits_get_errstatus(status, status_str);
+
+   strcpy(montage_msgstr, status_str);
+}
@@ -17,7 +17,7 @@
 
 int main(int argc, char **argv)
 {
-   int i, debug;
+   int i, debug, nproc;
 
    char cmdstr  [MAXSTR];
    char line    [STRLEN];
@@ -26,11 +26,86 @@ int main(int argc, char **argv)
    char jsonFile[STRLEN];
    char jsonStr [MAXSTR];
 
+   char *end;
+
    FILE *fin;
 
    struct mViewerReturn *returnStruct;
 
 
+   /*****************************************************/
+   /* Build a spatial index for a catalog or image      */
+   /* metadata overlay table, to be used by later runs  */
+   /* against the same table                            */
+   /*****************************************************/
+
+   if(argc == 3 && (strcmp(argv[1], "-index") == 0 || strcmp(argv[1], "-index-imginfo") == 0))
+   {
+      returnStruct = mViewerIndex(argv[2], strcmp(argv[1], "-index-imginfo") == 0, 0);
+
+      if(returnStruct->status == 1)
+      {
+         printf("[struct stat=\"ERROR\", msg=\"%s\"]\n", returnStruct->msg);
+         exit(1);
+      }
+      else
+      {
+         printf("[struct stat=\"OK\", %s]\n", returnStruct->msg);
+         exit(0);
+      }
+   }
+
+
+   /*****************************************************/
+   /* Render a list of JSON view commands, sharing the  */
+   /* images, histograms and so on between the views    */
+   /* and spreading them over several processes         */
+   /*****************************************************/
+
+   if(argc >= 3 && strcmp(argv[1], "-batch") == 0)
+   {
+      nproc = 0;
+      debug = 0;
+
+      for(i=3; i<argc; ++i)
+      {
+         if(strcmp(argv[i], "-d") == 0)
+            debug = 1;
+
+         else if(strcmp(argv[i], "-n") == 0 && i < argc-1)
+         {
+            nproc = strtol(argv[i+1], &end, 0);
+
+            if(nproc < 0 || end < argv[i+1] + strlen(argv[i+1]))
+            {
+               printf("[struct stat=\"ERROR\", msg=\"Process count must be a non-negative integer.\"]\n");
+               exit(1);
+            }
+
+            ++i;
+         }
+         else
+         {
+            printf("[struct stat=\"ERROR\", msg=\"Usage: mViewer -batch listfile [-n nproc] [-d]\"]\n");
+            exit(1);
+         }
+      }
+
+      returnStruct = mViewerBatch(argv[2], nproc, debug);
+
+      if(returnStruct->status == 1)
+      {
+         printf("[struct stat=\"ERROR\", msg=\"%s\"]\n", returnStruct->msg);
+         exit(1);
+      }
+      else
+      {
+         printf("[struct stat=\"OK\", %s]\n", returnStruct->msg);
+         exit(0);
+      }
+   }
+
+
    /*****************************************************/
    /* Scan through the command line parameters to pull  */
    /* out a few parameters (debug, output file, output  */
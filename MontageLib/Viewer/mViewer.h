@@ -4,6 +4,48 @@
 #define CMDMODE  0
 #define JSONMODE 1
 
+
+/* Everything the rendering threads need to turn */
+/* a pixel value into a color index              */
+
+struct mViewerStretch
+{
+   int    type;
+   int    logpower;
+   int    off;
+   double minval;
+   double maxval;
+   double diff;
+   double betaval;
+   double xoff;
+   int    naxis1;
+   double level[256];     /* Gaussian levels, made non-decreasing */
+};
+
+
+/* Streaming PNG output (mViewer_png.c) */
+
+struct mViewerPNG;
+
+
+/* One band of image rows (and the share of it */
+/* a single thread is to render)               */
+
+struct mViewerBand
+{
+   int      color;
+   int      nrow;
+   int      jj0;
+   int      start;
+   int      stride;
+   int      istart;
+   double   truecolor;
+   double **gray;
+   double **red;
+   double **green;
+   double **blue;
+};
+
 int    mViewer_parseSymbol        (char *symbolstr, int *symNPnt, int *symNMax, int *symType, double *symRotAngle);
 int    mViewer_colorLookup        (char *colorin, double *ovlyred, double *ovlygreen, double *ovlyblue);
 int    mViewer_hexVal             (char c);
@@ -30,6 +72,13 @@ int    mViewer_getRange           (fitsfile *fptr, char *minstr, char *maxstr,
                                    double *median, double *sigma,
                                    int count, int *planes);
 
+int    mViewer_openFile           (fitsfile **fptr, char *file, int hdu, int *status);
+char  *mViewer_checkHdr           (char *file, int hdu);
+void   mViewer_cacheFree          ();
+
+void   mViewer_scanImage          (fitsfile *fptr, int imnaxis1, int imnaxis2,
+                                   int count, int *planes);
+
 int    checkHdr                   (char *infile, int hdrflag, int hdu);
 int    checkWCS                   (struct WorldCoor *wcs, int action);
 
@@ -45,6 +94,10 @@ double mViewer_label_length       (char *face_path, int fontsize, char *text);
 
 void   mViewer_addOverlay         ();
 
+struct mViewerPNG *mViewer_pngOpen(char *filename, unsigned width, unsigned height, int gray, int (*palette)[3], char *comment);
+int    mViewer_pngRow             (struct mViewerPNG *png, unsigned char *row);
+int    mViewer_pngClose           (struct mViewerPNG *png);
+
 void   mViewer_labeledCurve      (char *face_path, int fontsize, int showLine,
                                    double *xcurve, double *ycurve, int npt,
                                    char *text, double offset,
@@ -80,6 +133,25 @@ void   mViewer_great_circle       (struct WorldCoor *wcs, int flipY,
                                    double lon0,  double lat0, double lon1, double lat1,
                                    double red,   double green, double blue);
 
+int    mViewer_viewCap            (int csysimg, double epochimg, int csys, double epoch,
+                                   double *x, double *y, double *z, double *radius);
+
+void   mViewer_drawDensity        (double *xyz, long npts, int csysimg, double epochimg, int csys, double epoch,
+                                   int binsize, double red, double green, double blue);
+
+void   mViewer_setStretch         (struct mViewerStretch *stretch, int type, int logpower,
+                                   double minval, double maxval, double diff, double betaval,
+                                   double *dataval, int off, double xoff, int naxis1);
+
+int    mViewer_grayIndex          (struct mViewerStretch *stretch, double val);
+double mViewer_colorLevel         (struct mViewerStretch *stretch, double val);
+int    mViewer_levelIndex         (struct mViewerStretch *stretch, double val);
+
+void   mViewer_renderBand         (struct mViewerBand *band, int jj0, int nrow);
+void  *mViewer_renderThread       (void *ptr);
+void   mViewer_grayRow            (struct mViewerBand *band, int k);
+void   mViewer_colorRow           (struct mViewerBand *band, int k);
+
 void   mViewer_symbol             (struct WorldCoor *wcs, int flipY,
                                    int csysimg,  double epochimg,
                                    int csyssym, double epochsym,
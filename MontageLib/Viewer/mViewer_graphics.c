@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <freetype2/ft2build.h>
 #include <freetype.h>
@@ -22,6 +24,72 @@ int    mViewer_getPixel    (int i, int j, int color);
 
 double mViewer_label_length(char *face_path, int fontsize, char *text);
 
+FT_Face mViewer_fontFace   (char *face_path);
+
+
+static FT_Library fontLibrary;
+static FT_Face    fontFace;
+static char       fontPath[1024] = "";
+
+
+/****************************************************/
+/*                                                  */
+/* The FreeType face for a font file.  Loading the  */
+/* font is far more work than drawing a short       */
+/* label, so the library and the face are kept for  */
+/* the life of the process (there is normally only  */
+/* the one font) rather than rebuilt per label.     */
+/*                                                  */
+/****************************************************/
+
+FT_Face mViewer_fontFace(char *face_path)
+{
+   FT_Error error;
+
+   if(strcmp(face_path, fontPath) == 0)
+      return fontFace;
+
+   if(fontPath[0] == '\0')
+   {
+      /* Initialize FT Library object */
+
+      error = FT_Init_FreeType( &fontLibrary );
+
+      if (error)
+      {
+         printf("[struct stat=\"ERROR\", msg=\"FreeType: Could not init Library.\"]\n");
+         exit(1);
+      }
+   }
+   else
+   {
+      FT_Done_Face( fontFace );
+
+      fontPath[0] = '\0';
+   }
+
+
+   /* Initialize FT face object */
+
+   error = FT_New_Face( fontLibrary, face_path, 0, &fontFace );
+
+   if (error == FT_Err_Unknown_File_Format)
+   {
+      printf("[struct stat=\"ERROR\", msg=\"FreeType: Font was opened, but type not supported.\"]\n");
+      exit(1);
+   }
+   else if (error)
+   {
+      printf("[struct stat=\"ERROR\", msg=\"FreeType: Could not find or load font file.\"]\n");
+      exit(1);
+   }
+
+   strncpy(fontPath, face_path, 1023);
+   fontPath[1023] = '\0';
+
+   return fontFace;
+}
+
 
 /****************************************************/
 /*                                                  */
@@ -36,7 +104,6 @@ void mViewer_labeledCurve( char *face_path, int fontsize, int showLine,
                            char *text, double offset, 
                            double red, double green, double blue)
 {
-   FT_Library  library;
    FT_Face     face;
    FT_Matrix   matrix;      // transformation matrix
    FT_Vector   pen;
@@ -222,31 +289,9 @@ void mViewer_labeledCurve( char *face_path, int fontsize, int showLine,
    // num_chars now contains the number of characters in the string.
    
 
-   /* Initialize FT Library object */
+   /* The FT face object (loaded once per font file) */
 
-   error = FT_Init_FreeType( &library );
-
-   if (error)
-   {
-      printf("[struct stat=\"ERROR\", msg=\"FreeType: Could not init Library.\"]\n");
-      exit(1);
-   }
-
-
-   /* Initialize FT face object */
-
-   error = FT_New_Face( library, face_path, 0, &face );
-
-   if (error == FT_Err_Unknown_File_Format)
-   {
-      printf("[struct stat=\"ERROR\", msg=\"FreeType: Font was opened, but type not supported.\"]\n");
-      exit(1);
-   }
-   else if (error)
-   {
-      printf("[struct stat=\"ERROR\", msg=\"FreeType: Could not find or load font file.\"]\n");
-      exit(1);
-   }
+   face = mViewer_fontFace(face_path);
 
 
    /* Set the Char size */
@@ -464,11 +509,6 @@ void mViewer_labeledCurve( char *face_path, int fontsize, int showLine,
    }
 
 
-   /* Free the face and the library objects */
-
-   FT_Done_Face    ( face );
-   FT_Done_FreeType( library );
-
 
    /* Draw the subsegment of the curve following the last character */
 
@@ -768,7 +808,6 @@ double mViewer_invfrac(double x)
 
 double mViewer_label_length( char *face_path, int fontsize, char *text)
 {
-   FT_Library  library;
    FT_Face     face;
    FT_Matrix   matrix;      // transformation matrix
    FT_Vector   pen;
@@ -862,31 +901,9 @@ double mViewer_label_length( char *face_path, int fontsize, char *text)
    // num_chars now contains the number of characters in the string.
    
 
-   /* Initialize FT Library object */
+   /* The FT face object (loaded once per font file) */
 
-   error = FT_Init_FreeType( &library );
-
-   if (error)
-   {
-      printf("[struct stat=\"ERROR\", msg=\"FreeType: Could not init Library.\"]\n");
-      exit(1);
-   }
-
-
-   /* Initialize FT face object */
-
-   error = FT_New_Face( library, face_path, 0, &face );
-
-   if (error == FT_Err_Unknown_File_Format)
-   {
-      printf("[struct stat=\"ERROR\", msg=\"FreeType: Font was opened, but type not supported.\"]\n");
-      exit(1);
-   }
-   else if (error)
-   {
-      printf("[struct stat=\"ERROR\", msg=\"FreeType: Could not find or load font file.\"]\n");
-      exit(1);
-   }
+   face = mViewer_fontFace(face_path);
 
 
    /* Set the Char size */
@@ -930,11 +947,6 @@ double mViewer_label_length( char *face_path, int fontsize, char *text)
    }
 
 
-   /* Free the face and the library objects */
-
-   FT_Done_Face    ( face );
-   FT_Done_FreeType( library );
-
    free(ucs4text);
 
    return(string_length);
@@ -0,0 +1,1237 @@
+/* Module: mViewer_png.c
+
+*/
+
+/*************************************************************************/
+/*                                                                       */
+/*  Row-streaming PNG writer for mViewer.                                */
+/*                                                                       */
+/*  lodepng wants the whole RGBA raster in memory before it starts       */
+/*  encoding, which is not possible for very large renders.  This        */
+/*  writer takes the image one row at a time:  each row is filtered      */
+/*  (using whichever of the five PNG filters gives the smallest sum,     */
+/*  the same heuristic lodepng uses), then fed through an LZ77           */
+/*  compressor with a 32K sliding window and one step of lazy matching.  */
+/*  The matches are collected into blocks of BLOCKSYMS symbols and each  */
+/*  block is written with its own (dynamic) Huffman codes.  The output   */
+/*  is split over as many IDAT chunks as needed.  Memory use is a few    */
+/*  rows plus the compression window and one block of symbols.           */
+/*                                                                       */
+/*  The input rows are RGBA like the rest of mViewer but the alpha is    */
+/*  always opaque, so we write RGB.  lodepng picks gray or a palette     */
+/*  after looking at the whole image;  we can't do that, but if the      */
+/*  caller knows the image has no color we write gray, and if every      */
+/*  pixel comes from a (256 entry) color table we write palette indices. */
+/*                                                                       */
+/*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lodepng.h>
+
+#define WSIZE      32768          /* Deflate window                 */
+#define WMASK      (WSIZE-1)
+#define HBITS      15
+#define HSIZE      (1<<HBITS)
+#define MINMATCH   3
+#define MAXMATCH   258
+#define MAXCHAIN   256            /* Longest hash chain we search   */
+#define NICEMATCH  128            /* Stop searching at this length  */
+#define TOOFAR     4096           /* Ignore length 3 matches past   */
+#define OUTSIZE    65536          /* IDAT chunk data size           */
+#define BLOCKSYMS  32768          /* Symbols per deflate block      */
+
+#define LCODES     286            /* Literal/length codes           */
+#define DCODES     30             /* Distance codes                 */
+#define BLCODES    19             /* Code length codes              */
+#define MAXBITS    15             /* Longest literal/distance code  */
+#define MAXBLBITS  7              /* Longest code length code       */
+
+struct mViewerPNG
+{
+   FILE          *fp;
+
+   unsigned       width;
+   unsigned       height;
+   unsigned       nrow;
+
+   int            gray;
+   int            bpp;
+
+   int            npal;
+   unsigned long  palrgb[256];
+   unsigned char  palidx[256];
+
+   unsigned char *prev;
+   unsigned char *filt[5];
+
+   unsigned char  win[2*WSIZE];
+   int            head[HSIZE];
+   int            link[WSIZE];
+   int            nwin;
+   int            pos;
+
+   unsigned long  bitbuf;
+   int            nbits;
+
+   unsigned short lit [BLOCKSYMS];
+   unsigned short dist[BLOCKSYMS];
+   int            nsym;
+
+   unsigned char  out[OUTSIZE];
+   int            nout;
+
+   unsigned long  adler1;
+   unsigned long  adler2;
+
+   int            error;
+};
+
+
+static unsigned long crcTable[256];
+static int           haveCrcTable = 0;
+
+static int lengthBase [29] = {   3,   4,   5,   6,   7,   8,   9,  10,  11,  13,
+                                15,  17,  19,  23,  27,  31,  35,  43,  51,  59,
+                                67,  83,  99, 115, 131, 163, 195, 227, 258 };
+
+static int lengthExtra[29] = {   0,   0,   0,   0,   0,   0,   0,   0,   1,   1,
+                                 1,   1,   2,   2,   2,   2,   3,   3,   3,   3,
+                                 4,   4,   4,   4,   5,   5,   5,   5,   0 };
+
+static int distBase   [30] = {    1,     2,     3,     4,     5,     7,     9,    13,    17,    25,
+                                 33,    49,    65,    97,   129,   193,   257,   385,   513,   769,
+                               1025,  1537,  2049,  3073,  4097,  6145,  8193, 12289, 16385, 24577 };
+
+static int distExtra  [30] = {    0,     0,     0,     0,     1,     1,     2,     2,     3,     3,
+                                  4,     4,     5,     5,     6,     6,     7,     7,     8,     8,
+                                  9,     9,    10,    10,    11,    11,    12,    12,    13,    13 };
+
+static int blOrder    [19] = {   16,    17,    18,     0,     8,     7,     9,     6,    10,     5,
+                                 11,     4,    12,     3,    13,     2,    14,     1,    15 };
+
+
+struct mViewerPNG   *mViewer_pngOpen   (char *filename, unsigned width, unsigned height, int gray, int (*palette)[3], char *comment);
+int                  mViewer_pngRow    (struct mViewerPNG *png, unsigned char *row);
+int                  mViewer_pngClose  (struct mViewerPNG *png);
+
+static unsigned long mViewer_pngCrc    (unsigned long crc, unsigned char *buf, int len);
+static void          mViewer_pngChunk  (struct mViewerPNG *png, char *type, unsigned char *data, int len);
+static void          mViewer_pngPut32  (unsigned char *buf, unsigned long val);
+static void          mViewer_pngBits   (struct mViewerPNG *png, unsigned value, int n);
+static int           mViewer_pngIndex  (struct mViewerPNG *png, unsigned char *pixel);
+static void          mViewer_pngSym    (struct mViewerPNG *png, int lit, int dist);
+static void          mViewer_pngBlock  (struct mViewerPNG *png, int final);
+static void          mViewer_pngLengths(unsigned long *freq, int n, int maxbits, unsigned char *len);
+static void          mViewer_pngCodes  (unsigned char *len, int n, unsigned *code);
+static void          mViewer_pngDeflate(struct mViewerPNG *png, unsigned char *data, int n, int final);
+static void          mViewer_pngAdler  (struct mViewerPNG *png, unsigned char *data, int n);
+static void          mViewer_pngSlide  (struct mViewerPNG *png);
+static int           mViewer_pngFind   (struct mViewerPNG *png, int pos, int *dist);
+static void          mViewer_pngInsert (struct mViewerPNG *png, int pos);
+static void          mViewer_pngLZ77   (struct mViewerPNG *png, int final);
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  Open the file and write everything up to the start   */
+/*  of the image data:  signature, header and the        */
+/*  (XMP) comment.  If 'gray' is set only the first      */
+/*  (red) value of each pixel is written.  Otherwise if  */
+/*  there is a palette (a 256 entry color table) every   */
+/*  pixel must be one of its colors and we write the     */
+/*  index.                                               */
+/*                                                       */
+/*********************************************************/
+
+struct mViewerPNG *mViewer_pngOpen(char *filename, unsigned width, unsigned height, int gray, int (*palette)[3], char *comment)
+{
+   int                i, k, len;
+   unsigned long      rgb;
+   unsigned char      ihdr[13];
+   unsigned char      plte[768];
+   unsigned char     *text, *ztext;
+   size_t             zlen;
+   struct mViewerPNG *png;
+
+   static unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+
+   static char keyword[] = "XML:com.adobe.xmp";
+
+   png = (struct mViewerPNG *)malloc(sizeof(struct mViewerPNG));
+
+   if(png == (struct mViewerPNG *)NULL)
+      return png;
+
+   png->fp = fopen(filename, "wb");
+
+   if(png->fp == (FILE *)NULL)
+   {
+      free(png);
+      return (struct mViewerPNG *)NULL;
+   }
+
+   png->width  = width;
+   png->height = height;
+   png->nrow   = 0;
+   png->error  = 0;
+
+   png->gray   = gray;
+   png->npal   = 0;
+
+   if(!gray && palette != (int (*)[3])NULL)
+      png->npal = 256;
+
+   png->bpp    = (gray || png->npal ? 1 : 3);
+
+   png->prev = (unsigned char *)calloc(png->bpp*width, 1);
+
+   for(i=0; i<5; ++i)
+      png->filt[i] = (unsigned char *)malloc(png->bpp*width + 1);
+
+   for(i=0; i<HSIZE; ++i)
+      png->head[i] = -1;
+
+   for(i=0; i<WSIZE; ++i)
+      png->link[i] = -1;
+
+   png->nwin   = 0;
+   png->pos    = 0;
+   png->bitbuf = 0;
+   png->nbits  = 0;
+   png->nsym   = 0;
+   png->nout   = 0;
+   png->adler1 = 1;
+   png->adler2 = 0;
+
+   fwrite(signature, 1, 8, png->fp);
+
+
+   /* Header: 8-bit gray, RGB or palette, no interlace */
+   /* (mViewer images are always opaque so we drop the  */
+   /* alpha)                                            */
+
+   mViewer_pngPut32(ihdr,   width);
+   mViewer_pngPut32(ihdr+4, height);
+
+   ihdr[ 8] = 8;
+   ihdr[ 9] = (gray ? 0 : (png->npal ? 3 : 2));
+   ihdr[10] = 0;
+   ihdr[11] = 0;
+   ihdr[12] = 0;
+
+   mViewer_pngChunk(png, "IHDR", ihdr, 13);
+
+
+   /* The palette, and a copy of it sorted by */
+   /* color for looking the pixels up         */
+
+   if(png->npal)
+   {
+      for(i=0; i<256; ++i)
+      {
+         plte[3*i  ] = palette[i][0];
+         plte[3*i+1] = palette[i][1];
+         plte[3*i+2] = palette[i][2];
+
+         rgb = ((unsigned long)plte[3*i] << 16) | (plte[3*i+1] << 8) | plte[3*i+2];
+
+         for(k=i; k>0 && png->palrgb[k-1] > rgb; --k)
+         {
+            png->palrgb[k] = png->palrgb[k-1];
+            png->palidx[k] = png->palidx[k-1];
+         }
+
+         png->palrgb[k] = rgb;
+         png->palidx[k] = i;
+      }
+
+      mViewer_pngChunk(png, "PLTE", plte, 768);
+   }
+
+
+   /* Compressed international text chunk, as */
+   /* mViewer_writePNG() (lodepng) makes       */
+
+   if(comment != (char *)NULL)
+   {
+      ztext = (unsigned char *)NULL;
+      zlen  = 0;
+
+      if(lodepng_zlib_compress(&ztext, &zlen, (unsigned char *)comment, strlen(comment),
+                               &lodepng_default_compress_settings) == 0)
+      {
+         len = strlen(keyword) + 5 + zlen;
+
+         text = (unsigned char *)malloc(len);
+
+         strcpy((char *)text, keyword);
+
+         i = strlen(keyword) + 1;
+
+         text[i++] = 1;
+         text[i++] = 0;
+         text[i++] = 0;
+         text[i++] = 0;
+
+         memcpy(text+i, ztext, zlen);
+
+         mViewer_pngChunk(png, "iTXt", text, len);
+
+         free(text);
+      }
+      else
+         png->error = 1;
+
+      free(ztext);
+   }
+
+
+   /* zlib header (the deflate blocks follow */
+   /* as the data comes in)                  */
+
+   mViewer_pngBits(png, 0x78, 8);
+   mViewer_pngBits(png, 0x01, 8);
+
+   return png;
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  Filter and compress one (RGBA) row.                  */
+/*                                                       */
+/*********************************************************/
+
+int mViewer_pngRow(struct mViewerPNG *png, unsigned char *row)
+{
+   int            i, k, n, x, a, b, c, p, pa, pb, pc, best, bpp;
+   unsigned long  sum, bestsum;
+   unsigned char  s;
+   unsigned char *prev;
+
+   if(png->nrow >= png->height)
+      return 1;
+
+   bpp  = png->bpp;
+   n    = bpp * png->width;
+   prev = png->prev;
+
+   for(k=0; k<5; ++k)
+      png->filt[k][0] = k;
+
+   for(i=0; i<n; ++i)
+   {
+      if(png->gray)
+         x = row[4*i];
+      else if(png->npal)
+         x = mViewer_pngIndex(png, row + 4*i);
+      else
+         x = row[i + i/3];
+
+      png->filt[0][i+1] = x;
+   }
+
+   for(i=0; i<n; ++i)
+   {
+      x = png->filt[0][i+1];
+
+      a = (i >= bpp ? png->filt[0][i+1-bpp] : 0);
+      b = prev[i];
+      c = (i >= bpp ? prev[i-bpp] : 0);
+
+      p  = a + b - c;
+      pa = abs(p - a);
+      pb = abs(p - b);
+      pc = abs(p - c);
+
+      if(pa <= pb && pa <= pc)
+         p = a;
+      else if(pb <= pc)
+         p = b;
+      else
+         p = c;
+
+      png->filt[1][i+1] = x - a;
+      png->filt[2][i+1] = x - b;
+      png->filt[3][i+1] = x - ((a + b) >> 1);
+      png->filt[4][i+1] = x - p;
+   }
+
+
+   /* Pick the filter with the smallest sum of */
+   /* absolute (signed) differences            */
+
+   best    = 0;
+   bestsum = 0;
+
+   for(k=0; k<5; ++k)
+   {
+      sum = 0;
+
+      for(i=1; i<=n; ++i)
+      {
+         s = png->filt[k][i];
+
+         sum += (s < 128 ? s : 256 - s);
+      }
+
+      if(k == 0 || sum < bestsum)
+      {
+         best    = k;
+         bestsum = sum;
+      }
+   }
+
+   mViewer_pngDeflate(png, png->filt[best], n+1, 0);
+
+   memcpy(prev, png->filt[0]+1, n);
+
+   ++png->nrow;
+
+   return png->error;
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  Finish the compressed stream and the file.  Returns  */
+/*  non-zero if anything went wrong (including not       */
+/*  getting all the rows).                               */
+/*                                                       */
+/*********************************************************/
+
+int mViewer_pngClose(struct mViewerPNG *png)
+{
+   int           i, error;
+   unsigned char adler[4];
+
+   mViewer_pngDeflate(png, (unsigned char *)NULL, 0, 1);
+
+
+   /* Last block, pad to a byte and add the checksum */
+
+   mViewer_pngBlock(png, 1);
+
+   if(png->nbits > 0)
+      mViewer_pngBits(png, 0, 8 - png->nbits);
+
+   mViewer_pngPut32(adler, (png->adler2 << 16) | png->adler1);
+
+   for(i=0; i<4; ++i)
+      mViewer_pngBits(png, adler[i], 8);
+
+   if(png->nout > 0)
+      mViewer_pngChunk(png, "IDAT", png->out, png->nout);
+
+   mViewer_pngChunk(png, "IEND", (unsigned char *)NULL, 0);
+
+   error = png->error;
+
+   if(png->nrow != png->height)
+      error = 1;
+
+   if(fclose(png->fp))
+      error = 1;
+
+   free(png->prev);
+
+   for(i=0; i<5; ++i)
+      free(png->filt[i]);
+
+   free(png);
+
+   return error;
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  Write a chunk:  length, type, data and the CRC of    */
+/*  the type and data.                                   */
+/*                                                       */
+/*********************************************************/
+
+static void mViewer_pngChunk(struct mViewerPNG *png, char *type, unsigned char *data, int len)
+{
+   unsigned long crc;
+   unsigned char buf[4];
+
+   mViewer_pngPut32(buf, len);
+
+   fwrite(buf, 1, 4, png->fp);
+   fwrite(type, 1, 4, png->fp);
+
+   if(len > 0)
+      fwrite(data, 1, len, png->fp);
+
+   crc = mViewer_pngCrc(0xffffffffUL, (unsigned char *)type, 4);
+
+   if(len > 0)
+      crc = mViewer_pngCrc(crc, data, len);
+
+   mViewer_pngPut32(buf, crc ^ 0xffffffffUL);
+
+   if(fwrite(buf, 1, 4, png->fp) != 4)
+      png->error = 1;
+}
+
+
+static void mViewer_pngPut32(unsigned char *buf, unsigned long val)
+{
+   buf[0] = (val >> 24) & 0xff;
+   buf[1] = (val >> 16) & 0xff;
+   buf[2] = (val >>  8) & 0xff;
+   buf[3] =  val        & 0xff;
+}
+
+
+static unsigned long mViewer_pngCrc(unsigned long crc, unsigned char *buf, int len)
+{
+   int           i, k;
+   unsigned long c;
+
+   if(!haveCrcTable)
+   {
+      for(i=0; i<256; ++i)
+      {
+         c = (unsigned long)i;
+
+         for(k=0; k<8; ++k)
+         {
+            if(c & 1)
+               c = 0xedb88320UL ^ (c >> 1);
+            else
+               c = c >> 1;
+         }
+
+         crcTable[i] = c;
+      }
+
+      haveCrcTable = 1;
+   }
+
+   for(i=0; i<len; ++i)
+      crc = crcTable[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+
+   return crc;
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  Bit-level output (deflate packs bits starting at     */
+/*  the least significant end of each byte).  Full       */
+/*  buffers go out as IDAT chunks.                       */
+/*                                                       */
+/*********************************************************/
+
+static void mViewer_pngBits(struct mViewerPNG *png, unsigned value, int n)
+{
+   png->bitbuf |= (unsigned long)value << png->nbits;
+   png->nbits  += n;
+
+   while(png->nbits >= 8)
+   {
+      png->out[png->nout] = png->bitbuf & 0xff;
+
+      ++png->nout;
+
+      png->bitbuf >>= 8;
+      png->nbits   -= 8;
+
+      if(png->nout == OUTSIZE)
+      {
+         mViewer_pngChunk(png, "IDAT", png->out, png->nout);
+
+         png->nout = 0;
+      }
+   }
+}
+
+
+/* Palette index of an RGB(A) pixel.  A color that isn't */
+/* in the palette is an error (the caller promised).     */
+
+static int mViewer_pngIndex(struct mViewerPNG *png, unsigned char *pixel)
+{
+   int           lo, hi, mid;
+   unsigned long rgb;
+
+   rgb = ((unsigned long)pixel[0] << 16) | (pixel[1] << 8) | pixel[2];
+
+   lo = 0;
+   hi = png->npal - 1;
+
+   while(lo <= hi)
+   {
+      mid = (lo + hi) / 2;
+
+      if(png->palrgb[mid] == rgb)
+         return png->palidx[mid];
+
+      if(png->palrgb[mid] < rgb)
+         lo = mid + 1;
+      else
+         hi = mid - 1;
+   }
+
+   png->error = 1;
+
+   return 0;
+}
+
+
+
+/* Queue a literal (dist == 0) or a length/distance */
+/* pair for the current block                       */
+
+static void mViewer_pngSym(struct mViewerPNG *png, int lit, int dist)
+{
+   png->lit [png->nsym] = lit;
+   png->dist[png->nsym] = dist;
+
+   ++png->nsym;
+
+   if(png->nsym == BLOCKSYMS)
+      mViewer_pngBlock(png, 0);
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  Write out the queued symbols as one deflate block    */
+/*  with Huffman codes built for them:  the block        */
+/*  header, the code lengths (themselves run-length and  */
+/*  Huffman coded), then the data and the end-of-block   */
+/*  code.                                                */
+/*                                                       */
+/*********************************************************/
+
+static void mViewer_pngBlock(struct mViewerPNG *png, int final)
+{
+   int           i, k, sym, len, dist, nlen, nrle, run;
+   int           hlit, hdist, hclen;
+
+   unsigned long lfreq [LCODES];
+   unsigned long dfreq [DCODES];
+   unsigned long blfreq[BLCODES];
+
+   unsigned char llen  [LCODES];
+   unsigned char dlen  [DCODES];
+   unsigned char bllen [BLCODES];
+
+   unsigned      lcode [LCODES];
+   unsigned      dcode [DCODES];
+   unsigned      blcode[BLCODES];
+
+   unsigned char lens  [LCODES+DCODES];
+   unsigned char rle   [LCODES+DCODES];
+   unsigned char rlex  [LCODES+DCODES];
+
+   unsigned char lsym  [BLOCKSYMS];
+   unsigned char dsym  [BLOCKSYMS];
+
+
+   /* Symbol frequencies (the length and distance */
+   /* codes are kept for the output pass)         */
+
+   for(i=0; i<LCODES; ++i) lfreq[i] = 0;
+   for(i=0; i<DCODES; ++i) dfreq[i] = 0;
+
+   for(k=0; k<png->nsym; ++k)
+   {
+      if(png->dist[k] == 0)
+         ++lfreq[png->lit[k]];
+
+      else
+      {
+         len  = png->lit [k];
+         dist = png->dist[k];
+
+         for(i=28; i>0; --i)
+            if(lengthBase[i] <= len)
+               break;
+
+         lsym[k] = i;
+
+         ++lfreq[257 + i];
+
+         for(i=29; i>0; --i)
+            if(distBase[i] <= dist)
+               break;
+
+         dsym[k] = i;
+
+         ++dfreq[i];
+      }
+   }
+
+   lfreq[256] = 1;
+
+   mViewer_pngLengths(lfreq, LCODES, MAXBITS, llen);
+   mViewer_pngLengths(dfreq, DCODES, MAXBITS, dlen);
+
+   mViewer_pngCodes(llen, LCODES, lcode);
+   mViewer_pngCodes(dlen, DCODES, dcode);
+
+
+   /* Run-length code the two sets of code lengths */
+   /* (16: repeat the last length 3-6 times, 17/18: */
+   /* 3-10 or 11-138 zeros)                         */
+
+   hlit = LCODES;
+
+   while(hlit > 257 && llen[hlit-1] == 0)
+      --hlit;
+
+   hdist = DCODES;
+
+   while(hdist > 1 && dlen[hdist-1] == 0)
+      --hdist;
+
+   nlen = 0;
+
+   for(i=0; i<hlit;  ++i) lens[nlen++] = llen[i];
+   for(i=0; i<hdist; ++i) lens[nlen++] = dlen[i];
+
+   nrle = 0;
+
+   for(i=0; i<nlen; i+=run)
+   {
+      run = 1;
+
+      while(i + run < nlen && lens[i+run] == lens[i])
+         ++run;
+
+      if(lens[i] == 0 && run >= 11)
+      {
+         if(run > 138)
+            run = 138;
+
+         rle [nrle] = 18;
+         rlex[nrle] = run - 11;
+         ++nrle;
+      }
+
+      else if(lens[i] == 0 && run >= 3)
+      {
+         rle [nrle] = 17;
+         rlex[nrle] = run - 3;
+         ++nrle;
+      }
+
+      else if(lens[i] != 0 && run >= 4)
+      {
+         if(run > 7)
+            run = 7;
+
+         rle [nrle] = lens[i];
+         rlex[nrle] = 0;
+         ++nrle;
+
+         rle [nrle] = 16;
+         rlex[nrle] = run - 4;
+         ++nrle;
+      }
+
+      else
+      {
+         run = 1;
+
+         rle [nrle] = lens[i];
+         rlex[nrle] = 0;
+         ++nrle;
+      }
+   }
+
+   for(i=0; i<BLCODES; ++i)
+      blfreq[i] = 0;
+
+   for(i=0; i<nrle; ++i)
+      ++blfreq[rle[i]];
+
+   mViewer_pngLengths(blfreq, BLCODES, MAXBLBITS, bllen);
+
+   mViewer_pngCodes(bllen, BLCODES, blcode);
+
+   hclen = BLCODES;
+
+   while(hclen > 4 && bllen[blOrder[hclen-1]] == 0)
+      --hclen;
+
+
+   /* Block header */
+
+   mViewer_pngBits(png, final ? 1 : 0, 1);
+   mViewer_pngBits(png, 2, 2);
+
+   mViewer_pngBits(png, hlit - 257, 5);
+   mViewer_pngBits(png, hdist - 1,  5);
+   mViewer_pngBits(png, hclen - 4,  4);
+
+   for(i=0; i<hclen; ++i)
+      mViewer_pngBits(png, bllen[blOrder[i]], 3);
+
+   for(i=0; i<nrle; ++i)
+   {
+      sym = rle[i];
+
+      mViewer_pngBits(png, blcode[sym], bllen[sym]);
+
+      if(sym == 16) mViewer_pngBits(png, rlex[i], 2);
+      if(sym == 17) mViewer_pngBits(png, rlex[i], 3);
+      if(sym == 18) mViewer_pngBits(png, rlex[i], 7);
+   }
+
+
+   /* And the data */
+
+   for(k=0; k<png->nsym; ++k)
+   {
+      if(png->dist[k] == 0)
+      {
+         sym = png->lit[k];
+
+         mViewer_pngBits(png, lcode[sym], llen[sym]);
+      }
+
+      else
+      {
+         sym = lsym[k];
+
+         mViewer_pngBits(png, lcode[257+sym], llen[257+sym]);
+
+         if(lengthExtra[sym] > 0)
+            mViewer_pngBits(png, png->lit[k] - lengthBase[sym], lengthExtra[sym]);
+
+         sym = dsym[k];
+
+         mViewer_pngBits(png, dcode[sym], dlen[sym]);
+
+         if(distExtra[sym] > 0)
+            mViewer_pngBits(png, png->dist[k] - distBase[sym], distExtra[sym]);
+      }
+   }
+
+   mViewer_pngBits(png, lcode[256], llen[256]);
+
+   png->nsym = 0;
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  Huffman code lengths for a set of symbol             */
+/*  frequencies, no longer than 'maxbits'.  If the       */
+/*  optimal tree is too deep we flatten the frequencies  */
+/*  and try again.  At least two symbols always get a    */
+/*  code, so every code set is complete.                 */
+/*                                                       */
+/*********************************************************/
+
+static void mViewer_pngLengths(unsigned long *freq, int n, int maxbits, unsigned char *len)
+{
+   int           i, k, a, b, nleaf, nnode, depth, maxlen;
+   int           sym   [LCODES];
+   int           parent[2*LCODES];
+   int           active[2*LCODES];
+   unsigned long weight[2*LCODES];
+   unsigned long f     [LCODES];
+
+   nleaf = 0;
+
+   for(i=0; i<n; ++i)
+   {
+      f[i] = freq[i];
+
+      if(f[i] > 0)
+         ++nleaf;
+   }
+
+   for(i=0; i<n && nleaf<2; ++i)
+   {
+      if(f[i] == 0)
+      {
+         f[i] = 1;
+         ++nleaf;
+      }
+   }
+
+   while(1)
+   {
+      nleaf = 0;
+
+      for(i=0; i<n; ++i)
+      {
+         len[i] = 0;
+
+         if(f[i] > 0)
+         {
+            sym   [nleaf] = i;
+            weight[nleaf] = f[i];
+            active[nleaf] = 1;
+
+            ++nleaf;
+         }
+      }
+
+
+      /* Repeatedly merge the two lightest nodes */
+
+      nnode = nleaf;
+
+      for(k=1; k<nleaf; ++k)
+      {
+         a = -1;
+         b = -1;
+
+         for(i=0; i<nnode; ++i)
+         {
+            if(!active[i])
+               continue;
+
+            if(a < 0 || weight[i] < weight[a])
+            {
+               b = a;
+               a = i;
+            }
+            else if(b < 0 || weight[i] < weight[b])
+               b = i;
+         }
+
+         weight[nnode] = weight[a] + weight[b];
+         active[nnode] = 1;
+
+         parent[a] = nnode;
+         parent[b] = nnode;
+
+         active[a] = 0;
+         active[b] = 0;
+
+         ++nnode;
+      }
+
+
+      /* The depth of each leaf is its code length */
+
+      maxlen = 0;
+
+      for(k=0; k<nleaf; ++k)
+      {
+         depth = 0;
+
+         for(i=k; i!=nnode-1; i=parent[i])
+            ++depth;
+
+         len[sym[k]] = depth;
+
+         if(depth > maxlen)
+            maxlen = depth;
+      }
+
+      if(maxlen <= maxbits)
+         break;
+
+      for(i=0; i<n; ++i)
+         if(f[i] > 0)
+            f[i] = (f[i] + 1) / 2;
+   }
+}
+
+
+/* Canonical codes for a set of code lengths (bit-reversed, */
+/* since deflate sends Huffman codes most significant bit   */
+/* first but everything else least significant bit first)   */
+
+static void mViewer_pngCodes(unsigned char *len, int n, unsigned *code)
+{
+   int      i, k;
+   unsigned next[MAXBITS+1], count[MAXBITS+1], c, rev;
+
+   for(i=0; i<=MAXBITS; ++i)
+      count[i] = 0;
+
+   for(i=0; i<n; ++i)
+      ++count[len[i]];
+
+   count[0] = 0;
+
+   c = 0;
+
+   for(i=1; i<=MAXBITS; ++i)
+   {
+      c = (c + count[i-1]) << 1;
+
+      next[i] = c;
+   }
+
+   for(i=0; i<n; ++i)
+   {
+      code[i] = 0;
+
+      if(len[i] == 0)
+         continue;
+
+      c = next[len[i]]++;
+
+      rev = 0;
+
+      for(k=0; k<len[i]; ++k)
+         rev |= ((c >> k) & 1) << (len[i]-1-k);
+
+      code[i] = rev;
+   }
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  Add data to the compression window, compressing as   */
+/*  we go.  Until the last call, we keep at least one    */
+/*  maximum-length match's worth of data in hand.        */
+/*                                                       */
+/*********************************************************/
+
+static void mViewer_pngDeflate(struct mViewerPNG *png, unsigned char *data, int n, int final)
+{
+   int take;
+
+   while(n > 0)
+   {
+      if(png->nwin == 2*WSIZE)
+         mViewer_pngSlide(png);
+
+      take = 2*WSIZE - png->nwin;
+
+      if(take > n)
+         take = n;
+
+      memcpy(png->win + png->nwin, data, take);
+
+      mViewer_pngAdler(png, data, take);
+
+      png->nwin += take;
+
+      data += take;
+      n    -= take;
+
+      mViewer_pngLZ77(png, 0);
+   }
+
+   if(final)
+      mViewer_pngLZ77(png, 1);
+}
+
+
+/* Running Adler-32 checksum of the uncompressed data (the */
+/* sums can go 5552 bytes before they need reducing)       */
+
+static void mViewer_pngAdler(struct mViewerPNG *png, unsigned char *data, int n)
+{
+   int           i, k;
+   unsigned long s1, s2;
+
+   s1 = png->adler1;
+   s2 = png->adler2;
+
+   while(n > 0)
+   {
+      k = (n < 5552 ? n : 5552);
+
+      for(i=0; i<k; ++i)
+      {
+         s1 += data[i];
+         s2 += s1;
+      }
+
+      s1 %= 65521;
+      s2 %= 65521;
+
+      data += k;
+      n    -= k;
+   }
+
+   png->adler1 = s1;
+   png->adler2 = s2;
+}
+
+
+static void mViewer_pngSlide(struct mViewerPNG *png)
+{
+   int i;
+
+   memmove(png->win, png->win + WSIZE, WSIZE);
+
+   png->nwin -= WSIZE;
+   png->pos  -= WSIZE;
+
+   for(i=0; i<HSIZE; ++i)
+      png->head[i] = (png->head[i] >= WSIZE ? png->head[i] - WSIZE : -1);
+
+   for(i=0; i<WSIZE; ++i)
+      png->link[i] = (png->link[i] >= WSIZE ? png->link[i] - WSIZE : -1);
+}
+
+
+#define HASH(p) (((win[p] << 10) ^ (win[(p)+1] << 5) ^ win[(p)+2]) & (HSIZE-1))
+
+
+/* Longest earlier match for the data at 'pos' */
+
+static int mViewer_pngFind(struct mViewerPNG *png, int pos, int *dist)
+{
+   int            avail, maxlen, cand, next, len, bestlen, chain;
+   unsigned char *win;
+
+   win = png->win;
+
+   avail = png->nwin - pos;
+
+   bestlen = 0;
+   *dist   = 0;
+
+   if(avail < MINMATCH)
+      return 0;
+
+   maxlen = avail;
+
+   if(maxlen > MAXMATCH)
+      maxlen = MAXMATCH;
+
+   cand  = png->head[HASH(pos)];
+   chain = MAXCHAIN;
+
+   while(cand >= 0 && pos - cand <= WSIZE && chain > 0)
+   {
+      if(win[cand+bestlen] == win[pos+bestlen])
+      {
+         len = 0;
+
+         while(len < maxlen && win[cand+len] == win[pos+len])
+            ++len;
+
+         if(len > bestlen)
+         {
+            bestlen = len;
+            *dist   = pos - cand;
+
+            if(len >= NICEMATCH || len == maxlen)
+               break;
+         }
+      }
+
+      next = png->link[cand & WMASK];
+
+      if(next >= cand)
+         break;
+
+      cand = next;
+
+      --chain;
+   }
+
+
+   /* A short match a long way back costs */
+   /* more than the literals would        */
+
+   if(bestlen == MINMATCH && *dist > TOOFAR)
+      bestlen = 0;
+
+   return bestlen;
+}
+
+
+static void mViewer_pngInsert(struct mViewerPNG *png, int pos)
+{
+   int            h;
+   unsigned char *win;
+
+   win = png->win;
+
+   if(pos + 2 >= png->nwin)
+      return;
+
+   h = HASH(pos);
+
+   png->link[pos & WMASK] = png->head[h];
+   png->head[h]           = pos;
+}
+
+
+/* Find the matches.  Before taking a match we check whether */
+/* the next position has a longer one;  if so, we send this  */
+/* byte as a literal and take that match instead.            */
+
+static void mViewer_pngLZ77(struct mViewerPNG *png, int final)
+{
+   int pos, end, k;
+   int len, dist, nextpos, nextlen, nextdist;
+
+   pos = png->pos;
+
+   end = png->nwin;
+
+   if(!final)
+      end -= MAXMATCH;
+
+   nextpos  = -1;
+   nextlen  =  0;
+   nextdist =  0;
+
+   while(pos < end)
+   {
+      if(pos == nextpos)
+      {
+         len  = nextlen;
+         dist = nextdist;
+      }
+      else
+         len = mViewer_pngFind(png, pos, &dist);
+
+      mViewer_pngInsert(png, pos);
+
+      if(len >= MINMATCH && len < NICEMATCH && pos + 1 < end)
+      {
+         nextpos = pos + 1;
+         nextlen = mViewer_pngFind(png, nextpos, &nextdist);
+
+         if(nextlen > len)
+         {
+            mViewer_pngSym(png, png->win[pos], 0);
+
+            ++pos;
+
+            continue;
+         }
+      }
+
+      if(len >= MINMATCH)
+      {
+         mViewer_pngSym(png, len, dist);
+
+         for(k=1; k<len; ++k)
+            mViewer_pngInsert(png, pos+k);
+
+         pos += len;
+      }
+      else
+      {
+         mViewer_pngSym(png, png->win[pos], 0);
+
+         ++pos;
+      }
+   }
+
+   png->pos = pos;
+}
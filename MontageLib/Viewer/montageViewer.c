@@ -19,7 +19,10 @@ Version  Developer        Date     Change
 #include <string.h>
 #include <strings.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include <lodepng.h>
 #include <jpeglib.h>
@@ -68,6 +71,18 @@ Version  Developer        Date     Change
 #define FOURCORNERS  0
 #define WCS          1
 
+#define  NTHREAD        4     /* Default number of rendering threads                      */
+#define  BANDROWS     256     /* Image rows read (then rendered in parallel) at a time    */
+#define  STREAMPIX   2.5e8     /* Output pixels above which we always stream the output    */
+
+#define  MAXFILECACHE  64     /* Image files (and HDUs) kept open in batch mode           */
+#define  MAXHISTCACHE   8     /* Image and file histograms kept in batch mode             */
+
+#define  LODLIMIT 100000     /* Catalog sources in view before we switch to density bins */
+#define  LODBIN        8     /* Density bin size (pixels)                                */
+#define  VIEWPAD    0.25     /* Search beyond the view (fraction of view radius) so      */
+                             /* symbols centered just outside the image are included    */
+
 
 
 static char fontfile[1024];
@@ -135,6 +150,22 @@ static char montage_msgstr[1024];
 
 static int debug;
 
+static int nthread;
+static int defaultThreads = NTHREAD;
+
+static int batchCache;
+
+static int stream;
+static int band0, bandny;
+
+static int ovlyimin, ovlyimax;
+static int ovlyjmin, ovlyjmax;
+
+static struct mViewerStretch grayStretch;
+static struct mViewerStretch redStretch;
+static struct mViewerStretch greenStretch;
+static struct mViewerStretch blueStretch;
+
 
 /*-***************************************************************************/
 /*                                                                           */
@@ -176,9 +207,10 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
 
    char     *checkHdr;
 
-   int       i, j, k, ipix, index, itemp, nowcs, ref, istatus;
+   int       i, j, k, itemp, nowcs, ref, istatus;
    int       istart, iend;
    int       jstart, jend, jinc;
+   int       jj0, nrow, nband;
    int       nullcnt;
    int       keysexist, keynum;
    int       datatype;
@@ -187,6 +219,12 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
    double    ix, iy;
    double    xpos, ypos;
 
+   struct mViewerBand band;
+
+   struct mViewerPNG *pngStream = (struct mViewerPNG *)NULL;
+
+   int       pngGray;
+
    int       grayType  = 0;
    int       redType   = 0;
    int       greenType = 0;
@@ -245,6 +283,9 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
 
       char   labelColumn[MAXSTR];     // Column containing label string
       double fontscale;
+
+      int    lodLimit;                // Max symbols in view before drawing density instead
+      int    lodBin;                  // Density bin size in pixels
    };
 
    struct catInfo cat[MAXCAT];
@@ -297,6 +338,7 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
 
    int       csys, symUnits, symNPnt, symNMax, symType, scaleType;
    double    epoch, symSize, symRotAngle, scaleVal, fontScale, fontSize;
+   int       lodLimit, lodBin;
 
    char      symSizeColumn [MAXSTR];
    char      symShapeColumn[MAXSTR];
@@ -309,6 +351,14 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
    double    charHeight, pixScale;
 
    int       ncol, ira, idec, stat;
+
+   struct montage_tableIndex *ovlyIndex;
+
+   char      idxfile[MAXSTR];
+   long      ncand, icand, npts;
+   long     *cand, *candoff;
+   double    capx, capy, capz, capRadius, symRadius;
+   double   *xyz;
    int       iscale, ilabel, icolor, isymsize, isymshape;
    double    ra, dec, flux;
 
@@ -362,8 +412,6 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
    double    median, sigma;
 
    double    graydiff, reddiff, greendiff, bluediff;
-   double    grayval, redval, greenval, blueval;
-   double    grayImVal, redImVal, greenImVal, blueImVal, maxImVal;
 
    double    redxoff, greenxoff, bluexoff;
    double    redyoff, greenyoff, blueyoff;
@@ -583,6 +631,12 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
 
    fontScale   = 1.;
 
+   lodLimit    = LODLIMIT;
+   lodBin      = LODBIN;
+
+   nthread     = defaultThreads;
+   stream      = 0;
+
    strcpy(symSizeColumn,  "");
    strcpy(symShapeColumn, "");
    strcpy(scaleColumn,    "");
@@ -621,12 +675,19 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
    flipX  = 0;
    flipY  = 0;
 
+   outType = PNG;
+   jpegfp  = (FILE *)NULL;
+
    if(strcmp(outFmt, "png") == 0)
       strcpy(pngfile, outFile);
 
    if(strcmp(outFmt, "jpeg") == 0)
+   {
       strcpy(jpegfile, outFile);
 
+      outType = JPEG;
+   }
+
    if(debug)
    {
       printf("DEBUG> mode = %d\n", mode);
@@ -703,6 +764,29 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
       }
 
 
+      /* STREAMING OUTPUT */
+
+      if(json_val(cmdstr, "stream", valstr))
+      {
+         if(strcasecmp(valstr, "true") == 0 || strcmp(valstr, "1") == 0)
+            stream = 1;
+      }
+
+
+      /* RENDERING THREADS */
+
+      if(json_val(cmdstr, "threads", valstr))
+      {
+         nthread = strtol(valstr, &end, 0);
+
+         if(nthread < 1 || end < valstr+strlen(valstr))
+         {
+            strcpy(returnStruct->msg, "Thread count must be a positive integer.");
+            return returnStruct;
+         }
+      }
+
+
       /* COORDINATE SYSTEM */
 
       if(json_val(cmdstr, "coord_sys", valstr))
@@ -743,7 +827,7 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
 
          if(!nowcs)
          {
-            checkHdr = montage_checkHdr(grayfile, 0, hdu);
+            checkHdr = mViewer_checkHdr(grayfile, hdu);
 
             if(checkHdr)
             {
@@ -800,7 +884,7 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
          }
 
 
-         if(fits_open_file(&grayfptr, grayfile, READONLY, &status))
+         if(mViewer_openFile(&grayfptr, grayfile, hdu, &status))
          {
             sprintf(returnStruct->msg, "Image file %s invalid FITS", grayfile);
             return returnStruct;
@@ -835,7 +919,7 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
 
          if(!nowcs)
          {
-            checkHdr = montage_checkHdr(redfile, 0, hdu);
+            checkHdr = mViewer_checkHdr(redfile, hdu);
 
             if(checkHdr)
             {
@@ -892,7 +976,7 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
          }
 
 
-         if(fits_open_file(&redfptr, redfile, READONLY, &status))
+         if(mViewer_openFile(&redfptr, redfile, hdu, &status))
          {
             sprintf(returnStruct->msg, "Image file %s invalid FITS", redfile);
             return returnStruct;
@@ -927,7 +1011,7 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
 
          if(!nowcs)
          {
-            checkHdr = montage_checkHdr(greenfile, 0, hdu);
+            checkHdr = mViewer_checkHdr(greenfile, hdu);
 
             if(checkHdr)
             {
@@ -984,7 +1068,7 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
          }
 
 
-         if(fits_open_file(&greenfptr, greenfile, READONLY, &status))
+         if(mViewer_openFile(&greenfptr, greenfile, hdu, &status))
          {
             sprintf(returnStruct->msg, "Image file %s invalid FITS", greenfile);
             return returnStruct;
@@ -1019,7 +1103,7 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
 
          if(!nowcs)
          {
-            checkHdr = montage_checkHdr(bluefile, 0, hdu);
+            checkHdr = mViewer_checkHdr(bluefile, hdu);
 
             if(checkHdr)
             {
@@ -1076,7 +1160,7 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
          }
 
 
-         if(fits_open_file(&bluefptr, bluefile, READONLY, &status))
+         if(mViewer_openFile(&bluefptr, bluefile, hdu, &status))
          {
             sprintf(returnStruct->msg, "Image file %s invalid FITS", bluefile);
             return returnStruct;
@@ -1323,6 +1407,23 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
             if(json_val(cmdstr, keystr, valstr))
                strcpy(cat[ncat].colorColumn, valstr);
 
+
+            sprintf(keystr, "overlays[%d].lod_limit", noverlay);  // Check for density switch-over count
+
+            cat[ncat].lodLimit = LODLIMIT;
+            if(json_val(cmdstr, keystr, valstr))
+               cat[ncat].lodLimit = atoi(valstr);
+
+
+            sprintf(keystr, "overlays[%d].lod_bin", noverlay);  // Check for density bin size
+
+            cat[ncat].lodBin = LODBIN;
+            if(json_val(cmdstr, keystr, valstr))
+               cat[ncat].lodBin = atoi(valstr);
+
+            if(cat[ncat].lodBin < 1)
+               cat[ncat].lodBin = 1;
+
             ++ncat;
          }
 
@@ -1373,6 +1474,9 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
 
             strcpy(cat[ncat].file, valstr);
 
+            cat[ncat].lodLimit = 0;
+            cat[ncat].lodBin   = LODBIN;
+
             ++ncat;
          }
 
@@ -1645,6 +1749,69 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
          }
          
 
+         /* STREAMING OUTPUT (BOUNDED MEMORY) */
+
+         else if(strcmp(argv[i], "-stream") == 0)
+            stream = 1;
+
+
+         /* RENDERING THREADS */
+
+         else if(strcmp(argv[i], "-threads") == 0)
+         {
+            if(i+1 >= argc)
+            {
+               strcpy(returnStruct->msg, "No count given for -threads.");
+               return returnStruct;
+            }
+
+            nthread = strtol(argv[i+1], &end, 0);
+
+            if(nthread < 1 || end < (argv[i+1] + (int)strlen(argv[i+1])))
+            {
+               strcpy(returnStruct->msg, "Thread count must be a positive integer.");
+               return returnStruct;
+            }
+
+            ++i;
+         }
+         
+
+         /* CATALOG DENSITY (LEVEL OF DETAIL) */
+
+         else if(strcmp(argv[i], "-lod") == 0)
+         {
+            if(i+1 >= argc)
+            {
+               strcpy(returnStruct->msg, "No symbol count given for -lod.");
+               return returnStruct;
+            }
+
+            lodLimit = strtol(argv[i+1], &end, 0);
+
+            if(end < (argv[i+1] + (int)strlen(argv[i+1])) || lodLimit < 0)
+            {
+               strcpy(returnStruct->msg, "Invalid -lod symbol count (must be a non-negative integer; 0 turns density mode off)");
+               return returnStruct;
+            }
+
+            ++i;
+
+            if(i+1 < argc && argv[i+1][0] != '-')
+            {
+               lodBin = strtol(argv[i+1], &end, 0);
+
+               if(end < (argv[i+1] + (int)strlen(argv[i+1])) || lodBin < 1)
+               {
+                  strcpy(returnStruct->msg, "Invalid -lod bin size (must be a positive integer number of pixels)");
+                  return returnStruct;
+               }
+
+               ++i;
+            }
+         }
+
+
          /* OVERLAY COLOR */
 
          else if(strcmp(argv[i], "-color") == 0)
@@ -2164,6 +2331,9 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
 
             cat[ncat].fontscale = fontScale;
 
+            cat[ncat].lodLimit = lodLimit;
+            cat[ncat].lodBin   = lodBin;
+
             ++ncat;
          }
 
@@ -2243,6 +2413,9 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
             strcpy(cat[ncat].symSizeColumn,  "");
             strcpy(cat[ncat].symShapeColumn, "");
 
+            cat[ncat].lodLimit = 0;
+            cat[ncat].lodBin   = LODBIN;
+
             ++ncat;
 
             ++i;
@@ -2293,7 +2466,7 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
 
             if(!nowcs)
             {
-               checkHdr = montage_checkHdr(grayfile, 0, hdu);
+               checkHdr = mViewer_checkHdr(grayfile, hdu);
  
                if(checkHdr)
                {
@@ -2382,7 +2555,7 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
             }
 
 
-            if(fits_open_file(&grayfptr, grayfile, READONLY, &status))
+            if(mViewer_openFile(&grayfptr, grayfile, hdu, &status))
             {
                sprintf(returnStruct->msg, "Image file %s invalid FITS", grayfile);
                return returnStruct;
@@ -2422,7 +2595,7 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
 
             if(!nowcs)
             {
-               checkHdr = montage_checkHdr(redfile, 0, hdu);
+               checkHdr = mViewer_checkHdr(redfile, hdu);
  
                if(checkHdr)
                {
@@ -2511,7 +2684,7 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
                i += 2;
             }
 
-            if(fits_open_file(&redfptr, redfile, READONLY, &status))
+            if(mViewer_openFile(&redfptr, redfile, hdu, &status))
             {
                sprintf(returnStruct->msg, "Image file %s invalid FITS", redfile);
                return returnStruct;
@@ -2551,7 +2724,7 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
 
             if(!nowcs)
             {
-               checkHdr = montage_checkHdr(greenfile, 0, hdu);
+               checkHdr = mViewer_checkHdr(greenfile, hdu);
  
                if(checkHdr)
                {
@@ -2640,7 +2813,7 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
                i += 2;
             }
 
-            if(fits_open_file(&greenfptr, greenfile, READONLY, &status))
+            if(mViewer_openFile(&greenfptr, greenfile, hdu, &status))
             {
                sprintf(returnStruct->msg, "Image file %s invalid FITS", greenfile);
                return returnStruct;
@@ -2680,7 +2853,7 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
 
             if(!nowcs)
             {
-               checkHdr = montage_checkHdr(bluefile, 0, hdu);
+               checkHdr = mViewer_checkHdr(bluefile, hdu);
  
                if(checkHdr)
                {
@@ -2768,7 +2941,7 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
                i += 2;
             }
 
-            if(fits_open_file(&bluefptr, bluefile, READONLY, &status))
+            if(mViewer_openFile(&bluefptr, bluefile, hdu, &status))
             {
                sprintf(returnStruct->msg, "Image file %s invalid FITS", bluefile);
                return returnStruct;
@@ -2869,7 +3042,7 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
 
       greenlogpower = redlogpower;
 
-      fits_open_file(&greenfptr, greenfile, READONLY, &status);
+      mViewer_openFile(&greenfptr, greenfile, redhdu, &status);
 
       if(redhdu > 0)
          fits_movabs_hdu(greenfptr, redhdu+1, NULL, &status);
@@ -3014,6 +3187,17 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
       return returnStruct;
    }
 
+   if(outType == JPEG && jpegfp == (FILE *)NULL)
+   {
+      jpegfp = fopen(jpegfile, "w+");
+
+      if(jpegfp == (FILE *)NULL)
+      {
+         snprintf(returnStruct->msg, sizeof(returnStruct->msg), "Error opening output file '%.990s'", jpegfile);
+         return returnStruct;
+      }
+   }
+
 
    /***************************/
    /* Set up pseudocolor info */
@@ -3717,6 +3901,18 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
 
 
 
+      /* How much of the output image we keep in memory at */
+      /* once:  all of it, or (when streaming) one band     */
+
+      if((double)nx * (double)ny > STREAMPIX)
+         stream = 1;
+
+      bandny = ny;
+
+      if(stream && bandny > BANDROWS)
+         bandny = BANDROWS;
+
+
       /* Set up the JPEG library info  */
       /* and start the JPEG compressor */
 
@@ -3747,7 +3943,7 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
 
       else if(outType == PNG)
       {
-         membytes = 4 * nx * ny;
+         membytes = 4 * nx * bandny;
 
          pngData = (unsigned char *)malloc(membytes * sizeof(unsigned char));
          pngOvly = (unsigned char *)malloc(membytes * sizeof(unsigned char));
@@ -3797,19 +3993,15 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
 
       nelements = naxis1;
 
-      rfitsbuf = (double *)malloc(nelements * sizeof(double));
-      gfitsbuf = (double *)malloc(nelements * sizeof(double));
-      bfitsbuf = (double *)malloc(nelements * sizeof(double));
-
       if(outType == JPEG)
       {
-         jpegData = (JSAMPROW *)malloc(ny * sizeof (JSAMPROW));
-         jpegOvly = (JSAMPROW *)malloc(ny * sizeof (JSAMPROW));
+         jpegData = (JSAMPROW *)malloc(bandny * sizeof (JSAMPROW));
+         jpegOvly = (JSAMPROW *)malloc(bandny * sizeof (JSAMPROW));
       }
 
-      ovlymask = (double  **)malloc(ny * sizeof (double *));
+      ovlymask = (double  **)malloc(bandny * sizeof (double *));
 
-      for(jj=0; jj<ny; ++jj)
+      for(jj=0; jj<bandny; ++jj)
       {
          if(outType == JPEG)
          {
@@ -3820,1776 +4012,3020 @@ struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFm
          ovlymask[jj] = (double *)malloc(nelements * sizeof(double));
       }
 
-      for(jj=0; jj<ny; ++jj)
-      {
-         for(i=0; i<nelements; ++i)
-         {
-            rfitsbuf[i] = mynan;
-            gfitsbuf[i] = mynan;
-            bfitsbuf[i] = mynan;
 
-            if(outType == JPEG)
-            {
-               jpegData[jj][3*i  ] = 0;
-               jpegData[jj][3*i+1] = 0;
-               jpegData[jj][3*i+2] = 0;
+      /* The stretch for each color, in the form */
+      /* the rendering threads use               */
 
-               jpegOvly[jj][3*i  ] = 0;
-               jpegOvly[jj][3*i+1] = 0;
-               jpegOvly[jj][3*i+2] = 0;
-            }
+      mViewer_setStretch(&redStretch,   redType,   redlogpower,   redminval,   redmaxval,
+                         reddiff,   redbetaval,   reddataval,   0,        redxoff,   rednaxis1);
 
-            ovlymask[jj][i] = 0.;
-         }
+      mViewer_setStretch(&greenStretch, greenType, greenlogpower, greenminval, greenmaxval,
+                         greendiff, greenbetaval, greendataval, greenOff, greenxoff, greennaxis1);
 
-         j = jstart + jj*jinc;
+      mViewer_setStretch(&blueStretch,  blueType,  bluelogpower,  blueminval,  bluemaxval,
+                         bluediff,  bluebetaval,  bluedataval,  0,        bluexoff,  bluenaxis1);
 
+      band.color     = 1;
+      band.istart    = istart;
+      band.truecolor = truecolor;
 
-         /* Read red */
+      band.red   = (double **)malloc(BANDROWS * sizeof(double *));
+      band.green = (double **)malloc(BANDROWS * sizeof(double *));
+      band.blue  = (double **)malloc(BANDROWS * sizeof(double *));
 
-         if(j - redyoff >= 0 && j - redyoff < rednaxis2)
-         {
-            fpixelRed[1] = j - redyoff + 1;
+      for(k=0; k<BANDROWS; ++k)
+      {
+         band.red  [k] = (double *)malloc(nelements * sizeof(double));
+         band.green[k] = (double *)malloc(nelements * sizeof(double));
+         band.blue [k] = (double *)malloc(nelements * sizeof(double));
+      }
+   }
 
-            if(fits_read_pix(redfptr, TDOUBLE, fpixelRed, rednaxis1, &mynan,
-                             rfitsbuf, &nullcnt, &status))
-               mViewer_printFitsError(status);
-         }
 
+   /* Grayscale/pseudocolor mode */
 
-         /* Read green */
+   else
+   {
+      if(debug)
+      {
+         printf("DEBUG> Processing Gray mode\n");
+         fflush(stdout);
+      }
 
-         if(j - greenyoff >= 0 && j - greenyoff < greennaxis2)
-         {
-            fpixelGreen[1] = j - greenyoff + 1;
+      /* First make sure that the WCS info is OK */
 
-            if(fits_read_pix(greenfptr, TDOUBLE, fpixelGreen, greennaxis1, &mynan,
-                             gfitsbuf, &nullcnt, &status))
-               mViewer_printFitsError(status);
-         }
+      if(strlen(grayfile) == 0)
+      {
+         strcpy(returnStruct->msg, "Grayscale/pseudocolor mode but no gray image given");
+         return returnStruct;
+      }
 
+      if(fits_get_hdrpos(grayfptr, &keysexist, &keynum, &status))
+         mViewer_printFitsError(status);
+
+      status = 0;
+      if(fits_get_hdrpos(grayfptr, &keysexist, &keynum, &status))
 
-         /* Read blue */
+      status = 0;
+      fits_read_key(grayfptr, TSTRING, "BUNIT", bunit, (char *)NULL, &status);
 
-         if(j - blueyoff >= 0 && j - blueyoff < bluenaxis2)
-         {
-            fpixelBlue[1] = j - blueyoff + 1;
+      if(status == KEY_NO_EXIST)
+         strcpy(bunit, "");
 
-            if(fits_read_pix(bluefptr, TDOUBLE, fpixelBlue, bluenaxis1, &mynan,
-                             bfitsbuf, &nullcnt, &status))
-               mViewer_printFitsError(status);
-         }
+      header  = malloc(keysexist * 80 + 1024);
+      comment = malloc(keysexist * 80 + 1024);
 
+      status = 0;
+      if(fits_get_image_wcs_keys(grayfptr, &header, &status))
+         mViewer_printFitsError(status);
 
-         /* Look up pixel color values */
+      wcs = wcsinit(header);
 
-         for(i=0; i<nx; ++i)
+      if(wcs == (struct WorldCoor *)NULL)
+      {
+         if(nowcs)
          {
+            status = 0;
+            if(fits_read_key(grayfptr, TLONG, "NAXIS1", &naxis1, (char *)NULL, &status))
+               mViewer_printFitsError(status);
 
-            /* RED */
-
-            ipix = i + istart - redxoff;
+            status = 0;
+            if(fits_read_key(grayfptr, TLONG, "NAXIS2", &naxis2, (char *)NULL, &status))
+               mViewer_printFitsError(status);
 
-            if(ipix < 0 || ipix >= rednaxis1)
-               redval = mynan;
-            else
-               redval = rfitsbuf[ipix];
+            wcs = mViewer_wcsfake(naxis1, naxis2);
+         }
+         else
+         {
+            sprintf(returnStruct->msg, "WCS init failed for [%s].", grayfile);
+            return returnStruct;
+         }
+      }
 
+      if(!nowcs)
+         montage_checkWCS(wcs);
 
-            /* Special case: blank pixel */
+      naxis1 = wcs->nxpix;
+      naxis2 = wcs->nypix;
 
-            if(mNaN(redval))
-               redImVal = 0.;
+      crval1 = wcs->xpos;
+      crval2 = wcs->ypos;
 
+      crpix1 = wcs->xrefpix;
+      crpix2 = wcs->yrefpix;
 
-            /* Gaussian histogram equalization */
+      xinc   = wcs->xinc;
+      yinc   = wcs->yinc;
+      cdelt1 = wcs->cdelt[0];
+      cdelt2 = wcs->cdelt[1];
+      cd11   = wcs->cd[0];
+      cd12   = wcs->cd[1];
+      cd21   = wcs->cd[2];
+      cd22   = wcs->cd[3];
+      crota2 = wcs->rot;
 
-            else if(redType == GAUSSIAN
-                 || redType == GAUSSIANLOG)
-            {
-               for(index=0; index<256; ++index)
-               {
-                  if(reddataval[index] >= redval)
-                     break;
-               }
+      if(wcs->syswcs == WCS_J2000)
+      {
+         csysimg  = EQUJ;
+         epochimg = 2000.;
 
-               if(index <   0) index =   0;
-               if(index > 255) index = 255;
+         if(wcs->equinox == 1950.)
+            epochimg = 1950;
+      }
+      else if(wcs->syswcs == WCS_B1950)
+      {
+         csysimg  = EQUB;
+         epochimg = 1950.;
 
-               redImVal = index;
-            }
+         if(wcs->equinox == 2000.)
+            epochimg = 2000.;
+      }
+      else if(wcs->syswcs == WCS_GALACTIC)
+      {
+         csysimg  = GAL;
+         epochimg = 2000.;
+      }
+      else if(wcs->syswcs == WCS_ECLIPTIC)
+      {
+         csysimg  = ECLJ;
+         epochimg = 2000.;
 
+         if(wcs->equinox == 1950.)
+         {
+            csysimg  = ECLB;
+            epochimg = 1950.;
+         }
+      }
+      else
+      {
+         csysimg  = EQUJ;
+         epochimg = 2000.;
+      }
 
-            /* ASIHN stretch */
+      if(debug)
+      {
+         printf("\nGray image:\n");
+         printf("naxis1   = %d\n", (int)wcs->nxpix);
+         printf("naxis2   = %d\n", (int)wcs->nypix);
+         printf("crval1   = %.6f\n", wcs->xpos);
+         printf("crval2   = %.6f\n", wcs->ypos);
+         printf("crpix1   = %.6f\n", wcs->xrefpix);
+         printf("crpix2   = %.6f\n", wcs->yrefpix);
+         printf("xinc     = %.6f\n", wcs->xinc);
+         printf("yinc     = %.6f\n", wcs->yinc);
+         printf("crota2   = %.6f\n", wcs->rot);
+         printf("csysimg  = %d\n",   csysimg);
+         printf("epochimg = %-g\n",  epochimg);
+         printf("\n");
 
-            else if(redType == ASINH)
-            {
-               redImVal  = (redval - redminval)/(redmaxval - redminval);
+         fflush(stdout);
+      }
 
-               if(redImVal < 0.0)
-                  redImVal = 0.;
-               else
-                  redImVal = 255. * asinh(redbetaval * redImVal)/redbetaval;
 
-               if(redImVal < 0.)
-                  redImVal = 0.;
+      /* Kludge to get around bug in WCS library:   */
+      /* 360 degrees sometimes added to pixel coord */
 
-               if(redImVal > 255.)
-                  redImVal = 255.;
+      ix = 0.5;
+      iy = 0.5;
 
-               index = (int)(redImVal+0.5);
-            }
+      pix2wcs(wcs, ix, iy, &xpos, &ypos);
 
+      offscl = wcs->offscl;
 
-            /* Finally, log power (including linear) */
+      x = 0.;
+      y = 0.;
+      
+      if(!offscl)
+         wcs2pix(wcs, xpos, ypos, &x, &y, &offscl);
 
+      xcorrection = x-ix;
+      ycorrection = y-iy;
+
+      if(offscl || mNaN(x) || mNaN(y))
+      {
+         xcorrection = 0.;
+         ycorrection = 0.;
+      }
+
+
+      if(debug)
+      {
+         printf("\n");
+         printf("DEBUG> GRAY: naxis1 = %d\n" , naxis1);
+         printf("DEBUG> GRAY: naxis2 = %d\n",  naxis2);
+         printf("DEBUG> GRAY: xinc   = %-g\n", xinc);
+         printf("DEBUG> GRAY: yinc   = %-g\n", yinc);
+         printf("DEBUG> GRAY: crota2 = %-g\n", crota2);
+         fflush(stdout);
+      }
+
+      if(!noflip)
+      {
+         if(xinc > 0)
+           flipX = 1;
+
+         if(yinc > 0)
+           flipY = 1;
+
+         if(fabs(crota2) >  90.
+         && fabs(crota2) < 270.)
+         {
+            flipX = 1 - flipX;
+            flipY = 1 - flipY;
+
+            crota2 = crota2 + 180;
+
+            while(crota2 > 360) crota2 -= 360.;
+         }
+
+         if(wcs->coorflip)
+            flipX = 1 - flipX;
+
+         if(flipX)
+         {
+           cdelt1 = -cdelt1;
+           cd11   = -cd11;
+           cd21   = -cd21;
+         }
+
+         if(flipY)
+         {
+           cdelt2 = -cdelt2;
+           cd12   = -cd12;
+           cd22   = -cd22;
+         }
+      }
+
+      mViewer_vamp_comment(comment);
+
+
+      /* Now adjust the data range if the limits */
+      /* were percentiles.  We had to wait until */
+      /* we had naxis1, naxis2 which is why this */
+      /* is here                                 */
+
+      if(debug)
+         printf("\n GRAY RANGE:\n");
+
+      if(strlen(grayhistfile) > 0)
+      {
+         if(mViewer_readHist(grayhistfile, &grayminval,  &graymaxval, graydataval, 
+                             &graydatamin, &graydatamax, &median, &sigma, &grayType))
+         {
+            strcpy(returnStruct->msg, montage_msgstr);
+            return returnStruct;
+         }
+      }
+      else
+      {
+         if(mViewer_getRange( grayfptr,        grayminstr,  graymaxstr, 
+                             &grayminval,     &graymaxval,  grayType, 
+                              graybetastr,    &graybetaval, graydataval,
+                              naxis1,          naxis2,
+                             &graydatamin,    &graydatamax,
+                             &median,         &sigma,
+                              grayPlaneCount,  grayPlanes))
+         {
+            strcpy(returnStruct->msg, montage_msgstr);
+            return returnStruct;
+         }
+      }
+
+      grayminpercent = mViewer_valuePercentile(grayminval);
+      graymaxpercent = mViewer_valuePercentile(graymaxval);
+
+      grayminsigma = (grayminval - median) / sigma;
+      graymaxsigma = (graymaxval - median) / sigma;
+
+      graydiff = graymaxval - grayminval;
+
+      if(debug)
+      {
+         printf("DEBUG> grayminval = %-g (%-g%%/%-gs)\n", grayminval, grayminpercent, grayminsigma);
+         printf("DEBUG> graymaxval = %-g (%-g%%/%-gs)\n", graymaxval, graymaxpercent, graymaxsigma);
+         printf("DEBUG> graydiff   = %-g\n", graydiff);
+         fflush(stdout);
+      }
+
+
+      /* Figure out which set of pixels to use */
+      /* and what order to read them in        */
+
+      istart = 0;
+      iend   = naxis1 - 1;
+      nx     = naxis1;
+
+      if(outType == JPEG && naxis1 > MAXDIM)
+      {
+         istart = (naxis1 - MAXDIM)/2;
+         iend   = istart + MAXDIM - 1;
+         nx     = MAXDIM;
+      }
+
+      jstart = 0;
+      jend   = naxis2 - 1;
+      ny     = naxis2;
+      jinc   = 1;
+
+      if(outType == JPEG && naxis2 > MAXDIM)
+      {
+         jstart = (naxis2 - MAXDIM)/2;
+         jend   = istart + MAXDIM - 2;
+         ny     = MAXDIM;
+      }
+
+      if(flipY)
+      {
+         itemp  = jstart;
+         jstart = jend;
+         jend   = itemp;
+         jinc   = -1;
+      }
+
+      if(debug)
+      {
+         printf("\n");
+         printf("DEBUG> nx               = %d\n", nx);
+         printf("DEBUG> istart           = %d\n", istart);
+         printf("DEBUG> iend             = %d\n", iend);
+         printf("DEBUG> flipX            = %d\n", flipX);
+         printf("\n");
+         printf("DEBUG> ny               = %d\n", ny);
+         printf("DEBUG> jstart           = %d\n", jstart);
+         printf("DEBUG> jend             = %d\n", jend);
+         printf("DEBUG> jinc             = %d\n", jinc);
+         printf("DEBUG> flipY            = %d\n", flipY);
+         fflush(stdout);
+      }
+
+
+      /* How much of the output image we keep in memory at */
+      /* once:  all of it, or (when streaming) one band     */
+
+      if((double)nx * (double)ny > STREAMPIX)
+         stream = 1;
+
+      bandny = ny;
+
+      if(stream && bandny > BANDROWS)
+         bandny = BANDROWS;
+
+
+      /* Set up the JPEG library info  */
+      /* and start the JPEG compressor */
+
+      if(outType == JPEG)
+      {
+         cinfo.err = jpeg_std_error(&jerr);
+
+         jpeg_create_compress(&cinfo);
+
+         jpeg_stdio_dest(&cinfo, jpegfp);
+
+         cinfo.image_width      = nx;
+         cinfo.image_height     = ny;
+         cinfo.input_components = 3;
+         cinfo.in_color_space = JCS_RGB;
+
+         jpeg_set_defaults(&cinfo);
+
+         quality = 85;
+
+         jpeg_set_quality (&cinfo, quality, TRUE);
+
+         jpeg_start_compress(&cinfo, TRUE);
+
+         jpeg_write_marker(&cinfo, JPEG_COM, 
+            (const JOCTET *)comment, strlen(comment));
+      }
+
+
+      /* Now, loop over the part of the image we want */
+
+      fpixelGray[0] = istart+1;
+      fpixelGray[2] = 1;
+      fpixelGray[3] = 1;
+
+      if(grayPlaneCount > 1)
+         fpixelGray[2] = grayPlanes[1];
+      if(grayPlaneCount > 2)
+         fpixelGray[3] = grayPlanes[2];
+
+      nelements = nx;
+
+      fitsbuf = (double *)NULL;
+
+      if(outType == JPEG)
+      {
+         jpegData = (JSAMPROW *)malloc(bandny * sizeof (JSAMPROW));
+         jpegOvly = (JSAMPROW *)malloc(bandny * sizeof (JSAMPROW));
+      }
+
+      else if(outType == PNG)
+      {
+         membytes = 4 * nx * bandny;
+
+         pngData = (unsigned char *)malloc(membytes * sizeof(unsigned char));
+         pngOvly = (unsigned char *)malloc(membytes * sizeof(unsigned char));
+
+         for(ii=0; ii<membytes; ++ii)
+         {
+            pngData[ii] = 0;
+            pngOvly[ii] = 0;
+         }
+      }
+      
+      if(debug)
+      {
+         printf("Image (PNG/JPEG) space allocated\n");
+         fflush(stdout);
+      }
+
+      ovlymask = (double  **)malloc(bandny * sizeof (double *));
+
+      for(jj=0; jj<bandny; ++jj)
+      {
+         if(outType == JPEG)
+         {
+            jpegData[jj] = (JSAMPROW)malloc(3*nelements);
+            jpegOvly[jj] = (JSAMPROW)malloc(3*nelements);
+         }
+
+         ovlymask[jj] = (double *)malloc(nelements * sizeof(double));
+      }
+
+      mViewer_setStretch(&grayStretch, grayType, graylogpower, grayminval, graymaxval,
+                         graydiff, graybetaval, graydataval, 0, 0., 0);
+
+      band.color     = 0;
+      band.istart    = istart;
+      band.truecolor = 0.;
+
+      band.gray = (double **)malloc(BANDROWS * sizeof(double *));
+
+      for(k=0; k<BANDROWS; ++k)
+         band.gray[k] = (double *)malloc(nelements * sizeof(double));
+   }
+
+
+   /* Overlay graphics sizes (the overlays themselves are  */
+   /* drawn into each band of the image as it is rendered) */
+
+   charHeight = 0.0025 * ny * fabs(cdelt2);
+   pixScale   = fabs(cdelt2);
+
+   if(nx * fabs(cdelt1) > ny * fabs(cdelt2))
+   {
+      charHeight = 0.0025 * nx * fabs(cdelt1);
+      pixScale   = fabs(cdelt1);
+   }
+
+
+   /* Now read and render the image a band of rows at a time (the reads */
+   /* are serial, the rendering of each band is spread over threads),   */
+   /* add the overlays and write the rows out.  Unless we are streaming */
+   /* the "output band" is the whole image and the PNG is written at    */
+   /* the end.                                                          */
+
+   if(outType == PNG && stream)
+   {
+      /* If neither the image nor any of the overlays  */
+      /* can have color, we can write a gray PNG.  If  */
+      /* there are no overlays, a pseudocolor image    */
+      /* only uses the colors in the color table.      */
+
+      pngGray = !isRGB;
+
+      for(i=0; i<256; ++i)
+      {
+         if(color_table[i][1] != color_table[i][0]
+         || color_table[i][2] != color_table[i][0])
+            pngGray = 0;
+      }
+
+      for(i=0; i<ngrid; ++i)
+      {
+         if(grid[i].green != grid[i].red || grid[i].blue != grid[i].red)
+            pngGray = 0;
+      }
+
+      for(i=0; i<ncat; ++i)
+      {
+         if(cat[i].green != cat[i].red || cat[i].blue != cat[i].red
+         || strlen(cat[i].colorColumn) > 0)
+            pngGray = 0;
+      }
+
+      for(i=0; i<nmark; ++i)
+      {
+         if(mark[i].green != mark[i].red || mark[i].blue != mark[i].red)
+            pngGray = 0;
+      }
+
+      for(i=0; i<nlabel; ++i)
+      {
+         if(label[i].green != label[i].red || label[i].blue != label[i].red)
+            pngGray = 0;
+      }
+
+      if(!isRGB && ngrid + ncat + nmark + nlabel == 0)
+         pngStream = mViewer_pngOpen(pngfile, nx, ny, pngGray, color_table, comment);
+      else
+         pngStream = mViewer_pngOpen(pngfile, nx, ny, pngGray, (int (*)[3])NULL, comment);
+
+      if(pngStream == (struct mViewerPNG *)NULL)
+      {
+         snprintf(returnStruct->msg, sizeof(returnStruct->msg), "Error opening output file '%.990s'", pngfile);
+         return returnStruct;
+      }
+   }
+
+   for(band0=0; band0<ny; band0+=bandny)
+   {
+      nband = bandny;
+
+      if(band0 + nband > ny)
+         nband = ny - band0;
+
+      if(outType == PNG)
+      {
+         for(ii=0; ii<4*nx*nband; ++ii)
+         {
+            pngData[ii] = 0;
+            pngOvly[ii] = 0;
+         }
+      }
+
+      ovlyimin = nx;
+      ovlyimax = -1;
+      ovlyjmin = bandny;
+      ovlyjmax = -1;
+
+      for(jj0=band0; jj0<band0+nband; jj0+=BANDROWS)
+      {
+         nrow = BANDROWS;
+
+         if(jj0 + nrow > band0 + nband)
+            nrow = band0 + nband - jj0;
+
+         for(k=0; k<nrow; ++k)
+         {
+            jj = jj0 + k - band0;
+
+            for(i=0; i<nx; ++i)
+            {
+               if(outType == JPEG)
+               {
+                  jpegData[jj][3*i  ] = 0;
+                  jpegData[jj][3*i+1] = 0;
+                  jpegData[jj][3*i+2] = 0;
+
+                  jpegOvly[jj][3*i  ] = 0;
+                  jpegOvly[jj][3*i+1] = 0;
+                  jpegOvly[jj][3*i+2] = 0;
+               }
+
+               ovlymask[jj][i] = 0.;
+            }
+
+            j = jstart + (jj0 + k)*jinc;
+
+            if(isRGB)
+            {
+               rfitsbuf = band.red  [k];
+               gfitsbuf = band.green[k];
+               bfitsbuf = band.blue [k];
+
+               for(i=0; i<nelements; ++i)
+               {
+                  rfitsbuf[i] = mynan;
+                  gfitsbuf[i] = mynan;
+                  bfitsbuf[i] = mynan;
+               }
+
+
+               /* Read red */
+
+               if(j - redyoff >= 0 && j - redyoff < rednaxis2)
+               {
+                  fpixelRed[1] = j - redyoff + 1;
+
+                  if(fits_read_pix(redfptr, TDOUBLE, fpixelRed, rednaxis1, &mynan,
+                                   rfitsbuf, &nullcnt, &status))
+                     mViewer_printFitsError(status);
+               }
+
+
+               /* Read green */
+
+               if(j - greenyoff >= 0 && j - greenyoff < greennaxis2)
+               {
+                  fpixelGreen[1] = j - greenyoff + 1;
+
+                  if(fits_read_pix(greenfptr, TDOUBLE, fpixelGreen, greennaxis1, &mynan,
+                                   gfitsbuf, &nullcnt, &status))
+                     mViewer_printFitsError(status);
+               }
+
+
+               /* Read blue */
+
+               if(j - blueyoff >= 0 && j - blueyoff < bluenaxis2)
+               {
+                  fpixelBlue[1] = j - blueyoff + 1;
+
+                  if(fits_read_pix(bluefptr, TDOUBLE, fpixelBlue, bluenaxis1, &mynan,
+                                   bfitsbuf, &nullcnt, &status))
+                     mViewer_printFitsError(status);
+               }
+            }
+
+            else
+            {
+               fitsbuf = band.gray[k];
+
+               for(i=0; i<nelements; ++i)
+                  fitsbuf[i] = mynan;
+
+               fpixelGray[1] = j+1;
+
+               if(fits_read_pix(grayfptr, TDOUBLE, fpixelGray, nelements, &mynan,
+                                fitsbuf, &nullcnt, &status))
+                  mViewer_printFitsError(status);
+            }
+         }
+
+         mViewer_renderBand(&band, jj0, nrow);
+      }
+
+
+      /* Draw the overlays.  The drawing routines only touch the rows of */
+      /* this band (see mViewer_setPixel()), so when streaming we simply */
+      /* draw everything again for each band.                            */
+
+      for(i=0; i<ngrid; ++i)
+      {
+         mViewer_makeGrid(wcs, csysimg, epochimg, 
+                          grid[i].csys, grid[i].epoch, grid[i].red, grid[i].green, grid[i].blue,  
+                          fontfile, grid[i].fontscale);
+         mViewer_addOverlay();
+      }
+
+
+      for(i=0; i<ncat; ++i)
+      {
+         /* If there is a spatial index for the table, */
+         /* we only need to read the records in view.  */
+         /* If there are more catalog sources in view  */
+         /* than we want to draw, we bin them instead  */
+         /* (using just the locations in the index).   */
+
+         ncand   = -1;
+         icand   =  0;
+         cand    = (long *)NULL;
+         candoff = (long *)NULL;
+
+         ovlyIndex = (struct montage_tableIndex *)NULL;
+
+         if(snprintf(idxfile, MAXSTR, "%s.vidx", cat[i].file) < MAXSTR)
+         {
+            if(cat[i].isImgInfo)
+               ovlyIndex = montage_indexOpen(idxfile, cat[i].file, "mViewerImgInfo");
             else
+               ovlyIndex = montage_indexOpen(idxfile, cat[i].file, "mViewer");
+         }
+
+         if(ovlyIndex)
+         {
+            mViewer_viewCap(csysimg, epochimg, cat[i].csys, cat[i].epoch, &capx, &capy, &capz, &capRadius);
+
+
+            /* Catalog symbols are drawn around their sources, so */
+            /* sources up to a symbol radius outside the view can */
+            /* still draw into it.  This is the same size the     */
+            /* drawing code below uses for unscaled symbols.      */
+
+            if(cat[i].isImgInfo == 0)
+            {
+               symRadius = cat[i].symSize;
+
+               if(cat[i].symUnits == FRACTIONAL)
+                  symRadius = symRadius * charHeight;
+
+               else if(cat[i].symUnits == SECONDS)
+                  symRadius = symRadius / 3600.;
+
+               else if(cat[i].symUnits == MINUTES)
+                  symRadius = symRadius / 60.;
+
+               else if(cat[i].symUnits == PIXELS)
+                  symRadius = symRadius * pixScale;
+
+               if(symRadius < 0.1*charHeight)
+                  symRadius = 0.1*charHeight;
+
+               capRadius += symRadius;
+
+               if(capRadius > 90.)
+                  capRadius = 180.;
+            }
+
+            ncand = montage_indexSearch(ovlyIndex, capx, capy, capz, capRadius, &cand, &candoff);
+
+            if(debug)
+            {
+               printf("DEBUG> Index %s: %ld of %ld records in view\n", idxfile, ncand, montage_indexCount(ovlyIndex));
+               fflush(stdout);
+            }
+
+            if(cat[i].isImgInfo == 0 && cat[i].lodLimit > 0 && ncand > cat[i].lodLimit)
+            {
+               npts = montage_indexPoints(ovlyIndex, capx, capy, capz, capRadius, &xyz);
+
+               mViewer_drawDensity(xyz, npts, csysimg, epochimg, cat[i].csys, cat[i].epoch,
+                                   cat[i].lodBin, cat[i].red, cat[i].green, cat[i].blue);
+
+               free(xyz);
+               free(cand);
+               free(candoff);
+
+               montage_indexClose(ovlyIndex);
+
+               mViewer_addOverlay();
+
+               continue;
+            }
+
+            montage_indexClose(ovlyIndex);
+
+
+            /* Symbols scaled by a table column can be any size; */
+            /* the largest isn't known without reading the whole */
+            /* table, so in that case we read it all after all.  */
+
+            if(cat[i].isImgInfo == 0 && strlen(cat[i].scaleColumn) > 0)
+            {
+               free(cand);
+               free(candoff);
+
+               ncand   = -1;
+               cand    = (long *)NULL;
+               candoff = (long *)NULL;
+            }
+         }
+
+         if(cat[i].isImgInfo == 0) /* CATALOG */
+         {
+            ncol = topen(cat[i].file);
+
+            if(ncol <= 0)
+            {
+               sprintf(returnStruct->msg, "Invalid table file [%s].", cat[i].file);
+               return returnStruct;
+            }
+
+            ira  = tcol("ra");
+            idec = tcol("dec");
+
+            if(ira  < 0) ira  = tcol("lon");
+            if(idec < 0) idec = tcol("lat");
+
+            if(ira < 0 || idec < 0)
+            {
+               sprintf(returnStruct->msg, "Cannot find 'ra' and 'dec (or 'lon','lat') in table [%s]", cat[i].file);
+               return returnStruct;
+            }
+
+
+            // Scaling 
+
+            iscale = -1;
+
+            if(strlen(cat[i].scaleColumn) > 0)
+            {
+               iscale = tcol(cat[i].scaleColumn);
+
+               if(iscale < 0)
+               {
+                  sprintf(returnStruct->msg, "Cannot find flux/mag column [%s] in table [%s]", cat[i].scaleColumn, cat[i].file);
+                  return returnStruct;
+               }
+            }
+
+         
+            // Color
+
+            icolor = -1;
+
+            if(strlen(cat[i].colorColumn) > 0)
+            {
+               icolor = tcol(cat[i].colorColumn);
+
+               if(icolor < 0)
+               {
+                  sprintf(returnStruct->msg, "Cannot find color column [%s] in table [%s]", cat[i].colorColumn, cat[i].file);
+                  return returnStruct;
+               }
+            }
+
+
+            // Symbol size
+
+            isymsize = -1;
+
+            if(strlen(cat[i].symSizeColumn) > 0)
+            {
+               isymsize = tcol(cat[i].symSizeColumn);
+
+               if(isymsize < 0)
+               {
+                  sprintf(returnStruct->msg, "Cannot find symbol size column [%s] in table [%s]", cat[i].symSizeColumn, cat[i].file);
+                  return returnStruct;
+               }
+            }
+
+
+            // Symbol shape
+
+            isymshape = -1;
+
+            if(strlen(cat[i].symShapeColumn) > 0)
+            {
+               isymshape = tcol(cat[i].symShapeColumn);
+
+               if(isymshape < 0)
+               {
+                  sprintf(returnStruct->msg, "Cannot find symbol shape column [%s] in table [%s]", cat[i].symShapeColumn, cat[i].file);
+                  return returnStruct;
+               }
+            }
+
+
+            // Label
+
+            ilabel = -1;
+
+            if(strlen(cat[i].labelColumn) > 0)
+            {
+               ilabel = tcol(cat[i].labelColumn);
+
+               if(ilabel < 0)
+               {
+                  sprintf(returnStruct->msg, "Cannot find label column [%s] in table [%s]", cat[i].labelColumn, cat[i].file);
+                  return returnStruct;
+               }
+            }
+
+
+            // Read through the file (or just the indexed records in view)
+
+            while(1)
+            {
+               if(ncand >= 0)
+               {
+                  if(icand >= ncand)
+                     break;
+
+                  tseekpos(candoff[icand]);
+
+                  ++icand;
+               }
+
+               stat = tread();
+
+               if(stat < 0)
+                  break;
+
+               if(tnull(ira) || tnull(idec))
+                  continue;
+
+
+               // Read location 
+
+               ra  = atof(tval(ira));
+               dec = atof(tval(idec));
+
+               if(iscale < 0)
+                  flux = cat[i].symSize;
+               else
+               {
+                  flux = atof(tval(iscale));
+
+                  if(tnull(iscale))
+                     continue;
+               }
+
+
+               // Read color
+
+               ovlyred   = cat[i].red;
+               ovlygreen = cat[i].green;
+               ovlyblue  = cat[i].blue;
+
+               if(icolor >= 0)
+               {
+                  if(!tnull(icolor))
+                  {
+                     strcpy(colorstr, tval(icolor));
+
+                     if(mViewer_colorLookup(colorstr, &ovlyred, &ovlygreen, &ovlyblue))
+                     {
+                        strcpy(returnStruct->msg, montage_msgstr);
+                        return returnStruct;
+                     }
+                  }
+               }
+
+
+               // Read symbol size
+
+               symSize  = cat[i].symSize;
+               symUnits = cat[i].symUnits;
+
+               if(isymsize >= 0)
+               {
+                  if(!tnull(isymsize))
+                  {
+                     strcpy(symbolstr, tval(isymsize));
+
+                     ptr = symbolstr + strlen(symbolstr) - 1;
+
+                     symUnits = FRACTIONAL;
+
+                     if(*ptr == 's')
+                        symUnits = SECONDS;
+
+                     else if(*ptr == 'm')
+                        symUnits = MINUTES;
+
+                     else if(*ptr == 'd')
+                        symUnits = DEGREES;
+
+                     else if(*ptr == 'p')
+                        symUnits = PIXELS;
+
+                     if(symUnits != FRACTIONAL)
+                        *ptr = '\0';
+
+                     symSize = strtod(symbolstr, &end);
+
+
+                     // If this fails, revert to default values
+
+                     if(end < (symbolstr + (int)strlen(symbolstr)) || symSize <= 0.)
+                     {
+                        symSize  = cat[i].symSize;
+                        symUnits = cat[i].symUnits;
+                     }
+                  }
+               }
+
+
+               // Read symbol shape
+
+               symNPnt     = cat[i].symNPnt;
+               symType     = cat[i].symType;
+               symRotAngle = cat[i].symRotAngle;
+
+               if(isymshape >= 0)
+               {
+                  if(!tnull(isymshape))
+                  {
+                     strcpy(symbolstr, tval(isymshape));
+
+                     istatus = mViewer_parseSymbol(symbolstr, &symNPnt, &symNMax, &symType, &symRotAngle);
+
+                     if(istatus)
+                     {
+                        symNPnt     = cat[i].symNPnt;
+                        symNMax     = cat[i].symNMax;
+                        symType     = cat[i].symType;
+                        symRotAngle = cat[i].symRotAngle;
+                     }
+                  }
+               }
+
+
+
+               if(debug)
+                  printf("Symbol: color=(%4.2f,%4.2f,%4.2f) shape=(%2d,%d,%6.2f) at (%6.2f,%6.2f) flux=%10.6f->", 
+                     ovlyred, ovlygreen, ovlyblue, symNPnt, symType, symRotAngle, ra, dec, flux);
+
+
+               // Process scaling information
+
+               if(iscale >= 0)
+               {
+                  if(cat[i].scaleType == FLUX)
+                     flux = flux / cat[i].scaleVal * cat[i].symSize;
+                  else if(cat[i].scaleType == MAG)
+                     flux = (cat[i].scaleVal - flux + 1) * cat[i].symSize;
+                  else if(cat[i].scaleType == LOGFLUX)
+                     flux = log10(10. * flux / cat[i].scaleVal) * cat[i].symSize;
+               }
+
+
+               if(cat[i].symUnits == FRACTIONAL)
+                   flux = flux * charHeight;
+
+                else if(cat[i].symUnits == SECONDS)
+                   flux = flux / 3600.;
+        
+                else if(cat[i].symUnits == MINUTES)
+                   flux = flux / 60.;
+ 
+                else if(cat[i].symUnits == DEGREES)
+                   flux = flux * 1.;
+
+               else if(cat[i].symUnits == PIXELS)
+                  flux = flux * pixScale;
+
+
+               if(flux < 0.1*charHeight)
+                  flux = 0.1*charHeight;
+
+               if(debug)
+               {
+                  printf("%10.6f\n", flux);
+                  fflush(stdout);
+               }
+
+
+               // Draw symbol
+
+               if(symSize > 0)
+               {
+                  mViewer_symbol(wcs, flipY, csysimg, epochimg, cat[i].csys, cat[i].epoch,
+                                 ra, dec, 0, flux, symNPnt, symNMax, symType, symRotAngle, 
+                                 ovlyred, ovlygreen, ovlyblue);
+
+                  if(debug)
+                  {
+                     printf("Symbol drawn.\n");
+                     fflush(stdout);
+                  }
+               }
+               else
+               {
+                  if(debug)
+                  {
+                     printf("Symbol not drawn.\n");
+                     fflush(stdout);
+                  }
+               }
+
+
+               // Write label
+
+               if(ilabel >= 0)
+               {
+                  strcpy(labelstr, tval(ilabel));
+
+                  if(strlen(labelstr) > 0)
+                  {
+                     wcs2pix(wcs, ra, dec, &xpix, &ypix, &offscl);
+
+                     fontSize = (int)(14. * cat[i].fontscale);
+
+                     if(fontSize < 1)
+                        fontSize = 1;
+
+                     mViewer_draw_label(fontfile, fontSize, xpix, ypix, labelstr, ovlyred, ovlygreen, ovlyblue);
+                  }
+
+                  if(debug)
+                  {
+                     printf("Label [%s] at (%-g,%-g)\n", labelstr, xpix, ypix);
+                     fflush(stdout);
+                  }
+               }
+            }
+
+            tclose();
+         }
+
+         else /* IMAGE INFO */
+         {
+            ncol = topen(cat[i].file);
+
+            if(ncol <= 0)
+            {
+               sprintf(returnStruct->msg, "Invalid table file [%s].\" ]\n", cat[i].file);
+               return returnStruct;
+            }
+         
+
+            // Color
+
+            icolor = -1;
+
+            if(strlen(cat[i].colorColumn) > 0)
+            {
+               icolor = tcol(cat[i].colorColumn);
+
+               if(icolor < 0)
+               {
+                  sprintf(returnStruct->msg, "Cannot find color column [%s] in table [%s]", cat[i].colorColumn, cat[i].file);
+                  return returnStruct;
+               }
+            }
+
+
+            // Find corner-related information
+
+            ira1  = tcol("ra1");
+            idec1 = tcol("dec1");
+            ira2  = tcol("ra2");
+            idec2 = tcol("dec2");
+            ira3  = tcol("ra3");
+            idec3 = tcol("dec3");
+            ira4  = tcol("ra4");
+            idec4 = tcol("dec4");
+
+            datatype = FOURCORNERS;
+
+            if(ira1 < 0 || idec1 < 0
+            || ira2 < 0 || idec2 < 0
+            || ira3 < 0 || idec3 < 0
+            || ira4 < 0 || idec4 < 0)
+            {
+               ictype1  = tcol("ctype1");
+               ictype2  = tcol("ctype2");
+               iequinox = tcol("equinox");
+               inl      = tcol("nl");
+               ins      = tcol("ns");
+               icrval1  = tcol("crval1");
+               icrval2  = tcol("crval2");
+               icrpix1  = tcol("crpix1");
+               icrpix2  = tcol("crpix2");
+               icdelt1  = tcol("cdelt1");
+               icdelt2  = tcol("cdelt2");
+               icrota2  = tcol("crota2");
+
+               if(ins < 0)
+                  ins = tcol("naxis1");
+
+               if(inl < 0)
+                  inl = tcol("naxis2");
+
+               if(ictype1 >= 0
+               && ictype2 >= 0
+               && inl     >= 0
+               && ins     >= 0
+               && icrval1 >= 0
+               && icrval2 >= 0
+               && icrpix1 >= 0
+               && icrpix2 >= 0
+               && icdelt1 >= 0
+               && icdelt2 >= 0
+               && icrota2 >= 0)
+
+                  datatype = WCS;
+
+               else
+               {
+                  sprintf(returnStruct->msg, "Cannot find 'ra1', 'dec1', etc. corners or WCS columns in table [%s]\n", cat[i].file);
+                  return returnStruct;
+               }
+            }
+
+            nimages = 0;
+
+            while(1)
             {
-               if(redval < redminval)
-                  redval = redminval;
+               if(ncand >= 0)
+               {
+                  if(icand >= ncand)
+                     break;
+
+                  tseekpos(candoff[icand]);
+
+                  ++icand;
+               }
+
+               stat = tread();
+
+               ++nimages;
+
+               if(stat < 0)
+                  break;
+
+
+               ovlyred   = cat[i].red;
+               ovlygreen = cat[i].green;
+               ovlyblue  = cat[i].blue;
+
+               if(icolor >= 0)
+               {
+                  if(!tnull(icolor))
+                  {
+                     strcpy(colorstr, tval(icolor));
+
+                     if(mViewer_colorLookup(colorstr, &ovlyred, &ovlygreen, &ovlyblue))
+                     {
+                        strcpy(returnStruct->msg, montage_msgstr);
+                        return returnStruct;
+                     }
+                  }
+               }
+
+
+               if(datatype == FOURCORNERS)
+               {
+                  if(tnull(ira1) || tnull(idec1)
+                  || tnull(ira2) || tnull(idec2)
+                  || tnull(ira3) || tnull(idec3)
+                  || tnull(ira4) || tnull(idec4))
+                     continue;
+
+                  ra1  = atof(tval(ira1));
+                  dec1 = atof(tval(idec1));
+                  ra2  = atof(tval(ira2));
+                  dec2 = atof(tval(idec2));
+                  ra3  = atof(tval(ira3));
+                  dec3 = atof(tval(idec3));
+                  ra4  = atof(tval(ira4));
+                  dec4 = atof(tval(idec4));
+               }
+               else
+               {
+                  strcpy(im_ctype1, tval(ictype1));
+                  strcpy(im_ctype2, tval(ictype2));
+
+                  im_naxis1    = atoi(tval(ins));
+                  im_naxis2    = atoi(tval(inl));
+                  im_crpix1    = atof(tval(icrpix1));
+                  im_crpix2    = atof(tval(icrpix2));
+                  im_crval1    = atof(tval(icrval1));
+                  im_crval2    = atof(tval(icrval2));
+                  im_cdelt1    = atof(tval(icdelt1));
+                  im_cdelt2    = atof(tval(icdelt2));
+                  im_crota2    = atof(tval(icrota2));
+                  im_equinox   = 2000;
+
+                  if(iequinox >= 0)
+                     im_equinox = atoi(tval(iequinox));
+
+                  strcpy(im_header, "");
+                  sprintf(temp, "SIMPLE  = T"                 ); mViewer_stradd(im_header, temp);
+                  sprintf(temp, "BITPIX  = -64"               ); mViewer_stradd(im_header, temp);
+                  sprintf(temp, "NAXIS   = 2"                 ); mViewer_stradd(im_header, temp);
+                  sprintf(temp, "NAXIS1  = %d",     im_naxis1 ); mViewer_stradd(im_header, temp);
+                  sprintf(temp, "NAXIS2  = %d",     im_naxis2 ); mViewer_stradd(im_header, temp);
+                  sprintf(temp, "CTYPE1  = '%s'",   im_ctype1 ); mViewer_stradd(im_header, temp);
+                  sprintf(temp, "CTYPE2  = '%s'",   im_ctype2 ); mViewer_stradd(im_header, temp);
+                  sprintf(temp, "CRVAL1  = %11.6f", im_crval1 ); mViewer_stradd(im_header, temp);
+                  sprintf(temp, "CRVAL2  = %11.6f", im_crval2 ); mViewer_stradd(im_header, temp);
+                  sprintf(temp, "CRPIX1  = %11.6f", im_crpix1 ); mViewer_stradd(im_header, temp);
+                  sprintf(temp, "CRPIX2  = %11.6f", im_crpix2 ); mViewer_stradd(im_header, temp);
+                  sprintf(temp, "CDELT1  = %14.9f", im_cdelt1 ); mViewer_stradd(im_header, temp);
+                  sprintf(temp, "CDELT2  = %14.9f", im_cdelt2 ); mViewer_stradd(im_header, temp);
+                  sprintf(temp, "CROTA2  = %11.6f", im_crota2 ); mViewer_stradd(im_header, temp);
+                  sprintf(temp, "EQUINOX = %d",     im_equinox); mViewer_stradd(im_header, temp);
+                  sprintf(temp, "END"                         ); mViewer_stradd(im_header, temp);
+
+                  im_wcs = wcsinit(im_header);
+
+                  if(im_wcs == (struct WorldCoor *)NULL)
+                  {
+                     sprintf(returnStruct->msg, "Bad WCS for image %d", nimages);
+                     return returnStruct;
+                  }
+
+                  montage_checkWCS(im_wcs);
+
+
+                  /* Get the coordinate system and epoch in a     */
+                  /* form compatible with the conversion library  */
+
+                  if(im_wcs->syswcs == WCS_J2000)
+                  {
+                     im_sys   = EQUJ;
+                     im_epoch = 2000.;
+
+                     if(im_wcs->equinox == 1950)
+                        im_epoch = 1950.;
+                  }
+                  else if(im_wcs->syswcs == WCS_B1950)
+                  {
+                     im_sys   = EQUB;
+                     im_epoch = 1950.;
+
+                     if(im_wcs->equinox == 2000)
+                        im_epoch = 2000;
+                  }
+                  else if(im_wcs->syswcs == WCS_GALACTIC)
+                  {
+                     im_sys   = GAL;
+                     im_epoch = 2000.;
+                  }
+                  else if(im_wcs->syswcs == WCS_ECLIPTIC)
+                  {
+                     im_sys   = ECLJ;
+                     im_epoch = 2000.;
+
+                     if(im_wcs->equinox == 1950)
+                     {
+                        im_sys   = ECLB;
+                        im_epoch = 1950.;
+                     }
+                  }
+                  else
+                  {
+                     im_sys   = EQUJ;
+                     im_epoch = 2000.;
+                  }
+
+
+                  /* Compute the locations of the corners of the images */
+
+                  pix2wcs(im_wcs, 0.5, 0.5, &xpos, &ypos);
 
-               if(redval > redmaxval)
-                  redval = redmaxval;
+                  convertCoordinates(im_sys, im_epoch, xpos, ypos,
+                                     EQUJ, 2000., &ra1, &dec1, 0.0);
 
-               redImVal = (redval - redminval)/reddiff;
+                  pix2wcs(im_wcs, im_naxis1+0.5, 0.5, &xpos, &ypos);
 
-               for(k=0; k<redlogpower; ++k)
-                  redImVal = log(9.*redImVal+1.);
-               
-               redImVal = 255. * redImVal;
-            }
+                  convertCoordinates(im_sys, im_epoch, xpos, ypos,
+                                     EQUJ, 2000., &ra2, &dec2, 0.0);
 
-            if(redImVal < 0.)
-               redImVal = 0.;
+                  pix2wcs(im_wcs, im_naxis1+0.5, im_naxis2+0.5, &xpos, &ypos);
 
+                  convertCoordinates(im_sys, im_epoch, xpos, ypos,
+                                     EQUJ, 2000., &ra3, &dec3, 0.0);
 
+                  pix2wcs(im_wcs, 0.5, im_naxis2+0.5, &xpos, &ypos);
 
-            /* GREEN */
+                  convertCoordinates(im_sys, im_epoch, xpos, ypos,
+                                     EQUJ, 2000., &ra4, &dec4, 0.0);
+               }
 
-            ipix = i + istart - greenxoff;
+               mViewer_great_circle(wcs, flipY, csysimg, epochimg, cat[i].csys, cat[i].epoch, ra1, dec1, ra2, dec2, ovlyred, ovlygreen, ovlyblue);
+               mViewer_great_circle(wcs, flipY, csysimg, epochimg, cat[i].csys, cat[i].epoch, ra2, dec2, ra3, dec3, ovlyred, ovlygreen, ovlyblue);
+               mViewer_great_circle(wcs, flipY, csysimg, epochimg, cat[i].csys, cat[i].epoch, ra3, dec3, ra4, dec4, ovlyred, ovlygreen, ovlyblue);
+               mViewer_great_circle(wcs, flipY, csysimg, epochimg, cat[i].csys, cat[i].epoch, ra4, dec4, ra1, dec1, ovlyred, ovlygreen, ovlyblue);
+            }
 
-            if(ipix < 0 || ipix >= greennaxis1)
-               greenval = mynan;
-            else
-               greenval = gfitsbuf[ipix];
+            tclose();
+         }
 
+         free(cand);
+         free(candoff);
 
-            /* Special case: blank pixel */
+         mViewer_addOverlay();
+      }
 
-            if(mNaN(greenval))
-               greenImVal = 0.;
 
+      for(i=0; i<nmark; ++i)
+      {
+         flux = mark[i].symSize;
 
-            /* Special case: blank pixel */
+         if(mark[i].symUnits == FRACTIONAL)
+            flux = flux * charHeight;
 
-            else if(greenOff)
-               greenImVal = 0.;
+         else if(mark[i].symUnits == SECONDS)
+            flux = flux / 3600.;
+ 
+         else if(mark[i].symUnits == MINUTES)
+            flux = flux / 60.;
+ 
+         else if(mark[i].symUnits == DEGREES)
+            flux = flux * 1.;
+ 
+         else if(mark[i].symUnits == PIXELS)
+            flux = flux * pixScale;
+ 
+         mViewer_symbol(wcs, flipY, csysimg, epochimg, mark[i].csys, mark[i].epoch,
+                        mark[i].ra, mark[i].dec, mark[i].inpix, flux, 
+                        mark[i].symNPnt, mark[i].symNMax, mark[i].symType, mark[i].symRotAngle, 
+                        mark[i].red, mark[i].green, mark[i].blue);
 
+         mViewer_addOverlay();
+      }
 
-            /* Gaussian histogram equalization */
 
-            else if(greenType == GAUSSIAN
-                 || greenType == GAUSSIANLOG)
-            {
-               for(index=0; index<256; ++index)
-               {
-                  if(greendataval[index] >= greenval)
-                     break;
-               }
+      for(i=0; i<nlabel; ++i)
+      {
+         if(label[i].inpix == 0)
+         {
+            ra  = label[i].x;
+            dec = label[i].y;
 
-               if(index <   0) index =   0;
-               if(index > 255) index = 255;
+            wcs2pix(wcs, ra, dec, &xpix, &ypix, &offscl);
 
-               greenImVal = index;
-            }
+            label[i].x = xpix;
+            label[i].y = ypix;
 
-            /* ASIHN stretch */
+            label[i].inpix = 1;
 
-            else if(greenType == ASINH)
+            if(debug)
             {
-               greenImVal  = (greenval - greenminval)/(greenmaxval - greenminval);
+               printf("DEBUG> label [%s]: (%-g,%-g) -> (%-g,%-g)\n", label[i].text, ra, dec, label[i].x, label[i].y);
+               fflush(stdout);
+            }
+         }
 
-               if(greenImVal < 0.0)
-                  greenImVal = 0.;
-               else
-                  greenImVal = 255. * asinh(greenbetaval * greenImVal)/greenbetaval;
+         ix = label[i].x;
+         iy = label[i].y;
 
-               if(greenImVal < 0.)
-                  greenImVal = 0.;
+         fontSize = (int)(14. * label[i].fontscale);
 
-               if(greenImVal > 255.)
-                  greenImVal = 255.;
+         if(fontSize < 1)
+            fontSize = 1;
 
-               index = (int)(greenImVal+0.5);
-            }
+         mViewer_draw_label(fontfile, fontSize, ix, iy, label[i].text, label[i].red, label[i].green, label[i].blue);
+         mViewer_addOverlay();
+      }
 
 
-            /* Finally, log power (including linear) */
+      /* Write data to JPEG file */
+         
+      if(outType == JPEG)
+      {
+         for(jj=0; jj<nband; ++jj)
+         {
+            jpegptr = (JSAMPARRAY) &jpegData[jj];
 
-            else
-            {
-               if(greenval < greenminval)
-                  greenval = greenminval;
+            jpeg_write_scanlines(&cinfo, jpegptr, 1);
+         }
+      }
 
-               if(greenval > greenmaxval)
-                  greenval = greenmaxval;
+      else if(outType == PNG && stream)
+      {
+         for(jj=0; jj<nband; ++jj)
+            mViewer_pngRow(pngStream, pngData + 4 * nx * jj);
+      }
+   }
 
-               greenImVal = (greenval - greenminval)/greendiff;
+   for(k=0; k<BANDROWS; ++k)
+   {
+      if(isRGB)
+      {
+         free(band.red  [k]);
+         free(band.green[k]);
+         free(band.blue [k]);
+      }
+      else
+         free(band.gray[k]);
+   }
 
-               for(k=0; k<greenlogpower; ++k)
-                  greenImVal = log(9.*greenImVal+1.);
-               
-               greenImVal = 255. * greenImVal;
-            }
+   if(isRGB)
+   {
+      free(band.red);
+      free(band.green);
+      free(band.blue);
+   }
+   else
+      free(band.gray);
 
-            if(greenImVal < 0.)
-               greenImVal = 0.;
 
+   /* Close up the image file and get out */
 
+   if(outType == JPEG)
+   {
+      jpeg_finish_compress(&cinfo);
 
-            /* BLUE */
+      fclose(jpegfp);
 
-            ipix = i + istart - bluexoff;
+      jpeg_destroy_compress(&cinfo);
+   }
 
-            if(ipix < 0 || ipix >= bluenaxis1)
-               blueval = mynan;
-            else
-               blueval = bfitsbuf[ipix];
+   else if(outType == PNG && stream)
+   {
+      if(mViewer_pngClose(pngStream))
+      {
+         snprintf(returnStruct->msg, sizeof(returnStruct->msg), "Error writing output file '%.990s'", pngfile);
+         return returnStruct;
+      }
+   }
 
+   else if(outType == PNG)
+   {
+      // pngError = lodepng_encode32_file(pngfile, pngData, nx, ny);
 
-            /* Special case: blank pixel */
+      pngError =  mViewer_writePNG(pngfile, pngData, nx, ny, comment);
 
-            if(mNaN(blueval))
-               blueImVal = 0.;
+      if(pngError)
+      {
+         strcpy(returnStruct->msg, lodepng_error_text(pngError));
+         return(returnStruct);
+      }
+   }
 
 
-            /* Gaussian histogram equalization */
+   returnStruct->status = 0;
 
-            else if(blueType == GAUSSIAN
-                 || blueType == GAUSSIANLOG)
-            {
-               for(index=0; index<256; ++index)
-               {
-                  if(bluedataval[index] >= blueval)
-                     break;
-               }
+   if(isRGB)
+   {
+      sprintf(returnStruct->msg, "type=\"color\", width=%d, height=%d, bmin=%-g, bminpercent=%.2f, bminsigma=%2f, bmax=%-g, bmaxpercent=%.2f, bmaxsigma=%.2f, gmin=%-g, gminpercent=%.2f, gminsigma=%.2f, gmax=%-g, gmaxpercent=%.2f, gmaxsigma=%.2f, rmin=%-g, rminpercent=%.2f, rminsigma=%.2f, rmax=%-g, rmaxpercent=%.2f, rmaxsigma=%.2f, rdatamin=%-g, rdatamax=%-g, gdatamin=%-g, gdatamax=%-g, bdatamin=%-g, bdatamax=%-g, xflip=%d, yflip=%d, bunit=\"%s\"",
+         nx, ny,
+         blueminval,  blueminpercent,  blueminsigma,
+         bluemaxval,  bluemaxpercent,  bluemaxsigma,
+         greenminval, greenminpercent, greenminsigma,
+         greenmaxval, greenmaxpercent, greenmaxsigma,
+         redminval,   redminpercent,   redminsigma,
+         redmaxval,   redmaxpercent,   redmaxsigma,
+         rdatamin,    rdatamax,
+         gdatamin,    gdatamax,
+         bdatamin,    bdatamax,
+         flipX,       flipY,
+         bunit);
 
-               if(index <   0) index =   0;
-               if(index > 255) index = 255;
+      sprintf(returnStruct->json, "\"type\":\"color\", \"width\":%d, \"height\":%d, \"bmin\":%-g, \"bminpercent\":%.2f, \"bminsigma\":%2f, \"bmax\":%-g, \"bmaxpercent\":%.2f, \"bmaxsigma\":%.2f, \"gmin\":%-g, \"gminpercent\":%.2f, \"gminsigma\":%.2f, \"gmax\":%-g, \"gmaxpercent\":%.2f, \"gmaxsigma\":%.2f, \"rmin\":%-g, \"rminpercent\":%.2f, \"rminsigma\":%.2f, \"rmax\":%-g, \"rmaxpercent\":%.2f, \"rmaxsigma\":%.2f, \"rdatamin\":%-g, \"rdatamax\":%-g, \"gdatamin\":%-g, \"gdatamax\":%-g, \"bdatamin\":%-g, \"bdatamax\":%-g, \"xflip\":%d, \"yflip\":%d, \"bunit\":\"%s\"}",
+         nx, ny,
+         blueminval,  blueminpercent,  blueminsigma,
+         bluemaxval,  bluemaxpercent,  bluemaxsigma,
+         greenminval, greenminpercent, greenminsigma,
+         greenmaxval, greenmaxpercent, greenmaxsigma,
+         redminval,   redminpercent,   redminsigma,
+         redmaxval,   redmaxpercent,   redmaxsigma,
+         rdatamin,    rdatamax,
+         gdatamin,    gdatamax,
+         bdatamin,    bdatamax,
+         flipX,       flipY,
+         bunit);
 
-               blueImVal = index;
-            }
+      strcpy(returnStruct->type, "color");
+      
+      returnStruct->nx              = nx;
+      returnStruct->ny              = ny;
+      returnStruct->grayminval      = 0.;
+      returnStruct->grayminpercent  = 0.;
+      returnStruct->grayminsigma    = 0.;
+      returnStruct->graymaxval      = 0.;
+      returnStruct->graymaxpercent  = 0.;
+      returnStruct->graymaxsigma    = 0.;
+      returnStruct->blueminval      = blueminval;
+      returnStruct->blueminpercent  = blueminpercent;
+      returnStruct->blueminsigma    = blueminsigma;
+      returnStruct->bluemaxval      = bluemaxval;
+      returnStruct->bluemaxpercent  = bluemaxpercent;
+      returnStruct->bluemaxsigma    = bluemaxsigma;
+      returnStruct->greenminval     = greenminval;
+      returnStruct->greenminpercent = greenminpercent;
+      returnStruct->greenminsigma   = greenminsigma;
+      returnStruct->greenmaxval     = greenmaxval;
+      returnStruct->greenmaxpercent = greenmaxpercent;
+      returnStruct->greenmaxsigma   = greenmaxsigma;
+      returnStruct->redminval       = redminval;
+      returnStruct->redminpercent   = redminpercent;
+      returnStruct->redminsigma     = redminsigma;
+      returnStruct->redmaxval       = redmaxval;
+      returnStruct->redmaxpercent   = redmaxpercent;
+      returnStruct->redmaxsigma     = redmaxsigma;
+      returnStruct->graydatamin     = 0.;
+      returnStruct->graydatamax     = 0.;
+      returnStruct->rdatamin        = rdatamin;
+      returnStruct->rdatamax        = rdatamax;
+      returnStruct->gdatamin        = gdatamin;
+      returnStruct->gdatamax        = gdatamax;
+      returnStruct->bdatamin        = bdatamin;
+      returnStruct->bdatamax        = bdatamax;
+      returnStruct->flipX           = flipX;
+      returnStruct->flipY           = flipY;
+      returnStruct->colortable      = 0;
+
+      strcpy(returnStruct->bunit, bunit);
+   }
+   else
+   {
+     sprintf(returnStruct->msg, "type=\"grayscale\", width=%d, height=%d, min=%-g, minpercent=%.2f, minsigma=%.2f, max=%-g, maxpercent=%.2f, maxsigma=%.2f, datamin=%-g, datamax=%-g, xflip=%d, yflip=%d, bunit=\"%s\", colortable=%d",
+         nx, ny,
+         grayminval,  grayminpercent, grayminsigma,
+         graymaxval,  graymaxpercent, graymaxsigma,
+         graydatamin, graydatamax,
+         flipX,       flipY,
+         bunit,       colortable);
+
+     sprintf(returnStruct->json, "\"type\":\"grayscale\", \"width\":%d, \"height\":%d, \"min\":%-g, \"minpercent\":%.2f, \"minsigma\":%.2f, \"max\":%-g, \"maxpercent\":%.2f, \"maxsigma\":%.2f, \"datamin\":%-g, \"datamax\":%-g, \"xflip\":%d, \"yflip\":%d, \"bunit\":\"%s\", \"colortable\":%d",
+         nx, ny,
+         grayminval,  grayminpercent, grayminsigma,
+         graymaxval,  graymaxpercent, graymaxsigma,
+         graydatamin, graydatamax,
+         flipX,       flipY,
+         bunit,       colortable);
+
+      strcpy(returnStruct->type, "grayscale");
+     
+      returnStruct->nx              = nx;
+      returnStruct->ny              = ny;
+      returnStruct->grayminval      = grayminval;
+      returnStruct->grayminpercent  = grayminpercent;
+      returnStruct->grayminsigma    = grayminsigma;
+      returnStruct->graymaxval      = graymaxval;
+      returnStruct->graymaxpercent  = graymaxpercent;
+      returnStruct->graymaxsigma    = graymaxsigma;
+      returnStruct->blueminval      = 0.;
+      returnStruct->blueminpercent  = 0.;
+      returnStruct->blueminsigma    = 0.;
+      returnStruct->bluemaxval      = 0.;
+      returnStruct->bluemaxpercent  = 0.;
+      returnStruct->bluemaxsigma    = 0.;
+      returnStruct->greenminval     = 0.;
+      returnStruct->greenminpercent = 0.;
+      returnStruct->greenminsigma   = 0.;
+      returnStruct->greenmaxval     = 0.;
+      returnStruct->greenmaxpercent = 0.;
+      returnStruct->greenmaxsigma   = 0.;
+      returnStruct->redminval       = 0.;
+      returnStruct->redminpercent   = 0.;
+      returnStruct->redminsigma     = 0.;
+      returnStruct->redmaxval       = 0.;
+      returnStruct->redmaxpercent   = 0.;
+      returnStruct->redmaxsigma     = 0.;
+      returnStruct->graydatamin     = graydatamin;
+      returnStruct->graydatamax     = graydatamax;
+      returnStruct->rdatamin        = 0.;
+      returnStruct->rdatamax        = 0.;
+      returnStruct->gdatamin        = 0.;
+      returnStruct->gdatamax        = 0.;
+      returnStruct->bdatamin        = 0.;
+      returnStruct->bdatamax        = 0.;
+      returnStruct->flipX           = flipX;
+      returnStruct->flipY           = flipY;
+      returnStruct->colortable      = colortable;
+
+      strcpy(returnStruct->bunit, bunit);
+   }
+
+   return returnStruct;
+}
+
+
+
+/*************************************************************************/
+/*                                                                       */
+/*  mViewerIndex                                                         */
+/*                                                                       */
+/*  Build the spatial index for a catalog (or image metadata) overlay    */
+/*  table.  Later renderings that use the (unchanged) table then read    */
+/*  only the records in view and, if there are too many sources to       */
+/*  draw, can bin them straight from the locations in the index.  The    */
+/*  index is written next to the table as <tblfile>.vidx.                */
+/*                                                                       */
+/*   char  *tblfile        Catalog or image metadata table               */
+/*   int    isImgInfo      The table is image metadata (outlines)        */
+/*   int    debug          Debugging output level                        */
+/*                                                                       */
+/*************************************************************************/
+
+struct mViewerReturn *mViewerIndex(char *tblfile, int isImgInfo, int debug)
+{
+   int    j, ncol, stat, nrec, datatype, equinox, sys;
+   int    ira, idec, iequinox, ins, inl, ictype1;
+   int    icrval1, icrval2, icrpix1, icrpix2, icdelt1, icdelt2;
+   int    icra[4], icdec[4];
+   long   recoff;
+   char   idxfile[MAXSTR];
+   char   colname[32];
+   char   ctype1[MAXSTR];
+   double dtr, ra, dec, dist, radius, len, xpos, ypos;
+   double naxis1, naxis2, crpix1, crpix2, cdelt;
+   double x[4], y[4], z[4];
+   double cx, cy, cz;
+
+   struct montage_tableIndex *index;
+
+   struct mViewerReturn *returnStruct;
+
+   dtr = atan(1.)/45.;
+
+   returnStruct = (struct mViewerReturn *)malloc(sizeof(struct mViewerReturn));
+
+   bzero((void *)returnStruct, sizeof(struct mViewerReturn));
+
+   returnStruct->status = 1;
+
+
+   /* Open the table and find the position columns */
+
+   ncol = topen(tblfile);
+
+   if(ncol <= 0)
+   {
+      sprintf(returnStruct->msg, "Invalid table file [%s].", tblfile);
+      return returnStruct;
+   }
+
+   ira  = -1;
+   idec = -1;
+
+   datatype = FOURCORNERS;
+
+   ins = inl = ictype1 = iequinox = -1;
+   icrval1 = icrval2 = icrpix1 = icrpix2 = icdelt1 = icdelt2 = -1;
+
+   if(!isImgInfo)
+   {
+      ira  = tcol("ra");
+      idec = tcol("dec");
+
+      if(ira  < 0) ira  = tcol("lon");
+      if(idec < 0) idec = tcol("lat");
+
+      if(ira < 0 || idec < 0)
+      {
+         tclose();
+         sprintf(returnStruct->msg, "Cannot find 'ra'/'dec' or 'lon'/'lat' columns in table [%s]", tblfile);
+         return returnStruct;
+      }
+   }
+   else
+   {
+      for(j=0; j<4; ++j)
+      {
+         sprintf(colname, "ra%d",  j+1); icra [j] = tcol(colname);
+         sprintf(colname, "dec%d", j+1); icdec[j] = tcol(colname);
+
+         if(icra[j] < 0 || icdec[j] < 0)
+            datatype = WCS;
+      }
 
+      if(datatype == WCS)
+      {
+         ictype1  = tcol("ctype1");
+         iequinox = tcol("equinox");
+         ins      = tcol("ns");
+         inl      = tcol("nl");
+         icrval1  = tcol("crval1");
+         icrval2  = tcol("crval2");
+         icrpix1  = tcol("crpix1");
+         icrpix2  = tcol("crpix2");
+         icdelt1  = tcol("cdelt1");
+         icdelt2  = tcol("cdelt2");
+
+         if(ins < 0) ins = tcol("naxis1");
+         if(inl < 0) inl = tcol("naxis2");
+
+         if(ictype1 < 0 || ins     < 0 || inl     < 0
+         || icrval1 < 0 || icrval2 < 0 || icrpix1 < 0
+         || icrpix2 < 0 || icdelt1 < 0 || icdelt2 < 0)
+         {
+            tclose();
+            sprintf(returnStruct->msg, "Cannot find 'ra1', 'dec1', etc. corners or WCS columns in table [%s]", tblfile);
+            return returnStruct;
+         }
+      }
+   }
 
-            /* ASIHN stretch */
+   index = montage_indexNew();
 
-            else if(blueType == ASINH)
-            {
-               blueImVal  = (blueval - blueminval)/(bluemaxval - blueminval);
+   if(index == (struct montage_tableIndex *)NULL)
+   {
+      tclose();
+      strcpy(returnStruct->msg, "Cannot allocate memory for index.");
+      return returnStruct;
+   }
 
-               if(blueImVal < 0.0)
-                  blueImVal = 0.;
-               else
-                  blueImVal = 255. * asinh(bluebetaval * blueImVal)/bluebetaval;
 
-               if(blueImVal < 0.)
-                  blueImVal = 0.;
+   /* Collect a bounding cap for each record, in the */
+   /* same coordinates the drawing code will use     */
 
-               if(blueImVal > 255.)
-                  blueImVal = 255.;
+   while(1)
+   {
+      recoff = ttell();
 
-               index = (int)(blueImVal+0.5);
-            }
+      stat = tread();
 
+      if(stat < 0)
+         break;
 
-            /* Finally, log power (including linear) */
+      if(!isImgInfo)
+      {
+         if(tnull(ira) || tnull(idec))
+            continue;
 
-            else
-            {
-               if(blueval < blueminval)
-                  blueval = blueminval;
+         ra  = atof(tval(ira));
+         dec = atof(tval(idec));
 
-               if(blueval > bluemaxval)
-                  blueval = bluemaxval;
+         cx = cos(ra*dtr) * cos(dec*dtr);
+         cy = sin(ra*dtr) * cos(dec*dtr);
+         cz = sin(dec*dtr);
 
-               blueImVal = (blueval - blueminval)/bluediff;
+         radius = 0.;
+      }
 
-               for(k=0; k<bluelogpower; ++k)
-                  blueImVal = log(9.*blueImVal+1.);
-               
-               blueImVal = 255. * blueImVal;
-            }
+      else if(datatype == FOURCORNERS)
+      {
+         for(j=0; j<4; ++j)
+            if(tnull(icra[j]) || tnull(icdec[j]))
+               break;
 
-            if(blueImVal < 0.)
-               blueImVal = 0.;
+         if(j < 4)
+            continue;
 
+         cx = cy = cz = 0.;
 
-            /* If we wish to preserve "color" */
+         for(j=0; j<4; ++j)
+         {
+            ra  = atof(tval(icra [j]));
+            dec = atof(tval(icdec[j]));
 
-            if(truecolor > 0.)
-            {
-               if(blueImVal  >= 255.
-               || greenImVal >= 255.
-               || redImVal   >= 255.)
-               {
-                  maxImVal = redImVal;
+            x[j] = cos(ra*dtr) * cos(dec*dtr);
+            y[j] = sin(ra*dtr) * cos(dec*dtr);
+            z[j] = sin(dec*dtr);
 
-                  if(greenImVal > maxImVal) maxImVal = greenImVal;
-                  if(blueImVal  > maxImVal) maxImVal = blueImVal;
+            cx += x[j];
+            cy += y[j];
+            cz += z[j];
+         }
 
-                  redImVal   = pow(redImVal   / maxImVal, truecolor) * 255.;
-                  greenImVal = pow(greenImVal / maxImVal, truecolor) * 255.;
-                  blueImVal  = pow(blueImVal  / maxImVal, truecolor) * 255.;
-               }
-               else
-               {
-                  maxImVal = redImVal;
+         len = sqrt(cx*cx + cy*cy + cz*cz);
 
-                  if(greenImVal > maxImVal) maxImVal = greenImVal;
-                  if(blueImVal  > maxImVal) maxImVal = blueImVal;
+         if(len <= 0.)
+         {
+            cx = x[0];
+            cy = y[0];
+            cz = z[0];
 
-                  if(maxImVal > 0.)
-                  {
-                     redImVal   = pow(redImVal   / maxImVal, truecolor) * maxImVal;
-                     greenImVal = pow(greenImVal / maxImVal, truecolor) * maxImVal;
-                     blueImVal  = pow(blueImVal  / maxImVal, truecolor) * maxImVal;
-                  }
-               }
-            }
-            else
-            {
-               if(blueImVal  > 255.) blueImVal  = 255.;
-               if(greenImVal > 255.) greenImVal = 255.;
-               if(redImVal   > 255.) redImVal   = 255.;
-            }
+            radius = 180.;
+         }
+         else
+         {
+            cx = cx / len;
+            cy = cy / len;
+            cz = cz / len;
 
-            
-            /* Populate the output JPEG array */
+            radius = 0.;
 
-            if(outType == JPEG)
+            for(j=0; j<4; ++j)
             {
-               if(flipX)
-               {
-                  jpegData[jj][3*(nx-1-i)  ] = (int)redImVal;
-                  jpegData[jj][3*(nx-1-i)+1] = (int)greenImVal;
-                  jpegData[jj][3*(nx-1-i)+2] = (int)blueImVal;
-               }
-               else
-               {
-                  jpegData[jj][3*i  ] = (int)redImVal;
-                  jpegData[jj][3*i+1] = (int)greenImVal;
-                  jpegData[jj][3*i+2] = (int)blueImVal;
-               }
-            }
+               dist = cx*x[j] + cy*y[j] + cz*z[j];
 
-            else if (outType == PNG)
-            {
-               if(flipX)
-               {
-                  ii = 4 * nx * jj + 4 * (nx-1-i);
+               if(dist >  1.) dist =  1.;
+               if(dist < -1.) dist = -1.;
 
-                  pngData[ii + 0] = (int)redImVal;
-                  pngData[ii + 1] = (int)greenImVal;
-                  pngData[ii + 2] = (int)blueImVal;
-                  pngData[ii + 3] = 255;
-               }
-               else
-               {
-                  ii = 4 * nx * jj + 4 * i;
+               dist = acos(dist) / dtr;
 
-                  pngData[ii + 0] = (int)redImVal;
-                  pngData[ii + 1] = (int)greenImVal;
-                  pngData[ii + 2] = (int)blueImVal;
-                  pngData[ii + 3] = 255;
-               }
+               if(dist > radius)
+                  radius = dist;
             }
          }
       }
-   }
-
-
-   /* Grayscale/pseudocolor mode */
-
-   else
-   {
-      if(debug)
-      {
-         printf("DEBUG> Processing Gray mode\n");
-         fflush(stdout);
-      }
-
-      /* First make sure that the WCS info is OK */
 
-      if(strlen(grayfile) == 0)
+      else
       {
-         strcpy(returnStruct->msg, "Grayscale/pseudocolor mode but no gray image given");
-         return returnStruct;
-      }
-
-      if(fits_get_hdrpos(grayfptr, &keysexist, &keynum, &status))
-         mViewer_printFitsError(status);
+         /* The drawing code converts the outlines of WCS-style */
+         /* records to Equatorial J2000, so we do the same with */
+         /* the reference location and bound the image by its   */
+         /* farthest corner from the reference pixel (with a    */
+         /* little extra for projection distortion).            */
 
-      status = 0;
-      if(fits_get_hdrpos(grayfptr, &keysexist, &keynum, &status))
+         strcpy(ctype1, tval(ictype1));
 
-      status = 0;
-      fits_read_key(grayfptr, TSTRING, "BUNIT", bunit, (char *)NULL, &status);
+         equinox = 2000;
 
-      if(status == KEY_NO_EXIST)
-         strcpy(bunit, "");
+         if(iequinox >= 0)
+            equinox = atoi(tval(iequinox));
 
-      header  = malloc(keysexist * 80 + 1024);
-      comment = malloc(keysexist * 80 + 1024);
+         if(strncmp(ctype1, "GLON", 4) == 0)
+            sys = GAL;
+         else if(strncmp(ctype1, "ELON", 4) == 0)
+            sys = (equinox == 1950) ? ECLB : ECLJ;
+         else
+            sys = (equinox == 1950) ? EQUB : EQUJ;
 
-      status = 0;
-      if(fits_get_image_wcs_keys(grayfptr, &header, &status))
-         mViewer_printFitsError(status);
+         xpos = atof(tval(icrval1));
+         ypos = atof(tval(icrval2));
 
-      wcs = wcsinit(header);
+         convertCoordinates(sys, (double)equinox, xpos, ypos,
+                            EQUJ, 2000., &ra, &dec, 0.0);
 
-      if(wcs == (struct WorldCoor *)NULL)
-      {
-         if(nowcs)
-         {
-            status = 0;
-            if(fits_read_key(grayfptr, TLONG, "NAXIS1", &naxis1, (char *)NULL, &status))
-               mViewer_printFitsError(status);
+         cx = cos(ra*dtr) * cos(dec*dtr);
+         cy = sin(ra*dtr) * cos(dec*dtr);
+         cz = sin(dec*dtr);
 
-            status = 0;
-            if(fits_read_key(grayfptr, TLONG, "NAXIS2", &naxis2, (char *)NULL, &status))
-               mViewer_printFitsError(status);
+         naxis1 = atof(tval(ins));
+         naxis2 = atof(tval(inl));
+         crpix1 = atof(tval(icrpix1));
+         crpix2 = atof(tval(icrpix2));
 
-            wcs = mViewer_wcsfake(naxis1, naxis2);
-         }
-         else
-         {
-            sprintf(returnStruct->msg, "WCS init failed for [%s].", grayfile);
-            return returnStruct;
-         }
-      }
+         cdelt = fabs(atof(tval(icdelt1)));
 
-      if(!nowcs)
-         montage_checkWCS(wcs);
+         if(fabs(atof(tval(icdelt2))) > cdelt)
+            cdelt = fabs(atof(tval(icdelt2)));
 
-      naxis1 = wcs->nxpix;
-      naxis2 = wcs->nypix;
+         xpos = fabs(crpix1 - 0.5);
 
-      crval1 = wcs->xpos;
-      crval2 = wcs->ypos;
+         if(fabs(naxis1 + 0.5 - crpix1) > xpos)
+            xpos = fabs(naxis1 + 0.5 - crpix1);
 
-      crpix1 = wcs->xrefpix;
-      crpix2 = wcs->yrefpix;
+         ypos = fabs(crpix2 - 0.5);
 
-      xinc   = wcs->xinc;
-      yinc   = wcs->yinc;
-      cdelt1 = wcs->cdelt[0];
-      cdelt2 = wcs->cdelt[1];
-      cd11   = wcs->cd[0];
-      cd12   = wcs->cd[1];
-      cd21   = wcs->cd[2];
-      cd22   = wcs->cd[3];
-      crota2 = wcs->rot;
+         if(fabs(naxis2 + 0.5 - crpix2) > ypos)
+            ypos = fabs(naxis2 + 0.5 - crpix2);
 
-      if(wcs->syswcs == WCS_J2000)
-      {
-         csysimg  = EQUJ;
-         epochimg = 2000.;
+         radius = sqrt(xpos*xpos + ypos*ypos) * cdelt * 1.1;
 
-         if(wcs->equinox == 1950.)
-            epochimg = 1950;
+         if(radius > 180.)
+            radius = 180.;
       }
-      else if(wcs->syswcs == WCS_B1950)
-      {
-         csysimg  = EQUB;
-         epochimg = 1950.;
 
-         if(wcs->equinox == 2000.)
-            epochimg = 2000.;
-      }
-      else if(wcs->syswcs == WCS_GALACTIC)
+      if(montage_indexAdd(index, recoff, cx, cy, cz, radius))
       {
-         csysimg  = GAL;
-         epochimg = 2000.;
+         tclose();
+         montage_indexClose(index);
+         strcpy(returnStruct->msg, "Cannot allocate memory for index.");
+         return returnStruct;
       }
-      else if(wcs->syswcs == WCS_ECLIPTIC)
-      {
-         csysimg  = ECLJ;
-         epochimg = 2000.;
+   }
 
-         if(wcs->equinox == 1950.)
-         {
-            csysimg  = ECLB;
-            epochimg = 1950.;
-         }
-      }
-      else
-      {
-         csysimg  = EQUJ;
-         epochimg = 2000.;
-      }
+   tclose();
 
-      if(debug)
-      {
-         printf("\nGray image:\n");
-         printf("naxis1   = %d\n", (int)wcs->nxpix);
-         printf("naxis2   = %d\n", (int)wcs->nypix);
-         printf("crval1   = %.6f\n", wcs->xpos);
-         printf("crval2   = %.6f\n", wcs->ypos);
-         printf("crpix1   = %.6f\n", wcs->xrefpix);
-         printf("crpix2   = %.6f\n", wcs->yrefpix);
-         printf("xinc     = %.6f\n", wcs->xinc);
-         printf("yinc     = %.6f\n", wcs->yinc);
-         printf("crota2   = %.6f\n", wcs->rot);
-         printf("csysimg  = %d\n",   csysimg);
-         printf("epochimg = %-g\n",  epochimg);
-         printf("\n");
 
-         fflush(stdout);
-      }
+   /* Pack the tree and write it out */
 
+   if(snprintf(idxfile, MAXSTR, "%s.vidx", tblfile) >= MAXSTR)
+   {
+      montage_indexClose(index);
+      strcpy(returnStruct->msg, "Table file name too long for index file.");
+      return returnStruct;
+   }
 
-      /* Kludge to get around bug in WCS library:   */
-      /* 360 degrees sometimes added to pixel coord */
+   nrec = montage_indexCount(index);
 
-      ix = 0.5;
-      iy = 0.5;
+   if(debug)
+   {
+      printf("DEBUG> Writing index %s (%d records)\n", idxfile, nrec);
+      fflush(stdout);
+   }
 
-      pix2wcs(wcs, ix, iy, &xpos, &ypos);
+   if(montage_indexWrite(index, idxfile, tblfile, isImgInfo ? "mViewerImgInfo" : "mViewer"))
+   {
+      montage_indexClose(index);
+      strcpy(returnStruct->msg, "Cannot write index file.");
+      return returnStruct;
+   }
 
-      offscl = wcs->offscl;
+   returnStruct->status = 0;
 
-      x = 0.;
-      y = 0.;
-      
-      if(!offscl)
-         wcs2pix(wcs, xpos, ypos, &x, &y, &offscl);
+   sprintf(returnStruct->msg,  "count=%d",       nrec);
+   sprintf(returnStruct->json, "{\"count\":%d}", nrec);
 
-      xcorrection = x-ix;
-      ycorrection = y-iy;
+   return returnStruct;
+}
 
-      if(offscl || mNaN(x) || mNaN(y))
-      {
-         xcorrection = 0.;
-         ycorrection = 0.;
-      }
 
 
-      if(debug)
-      {
-         printf("\n");
-         printf("DEBUG> GRAY: naxis1 = %d\n" , naxis1);
-         printf("DEBUG> GRAY: naxis2 = %d\n",  naxis2);
-         printf("DEBUG> GRAY: xinc   = %-g\n", xinc);
-         printf("DEBUG> GRAY: yinc   = %-g\n", yinc);
-         printf("DEBUG> GRAY: crota2 = %-g\n", crota2);
-         fflush(stdout);
-      }
+/*************************************************************************/
+/*                                                                       */
+/*  mViewerBatch                                                         */
+/*                                                                       */
+/*  Render a whole list of views (e.g. the many cutouts, stretches and   */
+/*  overlays a tile or thumbnail service makes of one mosaic) in one     */
+/*  call.  The list file holds a JSON array (or simply a sequence) of    */
+/*  mViewer JSON commands, each with an extra "out_file" and, if the     */
+/*  extension doesn't say, "out_format" ("png" or "jpeg").               */
+/*                                                                       */
+/*  The views are dealt out to a set of worker processes (mViewer keeps  */
+/*  its state in file-level variables, so one process renders one view   */
+/*  at a time).  Each worker keeps its images open, along with their     */
+/*  histograms and header checks, the histogram files it has read, the   */
+/*  color table and the label font, from one view to the next.  With    */
+/*  more than one worker a view renders with a single thread unless it   */
+/*  asks for more.                                                       */
+/*                                                                       */
+/*   char  *listfile       File of view commands                         */
+/*   int    nproc          Number of worker processes (0: one per CPU)   */
+/*   int    debug          Debugging output level                        */
+/*                                                                       */
+/*************************************************************************/
 
-      if(!noflip)
-      {
-         if(xinc > 0)
-           flipX = 1;
+struct mViewerReturn *mViewerBatch(char *listfile, int nproc, int debug)
+{
+   int    i, j, k, nview, maxview, depth, instr, status;
+   int    nfailed, nreport, firstfail;
+   int    pfd[2];
+   long   len, nread, nalloc;
+   pid_t *pid;
+   char  *text, *ptr, *start, *end;
+   char **views;
+   char  *done;
+   char   outFile[MAXSTR];
+   char   outFmt [MAXSTR];
+   char   line   [MAXSTR+64];
+   char   failmsg[MAXSTR];
+   char   msg    [MAXSTR];
+
+   FILE  *fin;
 
-         if(yinc > 0)
-           flipY = 1;
+   struct mViewerReturn *returnStruct;
+   struct mViewerReturn *viewReturn;
 
-         if(fabs(crota2) >  90.
-         && fabs(crota2) < 270.)
-         {
-            flipX = 1 - flipX;
-            flipY = 1 - flipY;
 
-            crota2 = crota2 + 180;
+   returnStruct = (struct mViewerReturn *)malloc(sizeof(struct mViewerReturn));
 
-            while(crota2 > 360) crota2 -= 360.;
-         }
+   bzero((void *)returnStruct, sizeof(struct mViewerReturn));
 
-         if(wcs->coorflip)
-            flipX = 1 - flipX;
+   returnStruct->status = 1;
 
-         if(flipX)
-         {
-           cdelt1 = -cdelt1;
-           cd11   = -cd11;
-           cd21   = -cd21;
-         }
 
-         if(flipY)
-         {
-           cdelt2 = -cdelt2;
-           cd12   = -cd12;
-           cd22   = -cd22;
-         }
-      }
+   /* Read the list */
 
-      mViewer_vamp_comment(comment);
+   fin = fopen(listfile, "r");
 
+   if(fin == (FILE *)NULL)
+   {
+      sprintf(returnStruct->msg, "Cannot open view list [%s].", listfile);
+      return returnStruct;
+   }
 
-      /* Now adjust the data range if the limits */
-      /* were percentiles.  We had to wait until */
-      /* we had naxis1, naxis2 which is why this */
-      /* is here                                 */
+   fseek(fin, 0L, SEEK_END);
+   len = ftell(fin);
+   fseek(fin, 0L, SEEK_SET);
 
-      if(debug)
-         printf("\n GRAY RANGE:\n");
+   text = (char *)malloc(len + 1);
 
-      if(strlen(grayhistfile) > 0)
-      {
-         if(mViewer_readHist(grayhistfile, &grayminval,  &graymaxval, graydataval, 
-                             &graydatamin, &graydatamax, &median, &sigma, &grayType))
-         {
-            strcpy(returnStruct->msg, montage_msgstr);
-            return returnStruct;
-         }
-      }
-      else
-      {
-         if(mViewer_getRange( grayfptr,        grayminstr,  graymaxstr, 
-                             &grayminval,     &graymaxval,  grayType, 
-                              graybetastr,    &graybetaval, graydataval,
-                              naxis1,          naxis2,
-                             &graydatamin,    &graydatamax,
-                             &median,         &sigma,
-                              grayPlaneCount,  grayPlanes))
-         {
-            strcpy(returnStruct->msg, montage_msgstr);
-            return returnStruct;
-         }
-      }
+   len = fread(text, 1, len, fin);
 
-      grayminpercent = mViewer_valuePercentile(grayminval);
-      graymaxpercent = mViewer_valuePercentile(graymaxval);
+   text[len] = '\0';
 
-      grayminsigma = (grayminval - median) / sigma;
-      graymaxsigma = (graymaxval - median) / sigma;
+   fclose(fin);
 
-      graydiff = graymaxval - grayminval;
 
-      if(debug)
-      {
-         printf("DEBUG> grayminval = %-g (%-g%%/%-gs)\n", grayminval, grayminpercent, grayminsigma);
-         printf("DEBUG> graymaxval = %-g (%-g%%/%-gs)\n", graymaxval, graymaxpercent, graymaxsigma);
-         printf("DEBUG> graydiff   = %-g\n", graydiff);
-         fflush(stdout);
-      }
+   /* Split it into the top-level JSON objects */
 
+   nview   = 0;
+   maxview = 1024;
 
-      /* Figure out which set of pixels to use */
-      /* and what order to read them in        */
+   views = (char **)malloc(maxview * sizeof(char *));
 
-      istart = 0;
-      iend   = naxis1 - 1;
-      nx     = naxis1;
+   depth = 0;
+   instr = 0;
+   start = text;
 
-      if(outType == JPEG && naxis1 > MAXDIM)
+   for(ptr=text; *ptr; ++ptr)
+   {
+      if(instr)
       {
-         istart = (naxis1 - MAXDIM)/2;
-         iend   = istart + MAXDIM - 1;
-         nx     = MAXDIM;
-      }
+         if(*ptr == '\\' && *(ptr+1))
+            ++ptr;
 
-      jstart = 0;
-      jend   = naxis2 - 1;
-      ny     = naxis2;
-      jinc   = 1;
+         else if(*ptr == '"')
+            instr = 0;
 
-      if(outType == JPEG && naxis2 > MAXDIM)
-      {
-         jstart = (naxis2 - MAXDIM)/2;
-         jend   = istart + MAXDIM - 2;
-         ny     = MAXDIM;
+         continue;
       }
 
-      if(flipY)
+      if(*ptr == '"')
+         instr = 1;
+
+      else if(*ptr == '{')
       {
-         itemp  = jstart;
-         jstart = jend;
-         jend   = itemp;
-         jinc   = -1;
+         if(depth == 0)
+            start = ptr;
+
+         ++depth;
       }
 
-      if(debug)
+      else if(*ptr == '}' && depth > 0)
       {
-         printf("\n");
-         printf("DEBUG> nx               = %d\n", nx);
-         printf("DEBUG> istart           = %d\n", istart);
-         printf("DEBUG> iend             = %d\n", iend);
-         printf("DEBUG> flipX            = %d\n", flipX);
-         printf("\n");
-         printf("DEBUG> ny               = %d\n", ny);
-         printf("DEBUG> jstart           = %d\n", jstart);
-         printf("DEBUG> jend             = %d\n", jend);
-         printf("DEBUG> jinc             = %d\n", jinc);
-         printf("DEBUG> flipY            = %d\n", flipY);
-         fflush(stdout);
+         --depth;
+
+         if(depth == 0)
+         {
+            if(nview >= maxview)
+            {
+               maxview += 1024;
+
+               views = (char **)realloc(views, maxview * sizeof(char *));
+            }
+
+            views[nview] = (char *)malloc(ptr - start + 2);
+
+            strncpy(views[nview], start, ptr - start + 1);
+
+            views[nview][ptr - start + 1] = '\0';
+
+            ++nview;
+         }
       }
+   }
 
+   free(text);
 
-      /* Set up the JPEG library info  */
-      /* and start the JPEG compressor */
+   if(depth != 0 || nview == 0)
+   {
+      for(i=0; i<nview; ++i)
+         free(views[i]);
 
-      if(outType == JPEG)
-      {
-         cinfo.err = jpeg_std_error(&jerr);
+      free(views);
 
-         jpeg_create_compress(&cinfo);
+      sprintf(returnStruct->msg, "No view commands (or unbalanced braces) in [%s].", listfile);
+      return returnStruct;
+   }
 
-         jpeg_stdio_dest(&cinfo, jpegfp);
 
-         cinfo.image_width      = nx;
-         cinfo.image_height     = ny;
-         cinfo.input_components = 3;
-         cinfo.in_color_space = JCS_RGB;
+   /* Worker count */
 
-         jpeg_set_defaults(&cinfo);
+   if(nproc <= 0)
+      nproc = sysconf(_SC_NPROCESSORS_ONLN);
 
-         quality = 85;
+   if(nproc < 1)
+      nproc = 1;
 
-         jpeg_set_quality (&cinfo, quality, TRUE);
+   if(nproc > nview)
+      nproc = nview;
 
-         jpeg_start_compress(&cinfo, TRUE);
+   if(nproc > 1)
+      defaultThreads = 1;
 
-         jpeg_write_marker(&cinfo, JPEG_COM, 
-            (const JOCTET *)comment, strlen(comment));
-      }
+   if(debug)
+   {
+      printf("DEBUG> mViewerBatch(): %d views, %d workers\n", nview, nproc);
+      fflush(stdout);
+   }
 
 
-      /* Now, loop over the part of the image we want */
+   /* Each worker reports one line per view ("index status  */
+   /* message") back up a pipe; a line is written in one    */
+   /* piece, so those from different workers don't mix.    */
+   /* With a single worker we just run the views here.      */
 
-      fpixelGray[0] = istart+1;
-      fpixelGray[2] = 1;
-      fpixelGray[3] = 1;
+   batchCache = 1;
 
-      if(grayPlaneCount > 1)
-         fpixelGray[2] = grayPlanes[1];
-      if(grayPlaneCount > 2)
-         fpixelGray[3] = grayPlanes[2];
+   done = (char *)malloc(nview);
 
-      nelements = nx;
+   for(k=0; k<nview; ++k)
+      done[k] = 0;
 
-      fitsbuf = (double *)malloc(nelements * sizeof(double));
+   nfailed   = 0;
+   firstfail = -1;
 
-      if(outType == JPEG)
+   strcpy(failmsg, "");
+
+   pid = (pid_t *)malloc(nproc * sizeof(pid_t));
+
+   if(nproc > 1)
+   {
+      if(pipe(pfd) != 0)
+         nproc = 1;
+
+      fflush(stdout);
+      fflush(stderr);
+   }
+
+   for(i=0; i<nproc; ++i)
+   {
+      if(nproc > 1)
       {
-         jpegData = (JSAMPROW *)malloc(ny * sizeof (JSAMPROW));
-         jpegOvly = (JSAMPROW *)malloc(ny * sizeof (JSAMPROW));
+         pid[i] = fork();
+
+         if(pid[i] != 0)
+            continue;
+
+         close(pfd[0]);
       }
 
-      else if(outType == PNG)
+      for(k=i; k<nview; k+=nproc)
       {
-         membytes = 4 * nx * ny;
+         strcpy(outFmt, "png");
 
-         pngData = (unsigned char *)malloc(membytes * sizeof(unsigned char));
-         pngOvly = (unsigned char *)malloc(membytes * sizeof(unsigned char));
+         if(json_val(views[k], "out_file", outFile) == (char *)NULL)
+         {
+            status = 1;
 
-         for(ii=0; ii<membytes; ++ii)
+            strcpy(msg, "View has no 'out_file'.");
+         }
+         else
          {
-            pngData[ii] = 0;
-            pngOvly[ii] = 0;
+            len = strlen(outFile);
+
+            if((len > 4 && strcasecmp(outFile+len-4, ".jpg")  == 0)
+            || (len > 5 && strcasecmp(outFile+len-5, ".jpeg") == 0))
+               strcpy(outFmt, "jpeg");
+
+            json_val(views[k], "out_format", outFmt);
+
+            viewReturn = mViewer(JSONMODE, views[k], outFile, outFmt, debug);
+
+            status = viewReturn->status;
+
+            strncpy(msg, viewReturn->msg, MAXSTR-1);
+
+            msg[MAXSTR-1] = '\0';
+
+            free(viewReturn);
+         }
+
+         if(nproc == 1)
+         {
+            done[k] = 1 + status;
+
+            if(status && firstfail < 0)
+            {
+               firstfail = k;
+               strcpy(failmsg, msg);
+            }
+
+            continue;
          }
+
+         for(j=0; j<strlen(msg); ++j)
+            if(msg[j] == '\n' || msg[j] == '\r')
+               msg[j] = ' ';
+
+         sprintf(line, "%d %d %s\n", k, status, msg);
+
+         if(write(pfd[1], line, strlen(line)) < 0)
+            break;
       }
-      
-      if(debug)
+
+      if(nproc > 1)
       {
-         printf("Image (PNG/JPEG) space allocated\n");
          fflush(stdout);
+
+         _exit(0);
       }
+   }
 
-      ovlymask = (double  **)malloc(ny * sizeof (double *));
 
-      for(jj=0; jj<ny; ++jj)
-      {
-         if(outType == JPEG)
-         {
-            jpegData[jj] = (JSAMPROW)malloc(3*nelements);
-            jpegOvly[jj] = (JSAMPROW)malloc(3*nelements);
-         }
+   /* Collect the worker reports.  A view whose worker */
+   /* died before reporting on it counts as a failure  */
 
-         ovlymask[jj] = (double *)malloc(nelements * sizeof(double));
-      }
+   if(nproc > 1)
+   {
+      close(pfd[1]);
 
-      for(jj=0; jj<ny; ++jj)
+      nread  = 0;
+      nalloc = 65536;
+
+      text = (char *)malloc(nalloc);
+
+      while(1)
       {
-         for(i=0; i<nelements; ++i)
+         if(nalloc - nread < MAXSTR+64)
          {
-            fitsbuf[i] = mynan;
+            nalloc += 65536;
 
-            if(outType == JPEG)
-            {
-               jpegData[jj][3*i  ] = 0;
-               jpegData[jj][3*i+1] = 0;
-               jpegData[jj][3*i+2] = 0;
+            text = (char *)realloc(text, nalloc);
+         }
 
-               jpegOvly[jj][3*i  ] = 0;
-               jpegOvly[jj][3*i+1] = 0;
-               jpegOvly[jj][3*i+2] = 0;
-            }
+         len = read(pfd[0], text+nread, nalloc-nread-1);
 
-            ovlymask[jj][i] = 0.;
-         }
+         if(len <= 0)
+            break;
 
-         j = jstart + jj*jinc;
+         nread += len;
+      }
 
-         fpixelGray[1] = j+1;
+      text[nread] = '\0';
 
-         if(fits_read_pix(grayfptr, TDOUBLE, fpixelGray, nelements, &mynan,
-                          fitsbuf, &nullcnt, &status))
-            mViewer_printFitsError(status);
+      close(pfd[0]);
 
-         for(i=0; i<nx; ++i)
-         {
-            /* Special case: blank pixel */
+      for(start=text; *start; start=ptr+1)
+      {
+         ptr = strchr(start, '\n');
 
-            if(mNaN(fitsbuf[i-istart]))
-               index = 0;
+         if(ptr == (char *)NULL)
+            break;
 
+         *ptr = '\0';
 
-            /* Gaussian histogram equalization */
+         strncpy(line, start, MAXSTR+63);
 
-            else if(grayType == GAUSSIAN
-                 || grayType == GAUSSIANLOG)
-            {
-               grayval = fitsbuf[i-istart];
+         line[MAXSTR+63] = '\0';
 
-               for(index=0; index<256; ++index)
-               {
-                  if(graydataval[index] >= grayval)
-                     break;
-               }
+         if(sscanf(line, "%d %d", &k, &status) != 2 || k < 0 || k >= nview)
+            continue;
 
-               if(index <   0) index =   0;
-               if(index > 255) index = 255;
-            }
+         done[k] = 1 + (status != 0);
 
+         if(status && (firstfail < 0 || k < firstfail))
+         {
+            firstfail = k;
 
-            /* ASIHN stretch */
+            end = strchr(line, ' ');
+            end = strchr(end+1, ' ');
 
-            else if(grayType == ASINH)
-            {
-               grayval = fitsbuf[i-istart];
+            strcpy(failmsg, end ? end+1 : "");
+         }
+      }
 
-               grayImVal  = (grayval - grayminval)/(graymaxval - grayminval);
+      free(text);
 
-               if(grayImVal < 0.0)
-                  grayImVal = 0.;
-               else
-                  grayImVal = 255. * asinh(graybetaval * grayImVal)/graybetaval;
+      for(i=0; i<nproc; ++i)
+      {
+         if(pid[i] > 0)
+            waitpid(pid[i], (int *)NULL, 0);
+      }
+   }
 
-               if(grayImVal < 0.)
-                  grayImVal = 0.;
+   nreport = 0;
 
-               if(grayImVal > 255.)
-                  grayImVal = 255.;
+   for(k=0; k<nview; ++k)
+   {
+      if(done[k])
+         ++nreport;
 
-               index = (int)(grayImVal+0.5);
-            }
+      if(done[k] != 1)
+      {
+         ++nfailed;
+
+         if(done[k] == 0 && (firstfail < 0 || k < firstfail))
+         {
+            firstfail = k;
+            strcpy(failmsg, "Worker process ended before rendering this view.");
+         }
+      }
+   }
 
+   if(nproc == 1)
+      mViewer_cacheFree();
 
-            /* Finally, log power (including linear) */
+   batchCache     = 0;
+   defaultThreads = NTHREAD;
 
-            else
-            {
-               grayval = fitsbuf[i-istart];
+   for(i=0; i<nview; ++i)
+      free(views[i]);
+
+   free(views);
+   free(done);
+   free(pid);
 
-               if(grayval < grayminval)
-                  grayval = grayminval;
+   if(debug)
+   {
+      printf("DEBUG> mViewerBatch(): %d of %d views reported, %d failed\n", nreport, nview, nfailed);
+      fflush(stdout);
+   }
 
-               if(grayval > graymaxval)
-                  grayval = graymaxval;
+   for(j=0; j<strlen(failmsg); ++j)
+      if(failmsg[j] == '"')
+         failmsg[j] = '\'';
 
-               grayImVal = (grayval - grayminval)/graydiff;
+   returnStruct->status = 0;
 
-               for(k=0; k<graylogpower; ++k)
-                  grayImVal = log(9.*grayImVal+1.);
+   if(nfailed == 0)
+   {
+      sprintf(returnStruct->msg,  "count=%d, failed=0", nview);
+      sprintf(returnStruct->json, "{\"count\":%d, \"failed\":0}", nview);
+   }
+   else
+   {
+      sprintf(returnStruct->msg,  "count=%d, failed=%d, firstfail=%d, failmsg=\"%.900s\"",
+         nview, nfailed, firstfail, failmsg);
+      sprintf(returnStruct->json, "{\"count\":%d, \"failed\":%d, \"firstfail\":%d, \"failmsg\":\"%.900s\"}",
+         nview, nfailed, firstfail, failmsg);
+   }
 
-               grayImVal = 255. * grayImVal;
+   return returnStruct;
+}
 
-               if(grayImVal <   0.)
-                  grayImVal =   0.;
 
-               if(grayImVal > 255.)
-                  grayImVal = 255.;
 
-               index = (int)(grayImVal+0.5);
-            }
+/*************************************************************************/
+/*                                                                       */
+/*  Copy the stretch parameters for one image (gray or one of the        */
+/*  colors) into the structure used by the rendering threads.            */
+/*                                                                       */
+/*  For the Gaussian stretches the pixel color is the first of the 256   */
+/*  data levels that is not below the pixel value.  We keep a running    */
+/*  maximum of the levels so the same answer can be found with a binary  */
+/*  search instead of a scan.                                            */
+/*                                                                       */
+/*************************************************************************/
 
-            if(outType == JPEG)
-            {
-               if(flipX)
-               {
-                  jpegData[jj][3*(nx-1-i)  ] = color_table[index][0];
-                  jpegData[jj][3*(nx-1-i)+1] = color_table[index][1];
-                  jpegData[jj][3*(nx-1-i)+2] = color_table[index][2];
-               }
-               else
-               {
-                  jpegData[jj][3*i  ] = color_table[index][0];
-                  jpegData[jj][3*i+1] = color_table[index][1];
-                  jpegData[jj][3*i+2] = color_table[index][2];
-               }
-            }
+void mViewer_setStretch(struct mViewerStretch *stretch, int type, int logpower,
+                        double minval, double maxval, double diff, double betaval,
+                        double *dataval, int off, double xoff, int naxis1)
+{
+   int    i;
+   double level;
 
-            else if(outType == PNG)
-            {
-               if(flipX)
-               {
-                  ii = 4 * nx * jj + 4 * (nx-1-i);
+   stretch->type     = type;
+   stretch->logpower = logpower;
+   stretch->minval   = minval;
+   stretch->maxval   = maxval;
+   stretch->diff     = diff;
+   stretch->betaval  = betaval;
+   stretch->off      = off;
+   stretch->xoff     = xoff;
+   stretch->naxis1   = naxis1;
 
-                  pngData[ii + 0] = color_table[index][0];
-                  pngData[ii + 1] = color_table[index][1];
-                  pngData[ii + 2] = color_table[index][2];
-                  pngData[ii + 3] = 255;
-               }
-               else
-               {
-                  ii = 4 * nx * jj + 4 * i;
+   level = -HUGE_VAL;
 
-                  pngData[ii + 0] = color_table[index][0];
-                  pngData[ii + 1] = color_table[index][1];
-                  pngData[ii + 2] = color_table[index][2];
-                  pngData[ii + 3] = 255;
-               }
-            }
-         }
+   for(i=0; i<256; ++i)
+   {
+      if(type == GAUSSIAN || type == GAUSSIANLOG)
+      {
+         if(!mNaN(dataval[i]) && dataval[i] > level)
+            level = dataval[i];
       }
+
+      stretch->level[i] = level;
    }
+}
 
 
-   /* Add graphics */
 
-   charHeight = 0.0025 * ny * fabs(cdelt2);
-   pixScale   = fabs(cdelt2);
+/*************************************************************************/
+/*                                                                       */
+/*  Index of the first Gaussian level at or above a (non-blank) value,   */
+/*  or 255 if there isn't one.                                           */
+/*                                                                       */
+/*************************************************************************/
 
-   if(nx * fabs(cdelt1) > ny * fabs(cdelt2))
-   {
-      charHeight = 0.0025 * nx * fabs(cdelt1);
-      pixScale   = fabs(cdelt1);
-   }
+int mViewer_levelIndex(struct mViewerStretch *stretch, double val)
+{
+   int lo, hi, mid;
 
-   for(i=0; i<ngrid; ++i)
+   lo = 0;
+   hi = 256;
+
+   while(lo < hi)
    {
-      mViewer_makeGrid(wcs, csysimg, epochimg, 
-                       grid[i].csys, grid[i].epoch, grid[i].red, grid[i].green, grid[i].blue,  
-                       fontfile, grid[i].fontscale);
-      mViewer_addOverlay();
+      mid = (lo + hi) / 2;
+
+      if(stretch->level[mid] >= val)
+         hi = mid;
+      else
+         lo = mid + 1;
    }
 
+   if(lo > 255)
+      lo = 255;
 
-   for(i=0; i<ncat; ++i)
-   {
-      if(cat[i].isImgInfo == 0) /* CATALOG */
-      {
-         ncol = topen(cat[i].file);
+   return lo;
+}
 
-         if(ncol <= 0)
-         {
-            sprintf(returnStruct->msg, "Invalid table file [%s].", cat[i].file);
-            return returnStruct;
-         }
 
-         ira  = tcol("ra");
-         idec = tcol("dec");
 
-         if(ira  < 0) ira  = tcol("lon");
-         if(idec < 0) idec = tcol("lat");
+/*************************************************************************/
+/*                                                                       */
+/*  Color table index for a grayscale/pseudocolor pixel value.           */
+/*                                                                       */
+/*************************************************************************/
 
-         if(ira < 0 || idec < 0)
-         {
-            sprintf(returnStruct->msg, "Cannot find 'ra' and 'dec (or 'lon','lat') in table [%s]", cat[i].file);
-            return returnStruct;
-         }
+int mViewer_grayIndex(struct mViewerStretch *stretch, double val)
+{
+   int    k;
+   double imval;
 
+   /* Special case: blank pixel */
 
-         // Scaling 
+   if(mNaN(val))
+      return 0;
 
-         iscale = -1;
 
-         if(strlen(cat[i].scaleColumn) > 0)
-         {
-            iscale = tcol(cat[i].scaleColumn);
+   /* Gaussian histogram equalization */
 
-            if(iscale < 0)
-            {
-               sprintf(returnStruct->msg, "Cannot find flux/mag column [%s] in table [%s]", cat[i].scaleColumn, cat[i].file);
-               return returnStruct;
-            }
-         }
+   if(stretch->type == GAUSSIAN
+   || stretch->type == GAUSSIANLOG)
+      return mViewer_levelIndex(stretch, val);
 
-         
-         // Color
 
-         icolor = -1;
+   /* ASIHN stretch */
 
-         if(strlen(cat[i].colorColumn) > 0)
-         {
-            icolor = tcol(cat[i].colorColumn);
+   if(stretch->type == ASINH)
+   {
+      imval = (val - stretch->minval)/(stretch->maxval - stretch->minval);
 
-            if(icolor < 0)
-            {
-               sprintf(returnStruct->msg, "Cannot find color column [%s] in table [%s]", cat[i].colorColumn, cat[i].file);
-               return returnStruct;
-            }
-         }
+      if(imval < 0.0)
+         imval = 0.;
+      else
+         imval = 255. * asinh(stretch->betaval * imval)/stretch->betaval;
 
+      if(imval < 0.)
+         imval = 0.;
 
-         // Symbol size
+      if(imval > 255.)
+         imval = 255.;
 
-         isymsize = -1;
+      return (int)(imval+0.5);
+   }
 
-         if(strlen(cat[i].symSizeColumn) > 0)
-         {
-            isymsize = tcol(cat[i].symSizeColumn);
 
-            if(isymsize < 0)
-            {
-               sprintf(returnStruct->msg, "Cannot find symbol size column [%s] in table [%s]", cat[i].symSizeColumn, cat[i].file);
-               return returnStruct;
-            }
-         }
+   /* Finally, log power (including linear) */
 
+   if(val < stretch->minval)
+      val = stretch->minval;
 
-         // Symbol shape
+   if(val > stretch->maxval)
+      val = stretch->maxval;
 
-         isymshape = -1;
+   imval = (val - stretch->minval)/stretch->diff;
 
-         if(strlen(cat[i].symShapeColumn) > 0)
-         {
-            isymshape = tcol(cat[i].symShapeColumn);
+   for(k=0; k<stretch->logpower; ++k)
+      imval = log(9.*imval+1.);
 
-            if(isymshape < 0)
-            {
-               sprintf(returnStruct->msg, "Cannot find symbol shape column [%s] in table [%s]", cat[i].symShapeColumn, cat[i].file);
-               return returnStruct;
-            }
-         }
+   imval = 255. * imval;
 
+   if(imval <   0.)
+      imval =   0.;
 
-         // Label
+   if(imval > 255.)
+      imval = 255.;
 
-         ilabel = -1;
+   return (int)(imval+0.5);
+}
 
-         if(strlen(cat[i].labelColumn) > 0)
-         {
-            ilabel = tcol(cat[i].labelColumn);
 
-            if(ilabel < 0)
-            {
-               sprintf(returnStruct->msg, "Cannot find label column [%s] in table [%s]", cat[i].labelColumn, cat[i].file);
-               return returnStruct;
-            }
-         }
 
+/*************************************************************************/
+/*                                                                       */
+/*  Intensity (0 and up; values over 255 are dealt with by the caller    */
+/*  when combining colors) for one color of a pixel.                     */
+/*                                                                       */
+/*************************************************************************/
 
-         // Read through the file
+double mViewer_colorLevel(struct mViewerStretch *stretch, double val)
+{
+   int    k;
+   double imval;
 
-         while(1)
-         {
-            stat = tread();
+   /* Special case: blank pixel or color turned off */
 
-            if(stat < 0)
-               break;
+   if(mNaN(val) || stretch->off)
+      imval = 0.;
 
-            if(tnull(ira) || tnull(idec))
-               continue;
 
+   /* Gaussian histogram equalization */
 
-            // Read location 
+   else if(stretch->type == GAUSSIAN
+        || stretch->type == GAUSSIANLOG)
+      imval = mViewer_levelIndex(stretch, val);
 
-            ra  = atof(tval(ira));
-            dec = atof(tval(idec));
 
-            if(iscale < 0)
-               flux = cat[i].symSize;
-            else
-            {
-               flux = atof(tval(iscale));
+   /* ASIHN stretch */
 
-               if(tnull(iscale))
-                  continue;
-            }
+   else if(stretch->type == ASINH)
+   {
+      imval = (val - stretch->minval)/(stretch->maxval - stretch->minval);
 
+      if(imval < 0.0)
+         imval = 0.;
+      else
+         imval = 255. * asinh(stretch->betaval * imval)/stretch->betaval;
 
-            // Read color
+      if(imval < 0.)
+         imval = 0.;
 
-            ovlyred   = cat[i].red;
-            ovlygreen = cat[i].green;
-            ovlyblue  = cat[i].blue;
+      if(imval > 255.)
+         imval = 255.;
+   }
 
-            if(icolor >= 0)
-            {
-               if(!tnull(icolor))
-               {
-                  strcpy(colorstr, tval(icolor));
 
-                  if(mViewer_colorLookup(colorstr, &ovlyred, &ovlygreen, &ovlyblue))
-                  {
-                     strcpy(returnStruct->msg, montage_msgstr);
-                     return returnStruct;
-                  }
-               }
-            }
+   /* Finally, log power (including linear) */
 
+   else
+   {
+      if(val < stretch->minval)
+         val = stretch->minval;
 
-            // Read symbol size
+      if(val > stretch->maxval)
+         val = stretch->maxval;
 
-            symSize  = cat[i].symSize;
-            symUnits = cat[i].symUnits;
+      imval = (val - stretch->minval)/stretch->diff;
 
-            if(isymsize >= 0)
-            {
-               if(!tnull(isymsize))
-               {
-                  strcpy(symbolstr, tval(isymsize));
+      for(k=0; k<stretch->logpower; ++k)
+         imval = log(9.*imval+1.);
 
-                  ptr = symbolstr + strlen(symbolstr) - 1;
+      imval = 255. * imval;
+   }
 
-                  symUnits = FRACTIONAL;
+   if(imval < 0.)
+      imval = 0.;
 
-                  if(*ptr == 's')
-                     symUnits = SECONDS;
+   return imval;
+}
 
-                  else if(*ptr == 'm')
-                     symUnits = MINUTES;
 
-                  else if(*ptr == 'd')
-                     symUnits = DEGREES;
 
-                  else if(*ptr == 'p')
-                     symUnits = PIXELS;
+/*************************************************************************/
+/*                                                                       */
+/*  Render a band of image rows (already read into memory) into the      */
+/*  PNG/JPEG array.  The rows are dealt out to the threads round-robin;  */
+/*  each output row depends only on its own input row so no locking is   */
+/*  needed.  The main thread takes the first share itself.               */
+/*                                                                       */
+/*************************************************************************/
 
-                  if(symUnits != FRACTIONAL)
-                     *ptr = '\0';
+void mViewer_renderBand(struct mViewerBand *band, int jj0, int nrow)
+{
+   int                 t, nthr;
+   int                *started;
+   pthread_t          *threads;
+   struct mViewerBand *work;
 
-                  symSize = strtod(symbolstr, &end);
+   nthr = nthread;
 
+   if(nthr > nrow) nthr = nrow;
+   if(nthr < 1)    nthr = 1;
 
-                  // If this fails, revert to default values
+   work    = (struct mViewerBand *)malloc(nthr * sizeof(struct mViewerBand));
+   threads = (pthread_t *)         malloc(nthr * sizeof(pthread_t));
+   started = (int *)               malloc(nthr * sizeof(int));
 
-                  if(end < (symbolstr + (int)strlen(symbolstr)) || symSize <= 0.)
-                  {
-                     symSize  = cat[i].symSize;
-                     symUnits = cat[i].symUnits;
-                  }
-               }
-            }
+   for(t=0; t<nthr; ++t)
+   {
+      work[t] = *band;
 
+      work[t].jj0    = jj0;
+      work[t].nrow   = nrow;
+      work[t].start  = t;
+      work[t].stride = nthr;
 
-            // Read symbol shape
+      started[t] = 0;
+   }
 
-            symNPnt     = cat[i].symNPnt;
-            symType     = cat[i].symType;
-            symRotAngle = cat[i].symRotAngle;
+   for(t=1; t<nthr; ++t)
+   {
+      if(pthread_create(&threads[t], NULL, mViewer_renderThread, &work[t]) == 0)
+         started[t] = 1;
+      else
+         mViewer_renderThread(&work[t]);
+   }
 
-            if(isymshape >= 0)
-            {
-               if(!tnull(isymshape))
-               {
-                  strcpy(symbolstr, tval(isymshape));
+   mViewer_renderThread(&work[0]);
 
-                  istatus = mViewer_parseSymbol(symbolstr, &symNPnt, &symNMax, &symType, &symRotAngle);
+   for(t=1; t<nthr; ++t)
+   {
+      if(started[t])
+         pthread_join(threads[t], NULL);
+   }
 
-                  if(istatus)
-                  {
-                     symNPnt     = cat[i].symNPnt;
-                     symNMax     = cat[i].symNMax;
-                     symType     = cat[i].symType;
-                     symRotAngle = cat[i].symRotAngle;
-                  }
-               }
-            }
+   free(work);
+   free(threads);
+   free(started);
+}
 
 
+void *mViewer_renderThread(void *ptr)
+{
+   int k;
 
-            if(debug)
-               printf("Symbol: color=(%4.2f,%4.2f,%4.2f) shape=(%2d,%d,%6.2f) at (%6.2f,%6.2f) flux=%10.6f->", 
-                  ovlyred, ovlygreen, ovlyblue, symNPnt, symType, symRotAngle, ra, dec, flux);
+   struct mViewerBand *band;
 
+   band = (struct mViewerBand *)ptr;
 
-            // Process scaling information
+   for(k=band->start; k<band->nrow; k+=band->stride)
+   {
+      if(band->color)
+         mViewer_colorRow(band, k);
+      else
+         mViewer_grayRow(band, k);
+   }
 
-            if(iscale >= 0)
-            {
-               if(cat[i].scaleType == FLUX)
-                  flux = flux / cat[i].scaleVal * cat[i].symSize;
-               else if(cat[i].scaleType == MAG)
-                  flux = (cat[i].scaleVal - flux + 1) * cat[i].symSize;
-               else if(cat[i].scaleType == LOGFLUX)
-                  flux = log10(10. * flux / cat[i].scaleVal) * cat[i].symSize;
-            }
+   return NULL;
+}
 
 
-            if(cat[i].symUnits == FRACTIONAL)
-                flux = flux * charHeight;
 
-             else if(cat[i].symUnits == SECONDS)
-                flux = flux / 3600.;
-        
-             else if(cat[i].symUnits == MINUTES)
-                flux = flux / 60.;
- 
-             else if(cat[i].symUnits == DEGREES)
-                flux = flux * 1.;
+/*************************************************************************/
+/*                                                                       */
+/*  One row of a grayscale/pseudocolor image.                            */
+/*                                                                       */
+/*************************************************************************/
 
-            else if(cat[i].symUnits == PIXELS)
-               flux = flux * pixScale;
+void mViewer_grayRow(struct mViewerBand *band, int k)
+{
+   int           i, index, row, col;
+   unsigned int  off;
+   double       *fitsbuf;
 
+   row = band->jj0 + k - band0;
 
-            if(flux < 0.1*charHeight)
-               flux = 0.1*charHeight;
+   fitsbuf = band->gray[k];
 
-            if(debug)
-            {
-               printf("%10.6f\n", flux);
-               fflush(stdout);
-            }
+   for(i=0; i<nx; ++i)
+   {
+      index = mViewer_grayIndex(&grayStretch, fitsbuf[i]);
 
+      col = i;
 
-            // Draw symbol
+      if(flipX)
+         col = nx-1-i;
 
-            if(symSize > 0)
-            {
-               mViewer_symbol(wcs, flipY, csysimg, epochimg, cat[i].csys, cat[i].epoch,
-                              ra, dec, 0, flux, symNPnt, symNMax, symType, symRotAngle, 
-                              ovlyred, ovlygreen, ovlyblue);
+      if(outType == JPEG)
+      {
+         jpegData[row][3*col  ] = color_table[index][0];
+         jpegData[row][3*col+1] = color_table[index][1];
+         jpegData[row][3*col+2] = color_table[index][2];
+      }
 
-               if(debug)
-               {
-                  printf("Symbol drawn.\n");
-                  fflush(stdout);
-               }
-            }
-            else
-            {
-               if(debug)
-               {
-                  printf("Symbol not drawn.\n");
-                  fflush(stdout);
-               }
-            }
+      else if(outType == PNG)
+      {
+         off = 4 * nx * row + 4 * col;
 
+         pngData[off + 0] = color_table[index][0];
+         pngData[off + 1] = color_table[index][1];
+         pngData[off + 2] = color_table[index][2];
+         pngData[off + 3] = 255;
+      }
+   }
+}
 
-            // Write label
 
-            if(ilabel >= 0)
-            {
-               strcpy(labelstr, tval(ilabel));
 
-               if(strlen(labelstr) > 0)
-               {
-                  wcs2pix(wcs, ra, dec, &xpix, &ypix, &offscl);
+/*************************************************************************/
+/*                                                                       */
+/*  One row of a three-color image.                                      */
+/*                                                                       */
+/*************************************************************************/
 
-                  fontSize = (int)(14. * cat[i].fontscale);
+void mViewer_colorRow(struct mViewerBand *band, int k)
+{
+   int           i, ipix, row, col;
+   unsigned int  off;
+   double        val, maxImVal, truecolor;
+   double        redImVal, greenImVal, blueImVal;
 
-                  if(fontSize < 1)
-                     fontSize = 1;
+   row = band->jj0 + k - band0;
 
-                  mViewer_draw_label(fontfile, fontSize, xpix, ypix, labelstr, ovlyred, ovlygreen, ovlyblue);
-               }
+   truecolor = band->truecolor;
 
-               if(debug)
-               {
-                  printf("Label [%s] at (%-g,%-g)\n", labelstr, xpix, ypix);
-                  fflush(stdout);
-               }
-            }
-         }
+   for(i=0; i<nx; ++i)
+   {
+      /* RED */
 
-         tclose();
-      }
+      ipix = i + band->istart - redStretch.xoff;
 
-      else /* IMAGE INFO */
-      {
-         ncol = topen(cat[i].file);
+      if(ipix < 0 || ipix >= redStretch.naxis1)
+         val = mynan;
+      else
+         val = band->red[k][ipix];
 
-         if(ncol <= 0)
-         {
-            sprintf(returnStruct->msg, "Invalid table file [%s].\" ]\n", cat[i].file);
-            return returnStruct;
-         }
-         
+      redImVal = mViewer_colorLevel(&redStretch, val);
 
-         // Color
 
-         icolor = -1;
+      /* GREEN */
 
-         if(strlen(cat[i].colorColumn) > 0)
-         {
-            icolor = tcol(cat[i].colorColumn);
+      ipix = i + band->istart - greenStretch.xoff;
 
-            if(icolor < 0)
-            {
-               sprintf(returnStruct->msg, "Cannot find color column [%s] in table [%s]", cat[i].colorColumn, cat[i].file);
-               return returnStruct;
-            }
-         }
+      if(ipix < 0 || ipix >= greenStretch.naxis1)
+         val = mynan;
+      else
+         val = band->green[k][ipix];
 
+      greenImVal = mViewer_colorLevel(&greenStretch, val);
 
-         // Find corner-related information
 
-         ira1  = tcol("ra1");
-         idec1 = tcol("dec1");
-         ira2  = tcol("ra2");
-         idec2 = tcol("dec2");
-         ira3  = tcol("ra3");
-         idec3 = tcol("dec3");
-         ira4  = tcol("ra4");
-         idec4 = tcol("dec4");
+      /* BLUE */
 
-         datatype = FOURCORNERS;
+      ipix = i + band->istart - blueStretch.xoff;
 
-         if(ira1 < 0 || idec1 < 0
-         || ira2 < 0 || idec2 < 0
-         || ira3 < 0 || idec3 < 0
-         || ira4 < 0 || idec4 < 0)
-         {
-            ictype1  = tcol("ctype1");
-            ictype2  = tcol("ctype2");
-            iequinox = tcol("equinox");
-            inl      = tcol("nl");
-            ins      = tcol("ns");
-            icrval1  = tcol("crval1");
-            icrval2  = tcol("crval2");
-            icrpix1  = tcol("crpix1");
-            icrpix2  = tcol("crpix2");
-            icdelt1  = tcol("cdelt1");
-            icdelt2  = tcol("cdelt2");
-            icrota2  = tcol("crota2");
-
-            if(ins < 0)
-               ins = tcol("naxis1");
-
-            if(inl < 0)
-               inl = tcol("naxis2");
-
-            if(ictype1 >= 0
-            && ictype2 >= 0
-            && inl     >= 0
-            && ins     >= 0
-            && icrval1 >= 0
-            && icrval2 >= 0
-            && icrpix1 >= 0
-            && icrpix2 >= 0
-            && icdelt1 >= 0
-            && icdelt2 >= 0
-            && icrota2 >= 0)
-
-               datatype = WCS;
+      if(ipix < 0 || ipix >= blueStretch.naxis1)
+         val = mynan;
+      else
+         val = band->blue[k][ipix];
 
-            else
-            {
-               sprintf(returnStruct->msg, "Cannot find 'ra1', 'dec1', etc. corners or WCS columns in table [%s]\n", cat[i].file);
-               return returnStruct;
-            }
-         }
+      blueImVal = mViewer_colorLevel(&blueStretch, val);
 
-         nimages = 0;
 
-         while(1)
-         {
-            stat = tread();
+      /* If we wish to preserve "color" */
 
-            ++nimages;
+      if(truecolor > 0.)
+      {
+         if(blueImVal  >= 255.
+         || greenImVal >= 255.
+         || redImVal   >= 255.)
+         {
+            maxImVal = redImVal;
 
-            if(stat < 0)
-               break;
+            if(greenImVal > maxImVal) maxImVal = greenImVal;
+            if(blueImVal  > maxImVal) maxImVal = blueImVal;
 
+            redImVal   = pow(redImVal   / maxImVal, truecolor) * 255.;
+            greenImVal = pow(greenImVal / maxImVal, truecolor) * 255.;
+            blueImVal  = pow(blueImVal  / maxImVal, truecolor) * 255.;
+         }
+         else
+         {
+            maxImVal = redImVal;
 
-            ovlyred   = cat[i].red;
-            ovlygreen = cat[i].green;
-            ovlyblue  = cat[i].blue;
+            if(greenImVal > maxImVal) maxImVal = greenImVal;
+            if(blueImVal  > maxImVal) maxImVal = blueImVal;
 
-            if(icolor >= 0)
+            if(maxImVal > 0.)
             {
-               if(!tnull(icolor))
-               {
-                  strcpy(colorstr, tval(icolor));
-
-                  if(mViewer_colorLookup(colorstr, &ovlyred, &ovlygreen, &ovlyblue))
-                  {
-                     strcpy(returnStruct->msg, montage_msgstr);
-                     return returnStruct;
-                  }
-               }
+               redImVal   = pow(redImVal   / maxImVal, truecolor) * maxImVal;
+               greenImVal = pow(greenImVal / maxImVal, truecolor) * maxImVal;
+               blueImVal  = pow(blueImVal  / maxImVal, truecolor) * maxImVal;
             }
+         }
+      }
+      else
+      {
+         if(blueImVal  > 255.) blueImVal  = 255.;
+         if(greenImVal > 255.) greenImVal = 255.;
+         if(redImVal   > 255.) redImVal   = 255.;
+      }
 
 
-            if(datatype == FOURCORNERS)
-            {
-               if(tnull(ira1) || tnull(idec1)
-               || tnull(ira2) || tnull(idec2)
-               || tnull(ira3) || tnull(idec3)
-               || tnull(ira4) || tnull(idec4))
-                  continue;
+      /* Populate the output array */
 
-               ra1  = atof(tval(ira1));
-               dec1 = atof(tval(idec1));
-               ra2  = atof(tval(ira2));
-               dec2 = atof(tval(idec2));
-               ra3  = atof(tval(ira3));
-               dec3 = atof(tval(idec3));
-               ra4  = atof(tval(ira4));
-               dec4 = atof(tval(idec4));
-            }
-            else
-            {
-               strcpy(im_ctype1, tval(ictype1));
-               strcpy(im_ctype2, tval(ictype2));
-
-               im_naxis1    = atoi(tval(ins));
-               im_naxis2    = atoi(tval(inl));
-               im_crpix1    = atof(tval(icrpix1));
-               im_crpix2    = atof(tval(icrpix2));
-               im_crval1    = atof(tval(icrval1));
-               im_crval2    = atof(tval(icrval2));
-               im_cdelt1    = atof(tval(icdelt1));
-               im_cdelt2    = atof(tval(icdelt2));
-               im_crota2    = atof(tval(icrota2));
-               im_equinox   = 2000;
-
-               if(iequinox >= 0)
-                  im_equinox = atoi(tval(iequinox));
-
-               strcpy(im_header, "");
-               sprintf(temp, "SIMPLE  = T"                 ); mViewer_stradd(im_header, temp);
-               sprintf(temp, "BITPIX  = -64"               ); mViewer_stradd(im_header, temp);
-               sprintf(temp, "NAXIS   = 2"                 ); mViewer_stradd(im_header, temp);
-               sprintf(temp, "NAXIS1  = %d",     im_naxis1 ); mViewer_stradd(im_header, temp);
-               sprintf(temp, "NAXIS2  = %d",     im_naxis2 ); mViewer_stradd(im_header, temp);
-               sprintf(temp, "CTYPE1  = '%s'",   im_ctype1 ); mViewer_stradd(im_header, temp);
-               sprintf(temp, "CTYPE2  = '%s'",   im_ctype2 ); mViewer_stradd(im_header, temp);
-               sprintf(temp, "CRVAL1  = %11.6f", im_crval1 ); mViewer_stradd(im_header, temp);
-               sprintf(temp, "CRVAL2  = %11.6f", im_crval2 ); mViewer_stradd(im_header, temp);
-               sprintf(temp, "CRPIX1  = %11.6f", im_crpix1 ); mViewer_stradd(im_header, temp);
-               sprintf(temp, "CRPIX2  = %11.6f", im_crpix2 ); mViewer_stradd(im_header, temp);
-               sprintf(temp, "CDELT1  = %14.9f", im_cdelt1 ); mViewer_stradd(im_header, temp);
-               sprintf(temp, "CDELT2  = %14.9f", im_cdelt2 ); mViewer_stradd(im_header, temp);
-               sprintf(temp, "CROTA2  = %11.6f", im_crota2 ); mViewer_stradd(im_header, temp);
-               sprintf(temp, "EQUINOX = %d",     im_equinox); mViewer_stradd(im_header, temp);
-               sprintf(temp, "END"                         ); mViewer_stradd(im_header, temp);
-
-               im_wcs = wcsinit(im_header);
-
-               if(im_wcs == (struct WorldCoor *)NULL)
-               {
-                  sprintf(returnStruct->msg, "Bad WCS for image %d", nimages);
-                  return returnStruct;
-               }
+      col = i;
 
-               montage_checkWCS(im_wcs);
+      if(flipX)
+         col = nx-1-i;
+
+      if(outType == JPEG)
+      {
+         jpegData[row][3*col  ] = (int)redImVal;
+         jpegData[row][3*col+1] = (int)greenImVal;
+         jpegData[row][3*col+2] = (int)blueImVal;
+      }
 
+      else if(outType == PNG)
+      {
+         off = 4 * nx * row + 4 * col;
 
-               /* Get the coordinate system and epoch in a     */
-               /* form compatible with the conversion library  */
+         pngData[off + 0] = (int)redImVal;
+         pngData[off + 1] = (int)greenImVal;
+         pngData[off + 2] = (int)blueImVal;
+         pngData[off + 3] = 255;
+      }
+   }
+}
 
-               if(im_wcs->syswcs == WCS_J2000)
-               {
-                  im_sys   = EQUJ;
-                  im_epoch = 2000.;
 
-                  if(im_wcs->equinox == 1950)
-                     im_epoch = 1950.;
-               }
-               else if(im_wcs->syswcs == WCS_B1950)
-               {
-                  im_sys   = EQUB;
-                  im_epoch = 1950.;
 
-                  if(im_wcs->equinox == 2000)
-                     im_epoch = 2000;
-               }
-               else if(im_wcs->syswcs == WCS_GALACTIC)
-               {
-                  im_sys   = GAL;
-                  im_epoch = 2000.;
-               }
-               else if(im_wcs->syswcs == WCS_ECLIPTIC)
-               {
-                  im_sys   = ECLJ;
-                  im_epoch = 2000.;
+/*************************************************************************/
+/*                                                                       */
+/*  Work out a cap on the sky (in the overlay's coordinate system)       */
+/*  that contains the whole output image, plus a margin.  If the image   */
+/*  is very wide or parts of it are off the projection, we just return   */
+/*  the whole sky.                                                       */
+/*                                                                       */
+/*************************************************************************/
 
-                  if(im_wcs->equinox == 1950)
-                  {
-                     im_sys   = ECLB;
-                     im_epoch = 1950.;
-                  }
-               }
-               else
-               {
-                  im_sys   = EQUJ;
-                  im_epoch = 2000.;
-               }
+int mViewer_viewCap(int csysimg, double epochimg, int csys, double epoch,
+                    double *x, double *y, double *z, double *radius)
+{
+   int    i, j, offscl;
+   double xpix, ypix, lon, lat, ra, dec;
+   double px, py, pz, dist, maxdist;
 
+   *x = 1.;
+   *y = 0.;
+   *z = 0.;
 
-               /* Compute the locations of the corners of the images */
+   *radius = 180.;
 
-               pix2wcs(im_wcs, 0.5, 0.5, &xpos, &ypos);
+   pix2wcs(wcs, (wcs->nxpix+1.)/2., (wcs->nypix+1.)/2., &lon, &lat);
 
-               convertCoordinates(im_sys, im_epoch, xpos, ypos,
-                                  EQUJ, 2000., &ra1, &dec1, 0.0);
+   if(wcs->offscl)
+      return 1;
 
-               pix2wcs(im_wcs, im_naxis1+0.5, 0.5, &xpos, &ypos);
+   convertCoordinates(csysimg, epochimg, lon, lat, csys, epoch, &ra, &dec, 0.0);
 
-               convertCoordinates(im_sys, im_epoch, xpos, ypos,
-                                  EQUJ, 2000., &ra2, &dec2, 0.0);
+   *x = cos(ra*dtr) * cos(dec*dtr);
+   *y = sin(ra*dtr) * cos(dec*dtr);
+   *z = sin(dec*dtr);
 
-               pix2wcs(im_wcs, im_naxis1+0.5, im_naxis2+0.5, &xpos, &ypos);
+   maxdist = 0.;
 
-               convertCoordinates(im_sys, im_epoch, xpos, ypos,
-                                  EQUJ, 2000., &ra3, &dec3, 0.0);
+   offscl = 0;
 
-               pix2wcs(im_wcs, 0.5, im_naxis2+0.5, &xpos, &ypos);
+   for(j=0; j<5; ++j)
+   {
+      for(i=0; i<5; ++i)
+      {
+         xpix = 0.5 + i * wcs->nxpix / 4.;
+         ypix = 0.5 + j * wcs->nypix / 4.;
 
-               convertCoordinates(im_sys, im_epoch, xpos, ypos,
-                                  EQUJ, 2000., &ra4, &dec4, 0.0);
-            }
+         pix2wcs(wcs, xpix, ypix, &lon, &lat);
 
-            mViewer_great_circle(wcs, flipY, csysimg, epochimg, cat[i].csys, cat[i].epoch, ra1, dec1, ra2, dec2, ovlyred, ovlygreen, ovlyblue);
-            mViewer_great_circle(wcs, flipY, csysimg, epochimg, cat[i].csys, cat[i].epoch, ra2, dec2, ra3, dec3, ovlyred, ovlygreen, ovlyblue);
-            mViewer_great_circle(wcs, flipY, csysimg, epochimg, cat[i].csys, cat[i].epoch, ra3, dec3, ra4, dec4, ovlyred, ovlygreen, ovlyblue);
-            mViewer_great_circle(wcs, flipY, csysimg, epochimg, cat[i].csys, cat[i].epoch, ra4, dec4, ra1, dec1, ovlyred, ovlygreen, ovlyblue);
+         if(wcs->offscl)
+         {
+            offscl = 1;
+            break;
          }
 
-         tclose();
-      }
+         convertCoordinates(csysimg, epochimg, lon, lat, csys, epoch, &ra, &dec, 0.0);
 
-      mViewer_addOverlay();
-   }
+         px = cos(ra*dtr) * cos(dec*dtr);
+         py = sin(ra*dtr) * cos(dec*dtr);
+         pz = sin(dec*dtr);
 
+         dist = px * *x + py * *y + pz * *z;
 
-   for(i=0; i<nmark; ++i)
-   {
-      flux = mark[i].symSize;
+         if(dist >  1.) dist =  1.;
+         if(dist < -1.) dist = -1.;
 
-      if(mark[i].symUnits == FRACTIONAL)
-         flux = flux * charHeight;
+         dist = acos(dist) / dtr;
 
-      else if(mark[i].symUnits == SECONDS)
-         flux = flux / 3600.;
- 
-      else if(mark[i].symUnits == MINUTES)
-         flux = flux / 60.;
- 
-      else if(mark[i].symUnits == DEGREES)
-         flux = flux * 1.;
- 
-      else if(mark[i].symUnits == PIXELS)
-         flux = flux * pixScale;
- 
-      mViewer_symbol(wcs, flipY, csysimg, epochimg, mark[i].csys, mark[i].epoch,
-                     mark[i].ra, mark[i].dec, mark[i].inpix, flux, 
-                     mark[i].symNPnt, mark[i].symNMax, mark[i].symType, mark[i].symRotAngle, 
-                     mark[i].red, mark[i].green, mark[i].blue);
+         if(dist > maxdist)
+            maxdist = dist;
+      }
 
-      mViewer_addOverlay();
+      if(offscl)
+         break;
    }
 
+   if(offscl)
+      return 1;
 
-   for(i=0; i<nlabel; ++i)
-   {
-      if(label[i].inpix == 0)
-      {
-         ra  = label[i].x;
-         dec = label[i].y;
-
-         wcs2pix(wcs, ra, dec, &xpix, &ypix, &offscl);
+   *radius = maxdist * (1. + VIEWPAD);
 
-         label[i].x = xpix;
-         label[i].y = ypix;
+   if(*radius > 90.)
+      *radius = 180.;
 
-         if(debug)
-         {
-            printf("DEBUG> label [%s]: (%-g,%-g) -> (%-g,%-g)\n", label[i].text, ra, dec, label[i].x, label[i].y);
-            fflush(stdout);
-         }
-      }
+   return 1;
+}
 
-      ix = label[i].x;
-      iy = label[i].y;
 
-      fontSize = (int)(14. * label[i].fontscale);
 
-      if(fontSize < 1)
-         fontSize = 1;
+/*************************************************************************/
+/*                                                                       */
+/*  Draw source density (rather than individual symbols) for a crowded   */
+/*  catalog overlay.  The source locations come from the spatial index   */
+/*  as unit vectors; we count them in square cells of 'binsize' pixels   */
+/*  and fill each non-empty cell with the overlay color, with a          */
+/*  brightness that scales logarithmically with the count.               */
+/*                                                                       */
+/*************************************************************************/
 
-      mViewer_draw_label(fontfile, fontSize, ix, iy, label[i].text, label[i].red, label[i].green, label[i].blue);
-      mViewer_addOverlay();
-   }
+void mViewer_drawDensity(double *xyz, long npts, int csysimg, double epochimg, int csys, double epoch,
+                         int binsize, double red, double green, double blue)
+{
+   long    k;
+   int     i, j, ix, iy, nbx, nby, offscl;
+   int    *count, cmax;
+   double  lon, lat, ilon, ilat, xpix, ypix, xc, yc;
+   double  brightness;
 
+   if(binsize < 1)
+      binsize = 1;
 
-   /* Write data to JPEG file */
-      
-   if(outType == JPEG)
-   {
-      for(jj=0; jj<ny; ++jj)
-      {
-         jpegptr = (JSAMPARRAY) &jpegData[jj];
+   nbx = wcs->nxpix / binsize + 1;
+   nby = wcs->nypix / binsize + 1;
 
-         jpeg_write_scanlines(&cinfo, jpegptr, 1);
-      }
-   }
+   count = (int *)calloc(nbx * nby, sizeof(int));
 
+   if(count == (int *)NULL)
+      return;
 
-   /* Close up the image file and get out */
+   cmax = 0;
 
-   if(outType == JPEG)
+   for(k=0; k<npts; ++k)
    {
-      jpeg_finish_compress(&cinfo);
+      lon = atan2(xyz[3*k+1], xyz[3*k]) / dtr;
 
-      fclose(jpegfp);
+      if(lon < 0.)
+         lon += 360.;
 
-      jpeg_destroy_compress(&cinfo);
-   }
+      lat = xyz[3*k+2];
 
-   else if(outType == PNG)
-   {
-      // pngError = lodepng_encode32_file(pngfile, pngData, nx, ny);
+      if(lat >  1.) lat =  1.;
+      if(lat < -1.) lat = -1.;
 
-      pngError =  mViewer_writePNG(pngfile, pngData, nx, ny, comment);
+      lat = asin(lat) / dtr;
 
-      if(pngError)
+      if(csys != csysimg || epoch != epochimg)
+         convertCoordinates(csys, epoch, lon, lat, csysimg, epochimg, &ilon, &ilat, 0.0);
+      else
       {
-         strcpy(returnStruct->msg, lodepng_error_text(pngError));
-         return(returnStruct);
+         ilon = lon;
+         ilat = lat;
       }
-   }
 
+      wcs2pix(wcs, ilon, ilat, &xpix, &ypix, &offscl);
 
-   returnStruct->status = 0;
+      if(offscl)
+         continue;
 
-   if(isRGB)
-   {
-      sprintf(returnStruct->msg, "type=\"color\", width=%d, height=%d, bmin=%-g, bminpercent=%.2f, bminsigma=%2f, bmax=%-g, bmaxpercent=%.2f, bmaxsigma=%.2f, gmin=%-g, gminpercent=%.2f, gminsigma=%.2f, gmax=%-g, gmaxpercent=%.2f, gmaxsigma=%.2f, rmin=%-g, rminpercent=%.2f, rminsigma=%.2f, rmax=%-g, rmaxpercent=%.2f, rmaxsigma=%.2f, rdatamin=%-g, rdatamax=%-g, gdatamin=%-g, gdatamax=%-g, bdatamin=%-g, bdatamax=%-g, xflip=%d, yflip=%d, bunit=\"%s\"",
-         nx, ny,
-         blueminval,  blueminpercent,  blueminsigma,
-         bluemaxval,  bluemaxpercent,  bluemaxsigma,
-         greenminval, greenminpercent, greenminsigma,
-         greenmaxval, greenmaxpercent, greenmaxsigma,
-         redminval,   redminpercent,   redminsigma,
-         redmaxval,   redmaxpercent,   redmaxsigma,
-         rdatamin,    rdatamax,
-         gdatamin,    gdatamax,
-         bdatamin,    bdatamax,
-         flipX,       flipY,
-         bunit);
+      xc = xpix;
+      yc = (!flipY || wcs->imflip) ? wcs->nypix - ypix : ypix;
 
-      sprintf(returnStruct->json, "\"type\":\"color\", \"width\":%d, \"height\":%d, \"bmin\":%-g, \"bminpercent\":%.2f, \"bminsigma\":%2f, \"bmax\":%-g, \"bmaxpercent\":%.2f, \"bmaxsigma\":%.2f, \"gmin\":%-g, \"gminpercent\":%.2f, \"gminsigma\":%.2f, \"gmax\":%-g, \"gmaxpercent\":%.2f, \"gmaxsigma\":%.2f, \"rmin\":%-g, \"rminpercent\":%.2f, \"rminsigma\":%.2f, \"rmax\":%-g, \"rmaxpercent\":%.2f, \"rmaxsigma\":%.2f, \"rdatamin\":%-g, \"rdatamax\":%-g, \"gdatamin\":%-g, \"gdatamax\":%-g, \"bdatamin\":%-g, \"bdatamax\":%-g, \"xflip\":%d, \"yflip\":%d, \"bunit\":\"%s\"}",
-         nx, ny,
-         blueminval,  blueminpercent,  blueminsigma,
-         bluemaxval,  bluemaxpercent,  bluemaxsigma,
-         greenminval, greenminpercent, greenminsigma,
-         greenmaxval, greenmaxpercent, greenmaxsigma,
-         redminval,   redminpercent,   redminsigma,
-         redmaxval,   redmaxpercent,   redmaxsigma,
-         rdatamin,    rdatamax,
-         gdatamin,    gdatamax,
-         bdatamin,    bdatamax,
-         flipX,       flipY,
-         bunit);
+      if(xc < 0. || yc < 0.)
+         continue;
 
-      strcpy(returnStruct->type, "color");
-      
-      returnStruct->nx              = nx;
-      returnStruct->ny              = ny;
-      returnStruct->grayminval      = 0.;
-      returnStruct->grayminpercent  = 0.;
-      returnStruct->grayminsigma    = 0.;
-      returnStruct->graymaxval      = 0.;
-      returnStruct->graymaxpercent  = 0.;
-      returnStruct->graymaxsigma    = 0.;
-      returnStruct->blueminval      = blueminval;
-      returnStruct->blueminpercent  = blueminpercent;
-      returnStruct->blueminsigma    = blueminsigma;
-      returnStruct->bluemaxval      = bluemaxval;
-      returnStruct->bluemaxpercent  = bluemaxpercent;
-      returnStruct->bluemaxsigma    = bluemaxsigma;
-      returnStruct->greenminval     = greenminval;
-      returnStruct->greenminpercent = greenminpercent;
-      returnStruct->greenminsigma   = greenminsigma;
-      returnStruct->greenmaxval     = greenmaxval;
-      returnStruct->greenmaxpercent = greenmaxpercent;
-      returnStruct->greenmaxsigma   = greenmaxsigma;
-      returnStruct->redminval       = redminval;
-      returnStruct->redminpercent   = redminpercent;
-      returnStruct->redminsigma     = redminsigma;
-      returnStruct->redmaxval       = redmaxval;
-      returnStruct->redmaxpercent   = redmaxpercent;
-      returnStruct->redmaxsigma     = redmaxsigma;
-      returnStruct->graydatamin     = 0.;
-      returnStruct->graydatamax     = 0.;
-      returnStruct->rdatamin        = rdatamin;
-      returnStruct->rdatamax        = rdatamax;
-      returnStruct->gdatamin        = gdatamin;
-      returnStruct->gdatamax        = gdatamax;
-      returnStruct->bdatamin        = bdatamin;
-      returnStruct->bdatamax        = bdatamax;
-      returnStruct->flipX           = flipX;
-      returnStruct->flipY           = flipY;
-      returnStruct->colortable      = 0;
+      ix = (int)(xc / binsize);
+      iy = (int)(yc / binsize);
 
-      strcpy(returnStruct->bunit, bunit);
+      if(ix >= nbx || iy >= nby)
+         continue;
+
+      ++count[iy*nbx + ix];
+
+      if(count[iy*nbx + ix] > cmax)
+         cmax = count[iy*nbx + ix];
    }
-   else
+
+   if(debug)
    {
-     sprintf(returnStruct->msg, "type=\"grayscale\", width=%d, height=%d, min=%-g, minpercent=%.2f, minsigma=%.2f, max=%-g, maxpercent=%.2f, maxsigma=%.2f, datamin=%-g, datamax=%-g, xflip=%d, yflip=%d, bunit=\"%s\", colortable=%d",
-         nx, ny,
-         grayminval,  grayminpercent, grayminsigma,
-         graymaxval,  graymaxpercent, graymaxsigma,
-         graydatamin, graydatamax,
-         flipX,       flipY,
-         bunit,       colortable);
+      printf("DEBUG> Density overlay: %ld sources, %dx%d cells of %d pixels, max count %d\n",
+         npts, nbx, nby, binsize, cmax);
+      fflush(stdout);
+   }
 
-     sprintf(returnStruct->json, "\"type\":\"grayscale\", \"width\":%d, \"height\":%d, \"min\":%-g, \"minpercent\":%.2f, \"minsigma\":%.2f, \"max\":%-g, \"maxpercent\":%.2f, \"maxsigma\":%.2f, \"datamin\":%-g, \"datamax\":%-g, \"xflip\":%d, \"yflip\":%d, \"bunit\":\"%s\", \"colortable\":%d",
-         nx, ny,
-         grayminval,  grayminpercent, grayminsigma,
-         graymaxval,  graymaxpercent, graymaxsigma,
-         graydatamin, graydatamax,
-         flipX,       flipY,
-         bunit,       colortable);
+   for(iy=0; iy<nby; ++iy)
+   {
+      for(ix=0; ix<nbx; ++ix)
+      {
+         if(count[iy*nbx + ix] == 0)
+            continue;
 
-      strcpy(returnStruct->type, "grayscale");
-     
-      returnStruct->nx              = nx;
-      returnStruct->ny              = ny;
-      returnStruct->grayminval      = grayminval;
-      returnStruct->grayminpercent  = grayminpercent;
-      returnStruct->grayminsigma    = grayminsigma;
-      returnStruct->graymaxval      = graymaxval;
-      returnStruct->graymaxpercent  = graymaxpercent;
-      returnStruct->graymaxsigma    = graymaxsigma;
-      returnStruct->blueminval      = 0.;
-      returnStruct->blueminpercent  = 0.;
-      returnStruct->blueminsigma    = 0.;
-      returnStruct->bluemaxval      = 0.;
-      returnStruct->bluemaxpercent  = 0.;
-      returnStruct->bluemaxsigma    = 0.;
-      returnStruct->greenminval     = 0.;
-      returnStruct->greenminpercent = 0.;
-      returnStruct->greenminsigma   = 0.;
-      returnStruct->greenmaxval     = 0.;
-      returnStruct->greenmaxpercent = 0.;
-      returnStruct->greenmaxsigma   = 0.;
-      returnStruct->redminval       = 0.;
-      returnStruct->redminpercent   = 0.;
-      returnStruct->redminsigma     = 0.;
-      returnStruct->redmaxval       = 0.;
-      returnStruct->redmaxpercent   = 0.;
-      returnStruct->redmaxsigma     = 0.;
-      returnStruct->graydatamin     = graydatamin;
-      returnStruct->graydatamax     = graydatamax;
-      returnStruct->rdatamin        = 0.;
-      returnStruct->rdatamax        = 0.;
-      returnStruct->gdatamin        = 0.;
-      returnStruct->gdatamax        = 0.;
-      returnStruct->bdatamin        = 0.;
-      returnStruct->bdatamax        = 0.;
-      returnStruct->flipX           = flipX;
-      returnStruct->flipY           = flipY;
-      returnStruct->colortable      = colortable;
+         brightness = 0.25 + 0.75 * log(1. + count[iy*nbx + ix]) / log(1. + cmax);
 
-      strcpy(returnStruct->bunit, bunit);
+         for(j=iy*binsize; j<(iy+1)*binsize; ++j)
+            for(i=ix*binsize; i<(ix+1)*binsize; ++i)
+               mViewer_setPixel(i, j, brightness, red, green, blue, 0);
+      }
    }
 
-   return returnStruct;
+   free(count);
 }
 
 
@@ -6031,6 +7467,8 @@ void mViewer_printFitsError(int status)
 /***********************************/
 
 
+static int lastColorTable = -1;
+
 void mViewer_createColorTable(int itable)
 {
     int    i, j, nseg;
@@ -6139,6 +7577,13 @@ void mViewer_createColorTable(int itable)
                             0,   0,   0,  85, 170, 255}; 
 
 
+   /* The table is left as is between calls (e.g. in batch mode) */
+
+   if(itable == lastColorTable)
+      return;
+
+   lastColorTable = itable;
+
    switch(itable)
    {
       case 0:
@@ -6358,35 +7803,178 @@ int mViewer_parseRange(char const *str, char const *kind, double *val, double *e
       }
    }
 
-   /* look for a trailing numeric term */
-   *extra = 0.0;
-   while (isspace(*ptr)) ++ptr;
-   if (*ptr == '-' || *ptr == '+') {
-      sign = (*ptr == '-') ? -1.0 : 1.0;
-      ++ptr;
-      while (isspace(*ptr)) ++ptr;
-      *extra = strtod(ptr, &end) * sign;
-      if (errno != 0) {
-         sprintf(montage_msgstr, "extra numeric term in %s '%s' cannot be converted to a finite floating point number",
-                kind, str);
-         return 1;
-      }
-      if (ptr == end) {
-         sprintf(montage_msgstr, "%s '%s' contains trailing junk", kind, str);
-         return 1;
+   /* look for a trailing numeric term */
+   *extra = 0.0;
+   while (isspace(*ptr)) ++ptr;
+   if (*ptr == '-' || *ptr == '+') {
+      sign = (*ptr == '-') ? -1.0 : 1.0;
+      ++ptr;
+      while (isspace(*ptr)) ++ptr;
+      *extra = strtod(ptr, &end) * sign;
+      if (errno != 0) {
+         sprintf(montage_msgstr, "extra numeric term in %s '%s' cannot be converted to a finite floating point number",
+                kind, str);
+         return 1;
+      }
+      if (ptr == end) {
+         sprintf(montage_msgstr, "%s '%s' contains trailing junk", kind, str);
+         return 1;
+      }
+      ptr = end;
+   }
+   while (isspace(*ptr)) ++ptr;
+   if (*ptr != '\0') {
+      sprintf(montage_msgstr, "%s '%s' contains trailing junk", kind, str);
+      return 1;
+   }
+
+   return 0;
+}
+
+
+/*************************************************************************/
+/*                                                                       */
+/*  Image files in batch mode                                            */
+/*                                                                       */
+/*  A single mViewer call opens and checks its images once.  In batch    */
+/*  mode (see mViewerBatch()) the same few mosaics are drawn over and    */
+/*  over, so the open file (one handle per HDU, as the three colors may  */
+/*  come from different HDUs of one file) and the fact that its header   */
+/*  passed the check are kept from one view to the next.  An entry is    */
+/*  dropped if the file has changed on disk (size or modification time)  */
+/*  and the oldest entry is closed when the table is full.               */
+/*                                                                       */
+/*************************************************************************/
+
+struct mViewerFile
+{
+   char      name[MAXSTR];
+   int       hdu;
+   time_t    mtime;
+   off_t     size;
+   int       hdrOK;
+   fitsfile *fptr;
+};
+
+static struct mViewerFile fileCache[MAXFILECACHE];
+
+static int nfileCache = 0;
+static int fileNext   = 0;
+
+
+static struct mViewerFile *mViewer_fileEntry(char *file, int hdu)
+{
+   int    i, status;
+
+   struct stat buf;
+
+   struct mViewerFile *entry;
+
+   if(strlen(file) >= MAXSTR || stat(file, &buf) != 0)
+      return (struct mViewerFile *)NULL;
+
+   entry = (struct mViewerFile *)NULL;
+
+   for(i=0; i<nfileCache; ++i)
+   {
+      if(fileCache[i].hdu == hdu && strcmp(fileCache[i].name, file) == 0)
+      {
+         entry = &fileCache[i];
+         break;
+      }
+   }
+
+   if(entry != (struct mViewerFile *)NULL)
+   {
+      if(entry->mtime == buf.st_mtime && entry->size == buf.st_size)
+         return entry;
+   }
+   else if(nfileCache < MAXFILECACHE)
+   {
+      entry = &fileCache[nfileCache];
+
+      ++nfileCache;
+   }
+   else
+   {
+      entry = &fileCache[fileNext];
+
+      fileNext = (fileNext + 1) % MAXFILECACHE;
+   }
+
+   if(entry->fptr != (fitsfile *)NULL)
+   {
+      status = 0;
+      fits_close_file(entry->fptr, &status);
+   }
+
+   strcpy(entry->name, file);
+
+   entry->hdu   = hdu;
+   entry->mtime = buf.st_mtime;
+   entry->size  = buf.st_size;
+   entry->hdrOK = 0;
+   entry->fptr  = (fitsfile *)NULL;
+
+   return entry;
+}
+
+
+/* Header check (montage_checkHdr()), remembered when it passes */
+
+char *mViewer_checkHdr(char *file, int hdu)
+{
+   char *msg;
+
+   struct mViewerFile *entry;
+
+   if(!batchCache)
+      return montage_checkHdr(file, 0, hdu);
+
+   entry = mViewer_fileEntry(file, hdu);
+
+   if(entry != (struct mViewerFile *)NULL && entry->hdrOK)
+      return (char *)NULL;
+
+   msg = montage_checkHdr(file, 0, hdu);
+
+   if(msg == (char *)NULL && entry != (struct mViewerFile *)NULL)
+      entry->hdrOK = 1;
+
+   return msg;
+}
+
+
+/* Open an image (the caller still moves to the HDU) */
+
+int mViewer_openFile(fitsfile **fptr, char *file, int hdu, int *status)
+{
+   struct mViewerFile *entry;
+
+   if(!batchCache)
+      return fits_open_file(fptr, file, READONLY, status);
+
+   entry = mViewer_fileEntry(file, hdu);
+
+   if(entry == (struct mViewerFile *)NULL)
+      return fits_open_file(fptr, file, READONLY, status);
+
+   if(entry->fptr == (fitsfile *)NULL)
+   {
+      if(fits_open_file(&entry->fptr, file, READONLY, status))
+      {
+         entry->fptr = (fitsfile *)NULL;
+         return *status;
       }
-      ptr = end;
-   }
-   while (isspace(*ptr)) ++ptr;
-   if (*ptr != '\0') {
-      sprintf(montage_msgstr, "%s '%s' contains trailing junk", kind, str);
-      return 1;
    }
 
-   return 0;
+   *fptr = entry->fptr;
+
+   return *status;
 }
 
 
+
 /***********************************/
 /*                                 */
 /*  Histogram percentile ranges    */
@@ -6405,51 +7993,206 @@ double  gausslev[NBIN];
 unsigned long npix;
 
 double  delta, rmin, rmax;
- 
-int mViewer_getRange(fitsfile *fptr, char *minstr, char *maxstr,
-                     double *rangemin, double *rangemax, 
-                     int type, char *betastr, double *rangebeta, double *dataval,
-                     int imnaxis1, int imnaxis2,  double *datamin, double *datamax,
-                     double *median, double *sig,
-                     int count, int *planes)
+
+
+/* Batch mode keeps the histograms of the images it */
+/* has scanned (the two passes through the data are */
+/* most of the work for a percentile or Gaussian    */
+/* stretch) and of the histogram files it has read  */
+
+struct mViewerHist
 {
-   int     i, j, k, mintype, maxtype, betatype, nullcnt, status;
-   long    fpixel[4], nelements;
-   double  d, diff, minval, maxval, betaval;
-   double  lev16, lev50, lev84, sigma;
-   double  minextra, maxextra, betaextra;
-   double *data;
+   int            used;
+   char           name[MAXSTR];
+   int            hdu;
+   int            plane[2];
+   time_t         mtime;
+   off_t          size;
+   double         rmin, rmax;
+   unsigned long  npix;
+   int           *hist;
+};
+
+struct mViewerHistFile
+{
+   int            used;
+   char           name[MAXSTR];
+   time_t         mtime;
+   off_t          size;
+   int            type;
+   double         minval, maxval;
+   double         datamin, datamax;
+   double         median, sigma;
+   double         rmin, rmax, delta;
+   unsigned long  npix;
+   double         dataval[256];
+   int           *hist;
+   double        *chist;
+   double        *datalev;
+   double        *gausslev;
+};
+
+static struct mViewerHist     imgHist [MAXHISTCACHE];
+static struct mViewerHistFile fileHist[MAXHISTCACHE];
+
+static int imgHistNext  = 0;
+static int fileHistNext = 0;
+
+
+static struct mViewerHist *mViewer_imgHist(fitsfile *fptr, int count, int *planes, int *found)
+{
+   int    i, hdu, plane[2], status;
+   char   name[MAXSTR];
 
-   double  glow, ghigh, gaussval, gaussstep;
-   double  dlow, dhigh;
-   double  gaussmin, gaussmax;
+   struct stat buf;
 
+   struct mViewerHist *entry;
 
-   nbin = NBIN - 1;
+   *found = 0;
 
-   /* MIN/MAX: Determine what type of  */
-   /* range string we are dealing with */
+   status = 0;
 
-   if(mViewer_parseRange(minstr, "display min", &minval, &minextra, &mintype))
-      return 1;
+   if(fits_file_name(fptr, name, &status) || fits_get_hdu_num(fptr, &hdu) == 0)
+      return (struct mViewerHist *)NULL;
 
-   if(mViewer_parseRange(maxstr, "display max", &maxval, &maxextra, &maxtype))
-      return 1;
+   if(stat(name, &buf) != 0)
+      return (struct mViewerHist *)NULL;
 
-   betaval   = 0.;
-   betaextra = 0.;
+   plane[0] = (count > 1 ? planes[1] : 1);
+   plane[1] = (count > 2 ? planes[2] : 1);
 
-   if (type == ASINH) {
-      if(mViewer_parseRange(betastr, "beta value", &betaval, &betaextra, &betatype))
-         return 1;
+   for(i=0; i<MAXHISTCACHE; ++i)
+   {
+      entry = &imgHist[i];
+
+      if(entry->used
+      && entry->hdu      == hdu
+      && entry->plane[0] == plane[0]
+      && entry->plane[1] == plane[1]
+      && entry->mtime    == buf.st_mtime
+      && entry->size     == buf.st_size
+      && strcmp(entry->name, name) == 0)
+      {
+         *found = 1;
+         return entry;
+      }
    }
 
-   /* If we don't have to generate the image */
-   /* histogram, get out now                 */
+   entry = &imgHist[imgHistNext];
 
-   *rangemin  = minval + minextra;
-   *rangemax  = maxval + maxextra;
-   *rangebeta = betaval + betaextra;
+   imgHistNext = (imgHistNext + 1) % MAXHISTCACHE;
+
+   if(entry->hist == (int *)NULL)
+      entry->hist = (int *)malloc(NBIN * sizeof(int));
+
+   strcpy(entry->name, name);
+
+   entry->used     = 0;
+   entry->hdu      = hdu;
+   entry->plane[0] = plane[0];
+   entry->plane[1] = plane[1];
+   entry->mtime    = buf.st_mtime;
+   entry->size     = buf.st_size;
+
+   return entry;
+}
+
+
+static struct mViewerHistFile *mViewer_fileHist(char *histfile, int *found)
+{
+   int    i;
+
+   struct stat buf;
+
+   struct mViewerHistFile *entry;
+
+   *found = 0;
+
+   if(strlen(histfile) >= MAXSTR || stat(histfile, &buf) != 0)
+      return (struct mViewerHistFile *)NULL;
+
+   for(i=0; i<MAXHISTCACHE; ++i)
+   {
+      entry = &fileHist[i];
+
+      if(entry->used
+      && entry->mtime == buf.st_mtime
+      && entry->size  == buf.st_size
+      && strcmp(entry->name, histfile) == 0)
+      {
+         *found = 1;
+         return entry;
+      }
+   }
+
+   entry = &fileHist[fileHistNext];
+
+   fileHistNext = (fileHistNext + 1) % MAXHISTCACHE;
+
+   if(entry->hist == (int *)NULL)
+   {
+      entry->hist     = (int    *)malloc(NBIN * sizeof(int));
+      entry->chist    = (double *)malloc(NBIN * sizeof(double));
+      entry->datalev  = (double *)malloc(NBIN * sizeof(double));
+      entry->gausslev = (double *)malloc(NBIN * sizeof(double));
+   }
+
+   strcpy(entry->name, histfile);
+
+   entry->used  = 0;
+   entry->mtime = buf.st_mtime;
+   entry->size  = buf.st_size;
+
+   return entry;
+}
+
+
+/* Close the files and release the histograms kept in batch mode */
+
+void mViewer_cacheFree()
+{
+   int i, status;
+
+   for(i=0; i<nfileCache; ++i)
+   {
+      if(fileCache[i].fptr != (fitsfile *)NULL)
+      {
+         status = 0;
+         fits_close_file(fileCache[i].fptr, &status);
+      }
+   }
+
+   nfileCache = 0;
+   fileNext   = 0;
+
+   bzero((void *)fileCache, sizeof(fileCache));
+
+   for(i=0; i<MAXHISTCACHE; ++i)
+   {
+      free(imgHist[i].hist);
+
+      free(fileHist[i].hist);
+      free(fileHist[i].chist);
+      free(fileHist[i].datalev);
+      free(fileHist[i].gausslev);
+   }
+
+   imgHistNext  = 0;
+   fileHistNext = 0;
+
+   bzero((void *)imgHist,  sizeof(imgHist));
+   bzero((void *)fileHist, sizeof(fileHist));
+}
+
+
+/* Scan an image for its data range and histogram */
+
+void mViewer_scanImage(fitsfile *fptr, int imnaxis1, int imnaxis2, int count, int *planes)
+{
+   int     i, j, k, nullcnt, status;
+   long    fpixel[4], nelements;
+   double  d, diff;
+   double *data;
 
 
    /* Find the min, max values in the image */
@@ -6495,18 +8238,8 @@ int mViewer_getRange(fitsfile *fptr, char *minstr, char *maxstr,
       ++fpixel[1];
    }
 
-   *datamin = rmin;
-   *datamax = rmax;
-
    diff = rmax - rmin;
 
-   if(debug)
-   {
-      printf("DEBUG> mViewer_getRange(): rmin = %-g, rmax = %-g (diff = %-g)\n",
-         rmin, rmax, diff);
-      fflush(stdout);
-   }
-
 
    /* Populate the histogram */
 
@@ -6541,6 +8274,103 @@ int mViewer_getRange(fitsfile *fptr, char *minstr, char *maxstr,
       ++fpixel[1];
    }
 
+   free(data);
+}
+
+ 
+int mViewer_getRange(fitsfile *fptr, char *minstr, char *maxstr,
+                     double *rangemin, double *rangemax, 
+                     int type, char *betastr, double *rangebeta, double *dataval,
+                     int imnaxis1, int imnaxis2,  double *datamin, double *datamax,
+                     double *median, double *sig,
+                     int count, int *planes)
+{
+   int     i, j, mintype, maxtype, betatype, found, ilev;
+   double  diff, minval, maxval, betaval, lastval;
+   double  lev16, lev50, lev84, sigma;
+   double  minextra, maxextra, betaextra;
+
+   double  glow, ghigh, gaussval, gaussstep;
+   double  dlow, dhigh;
+   double  gaussmin, gaussmax;
+
+   struct mViewerHist *cache;
+
+
+   nbin = NBIN - 1;
+
+   /* MIN/MAX: Determine what type of  */
+   /* range string we are dealing with */
+
+   if(mViewer_parseRange(minstr, "display min", &minval, &minextra, &mintype))
+      return 1;
+
+   if(mViewer_parseRange(maxstr, "display max", &maxval, &maxextra, &maxtype))
+      return 1;
+
+   betaval   = 0.;
+   betaextra = 0.;
+
+   if (type == ASINH) {
+      if(mViewer_parseRange(betastr, "beta value", &betaval, &betaextra, &betatype))
+         return 1;
+   }
+
+   /* If we don't have to generate the image */
+   /* histogram, get out now                 */
+
+   *rangemin  = minval + minextra;
+   *rangemax  = maxval + maxextra;
+   *rangebeta = betaval + betaextra;
+
+
+   /* Find the min, max values in the image and  */
+   /* populate the histogram (in batch mode we    */
+   /* may have done this for the image already)   */
+
+   cache = (struct mViewerHist *)NULL;
+
+   found = 0;
+
+   if(batchCache)
+      cache = mViewer_imgHist(fptr, count, planes, &found);
+
+   if(found)
+   {
+      rmin = cache->rmin;
+      rmax = cache->rmax;
+      npix = cache->npix;
+
+      memcpy(hist, cache->hist, NBIN * sizeof(int));
+   }
+   else
+   {
+      mViewer_scanImage(fptr, imnaxis1, imnaxis2, count, planes);
+
+      if(cache != (struct mViewerHist *)NULL)
+      {
+         cache->rmin = rmin;
+         cache->rmax = rmax;
+         cache->npix = npix;
+
+         memcpy(cache->hist, hist, NBIN * sizeof(int));
+
+         cache->used = 1;
+      }
+   }
+
+   *datamin = rmin;
+   *datamax = rmax;
+
+   diff = rmax - rmin;
+
+   if(debug)
+   {
+      printf("DEBUG> mViewer_getRange(): rmin = %-g, rmax = %-g (diff = %-g)\n",
+         rmin, rmax, diff);
+      fflush(stdout);
+   }
+
 
    /* Compute the cumulative histogram      */
    /* and the histogram bin edge boundaries */
@@ -6648,14 +8478,26 @@ int mViewer_getRange(fitsfile *fptr, char *minstr, char *maxstr,
       {
          gaussstep = (gaussmax - gaussmin)/255.;
 
+         ilev    = 1;
+         lastval = 0.;
+
          for(j=0; j<256; ++j)
          {
             gaussval = gaussmin + gaussstep * j;
 
-            for(i=1; i<nbin-1; ++i)
+            /* The levels normally rise with j, so the */
+            /* search can carry on from the last one   */
+
+            if(j == 0 || gaussval < lastval)
+               ilev = 1;
+
+            for(i=ilev; i<nbin-1; ++i)
                if(gausslev[i] >= gaussval)
                   break;
 
+            ilev    = i;
+            lastval = gaussval;
+
             glow  = gausslev[i-1];
             ghigh = gausslev[i];
 
@@ -6673,14 +8515,26 @@ int mViewer_getRange(fitsfile *fptr, char *minstr, char *maxstr,
       {
          gaussstep = log10(gaussmax - gaussmin)/255.;
 
+         ilev    = 1;
+         lastval = 0.;
+
          for(j=0; j<256; ++j)
          {
             gaussval = gaussmax - pow(10., gaussstep * (256. - j));
 
-            for(i=1; i<nbin-1; ++i)
+            /* The levels normally rise with j, so the */
+            /* search can carry on from the last one   */
+
+            if(j == 0 || gaussval < lastval)
+               ilev = 1;
+
+            for(i=ilev; i<nbin-1; ++i)
                if(gausslev[i] >= gaussval)
                   break;
 
+            ilev    = i;
+            lastval = gaussval;
+
             glow  = gausslev[i-1];
             ghigh = gausslev[i];
 
@@ -6703,13 +8557,49 @@ int mViewer_getRange(fitsfile *fptr, char *minstr, char *maxstr,
 int mViewer_readHist(char *histfile,  double *minval,  double *maxval, double *dataval, 
                      double *datamin, double *datamax, double *median, double *sigma, int *type)
 {
-   int   i;
+   int   i, found;
 
    FILE *fhist;
 
    char  line [1024];
    char  label[1024];
 
+   struct mViewerHistFile *cache;
+
+
+   /* In batch mode we may have read the file already */
+
+   cache = (struct mViewerHistFile *)NULL;
+
+   found = 0;
+
+   if(batchCache)
+      cache = mViewer_fileHist(histfile, &found);
+
+   if(found)
+   {
+      *type    = cache->type;
+      *minval  = cache->minval;
+      *maxval  = cache->maxval;
+      *datamin = cache->datamin;
+      *datamax = cache->datamax;
+      *median  = cache->median;
+      *sigma   = cache->sigma;
+
+      rmin  = cache->rmin;
+      rmax  = cache->rmax;
+      delta = cache->delta;
+      npix  = cache->npix;
+
+      memcpy(dataval,  cache->dataval,  256  * sizeof(double));
+      memcpy(hist,     cache->hist,     NBIN * sizeof(int));
+      memcpy(chist,    cache->chist,    NBIN * sizeof(double));
+      memcpy(datalev,  cache->datalev,  NBIN * sizeof(double));
+      memcpy(gausslev, cache->gausslev, NBIN * sizeof(double));
+
+      return 0;
+   }
+
    fhist = fopen(histfile, "r");
 
    if(fhist == (FILE *)NULL)
@@ -6773,6 +8663,30 @@ int mViewer_readHist(char *histfile,  double *minval,  double *maxval, double *d
 
    fclose(fhist);
 
+   if(cache != (struct mViewerHistFile *)NULL)
+   {
+      cache->type    = *type;
+      cache->minval  = *minval;
+      cache->maxval  = *maxval;
+      cache->datamin = *datamin;
+      cache->datamax = *datamax;
+      cache->median  = *median;
+      cache->sigma   = *sigma;
+
+      cache->rmin  = rmin;
+      cache->rmax  = rmax;
+      cache->delta = delta;
+      cache->npix  = npix;
+
+      memcpy(cache->dataval,  dataval,  256  * sizeof(double));
+      memcpy(cache->hist,     hist,     NBIN * sizeof(int));
+      memcpy(cache->chist,    chist,    NBIN * sizeof(double));
+      memcpy(cache->datalev,  datalev,  NBIN * sizeof(double));
+      memcpy(cache->gausslev, gausslev, NBIN * sizeof(double));
+
+      cache->used = 1;
+   }
+
    return 0;
 }
 
@@ -7264,9 +9178,16 @@ double mViewer_erfinv (double p)
 /*                          */
 /****************************/
 
+/* The overlay drawing routines only ever see the band of  */
+/* output rows currently in memory (all of them unless we  */
+/* are streaming).  Pixels outside it are dropped here and */
+/* drawn when their own band comes round.  We keep track   */
+/* of the area touched so mViewer_addOverlay() only has to */
+/* blend that.                                             */
+
 int mViewer_setPixel(int i, int j, double brightness, double red, double green, double blue, int force)
 {
-   int offset;
+   int offset, row;
    int rval, gval, bval;
 
    if(i < 0 || i >= nx)
@@ -7275,7 +9196,12 @@ int mViewer_setPixel(int i, int j, double brightness, double red, double green,
    if(j < 0 || j >= ny)
       return 0;
 
-   if(!force && ovlymask[ny - 1 - j][i] != 0.)
+   row = ny - 1 - j - band0;
+
+   if(row < 0 || row >= bandny)
+      return 1;
+
+   if(!force && ovlymask[row][i] != 0.)
       return 1;
 
    rval = red   * 255;
@@ -7284,14 +9210,14 @@ int mViewer_setPixel(int i, int j, double brightness, double red, double green,
 
    if(outType == JPEG)
    {
-      jpegOvly[ny - 1 - j][3*i]   = rval; 
-      jpegOvly[ny - 1 - j][3*i+1] = gval;
-      jpegOvly[ny - 1 - j][3*i+2] = bval;
+      jpegOvly[row][3*i]   = rval; 
+      jpegOvly[row][3*i+1] = gval;
+      jpegOvly[row][3*i+2] = bval;
    }
 
    else if(outType == PNG)
    {
-      offset = 4 * nx * (ny-1-j) + 4 * i;
+      offset = 4 * nx * row + 4 * i;
 
       if(brightness > 0)
       {
@@ -7302,9 +9228,14 @@ int mViewer_setPixel(int i, int j, double brightness, double red, double green,
    }
 
    if(brightness < 1.e-9)
-      ovlymask[ny - 1 - j][i] = 1.e-9;
+      ovlymask[row][i] = 1.e-9;
    else
-      ovlymask[ny - 1 - j][i] = brightness;
+      ovlymask[row][i] = brightness;
+
+   if(i   < ovlyimin) ovlyimin = i;
+   if(i   > ovlyimax) ovlyimax = i;
+   if(row < ovlyjmin) ovlyjmin = row;
+   if(row > ovlyjmax) ovlyjmax = row;
 
    return 1;
 }
@@ -7312,7 +9243,7 @@ int mViewer_setPixel(int i, int j, double brightness, double red, double green,
 
 int mViewer_getPixel(int i, int j, int color)
 {
-   int val;
+   int val, row;
 
    if(i < 0 || i >= nx)
       return 0;
@@ -7323,13 +9254,18 @@ int mViewer_getPixel(int i, int j, int color)
    if(color > 2)
       return 0;
 
+   row = ny - 1 - j - band0;
+
+   if(row < 0 || row >= bandny)
+      return 0;
+
    val = 0;
 
    if(outType == JPEG)
-      val = jpegData[ny - 1 - j][3*i+color];
+      val = jpegData[row][3*i+color];
 
    else if(outType == PNG)
-      val = pngData[4 * nx * (ny - 1 - j) + 4 * i + color];
+      val = pngData[4 * nx * row + 4 * i + color];
 
    return val;
 }
@@ -7347,12 +9283,15 @@ void mViewer_addOverlay()
    int    i, j, offset;
    double brightness;
 
-   for(j=0; j<ny; ++j)
+   for(j=ovlyjmin; j<=ovlyjmax; ++j)
    {
-      for(i=0; i<nx; ++i)
+      for(i=ovlyimin; i<=ovlyimax; ++i)
       {
          brightness = ovlymask[j][i];
 
+         if(brightness == 0.)
+            continue;
+
          if(outType == JPEG)
          {
             jpegData[j][3*i  ] = brightness * jpegOvly[j][3*i+0] + (1. - brightness) * jpegData[j][3*i  ];
@@ -7375,6 +9314,11 @@ void mViewer_addOverlay()
          ovlymask[j][i] = 0.;
       }
    }
+
+   ovlyimin = nx;
+   ovlyimax = -1;
+   ovlyjmin = bandny;
+   ovlyjmax = -1;
 }
 
 
@@ -9,12 +9,15 @@
 #include <svc.h>
 
 int  debug = 0;
+int  njobs;
 
 int  nhdr;
 
 char hdrDir[1024];
 
 void createSubHdrs(char *hdrStr, int level);
+void runJob(char *cmd);
+void jobDone(int slot);
 
 
 /*************************************************************/
@@ -34,7 +37,6 @@ int main(int argc, char **argv)
 
    char   hdrStr  [256];
    char   cmd    [1024];
-   char   status   [32];
 
    struct stat buf;
 
@@ -42,20 +44,34 @@ int main(int argc, char **argv)
 
    // Process command line
 
-   if(argc > 2 && strcmp(argv[1], "-d") == 0)
+   njobs = 1;
+
+   while(argc > 2 && (strcmp(argv[1], "-d") == 0 || strcmp(argv[1], "-j") == 0))
    {
-      debug = atoi(argv[2]);
+      if(strcmp(argv[1], "-d") == 0)
+      {
+         debug = atoi(argv[2]);
 
-      if(debug > 1)
-         svc_debug(stdout);
+         if(debug > 1)
+            svc_debug(stdout);
+      }
+      else
+      {
+         njobs = atoi(argv[2]);
+
+         if(njobs < 1)
+            njobs = 1;
+      }
 
       argv += 2;
       argc -= 2;
    }
 
+   svc_pool_init(njobs);
+
    if(argc < 3)
    {
-      printf("[struct stat=\"ERROR\", msg=\"Usage: mHdrWWTExec [-d lev] tileLevel hdrDir\"]\n");
+      printf("[struct stat=\"ERROR\", msg=\"Usage: mHdrWWTExec [-d lev] [-j njobs] tileLevel hdrDir\"]\n");
       fflush(stdout);
       exit(0);
    }
@@ -116,22 +132,16 @@ int main(int argc, char **argv)
       fflush(stdout);
    }
 
-   svc_run(cmd);
-
-   strcpy(status, svc_value("stat"));
-
-   if(strcmp(status, "OK") != 0)
-   {
-      printf("[stat=\"ERROR\", msg=\"%s\"]\n", svc_value("msg"));
-      fflush(stdout);
-      exit(0);
-   }
+   nhdr = 0;
 
+   runJob(cmd);
 
-   nhdr = 1;
 
    createSubHdrs(hdrStr, level);
 
+   while(svc_pool_active())
+      jobDone(svc_pool_wait());
+
 
    // All done
 
@@ -147,7 +157,6 @@ void createSubHdrs(char *instr, int level)
    int  i;
    char hdrStr  [256];
    char cmd    [1024];
-   char status   [32];
 
    if(level == 0)
       return;
@@ -164,19 +173,52 @@ void createSubHdrs(char *instr, int level)
          fflush(stdout);
       }
 
-      svc_run(cmd);
+      runJob(cmd);
 
-      strcpy(status, svc_value("stat"));
+      createSubHdrs(hdrStr, level-1);
+   }
+}
 
-      if(strcmp(status, "OK") != 0)
-      {
-         printf("[stat=\"ERROR\", msg=\"%s\"]\n", svc_value("msg"));
-         fflush(stdout);
-         exit(0);
-      }
 
-      ++nhdr;
 
-      createSubHdrs(hdrStr, level-1);
+// Start a child, first waiting for a free pool slot if necessary
+
+void runJob(char *cmd)
+{
+   if(svc_pool_full())
+      jobDone(svc_pool_wait());
+
+   if(svc_pool_submit(cmd) < 0)
+   {
+      svc_pool_close();
+
+      printf("[struct stat=\"ERROR\", msg=\"Cannot start [%s]\"]\n", cmd);
+      fflush(stdout);
+      exit(0);
+   }
+}
+
+
+
+// Check the return structure of a finished child
+
+void jobDone(int slot)
+{
+   char status[32];
+
+   if(slot < 0)
+      return;
+
+   strcpy(status, svc_value("stat"));
+
+   if(strcmp(status, "OK") != 0)
+   {
+      printf("[stat=\"ERROR\", msg=\"%s\"]\n", svc_value("msg"));
+      fflush(stdout);
+
+      svc_pool_close();
+      exit(0);
    }
+
+   ++nhdr;
 }
@@ -13,6 +13,7 @@
 #define COLOR     1
 
 int  debug = 0;
+int  njobs;
 
 int  nimage, mode, colorTable, trueColor;
 
@@ -28,6 +29,8 @@ char pngDir    [1024];
 char baseName  [1024];
 
 void createSubTiles(char *tileStr, int level);
+void runJob(char *cmd);
+void jobDone(int slot);
 
 
 int main(int argc, char **argv)
@@ -37,7 +40,6 @@ int main(int argc, char **argv)
 
    char   tileStr [256];
    char   cmd    [1024];
-   char   status   [32];
 
    struct stat buf;
 
@@ -45,20 +47,34 @@ int main(int argc, char **argv)
 
    // Process command line
 
-   if(argc > 2 && strcmp(argv[1], "-d") == 0)
+   njobs = 1;
+
+   while(argc > 2 && (strcmp(argv[1], "-d") == 0 || strcmp(argv[1], "-j") == 0))
    {
-      debug = atoi(argv[2]);
+      if(strcmp(argv[1], "-d") == 0)
+      {
+         debug = atoi(argv[2]);
 
-      if(debug > 1)
-         svc_debug(stdout);
+         if(debug > 1)
+            svc_debug(stdout);
+      }
+      else
+      {
+         njobs = atoi(argv[2]);
+
+         if(njobs < 1)
+            njobs = 1;
+      }
 
       argv += 2;
       argc -= 2;
    }
 
+   svc_pool_init(njobs);
+
    if(argc < 7)
    {
-      printf("[struct stat=\"ERROR\", msg=\"Usage: mPNGWWTExec [-d lev] colorTable tileLevel baseName grayDir gray.hist pngDir | mPNGWWTExec [-d lev] -c trueColor tileLevel baseName blueTileDir blue.hist greenTileDir green.hist redTileDir red.hist pngDir\"]\n"); 
+      printf("[struct stat=\"ERROR\", msg=\"Usage: mPNGWWTExec [-d lev] [-j njobs] colorTable tileLevel baseName grayDir gray.hist pngDir | mPNGWWTExec [-d lev] [-j njobs] -c trueColor tileLevel baseName blueTileDir blue.hist greenTileDir green.hist redTileDir red.hist pngDir\"]\n"); 
       fflush(stdout);
       exit(0);
    }
@@ -74,7 +90,7 @@ int main(int argc, char **argv)
 
       if(argc < 11)
       {
-         printf("[struct stat=\"ERROR\", msg=\"Usage: mPNGWWTExec [-d lev] colorTable tileLevel baseName grayDir gray.hist pngDir | mPNGWWTExec [-d lev] -c trueColor tileLevel baseName blueTileDir blue.hist greenTileDir green.hist redTileDir red.hist pngDir\"]\n"); 
+         printf("[struct stat=\"ERROR\", msg=\"Usage: mPNGWWTExec [-d lev] [-j njobs] colorTable tileLevel baseName grayDir gray.hist pngDir | mPNGWWTExec [-d lev] [-j njobs] -c trueColor tileLevel baseName blueTileDir blue.hist greenTileDir green.hist redTileDir red.hist pngDir\"]\n"); 
          fflush(stdout);
          exit(0);
       }
@@ -312,21 +328,15 @@ int main(int argc, char **argv)
       fflush(stdout);
    }
 
-   svc_run(cmd);
-
-   strcpy(status, svc_value("stat"));
-
-   if(strcmp(status, "OK") != 0)
-   {
-      printf("[stat=\"ERROR\", msg=\"%s\"]\n", svc_value("msg"));
-      fflush(stdout);
-      exit(0);
-   }
+   nimage = 0;
 
-   nimage = 1;
+   runJob(cmd);
 
    createSubTiles(tileStr, level);
 
+   while(svc_pool_active())
+      jobDone(svc_pool_wait());
+
 
    // All done
 
@@ -342,7 +352,6 @@ void createSubTiles(char *instr, int level)
    int  i;
    char tileStr [256];
    char cmd    [1024];
-   char status   [32];
 
    if(level == 0)
       return;
@@ -372,19 +381,52 @@ void createSubTiles(char *instr, int level)
          fflush(stdout);
       }
 
-      svc_run(cmd);
+      runJob(cmd);
 
-      strcpy(status, svc_value("stat"));
+      createSubTiles(tileStr, level-1);
+   }
+}
 
-      if(strcmp(status, "OK") != 0)
-      {
-         printf("[stat=\"ERROR\", msg=\"%s\"]\n", svc_value("msg"));
-         fflush(stdout);
-         exit(0);
-      }
 
-      ++nimage;
 
-      createSubTiles(tileStr, level-1);
+// Start a child, first waiting for a free pool slot if necessary
+
+void runJob(char *cmd)
+{
+   if(svc_pool_full())
+      jobDone(svc_pool_wait());
+
+   if(svc_pool_submit(cmd) < 0)
+   {
+      svc_pool_close();
+
+      printf("[struct stat=\"ERROR\", msg=\"Cannot start [%s]\"]\n", cmd);
+      fflush(stdout);
+      exit(0);
+   }
+}
+
+
+
+// Check the return structure of a finished child
+
+void jobDone(int slot)
+{
+   char status[32];
+
+   if(slot < 0)
+      return;
+
+   strcpy(status, svc_value("stat"));
+
+   if(strcmp(status, "OK") != 0)
+   {
+      printf("[stat=\"ERROR\", msg=\"%s\"]\n", svc_value("msg"));
+      fflush(stdout);
+
+      svc_pool_close();
+      exit(0);
    }
+
+   ++nimage;
 }
@@ -12,6 +12,7 @@
 #define COLOR     1
 
 int  debug = 0;
+int  njobs;
 
 int  nimage;
 
@@ -21,6 +22,8 @@ char tileDir   [1024];
 char hdrDir    [1024];
 
 void createSubTiles(char *tileStr, int level);
+void runJob(char *cmd);
+void jobDone(int slot);
 
 
 int main(int argc, char **argv)
@@ -30,7 +33,6 @@ int main(int argc, char **argv)
 
    char   tileStr [256];
    char   cmd    [1024];
-   char   status   [32];
 
    struct stat buf;
 
@@ -38,20 +40,34 @@ int main(int argc, char **argv)
 
    // Process command line
 
-   if(argc > 2 && strcmp(argv[1], "-d") == 0)
+   njobs = 1;
+
+   while(argc > 2 && (strcmp(argv[1], "-d") == 0 || strcmp(argv[1], "-j") == 0))
    {
-      debug = atoi(argv[2]);
+      if(strcmp(argv[1], "-d") == 0)
+      {
+         debug = atoi(argv[2]);
 
-      if(debug > 1)
-         svc_debug(stdout);
+         if(debug > 1)
+            svc_debug(stdout);
+      }
+      else
+      {
+         njobs = atoi(argv[2]);
+
+         if(njobs < 1)
+            njobs = 1;
+      }
 
       argv += 2;
       argc -= 2;
    }
 
+   svc_pool_init(njobs);
+
    if(argc < 6)
    {
-      printf("[struct stat=\"ERROR\", msg=\"Usage: mProjWWTExec [-d lev] tileLevel input.fits baseName hdrDir tileDir\"]\n");
+      printf("[struct stat=\"ERROR\", msg=\"Usage: mProjWWTExec [-d lev] [-j njobs] tileLevel input.fits baseName hdrDir tileDir\"]\n");
       fflush(stdout);
       exit(0);
    }
@@ -149,21 +165,15 @@ int main(int argc, char **argv)
       fflush(stdout);
    }
 
-   svc_run(cmd);
-
-   strcpy(status, svc_value("stat"));
-
-   if(strcmp(status, "OK") != 0)
-   {
-      printf("[stat=\"ERROR\", msg=\"%s\"]\n", svc_value("msg"));
-      fflush(stdout);
-      exit(0);
-   }
+   nimage = 0;
 
-   nimage = 1;
+   runJob(cmd);
 
    createSubTiles(tileStr, level);
 
+   while(svc_pool_active())
+      jobDone(svc_pool_wait());
+
 
    // All done
 
@@ -179,7 +189,6 @@ void createSubTiles(char *instr, int level)
    int  i;
    char tileStr [256];
    char cmd    [1024];
-   char status   [32];
 
    if(level == 0)
       return;
@@ -197,19 +206,52 @@ void createSubTiles(char *instr, int level)
          fflush(stdout);
       }
 
-      svc_run(cmd);
+      runJob(cmd);
 
-      strcpy(status, svc_value("stat"));
+      createSubTiles(tileStr, level-1);
+   }
+}
 
-      if(strcmp(status, "OK") != 0)
-      {
-         printf("[stat=\"ERROR\", msg=\"%s\"]\n", svc_value("msg"));
-         fflush(stdout);
-         exit(0);
-      }
 
-      ++nimage;
 
-      createSubTiles(tileStr, level-1);
+// Start a child, first waiting for a free pool slot if necessary
+
+void runJob(char *cmd)
+{
+   if(svc_pool_full())
+      jobDone(svc_pool_wait());
+
+   if(svc_pool_submit(cmd) < 0)
+   {
+      svc_pool_close();
+
+      printf("[struct stat=\"ERROR\", msg=\"Cannot start [%s]\"]\n", cmd);
+      fflush(stdout);
+      exit(0);
+   }
+}
+
+
+
+// Check the return structure of a finished child
+
+void jobDone(int slot)
+{
+   char status[32];
+
+   if(slot < 0)
+      return;
+
+   strcpy(status, svc_value("stat"));
+
+   if(strcmp(status, "OK") != 0)
+   {
+      printf("[stat=\"ERROR\", msg=\"%s\"]\n", svc_value("msg"));
+      fflush(stdout);
+
+      svc_pool_close();
+      exit(0);
    }
+
+   ++nimage;
 }
@@ -8,6 +8,23 @@
 /* Define Montage library prototypes */
 /*************************************/
 
+// In-memory image for the xxxMem() functions.  These run the same module
+// code as the file-based functions, reading the caller's pixels in place and
+// returning the output pixels in arrays of their own (montage_imageFree()).
+// As with the file-based functions, the modules keep static state, so calls
+// to the same module must not overlap.
+
+struct mImage
+{
+   char  *header;        // FITS header (80-character cards, run together or one per line)
+   int    bitpix;        // -32 (float pixels) or -64 (double pixels)
+   long   naxes[2];      // Image size
+   void  *data;          // naxes[0]*naxes[1] pixels, first row first
+   void  *block;         // Storage owned by the structure (NULL for caller-owned pixels)
+};
+
+//-------------------
+
 struct mAddCubeReturn
 {
    int    status;        // Return status (0: OK, 1:ERROR)
@@ -32,6 +49,10 @@ struct mAddReturn
 struct mAddReturn *mAdd(char *path, char *tblfile, char *template_file, char *output_file,
                         int shrink, int haveAreas, int coadd, int debug);
 
+struct mAddReturn *mAddMem(int nimage, struct mImage **input, struct mImage **inarea,
+                           char *template_hdr, struct mImage **output, struct mImage **area,
+                           int shrink, int coadd, int debug);
+
 //-------------------
 
 struct mBackgroundReturn
@@ -45,6 +66,10 @@ struct mBackgroundReturn
 struct mBackgroundReturn *mBackground(char *input_file, char *output_file, double A, double B, double C,
                                       int noAreasin, int debug);
 
+struct mBackgroundReturn *mBackgroundMem(struct mImage *input, struct mImage *inarea,
+                                         struct mImage **output, struct mImage **area,
+                                         double A, double B, double C, int debug);
+
 //-------------------
 
 struct mBestImageReturn
@@ -60,6 +85,8 @@ struct mBestImageReturn
 
 struct mBestImageReturn *mBestImage(char *tblfile, double ra, double dec, int debug);
 
+struct mBestImageReturn *mBestImageIndex(char *tblfile, int debug);
+
 //-------------------
 
 struct mBgModelReturn
@@ -72,6 +99,9 @@ struct mBgModelReturn
 struct mBgModelReturn *mBgModel(char *imgfile, char *fitfile, char *corrtbl, int noslope, int useall, 
                                 int niterations, int debug);
 
+struct mBgModelReturn *mBgModelWarm(char *imgfile, char *fitfile, char *corrtbl, char *initfile, int noslope,
+                                    int useall, int niterations, int debug);
+
 //-------------------
 
 struct mCoverageCheckReturn
@@ -85,6 +115,8 @@ struct mCoverageCheckReturn
 struct mCoverageCheckReturn *mCoverageCheck(char *path, char *infile, char *outfile, int mode, char *hdrfile, 
                                             int narray, double *array, int debug);
 
+struct mCoverageCheckReturn *mCoverageCheckIndex(char *infile, int debug);
+
 //-------------------
 
 struct mDiffReturn
@@ -98,6 +130,11 @@ struct mDiffReturn
 struct mDiffReturn *mDiff(char *input_file1, char *input_file2, char *output_file, 
                           char *template_file, int noAreas, double factor, int debug);
 
+struct mDiffReturn *mDiffMem(struct mImage *input1, struct mImage *area1,
+                             struct mImage *input2, struct mImage *area2,
+                             char *template_hdr, struct mImage **output, struct mImage **area,
+                             double factor, int debug);
+
 //-------------------
 
 struct mExamineReturn
@@ -167,6 +204,23 @@ struct mExamineReturn *mExamine(int areaMode, char *infile, int hdu, int plane3,
 
 //-------------------
 
+struct mExamineBatchReturn
+{
+   int    status;        // Return status (0: OK, 1:ERROR)
+   char   msg [1024];    // Return message (for error return)
+   char   json[4096];    // Return parameters as JSON string
+   int    count;         // Number of sources measured
+   int    failed;        // Number of sources off the image or with no data
+   int    nread;         // Number of image rows read
+   double time;          // Run time (sec)   
+};
+
+struct mExamineBatchReturn *mExamineBatch(int areaMode, char *infile, int hdu, int plane3, int plane4,
+                                          char *tblfile, char *outtbl, double radius, int radinpix,
+                                          int nthread, int debug);
+
+//-------------------
+
 struct mFitplaneReturn
 {
    int    status;        // Return status (0: OK, 1:ERROR)
@@ -194,6 +248,8 @@ struct mFitplaneReturn
 
 struct mFitplaneReturn *mFitplane(char *input_file, int levelOnly, int border, int debug);
 
+struct mFitplaneReturn *mFitplaneMem(struct mImage *input, int levelOnly, int border, int debug);
+
 //-------------------
 
 struct mFixNaNReturn
@@ -344,6 +400,11 @@ struct mProjectReturn *mProject(char *input_file, int hdu, char *output_file, ch
                                 double drizzle, double fluxScale, int energyMode, int expand, 
                                 int fullRegion, int debug);
 
+struct mProjectReturn *mProjectMem(struct mImage *input, char *template_hdr,
+                                   struct mImage **output, struct mImage **area,
+                                   double drizzle, double fluxScale, int energyMode,
+                                   int expand, int fullRegion, int debug);
+
 //-------------------
 
 struct mProjectCubeReturn
@@ -374,6 +435,11 @@ struct mProjectPPReturn *mProjectPP(char *input_file, int hdu, char *output_file
                                     char *altin, char *altout, double drizzle, double fluxScale,
                                     int expand, int fullRegion, int debug);
 
+struct mProjectPPReturn *mProjectPPMem(struct mImage *input, char *template_hdr,
+                                       struct mImage **output, struct mImage **area,
+                                       double drizzle, double fluxScale,
+                                       int expand, int fullRegion, int debug);
+
 //-------------------
 
 struct mProjectQLReturn
@@ -388,6 +454,11 @@ struct mProjectQLReturn *mProjectQL(char *input_file, int hdu, char *output_file
                                     char *weight_file, double fixedWeight, double threshold, char *borderstr,
                                     double fluxScale, int expand, int fullRegion, int noAreas, int debug);
 
+struct mProjectQLReturn *mProjectQLMem(struct mImage *input, char *template_hdr,
+                                       struct mImage **output, struct mImage **area,
+                                       int interp, double fluxScale,
+                                       int expand, int fullRegion, int debug);
+
 //-------------------
 
 struct mPutHdrReturn
@@ -412,6 +483,11 @@ struct mShrinkReturn
 struct mShrinkReturn *mShrink(char *input_file, int hdu, char *output_file, double shrinkFactor, 
                               int fixedSize, int debug);
 
+struct mShrinkReturn *mShrinkMem(struct mImage *input, struct mImage **output,
+                                 double shrinkFactor, int fixedSize, int debug);
+
+struct mShrinkReturn *mShrinkPyramid(char *input_file, int hdu, char *output_base, int maxfactor, int debug);
+
 //-------------------
 
 struct mShrinkCubeReturn
@@ -453,6 +529,28 @@ struct mSubimageReturn
 struct mSubimageReturn *mSubimage(int mode, char *infile, int hdu, char *outfile, double xref, double yref, 
                                   double xsize, double ysize, int nowcs, int debug);
 
+struct mSubimageReturn *mSubimageMem(int mode, struct mImage *input, struct mImage **output,
+                                     double xref, double yref, double xsize, double ysize,
+                                     int nowcs, int debug);
+
+//-------------------
+
+struct mSubimageBatchReturn
+{
+   int    status;        // Return status (0: OK, 1:ERROR)
+   char   msg [1024];    // Return message (for error return)
+   char   json[4096];    // Return parameters as JSON string
+   int    count;         // Number of cutouts written
+   int    nblank;        // Number of cutouts that are completely blank
+   int    nflat;         // Number of cutouts that are flat (all the same value)
+   int    failed;        // Number of regions off the image or not written
+   int    nread;         // Number of image rows read
+   double time;          // Run time (sec)   
+};
+
+struct mSubimageBatchReturn *mSubimageBatch(char *infile, int hdu, char *tblfile, char *outdir, char *outtbl,
+                                            int pixMode, int nthread, int debug);
+
 //-------------------
 
 struct mSubsetReturn
@@ -528,6 +626,8 @@ struct mViewerReturn
 };
 
 struct mViewerReturn *mViewer(int mode, char *cmdstr, char *outFile, char *outFmt, int debug);
+struct mViewerReturn *mViewerIndex(char *tblfile, int isImgInfo, int debug);
+struct mViewerReturn *mViewerBatch(char *listfile, int nproc, int debug);
 
 //-------------------
 
@@ -539,6 +639,71 @@ int   montage_debugCheck  (char *debugStr);
 char *montage_filePath    (char *path, char *fname);
 char *montage_fileName    (char *fname);
 
+struct montage_tableIndex;
+
+struct montage_tableIndex *montage_indexNew   (void);
+int                        montage_indexAdd   (struct montage_tableIndex *index, long offset,
+                                               double x, double y, double z, double radius);
+long                       montage_indexCount (struct montage_tableIndex *index);
+int                        montage_indexWrite (struct montage_tableIndex *index, char *idxfile, char *tblfile, char *tag);
+struct montage_tableIndex *montage_indexOpen  (char *idxfile, char *tblfile, char *tag);
+long                       montage_indexSearch(struct montage_tableIndex *index, double x, double y, double z,
+                                               double radius, long **recno, long **offset);
+long                       montage_indexPoints(struct montage_tableIndex *index, double x, double y, double z,
+                                               double radius, double **xyz);
+void                       montage_indexClose (struct montage_tableIndex *index);
+
+struct montage_templateCache
+{
+   char  *text;
+   long   size;
+   int    type;
+   double offset;
+};
+
+int   montage_templateSame (struct montage_templateCache *cache, char *filename, int type, double offset);
+void  montage_templateKeep (struct montage_templateCache *cache, char *filename, int type, double offset);
+void  montage_templateClear(struct montage_templateCache *cache);
+
+int   montage_serverMode   (char *progname, int (*command)(int argc, char **argv));
+
+int   montage_setBitpix    (int bitpix);
+int   montage_outBitpix    (void);
+
+int   montage_setCompress  (char *spec);
+int   montage_outCompress  (double *qlevel);
+char *montage_outName      (char *fname);
+
+int   montage_setThreads   (int nthread);
+int   montage_outThreads   (void);
+
+void  montage_statsStart   (char *module);
+void  montage_phaseBegin   (char *phase);
+void  montage_phaseEnd     (char *phase);
+void  montage_countPixels  (long long n);
+void  montage_countOverlaps(long long n);
+char *montage_statsEnd     (void);
+
+void  montage_imageFree    (struct mImage *image);
+
+#ifdef _FITSIO_H
+int   montage_compressImage(fitsfile **fptr, char *fname, int *status);
+int   montage_compressArea (fitsfile **fptr, char *fname, int *status);
+int   montage_writePix     (fitsfile *fptr, int datatype, long *fpixel, long nelements, void *array, int *status);
+int   montage_memOpen      (fitsfile **fptr, struct mImage *image, int *status);
+int   montage_readPix      (fitsfile *fptr, struct mImage *image, int datatype, long *fpixel, long nelements, void *nulval, void *array, int *anynul, int *status);
+int   montage_memOutput    (fitsfile *fptr, struct mImage **image, int *status);
+int   montage_putPix       (fitsfile *fptr, struct mImage *image, int datatype, long *fpixel, long nelements, void *array, int *status);
+int   montage_closeInput   (fitsfile *fptr, struct mImage *image, int *status);
+int   montage_closeOutput  (fitsfile *fptr, struct mImage *image, int *status);
+FILE *montage_memText      (char *text);
+int   montage_writeTemplate(fitsfile *fptr, char *template_file, char *header, int *status);
+int   montage_copyHeader   (fitsfile *infptr, fitsfile *outfptr, int *status);
+int   montage_imageHdr     (fitsfile *fptr, char **header, int *status);
+void  montage_countRead    (fitsfile *fptr, long nelements);
+void  montage_countWrite   (fitsfile *fptr, long nelements);
+#endif
+
 #ifndef _BSD_SOURCE
 #define _BSD_SOURCE
 #endif
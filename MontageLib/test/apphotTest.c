@@ -0,0 +1,202 @@
+/* Module: apphotTest.c
+
+*/
+
+/*************************************************************************/
+/*                                                                       */
+/*  Regression test for mExamine single-source aperture photometry.      */
+/*                                                                       */
+/*  A 200x200 TAN image (0.001 degree pixels) is written with a flat     */
+/*  background of 10 and two circular gaussian sources (sigma 3 pixels,  */
+/*  integrated flux 10000 each), one at pixel (100,100) and one at       */
+/*  (8,100) next to the image edge.  mExamine is run in APPHOT mode on   */
+/*  each with the default 30 pixel aperture; the edge one is clipped.    */
+/*                                                                       */
+/*  Until the aperture was sized in pixels, its radius was the radius    */
+/*  in degrees (0.03 here), so only the peak pixel was used and the      */
+/*  total flux came back as zero.  The values printed as "old" are what  */
+/*  that code returned; "new" is what this test checks.                  */
+/*                                                                       */
+/*  Usage:  apphotTest [workdir]                                         */
+/*                                                                       */
+/*  Exits 0 if every case matches its expected value.                    */
+/*                                                                       */
+/*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <fitsio.h>
+#include <montage.h>
+
+#define MAXSTR  1024
+
+#define APPHOT     2
+
+#define NAXIS    200
+#define BACKGND   10.
+#define SRCFLUX  1.e4
+#define SRCSIG    3.
+
+#define TOL     1.e-6
+
+
+struct apphotCase
+{
+   char   *name;
+   double  x, y;
+   double  oldval;
+   double  newval;
+};
+
+static struct apphotCase cases[] =
+{
+   {"center", 100., 100., 0., 9.9935537e+03},
+   {"edge",     8., 100., 0., 9.9364025e+03}
+};
+
+static int ncase = sizeof(cases) / sizeof(struct apphotCase);
+
+
+int makeImage(char *fname);
+
+
+int main(int argc, char **argv)
+{
+   int    i, nfail;
+   char   workdir[MAXSTR];
+   char   fname  [MAXSTR];
+   double diff;
+
+   struct mExamineReturn *ret;
+
+   strcpy(workdir, ".");
+
+   if(argc > 1)
+      strcpy(workdir, argv[1]);
+
+   snprintf(fname, MAXSTR, "%s/apphot.fits", workdir);
+
+   if(makeImage(fname))
+   {
+      printf("[struct stat=\"ERROR\", msg=\"Cannot create test image %s\"]\n", fname);
+      exit(1);
+   }
+
+   nfail = 0;
+
+   printf("%-8s %14s %14s %14s\n", "case", "old", "new", "expected");
+
+   for(i=0; i<ncase; ++i)
+   {
+      ret = mExamine(APPHOT, fname, 0, 0, 0, cases[i].x, cases[i].y, 30., 1, 1, 0);
+
+      if(ret->status)
+      {
+         printf("%-8s ERROR: %s\n", cases[i].name, ret->msg);
+         ++nfail;
+         free(ret);
+         continue;
+      }
+
+      diff = fabs(ret->totalflux - cases[i].newval) / cases[i].newval;
+
+      printf("%-8s %14.7e %14.7e %14.7e %s\n",
+         cases[i].name, cases[i].oldval, ret->totalflux, cases[i].newval,
+         diff < TOL ? "OK" : "FAIL");
+
+      if(!(diff < TOL))
+         ++nfail;
+
+      free(ret);
+   }
+
+   remove(fname);
+
+   printf("[struct stat=\"%s\", count=%d, failed=%d]\n",
+      nfail ? "ERROR" : "OK", ncase, nfail);
+
+   exit(nfail ? 1 : 0);
+}
+
+
+/*************************************************/
+/*                                               */
+/*  Write the background plus gaussian sources   */
+/*                                               */
+/*************************************************/
+
+int makeImage(char *fname)
+{
+   int       i, j, status;
+   long      naxes[2];
+   double   *data;
+   double    dx, dy, norm;
+   double    crval1, crval2, crpix1, crpix2, cdelt1, cdelt2;
+   fitsfile *fptr;
+
+   status = 0;
+
+   naxes[0] = NAXIS;
+   naxes[1] = NAXIS;
+
+   remove(fname);
+
+   if(fits_create_file(&fptr, fname, &status))
+      return 1;
+
+   if(fits_create_img(fptr, DOUBLE_IMG, 2, naxes, &status))
+      return 1;
+
+   fits_update_key(fptr, TSTRING, "CTYPE1", "RA---TAN", "", &status);
+   fits_update_key(fptr, TSTRING, "CTYPE2", "DEC--TAN", "", &status);
+
+   crval1 =  180.;
+   crval2 =   30.;
+   crpix1 =  100.;
+   crpix2 =  100.;
+   cdelt1 = -0.001;
+   cdelt2 =  0.001;
+
+   fits_update_key(fptr, TDOUBLE, "CRVAL1", &crval1, "", &status);
+   fits_update_key(fptr, TDOUBLE, "CRVAL2", &crval2, "", &status);
+   fits_update_key(fptr, TDOUBLE, "CRPIX1", &crpix1, "", &status);
+   fits_update_key(fptr, TDOUBLE, "CRPIX2", &crpix2, "", &status);
+   fits_update_key(fptr, TDOUBLE, "CDELT1", &cdelt1, "", &status);
+   fits_update_key(fptr, TDOUBLE, "CDELT2", &cdelt2, "", &status);
+
+   if(status)
+      return 1;
+
+   data = (double *)malloc(NAXIS * sizeof(double));
+
+   norm = SRCFLUX / (8. * atan(1.) * SRCSIG * SRCSIG);
+
+   for(j=1; j<=NAXIS; ++j)
+   {
+      for(i=1; i<=NAXIS; ++i)
+      {
+         data[i-1] = BACKGND;
+
+         dx = i - 100.;
+         dy = j - 100.;
+
+         data[i-1] += norm * exp(-(dx*dx + dy*dy) / (2. * SRCSIG * SRCSIG));
+
+         dx = i - 8.;
+
+         data[i-1] += norm * exp(-(dx*dx + dy*dy) / (2. * SRCSIG * SRCSIG));
+      }
+
+      if(fits_write_img(fptr, TDOUBLE, (long)(j-1)*NAXIS+1, NAXIS, data, &status))
+         break;
+   }
+
+   free(data);
+
+   fits_close_file(fptr, &status);
+
+   return status ? 1 : 0;
+}
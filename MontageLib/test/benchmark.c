@@ -0,0 +1,1034 @@
+/* Module: benchmark.c
+
+*/
+
+/*************************************************************************/
+/*                                                                       */
+/*  MontageLib performance benchmark.                                    */
+/*                                                                       */
+/*  A synthetic field is generated with mMakeImg (gaussian noise, a      */
+/*  different background plane for each image and point sources from a   */
+/*  random catalog): a grid of slightly rotated TAN images of a given    */
+/*  size and fractional overlap.  Everything is seeded, so the same      */
+/*  arguments always produce the same pixels.                            */
+/*                                                                       */
+/*  The normal mosaic processing is then run on it, one stage at a time: */
+/*  mProject, mProjectPP and mProjectQL on all the images, mDiff and     */
+/*  mFitplane on all the overlaps, mBgModel, mAdd (mean and median),     */
+/*  mShrink and mViewer (serial and with rendering threads).  Each stage */
+/*  runs in a child process so its peak resident memory can be taken     */
+/*  from wait4(); wall time is measured around the child.                */
+/*                                                                       */
+/*  One JSON record per stage (and field) is written to the output file; */
+/*  "npix" is the number of pixels the stage reads or produces (input    */
+/*  pixels for the reprojections, output pixels for mMakeImg, mDiff and  */
+/*  mAdd, and the pixels examined for the rest).                         */
+/*                                                                       */
+/*  Usage:  benchmark [-w workdir][-s sizes][-v overlaps][-g grid]       */
+/*                    [-r repeats][-t threads][-o out.json]              */
+/*                                                                       */
+/*  where sizes and overlaps are comma-separated lists (default          */
+/*  "256,512" and "0.1,0.3"), grid is the number of images on a side     */
+/*  (default 3) and repeats is how many times each stage is run (the     */
+/*  fastest run is reported).  Note that mProject, being exact, takes    */
+/*  minutes per field at 1024 pixels and beyond.                         */
+/*                                                                       */
+/*************************************************************************/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <fitsio.h>
+#include <mtbl.h>
+#include <montage.h>
+
+#define MAXSTR   1024
+#define MAXLIST    32
+
+#define MEAN        0
+#define MEDIAN      1
+
+#define CMDMODE     0
+
+#define CDELT       2.777778e-4
+#define RA0       150.0
+#define DEC0        2.0
+
+#define SRCDENS  2000.      /* Pixels per catalog source */
+#define REFMAG     20.
+#define PSFWIDTH    2.
+#define NOISE       1.
+
+#define SHRINK      4.
+
+
+struct bench
+{
+   char   dir[MAXSTR];      // Work directory for this field
+   int    size;             // Image size (pixels on a side)
+   double overlap;          // Fractional overlap of neighbouring images
+   int    grid;             // Images on a side
+   int    nimage;           // grid * grid
+   int    nthread;          // mViewer rendering threads (parallel run)
+};
+
+struct stats
+{
+   int    status;           // Child exit status (0: OK)
+   double wall;             // Elapsed time (sec)
+   double cpu;              // User + system CPU time (sec)
+   long   maxrss;           // Peak resident set (KB)
+};
+
+static struct bench field;
+
+static FILE  *fout;
+
+static int    nstage, nfail;
+
+static unsigned long seed;
+
+void   bench_usage    (char *pgm);
+int    bench_list     (char *str, double *list);
+int    bench_field    (void);
+int    bench_hdr      (char *fname, int naxis1, int naxis2, double ra, double dec, double rot);
+double bench_random   (void);
+long   bench_npix     (char *fname);
+long   bench_npixTbl  (char *tblfile, char *col, char *dir);
+int    bench_run      (char *module, char *variant, int (*stage)(void *), void *arg, int reps,
+                       long npix, int nimage);
+
+int    stage_makeImg  (void *arg);
+int    stage_project  (void *arg);
+int    stage_diff     (void *arg);
+int    stage_fitplane (void *arg);
+int    stage_bgModel  (void *arg);
+int    stage_add      (void *arg);
+int    stage_shrink   (void *arg);
+int    stage_viewer   (void *arg);
+
+
+/*************************************************************************/
+/*                                                                       */
+/*  main() - Parse the arguments and loop over the field configurations  */
+/*                                                                       */
+/*************************************************************************/
+
+int main(int argc, char **argv)
+{
+   int    c, i, j, nsize, noverlap, reps, grid, nthread;
+   int    proj[3] = {0, 1, 2};
+   int    coadd[2] = {MEAN, MEDIAN};
+   int    serial;
+   long   nraw, nproj, ndiff, nmos;
+
+   double sizes   [MAXLIST];
+   double overlaps[MAXLIST];
+
+   char   workdir [MAXSTR];
+   char   outfile [MAXSTR];
+   char   fname   [MAXSTR];
+   char   sizestr [MAXSTR];
+   char   ovlpstr [MAXSTR];
+   char   difftbl [MAXSTR];
+   char   variant [MAXSTR];
+
+   strcpy(workdir, "bench");
+   strcpy(outfile, "");
+   strcpy(sizestr, "256,512");
+   strcpy(ovlpstr, "0.1,0.3");
+
+   grid    = 3;
+   reps    = 1;
+   nthread = 4;
+
+   while ((c = getopt(argc, argv, "w:s:v:g:r:t:o:")) != EOF)
+   {
+      switch (c)
+      {
+         case 'w':
+            strcpy(workdir, optarg);
+            break;
+
+         case 's':
+            strcpy(sizestr, optarg);
+            break;
+
+         case 'v':
+            strcpy(ovlpstr, optarg);
+            break;
+
+         case 'g':
+            grid = atoi(optarg);
+            break;
+
+         case 'r':
+            reps = atoi(optarg);
+            break;
+
+         case 't':
+            nthread = atoi(optarg);
+            break;
+
+         case 'o':
+            strcpy(outfile, optarg);
+            break;
+
+         default:
+            bench_usage(argv[0]);
+            break;
+      }
+   }
+
+   if(optind != argc || grid < 1 || reps < 1 || nthread < 1)
+      bench_usage(argv[0]);
+
+   nsize    = bench_list(sizestr, sizes);
+   noverlap = bench_list(ovlpstr, overlaps);
+
+   if(nsize < 1 || noverlap < 1)
+      bench_usage(argv[0]);
+
+   for(i=0; i<noverlap; ++i)
+   {
+      if(overlaps[i] < 0. || overlaps[i] >= 1.)
+      {
+         printf("[struct stat=\"ERROR\", msg=\"Overlap must be in [0,1)\"]\n");
+         exit(1);
+      }
+   }
+
+   if(mkdir(workdir, 0775) < 0 && errno != EEXIST)
+   {
+      printf("[struct stat=\"ERROR\", msg=\"Cannot create work directory %s\"]\n", workdir);
+      exit(1);
+   }
+
+   if(strlen(outfile) == 0)
+      sprintf(outfile, "%s/benchmark.json", workdir);
+
+   fout = fopen(outfile, "w+");
+
+   if(fout == (FILE *)NULL)
+   {
+      printf("[struct stat=\"ERROR\", msg=\"Cannot open output file %s\"]\n", outfile);
+      exit(1);
+   }
+
+   nstage = 0;
+   nfail  = 0;
+
+
+   /*************************************/
+   /* Loop over the field configuration */
+   /*************************************/
+
+   for(i=0; i<nsize; ++i)
+   {
+      for(j=0; j<noverlap; ++j)
+      {
+         field.size    = (int)sizes[i];
+         field.overlap = overlaps[j];
+         field.grid    = grid;
+         field.nimage  = grid * grid;
+         field.nthread = nthread;
+
+         sprintf(field.dir, "%s/s%d_o%.2f", workdir, field.size, field.overlap);
+
+         if(bench_field())
+         {
+            printf("[struct stat=\"ERROR\", msg=\"Cannot set up field in %s\"]\n", field.dir);
+            exit(1);
+         }
+
+         nraw = (long)field.nimage * field.size * field.size;
+
+
+         /* Synthetic images */
+
+         if(bench_run("mMakeImg", "", stage_makeImg, (void *)NULL, reps, nraw, field.nimage))
+            continue;
+
+
+         /* Reprojection (the mProject output is the one used from here on) */
+
+         if(bench_run("mProject", "", stage_project, (void *)&proj[0], reps, nraw, field.nimage))
+            continue;
+
+         bench_run("mProjectPP", "", stage_project, (void *)&proj[1], reps, nraw, field.nimage);
+         bench_run("mProjectQL", "", stage_project, (void *)&proj[2], reps, nraw, field.nimage);
+
+         sprintf(variant, "%s/proj",       field.dir);
+         sprintf(fname,   "%s/images.tbl", field.dir);
+
+         free(mImgtbl(variant, fname, 0, 0, 0, 0, 0, 0, 0, "", "", 0));
+
+         nproj = bench_npixTbl(fname, "fname", "proj");
+
+
+         /* Background matching */
+
+         sprintf(difftbl, "%s/diffs.tbl", field.dir);
+
+         free(mOverlaps(fname, difftbl, 0, 0));
+
+         bench_run("mDiff", "", stage_diff, (void *)NULL, reps, -1L, 0);
+
+         ndiff = bench_npixTbl(difftbl, "diff", "diffs");
+
+         bench_run("mFitplane", "", stage_fitplane, (void *)NULL, reps, ndiff, 0);
+         bench_run("mBgModel",  "", stage_bgModel,  (void *)NULL, reps, 0L,    field.nimage);
+
+
+         /* Coaddition */
+
+         bench_run("mAdd", "mean",   stage_add, (void *)&coadd[0], reps, nproj, field.nimage);
+         bench_run("mAdd", "median", stage_add, (void *)&coadd[1], reps, nproj, field.nimage);
+
+         sprintf(fname, "%s/mosaic.fits", field.dir);
+         nmos = bench_npix(fname);
+
+         bench_run("mShrink", "", stage_shrink, (void *)NULL, reps, nmos, 1);
+
+
+         /* Rendering, serial and threaded */
+
+         serial = 1;
+         bench_run("mViewer", "serial", stage_viewer, (void *)&serial, reps, nmos, 1);
+
+         sprintf(variant, "threads=%d", nthread);
+         bench_run("mViewer", variant, stage_viewer, (void *)&field.nthread, reps, nmos, 1);
+      }
+   }
+
+   fclose(fout);
+
+   if(nfail)
+   {
+      printf("[struct stat=\"ERROR\", msg=\"%d of %d stages failed\", output=\"%s\"]\n", nfail, nstage, outfile);
+      exit(1);
+   }
+
+   printf("[struct stat=\"OK\", nstage=%d, output=\"%s\"]\n", nstage, outfile);
+   fflush(stdout);
+   exit(0);
+}
+
+
+
+/*************************************************************************/
+/*                                                                       */
+/*  Set up a field: directories, header templates for the images and     */
+/*  the mosaic, and the point source catalog.                            */
+/*                                                                       */
+/*************************************************************************/
+
+int bench_field()
+{
+   int    i, j, k, nsrc, nx, ny;
+   double dtr, step, ra, dec, width, height, cosdec;
+
+   char   fname[MAXSTR];
+   char  *subdir[] = {"", "/raw", "/proj", "/projpp", "/projql", "/diffs", "/out"};
+
+   FILE  *fcat;
+
+   for(i=0; i<7; ++i)
+   {
+      sprintf(fname, "%s%s", field.dir, subdir[i]);
+
+      if(mkdir(fname, 0775) < 0 && errno != EEXIST)
+         return 1;
+   }
+
+   dtr = atan(1.) / 45.;
+
+   cosdec = cos(DEC0 * dtr);
+
+   step = field.size * (1. - field.overlap) * CDELT;
+
+
+   /* One header per image; alternating small rotations */
+
+   k = 0;
+
+   for(j=0; j<field.grid; ++j)
+   {
+      for(i=0; i<field.grid; ++i)
+      {
+         ra  = RA0  + (i - (field.grid-1)/2.) * step / cosdec;
+         dec = DEC0 + (j - (field.grid-1)/2.) * step;
+
+         sprintf(fname, "%s/raw/im%d.hdr", field.dir, k);
+
+         if(bench_hdr(fname, field.size, field.size, ra, dec, 5. * (k%3 - 1)))
+            return 1;
+
+         ++k;
+      }
+   }
+
+
+   /* The mosaic covers the whole field with a margin */
+
+   width  = (field.grid - 1) * step + field.size * CDELT * 1.5;
+   height = width;
+
+   nx = (int)(width  / CDELT + 0.5);
+   ny = (int)(height / CDELT + 0.5);
+
+   sprintf(fname, "%s/region.hdr", field.dir);
+
+   if(bench_hdr(fname, nx, ny, RA0, DEC0, 0.))
+      return 1;
+
+
+   /* Point source catalog (IPAC table) */
+
+   sprintf(fname, "%s/sources.tbl", field.dir);
+
+   fcat = fopen(fname, "w+");
+
+   if(fcat == (FILE *)NULL)
+      return 1;
+
+   fprintf(fcat, "|      ra      |     dec      |   mag   |\n");
+   fprintf(fcat, "|    double    |    double    |  double |\n");
+
+   nsrc = (int)((double)nx * ny / SRCDENS);
+
+   seed = 12345UL + field.size;
+
+   for(i=0; i<nsrc; ++i)
+   {
+      ra  = RA0  + (bench_random() - 0.5) * width / cosdec;
+      dec = DEC0 + (bench_random() - 0.5) * height;
+
+      fprintf(fcat, " %14.8f %14.8f %9.3f \n", ra, dec, 12. + 8. * bench_random());
+   }
+
+   fclose(fcat);
+
+   return 0;
+}
+
+
+
+/*************************************************************************/
+/*                                                                       */
+/*  Write a TAN header template                                          */
+/*                                                                       */
+/*************************************************************************/
+
+int bench_hdr(char *fname, int naxis1, int naxis2, double ra, double dec, double rot)
+{
+   FILE *fhdr;
+
+   fhdr = fopen(fname, "w+");
+
+   if(fhdr == (FILE *)NULL)
+      return 1;
+
+   fprintf(fhdr, "SIMPLE  = T\n");
+   fprintf(fhdr, "BITPIX  = -64\n");
+   fprintf(fhdr, "NAXIS   = 2\n");
+   fprintf(fhdr, "NAXIS1  = %d\n", naxis1);
+   fprintf(fhdr, "NAXIS2  = %d\n", naxis2);
+   fprintf(fhdr, "CTYPE1  = 'RA---TAN'\n");
+   fprintf(fhdr, "CTYPE2  = 'DEC--TAN'\n");
+   fprintf(fhdr, "EQUINOX = 2000\n");
+   fprintf(fhdr, "CRVAL1  = %.8f\n", ra);
+   fprintf(fhdr, "CRVAL2  = %.8f\n", dec);
+   fprintf(fhdr, "CRPIX1  = %.2f\n", (naxis1 + 1.) / 2.);
+   fprintf(fhdr, "CRPIX2  = %.2f\n", (naxis2 + 1.) / 2.);
+   fprintf(fhdr, "CDELT1  = %.9f\n", -CDELT);
+   fprintf(fhdr, "CDELT2  = %.9f\n",  CDELT);
+   fprintf(fhdr, "CROTA2  = %.4f\n", rot);
+   fprintf(fhdr, "END\n");
+
+   fclose(fhdr);
+
+   return 0;
+}
+
+
+
+/*************************************************************************/
+/*                                                                       */
+/*  Run one stage in a child process and write its JSON record.  The     */
+/*  return value is the stage status; without images or reprojections    */
+/*  the rest of a field is skipped.                                      */
+/*                                                                       */
+/*  A negative npix means "count the stage's output afterwards" and a    */
+/*  zero nimage "use the number of overlaps"; both are for the mDiff and */
+/*  mFitplane stages, whose work depends on what mOverlaps found.        */
+/*                                                                       */
+/*************************************************************************/
+
+int bench_run(char *module, char *variant, int (*stage)(void *), void *arg, int reps,
+               long npix, int nimage)
+{
+   int            irep, wstatus;
+   pid_t          pid;
+   struct timeval start, end;
+   struct rusage  usage;
+   struct stats   best, curr;
+
+   char           fname[MAXSTR];
+
+   best.status = 0;
+   best.wall   = -1.;
+   best.cpu    = 0.;
+   best.maxrss = 0L;
+
+   for(irep=0; irep<reps; ++irep)
+   {
+      fflush(stdout);
+      fflush(fout);
+
+      gettimeofday(&start, (struct timezone *)NULL);
+
+      pid = fork();
+
+      if(pid < 0)
+      {
+         best.status = 1;
+         break;
+      }
+
+      if(pid == 0)
+         exit(stage(arg) ? 1 : 0);
+
+      if(wait4(pid, &wstatus, 0, &usage) < 0)
+      {
+         best.status = 1;
+         break;
+      }
+
+      gettimeofday(&end, (struct timezone *)NULL);
+
+      curr.wall   = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1.e6;
+      curr.cpu    = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1.e6
+                  + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1.e6;
+      curr.maxrss = usage.ru_maxrss;
+      curr.status = !WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0;
+
+      if(curr.status)
+      {
+         best.status = 1;
+         break;
+      }
+
+      if(best.wall < 0. || curr.wall < best.wall)
+         best = curr;
+   }
+
+   if(npix < 0)
+   {
+      sprintf(fname, "%s/diffs.tbl", field.dir);
+
+      npix = bench_npixTbl(fname, "diff", "diffs");
+   }
+
+   if(nimage == 0)
+   {
+      sprintf(fname, "%s/diffs.tbl", field.dir);
+
+      nimage = bench_npixTbl(fname, "diff", (char *)NULL);
+   }
+
+   ++nstage;
+
+   if(best.status)
+   {
+      ++nfail;
+
+      fprintf(fout, "{\"module\":\"%s\", \"variant\":\"%s\", \"size\":%d, \"overlap\":%.2f, \"nimage\":%d, \"status\":\"ERROR\"}\n",
+         module, variant, field.size, field.overlap, nimage);
+
+      fflush(fout);
+      return 1;
+   }
+
+   if(best.wall <= 0.)
+      best.wall = 1.e-6;
+
+   fprintf(fout, "{\"module\":\"%s\", \"variant\":\"%s\", \"size\":%d, \"overlap\":%.2f, \"nimage\":%d, \"status\":\"OK\", "
+                 "\"reps\":%d, \"wall\":%.4f, \"cpu\":%.4f, \"npix\":%ld, \"pixrate\":%.6e, \"imgrate\":%.4f, \"maxrss\":%ld}\n",
+      module, variant, field.size, field.overlap, nimage, reps, best.wall, best.cpu,
+      npix, npix / best.wall, nimage / best.wall, best.maxrss);
+
+   fflush(fout);
+
+   return 0;
+}
+
+
+
+/*************************************************************************/
+/*                                                                       */
+/*  The stages.  These run in the child process; a non-zero return is a  */
+/*  failure.                                                             */
+/*                                                                       */
+/*************************************************************************/
+
+int stage_makeImg(void *arg)
+{
+   int     k;
+   double  bg;
+
+   char    hdrfile[MAXSTR];
+   char    outfile[MAXSTR];
+   char    catfile[MAXSTR];
+
+   char   *cat_file[1];
+   char   *colname [1];
+   double  width   [1];
+   double  refmag  [1];
+   double  epoch   [1];
+
+   struct mMakeImgReturn *ret;
+
+   sprintf(catfile, "%s/sources.tbl", field.dir);
+
+   cat_file[0] = catfile;
+   colname [0] = "mag";
+   width   [0] = PSFWIDTH;
+   refmag  [0] = REFMAG;
+   epoch   [0] = 2000.;
+
+   for(k=0; k<field.nimage; ++k)
+   {
+      sprintf(hdrfile, "%s/raw/im%d.hdr",  field.dir, k);
+      sprintf(outfile, "%s/raw/im%d.fits", field.dir, k);
+
+      srand(1000 + k);
+
+      bg = 10. + k;
+
+      ret = mMakeImg(hdrfile, outfile, NOISE, bg, bg + 0.5 * (k%3), bg + 0.5 * (k%2), bg - 0.5 * (k%3),
+                     1, cat_file, colname, width, refmag, epoch, 0, 0, (char **)NULL, "", 0, 0);
+
+      if(ret->status)
+      {
+         fprintf(stderr, "mMakeImg %s: %s\n", outfile, ret->msg);
+         free(ret);
+         return 1;
+      }
+
+      free(ret);
+   }
+
+   return 0;
+}
+
+
+int stage_project(void *arg)
+{
+   int   k, mode;
+   int   status;
+
+   char  infile [MAXSTR];
+   char  outfile[MAXSTR];
+   char  hdrfile[MAXSTR];
+   char  msg    [MAXSTR];
+   char *outdir[] = {"proj", "projpp", "projql"};
+
+   struct mProjectReturn   *ret;
+   struct mProjectPPReturn *retpp;
+   struct mProjectQLReturn *retql;
+
+   mode = *((int *)arg);
+
+   sprintf(hdrfile, "%s/region.hdr", field.dir);
+
+   for(k=0; k<field.nimage; ++k)
+   {
+      sprintf(infile,  "%s/raw/im%d.fits", field.dir, k);
+      sprintf(outfile, "%s/%s/im%d.fits",  field.dir, outdir[mode], k);
+
+      if(mode == 0)
+      {
+         ret = mProject(infile, 0, outfile, hdrfile, "", 1., 0., "", 0., 1., 0, 0, 0, 0);
+
+         status = ret->status;
+         strcpy(msg, ret->msg);
+         free(ret);
+      }
+      else if(mode == 1)
+      {
+         retpp = mProjectPP(infile, 0, outfile, hdrfile, "", 1., 0., "", "", "", 0., 1., 0, 0, 0);
+
+         status = retpp->status;
+         strcpy(msg, retpp->msg);
+         free(retpp);
+      }
+      else
+      {
+         retql = mProjectQL(infile, 0, outfile, hdrfile, 0, "", 1., 0., "", 1., 0, 0, 0, 0);
+
+         status = retql->status;
+         strcpy(msg, retql->msg);
+         free(retql);
+      }
+
+      if(status)
+      {
+         fprintf(stderr, "%s %s: %s\n", outdir[mode], outfile, msg);
+         return 1;
+      }
+   }
+
+   return 0;
+}
+
+
+int stage_diff(void *arg)
+{
+   int   ncols, iplus, iminus, idiff;
+
+   char  tblfile[MAXSTR];
+   char  plus   [MAXSTR];
+   char  minus  [MAXSTR];
+   char  diff   [MAXSTR];
+   char  hdrfile[MAXSTR];
+
+   struct mDiffReturn *ret;
+
+   sprintf(tblfile, "%s/diffs.tbl",  field.dir);
+   sprintf(hdrfile, "%s/region.hdr", field.dir);
+
+   ncols = topen(tblfile);
+
+   if(ncols <= 0)
+      return 1;
+
+   iplus  = tcol("plus");
+   iminus = tcol("minus");
+   idiff  = tcol("diff");
+
+   if(iplus < 0 || iminus < 0 || idiff < 0)
+      return 1;
+
+   while(tread() >= 0)
+   {
+      sprintf(plus,  "%s/proj/%s",  field.dir, tval(iplus));
+      sprintf(minus, "%s/proj/%s",  field.dir, tval(iminus));
+      sprintf(diff,  "%s/diffs/%s", field.dir, tval(idiff));
+
+      ret = mDiff(plus, minus, diff, hdrfile, 0, 1., 0);
+
+      /* As in mDiffExec, a failed difference (typically */
+      /* an overlap with no common pixels) is skipped    */
+
+      free(ret);
+   }
+
+   tclose();
+
+   return 0;
+}
+
+
+int stage_fitplane(void *arg)
+{
+   int   ncols, icntr1, icntr2, idiff;
+
+   char  tblfile[MAXSTR];
+   char  fitfile[MAXSTR];
+   char  diff   [MAXSTR];
+
+   FILE *ffit;
+
+   struct mFitplaneReturn *ret;
+
+   sprintf(tblfile, "%s/diffs.tbl", field.dir);
+   sprintf(fitfile, "%s/fits.tbl",  field.dir);
+
+   ncols = topen(tblfile);
+
+   if(ncols <= 0)
+      return 1;
+
+   icntr1 = tcol("cntr1");
+   icntr2 = tcol("cntr2");
+   idiff  = tcol("diff");
+
+   if(icntr1 < 0 || icntr2 < 0 || idiff < 0)
+      return 1;
+
+   ffit = fopen(fitfile, "w+");
+
+   if(ffit == (FILE *)NULL)
+      return 1;
+
+   fprintf(ffit, "|   plus  |  minus  |         a      |        b       |        c       |    crpix1    |    crpix2    |   xmin   |   xmax   |   ymin   |   ymax   |   xcenter   |   ycenter   |    npixel   |      rms       |      boxx      |      boxy      |    boxwidth    |   boxheight    |     boxang     |\n");
+
+   while(tread() >= 0)
+   {
+      sprintf(diff, "%s/diffs/%s", field.dir, tval(idiff));
+
+      ret = mFitplane(diff, 0, 0, 0);
+
+      if(ret->status == 0)
+         fprintf(ffit, " %9d %9d %16.5e %16.5e %16.5e %14.2f %14.2f %10d %10d %10d %10d %13.2f %13.2f %13.0f %16.5e %16.1f %16.1f %16.1f %16.1f %16.1f \n",
+            atoi(tval(icntr1)), atoi(tval(icntr2)), ret->a, ret->b, ret->c, ret->crpix1, ret->crpix2,
+            (int)ret->xmin, (int)ret->xmax, (int)ret->ymin, (int)ret->ymax, ret->xcenter, ret->ycenter,
+            (double)ret->npixel, ret->rms, ret->boxx, ret->boxy, ret->boxwidth, ret->boxheight, ret->boxang);
+
+      free(ret);
+   }
+
+   fclose(ffit);
+   tclose();
+
+   return 0;
+}
+
+
+int stage_bgModel(void *arg)
+{
+   char  imgtbl [MAXSTR];
+   char  fitfile[MAXSTR];
+   char  corrtbl[MAXSTR];
+
+   struct mBgModelReturn *ret;
+
+   sprintf(imgtbl,  "%s/images.tbl",      field.dir);
+   sprintf(fitfile, "%s/fits.tbl",        field.dir);
+   sprintf(corrtbl, "%s/corrections.tbl", field.dir);
+
+   ret = mBgModel(imgtbl, fitfile, corrtbl, 0, 0, 10000, 0);
+
+   if(ret->status)
+   {
+      fprintf(stderr, "mBgModel: %s\n", ret->msg);
+      free(ret);
+      return 1;
+   }
+
+   free(ret);
+   return 0;
+}
+
+
+int stage_add(void *arg)
+{
+   int   coadd;
+
+   char  path   [MAXSTR];
+   char  imgtbl [MAXSTR];
+   char  hdrfile[MAXSTR];
+   char  outfile[MAXSTR];
+
+   struct mAddReturn *ret;
+
+   coadd = *((int *)arg);
+
+   sprintf(path,    "%s/proj",       field.dir);
+   sprintf(imgtbl,  "%s/images.tbl", field.dir);
+   sprintf(hdrfile, "%s/region.hdr", field.dir);
+
+   if(coadd == MEAN)
+      sprintf(outfile, "%s/mosaic.fits", field.dir);
+   else
+      sprintf(outfile, "%s/out/mosaic_median.fits", field.dir);
+
+   ret = mAdd(path, imgtbl, hdrfile, outfile, 0, 1, coadd, 0);
+
+   if(ret->status)
+   {
+      fprintf(stderr, "mAdd: %s\n", ret->msg);
+      free(ret);
+      return 1;
+   }
+
+   free(ret);
+   return 0;
+}
+
+
+int stage_shrink(void *arg)
+{
+   char  infile [MAXSTR];
+   char  outfile[MAXSTR];
+
+   struct mShrinkReturn *ret;
+
+   sprintf(infile,  "%s/mosaic.fits",           field.dir);
+   sprintf(outfile, "%s/out/mosaic_small.fits", field.dir);
+
+   ret = mShrink(infile, 0, outfile, SHRINK, 0, 0);
+
+   if(ret->status)
+   {
+      fprintf(stderr, "mShrink: %s\n", ret->msg);
+      free(ret);
+      return 1;
+   }
+
+   free(ret);
+   return 0;
+}
+
+
+int stage_viewer(void *arg)
+{
+   int   nthread;
+
+   char  cmdstr [MAXSTR];
+   char  outfile[MAXSTR];
+
+   struct mViewerReturn *ret;
+
+   nthread = *((int *)arg);
+
+   sprintf(outfile, "%s/out/mosaic_%d.png", field.dir, nthread);
+
+   sprintf(cmdstr, "mViewer -threads %d -ct 1 -gray %s/mosaic.fits -1s max gaussian-log -out %s",
+      nthread, field.dir, outfile);
+
+   ret = mViewer(CMDMODE, cmdstr, outfile, "png", 0);
+
+   if(ret->status)
+   {
+      fprintf(stderr, "mViewer: %s\n", ret->msg);
+      free(ret);
+      return 1;
+   }
+
+   free(ret);
+   return 0;
+}
+
+
+
+/*************************************************************************/
+/*                                                                       */
+/*  Helpers                                                              */
+/*                                                                       */
+/*************************************************************************/
+
+/* Parse a comma-separated list of numbers */
+
+int bench_list(char *str, double *list)
+{
+   int   n;
+   char *ptr, *end;
+
+   n   = 0;
+   ptr = str;
+
+   while(*ptr != '\0' && n < MAXLIST)
+   {
+      list[n] = strtod(ptr, &end);
+
+      if(end == ptr || (*end != ',' && *end != '\0'))
+         return -1;
+
+      ++n;
+
+      ptr = end;
+
+      if(*ptr == ',')
+         ++ptr;
+   }
+
+   return n;
+}
+
+
+/* Deterministic uniform random numbers in [0,1) (LCG) */
+
+double bench_random()
+{
+   seed = (seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+
+   return (double)seed / 2147483648.;
+}
+
+
+/* Number of pixels in a FITS image (0 if unreadable) */
+
+long bench_npix(char *fname)
+{
+   int       status;
+   long      naxes[2];
+   fitsfile *fptr;
+
+   status = 0;
+
+   if(fits_open_image(&fptr, fname, READONLY, &status))
+      return 0L;
+
+   if(fits_get_img_size(fptr, 2, naxes, &status))
+      naxes[0] = naxes[1] = 0;
+
+   status = 0;
+   fits_close_file(fptr, &status);
+
+   return naxes[0] * naxes[1];
+}
+
+
+/* Total pixels of the images named in a table column (relative to    */
+/* a subdirectory of the field unless absolute); with a NULL          */
+/* directory just count the table rows.                               */
+
+long bench_npixTbl(char *tblfile, char *col, char *dir)
+{
+   int   icol;
+   long  npix;
+   char  fname[MAXSTR];
+
+   if(topen(tblfile) <= 0)
+      return 0L;
+
+   icol = tcol(col);
+
+   if(icol < 0)
+   {
+      tclose();
+      return 0L;
+   }
+
+   npix = 0L;
+
+   while(tread() >= 0)
+   {
+      if(dir == (char *)NULL)
+         ++npix;
+      else
+      {
+         if(tval(icol)[0] == '/')
+            strcpy(fname, tval(icol));
+         else
+            sprintf(fname, "%s/%s/%s", field.dir, dir, tval(icol));
+
+         npix += bench_npix(fname);
+      }
+   }
+
+   tclose();
+
+   return npix;
+}
+
+
+void bench_usage(char *pgm)
+{
+   printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-w workdir][-s sizes][-v overlaps][-g grid][-r repeats][-t threads][-o out.json]\"]\n", pgm);
+   exit(1);
+}
@@ -0,0 +1,74 @@
+/* Module: bitpix.c
+
+*/
+
+/*************************************************************************/
+/*                                                                       */
+/*  Output pixel type for the image-generating modules.                  */
+/*                                                                       */
+/*  mProject, mProjectPP, mDiff, mAdd and mShrink all compute in double  */
+/*  precision and have always written BITPIX -64 images.  For a large    */
+/*  mosaic the intermediate files (projected images, area images,        */
+/*  differences) dominate the disk I/O and single precision is more      */
+/*  than adequate for them, so the output BITPIX can be switched to -32. */
+/*  The modules still hand double buffers to fits_write_pix(); CFITSIO   */
+/*  does the conversion.                                                 */
+/*                                                                       */
+/*  The setting is process-wide.  A program can set it explicitly (the   */
+/*  executables do so with their "-F" flag) or the whole pipeline can    */
+/*  be switched by setting the environment variable MONTAGE_BITPIX to    */
+/*  -32.                                                                 */
+/*                                                                       */
+/*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <montage.h>
+
+
+static int montage_bitpix = 0;
+
+
+/*********************************************************/
+/*                                                       */
+/*  Set the output BITPIX.  Only -64 and -32 are         */
+/*  allowed; zero resets to the default (environment     */
+/*  or -64).  Returns 0 on success, 1 if the value is    */
+/*  not allowed.                                         */
+/*                                                       */
+/*********************************************************/
+
+int montage_setBitpix(int bitpix)
+{
+   if(bitpix != 0 && bitpix != -64 && bitpix != -32)
+      return 1;
+
+   montage_bitpix = bitpix;
+
+   return 0;
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  The BITPIX output images should be written with.     */
+/*                                                       */
+/*********************************************************/
+
+int montage_outBitpix(void)
+{
+   char *env;
+
+   if(montage_bitpix != 0)
+      return montage_bitpix;
+
+   env = getenv("MONTAGE_BITPIX");
+
+   if(env != (char *)NULL && atoi(env) == -32)
+      return -32;
+
+   return -64;
+}
@@ -119,6 +119,8 @@ void montage_checkHdrExact(int stringent)
 char *montage_checkHdr(char *infile, int hdrflag, int hdu)
 {
    int       i, len, ncard, morekeys;
+   int       compressed, bitpix, naxis, keyclass;
+   long      naxes[10];
 
    int       status = 0;
 
@@ -208,6 +210,62 @@ char *montage_checkHdr(char *infile, int hdrflag, int hdu)
          }
       }
 
+      else
+      {
+         /* A tile-compressed image is stored in the */
+         /* first extension, behind an empty primary */
+
+         if(fits_get_img_dim(infptr, &naxis, &status) == 0 && naxis == 0)
+         {
+            if(fits_movabs_hdu(infptr, 2, NULL, &status)
+            || !fits_is_compressed_image(infptr, &status))
+            {
+               status = 0;
+               fits_movabs_hdu(infptr, 1, NULL, &status);
+            }
+         }
+
+         status = 0;
+      }
+
+
+      /* For a compressed image, the structural keywords   */
+      /* are those of the binary table; use the image ones */
+
+      compressed = fits_is_compressed_image(infptr, &status);
+
+      if(compressed)
+      {
+         if(fits_get_img_param(infptr, 10, &bitpix, &naxis, naxes, &status))
+         {
+            montage_FITSerror(status);
+            return montage_msgstr;
+         }
+
+         montage_fitsCheck("SIMPLE", "T");
+         sprintf(line, "%-8s= %20s", "SIMPLE", "T");
+         montage_strAdd(mHeader, line);
+
+         sprintf(tmpstr, "%d", bitpix);
+         montage_fitsCheck("BITPIX", tmpstr);
+         sprintf(line, "%-8s= %20s", "BITPIX", tmpstr);
+         montage_strAdd(mHeader, line);
+
+         sprintf(tmpstr, "%d", naxis);
+         montage_fitsCheck("NAXIS", tmpstr);
+         sprintf(line, "%-8s= %20s", "NAXIS", tmpstr);
+         montage_strAdd(mHeader, line);
+
+         for(i=0; i<naxis && i<10; ++i)
+         {
+            sprintf(fitskeyword, "NAXIS%d", i+1);
+            sprintf(tmpstr, "%ld", naxes[i]);
+            montage_fitsCheck(fitskeyword, tmpstr);
+            sprintf(line, "%-8s= %20s", fitskeyword, tmpstr);
+            montage_strAdd(mHeader, line);
+         }
+      }
+
       if(fits_get_hdrspace (infptr, &ncard, &morekeys, &status))
       {
          montage_FITSerror(status);
@@ -231,6 +289,16 @@ char *montage_checkHdr(char *infile, int hdrflag, int hdu)
             return montage_msgstr;
          }
 
+         if(compressed)
+         {
+            sprintf(line, "%-8s= %20s", fitskeyword, fitsvalue);
+
+            keyclass = fits_get_keyclass(line);
+
+            if(keyclass <= TYP_CMPRS_KEY || keyclass == TYP_CKSUM_KEY)
+               continue;
+         }
+
          if(fitsvalue[0] == '\'')
          {
             strcpy(tmpstr, fitsvalue+1);
@@ -0,0 +1,504 @@
+/* Module: compress.c
+
+*/
+
+/*************************************************************************/
+/*                                                                       */
+/*  Tile-compressed output (and input) support.                          */
+/*                                                                       */
+/*  The intermediate images in a mosaic (projected images, differences   */
+/*  and especially the area images, which are mostly constant) compress  */
+/*  very well with the FITS tile compression conventions, which CFITSIO  */
+/*  supports.  The output image is stored as a binary table extension    */
+/*  behind an empty primary HDU, one image row per tile, so modules that */
+/*  read their input a row at a time decompress each tile exactly once.  */
+/*                                                                       */
+/*  The modules build their output headers with fits_write_key_template()*/
+/*  and then patch BITPIX, NAXISn and so on; done directly on a          */
+/*  compressed HDU this would overwrite the binary table structure       */
+/*  keywords.  So when compression is on the header is first built in a  */
+/*  memory file (no pixels are ever written there) and the real          */
+/*  compressed file is created from it by montage_compressImage() just   */
+/*  before the pixel data is written.                                    */
+/*                                                                       */
+/*  Like the output BITPIX, the compression setting is process-wide.     */
+/*  The executables set it with "-C spec"; alternatively the whole       */
+/*  pipeline can be switched with the environment variable               */
+/*  MONTAGE_COMPRESS.  The spec is "rice" or "gzip", optionally followed */
+/*  by ":q" giving the floating-point quantization level (the tile noise */
+/*  sigma divided by q; default 16).  q must be positive: the modules    */
+/*  hand CFITSIO double buffers and its lossless (unquantized) mode only */
+/*  exists for float data, so the pixels are always quantized.  "none"   */
+/*  turns compression off.  Images written to memory (memImage.c) are    */
+/*  never compressed.                                                    */
+/*                                                                       */
+/*  Area images are created with montage_compressArea() instead.  Their  */
+/*  tiles are mostly constant and have no noise to scale a step from     */
+/*  (CFITSIO would store such tiles uncompressed), and the areas weight  */
+/*  every later co-addition, so they are quantized with a fixed step of  */
+/*  2^-24 of the largest value in each buffer written: constant tiles    */
+/*  come back exactly and the rest to single-precision accuracy.         */
+/*                                                                       */
+/*  Blank (NaN) pixels need care: CFITSIO only recognizes them when the  */
+/*  data is written with an explicit null value, so the modules write    */
+/*  their pixels through montage_writePix(), which substitutes a flag    */
+/*  value for the NaNs of a compressed image.                            */
+/*                                                                       */
+/*  On the reading side, montage_imageHdr() returns the header of an     */
+/*  image HDU as a string for wcsinit(), translating the compressed      */
+/*  image keywords back to the ones of the original image.               */
+/*                                                                       */
+/*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+
+#include <fitsio.h>
+#include <montage.h>
+
+#define QLEVEL 16.
+
+#define NULLFLAG -9.1191291391491e-36
+
+
+static int    montage_compressSet = 0;
+static int    montage_compressType;
+static double montage_compressQ;
+
+static int    montage_parseCompress(char *spec, int *type, double *q);
+
+
+/*********************************************************/
+/*                                                       */
+/*  Set the output compression.  A NULL or empty spec    */
+/*  resets to the default (environment or none).         */
+/*  Returns 0 on success, 1 if the spec is invalid.      */
+/*                                                       */
+/*********************************************************/
+
+int montage_setCompress(char *spec)
+{
+   int    type;
+   double q;
+
+   if(spec == (char *)NULL || strlen(spec) == 0)
+   {
+      montage_compressSet = 0;
+      return 0;
+   }
+
+   if(montage_parseCompress(spec, &type, &q))
+      return 1;
+
+   montage_compressSet  = 1;
+   montage_compressType = type;
+   montage_compressQ    = q;
+
+   return 0;
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  The compression type (CFITSIO RICE_1 or GZIP_1)      */
+/*  output images should be written with; 0 for none.    */
+/*  If qlevel is not NULL it is set to the quantization  */
+/*  level.                                               */
+/*                                                       */
+/*********************************************************/
+
+int montage_outCompress(double *qlevel)
+{
+   int    type;
+   double q;
+   char  *env;
+
+   type = 0;
+   q    = QLEVEL;
+
+   if(montage_compressSet)
+   {
+      type = montage_compressType;
+      q    = montage_compressQ;
+   }
+   else
+   {
+      env = getenv("MONTAGE_COMPRESS");
+
+      if(env != (char *)NULL && montage_parseCompress(env, &type, &q))
+         type = 0;
+   }
+
+   if(qlevel)
+      *qlevel = q;
+
+   return type;
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  The name to give fits_create_file() for an output    */
+/*  image.  With compression on, the header is staged in */
+/*  memory (see montage_compressImage() below).          */
+/*                                                       */
+/*********************************************************/
+
+char *montage_outName(char *fname)
+{
+   if(montage_outCompress((double *)NULL))
+      return "mem://";
+
+   return fname;
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  Called once the output header is complete and before */
+/*  any pixels are written.  If compression is on, the   */
+/*  image in *fptr is a header-only memory file; create  */
+/*  the real (tile-compressed) file, copy the header to  */
+/*  it, close the memory file and switch *fptr over.     */
+/*  Otherwise this does nothing.                         */
+/*                                                       */
+/*********************************************************/
+
+static int montage_compress(fitsfile **fptr, char *fname, int area, int *status);
+
+int montage_compressImage(fitsfile **fptr, char *fname, int *status)
+{
+   return montage_compress(fptr, fname, 0, status);
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  The same for an area image: the compressed file is   */
+/*  flagged for the fixed-step quantization applied by   */
+/*  montage_writePix().                                  */
+/*                                                       */
+/*********************************************************/
+
+int montage_compressArea(fitsfile **fptr, char *fname, int *status)
+{
+   return montage_compress(fptr, fname, 1, status);
+}
+
+
+static int montage_compress(fitsfile **fptr, char *fname, int area, int *status)
+{
+   int       i, type, bitpix, naxis, nkeys, keyclass;
+   long      naxes[10], tile[10];
+   double    q;
+   char      card[FLEN_CARD];
+   fitsfile *cfptr;
+
+   if(*status > 0)
+      return *status;
+
+   type = montage_outCompress(&q);
+
+   /* A negative level is an absolute step to CFITSIO; */
+   /* montage_writePix() sets the real one per buffer  */
+
+   if(area)
+      q = -1.;
+
+   if(type == 0)
+      return 0;
+
+   if(fits_get_img_param(*fptr, 10, &bitpix, &naxis, naxes, status))
+      return *status;
+
+   remove(fname);
+
+   if(fits_create_file(&cfptr, fname, status))
+      return *status;
+
+
+   /* One tile per image row */
+
+   tile[0] = naxes[0];
+
+   for(i=1; i<naxis; ++i)
+      tile[i] = 1;
+
+   /* No subtractive dithering: CFITSIO removes  */
+   /* the dither in single precision, which ruins */
+   /* tiles that contain blank pixels (their      */
+   /* integers sit near -2^31).  Undithered       */
+   /* output is also reproducible run to run.     */
+
+   fits_set_compression_type(cfptr, type, status);
+   fits_set_tile_dim        (cfptr, naxis, tile, status);
+   fits_set_quantize_level  (cfptr, (float)q, status);
+   fits_set_quantize_dither (cfptr, -1, status);
+
+   if(fits_create_img(cfptr, bitpix, naxis, naxes, status))
+      return *status;
+
+
+   /* Copy everything but the structural keywords */
+
+   if(fits_get_hdrspace(*fptr, &nkeys, NULL, status))
+      return *status;
+
+   for(i=1; i<=nkeys; ++i)
+   {
+      if(fits_read_record(*fptr, i, card, status))
+         return *status;
+
+      keyclass = fits_get_keyclass(card);
+
+      if(keyclass <= TYP_CMPRS_KEY || keyclass == TYP_CKSUM_KEY)
+         continue;
+
+      if(fits_write_record(cfptr, card, status))
+         return *status;
+   }
+
+   if(fits_close_file(*fptr, status))
+      return *status;
+
+   *fptr = cfptr;
+
+   return *status;
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  fits_write_pix() replacement.  For a tile-compressed */
+/*  image the NaNs in a double buffer are swapped for a  */
+/*  flag value CFITSIO is told about (and swapped back   */
+/*  afterwards), and an area image gets its quantization */
+/*  step; otherwise it is fits_write_pix().              */
+/*                                                       */
+/*********************************************************/
+
+int montage_writePix(fitsfile *fptr, int datatype, long *fpixel,
+                     long nelements, void *array, int *status)
+{
+   long    i;
+   float   qlevel;
+   double *data, nullval, maxval;
+
+   if(*status > 0)
+      return *status;
+
+   if(datatype != TDOUBLE || !fits_is_compressed_image(fptr, status))
+      return fits_write_pix(fptr, datatype, fpixel, nelements, array, status);
+
+   data    = (double *)array;
+   nullval = NULLFLAG;
+
+   for(i=0; i<nelements; ++i)
+      if(isnan(data[i]))
+         data[i] = nullval;
+
+   fits_get_quantize_level(fptr, &qlevel, status);
+
+   if(qlevel < 0.)
+   {
+      maxval = 0.;
+
+      for(i=0; i<nelements; ++i)
+         if(data[i] != nullval && fabs(data[i]) > maxval)
+            maxval = fabs(data[i]);
+
+      if(maxval == 0. || !isfinite(maxval))
+         maxval = 1.;
+
+      fits_set_quantize_level(fptr, -(float)ldexp(maxval, -24), status);
+   }
+
+   fits_write_pixnull(fptr, TDOUBLE, fpixel, nelements, array, &nullval, status);
+
+   for(i=0; i<nelements; ++i)
+      if(data[i] == nullval)
+         data[i] = NAN;
+
+   return *status;
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  fits_copy_header() replacement for modules that      */
+/*  start their output from a copy of the input header.  */
+/*  A tile-compressed input HDU is copied as the plain   */
+/*  image it represents.                                 */
+/*                                                       */
+/*********************************************************/
+
+int montage_copyHeader(fitsfile *infptr, fitsfile *outfptr, int *status)
+{
+   int    i, bitpix, naxis, nkeys, keyclass;
+   long   naxes[10];
+   char   card[FLEN_CARD];
+
+   if(*status > 0)
+      return *status;
+
+   if(!fits_is_compressed_image(infptr, status))
+      return fits_copy_header(infptr, outfptr, status);
+
+   if(fits_get_img_param(infptr, 10, &bitpix, &naxis, naxes, status))
+      return *status;
+
+   if(fits_create_img(outfptr, bitpix, naxis, naxes, status))
+      return *status;
+
+   if(fits_get_hdrspace(infptr, &nkeys, NULL, status))
+      return *status;
+
+   for(i=1; i<=nkeys; ++i)
+   {
+      if(fits_read_record(infptr, i, card, status))
+         return *status;
+
+      keyclass = fits_get_keyclass(card);
+
+      if(keyclass <= TYP_CMPRS_KEY || keyclass == TYP_CKSUM_KEY)
+         continue;
+
+      if(fits_write_record(outfptr, card, status))
+         return *status;
+   }
+
+   return *status;
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  Return the header of the current image HDU as a      */
+/*  single string of 80-character cards (as wanted by    */
+/*  wcsinit()).  For a tile-compressed image the binary  */
+/*  table and compression keywords are dropped and the   */
+/*  image's own BITPIX and NAXISn put back.  The string  */
+/*  should be freed by the caller.                       */
+/*                                                       */
+/*********************************************************/
+
+int montage_imageHdr(fitsfile *fptr, char **header, int *status)
+{
+   int    i, nkeys, nout, bitpix, naxis, keyclass;
+   long   naxes[10];
+   char   card[FLEN_CARD];
+   char  *hdr;
+
+   if(*status > 0)
+      return *status;
+
+   if(!fits_is_compressed_image(fptr, status))
+      return fits_get_image_wcs_keys(fptr, header, status);
+
+   if(fits_get_img_param(fptr, 10, &bitpix, &naxis, naxes, status))
+      return *status;
+
+   if(fits_get_hdrspace(fptr, &nkeys, NULL, status))
+      return *status;
+
+   hdr = (char *)malloc((nkeys + 14) * 80 + 1);
+
+   if(hdr == (char *)NULL)
+      return (*status = MEMORY_ALLOCATION);
+
+   nout = 0;
+
+   sprintf(card, "SIMPLE  = %20s", "T");
+   sprintf(hdr + 80*nout++, "%-80s", card);
+
+   sprintf(card, "BITPIX  = %20d", bitpix);
+   sprintf(hdr + 80*nout++, "%-80s", card);
+
+   sprintf(card, "NAXIS   = %20d", naxis);
+   sprintf(hdr + 80*nout++, "%-80s", card);
+
+   for(i=0; i<naxis && i<10; ++i)
+   {
+      sprintf(card, "NAXIS%-3d= %20ld", i+1, naxes[i]);
+      sprintf(hdr + 80*nout++, "%-80s", card);
+   }
+
+   for(i=1; i<=nkeys; ++i)
+   {
+      if(fits_read_record(fptr, i, card, status))
+      {
+         free(hdr);
+         return *status;
+      }
+
+      keyclass = fits_get_keyclass(card);
+
+      if(keyclass <= TYP_CMPRS_KEY || keyclass == TYP_CKSUM_KEY)
+         continue;
+
+      sprintf(hdr + 80*nout++, "%-80s", card);
+   }
+
+   sprintf(hdr + 80*nout++, "%-80s", "END");
+
+   *header = hdr;
+
+   return *status;
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  Parse a compression spec ("rice", "gzip:4", ...)     */
+/*                                                       */
+/*********************************************************/
+
+static int montage_parseCompress(char *spec, int *type, double *q)
+{
+   char  name[32];
+   char *colon, *end;
+   int   len;
+
+   *type = 0;
+   *q    = QLEVEL;
+
+   colon = strchr(spec, ':');
+
+   len = strlen(spec);
+
+   if(colon)
+      len = colon - spec;
+
+   if(len >= 32)
+      return 1;
+
+   strncpy(name, spec, len);
+   name[len] = '\0';
+
+        if(strcasecmp(name, "none") == 0) *type = 0;
+   else if(strcasecmp(name, "rice") == 0) *type = RICE_1;
+   else if(strcasecmp(name, "gzip") == 0) *type = GZIP_1;
+   else
+      return 1;
+
+   if(colon)
+   {
+      *q = strtod(colon+1, &end);
+
+      if(end == colon+1 || *end != '\0' || *q <= 0.)
+         return 1;
+   }
+
+   return 0;
+}
@@ -0,0 +1,496 @@
+/* Module: memImage.c
+
+*/
+
+/*************************************************************************/
+/*                                                                       */
+/*  In-memory images.                                                    */
+/*                                                                       */
+/*  The image processing modules have a buffer-based form (mProjectMem() */
+/*  and so on) as well as the file-based one.  Both run the same module  */
+/*  code; these routines are what that code calls instead of the CFITSIO */
+/*  file routines when an image is in memory (struct mImage: a header    */
+/*  string and a float or double pixel array).                           */
+/*                                                                       */
+/*  The header keywords are still read through CFITSIO, from a FITS      */
+/*  memory file holding only the header, so the modules need no special  */
+/*  keyword handling.  The pixels never go through FITS: input pixels    */
+/*  are read straight from the caller's array and output pixels are      */
+/*  stored straight into the array handed back.                          */
+/*                                                                       */
+/*  Everything here works on the arguments it is given; there is no      */
+/*  shared state.                                                        */
+/*                                                                       */
+/*************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <fitsio.h>
+#include <fitsio2.h>
+#include <montage.h>
+
+
+static int montage_memDone(fitsfile *fptr, int *status);
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  Open the header of an input image for keyword reads. */
+/*  The header may be either 80-character cards run      */
+/*  together (as wcsinit() wants) or one card per line   */
+/*  (as in a template file); its structural keywords are */
+/*  replaced by ones describing the pixel array.         */
+/*                                                       */
+/*********************************************************/
+
+int montage_memOpen(fitsfile **fptr, struct mImage *image, int *status)
+{
+   int   len, keyclass;
+   char *ptr, *end;
+   char  card[FLEN_CARD];
+
+   if(*status > 0)
+      return *status;
+
+   if(image == (struct mImage *)NULL || image->header == (char *)NULL
+   || (image->bitpix != -32 && image->bitpix != -64)
+   || image->naxes[0] <= 0 || image->naxes[1] <= 0
+   || image->data == (void *)NULL)
+   {
+      ffpmsg("Invalid in-memory image (need a header and a -32 or -64 pixel array)");
+      return (*status = BAD_DIMEN);
+   }
+
+   if(fits_create_file(fptr, "mem://", status))
+      return *status;
+
+   if(fits_create_img(*fptr, image->bitpix, 2, image->naxes, status))
+      return montage_memDone(*fptr, status);
+
+   ptr = image->header;
+
+   while(*ptr != '\0')
+   {
+      end = strchr(ptr, '\n');
+
+      if(end != (char *)NULL && end - ptr <= 81)
+         len = end - ptr;
+      else
+      {
+         len = strlen(ptr);
+
+         if(len > 80)
+            len = 80;
+
+         end = ptr + len - 1;
+      }
+
+      strncpy(card, ptr, len);
+      card[len] = '\0';
+
+      if(len > 0 && card[len-1] == '\r')
+         card[len-1] = '\0';
+
+      ptr = end + 1;
+
+      if(strlen(card) == 0)
+         continue;
+
+      if(strncmp(card, "END", 3) == 0 && (card[3] == '\0' || card[3] == ' '))
+         break;
+
+      keyclass = fits_get_keyclass(card);
+
+      if(keyclass <= TYP_CMPRS_KEY || keyclass == TYP_SCAL_KEY
+      || keyclass == TYP_CKSUM_KEY || keyclass == TYP_NULL_KEY)
+         continue;
+
+      if(fits_write_record(*fptr, card, status))
+         return montage_memDone(*fptr, status);
+   }
+
+   if(fits_set_hdustruc(*fptr, status))
+      return montage_memDone(*fptr, status);
+
+   return *status;
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  fits_read_pix() for an image that may be in memory.  */
+/*  With no image this is just fits_read_pix().          */
+/*  Otherwise the pixels are taken from the image array  */
+/*  (first two axes only), with the same null handling.  */
+/*                                                       */
+/*********************************************************/
+
+int montage_readPix(fitsfile *fptr, struct mImage *image, int datatype, long *fpixel,
+                    long nelements, void *nulval, void *array, int *anynul, int *status)
+{
+   long   i, offset;
+   int    check;
+   double value, null;
+
+   if(image == (struct mImage *)NULL)
+      return fits_read_pix(fptr, datatype, fpixel, nelements, nulval, array, anynul, status);
+
+   if(*status > 0)
+      return *status;
+
+   if(datatype != TDOUBLE && datatype != TFLOAT)
+      return (*status = BAD_DATATYPE);
+
+   offset = (fpixel[1] - 1) * image->naxes[0] + fpixel[0] - 1;
+
+   if(offset < 0 || offset + nelements > image->naxes[0] * image->naxes[1])
+      return (*status = BAD_PIX_NUM);
+
+   null  = 0.;
+   check = 0;
+
+   if(nulval != (void *)NULL)
+   {
+      if(datatype == TDOUBLE) null = *(double *)nulval;
+      else                    null = *(float  *)nulval;
+
+      check = (null != 0.);
+   }
+
+   if(anynul)
+      *anynul = 0;
+
+   for(i=0; i<nelements; ++i)
+   {
+      if(image->bitpix == -32) value = ((float  *)image->data)[offset+i];
+      else                     value = ((double *)image->data)[offset+i];
+
+      if(check && isnan(value))
+      {
+         value = null;
+
+         if(anynul)
+            *anynul = 1;
+      }
+
+      if(datatype == TDOUBLE) ((double *)array)[i] = value;
+      else                    ((float  *)array)[i] = value;
+   }
+
+   return *status;
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  Used in place of montage_compressImage() when the    */
+/*  output goes to memory:  once the output header in    */
+/*  fptr (a "mem://" file) is complete, make the image   */
+/*  to hold the pixels.  Its header is filled in by      */
+/*  montage_closeOutput().                               */
+/*                                                       */
+/*********************************************************/
+
+int montage_memOutput(fitsfile *fptr, struct mImage **image, int *status)
+{
+   int  bitpix, naxis, size;
+   long naxes[10];
+
+   struct mImage *out;
+
+   *image = (struct mImage *)NULL;
+
+   if(*status > 0)
+      return *status;
+
+   naxes[0] = naxes[1] = 1;
+
+   if(fits_set_hdustruc(fptr, status)
+   || fits_get_img_param(fptr, 10, &bitpix, &naxis, naxes, status))
+      return *status;
+
+   out = (struct mImage *)calloc(1, sizeof(struct mImage));
+
+   if(out == (struct mImage *)NULL)
+      return (*status = MEMORY_ALLOCATION);
+
+   out->bitpix   = (bitpix == FLOAT_IMG ? -32 : -64);
+   out->naxes[0] = naxes[0];
+   out->naxes[1] = naxes[1];
+
+   size = -out->bitpix/8;
+
+   out->data  = calloc(naxes[0] * naxes[1], size);
+   out->block = out->data;
+
+   if(out->data == (void *)NULL)
+   {
+      free(out);
+      return (*status = MEMORY_ALLOCATION);
+   }
+
+   *image = out;
+
+   return *status;
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  montage_writePix() for an output that may be in      */
+/*  memory.  With no image this is montage_writePix();   */
+/*  otherwise the pixels are stored in the image array.  */
+/*                                                       */
+/*********************************************************/
+
+int montage_putPix(fitsfile *fptr, struct mImage *image, int datatype, long *fpixel,
+                   long nelements, void *array, int *status)
+{
+   long   i, offset;
+   double value;
+
+   if(image == (struct mImage *)NULL)
+      return montage_writePix(fptr, datatype, fpixel, nelements, array, status);
+
+   if(*status > 0)
+      return *status;
+
+   if(datatype != TDOUBLE && datatype != TFLOAT)
+      return (*status = BAD_DATATYPE);
+
+   offset = (fpixel[1] - 1) * image->naxes[0] + fpixel[0] - 1;
+
+   if(offset < 0 || offset + nelements > image->naxes[0] * image->naxes[1])
+      return (*status = BAD_PIX_NUM);
+
+   for(i=0; i<nelements; ++i)
+   {
+      if(datatype == TDOUBLE) value = ((double *)array)[i];
+      else                    value = ((float  *)array)[i];
+
+      if(image->bitpix == -32) ((float  *)image->data)[offset+i] = value;
+      else                     ((double *)image->data)[offset+i] = value;
+   }
+
+   return *status;
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  fits_close_file() for an input image that may be in  */
+/*  memory (opened by montage_memOpen()).                */
+/*                                                       */
+/*********************************************************/
+
+int montage_closeInput(fitsfile *fptr, struct mImage *image, int *status)
+{
+   if(image == (struct mImage *)NULL)
+      return fits_close_file(fptr, status);
+
+   return montage_memDone(fptr, status);
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  fits_close_file() for an output image that may be in */
+/*  memory.  The image is given the final header.        */
+/*                                                       */
+/*********************************************************/
+
+int montage_closeOutput(fitsfile *fptr, struct mImage *image, int *status)
+{
+   int   nkeys;
+   char *header;
+
+   if(image == (struct mImage *)NULL)
+      return fits_close_file(fptr, status);
+
+   if(*status <= 0
+   && fits_hdr2str(fptr, 0, (char **)NULL, 0, &header, &nkeys, status) == 0)
+   {
+      free(image->header);
+
+      image->header = header;
+   }
+
+   return montage_memDone(fptr, status);
+}
+
+
+/* The memory file only ever holds a header.  Closed   */
+/* normally, CFITSIO would first write out a zero data */
+/* unit the size of the image, so it is closed as if   */
+/* it had been opened read-only.                       */
+
+static int montage_memDone(fitsfile *fptr, int *status)
+{
+   int tstatus;
+
+   tstatus = 0;
+
+   fits_flush_file(fptr, &tstatus);
+
+   (fptr->Fptr)->writemode = READONLY;
+
+   fits_close_file(fptr, &tstatus);
+
+   if(*status <= 0)
+      *status = tstatus;
+
+   return *status;
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  A header template given as a string, opened for      */
+/*  reading the way the modules read template files.     */
+/*  80-character cards run together are given one per    */
+/*  line.  The stream lives in memory and is gone when   */
+/*  closed.                                              */
+/*                                                       */
+/*********************************************************/
+
+FILE *montage_memText(char *text)
+{
+   long  len, size;
+   char *ptr, *end;
+   FILE *fp;
+
+   if(text == (char *)NULL)
+      return (FILE *)NULL;
+
+   size = strlen(text);
+
+   size = size + size / 80 + 2;
+
+   fp = fmemopen(NULL, size, "w+");
+
+   if(fp == (FILE *)NULL)
+      return fp;
+
+   ptr = text;
+
+   while(*ptr != '\0')
+   {
+      end = strchr(ptr, '\n');
+
+      if(end != (char *)NULL && end - ptr <= 81)
+         len = end - ptr;
+      else
+      {
+         len = strlen(ptr);
+
+         if(len > 80)
+            len = 80;
+
+         end = ptr + len - 1;
+      }
+
+      fwrite(ptr, 1, len, fp);
+      fputc('\n', fp);
+
+      ptr = end + 1;
+   }
+
+   rewind(fp);
+
+   return fp;
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  fits_write_key_template() for a template that may be */
+/*  a string (header) rather than a file.                */
+/*                                                       */
+/*********************************************************/
+
+int montage_writeTemplate(fitsfile *fptr, char *template_file, char *header, int *status)
+{
+   int   keytype;
+   char  card[FLEN_CARD], line[161];
+   char  keyname[FLEN_KEYWORD], newname[FLEN_KEYWORD];
+   FILE *fp;
+
+   if(header == (char *)NULL)
+      return fits_write_key_template(fptr, template_file, status);
+
+   if(*status > 0)
+      return *status;
+
+   fp = montage_memText(header);
+
+   if(fp == (FILE *)NULL)
+      return (*status = FILE_NOT_OPENED);
+
+   while(fgets(line, 160, fp) != (char *)NULL)
+   {
+      line[160] = '\0';
+
+      if(strlen(line) > 0 && line[strlen(line)-1] == '\n')
+         line[strlen(line)-1]  = '\0';
+
+      if(fits_parse_template(line, card, &keytype, status) > 0)
+         break;
+
+      strncpy(keyname, card, 8);
+      keyname[8] = '\0';
+
+      if(keytype == -2)
+      {
+         strncpy(newname, &card[40], 8);
+         newname[8] = '\0';
+
+         fits_modify_name(fptr, keyname, newname, status);
+      }
+      else if(keytype == -1)
+         fits_delete_key(fptr, keyname, status);
+
+      else if(keytype == 0)
+         fits_update_card(fptr, keyname, card, status);
+
+      else if(keytype == 1)
+         fits_write_record(fptr, card, status);
+
+      else
+         break;
+   }
+
+   fclose(fp);
+
+   return *status;
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  Free an image returned by the memory interface.      */
+/*                                                       */
+/*********************************************************/
+
+void montage_imageFree(struct mImage *image)
+{
+   if(image == (struct mImage *)NULL)
+      return;
+
+   free(image->header);
+   free(image->block);
+   free(image);
+}
@@ -0,0 +1,160 @@
+/* Module: serverMode.c
+
+*/
+
+/*************************************************************************/
+/*                                                                       */
+/*  Simple "server" loop for the module executables.                     */
+/*                                                                       */
+/*  Rather than starting a new process (and re-reading the same header   */
+/*  template, etc.) for every image, a workflow can start a program like */
+/*  mProject once with the single argument "-server" and then write      */
+/*  command lines to its stdin, one per line.  Each line holds exactly   */
+/*  what would otherwise follow the program name on the command line;    */
+/*  double quotes can be used around arguments containing spaces.  Each  */
+/*  command is answered with the usual single-line return structure      */
+/*  and stdout is flushed.  The loop ends on EOF or the command "quit".  */
+/*                                                                       */
+/*  The caller supplies the function that processes one argument list    */
+/*  (basically its old main()) which must print its return structure     */
+/*  and return rather than exit.                                         */
+/*                                                                       */
+/*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include <montage.h>
+
+#define MAXLINE 16384
+#define MAXARG   256
+
+extern int optind;
+
+#if defined(__APPLE__) || defined(__FreeBSD__)
+extern int optreset;
+#endif
+
+
+static int montage_serverArgs(char *line, char **argv, int maxarg);
+
+
+int montage_serverMode(char *progname, int (*command)(int argc, char **argv))
+{
+   int   len, argc;
+   char  line[MAXLINE];
+   char *argv[MAXARG];
+
+   while(fgets(line, MAXLINE, stdin) != (char *)NULL)
+   {
+      len = strlen(line);
+
+      while(len > 0 && (line[len-1] == '\n' || line[len-1] == '\r'))
+      {
+         line[len-1] = '\0';
+         --len;
+      }
+
+      argv[0] = progname;
+
+      argc = montage_serverArgs(line, argv+1, MAXARG-2) + 1;
+
+      argv[argc] = (char *)NULL;
+
+      if(argc == 1)
+         continue;
+
+      if(strcmp(argv[1], "quit") == 0)
+      {
+         printf("[struct stat=\"OK\"]\n");
+         fflush(stdout);
+         break;
+      }
+
+
+      /* Reset getopt() so the command can rescan its arguments */
+
+#ifdef __GLIBC__
+      optind = 0;
+#else
+      optind = 1;
+#endif
+
+#if defined(__APPLE__) || defined(__FreeBSD__)
+      optreset = 1;
+#endif
+
+      (*command)(argc, argv);
+
+      fflush(stdout);
+   }
+
+   fflush(stdout);
+
+   return 0;
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  Split a command line into whitespace-separated       */
+/*  arguments (in place), honoring double quotes.        */
+/*                                                       */
+/*********************************************************/
+
+static int montage_serverArgs(char *line, char **argv, int maxarg)
+{
+   int   argc;
+   char *ptr, *out;
+
+   argc = 0;
+   ptr  = line;
+
+   while(argc < maxarg)
+   {
+      while(*ptr == ' ' || *ptr == '\t')
+         ++ptr;
+
+      if(*ptr == '\0')
+         break;
+
+      argv[argc] = ptr;
+      ++argc;
+
+      out = ptr;
+
+      while(*ptr != '\0' && *ptr != ' ' && *ptr != '\t')
+      {
+         if(*ptr == '"')
+         {
+            ++ptr;
+
+            while(*ptr != '\0' && *ptr != '"')
+            {
+               *out = *ptr;
+               ++out;
+               ++ptr;
+            }
+
+            if(*ptr == '"')
+               ++ptr;
+         }
+         else
+         {
+            *out = *ptr;
+            ++out;
+            ++ptr;
+         }
+      }
+
+      if(*ptr != '\0')
+         ++ptr;
+
+      *out = '\0';
+   }
+
+   return argc;
+}
@@ -0,0 +1,371 @@
+/* Module: stats.c
+
+*/
+
+/*************************************************************************/
+/*                                                                       */
+/*  Per-phase timing and counters for the core modules.                  */
+/*                                                                       */
+/*  A module calls montage_statsStart() on entry and brackets its main   */
+/*  stages (reading, coordinate transforms, overlap computation,         */
+/*  writing, ...) with montage_phaseBegin() / montage_phaseEnd().  The   */
+/*  same phase may be entered many times (once per image row, say); the  */
+/*  wall-clock and CPU time are summed.  Pixel, overlap and byte counts  */
+/*  are accumulated with the montage_count*() routines.  On success the  */
+/*  module calls montage_statsEnd(), which returns a JSON fragment that  */
+/*  goes into the return structure "json" string.                        */
+/*                                                                       */
+/*  Phases are meant to be timed at row or stage granularity: each       */
+/*  begin/end pair costs a couple of clock reads, which is nothing next  */
+/*  to a row of pixel overlaps but would be noticeable per pixel.        */
+/*                                                                       */
+/*  If the environment variable MONTAGE_TRACE names a file, events in    */
+/*  Chrome trace-event format ("JSON array" form, which the viewers      */
+/*  accept without the closing bracket) are appended to it: one for      */
+/*  each module call, with the phase totals as arguments, plus one for   */
+/*  each phase interval of at least a millisecond.  Timestamps are       */
+/*  absolute, so the files from all the processes of a pipeline run can  */
+/*  share one trace and be viewed on a single timeline.  Each event is   */
+/*  a single append-mode write() so concurrent processes don't mix       */
+/*  their lines.                                                         */
+/*                                                                       */
+/*************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#include <fitsio.h>
+#include <montage.h>
+
+#define MAXPHASE    32
+#define MAXSTR     256
+#define TRACEMIN  1000.
+
+struct phaseInfo
+{
+   char   name[MAXSTR];
+   int    active;
+   long   calls;
+   double wall0;
+   double cpu0;
+   double wall;
+   double cpu;
+};
+
+static char   stats_module[MAXSTR];
+static double stats_wall0;
+static double stats_cpu0;
+
+static struct phaseInfo stats_phase[MAXPHASE];
+static int              stats_nphase = 0;
+
+static long long stats_pixels;
+static long long stats_overlaps;
+static long long stats_bytesRead;
+static long long stats_bytesWritten;
+
+static int  stats_traceFd = -2;
+
+static char stats_json[4096];
+
+static double stats_wallTime(void);
+static double stats_cpuTime (void);
+static void   stats_trace   (char *name, char *cat, double ts, double dur, char *args);
+
+
+/*********************************************************/
+/*                                                       */
+/*  Reset everything at the start of a module call.      */
+/*  (In server mode many calls share one process.)       */
+/*                                                       */
+/*********************************************************/
+
+void montage_statsStart(char *module)
+{
+   strncpy(stats_module, module, MAXSTR-1);
+   stats_module[MAXSTR-1] = '\0';
+
+   stats_nphase = 0;
+
+   stats_pixels       = 0;
+   stats_overlaps     = 0;
+   stats_bytesRead    = 0;
+   stats_bytesWritten = 0;
+
+   stats_wall0 = stats_wallTime();
+   stats_cpu0  = stats_cpuTime();
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  Start and stop timing a named phase.                 */
+/*                                                       */
+/*********************************************************/
+
+static struct phaseInfo *stats_lookup(char *phase)
+{
+   int i;
+
+   for(i=0; i<stats_nphase; ++i)
+      if(strcmp(stats_phase[i].name, phase) == 0)
+         return &stats_phase[i];
+
+   if(stats_nphase >= MAXPHASE)
+      return (struct phaseInfo *)NULL;
+
+   i = stats_nphase;
+
+   strncpy(stats_phase[i].name, phase, MAXSTR-1);
+   stats_phase[i].name[MAXSTR-1] = '\0';
+
+   stats_phase[i].active = 0;
+   stats_phase[i].calls  = 0;
+   stats_phase[i].wall   = 0.;
+   stats_phase[i].cpu    = 0.;
+
+   ++stats_nphase;
+
+   return &stats_phase[i];
+}
+
+
+void montage_phaseBegin(char *phase)
+{
+   struct phaseInfo *p;
+
+   p = stats_lookup(phase);
+
+   if(p == (struct phaseInfo *)NULL)
+      return;
+
+   p->active = 1;
+   p->wall0  = stats_wallTime();
+   p->cpu0   = stats_cpuTime();
+}
+
+
+void montage_phaseEnd(char *phase)
+{
+   struct phaseInfo *p;
+   double wall, cpu;
+
+   p = stats_lookup(phase);
+
+   if(p == (struct phaseInfo *)NULL || !p->active)
+      return;
+
+   wall = stats_wallTime();
+   cpu  = stats_cpuTime();
+
+   p->wall += wall - p->wall0;
+   p->cpu  += cpu  - p->cpu0;
+
+   ++p->calls;
+
+   p->active = 0;
+
+   if((wall - p->wall0) * 1.e6 >= TRACEMIN)
+      stats_trace(p->name, stats_module, p->wall0 * 1.e6, (wall - p->wall0) * 1.e6, (char *)NULL);
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  Counters.  Bytes are counted as pixel data in the    */
+/*  image's own BITPIX (for a compressed image, the      */
+/*  uncompressed size).                                  */
+/*                                                       */
+/*********************************************************/
+
+void montage_countPixels(long long n)
+{
+   stats_pixels += n;
+}
+
+
+void montage_countOverlaps(long long n)
+{
+   stats_overlaps += n;
+}
+
+
+static long long stats_pixBytes(fitsfile *fptr, long nelements)
+{
+   int bitpix, status;
+
+   status = 0;
+
+   if(fits_get_img_type(fptr, &bitpix, &status))
+      return 0;
+
+   return (long long)nelements * (bitpix < 0 ? -bitpix : bitpix) / 8;
+}
+
+
+void montage_countRead(fitsfile *fptr, long nelements)
+{
+   stats_bytesRead += stats_pixBytes(fptr, nelements);
+}
+
+
+void montage_countWrite(fitsfile *fptr, long nelements)
+{
+   stats_bytesWritten += stats_pixBytes(fptr, nelements);
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  Finish a module call: return the JSON fragment       */
+/*  (without the enclosing braces) and write the         */
+/*  module's trace event.                                */
+/*                                                       */
+/*********************************************************/
+
+char *montage_statsEnd(void)
+{
+   int           i;
+   long          peak;
+   double        wall, cpu;
+   char          phases[2048], item[MAXSTR+128], args[4100];
+   struct rusage usage;
+
+   wall = stats_wallTime() - stats_wall0;
+   cpu  = stats_cpuTime()  - stats_cpu0;
+
+   peak = 0;
+
+   if(getrusage(RUSAGE_SELF, &usage) == 0)
+   {
+#ifdef __APPLE__
+      peak = usage.ru_maxrss / 1024;
+#else
+      peak = usage.ru_maxrss;
+#endif
+   }
+
+   strcpy(phases, "");
+
+   for(i=0; i<stats_nphase; ++i)
+   {
+      sprintf(item, "%s\"%s\":{\"wall\":%.6f, \"cpu\":%.6f, \"calls\":%ld}",
+         i > 0 ? ", " : "", stats_phase[i].name, stats_phase[i].wall, stats_phase[i].cpu, stats_phase[i].calls);
+
+      if(strlen(phases) + strlen(item) >= sizeof(phases))
+         break;
+
+      strcat(phases, item);
+   }
+
+   sprintf(stats_json, "\"wall\":%.6f, \"cpu\":%.6f, \"phases\":{%s}, \"pixels\":%lld, \"overlaps\":%lld, \"bytesread\":%lld, \"byteswritten\":%lld, \"peakkb\":%ld",
+      wall, cpu, phases, stats_pixels, stats_overlaps, stats_bytesRead, stats_bytesWritten, peak);
+
+   sprintf(args, "{%s}", stats_json);
+
+   stats_trace(stats_module, "module", stats_wall0 * 1.e6, wall * 1.e6, args);
+
+   return stats_json;
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  Clocks (seconds).  Wall-clock time is absolute so    */
+/*  trace events from different processes line up.       */
+/*                                                       */
+/*********************************************************/
+
+static double stats_wallTime(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_REALTIME, &ts);
+
+   return (double)ts.tv_sec + ts.tv_nsec * 1.e-9;
+}
+
+
+static double stats_cpuTime(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+
+   return (double)ts.tv_sec + ts.tv_nsec * 1.e-9;
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  Append one complete ("X") event to the trace file.   */
+/*  The first process to create the file writes the      */
+/*  opening bracket.                                     */
+/*                                                       */
+/*********************************************************/
+
+static void stats_trace(char *name, char *cat, double ts, double dur, char *args)
+{
+   char   *fname;
+   char    line[8192];
+   int     pid, len;
+
+   if(stats_traceFd == -2)
+   {
+      stats_traceFd = -1;
+
+      fname = getenv("MONTAGE_TRACE");
+
+      if(fname == (char *)NULL || strlen(fname) == 0)
+         return;
+
+      stats_traceFd = open(fname, O_WRONLY | O_APPEND | O_CREAT | O_EXCL, 0644);
+
+      if(stats_traceFd >= 0)
+      {
+         if(write(stats_traceFd, "[\n", 2) != 2)
+         {
+            close(stats_traceFd);
+            stats_traceFd = -1;
+         }
+      }
+      else
+         stats_traceFd = open(fname, O_WRONLY | O_APPEND);
+   }
+
+   if(stats_traceFd < 0)
+      return;
+
+   pid = (int)getpid();
+
+   if(args == (char *)NULL)
+      len = snprintf(line, sizeof(line),
+               "{\"name\":\"%s\", \"cat\":\"%s\", \"ph\":\"X\", \"ts\":%.0f, \"dur\":%.0f, \"pid\":%d, \"tid\":%d},\n",
+               name, cat, ts, dur, pid, pid);
+   else
+      len = snprintf(line, sizeof(line),
+               "{\"name\":\"%s\", \"cat\":\"%s\", \"ph\":\"X\", \"ts\":%.0f, \"dur\":%.0f, \"pid\":%d, \"tid\":%d, \"args\":%s},\n",
+               name, cat, ts, dur, pid, pid, args);
+
+   if(len <= 0 || len >= (int)sizeof(line))
+      return;
+
+   if(write(stats_traceFd, line, len) != len)
+   {
+      close(stats_traceFd);
+      stats_traceFd = -1;
+   }
+}
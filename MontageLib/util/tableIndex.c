@@ -0,0 +1,758 @@
+/* Module: tableIndex.c
+
+*/
+
+/*************************************************************************/
+/*                                                                       */
+/*  Persistent spatial index for image metadata tables.                  */
+/*                                                                       */
+/*  Each table record is reduced to a bounding cap on the sky (center    */
+/*  unit vector plus radius), turned into a 3D box in unit-vector space  */
+/*  and packed into an R-tree.  Since the tables are static, the tree is */
+/*  bulk-loaded (sort-tile-recursive) rather than built by insertion.    */
+/*  As with the util/Search memory-map files, nodes are stored as an     */
+/*  array addressed by ID so the file can be mmap()ed and searched       */
+/*  in place with no parsing.                                            */
+/*                                                                       */
+/*  File layout:  header, node array, then the byte offset of every      */
+/*  record in the table (so records can be re-read with tseekpos()).     */
+/*                                                                       */
+/*  The header carries a tag naming the program that built it (each     */
+/*  program has its own idea of the bounding cap) and the size and       */
+/*  modification time of the table.  If these do not match, the index    */
+/*  is ignored and the caller falls back to reading the whole table.     */
+/*                                                                       */
+/*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <montage.h>
+
+#define MAGIC    "MTBLIDX1"
+#define MAXCARD  16
+#define HDRSIZE  4096
+
+/* Padding (degrees) on every cap to cover acos() */
+/* round-off in the callers' own distance checks  */
+
+#define CAPPAD   1.e-5
+
+
+struct IndexHdr
+{
+   char   magic[8];
+   char   tag[32];
+   long   tblsize;
+   long   tblmtime;
+   long   nrec;
+   long   nnode;
+   long   root;
+   int    maxcard;
+   int    nlevel;
+};
+
+struct IndexNode
+{
+   int    count;
+   int    level;                /* 0 is a leaf            */
+   double box  [MAXCARD][6];    /* xmin,ymin,zmin,xmax,.. */
+   long   child[MAXCARD];       /* node ID or record no.  */
+};
+
+struct IndexItem
+{
+   double box[6];
+   long   id;
+};
+
+struct montage_tableIndex
+{
+   /* Building */
+
+   struct IndexItem *items;
+   long              nitem;
+   long              maxitem;
+   long             *offsets;
+
+   /* Searching */
+
+   char             *map;
+   long              mapsize;
+
+   struct IndexHdr  *hdr;
+   struct IndexNode *nodes;
+   long             *recoff;
+};
+
+
+static int  sortAxis;
+
+static int  montage_indexCompare(const void *a, const void *b);
+static void montage_indexCapBox (double x, double y, double z, double radius, double *box);
+static long montage_indexWalk   (struct montage_tableIndex *index, double x, double y, double z, double radius,
+                                 long **found, double **xyz);
+
+
+
+/*********************************************/
+/*                                           */
+/*  montage_indexNew()                       */
+/*                                           */
+/*  Start an empty index (for building).     */
+/*                                           */
+/*********************************************/
+
+struct montage_tableIndex *montage_indexNew()
+{
+   struct montage_tableIndex *index;
+
+   index = (struct montage_tableIndex *)malloc(sizeof(struct montage_tableIndex));
+
+   memset((void *)index, 0, sizeof(struct montage_tableIndex));
+
+   index->maxitem = 4096;
+
+   index->items   = (struct IndexItem *)malloc(index->maxitem * sizeof(struct IndexItem));
+   index->offsets = (long *)malloc(index->maxitem * sizeof(long));
+
+   return index;
+}
+
+
+
+/*********************************************/
+/*                                           */
+/*  montage_indexAdd()                       */
+/*                                           */
+/*  Add the bounding cap (unit vector center */
+/*  and radius in degrees) of the next       */
+/*  record.  Records must be added in table  */
+/*  order, with 'offset' from ttell().       */
+/*                                           */
+/*********************************************/
+
+int montage_indexAdd(struct montage_tableIndex *index, long offset,
+                     double x, double y, double z, double radius)
+{
+   if(index->nitem >= index->maxitem)
+   {
+      index->maxitem += index->maxitem;
+
+      index->items   = (struct IndexItem *)realloc(index->items, index->maxitem * sizeof(struct IndexItem));
+      index->offsets = (long *)realloc(index->offsets, index->maxitem * sizeof(long));
+
+      if(index->items == (struct IndexItem *)NULL || index->offsets == (long *)NULL)
+         return 1;
+   }
+
+   montage_indexCapBox(x, y, z, radius + CAPPAD, index->items[index->nitem].box);
+
+   index->items  [index->nitem].id = index->nitem;
+   index->offsets[index->nitem]    = offset;
+
+   ++index->nitem;
+
+   return 0;
+}
+
+
+
+/*********************************************/
+/*                                           */
+/*  montage_indexCount()                     */
+/*                                           */
+/*  Number of records in the index.          */
+/*                                           */
+/*********************************************/
+
+long montage_indexCount(struct montage_tableIndex *index)
+{
+   if(index->hdr)
+      return index->hdr->nrec;
+
+   return index->nitem;
+}
+
+
+
+/*********************************************/
+/*                                           */
+/*  montage_indexWrite()                     */
+/*                                           */
+/*  Bulk-load the R-tree and write the index */
+/*  file.  Frees the build memory if it      */
+/*  succeeds; otherwise the caller should    */
+/*  montage_indexClose() it.                 */
+/*                                           */
+/*********************************************/
+
+int montage_indexWrite(struct montage_tableIndex *index, char *idxfile, char *tblfile, char *tag)
+{
+   long   i, j, k, n, nleaf, nslab, nrun, slab, run, start, end, rstart, rend;
+   long   maxnode, nnode, nrec, first;
+   int    m, level;
+   double S;
+
+   struct stat buf;
+
+   struct IndexHdr   hdr;
+   struct IndexNode *nodes, *node;
+   struct IndexItem *items;
+
+   char   pad[HDRSIZE];
+
+   FILE  *fout;
+
+
+   if(stat(tblfile, &buf) != 0)
+      return 1;
+
+   items = index->items;
+   n     = index->nitem;
+   nrec  = n;
+
+   maxnode = 16;
+   nnode   = 0;
+
+   nodes = (struct IndexNode *)malloc(maxnode * sizeof(struct IndexNode));
+
+   level = 0;
+
+   if(n == 0)
+   {
+      memset((void *)&nodes[0], 0, sizeof(struct IndexNode));
+
+      nnode = 1;
+   }
+
+
+   /* Pack each level sort-tile-recursive style:  sort by */
+   /* x into slabs, each slab by y into runs, each run by */
+   /* z into nodes of MAXCARD entries.  Node boxes become */
+   /* the items for the next level up.                    */
+
+   while(n > 0)
+   {
+      first = nnode;
+
+      nleaf = (n + MAXCARD - 1) / MAXCARD;
+
+      S = ceil(pow((double)nleaf, 1./3.) - 1.e-9);
+
+      if(S < 1.)
+         S = 1.;
+
+      nrun  = (long)S * MAXCARD;
+      nslab = (long)S * nrun;
+
+      sortAxis = 0;
+      qsort(items, n, sizeof(struct IndexItem), montage_indexCompare);
+
+      for(slab=0; slab<n; slab+=nslab)
+      {
+         end = slab + nslab;
+         if(end > n) end = n;
+
+         sortAxis = 1;
+         qsort(items+slab, end-slab, sizeof(struct IndexItem), montage_indexCompare);
+
+         for(run=slab; run<end; run+=nrun)
+         {
+            rend = run + nrun;
+            if(rend > end) rend = end;
+
+            sortAxis = 2;
+            qsort(items+run, rend-run, sizeof(struct IndexItem), montage_indexCompare);
+
+            for(rstart=run; rstart<rend; rstart+=MAXCARD)
+            {
+               if(nnode >= maxnode)
+               {
+                  maxnode += maxnode;
+
+                  nodes = (struct IndexNode *)realloc(nodes, maxnode * sizeof(struct IndexNode));
+
+                  if(nodes == (struct IndexNode *)NULL)
+                     return 1;
+               }
+
+               node = &nodes[nnode];
+
+               memset((void *)node, 0, sizeof(struct IndexNode));
+
+               node->level = level;
+
+               for(start=rstart; start<rstart+MAXCARD && start<rend; ++start)
+               {
+                  for(k=0; k<6; ++k)
+                     node->box[node->count][k] = items[start].box[k];
+
+                  node->child[node->count] = items[start].id;
+
+                  ++node->count;
+               }
+
+               ++nnode;
+            }
+         }
+      }
+
+
+      /* Replace the items with the new nodes' boxes */
+
+      j = 0;
+
+      for(i=first; i<nnode; ++i)
+      {
+         node = &nodes[i];
+
+         for(k=0; k<3; ++k)
+         {
+            items[j].box[k]   =  2.;
+            items[j].box[k+3] = -2.;
+         }
+
+         for(m=0; m<node->count; ++m)
+         {
+            for(k=0; k<3; ++k)
+            {
+               if(node->box[m][k]   < items[j].box[k]  ) items[j].box[k]   = node->box[m][k];
+               if(node->box[m][k+3] > items[j].box[k+3]) items[j].box[k+3] = node->box[m][k+3];
+            }
+         }
+
+         items[j].id = i;
+
+         ++j;
+      }
+
+      n = j;
+
+      ++level;
+
+      if(n == 1)
+         break;
+   }
+
+
+   /* Write the header, nodes and record offsets */
+
+   memset((void *)&hdr, 0, sizeof(struct IndexHdr));
+
+   memcpy(hdr.magic, MAGIC, 8);
+
+   strncpy(hdr.tag, tag, 31);
+
+   hdr.tblsize  = (long)buf.st_size;
+   hdr.tblmtime = (long)buf.st_mtime;
+   hdr.nrec     = nrec;
+   hdr.nnode    = nnode;
+   hdr.root     = nnode - 1;
+   hdr.maxcard  = MAXCARD;
+   hdr.nlevel   = level;
+
+   fout = fopen(idxfile, "w+");
+
+   if(fout == (FILE *)NULL)
+   {
+      free(nodes);
+      return 1;
+   }
+
+   memset((void *)pad, 0, HDRSIZE);
+   memcpy(pad, (void *)&hdr, sizeof(struct IndexHdr));
+
+   if(fwrite(pad,            1, HDRSIZE, fout) != HDRSIZE
+   || fwrite(nodes,          sizeof(struct IndexNode), nnode, fout) != nnode
+   || fwrite(index->offsets, sizeof(long),             nrec,  fout) != nrec)
+   {
+      fclose(fout);
+      free(nodes);
+      return 1;
+   }
+
+   fclose(fout);
+
+   free(nodes);
+   free(index->items);
+   free(index->offsets);
+   free(index);
+
+   return 0;
+}
+
+
+
+/*********************************************/
+/*                                           */
+/*  montage_indexOpen()                      */
+/*                                           */
+/*  Map an index file for searching.  Returns*/
+/*  NULL if there is no index or it is out   */
+/*  of date with respect to the table.       */
+/*                                           */
+/*********************************************/
+
+struct montage_tableIndex *montage_indexOpen(char *idxfile, char *tblfile, char *tag)
+{
+   int    fd;
+   char  *map;
+
+   struct stat tblbuf, idxbuf;
+
+   struct IndexHdr *hdr;
+
+   struct montage_tableIndex *index;
+
+
+   if(stat(tblfile, &tblbuf) != 0)
+      return (struct montage_tableIndex *)NULL;
+
+   if(stat(idxfile, &idxbuf) != 0 || idxbuf.st_size < HDRSIZE)
+      return (struct montage_tableIndex *)NULL;
+
+   fd = open(idxfile, O_RDONLY);
+
+   if(fd < 0)
+      return (struct montage_tableIndex *)NULL;
+
+   map = mmap(0, idxbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+   close(fd);
+
+   if(map == MAP_FAILED)
+      return (struct montage_tableIndex *)NULL;
+
+   hdr = (struct IndexHdr *)map;
+
+   if(strncmp(hdr->magic, MAGIC, 8) != 0
+   || strncmp(hdr->tag, tag, 31)    != 0
+   || hdr->maxcard  != MAXCARD
+   || hdr->tblsize  != (long)tblbuf.st_size
+   || hdr->tblmtime != (long)tblbuf.st_mtime
+   || idxbuf.st_size != HDRSIZE + hdr->nnode * (long)sizeof(struct IndexNode)
+                                + hdr->nrec  * (long)sizeof(long))
+   {
+      munmap(map, idxbuf.st_size);
+      return (struct montage_tableIndex *)NULL;
+   }
+
+   index = (struct montage_tableIndex *)malloc(sizeof(struct montage_tableIndex));
+
+   memset((void *)index, 0, sizeof(struct montage_tableIndex));
+
+   index->map     = map;
+   index->mapsize = idxbuf.st_size;
+   index->hdr     = hdr;
+   index->nodes   = (struct IndexNode *)(map + HDRSIZE);
+   index->recoff  = (long *)(map + HDRSIZE + hdr->nnode * sizeof(struct IndexNode));
+
+   return index;
+}
+
+
+
+/*********************************************/
+/*                                           */
+/*  montage_indexSearch()                    */
+/*                                           */
+/*  Find all records whose bounding cap may  */
+/*  come within 'radius' degrees of the      */
+/*  given point.  Returns the count; the     */
+/*  record numbers (in table order) and      */
+/*  their byte offsets are returned in       */
+/*  arrays the caller must free().           */
+/*                                           */
+/*********************************************/
+
+long montage_indexSearch(struct montage_tableIndex *index, double x, double y, double z, double radius,
+                         long **recno, long **offset)
+{
+   long   nfound, i, *found;
+
+
+   nfound = montage_indexWalk(index, x, y, z, radius, &found, (double **)NULL);
+
+
+   /* Callers process the records in table order */
+
+   sortAxis = -1;
+   qsort(found, nfound, sizeof(long), montage_indexCompare);
+
+   *recno  = found;
+   *offset = (long *)malloc((nfound+1) * sizeof(long));
+
+   for(i=0; i<nfound; ++i)
+      (*offset)[i] = index->recoff[found[i]];
+
+   return nfound;
+}
+
+
+
+/*********************************************/
+/*                                           */
+/*  montage_indexPoints()                    */
+/*                                           */
+/*  Same search, but return the centers of   */
+/*  the records' caps (unit vectors, three   */
+/*  per record, in no particular order)      */
+/*  straight from the index, without going   */
+/*  back to the table.  For point tables     */
+/*  this is all that is needed to count or   */
+/*  bin sources.  The array must be free()d. */
+/*                                           */
+/*********************************************/
+
+long montage_indexPoints(struct montage_tableIndex *index, double x, double y, double z, double radius,
+                         double **xyz)
+{
+   long   nfound, *found;
+
+   nfound = montage_indexWalk(index, x, y, z, radius, &found, xyz);
+
+   free(found);
+
+   return nfound;
+}
+
+
+
+/*********************************************/
+/*                                           */
+/*  Walk the tree, collecting the leaf       */
+/*  entries that overlap the search box      */
+/*  (and optionally their box centers).      */
+/*                                           */
+/*********************************************/
+
+static long montage_indexWalk(struct montage_tableIndex *index, double x, double y, double z, double radius,
+                              long **foundout, double **xyzout)
+{
+   long   nstack, maxstack, id, nfound, maxfound, *stack, *found;
+   int    m, k, overlap;
+   double box[6], len, *xyz;
+
+   struct IndexNode *node;
+
+
+   montage_indexCapBox(x, y, z, radius + CAPPAD, box);
+
+   maxstack = 64 * MAXCARD;
+   stack    = (long *)malloc(maxstack * sizeof(long));
+
+   maxfound = 1024;
+   found    = (long *)malloc(maxfound * sizeof(long));
+
+   xyz = (double *)NULL;
+
+   if(xyzout)
+      xyz = (double *)malloc(3 * maxfound * sizeof(double));
+
+   nfound = 0;
+   nstack = 1;
+
+   stack[0] = index->hdr->root;
+
+   while(nstack > 0)
+   {
+      --nstack;
+
+      node = &index->nodes[stack[nstack]];
+
+      for(m=0; m<node->count; ++m)
+      {
+         overlap = 1;
+
+         for(k=0; k<3; ++k)
+         {
+            if(node->box[m][k] > box[k+3] || node->box[m][k+3] < box[k])
+            {
+               overlap = 0;
+               break;
+            }
+         }
+
+         if(!overlap)
+            continue;
+
+         id = node->child[m];
+
+         if(node->level > 0)
+         {
+            if(nstack >= maxstack)
+            {
+               maxstack += maxstack;
+               stack = (long *)realloc(stack, maxstack * sizeof(long));
+            }
+
+            stack[nstack] = id;
+            ++nstack;
+         }
+         else
+         {
+            if(nfound >= maxfound)
+            {
+               maxfound += maxfound;
+               found = (long *)realloc(found, maxfound * sizeof(long));
+
+               if(xyz)
+                  xyz = (double *)realloc(xyz, 3 * maxfound * sizeof(double));
+            }
+
+            found[nfound] = id;
+
+            if(xyz)
+            {
+               len = 0.;
+
+               for(k=0; k<3; ++k)
+               {
+                  xyz[3*nfound+k] = (node->box[m][k] + node->box[m][k+3]) / 2.;
+
+                  len += xyz[3*nfound+k] * xyz[3*nfound+k];
+               }
+
+               len = sqrt(len);
+
+               if(len > 0.)
+               {
+                  for(k=0; k<3; ++k)
+                     xyz[3*nfound+k] /= len;
+               }
+            }
+
+            ++nfound;
+         }
+      }
+   }
+
+   free(stack);
+
+   *foundout = found;
+
+   if(xyzout)
+      *xyzout = xyz;
+
+   return nfound;
+}
+
+
+
+/*********************************************/
+/*                                           */
+/*  montage_indexClose()                     */
+/*                                           */
+/*********************************************/
+
+void montage_indexClose(struct montage_tableIndex *index)
+{
+   if(index == (struct montage_tableIndex *)NULL)
+      return;
+
+   if(index->map)
+      munmap(index->map, index->mapsize);
+
+   free(index->items);
+   free(index->offsets);
+   free(index);
+}
+
+
+
+/*********************************************/
+/*                                           */
+/*  Bounding box (in unit vector space) of   */
+/*  a spherical cap.  Along each axis the    */
+/*  cap spans the angles (a-r) to (a+r)      */
+/*  from that axis, clipped to [0,180].      */
+/*  Anything undefined gets the full box.    */
+/*                                           */
+/*********************************************/
+
+static void montage_indexCapBox(double x, double y, double z, double radius, double *box)
+{
+   int    k;
+   double c[3], a, r, amin, amax, dtr;
+
+   dtr = atan(1.)/45.;
+
+   c[0] = x;
+   c[1] = y;
+   c[2] = z;
+
+   r = radius * dtr;
+
+   if(isnan(x) || isnan(y) || isnan(z) || isnan(r) || r >= 4.*atan(1.))
+   {
+      for(k=0; k<3; ++k)
+      {
+         box[k]   = -2.;
+         box[k+3] =  2.;
+      }
+
+      return;
+   }
+
+   for(k=0; k<3; ++k)
+   {
+      if(c[k] >  1.) c[k] =  1.;
+      if(c[k] < -1.) c[k] = -1.;
+
+      a = acos(c[k]);
+
+      amin = a - r;
+      amax = a + r;
+
+      if(amin < 0.)          amin = 0.;
+      if(amax > 4.*atan(1.)) amax = 4.*atan(1.);
+
+      box[k]   = cos(amax) - 1.e-12;
+      box[k+3] = cos(amin) + 1.e-12;
+   }
+}
+
+
+
+/*********************************************/
+/*                                           */
+/*  Sort by box center along one axis (or by */
+/*  record number, for sortAxis < 0)         */
+/*                                           */
+/*********************************************/
+
+static int montage_indexCompare(const void *a, const void *b)
+{
+   double ca, cb;
+   long   la, lb;
+
+   struct IndexItem *ia, *ib;
+
+   if(sortAxis < 0)
+   {
+      la = *(long *)a;
+      lb = *(long *)b;
+
+      if(la < lb) return -1;
+      if(la > lb) return  1;
+      return 0;
+   }
+
+   ia = (struct IndexItem *)a;
+   ib = (struct IndexItem *)b;
+
+   ca = ia->box[sortAxis] + ia->box[sortAxis+3];
+   cb = ib->box[sortAxis] + ib->box[sortAxis+3];
+
+   if(ca < cb) return -1;
+   if(ca > cb) return  1;
+   return 0;
+}
@@ -0,0 +1,160 @@
+/* Module: templateCache.c
+
+*/
+
+/*************************************************************************/
+/*                                                                       */
+/*  Header template cache for long-running (server mode) processes.      */
+/*                                                                       */
+/*  The modules keep the parsed output template (image size, reference   */
+/*  pixel, WCS structure) in static variables.  When the same process    */
+/*  is asked to use the same template over and over, there is no need    */
+/*  to re-check and re-parse it each time.  We keep a copy of the text   */
+/*  of the template last loaded (plus a small amount of context from the */
+/*  caller:  a header "type" and the expansion offset) and the module    */
+/*  skips reading it again if nothing has changed.                       */
+/*                                                                       */
+/*  We compare the file contents rather than the modification time;     */
+/*  templates are small and a workflow may well rewrite one in the same  */
+/*  second.                                                              */
+/*                                                                       */
+/*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <montage.h>
+
+
+static char *montage_readText(char *filename, long *size);
+
+
+/*********************************************************/
+/*                                                       */
+/*  Returns 1 if the file and context match what was     */
+/*  last recorded in the cache (so the caller's parsed   */
+/*  version is still good), 0 otherwise.                 */
+/*                                                       */
+/*********************************************************/
+
+int montage_templateSame(struct montage_templateCache *cache, char *filename, int type, double offset)
+{
+   int   same;
+   long  size;
+   char *text;
+
+   if(cache->text == (char *)NULL)
+      return 0;
+
+   if(cache->type != type || cache->offset != offset)
+      return 0;
+
+   text = montage_readText(filename, &size);
+
+   if(text == (char *)NULL)
+      return 0;
+
+   same = 0;
+
+   if(size == cache->size && memcmp(text, cache->text, size) == 0)
+      same = 1;
+
+   free(text);
+
+   return same;
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  Record the file just successfully loaded.  Should    */
+/*  be called only after the caller has finished         */
+/*  parsing it without error.                            */
+/*                                                       */
+/*********************************************************/
+
+void montage_templateKeep(struct montage_templateCache *cache, char *filename, int type, double offset)
+{
+   montage_templateClear(cache);
+
+   cache->text = montage_readText(filename, &cache->size);
+
+   cache->type   = type;
+   cache->offset = offset;
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  Forget whatever is in the cache (e.g. because the    */
+/*  parsed version has been overwritten).                */
+/*                                                       */
+/*********************************************************/
+
+void montage_templateClear(struct montage_templateCache *cache)
+{
+   free(cache->text);
+
+   cache->text   = (char *)NULL;
+   cache->size   = 0;
+   cache->type   = 0;
+   cache->offset = 0.;
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  Read a whole (small) file into memory.               */
+/*                                                       */
+/*********************************************************/
+
+static char *montage_readText(char *filename, long *size)
+{
+   FILE *fp;
+   char *text;
+   long  nalloc, nread;
+
+   *size = 0;
+
+   fp = fopen(filename, "r");
+
+   if(fp == (FILE *)NULL)
+      return (char *)NULL;
+
+   nalloc = 8192;
+   nread  = 0;
+
+   text = (char *)malloc(nalloc);
+
+   while(1)
+   {
+      if(nread == nalloc)
+      {
+         nalloc += 8192;
+
+         text = (char *)realloc(text, nalloc);
+      }
+
+      nread += fread(text + nread, 1, nalloc - nread, fp);
+
+      if(ferror(fp))
+      {
+         fclose(fp);
+         free(text);
+         return (char *)NULL;
+      }
+
+      if(feof(fp))
+         break;
+   }
+
+   fclose(fp);
+
+   *size = nread;
+
+   return text;
+}
@@ -0,0 +1,78 @@
+/* Module: threads.c
+
+*/
+
+/*************************************************************************/
+/*                                                                       */
+/*  Worker thread count for the modules that can split their output      */
+/*  rows among threads (currently mProjectQL).                           */
+/*                                                                       */
+/*  The default is a single thread: these modules are usually run many   */
+/*  at a time by the Exec drivers, which already keep the processors     */
+/*  busy.  When one is run on its own a program can set the count        */
+/*  explicitly (the executables do so with their "-n" flag) or set the   */
+/*  environment variable MONTAGE_THREADS.                                */
+/*                                                                       */
+/*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <montage.h>
+
+#define MAXTHREADS 256
+
+
+static int montage_threads = 0;
+
+
+/*********************************************************/
+/*                                                       */
+/*  Set the thread count.  Zero resets to the default    */
+/*  (environment or one).  Returns 0 on success, 1 if    */
+/*  the value is not allowed.                            */
+/*                                                       */
+/*********************************************************/
+
+int montage_setThreads(int nthread)
+{
+   if(nthread < 0 || nthread > MAXTHREADS)
+      return 1;
+
+   montage_threads = nthread;
+
+   return 0;
+}
+
+
+
+/*********************************************************/
+/*                                                       */
+/*  The number of threads a module should use.           */
+/*                                                       */
+/*********************************************************/
+
+int montage_outThreads(void)
+{
+   int   nthread;
+   char *env;
+
+   if(montage_threads > 0)
+      return montage_threads;
+
+   env = getenv("MONTAGE_THREADS");
+
+   if(env == (char *)NULL)
+      return 1;
+
+   nthread = atoi(env);
+
+   if(nthread < 1)
+      return 1;
+
+   if(nthread > MAXTHREADS)
+      return MAXTHREADS;
+
+   return nthread;
+}
@@ -0,0 +1,1422 @@
+/* Module: mDAGExec.c
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <hashtable.h>
+
+#define MAXSTR     1024
+#define MAXID       128
+#define MAXHASH   65536
+
+#define WAITING       0
+#define RUNNING       1
+#define DONE          2
+#define FAILED        3
+
+char *strdup(const char *s1);
+
+
+/* A workflow job, as read from the DAX */
+
+struct Job
+{
+   char    id  [MAXID];
+   char    name[MAXID];
+
+   int     argc;
+   int     maxarg;
+   char  **argv;
+
+   int     nparent, maxparent;
+   int    *parent;
+
+   int     nchild,  maxchild;
+   int    *child;
+
+   int     state;
+   int     npending;
+   int     attempts;
+   int     skip;
+
+   double  weight;
+   double  priority;
+   double  start;
+   pid_t   pid;
+};
+
+struct Job *jobs;
+int         njobs, maxjobs;
+
+
+/* <uses> entries, only needed to infer dependencies */
+
+struct Use
+{
+   int   job;
+   int   output;
+   char *file;
+};
+
+struct Use *uses;
+int         nuses, maxuses;
+
+
+/* Ready queue: a max-heap on critical-path priority */
+
+int *heap;
+int  nheap;
+
+char  statusdir[MAXSTR+16];
+char  workdir  [MAXSTR];
+char  bindir   [MAXSTR];
+
+int   debug = 0;
+
+int    readDAX      (char *daxfile);
+int    addJob       (char *id, char *name);
+int    addArg       (struct Job *job, char *arg, int join);
+int    addUse       (int job, char *file, int output);
+int    addEdge      (int parent, int child);
+int    jobIndex     (HT_table_t *table, char *key);
+char  *getAttr      (char *tag, char *attr, char *value);
+void   decode       (char *str);
+int    topoOrder    (int *order);
+void   readStatus   (void);
+void   writeStatus  (struct Job *job, int ok, double elapsed);
+int    launch       (int ijob);
+int    jobFailed    (struct Job *job, int status);
+void   heapPush     (int ijob);
+int    heapPop      (void);
+double now          (void);
+void   printError   (char *msg);
+
+
+/*************************************************************************/
+/*                                                                       */
+/*  mDAGExec                                                             */
+/*                                                                       */
+/*  Runs the workflow described in a DAX file (as written by mDAG or     */
+/*  mDAGGalacticPlane) on the local machine, without Pegasus/Condor.     */
+/*                                                                       */
+/*  Job dependencies come from the <child>/<parent> elements, plus any   */
+/*  implied by one job's <uses link="output"> file being another's       */
+/*  input.  Jobs whose parents have all finished are started, up to a   */
+/*  concurrency limit (default: the number of processors), the one with  */
+/*  the longest remaining path to the end of the workflow first, so the  */
+/*  critical path (e.g. mBgModel and the mAdds) is never left waiting    */
+/*  behind a mass of short jobs.  Path lengths are measured with the     */
+/*  run times recorded by earlier runs where there are any.              */
+/*                                                                       */
+/*  All jobs run in the working directory, which must already contain    */
+/*  the workflow input files.  Each job's output goes to a file in the   */
+/*  status directory and, when the job finishes, a status file records   */
+/*  the outcome.  A failed job (non-zero exit or an ERROR return         */
+/*  structure) is retried; if it still fails its descendants are not     */
+/*  run but the rest of the workflow is.  Running mDAGExec again         */
+/*  resumes: jobs with an OK status file (and whose parents are also     */
+/*  being skipped) are not rerun.                                        */
+/*                                                                       */
+/*************************************************************************/
+
+int main(int argc, char **argv)
+{
+   int     i, j, c, ijob, status, nrunning, maxrun, retries;
+   int     nskip, nrun, nretry, nfail, nblocked;
+   int    *order;
+   double  start, elapsed, maxpath;
+   pid_t   pid;
+   char    msg[2*MAXSTR];
+
+   struct Job *job;
+
+
+   /***************************************/
+   /* Process the command-line parameters */
+   /***************************************/
+
+   maxrun  = sysconf(_SC_NPROCESSORS_ONLN);
+   retries = 2;
+
+   if(maxrun < 1)
+      maxrun = 1;
+
+   strcpy(workdir,   ".");
+   strcpy(statusdir, "");
+   strcpy(bindir,    "");
+
+   opterr = 0;
+
+   while ((c = getopt(argc, argv, "dn:r:w:s:p:")) != EOF)
+   {
+      switch (c)
+      {
+         case 'd':
+            debug = 1;
+            break;
+
+         case 'n':
+            maxrun = atoi(optarg);
+
+            if(maxrun < 1)
+            {
+               printf("[struct stat=\"ERROR\", msg=\"Job limit (%s) must be a positive integer\"]\n", optarg);
+               exit(1);
+            }
+            break;
+
+         case 'r':
+            retries = atoi(optarg);
+
+            if(retries < 0)
+            {
+               printf("[struct stat=\"ERROR\", msg=\"Retry count (%s) must be a non-negative integer\"]\n", optarg);
+               exit(1);
+            }
+            break;
+
+         case 'w':
+            strcpy(workdir, optarg);
+            break;
+
+         case 's':
+            strcpy(statusdir, optarg);
+            break;
+
+         case 'p':
+            strcpy(bindir, optarg);
+            break;
+
+         default:
+            printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-d] [-n maxjobs] [-r retries] [-w workdir] [-s statusdir] [-p bindir] dag.xml\"]\n", argv[0]);
+            exit(1);
+            break;
+      }
+   }
+
+   if(argc - optind < 1)
+   {
+      printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-d] [-n maxjobs] [-r retries] [-w workdir] [-s statusdir] [-p bindir] dag.xml\"]\n", argv[0]);
+      exit(1);
+   }
+
+   if(strlen(statusdir) == 0)
+      sprintf(statusdir, "%s/dagstatus", workdir);
+
+   if(mkdir(statusdir, 0775) < 0 && errno != EEXIST)
+   {
+      sprintf(msg, "Cannot create status directory %s", statusdir);
+      printError(msg);
+   }
+
+   start = now();
+
+
+   /****************************/
+   /* Read the workflow (DAX)  */
+   /****************************/
+
+   if(readDAX(argv[optind]))
+      exit(1);
+
+   if(njobs == 0)
+      printError("No jobs in DAX file");
+
+   order = (int *)malloc(njobs * sizeof(int));
+   heap  = (int *)malloc(njobs * sizeof(int));
+
+   if(order == (int *)NULL || heap == (int *)NULL)
+      printError("Memory allocation failure");
+
+   if(topoOrder(order))
+      printError("DAX dependencies contain a cycle");
+
+   if(debug)
+   {
+      printf("%d jobs read from %s\n", njobs, argv[optind]);
+      fflush(stdout);
+   }
+
+
+   /********************************************/
+   /* Previous run status: which jobs are done */
+   /* and how long each kind of job takes      */
+   /********************************************/
+
+   readStatus();
+
+   nskip = 0;
+
+   for(i=0; i<njobs; ++i)
+   {
+      job = &jobs[order[i]];
+
+      for(j=0; j<job->nparent; ++j)
+         if(!jobs[job->parent[j]].skip)
+            job->skip = 0;
+
+      if(job->skip)
+      {
+         job->state = DONE;
+         ++nskip;
+      }
+   }
+
+
+   /*************************************************/
+   /* Critical-path priority: the job's own weight  */
+   /* plus the longest path below it (the "bottom   */
+   /* level"), computed in reverse topological order */
+   /*************************************************/
+
+   maxpath = 0.;
+
+   for(i=njobs-1; i>=0; --i)
+   {
+      job = &jobs[order[i]];
+
+      job->priority = 0.;
+
+      for(j=0; j<job->nchild; ++j)
+         if(jobs[job->child[j]].priority > job->priority)
+            job->priority = jobs[job->child[j]].priority;
+
+      job->priority += job->weight;
+
+      if(job->priority > maxpath)
+         maxpath = job->priority;
+   }
+
+   free(order);
+
+   if(debug)
+   {
+      printf("%d jobs already done; critical path length %.1f\n", nskip, maxpath);
+      fflush(stdout);
+   }
+
+
+   /*********************************/
+   /* Initial ready set: jobs whose */
+   /* parents are all done          */
+   /*********************************/
+
+   nheap = 0;
+
+   for(i=0; i<njobs; ++i)
+   {
+      job = &jobs[i];
+
+      if(job->state == DONE)
+         continue;
+
+      job->npending = 0;
+
+      for(j=0; j<job->nparent; ++j)
+         if(jobs[job->parent[j]].state != DONE)
+            ++job->npending;
+
+      if(job->npending == 0)
+         heapPush(i);
+   }
+
+
+   /***********************************************/
+   /* Keep up to maxrun jobs running until there  */
+   /* is nothing left that can run                */
+   /***********************************************/
+
+   nrunning = 0;
+   nrun     = 0;
+   nretry   = 0;
+   nfail    = 0;
+
+   while(1)
+   {
+      while(nrunning < maxrun && nheap > 0)
+      {
+         ijob = heapPop();
+
+         if(launch(ijob))
+         {
+            writeStatus(&jobs[ijob], 0, 0.);
+
+            jobs[ijob].state = FAILED;
+            ++nfail;
+
+            continue;
+         }
+
+         ++nrunning;
+      }
+
+      if(nrunning == 0)
+         break;
+
+      pid = waitpid(-1, &status, 0);
+
+      if(pid < 0)
+      {
+         if(errno == EINTR)
+            continue;
+
+         break;
+      }
+
+      for(ijob=0; ijob<njobs; ++ijob)
+         if(jobs[ijob].state == RUNNING && jobs[ijob].pid == pid)
+            break;
+
+      if(ijob >= njobs)
+         continue;
+
+      --nrunning;
+
+      job = &jobs[ijob];
+
+      elapsed = now() - job->start;
+
+      if(jobFailed(job, status))
+      {
+         if(job->attempts <= retries)
+         {
+            if(debug)
+            {
+               printf("%s (%s) failed; retrying\n", job->id, job->name);
+               fflush(stdout);
+            }
+
+            job->state = WAITING;
+
+            heapPush(ijob);
+
+            ++nretry;
+
+            continue;
+         }
+
+         if(debug)
+         {
+            printf("%s (%s) failed after %d attempts\n", job->id, job->name, job->attempts);
+            fflush(stdout);
+         }
+
+         writeStatus(job, 0, elapsed);
+
+         job->state = FAILED;
+
+         ++nfail;
+
+         continue;
+      }
+
+      if(debug)
+      {
+         printf("%s (%s) done (%.1f sec)\n", job->id, job->name, elapsed);
+         fflush(stdout);
+      }
+
+      writeStatus(job, 1, elapsed);
+
+      job->state = DONE;
+
+      ++nrun;
+
+      for(j=0; j<job->nchild; ++j)
+      {
+         --jobs[job->child[j]].npending;
+
+         if(jobs[job->child[j]].npending == 0)
+            heapPush(job->child[j]);
+      }
+   }
+
+   nblocked = 0;
+
+   for(i=0; i<njobs; ++i)
+      if(jobs[i].state == WAITING)
+         ++nblocked;
+
+   if(nfail > 0 || nblocked > 0)
+   {
+      printf("[struct stat=\"ERROR\", msg=\"%d jobs failed and %d could not be run; rerun to resume\", njobs=%d, skipped=%d, run=%d, retries=%d, failed=%d, blocked=%d, time=%.1f]\n",
+         nfail, nblocked, njobs, nskip, nrun, nretry, nfail, nblocked, now() - start);
+      fflush(stdout);
+      exit(1);
+   }
+
+   printf("[struct stat=\"OK\", njobs=%d, skipped=%d, run=%d, retries=%d, time=%.1f]\n",
+      njobs, nskip, nrun, nretry, now() - start);
+   fflush(stdout);
+   exit(0);
+}
+
+
+
+/**************************************************/
+/*                                                */
+/*  Read the DAX.  Only the elements we need are  */
+/*  recognized: <job> (id and name), the tokens   */
+/*  and <filename> elements of its <argument>,    */
+/*  its <uses> and the <child>/<parent> lists.    */
+/*                                                */
+/**************************************************/
+
+int readDAX(char *daxfile)
+{
+   int    i, k, ijob, ichild, iparent, inJob, inArg, join, len;
+   long   size;
+   char  *buffer, *p, *q, *tag, *text, *tok, sep;
+   char   name [MAXSTR];
+   char   value[MAXSTR];
+   char   link [MAXSTR];
+   char   msg  [2*MAXSTR];
+   char   key  [MAXSTR];
+
+   FILE  *fdax;
+
+   HT_table_t *ids, *producers;
+
+
+   /* Read the whole file */
+
+   fdax = fopen(daxfile, "r");
+
+   if(fdax == (FILE *)NULL)
+   {
+      sprintf(msg, "Cannot open DAX file %s", daxfile);
+      printError(msg);
+   }
+
+   fseek(fdax, 0L, SEEK_END);
+   size = ftell(fdax);
+   fseek(fdax, 0L, SEEK_SET);
+
+   buffer = (char *)malloc(size + 1);
+
+   if(buffer == (char *)NULL)
+      printError("Memory allocation failure");
+
+   if(fread(buffer, 1, size, fdax) != (size_t)size)
+   {
+      sprintf(msg, "Error reading DAX file %s", daxfile);
+      printError(msg);
+   }
+
+   buffer[size] = '\0';
+
+   fclose(fdax);
+
+   ids = HT_create_table(MAXHASH);
+
+   njobs  = 0;
+   nuses  = 0;
+
+   ijob   = -1;
+   ichild = -1;
+   inJob  = 0;
+   inArg  = 0;
+   join   = 0;
+
+   p = buffer;
+
+   while(1)
+   {
+      q = strchr(p, '<');
+
+      if(q == (char *)NULL)
+         break;
+
+
+      /* Character data: argument tokens */
+
+      if(inArg && q > p)
+      {
+         *q = '\0';
+
+         decode(p);
+
+         text = p;
+
+         while(*text != '\0')
+         {
+            if(strchr(" \t\r\n", *text) != (char *)NULL)
+            {
+               join = 0;
+               ++text;
+               continue;
+            }
+
+            len = strcspn(text, " \t\r\n");
+
+            tok = text;
+            sep = text[len];
+
+            text[len] = '\0';
+
+            addArg(&jobs[ijob], tok, join);
+
+
+            /* A token running right up to the next tag */
+            /* is joined with a following <filename>    */
+
+            if(sep == '\0')
+            {
+               join  = 1;
+               text += len;
+            }
+            else
+            {
+               join  = 0;
+               text += len + 1;
+            }
+         }
+
+         *q = '<';
+      }
+
+      if(strncmp(q, "<!--", 4) == 0)
+      {
+         p = strstr(q, "-->");
+
+         if(p == (char *)NULL)
+            break;
+
+         p += 3;
+         continue;
+      }
+
+      p = strchr(q, '>');
+
+      if(p == (char *)NULL)
+         break;
+
+      *p = '\0';
+      ++p;
+
+      tag = q + 1;
+
+      if(*tag == '?' || *tag == '!')
+         continue;
+
+      for(k=0; k<MAXSTR-1 && tag[k] != '\0' && strchr(" \t\r\n/", tag[k]) == (char *)NULL; ++k)
+         name[k] = tag[k];
+
+      name[k] = '\0';
+
+      if(*tag == '/')
+      {
+         if(strcmp(tag, "/job") == 0)
+         {
+            inJob = 0;
+            inArg = 0;
+         }
+
+         else if(strcmp(tag, "/argument") == 0)
+            inArg = 0;
+
+         else if(strcmp(tag, "/child") == 0)
+            ichild = -1;
+
+         join = 0;
+
+         continue;
+      }
+
+      if(strcmp(name, "job") == 0)
+      {
+         if(getAttr(tag, "id", value) == (char *)NULL)
+            printError("DAX job without an id");
+
+         if(getAttr(tag, "name", name) == (char *)NULL)
+         {
+            sprintf(msg, "DAX job %s has no name", value);
+            printError(msg);
+         }
+
+         ijob = addJob(value, name);
+
+         sprintf(key, "%d", ijob);
+
+         if(HT_lookup_key(ids, value) != (char *)NULL)
+         {
+            sprintf(msg, "Duplicate DAX job id %s", value);
+            printError(msg);
+         }
+
+         HT_add_entry(ids, value, key);
+
+         inJob = (tag[strlen(tag)-1] != '/');
+      }
+
+      else if(inJob && strcmp(name, "argument") == 0)
+      {
+         inArg = (tag[strlen(tag)-1] != '/');
+         join  = 0;
+      }
+
+      else if(inArg && strcmp(name, "filename") == 0)
+      {
+         if(getAttr(tag, "file", value) != (char *)NULL)
+            addArg(&jobs[ijob], value, join);
+
+         join = 1;
+      }
+
+      else if(inJob && strcmp(name, "uses") == 0)
+      {
+         if(getAttr(tag, "file", value) != (char *)NULL)
+         {
+            if(getAttr(tag, "link", link) == (char *)NULL)
+               strcpy(link, "input");
+
+            if(strcmp(link, "input") == 0 || strcmp(link, "inout") == 0)
+               addUse(ijob, value, 0);
+
+            if(strcmp(link, "output") == 0 || strcmp(link, "inout") == 0)
+               addUse(ijob, value, 1);
+         }
+      }
+
+      else if(strcmp(name, "child") == 0)
+      {
+         if(getAttr(tag, "ref", value) == (char *)NULL
+         || (ichild = jobIndex(ids, value)) < 0)
+         {
+            sprintf(msg, "DAX child refers to unknown job %s", value);
+            printError(msg);
+         }
+      }
+
+      else if(strcmp(name, "parent") == 0 && ichild >= 0)
+      {
+         if(getAttr(tag, "ref", value) == (char *)NULL
+         || (iparent = jobIndex(ids, value)) < 0)
+         {
+            sprintf(msg, "DAX parent refers to unknown job %s", value);
+            printError(msg);
+         }
+
+         addEdge(iparent, ichild);
+      }
+   }
+
+   free(buffer);
+
+   HT_free_table(ids);
+
+
+   /* Dependencies implied by the files */
+
+   producers = HT_create_table(MAXHASH);
+
+   for(i=0; i<nuses; ++i)
+   {
+      if(uses[i].output)
+      {
+         sprintf(key, "%d", uses[i].job);
+         HT_add_entry(producers, uses[i].file, key);
+      }
+   }
+
+   for(i=0; i<nuses; ++i)
+   {
+      if(uses[i].output)
+         continue;
+
+      q = HT_lookup_key(producers, uses[i].file);
+
+      while(q != (char *)NULL)
+      {
+         iparent = atoi(q);
+
+         if(iparent != uses[i].job)
+            addEdge(iparent, uses[i].job);
+
+         q = HT_next_entry(producers);
+      }
+   }
+
+   HT_free_table(producers);
+
+   for(i=0; i<nuses; ++i)
+      free(uses[i].file);
+
+   free(uses);
+
+   for(i=0; i<njobs; ++i)
+   {
+      if(jobs[i].argc == 0)
+      {
+         jobs[i].argv = (char **)malloc(2 * sizeof(char *));
+         jobs[i].maxarg = 2;
+      }
+
+      jobs[i].argv[jobs[i].argc] = (char *)NULL;
+   }
+
+   return 0;
+}
+
+
+
+/**************************************************/
+/*                                                */
+/*  Job table maintenance.                        */
+/*                                                */
+/**************************************************/
+
+int addJob(char *id, char *name)
+{
+   struct Job *job;
+   char       *ptr;
+
+   if(njobs >= maxjobs)
+   {
+      maxjobs += 1024;
+
+      jobs = (struct Job *)realloc(jobs, maxjobs * sizeof(struct Job));
+
+      if(jobs == (struct Job *)NULL)
+         printError("Memory allocation failure");
+   }
+
+   job = &jobs[njobs];
+
+   memset((void *)job, 0, sizeof(struct Job));
+
+   strncpy(job->id, id, MAXID-1);
+
+
+   /* Strip any transformation namespace ("montage::mAdd") */
+
+   ptr = strrchr(name, ':');
+
+   if(ptr != (char *)NULL)
+      name = ptr + 1;
+
+   strncpy(job->name, name, MAXID-1);
+
+   job->state  = WAITING;
+   job->weight = 1.;
+
+   addArg(job, name, 0);
+
+   ++njobs;
+
+   return njobs - 1;
+}
+
+
+int addArg(struct Job *job, char *arg, int join)
+{
+   char *str;
+
+   if(join && job->argc > 1)
+   {
+      str = (char *)malloc(strlen(job->argv[job->argc-1]) + strlen(arg) + 1);
+
+      strcpy(str, job->argv[job->argc-1]);
+      strcat(str, arg);
+
+      free(job->argv[job->argc-1]);
+
+      job->argv[job->argc-1] = str;
+
+      return 0;
+   }
+
+   if(job->argc + 1 >= job->maxarg)
+   {
+      job->maxarg += 16;
+
+      job->argv = (char **)realloc(job->argv, job->maxarg * sizeof(char *));
+
+      if(job->argv == (char **)NULL)
+         printError("Memory allocation failure");
+   }
+
+   job->argv[job->argc] = strdup(arg);
+
+   ++job->argc;
+
+   return 0;
+}
+
+
+int addUse(int job, char *file, int output)
+{
+   if(nuses >= maxuses)
+   {
+      maxuses += 4096;
+
+      uses = (struct Use *)realloc(uses, maxuses * sizeof(struct Use));
+
+      if(uses == (struct Use *)NULL)
+         printError("Memory allocation failure");
+   }
+
+   uses[nuses].job    = job;
+   uses[nuses].output = output;
+   uses[nuses].file   = strdup(file);
+
+   ++nuses;
+
+   return 0;
+}
+
+
+int addEdge(int parent, int child)
+{
+   int         i;
+   struct Job *job;
+
+   job = &jobs[child];
+
+   for(i=0; i<job->nparent; ++i)
+      if(job->parent[i] == parent)
+         return 0;
+
+   if(job->nparent >= job->maxparent)
+   {
+      job->maxparent += 16;
+
+      job->parent = (int *)realloc(job->parent, job->maxparent * sizeof(int));
+
+      if(job->parent == (int *)NULL)
+         printError("Memory allocation failure");
+   }
+
+   job->parent[job->nparent] = parent;
+
+   ++job->nparent;
+
+   job = &jobs[parent];
+
+   if(job->nchild >= job->maxchild)
+   {
+      job->maxchild += 16;
+
+      job->child = (int *)realloc(job->child, job->maxchild * sizeof(int));
+
+      if(job->child == (int *)NULL)
+         printError("Memory allocation failure");
+   }
+
+   job->child[job->nchild] = child;
+
+   ++job->nchild;
+
+   return 0;
+}
+
+
+int jobIndex(HT_table_t *table, char *key)
+{
+   char *val;
+
+   val = HT_lookup_key(table, key);
+
+   if(val == (char *)NULL)
+      return -1;
+
+   return atoi(val);
+}
+
+
+
+/**************************************************/
+/*                                                */
+/*  Extract a (double-quoted) attribute value     */
+/*  from the text of a tag.                       */
+/*                                                */
+/**************************************************/
+
+char *getAttr(char *tag, char *attr, char *value)
+{
+   int   len;
+   char *ptr, *end;
+
+   len = strlen(attr);
+
+   ptr = tag;
+
+   while((ptr = strstr(ptr, attr)) != (char *)NULL)
+   {
+      if(ptr > tag && strchr(" \t\r\n", *(ptr-1)) != (char *)NULL
+      && *(ptr+len) == '=' && *(ptr+len+1) == '"')
+      {
+         ptr += len + 2;
+
+         end = strchr(ptr, '"');
+
+         if(end == (char *)NULL || end - ptr >= MAXSTR)
+            return (char *)NULL;
+
+         strncpy(value, ptr, end - ptr);
+
+         value[end - ptr] = '\0';
+
+         decode(value);
+
+         return value;
+      }
+
+      ptr += len;
+   }
+
+   return (char *)NULL;
+}
+
+
+
+/**************************************************/
+/*                                                */
+/*  Replace the predefined XML entities in place. */
+/*                                                */
+/**************************************************/
+
+void decode(char *str)
+{
+   int   i, j, k;
+
+   char *entity[] = {"&amp;", "&lt;", "&gt;", "&quot;", "&apos;"};
+   char  ch    [] = {'&',     '<',    '>',    '"',      '\''    };
+
+   j = 0;
+
+   for(i=0; str[i] != '\0'; ++i)
+   {
+      if(str[i] == '&')
+      {
+         for(k=0; k<5; ++k)
+         {
+            if(strncmp(str+i, entity[k], strlen(entity[k])) == 0)
+            {
+               str[j] = ch[k];
+               ++j;
+
+               i += strlen(entity[k]) - 1;
+               break;
+            }
+         }
+
+         if(k < 5)
+            continue;
+      }
+
+      str[j] = str[i];
+      ++j;
+   }
+
+   str[j] = '\0';
+}
+
+
+
+/**************************************************/
+/*                                                */
+/*  Topological order of the jobs (Kahn).         */
+/*  Returns 1 if there is a cycle.                */
+/*                                                */
+/**************************************************/
+
+int topoOrder(int *order)
+{
+   int i, j, n, head;
+
+   for(i=0; i<njobs; ++i)
+      jobs[i].npending = jobs[i].nparent;
+
+   n = 0;
+
+   for(i=0; i<njobs; ++i)
+   {
+      if(jobs[i].npending == 0)
+      {
+         order[n] = i;
+         ++n;
+      }
+   }
+
+   for(head=0; head<n; ++head)
+   {
+      i = order[head];
+
+      for(j=0; j<jobs[i].nchild; ++j)
+      {
+         --jobs[jobs[i].child[j]].npending;
+
+         if(jobs[jobs[i].child[j]].npending == 0)
+         {
+            order[n] = jobs[i].child[j];
+            ++n;
+         }
+      }
+   }
+
+   return (n != njobs);
+}
+
+
+
+/**************************************************/
+/*                                                */
+/*  Read the status files from an earlier run.    */
+/*  Jobs that finished OK are marked to be        */
+/*  skipped; the recorded times give the          */
+/*  average run time of each kind of job, which   */
+/*  is used as its weight in the critical path    */
+/*  (one second for kinds of job not yet timed).  */
+/*                                                */
+/**************************************************/
+
+void readStatus()
+{
+   int     i, k, nname;
+   double  t;
+   char    fname[2*MAXSTR];
+   char    line [MAXSTR];
+   char   *ptr;
+   FILE   *fstat;
+
+   char  **names;
+   double *sum;
+   int    *count;
+
+   names = (char  **)malloc(njobs * sizeof(char *));
+   sum   = (double *)malloc(njobs * sizeof(double));
+   count = (int    *)malloc(njobs * sizeof(int));
+
+   nname = 0;
+
+   for(i=0; i<njobs; ++i)
+   {
+      sprintf(fname, "%s/%s.status", statusdir, jobs[i].id);
+
+      fstat = fopen(fname, "r");
+
+      if(fstat == (FILE *)NULL)
+         continue;
+
+      if(fgets(line, MAXSTR, fstat) == (char *)NULL)
+      {
+         fclose(fstat);
+         continue;
+      }
+
+      fclose(fstat);
+
+      if(strncmp(line, "[struct stat=\"OK\"", 17) != 0)
+         continue;
+
+      jobs[i].skip = 1;
+
+      ptr = strstr(line, "time=");
+
+      if(ptr == (char *)NULL)
+         continue;
+
+      t = atof(ptr+5);
+
+      for(k=0; k<nname; ++k)
+         if(strcmp(names[k], jobs[i].name) == 0)
+            break;
+
+      if(k == nname)
+      {
+         names[k] = jobs[i].name;
+         sum  [k] = 0.;
+         count[k] = 0;
+
+         ++nname;
+      }
+
+      sum  [k] += t;
+      count[k] += 1;
+   }
+
+   for(i=0; i<njobs; ++i)
+   {
+      for(k=0; k<nname; ++k)
+      {
+         if(strcmp(names[k], jobs[i].name) == 0)
+         {
+            jobs[i].weight = sum[k] / count[k];
+
+            if(jobs[i].weight < 0.001)
+               jobs[i].weight = 0.001;
+
+            break;
+         }
+      }
+   }
+
+   free(names);
+   free(sum);
+   free(count);
+}
+
+
+
+/**************************************************/
+/*                                                */
+/*  Record the final outcome of a job.            */
+/*                                                */
+/**************************************************/
+
+void writeStatus(struct Job *job, int ok, double elapsed)
+{
+   char  fname[2*MAXSTR];
+   FILE *fstat;
+
+   sprintf(fname, "%s/%s.status", statusdir, job->id);
+
+   fstat = fopen(fname, "w+");
+
+   if(fstat == (FILE *)NULL)
+      return;
+
+   if(ok)
+      fprintf(fstat, "[struct stat=\"OK\", name=\"%s\", attempts=%d, time=%.3f]\n",
+         job->name, job->attempts, elapsed);
+   else
+      fprintf(fstat, "[struct stat=\"ERROR\", msg=\"Job failed; see %s.out\", name=\"%s\", attempts=%d, time=%.3f]\n",
+         job->id, job->name, job->attempts, elapsed);
+
+   fclose(fstat);
+}
+
+
+
+/**************************************************/
+/*                                                */
+/*  Start a job in the working directory, with    */
+/*  its output going to the status directory.     */
+/*                                                */
+/**************************************************/
+
+int launch(int ijob)
+{
+   int         fd;
+   char        fname[2*MAXSTR];
+   char        exe  [2*MAXSTR];
+   pid_t       pid;
+   struct Job *job;
+
+   job = &jobs[ijob];
+
+   sprintf(fname, "%s/%s.status", statusdir, job->id);
+
+   unlink(fname);
+
+   sprintf(fname, "%s/%s.out", statusdir, job->id);
+
+   if(strlen(bindir) > 0)
+      sprintf(exe, "%s/%s", bindir, job->name);
+   else
+      strcpy(exe, job->name);
+
+   ++job->attempts;
+
+   if(debug)
+   {
+      printf("%s (%s) started, priority %.2f, attempt %d\n",
+         job->id, job->name, job->priority, job->attempts);
+      fflush(stdout);
+   }
+
+   fflush(stdout);
+
+   pid = fork();
+
+   if(pid < 0)
+      return 1;
+
+   if(pid == 0)
+   {
+      fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0664);
+
+      if(fd < 0)
+         _exit(127);
+
+      dup2(fd, 1);
+      dup2(fd, 2);
+      close(fd);
+
+      if(chdir(workdir) < 0)
+         _exit(127);
+
+      if(strlen(bindir) > 0)
+         execv(exe, job->argv);
+      else
+         execvp(exe, job->argv);
+
+      fprintf(stderr, "[struct stat=\"ERROR\", msg=\"Cannot execute %s\"]\n", exe);
+
+      _exit(127);
+   }
+
+   job->pid   = pid;
+   job->state = RUNNING;
+   job->start = now();
+
+   return 0;
+}
+
+
+
+/**************************************************/
+/*                                                */
+/*  A job failed if it did not exit normally      */
+/*  with status zero or if it reported an ERROR   */
+/*  return structure (some programs exit with     */
+/*  zero even then).                              */
+/*                                                */
+/**************************************************/
+
+int jobFailed(struct Job *job, int status)
+{
+   char  fname[2*MAXSTR];
+   char  line [MAXSTR];
+   FILE *fout;
+   int   failed;
+
+   if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      return 1;
+
+   sprintf(fname, "%s/%s.out", statusdir, job->id);
+
+   fout = fopen(fname, "r");
+
+   if(fout == (FILE *)NULL)
+      return 0;
+
+   failed = 0;
+
+   while(fgets(line, MAXSTR, fout) != (char *)NULL)
+   {
+      if(strstr(line, "[struct stat=\"ERROR\"") != (char *)NULL)
+      {
+         failed = 1;
+         break;
+      }
+   }
+
+   fclose(fout);
+
+   return failed;
+}
+
+
+
+/**************************************************/
+/*                                                */
+/*  Ready queue (binary max-heap on priority)     */
+/*                                                */
+/**************************************************/
+
+void heapPush(int ijob)
+{
+   int i, parent, tmp;
+
+   i = nheap;
+
+   heap[i] = ijob;
+
+   ++nheap;
+
+   while(i > 0)
+   {
+      parent = (i - 1) / 2;
+
+      if(jobs[heap[parent]].priority >= jobs[heap[i]].priority)
+         break;
+
+      tmp          = heap[parent];
+      heap[parent] = heap[i];
+      heap[i]      = tmp;
+
+      i = parent;
+   }
+}
+
+
+int heapPop()
+{
+   int i, top, left, right, largest, tmp;
+
+   top = heap[0];
+
+   --nheap;
+
+   heap[0] = heap[nheap];
+
+   i = 0;
+
+   while(1)
+   {
+      left    = 2*i + 1;
+      right   = 2*i + 2;
+      largest = i;
+
+      if(left < nheap && jobs[heap[left]].priority > jobs[heap[largest]].priority)
+         largest = left;
+
+      if(right < nheap && jobs[heap[right]].priority > jobs[heap[largest]].priority)
+         largest = right;
+
+      if(largest == i)
+         break;
+
+      tmp           = heap[largest];
+      heap[largest] = heap[i];
+      heap[i]       = tmp;
+
+      i = largest;
+   }
+
+   return top;
+}
+
+
+
+/**************************************************/
+/*                                                */
+/*  Wall-clock time in seconds                    */
+/*                                                */
+/**************************************************/
+
+double now()
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, (struct timezone *)NULL);
+
+   return (double)tv.tv_sec + tv.tv_usec * 1.e-6;
+}
+
+
+
+/**************************************************/
+/*                                                */
+/*  Print out error message and exit              */
+/*                                                */
+/**************************************************/
+
+void printError(char *msg)
+{
+   printf("[struct stat=\"ERROR\", msg=\"%s\"]\n", msg);
+   fflush(stdout);
+   exit(1);
+}
@@ -719,6 +719,20 @@ int tseek(int recno)
 }
 
 
+long ttell()
+{
+   return((long)ftello(tfile));
+}
+
+
+
+int tseekpos(long offset)
+{
+   return(fseeko(tfile, (off_t)offset, SEEK_SET));
+}
+
+
+
 int tread()
 {
    int i, j;
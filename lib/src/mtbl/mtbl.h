@@ -92,6 +92,8 @@ char *tkeyval(int i);
 char *tfindkey(char *key);
 char *thdrline(int i);
 int   tseek(int recno);
+long  ttell();
+int   tseekpos(long offset);
 int   tread();
 char *tval(int col);
 int   tnull(int col);
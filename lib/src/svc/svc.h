@@ -52,5 +52,12 @@ SVC *svc_struct(char *instr);
 char *svc_stripblanks(char *ptr, int len, int quotes);
 int svc_free(SVC *svc);
 char *svc_val(char *structstr, char *key, char *val);
+int svc_pool_init(int maxjobs);
+int svc_pool_submit(char *svcstr);
+int svc_pool_wait();
+char *svc_pool_return(int slot);
+int svc_pool_active();
+int svc_pool_full();
+int svc_pool_close();
 
 #endif /* ISIS_SVC */
@@ -7,6 +7,8 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/wait.h>
+#include <sys/select.h>
+#include <fcntl.h>
 #include <signal.h>
 
 #include <svc.h>
@@ -922,6 +924,372 @@ int svc_command(int svc, char *cmdstr)
 
 
 
+/**********************************************************************/
+/* Asynchronous job pool.  Up to 'svc_pool_max' non-interactive       */
+/* services (as in svc_run()) can be running at once.  Each running   */
+/* job occupies a pool slot; svc_pool_submit() returns the slot used  */
+/* and svc_pool_wait() returns the slot of whichever job finishes     */
+/* next, leaving that job's return structure where svc_value() will   */
+/* find it.  The caller can key any per-job bookkeeping on the slot   */
+/* number, which is always in the range [0, maxjobs).                 */
+/**********************************************************************/
+
+struct svc_job
+{
+   int   index;       /* Service table index (-1 if slot is free)          */
+   char *buf;         /* Return structure collected from the child         */
+   int   nbuf;        /* Characters collected so far                       */
+   int   nalloc;      /* Space allocated for buf                           */
+};
+
+static struct svc_job *svc_pool = (struct svc_job *)NULL;
+
+static int svc_pool_max   = 0;       /* Concurrency limit                  */
+static int svc_pool_count = 0;       /* Number of jobs currently running   */
+
+
+/**************************************/
+/* Set the pool concurrency limit and */
+/* allocate the slot table            */
+/**************************************/
+
+int svc_pool_init(int maxjobs)
+{
+   int i;
+
+   if(svc_debug_stream)
+   {
+      fprintf(svc_debug_stream,
+	 "SVC_DEBUG>  Entering svc_pool_init(): maxjobs = %d<br>\n", maxjobs);
+      fflush(svc_debug_stream);
+   }
+
+   if(svc_pool_count > 0)
+      return(SVC_ERROR);
+
+   if(maxjobs < 1)
+      maxjobs = 1;
+
+   if(svc_pool)
+   {
+      for(i=0; i<svc_pool_max; ++i)
+	 free((void *)svc_pool[i].buf);
+
+      free((void *)svc_pool);
+   }
+
+   svc_pool = (struct svc_job *)malloc(maxjobs * sizeof(struct svc_job));
+
+   if(svc_pool == (struct svc_job *)NULL)
+   {
+      svc_pool_max = 0;
+      return(SVC_ERROR);
+   }
+
+   for(i=0; i<maxjobs; ++i)
+   {
+      svc_pool[i].index  = -1;
+      svc_pool[i].nbuf   =  0;
+      svc_pool[i].nalloc =  SVC_STRLEN;
+      svc_pool[i].buf    = (char *)malloc(SVC_STRLEN * sizeof(char));
+
+      if(svc_pool[i].buf == (char *)NULL)
+	 return(SVC_ERROR);
+
+      svc_pool[i].buf[0] = '\0';
+   }
+
+   svc_pool_max = maxjobs;
+
+   return(SVC_OK);
+}
+
+
+
+/*****************************************/
+/* Start a job in a free pool slot.      */
+/* Returns the slot number, or SVC_ERROR */
+/* if the pool is full or the child      */
+/* could not be started.                 */
+/*****************************************/
+
+int svc_pool_submit(char *svcstr)
+{
+   int slot, index;
+
+   if(svc_debug_stream)
+   {
+      fprintf(svc_debug_stream,
+	 "SVC_DEBUG>  Entering svc_pool_submit(): svcstr = [%s]<br>\n", 
+	 svcstr ? svcstr : "(null)");
+      fflush(svc_debug_stream);
+   }
+
+   if(svc_pool_max == 0 && svc_pool_init(1) == SVC_ERROR)
+      return(SVC_ERROR);
+
+   slot = -1;
+
+   for(index=0; index<svc_pool_max; ++index)
+   {
+      if(svc_pool[index].index < 0)
+      {
+	 slot = index;
+	 break;
+      }
+   }
+
+   if(slot < 0)
+   {
+      if(svc_debug_stream)
+      {
+	 fprintf(svc_debug_stream,
+	    "SVC_DEBUG>  svc_pool_submit(): pool is full<br>\n");
+	 fflush(svc_debug_stream);
+      }
+
+      return(SVC_ERROR);
+   }
+
+   index = svc_init(svcstr);
+
+   if(index == SVC_ERROR)
+      return(SVC_ERROR);
+
+
+   /* Keep our end of the pipes out of later children */
+   /* so they can't hold this child's stdin open      */
+
+   (void) fcntl(svc_list[index]->fdin[1],  F_SETFD, FD_CLOEXEC);
+   (void) fcntl(svc_list[index]->fdout[0], F_SETFD, FD_CLOEXEC);
+
+   svc_pool[slot].index  = index;
+   svc_pool[slot].nbuf   = 0;
+   svc_pool[slot].buf[0] = '\0';
+
+   ++svc_pool_count;
+
+   if(svc_debug_stream)
+   {
+      fprintf(svc_debug_stream,
+	 "SVC_DEBUG>  svc_pool_submit(): slot %d, index %d, pid %d<br>\n", 
+	 slot, index, svc_list[index]->pid);
+      fflush(svc_debug_stream);
+   }
+
+   return(slot);
+}
+
+
+
+/***********************************************/
+/* Wait for any running job to send its return */
+/* structure.  Returns the job's slot number   */
+/* (svc_value() then refers to that job), or   */
+/* SVC_ERROR if there are no jobs running.     */
+/***********************************************/
+
+int svc_pool_wait()
+{
+   int    i, fd, maxfd, nread, done;
+   char  *ptr;
+   fd_set fds;
+
+   static char nullmsg[] 
+      = "[struct stat=\"ABORT\", msg=\"No child program executable or program aborted\"]";
+
+   if(svc_debug_stream)
+   {
+      fprintf(svc_debug_stream,
+	 "SVC_DEBUG>  Entering svc_pool_wait(): %d jobs running<br>\n", svc_pool_count);
+      fflush(svc_debug_stream);
+   }
+
+   if(svc_pool_count == 0)
+      return(SVC_ERROR);
+
+   while(1)
+   {
+      FD_ZERO(&fds);
+
+      maxfd = -1;
+
+      for(i=0; i<svc_pool_max; ++i)
+      {
+	 if(svc_pool[i].index < 0)
+	    continue;
+
+	 fd = svc_list[svc_pool[i].index]->fdout[0];
+
+	 FD_SET(fd, &fds);
+
+	 if(fd > maxfd)
+	    maxfd = fd;
+      }
+
+      if(select(maxfd+1, &fds, (fd_set *)NULL, (fd_set *)NULL, 
+		(struct timeval *)NULL) < 0)
+      {
+	 if(errno == EINTR)
+	    continue;
+
+	 return(SVC_ERROR);
+      }
+
+
+      /* Collect whatever is ready.  A job is done when */
+      /* its first line is complete or it hits EOF      */
+
+      for(i=0; i<svc_pool_max; ++i)
+      {
+	 if(svc_pool[i].index < 0)
+	    continue;
+
+	 fd = svc_list[svc_pool[i].index]->fdout[0];
+
+	 if(!FD_ISSET(fd, &fds))
+	    continue;
+
+	 if(svc_pool[i].nalloc - svc_pool[i].nbuf < SVC_STRLEN)
+	 {
+	    svc_pool[i].nalloc += SVC_STRLEN;
+
+	    svc_pool[i].buf = (char *)realloc((void *)svc_pool[i].buf, 
+				 svc_pool[i].nalloc * sizeof(char));
+
+	    if(svc_pool[i].buf == (char *)NULL)
+	       return(SVC_ERROR);
+	 }
+
+	 nread = read(fd, svc_pool[i].buf + svc_pool[i].nbuf, SVC_STRLEN - 1);
+
+	 done = 0;
+
+	 if(nread < 0 && errno == EINTR)
+	    continue;
+
+	 if(nread <= 0)
+	 {
+	    if(svc_debug_stream)
+	    {
+	       fprintf(svc_debug_stream,
+		  "SVC_DEBUG>  svc_pool_wait(): EOF on slot %d<br>\n", i);
+	       fflush(svc_debug_stream);
+	    }
+
+	    strcpy(svc_pool[i].buf, nullmsg);
+
+	    done = 1;
+	 }
+	 else
+	 {
+	    svc_pool[i].nbuf += nread;
+
+	    svc_pool[i].buf[svc_pool[i].nbuf] = '\0';
+
+	    ptr = strchr(svc_pool[i].buf, '\n');
+
+	    if(ptr)
+	    {
+	       *ptr = '\0';
+	       done = 1;
+	    }
+	 }
+
+	 if(done)
+	 {
+	    svc_close(svc_pool[i].index);
+
+	    svc_pool[i].index = -1;
+
+	    --svc_pool_count;
+
+	    svc_return_string = svc_pool[i].buf;
+
+	    if(svc_debug_stream)
+	    {
+	       fprintf(svc_debug_stream,
+		  "SVC_DEBUG>  svc_pool_wait(): slot %d returned [%s]<br>\n", 
+		  i, svc_return_string);
+	       fflush(svc_debug_stream);
+	    }
+
+	    return(i);
+	 }
+      }
+   }
+}
+
+
+
+/*************************************/
+/* Return structure last received in */
+/* a pool slot                       */
+/*************************************/
+
+char *svc_pool_return(int slot)
+{
+   if(slot < 0 || slot >= svc_pool_max)
+      return((char *)NULL);
+
+   return(svc_pool[slot].buf);
+}
+
+
+
+/***********************************/
+/* Number of pool jobs running and */
+/* whether there is a free slot    */
+/***********************************/
+
+int svc_pool_active()
+{
+   return(svc_pool_count);
+}
+
+
+int svc_pool_full()
+{
+   if(svc_pool_max == 0)
+      return(0);
+
+   return(svc_pool_count >= svc_pool_max);
+}
+
+
+
+/***********************************/
+/* Shut down all running pool jobs */
+/***********************************/
+
+int svc_pool_close()
+{
+   int i;
+
+   if(svc_debug_stream)
+   {
+      fprintf(svc_debug_stream,
+	 "SVC_DEBUG>  Entering svc_pool_close()<br>\n");
+      fflush(svc_debug_stream);
+   }
+
+   for(i=0; i<svc_pool_max; ++i)
+   {
+      if(svc_pool[i].index < 0)
+	 continue;
+
+      svc_close(svc_pool[i].index);
+
+      svc_pool[i].index = -1;
+   }
+
+   svc_pool_count = 0;
+
+   return(SVC_OK);
+}
+
+
+
 /**********************************************************************/
 /* Relatively generic routine to extract the structure value          */
 /* requested and return a string pointer to it.                       */
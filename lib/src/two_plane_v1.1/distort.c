@@ -9,6 +9,8 @@ void distort(double x, double y, DistCoeff coeff, double *u, double *v)
   m = coeff.AP_ORDER;
   n = coeff.BP_ORDER;
 
+  s[0] = 0.;
+
   temp_x = x - coeff.crpix1;
   temp_y = y - coeff.crpix2;
 
@@ -43,3 +45,68 @@ void distort(double x, double y, DistCoeff coeff, double *u, double *v)
   *u = x + *u;
   *v = y + *v;
 }
+
+
+/* Row version of distort() for n points at a time.  The polynomials */
+/* are evaluated in the same Horner order as above, but each step is */
+/* a loop over the points (held as separate x and y arrays) so the   */
+/* compiler can vectorize it.  u,v must not overlap x,y.             */
+
+void sip_poly_row(int n, double C[MAXORDER][MAXORDER], int order,
+                  double *tx, double *ty, double *out, double *col)
+{
+  int m, i, j, k;
+  double c;
+
+  m = order;
+
+  c = C[m][0];
+  for (i=0; i<n; i++)
+    out[i] = c;
+
+  for (j=1; j<=m; j++) {
+    c = C[m-j][j];
+    for (i=0; i<n; i++)
+      col[i] = c;
+
+    for (k=j-1; k>=0; k--) {
+      c = C[m-j][k];
+      for (i=0; i<n; i++)
+        col[i] = ty[i]*col[i] + c;
+    }
+
+    for (i=0; i<n; i++)
+      out[i] = tx[i]*out[i] + col[i];
+  }
+}
+
+
+void distort_row(int n, double *x, double *y, DistCoeff *coeff, double *u, double *v)
+{
+  int i, i0, nc;
+  double tx[DIST_CHUNK], ty[DIST_CHUNK], col[DIST_CHUNK];
+  double su[DIST_CHUNK], sv[DIST_CHUNK];
+
+  for (i0=0; i0<n; i0+=DIST_CHUNK) {
+    nc = n - i0;
+    if (nc > DIST_CHUNK)
+      nc = DIST_CHUNK;
+
+    for (i=0; i<nc; i++) {
+      tx[i] = x[i0+i] - coeff->crpix1;
+      ty[i] = y[i0+i] - coeff->crpix2;
+    }
+
+    sip_poly_row(nc, coeff->AP, coeff->AP_ORDER, tx, ty, su, col);
+    sip_poly_row(nc, coeff->BP, coeff->BP_ORDER, tx, ty, sv, col);
+
+    for (i=0; i<nc; i++) {
+      u[i0+i] = x[i0+i] + su[i];
+      v[i0+i] = y[i0+i] + sv[i];
+    }
+  }
+
+  if (coeff->inverse == INVERSE_ITERATE)
+    for (i=0; i<n; i++)
+      distort_refine(x[i], y[i], coeff, &u[i], &v[i]);
+}
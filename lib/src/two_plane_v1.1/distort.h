@@ -16,6 +16,34 @@ typedef struct {
   double crpix2;
   double a_dmax;
   double b_dmax;
+  int    inverse;                /* how distort() inverts A/B (below)  */
+  double inverse_error;          /* max AP/BP round-trip error, pixels */
 } DistCoeff;
 
+/* The AP/BP polynomials are only an approximation to the inverse of */
+/* A/B.  setup_inverse() fits them if the header left them out and   */
+/* measures the round-trip error over the image; if that is more     */
+/* than INVERSE_TOLERANCE pixels the polynomial result is refined by */
+/* Newton iteration on A/B.                                          */
+
+#define INVERSE_HEADER     0     /* AP/BP from the header, good enough */
+#define INVERSE_FIT        1     /* AP/BP fitted here, good enough     */
+#define INVERSE_ITERATE    2     /* refine by iteration                */
+
+#define INVERSE_TOLERANCE  0.001
+
+#define DIST_CHUNK         256   /* points per pass in the row routines */
+
+void distort  (double x, double y, DistCoeff coeff, double *u, double *v);
+void undistort(double u, double v, DistCoeff coeff, double *x, double *y);
+
+void distort_row  (int n, double *x, double *y, DistCoeff *coeff, double *u, double *v);
+void undistort_row(int n, double *u, double *v, DistCoeff *coeff, double *x, double *y);
+
+void sip_poly_row(int n, double C[MAXORDER][MAXORDER], int order,
+                  double *tx, double *ty, double *out, double *col);
+
+int  setup_inverse (DistCoeff *coeff, int naxis1, int naxis2);
+void distort_refine(double x, double y, DistCoeff *coeff, double *u, double *v);
+
 #endif
@@ -0,0 +1,303 @@
+/***********************************************
+invdistort.c
+Purpose
+Check the AP/BP (pixel -> distorted pixel) polynomials
+against the A/B ones they are supposed to invert, fit
+them if the header didn't supply any, and fall back to
+Newton iteration on A/B where the polynomial inverse
+isn't accurate enough.
+
+The check is done once, when the distortion is set up:
+a grid covering the image (plus a one pixel margin) is
+taken through undistort() and back through distort()
+and the largest round-trip error is kept in the
+coefficient structure.
+*********************************************/
+#include <stdio.h>
+#include <math.h>
+#include "distort.h"
+
+#define FIT_GRID     25
+#define CHECK_GRID   49
+#define MAXTERM      (MAXORDER*(MAXORDER+1)/2)
+#define MAXITER      20
+#define ITER_TOL     1.e-10
+
+static int    sip_empty    (double C[MAXORDER][MAXORDER], int order);
+static int    fit_inverse  (DistCoeff *coeff, int naxis1, int naxis2);
+static double inverse_error(DistCoeff *coeff, int naxis1, int naxis2);
+static void   sip_eval     (double C[MAXORDER][MAXORDER], int order, double tx, double ty,
+                            double *f, double *fx, double *fy);
+
+
+/* Decide how distort() is to invert A/B for this image; returns */
+/* (and sets coeff->inverse to) one of the INVERSE_* codes.       */
+
+int setup_inverse(DistCoeff *coeff, int naxis1, int naxis2)
+{
+  coeff->inverse       = INVERSE_HEADER;
+  coeff->inverse_error = -1.;
+
+  /* no AP/BP in the header: fit them */
+  if (sip_empty(coeff->AP, coeff->AP_ORDER) && sip_empty(coeff->BP, coeff->BP_ORDER)
+  && !(sip_empty(coeff->A, coeff->A_ORDER) && sip_empty(coeff->B, coeff->B_ORDER))) {
+    if (naxis1 <= 0 || naxis2 <= 0 || fit_inverse(coeff, naxis1, naxis2) != 0) {
+      coeff->inverse = INVERSE_ITERATE;
+      return coeff->inverse;
+    }
+    coeff->inverse = INVERSE_FIT;
+  }
+
+  if (naxis1 <= 0 || naxis2 <= 0)
+    return coeff->inverse;
+
+  coeff->inverse_error = inverse_error(coeff, naxis1, naxis2);
+
+  if (!(coeff->inverse_error <= INVERSE_TOLERANCE))
+    coeff->inverse = INVERSE_ITERATE;
+
+  return coeff->inverse;
+}
+
+
+/* Refine (u,v), an estimate of distort(x,y), so that */
+/* undistort(u,v) reproduces (x,y).                   */
+
+void distort_refine(double x, double y, DistCoeff *coeff, double *u, double *v)
+{
+  int iter;
+  double a, ax, ay, b, bx, by;
+  double rx, ry, det, du, dv;
+
+  for (iter=0; iter<MAXITER; iter++) {
+    sip_eval(coeff->A, coeff->A_ORDER, *u - coeff->crpix1, *v - coeff->crpix2, &a, &ax, &ay);
+    sip_eval(coeff->B, coeff->B_ORDER, *u - coeff->crpix1, *v - coeff->crpix2, &b, &bx, &by);
+
+    rx = *u + a - x;
+    ry = *v + b - y;
+
+    det = (1. + ax) * (1. + by) - ay * bx;
+    if (det == 0.)
+      return;
+
+    du = ((1. + by) * rx - ay * ry) / det;
+    dv = ((1. + ax) * ry - bx * rx) / det;
+
+    *u -= du;
+    *v -= dv;
+
+    if (fabs(du) < ITER_TOL && fabs(dv) < ITER_TOL)
+      return;
+  }
+}
+
+
+static int sip_empty(double C[MAXORDER][MAXORDER], int order)
+{
+  int i, j;
+
+  for (i=0; i<=order && i<MAXORDER; i++)
+    for (j=0; j<=order-i && j<MAXORDER; j++)
+      if (C[i][j] != 0.)
+        return 0;
+
+  return 1;
+}
+
+
+/* Least-squares fit of AP/BP on a grid of undistorted points. */
+/* Coordinates are scaled to about [-1,1] for the fit.         */
+
+static int fit_inverse(DistCoeff *coeff, int naxis1, int naxis2)
+{
+  int i, j, k, l, n, order, nterm, imax;
+  int pi[MAXTERM], pj[MAXTERM];
+  double M[MAXTERM][MAXTERM], R[MAXTERM][2], f[MAXTERM];
+  double xp[MAXORDER], yp[MAXORDER];
+  double u[FIT_GRID], v[FIT_GRID], x[FIT_GRID], y[FIT_GRID];
+  double scale, tx, ty, t, pmax, s;
+
+  /* one order more than A/B, as is usual for SIP inverses */
+  order = coeff->A_ORDER > coeff->B_ORDER ? coeff->A_ORDER : coeff->B_ORDER;
+  order++;
+  if (order < 1)
+    order = 1;
+  if (order > MAXORDER-1)
+    order = MAXORDER-1;
+
+  nterm = 0;
+  for (i=0; i<=order; i++)
+    for (j=0; j<=order-i; j++) {
+      pi[nterm] = i;
+      pj[nterm] = j;
+      nterm++;
+    }
+
+  scale = 0.5 * ((naxis1 > naxis2 ? naxis1 : naxis2) + 2);
+
+  for (k=0; k<nterm; k++) {
+    for (l=0; l<nterm; l++)
+      M[k][l] = 0.;
+    R[k][0] = 0.;
+    R[k][1] = 0.;
+  }
+
+  /* normal equations */
+  for (j=0; j<FIT_GRID; j++) {
+    for (i=0; i<FIT_GRID; i++) {
+      u[i] = -0.5 + (naxis1 + 2.) * i / (FIT_GRID - 1.);
+      v[i] = -0.5 + (naxis2 + 2.) * j / (FIT_GRID - 1.);
+    }
+
+    undistort_row(FIT_GRID, u, v, coeff, x, y);
+
+    for (i=0; i<FIT_GRID; i++) {
+      tx = (x[i] - coeff->crpix1) / scale;
+      ty = (y[i] - coeff->crpix2) / scale;
+
+      xp[0] = 1.;
+      yp[0] = 1.;
+      for (k=1; k<=order; k++) {
+        xp[k] = xp[k-1] * tx;
+        yp[k] = yp[k-1] * ty;
+      }
+
+      for (k=0; k<nterm; k++)
+        f[k] = xp[pi[k]] * yp[pj[k]];
+
+      for (k=0; k<nterm; k++) {
+        for (l=0; l<nterm; l++)
+          M[k][l] += f[k] * f[l];
+        R[k][0] += f[k] * (u[i] - x[i]);
+        R[k][1] += f[k] * (v[i] - y[i]);
+      }
+    }
+  }
+
+  /* Gaussian elimination with partial pivoting */
+  for (k=0; k<nterm; k++) {
+    imax = k;
+    pmax = fabs(M[k][k]);
+    for (i=k+1; i<nterm; i++)
+      if (fabs(M[i][k]) > pmax) {
+        pmax = fabs(M[i][k]);
+        imax = i;
+      }
+
+    if (pmax < 1.e-12 * fabs(M[0][0]))
+      return 1;
+
+    if (imax != k) {
+      for (l=0; l<nterm; l++) {
+        t = M[k][l]; M[k][l] = M[imax][l]; M[imax][l] = t;
+      }
+      t = R[k][0]; R[k][0] = R[imax][0]; R[imax][0] = t;
+      t = R[k][1]; R[k][1] = R[imax][1]; R[imax][1] = t;
+    }
+
+    for (i=k+1; i<nterm; i++) {
+      t = M[i][k] / M[k][k];
+      for (l=k; l<nterm; l++)
+        M[i][l] -= t * M[k][l];
+      R[i][0] -= t * R[k][0];
+      R[i][1] -= t * R[k][1];
+    }
+  }
+
+  for (k=nterm-1; k>=0; k--) {
+    for (l=k+1; l<nterm; l++) {
+      R[k][0] -= M[k][l] * R[l][0];
+      R[k][1] -= M[k][l] * R[l][1];
+    }
+    R[k][0] /= M[k][k];
+    R[k][1] /= M[k][k];
+  }
+
+  /* back to pixel units */
+  for (i=0; i<MAXORDER; i++)
+    for (j=0; j<MAXORDER; j++) {
+      coeff->AP[i][j] = 0.;
+      coeff->BP[i][j] = 0.;
+    }
+
+  coeff->AP_ORDER = order;
+  coeff->BP_ORDER = order;
+
+  for (n=0; n<nterm; n++) {
+    s = pow(scale, (double)(pi[n] + pj[n]));
+    coeff->AP[pi[n]][pj[n]] = R[n][0] / s;
+    coeff->BP[pi[n]][pj[n]] = R[n][1] / s;
+  }
+
+  return 0;
+}
+
+
+/* Largest |distort(undistort(p)) - p| over the image, using */
+/* the polynomials alone.                                    */
+
+static double inverse_error(DistCoeff *coeff, int naxis1, int naxis2)
+{
+  int i, j, inverse;
+  double u[CHECK_GRID], v[CHECK_GRID], x[CHECK_GRID], y[CHECK_GRID];
+  double uu[CHECK_GRID], vv[CHECK_GRID];
+  double dx, dy, err, maxerr;
+
+  inverse = coeff->inverse;
+  coeff->inverse = INVERSE_HEADER;
+
+  maxerr = 0.;
+
+  for (j=0; j<CHECK_GRID; j++) {
+    for (i=0; i<CHECK_GRID; i++) {
+      u[i] = -0.5 + (naxis1 + 2.) * i / (CHECK_GRID - 1.);
+      v[i] = -0.5 + (naxis2 + 2.) * j / (CHECK_GRID - 1.);
+    }
+
+    undistort_row(CHECK_GRID, u,  v,  coeff, x,  y);
+    distort_row  (CHECK_GRID, x,  y,  coeff, uu, vv);
+
+    for (i=0; i<CHECK_GRID; i++) {
+      dx = uu[i] - u[i];
+      dy = vv[i] - v[i];
+      err = sqrt(dx*dx + dy*dy);
+
+      if (!(err <= maxerr))
+        maxerr = err;
+    }
+  }
+
+  coeff->inverse = inverse;
+
+  return maxerr;
+}
+
+
+/* Polynomial value and first derivatives by direct summation. */
+
+static void sip_eval(double C[MAXORDER][MAXORDER], int order, double tx, double ty,
+                     double *f, double *fx, double *fy)
+{
+  int i, j;
+  double xp[MAXORDER+1], yp[MAXORDER+1];
+
+  xp[0] = 1.;
+  yp[0] = 1.;
+  for (i=1; i<=order; i++) {
+    xp[i] = xp[i-1] * tx;
+    yp[i] = yp[i-1] * ty;
+  }
+
+  *f  = 0.;
+  *fx = 0.;
+  *fy = 0.;
+
+  for (i=0; i<=order; i++)
+    for (j=0; j<=order-i; j++) {
+      *f += C[i][j] * xp[i] * yp[j];
+      if (i > 0)
+        *fx += i * C[i][j] * xp[i-1] * yp[j];
+      if (j > 0)
+        *fy += j * C[i][j] * xp[i] * yp[j-1];
+    }
+}
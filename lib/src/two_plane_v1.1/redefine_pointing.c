@@ -304,7 +304,7 @@ int replace_keyword(char *fitsheader, double value, const char *key){
 
   sprintf(char_value,"%9.8f",value);
   total_length = strlen(char_value);
-  strncpy(temp,char_value,total_length);
+  memcpy(temp,char_value,total_length);
   temp += total_length;
   while(*(temp) != ' '){
     *(temp++) = ' ';
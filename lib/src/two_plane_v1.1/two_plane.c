@@ -24,10 +24,10 @@ warnings/error.
 #include "two_plane.h"
 #include "distort.h"
 
-void distort(double x, double y, DistCoeff coeff, double *u, double *v);
-void undistort(double u, double v, DistCoeff coeff, double *x, double *y);
 int  initdata_byheader(char *fitsheader, DistCoeff *coeff);
 
+static int proj_code(char *ptype);
+
 
 int plane1_to_plane2_transform(double x_1, double y_1, double *x_2, double *y_2, 
 			   struct TwoPlane *two_plane){
@@ -187,6 +187,8 @@ int plane1_to_plane2_transform(double x_1, double y_1, double *x_2, double *y_2,
   /* do distort if necesssary*/
   if(two_plane->second_distorted > 0){
      distort(x_temp, y_temp, two_plane->DistortCoeffSecond, x_2, y_2);
+     if(two_plane->DistortCoeffSecond.inverse == INVERSE_ITERATE)
+       distort_refine(x_temp, y_temp, &(two_plane->DistortCoeffSecond), x_2, y_2);
   }
   else{
     *x_2 = x_temp;
@@ -362,6 +364,8 @@ int plane2_to_plane1_transform(double x_2, double y_2, double *x_1, double *y_1,
   /* do distort if necesssary*/
   if(two_plane->first_distorted > 0){
      distort(x_temp, y_temp, two_plane->DistortCoeffFirst, x_1, y_1);
+     if(two_plane->DistortCoeffFirst.inverse == INVERSE_ITERATE)
+       distort_refine(x_temp, y_temp, &(two_plane->DistortCoeffFirst), x_1, y_1);
   }
   else{
     *x_1 = x_temp;
@@ -375,6 +379,259 @@ int plane2_to_plane1_transform(double x_2, double y_2, double *x_1, double *y_1,
 }
      
 
+/* Row (batch) version of plane1_to_plane2_transform() for n points,
+   e.g. all the pixel corners along one row of the input image.
+   status[i] is what the single-point call would have returned for
+   point i; points that can't be projected get zero coordinates.
+   The points are taken TWO_PLANE_CHUNK at a time and each step of
+   the transform (distortion polynomials, rotation, projection
+   conversions) is done as a loop over the chunk, with the same
+   arithmetic as the single-point code, so the results are identical
+   and the simple loops can be vectorized by the compiler. */
+
+int plane1_to_plane2_transform_row(int n, double *x_in, double *y_in,
+                                   double *x_out, double *y_out, int *status,
+                                   struct TwoPlane *two_plane){
+
+  int i, i0, nc, *st;
+  double x_1[TWO_PLANE_CHUNK], y_1[TWO_PLANE_CHUNK];
+  double x_temp[TWO_PLANE_CHUNK], y_temp[TWO_PLANE_CHUNK];
+  double conv[TWO_PLANE_CHUNK];
+  double *xo, *yo;
+  double cos_theta, sin_theta, den, sq, tan_phi_squared;
+
+  if(two_plane->initialized != 1){
+    for(i=0; i<n; i++){
+      x_out[i] = 0;
+      y_out[i] = 0;
+      status[i] = TWO_PLANE_NOT_INITIALIZED;
+    }
+    return TWO_PLANE_NOT_INITIALIZED;
+  }
+
+  cos_theta = two_plane->cos_theta;
+  sin_theta = two_plane->sin_theta;
+
+  for(i0=0; i0<n; i0+=TWO_PLANE_CHUNK){
+    nc = n - i0;
+    if(nc > TWO_PLANE_CHUNK)
+      nc = TWO_PLANE_CHUNK;
+
+    st = status + i0;
+    xo = x_out  + i0;
+    yo = y_out  + i0;
+
+    for(i=0; i<nc; i++)
+      st[i] = 0;
+
+    /* do undistort if necesssary*/
+    if(two_plane->first_distorted > 0)
+      undistort_row(nc, x_in+i0, y_in+i0, &(two_plane->DistortCoeffFirst), x_1, y_1);
+    else{
+      for(i=0; i<nc; i++){
+        x_1[i] = x_in[i0+i];
+        y_1[i] = y_in[i0+i];
+      }
+    }
+
+    /*  rotate to the perp and paral coordinate system */
+    if(two_plane->have_cdmatrix1){
+      for(i=0; i<nc; i++){
+        x_temp[i] = two_plane->cd1_11 * (x_1[i] - two_plane->x_center_1) +
+          two_plane->cd1_12 * (y_1[i] - two_plane->y_center_1);
+        y_temp[i] = two_plane->cd1_21 * (x_1[i] -two_plane->x_center_1) +
+          two_plane->cd1_22 * (y_1[i] - two_plane->y_center_1);
+        x_temp[i] *= PI180;
+      }
+    }
+    else{
+      for(i=0; i<nc; i++){
+        x_temp[i] = two_plane->cdelt1_1 * (x_1[i] - two_plane->x_center_1) * two_plane->cos_phi_1 +
+          two_plane->cdelt2_1 * (y_1[i] - two_plane->y_center_1) * two_plane->sin_phi_1;
+        y_temp[i] = -two_plane->cdelt1_1 * (x_1[i] -two_plane->x_center_1) * two_plane->sin_phi_1 +
+          two_plane->cdelt2_1 * (y_1[i] - two_plane->y_center_1) * two_plane->cos_phi_1;
+        x_temp[i] *= PI180;
+      }
+    }
+
+    /* projection of the first plane (none for TAN) */
+    switch(two_plane->proj_code_1){
+    case PROJ_SIN:
+      for(i=0; i<nc; i++){
+        sq = x_temp[i] * x_temp[i] + y_temp[i] * y_temp[i] * PI180 * PI180;
+        if(sq > 1){
+          st[i] = CANNOT_PROJECT;
+          conv[i] = 1;
+        }
+        else if(sq < 1)
+          conv[i] = sqrt(1 - sq);
+        else
+          conv[i] = 0;
+      }
+      for(i=0; i<nc; i++){
+        x_temp[i] /= conv[i];
+        y_temp[i] /= conv[i];
+      }
+      break;
+
+    case PROJ_ZEA:
+      for(i=0; i<nc; i++){
+        sq = 0.25*(x_temp[i] * x_temp[i] + y_temp[i] * y_temp[i] * PI180 * PI180);
+        if(sq > 0.5){
+          st[i] = CANNOT_PROJECT;
+          conv[i] = 1;
+        }
+        else
+          conv[i] = 0.5*sqrt(1 - sq)/(1-2*sq);
+      }
+      for(i=0; i<nc; i++){
+        x_temp[i] *= conv[i];
+        y_temp[i] *= conv[i];
+      }
+      break;
+
+    case PROJ_STG:
+      for(i=0; i<nc; i++){
+        sq = 0.25*(x_temp[i] * x_temp[i] + y_temp[i] * y_temp[i] * PI180 * PI180);
+        if(sq >= 1){
+          st[i] = CANNOT_PROJECT;
+          conv[i] = 1;
+        }
+        else
+          conv[i] = 1 - sq;
+      }
+      for(i=0; i<nc; i++){
+        x_temp[i] *= conv[i];
+        y_temp[i] *= conv[i];
+      }
+      break;
+
+    case PROJ_ARC:
+      for(i=0; i<nc; i++){
+        sq = x_temp[i] * x_temp[i]/(PI180 * PI180) + y_temp[i] * y_temp[i];
+        if(sq <= 0){
+          st[i] = CANNOT_PROJECT;
+          conv[i] = 1;
+        }
+        else
+          conv[i] = tan(sqrt(sq))/sqrt(sq);
+      }
+      for(i=0; i<nc; i++){
+        x_temp[i] *= conv[i];
+        y_temp[i] *= conv[i];
+      }
+      break;
+
+    case PROJ_OTHER:
+      for(i=0; i<nc; i++)
+        if(cos_theta - x_temp[i] * sin_theta <= 0)
+          st[i] = CANNOT_PROJECT;
+      break;
+    }
+
+    /* rotate from the first plane to the second */
+    for(i=0; i<nc; i++){
+      den = cos_theta - x_temp[i] * sin_theta;
+      y_1[i] = y_temp[i] / den;
+      x_1[i] = (sin_theta + x_temp[i] * cos_theta)/den/ PI180;
+    }
+
+    /* projection of the second plane (none for TAN) */
+    switch(two_plane->proj_code_2){
+    case PROJ_SIN:
+      for(i=0; i<nc; i++){
+        tan_phi_squared = (x_1[i] * x_1[i] + y_1[i] * y_1[i]) * PI180 * PI180;
+        conv[i] = 1./ sqrt(1 + tan_phi_squared);
+      }
+      break;
+
+    case PROJ_ZEA:
+      for(i=0; i<nc; i++){
+        tan_phi_squared = (x_1[i] * x_1[i] + y_1[i] * y_1[i]) * PI180 * PI180;
+        if(tan_phi_squared > Epsilon)
+          conv[i] = sqrt(2.*(1.-1./sqrt(1+tan_phi_squared)))/sqrt(tan_phi_squared);
+        else
+          conv[i] = 1;
+      }
+      break;
+
+    case PROJ_STG:
+      for(i=0; i<nc; i++){
+        tan_phi_squared = (x_1[i] * x_1[i] + y_1[i] * y_1[i]) * PI180 * PI180;
+        conv[i] = 1./(sqrt(1+tan_phi_squared)+1);
+      }
+      break;
+
+    case PROJ_ARC:
+      for(i=0; i<nc; i++){
+        tan_phi_squared = (x_1[i] * x_1[i] + y_1[i] * y_1[i]) * PI180 * PI180;
+        if(tan_phi_squared <= 0){
+          st[i] = CANNOT_PROJECT;
+          conv[i] = 1;
+        }
+        else
+          conv[i] = atan(sqrt(tan_phi_squared))/sqrt(tan_phi_squared);
+      }
+      break;
+
+    default:
+      for(i=0; i<nc; i++)
+        conv[i] = 1;
+      break;
+    }
+
+    if(two_plane->proj_code_2 != PROJ_TAN && two_plane->proj_code_2 != PROJ_OTHER){
+      for(i=0; i<nc; i++){
+        x_1[i] *= conv[i];
+        y_1[i] *= conv[i];
+      }
+    }
+
+    /*  rotate to the x and y coordinates of the output frame */
+    if(two_plane->have_cdmatrix2){
+      for(i=0; i<nc; i++){
+        x_temp[i] = two_plane->invcd2_11 * x_1[i] + two_plane->invcd2_12 * y_1[i];
+        y_temp[i] = two_plane->invcd2_21 * x_1[i] + two_plane->invcd2_22 * y_1[i];
+        x_temp[i] += two_plane->x_center_2;
+        y_temp[i] += two_plane->y_center_2;
+      }
+    }
+    else{
+      for(i=0; i<nc; i++){
+        x_temp[i] = (x_1[i]) * two_plane->cos_phi_2 - (y_1[i]) * two_plane->sin_phi_2;
+        y_temp[i] = (x_1[i]) * two_plane->sin_phi_2 + (y_1[i]) * two_plane->cos_phi_2;
+        x_temp[i] /= two_plane->cdelt1_2;
+        y_temp[i] /= two_plane->cdelt2_2;
+        x_temp[i] += two_plane->x_center_2;
+        y_temp[i] += two_plane->y_center_2;
+      }
+    }
+
+    /* do distort if necesssary*/
+    if(two_plane->second_distorted > 0)
+      distort_row(nc, x_temp, y_temp, &(two_plane->DistortCoeffSecond), xo, yo);
+    else{
+      for(i=0; i<nc; i++){
+        xo[i] = x_temp[i];
+        yo[i] = y_temp[i];
+      }
+    }
+
+    for(i=0; i<nc; i++){
+      if(st[i] == CANNOT_PROJECT){
+        xo[i] = 0;
+        yo[i] = 0;
+      }
+      else if(xo[i] < 0.5 || xo[i] > two_plane->naxis1_2 + 0.5 || 
+              yo[i] < 0.5 || yo[i] > two_plane->naxis2_2 + 0.5)
+        st[i] = PROJECT_OUTSIDE_IMAGE;
+    }
+  }
+
+  return 0;
+}
+     
+
 int Initialize_TwoPlane_FirstDistort(struct TwoPlane *two_plane, 
 				      char *fitsheader, struct WorldCoor *WCS){
 
@@ -386,6 +643,8 @@ int Initialize_TwoPlane_FirstDistort(struct TwoPlane *two_plane,
   
   two_plane->first_distorted = initdata_byheader(fitsheader, &(two_plane->DistortCoeffFirst));
   two_plane->second_distorted = 0;
+  if(two_plane->first_distorted > 0)
+    setup_inverse(&(two_plane->DistortCoeffFirst), two_plane->naxis1_1, two_plane->naxis2_1);
   if(wcs != NULL)
     free (wcs);
 
@@ -404,6 +663,8 @@ int Initialize_TwoPlane_SecondDistort(struct TwoPlane *two_plane,
   two_plane->second_distorted = initdata_byheader(fitsheader, 
 						  &(two_plane->DistortCoeffSecond) );
   two_plane->first_distorted = 0;
+  if(two_plane->second_distorted > 0)
+    setup_inverse(&(two_plane->DistortCoeffSecond), two_plane->naxis1_2, two_plane->naxis2_2);
   if(WCS != NULL)
     free (WCS);
 
@@ -425,6 +686,10 @@ int Initialize_TwoPlane_BothDistort(struct TwoPlane *two_plane,
                                                  &(two_plane->DistortCoeffFirst));
   two_plane->second_distorted = initdata_byheader(fitsheader2,
                                                   &(two_plane->DistortCoeffSecond));
+  if(two_plane->first_distorted > 0)
+    setup_inverse(&(two_plane->DistortCoeffFirst), two_plane->naxis1_1, two_plane->naxis2_1);
+  if(two_plane->second_distorted > 0)
+    setup_inverse(&(two_plane->DistortCoeffSecond), two_plane->naxis1_2, two_plane->naxis2_2);
   if(WCS != NULL)
     free (WCS);
   if(wcs != NULL)
@@ -437,6 +702,7 @@ int SetDistortionPlaneFirstSimple(struct TwoPlane *two_plane,
 			    DistCoeff *coeff){
   two_plane->DistortCoeffFirst = *coeff;
   two_plane->first_distorted = 1;
+  setup_inverse(&(two_plane->DistortCoeffFirst), two_plane->naxis1_1, two_plane->naxis2_1);
   
   return 0;
 
@@ -446,6 +712,7 @@ int SetDistortionPlaneSecondSimple(struct TwoPlane *two_plane,
 			    DistCoeff *coeff){
   two_plane->DistortCoeffSecond = *coeff;
   two_plane->second_distorted = 1;
+  setup_inverse(&(two_plane->DistortCoeffSecond), two_plane->naxis1_2, two_plane->naxis2_2);
   
   return 0;
 
@@ -505,6 +772,7 @@ int SetDistortionPlaneFirst(struct TwoPlane *two_plane,
   two_plane->DistortCoeffFirst.crpix1 = xrefpix;
   two_plane->DistortCoeffFirst.crpix2 = yrefpix;
   two_plane->first_distorted = 1;
+  setup_inverse(&(two_plane->DistortCoeffFirst), two_plane->naxis1_1, two_plane->naxis2_1);
 
   return 0;
 }
@@ -565,6 +833,7 @@ int SetDistortionPlaneSecond(struct TwoPlane *two_plane,
   two_plane->DistortCoeffSecond.crpix1 = xrefpix;
   two_plane->DistortCoeffSecond.crpix2 = yrefpix;
   two_plane->second_distorted = 1;
+  setup_inverse(&(two_plane->DistortCoeffSecond), two_plane->naxis1_2, two_plane->naxis2_2);
   
   return 0;
 }
@@ -762,6 +1031,8 @@ int Initialize_TwoPlane(struct TwoPlane *two_plane, struct WorldCoor *wcs, struc
 
   strcpy(two_plane->projection_type_1,wcs->ptype);
   strcpy(two_plane->projection_type_2,WCS->ptype);
+  two_plane->proj_code_1 = proj_code(two_plane->projection_type_1);
+  two_plane->proj_code_2 = proj_code(two_plane->projection_type_2);
   
   two_plane->initialized = 1;
   two_plane->first_distorted = 0;
@@ -785,3 +1056,15 @@ int Initialize_TwoPlane(struct TwoPlane *two_plane, struct WorldCoor *wcs, struc
     
   return 0;
 }
+
+
+static int proj_code(char *ptype){
+
+  if(!strcmp(ptype,"TAN")) return PROJ_TAN;
+  if(!strcmp(ptype,"SIN")) return PROJ_SIN;
+  if(!strcmp(ptype,"ZEA")) return PROJ_ZEA;
+  if(!strcmp(ptype,"STG")) return PROJ_STG;
+  if(!strcmp(ptype,"ARC")) return PROJ_ARC;
+
+  return PROJ_OTHER;
+}
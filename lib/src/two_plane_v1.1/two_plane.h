@@ -14,6 +14,16 @@
 #endif
 #define	PI180                   0.0174532925199433
 #define Epsilon                 0.00000000000000000000001
+
+/* projection codes, cached so the row transform doesn't strcmp() */
+#define PROJ_TAN                0
+#define PROJ_SIN                1
+#define PROJ_ZEA                2
+#define PROJ_STG                3
+#define PROJ_ARC                4
+#define PROJ_OTHER              5
+
+#define TWO_PLANE_CHUNK         DIST_CHUNK
 struct TwoPlane{
   char projection_type_1[4];
   char projection_type_2[4];
@@ -58,12 +68,17 @@ struct TwoPlane{
   double invcd2_12;
   double invcd2_21;
   double invcd2_22;
+  int proj_code_1;
+  int proj_code_2;
 };
 
 int plane1_to_plane2_transform(double x_in, double y_in, double *x_out, double *y_out, 
 	      struct TwoPlane *two_plane);
 int plane2_to_plane1_transform(double x_in, double y_in, double *x_out, double *y_out, 
 		      struct TwoPlane *two_plane);
+int plane1_to_plane2_transform_row(int n, double *x_in, double *y_in,
+                                   double *x_out, double *y_out, int *status,
+                                   struct TwoPlane *two_plane);
 int Initialize_TwoPlane(struct TwoPlane *two_plane, struct WorldCoor *wcs, struct WorldCoor *WCS);
 
 int Initialize_TwoPlane_FirstDistort(struct TwoPlane *two_plane, 
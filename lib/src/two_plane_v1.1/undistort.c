@@ -7,6 +7,8 @@ void undistort(double u, double v, DistCoeff coeff, double *x, double *y)
   m = coeff.A_ORDER;
   n = coeff.B_ORDER;
 
+  s[0] = 0.;
+
   temp_u = u - coeff.crpix1;
   temp_v = v - coeff.crpix2;
   /* compute u */
@@ -42,3 +44,33 @@ void undistort(double u, double v, DistCoeff coeff, double *x, double *y)
 /*   *x = u + *x + coeff.crpix1; */
 /*   *y = v + *y + coeff.crpix2; */
 }
+
+
+/* Row version of undistort(); see distort_row().  x,y must not */
+/* overlap u,v.                                                 */
+
+void undistort_row(int n, double *u, double *v, DistCoeff *coeff, double *x, double *y)
+{
+  int i, i0, nc;
+  double tu[DIST_CHUNK], tv[DIST_CHUNK], col[DIST_CHUNK];
+  double sx[DIST_CHUNK], sy[DIST_CHUNK];
+
+  for (i0=0; i0<n; i0+=DIST_CHUNK) {
+    nc = n - i0;
+    if (nc > DIST_CHUNK)
+      nc = DIST_CHUNK;
+
+    for (i=0; i<nc; i++) {
+      tu[i] = u[i0+i] - coeff->crpix1;
+      tv[i] = v[i0+i] - coeff->crpix2;
+    }
+
+    sip_poly_row(nc, coeff->A, coeff->A_ORDER, tu, tv, sx, col);
+    sip_poly_row(nc, coeff->B, coeff->B_ORDER, tu, tv, sy, col);
+
+    for (i=0; i<nc; i++) {
+      x[i0+i] = u[i0+i] + sx[i];
+      y[i0+i] = v[i0+i] + sy[i];
+    }
+  }
+}
@@ -14,6 +14,9 @@ Version  Developer        Date     Change
 #include <string.h>
 #include <math.h>
 #include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include <mtbl.h>
 #include <fitsio.h>
@@ -23,10 +26,17 @@ Version  Developer        Date     Change
 #define MAXSTR  256
 #define MAXFILE 256
 
+#define BLOCKROWS  4096
+#define READRECS  65536
+
 int    parseLine     (char *line);
 int    readTemplate  (char *filename);
 void   printFitsError(int);
 void   printError    (char *);
+long   tiledMap      (char *input_file, char *output_file, char *template_file,
+                      int isImg, int haveFlux, int ismag, double refmag,
+                      int *cols, int fluxcol, double weights[5][5],
+                      int csys, double equinox, double pixscale);
 
 char  *tval(int);
 
@@ -39,9 +49,75 @@ struct
    struct WorldCoor *wcs;
    int               sys;
    double            epoch;
+   char             *header;
 }
    output;
 
+
+/* Tiled mode:  the output is split into full-width row bands (which   */
+/* are contiguous in the FITS file).  A first streaming pass finds the */
+/* bands each table row reaches (projecting the rows in parallel) and  */
+/* bins the rows themselves (ra, dec, flux) by band into a spill file. */
+/* A second pass rebuilds the bands in parallel, projecting and        */
+/* spreading each band's rows into that band only, and writes each one */
+/* with a single sequential FITS write.  Rows are kept in table order  */
+/* throughout, so the result is the same as the single-array version.  */
+
+struct Block
+{
+   int             state;       /* 0 free, 1 queued, 2 working, 3 done */
+   int             nrow;
+   double         *in;
+   long           *bandlo;
+   long           *bandhi;
+};
+
+#define BLOCK_FREE    0
+#define BLOCK_QUEUED  1
+#define BLOCK_WORKING 2
+#define BLOCK_DONE    3
+
+struct
+{
+   int              nthread;
+   long             bandrows;
+   long             nband;
+   long             budget;
+
+   int              isImg;
+   int              ismag;
+   double           refmag;
+   int              csys;
+   double           equinox;
+   double           pixscale;
+   double           weights[5][5];
+   int              ninval;
+
+   struct Block    *block;
+   int              nblock;
+   int              quit;
+
+   double         **buf;
+   long            *nbuf;
+   long            *maxbuf;
+   long             nbuffered;
+
+   long           **chunkoff;
+   long           **chunkcnt;
+   long            *nchunk;
+   long            *maxchunk;
+
+   FILE            *spill;
+   char             spillfile[MAXSTR];
+
+   long             nextband;
+   long             nextwrite;
+
+   pthread_mutex_t  mutex;
+   pthread_cond_t   cond;
+}
+   tile;
+
 static time_t currtime, start;
 
 extern char *optarg;
@@ -69,7 +145,8 @@ double ycorrection;
 
 int main(int argc, char **argv)
 {
-   int       i, j, l, m, c, count, ismag, ncol;
+   int       i, j, l, m, c, ismag, ncol;
+   long      count;
    int       dl, dm, width, haveFlux, isImg, csys;
    int       side, ibegin, iend, nstep, useCenter;
    int       racol, deccol, fluxcol;
@@ -137,6 +214,10 @@ int main(int argc, char **argv)
    double    sumweights;
    double    refmag;
 
+   int       tiled, nthread, cols[10];
+   long      bandrows, budget;
+   char     *end;
+
    dtr = atan(1.0)/45.;
 
 
@@ -149,12 +230,41 @@ int main(int argc, char **argv)
 
    useCenter = 0;
 
+   tiled    = 0;
+   nthread  = 4;
+   bandrows = 0;
+   budget   = 1024;
+
    strcpy(colname, "");
 
-   while ((c = getopt(argc, argv, "pm:d:w:c:")) != EOF) 
+   while ((c = getopt(argc, argv, "pm:d:w:c:n:t:M:")) != EOF) 
    {
       switch (c) 
       {
+         case 'n':
+            tiled   = 1;
+            nthread = strtol(optarg, &end, 10);
+
+            if(end < optarg + strlen(optarg) || nthread < 1)
+               printError("Thread count (-n) must be a positive integer");
+            break;
+
+         case 't':
+            tiled    = 1;
+            bandrows = strtol(optarg, &end, 10);
+
+            if(end < optarg + strlen(optarg) || bandrows < 1)
+               printError("Tile height (-t) must be a positive integer");
+            break;
+
+         case 'M':
+            tiled  = 1;
+            budget = strtol(optarg, &end, 10);
+
+            if(end < optarg + strlen(optarg) || budget < 1)
+               printError("Memory budget (-M, in MB) must be a positive integer");
+            break;
+
          case 'm':
 	    ismag = 1;
 	    refmag = atof(optarg);
@@ -177,7 +287,7 @@ int main(int argc, char **argv)
             break;
 
          default:
-	    printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-c column][-m refmag][-d level][-w size] in.tbl out.fits hdr.template\"]\n", argv[0]);
+	    printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-c column][-m refmag][-d level][-w size][-n threads][-t tilerows][-M memMB] in.tbl out.fits hdr.template\"]\n", argv[0]);
             exit(1);
             break;
       }
@@ -185,7 +295,7 @@ int main(int argc, char **argv)
 
    if (argc - optind < 3) 
    {
-      printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-c column][-m refmag][-d level][-w size] in.tbl out.fits hdr.template\"]\n", argv[0]);
+      printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-c column][-m refmag][-d level][-w size][-n threads][-t tilerows][-M memMB] in.tbl out.fits hdr.template\"]\n", argv[0]);
       exit(1);
    }
 
@@ -348,6 +458,39 @@ int main(int argc, char **argv)
    }
 
 
+   /*****************************************************/ 
+   /* For very large catalogs / images, build the image */ 
+   /* a tile (row band) at a time in bounded memory     */ 
+   /*****************************************************/ 
+
+   if(tiled)
+   {
+      tile.nthread  = nthread;
+      tile.bandrows = bandrows;
+      tile.budget   = budget * 1024L * 1024L;
+
+      cols[0] = racol;   cols[1] = deccol;
+      cols[2] = ra1col;  cols[3] = dec1col;
+      cols[4] = ra2col;  cols[5] = dec2col;
+      cols[6] = ra3col;  cols[7] = dec3col;
+      cols[8] = ra4col;  cols[9] = dec4col;
+
+      time(&currtime);
+      start = currtime;
+
+      count = tiledMap(input_file, output_file, template_file, isImg, haveFlux, ismag, refmag,
+                       cols, fluxcol, weights, csys, equinox, pixscale);
+
+      time(&currtime);
+
+      printf("[struct stat=\"OK\", time=%d, count=%ld, tiles=%ld]\n", 
+         (int)(currtime - start), count, tile.nband);
+      fflush(stdout);
+
+      exit(0);
+   }
+
+
    /***********************************************/ 
    /* Allocate memory for the output image pixels */ 
    /***********************************************/ 
@@ -433,7 +576,7 @@ int main(int argc, char **argv)
       {
 	 if(debug && count/1000*1000 == count)
 	 {
-	    printf("%9d image outlines processed\n", count);
+	    printf("%9ld image outlines processed\n", count);
 	    fflush(stdout);
 	 }
 
@@ -554,7 +697,7 @@ int main(int argc, char **argv)
       {
 	 if(debug && count/1000*1000 == count)
 	 {
-	    printf("%9d sources processed\n", count);
+	    printf("%9ld sources processed\n", count);
 	    fflush(stdout);
 	 }
 
@@ -701,6 +844,877 @@ int main(int argc, char **argv)
 }
 
 
+/**************************************************/
+/*                                                */
+/*  tiledMap                                      */
+/*                                                */
+/*  Build the output image in full-width row      */
+/*  bands ("tiles") under a memory budget.        */
+/*                                                */
+/*  Pass 1 streams the table: the main thread     */
+/*  reads blocks of rows, worker threads find     */
+/*  the bands each row reaches and the main       */
+/*  thread bins the rows (in table order) by      */
+/*  band, spilling the bins to disk as the        */
+/*  budget fills up.                              */
+/*                                                */
+/*  Pass 2 rebuilds the bands in parallel (no     */
+/*  more than one per thread in memory) from      */
+/*  their binned rows and writes each band, in    */
+/*  order, with a single FITS write.              */
+/*                                                */
+/*  Returns the number of table rows.             */
+/*                                                */
+/**************************************************/
+
+void *tileProject   (void *arg);
+void *tileAccumulate(void *arg);
+int   tileRow       (struct WorldCoor *wcs, double *in, long *mlo, long *mhi,
+                     double *data, long mbegin, long mend);
+void  tileBin       (struct Block *block);
+void  tileFlush     (void);
+
+long tiledMap(char *input_file, char *output_file, char *template_file,
+              int isImg, int haveFlux, int ismag, double refmag,
+              int *cols, int fluxcol, double weights[5][5],
+              int csys, double equinox, double pixscale)
+{
+   int        i, j, k, ib, ninval, status;
+   long       count, band, maxrows;
+   double     ilon, ilat;
+   double    *in;
+
+   struct stat tblstat;
+
+   pthread_t *thread;
+
+   struct WorldCoor **wcs;
+
+   struct Block *block;
+
+   int        bitpix = DOUBLE_IMG;
+   long       naxis  = 2;
+
+
+   ninval = 3;
+
+   if(isImg)
+      ninval = 9;
+
+   tile.isImg    = isImg;
+   tile.ismag    = ismag;
+   tile.refmag   = refmag;
+   tile.csys     = csys;
+   tile.equinox  = equinox;
+   tile.pixscale = pixscale;
+   tile.ninval   = ninval;
+
+   for(i=0; i<5; ++i)
+      for(j=0; j<5; ++j)
+         tile.weights[i][j] = weights[i][j];
+
+
+   /* tread() gives the same return at the end of the  */
+   /* table and on a read error; the file position     */
+   /* (compared to the file size) tells them apart     */
+
+   if(stat(input_file, &tblstat) < 0)
+      printError("Cannot stat input table");
+
+
+   /* Half the budget goes to the bands being accumulated */
+   /* (one per thread), half to the pass 1 binning        */
+
+   maxrows = tile.budget / 2 / (tile.nthread * output.naxes[0] * sizeof(double));
+
+   if(tile.bandrows == 0)
+      tile.bandrows = maxrows;
+
+   if(tile.bandrows < 1)
+      tile.bandrows = 1;
+
+   if(tile.bandrows > output.naxes[1])
+      tile.bandrows = output.naxes[1];
+
+   tile.nband = (output.naxes[1] + tile.bandrows - 1) / tile.bandrows;
+
+   if(debug >= 1)
+   {
+      printf("tiled mode: %d threads, %ld rows per tile, %ld tiles, %ld byte budget\n",
+         tile.nthread, tile.bandrows, tile.nband, tile.budget);
+      fflush(stdout);
+   }
+
+
+   /* Band bins and spill file */
+
+   tile.buf      = (double **)calloc(tile.nband, sizeof(double *));
+   tile.nbuf     = (long *)calloc(tile.nband, sizeof(long));
+   tile.maxbuf   = (long *)calloc(tile.nband, sizeof(long));
+
+   tile.chunkoff = (long **)calloc(tile.nband, sizeof(long *));
+   tile.chunkcnt = (long **)calloc(tile.nband, sizeof(long *));
+   tile.nchunk   = (long *)calloc(tile.nband, sizeof(long));
+   tile.maxchunk = (long *)calloc(tile.nband, sizeof(long));
+
+   if(tile.buf == (double **)NULL      || tile.chunkoff == (long **)NULL
+   || tile.chunkcnt == (long **)NULL   || tile.maxchunk == (long *)NULL)
+      printError("Cannot allocate tile bins");
+
+   tile.nbuffered = 0;
+
+   sprintf(tile.spillfile, "%s.spill", output_file);
+
+   tile.spill = fopen(tile.spillfile, "w+");
+
+   if(tile.spill == (FILE *)NULL)
+      printError("Cannot open tile spill file");
+
+   unlink(tile.spillfile);
+
+
+   /* One WCS structure per thread, and prime the */
+   /* coordinate library's cached transforms      */
+
+   wcs    = (struct WorldCoor **)malloc(tile.nthread * sizeof(struct WorldCoor *));
+   thread = (pthread_t *)malloc(tile.nthread * sizeof(pthread_t));
+
+   for(i=0; i<tile.nthread; ++i)
+   {
+      wcs[i] = wcsinit(output.header);
+
+      if(wcs[i] == (struct WorldCoor *)NULL)
+         printError("Output wcsinit() failed.");
+   }
+
+   convertCoordinates (EQUJ, 2000., 0., 0., csys, equinox, &ilon, &ilat, 0.);
+
+   pthread_mutex_init(&tile.mutex, NULL);
+   pthread_cond_init (&tile.cond,  NULL);
+
+
+   /**********/
+   /* Pass 1 */
+   /**********/
+
+   tile.nblock = 2 * tile.nthread;
+   tile.quit   = 0;
+
+   tile.block = (struct Block *)calloc(tile.nblock, sizeof(struct Block));
+
+   for(i=0; i<tile.nblock; ++i)
+   {
+      tile.block[i].in     = (double *)malloc(BLOCKROWS * ninval * sizeof(double));
+      tile.block[i].bandlo = (long *)malloc(BLOCKROWS * sizeof(long));
+      tile.block[i].bandhi = (long *)malloc(BLOCKROWS * sizeof(long));
+
+      if(tile.block[i].in == (double *)NULL
+      || tile.block[i].bandlo == (long *)NULL || tile.block[i].bandhi == (long *)NULL)
+         printError("Cannot allocate row blocks");
+   }
+
+   for(i=0; i<tile.nthread; ++i)
+      pthread_create(&thread[i], NULL, tileProject, (void *)wcs[i]);
+
+   count = 0;
+   ib    = 0;
+
+   while(1)
+   {
+      block = &tile.block[ib];
+
+
+      /* The slot we want is the oldest one in flight; */
+      /* wait for it and bin its rows                  */
+
+      if(block->state != BLOCK_FREE)
+      {
+         pthread_mutex_lock(&tile.mutex);
+
+         while(block->state != BLOCK_DONE)
+            pthread_cond_wait(&tile.cond, &tile.mutex);
+
+         pthread_mutex_unlock(&tile.mutex);
+
+         tileBin(block);
+
+         block->state = BLOCK_FREE;
+      }
+
+
+      /* Read the next set of rows */
+
+      block->nrow = 0;
+
+      while(block->nrow < BLOCKROWS)
+      {
+         if(tread() < 0)
+         {
+            if(ttell() < (long)tblstat.st_size)
+               printError("Error reading input table");
+
+            break;
+         }
+
+         in = block->in + block->nrow * ninval;
+
+         if(isImg)
+         {
+            for(k=0; k<8; ++k)
+               in[k] = atof(tval(cols[k+2]));
+         }
+         else
+         {
+            in[0] = atof(tval(cols[0]));
+            in[1] = atof(tval(cols[1]));
+         }
+
+         if(haveFlux)
+            in[ninval-1] = atof(tval(fluxcol));
+         else
+            in[ninval-1] = 1;
+
+         ++block->nrow;
+         ++count;
+
+         if(debug && count/1000*1000 == count)
+         {
+            if(isImg)
+               printf("%9ld image outlines processed\n", count);
+            else
+               printf("%9ld sources processed\n", count);
+
+            fflush(stdout);
+         }
+      }
+
+      if(block->nrow == 0)
+         break;
+
+      pthread_mutex_lock(&tile.mutex);
+
+      block->state = BLOCK_QUEUED;
+
+      pthread_cond_broadcast(&tile.cond);
+      pthread_mutex_unlock(&tile.mutex);
+
+      ib = (ib + 1) % tile.nblock;
+   }
+
+
+   /* Drain the blocks still in flight, oldest first */
+
+   for(k=0; k<tile.nblock; ++k)
+   {
+      block = &tile.block[(ib + k) % tile.nblock];
+
+      if(block->state == BLOCK_FREE)
+         continue;
+
+      pthread_mutex_lock(&tile.mutex);
+
+      while(block->state != BLOCK_DONE)
+         pthread_cond_wait(&tile.cond, &tile.mutex);
+
+      pthread_mutex_unlock(&tile.mutex);
+
+      tileBin(block);
+
+      block->state = BLOCK_FREE;
+   }
+
+   pthread_mutex_lock(&tile.mutex);
+
+   tile.quit = 1;
+
+   pthread_cond_broadcast(&tile.cond);
+   pthread_mutex_unlock(&tile.mutex);
+
+   for(i=0; i<tile.nthread; ++i)
+      pthread_join(thread[i], NULL);
+
+   tileFlush();
+
+   fflush(tile.spill);
+
+   for(i=0; i<tile.nblock; ++i)
+   {
+      free(tile.block[i].in);
+      free(tile.block[i].bandlo);
+      free(tile.block[i].bandhi);
+   }
+
+   free(tile.block);
+
+   for(band=0; band<tile.nband; ++band)
+      free(tile.buf[band]);
+
+   if(debug >= 1)
+   {
+      printf("Pass 1 done: %ld rows binned into %ld tiles\n", count, tile.nband);
+      fflush(stdout);
+   }
+
+
+   /************************/
+   /* Create the FITS file */
+   /************************/
+
+   status = 0;
+
+   remove(output_file);
+
+   if(fits_create_file(&output.fptr, output_file, &status))
+      printFitsError(status);
+
+   if (fits_create_img(output.fptr, bitpix, naxis, output.naxes, &status))
+      printFitsError(status);
+
+
+   /**********/
+   /* Pass 2 */
+   /**********/
+
+   tile.nextband  = 0;
+   tile.nextwrite = 0;
+
+   for(i=0; i<tile.nthread; ++i)
+      pthread_create(&thread[i], NULL, tileAccumulate, (void *)wcs[i]);
+
+   for(i=0; i<tile.nthread; ++i)
+      pthread_join(thread[i], NULL);
+
+   fclose(tile.spill);
+
+
+   /*************************************/
+   /* Add keywords from a template file */
+   /*************************************/
+
+   if(fits_write_key_template(output.fptr, template_file, &status))
+      printFitsError(status);
+
+   if(fits_close_file(output.fptr, &status))
+      printFitsError(status);
+
+   if(debug >= 1)
+   {
+      printf("FITS image finalized\n");
+      fflush(stdout);
+   }
+
+   for(i=0; i<tile.nthread; ++i)
+      wcsfree(wcs[i]);
+
+   free(wcs);
+   free(thread);
+
+   return count;
+}
+
+
+
+/**************************************************/
+/*                                                */
+/*  tileProject                                   */
+/*                                                */
+/*  Pass 1 worker: find the range of bands each   */
+/*  row in a block reaches (-1 if it misses the   */
+/*  image).                                       */
+/*                                                */
+/**************************************************/
+
+void *tileProject(void *arg)
+{
+   struct WorldCoor *wcs;
+   struct Block     *block;
+
+   int    k, row;
+   long   mlo, mhi;
+
+   wcs = (struct WorldCoor *)arg;
+
+   while(1)
+   {
+      pthread_mutex_lock(&tile.mutex);
+
+      block = (struct Block *)NULL;
+
+      while(1)
+      {
+         for(k=0; k<tile.nblock; ++k)
+         {
+            if(tile.block[k].state == BLOCK_QUEUED)
+            {
+               block = &tile.block[k];
+               break;
+            }
+         }
+
+         if(block || tile.quit)
+            break;
+
+         pthread_cond_wait(&tile.cond, &tile.mutex);
+      }
+
+      if(block == (struct Block *)NULL)
+      {
+         pthread_mutex_unlock(&tile.mutex);
+         return (void *)NULL;
+      }
+
+      block->state = BLOCK_WORKING;
+
+      pthread_mutex_unlock(&tile.mutex);
+
+
+      for(row=0; row<block->nrow; ++row)
+      {
+         block->bandlo[row] = -1;
+         block->bandhi[row] = -1;
+
+         if(tileRow(wcs, block->in + row * tile.ninval, &mlo, &mhi, (double *)NULL, 0, 0))
+         {
+            block->bandlo[row] = mlo / tile.bandrows;
+            block->bandhi[row] = mhi / tile.bandrows;
+         }
+      }
+
+      pthread_mutex_lock(&tile.mutex);
+
+      block->state = BLOCK_DONE;
+
+      pthread_cond_broadcast(&tile.cond);
+      pthread_mutex_unlock(&tile.mutex);
+   }
+}
+
+
+
+/**************************************************/
+/*                                                */
+/*  tileRow                                       */
+/*                                                */
+/*  Project one table row (the same arithmetic    */
+/*  as the single-array code in main()) and       */
+/*  return the range of image rows it touches in  */
+/*  mlo/mhi.  If a band is given, also spread the */
+/*  row into the band's pixels (image rows        */
+/*  mbegin to mend-1).                            */
+/*                                                */
+/*  Returns 1 if the row lands on the image,      */
+/*  0 if it does not.                             */
+/*                                                */
+/**************************************************/
+
+int tileRow(struct WorldCoor *wcs, double *in, long *mlo, long *mhi,
+            double *data, long mbegin, long mend)
+{
+   int       i, k, side, ibegin, iend, nstep, offscl, found;
+   int       l, m, dl, dm;
+   double    ra[4], dec[4];
+   double    rac, decc, ilon, ilat, oxpix, oypix, pixel_value;
+   double    x, y, z, x0, y0, z0, x1, y1, z1;
+   double    xn, yn, zn, ran, decn, len;
+   double    sina, cosa, sind, cosd;
+   double    a11, a12, a13, a21, a22, a23;
+   double    x0p, y0p, x1p, y1p;
+   double    lon0, lon1, lon, xp, yp, offset, dtr;
+
+   dtr = atan(1.0)/45.;
+
+   pixel_value = in[tile.ninval-1];
+
+
+   /* Point source, spread over +/- 2 pixels */
+
+   if(!tile.isImg)
+   {
+      rac  = in[0];
+      decc = in[1];
+
+      convertCoordinates (EQUJ,   2000.,    rac,   decc,
+                          tile.csys, tile.equinox, &ilon, &ilat, 0.);
+
+      if(tile.ismag)
+         pixel_value = pow(10., 0.4 * (tile.refmag - pixel_value));
+
+      wcs2pix(wcs, ilon, ilat, &oxpix, &oypix, &offscl);
+
+      if(pixel_value >= 1.e10 || offscl)
+         return 0;
+
+      l = (int)(oxpix + 0.5) - 1;
+      m = (int)(oypix + 0.5) - 1;
+
+      if(l < 0 || m < 0 || l >= output.naxes[0] || m >= output.naxes[1])
+         return 0;
+
+      *mlo = m - 2;
+      *mhi = m + 2;
+
+      if(*mlo < 0)                *mlo = 0;
+      if(*mhi >= output.naxes[1]) *mhi = output.naxes[1] - 1;
+
+      if(data == (double *)NULL)
+         return 1;
+
+      for(dl=-2; dl<=2; ++dl)
+      {
+         if(l+dl < 0 || l+dl>= output.naxes[0])
+            continue;
+
+         for(dm=-2; dm<=2; ++dm)
+         {
+            if(m+dm < mbegin || m+dm >= mend)
+               continue;
+
+            data[(m+dm-mbegin)*output.naxes[0] + l+dl] += tile.weights[dm+2][dl+2] * pixel_value;
+         }
+      }
+
+      return 1;
+   }
+
+
+   /* Image outline, traced a half pixel at a time */
+
+   found = 0;
+
+   for(k=0; k<4; ++k)
+   {
+      ra [k] = in[2*k];
+      dec[k] = in[2*k+1];
+   }
+
+   for(side=0; side<4; ++side)
+   {
+      ibegin = side;
+      iend   = (side+1)%4;
+
+      x0 = cos(ra[ibegin]*dtr) * cos(dec[ibegin]*dtr);
+      y0 = sin(ra[ibegin]*dtr) * cos(dec[ibegin]*dtr);
+      z0 = sin(dec[ibegin]*dtr);
+
+      x1 = cos(ra[iend]*dtr) * cos(dec[iend]*dtr);
+      y1 = sin(ra[iend]*dtr) * cos(dec[iend]*dtr);
+      z1 = sin(dec[iend]*dtr);
+
+      xn = y0*z1 - z0*y1;
+      yn = z0*x1 - x0*z1;
+      zn = x0*y1 - y0*x1;
+
+      len = sqrt(xn*xn + yn*yn + zn*zn);
+
+      xn = xn / len;
+      yn = yn / len;
+      zn = zn / len;
+
+      ran  = atan2(yn, xn);
+      decn = asin(zn);
+
+      sina = sin(ran);
+      cosa = cos(ran);
+
+      sind = sin(decn);
+      cosd = cos(decn);
+
+      a11 =  cosa*sind;
+      a12 =  sina*sind;
+      a13 = -cosd;
+      a21 = -sina;
+      a22 =  cosa;
+      a23 =  0.;
+
+      x0p =  a11*x0 + a12*y0 + a13*z0;
+      y0p =  a21*x0 + a22*y0 + a23*z0;
+
+      x1p =  a11*x1 + a12*y1 + a13*z1;
+      y1p =  a21*x1 + a22*y1 + a23*z1;
+
+      lon0 = atan2(y0p, x0p);
+      lon1 = atan2(y1p, x1p);
+
+      if(fabs(lon1-lon0)/dtr > 180.)
+      {
+         if(lon0 < 0.) lon0 += 360.*dtr;
+         if(lon1 < 0.) lon1 += 360.*dtr;
+      }
+
+      offset = tile.pixscale/2.*dtr;
+      if(lon0 > lon1)
+         offset = -offset;
+
+      nstep = (lon1 - lon0)/offset;
+
+      lon = lon0;
+      for(i=0; i<nstep; ++i)
+      {
+         lon += offset;
+
+         xp = cos(lon);
+         yp = sin(lon);
+
+         x = a11*xp + a21*yp;
+         y = a12*xp + a22*yp;
+         z = a13*xp + a23*yp;
+
+         rac  = atan2(y,x)/dtr;
+         decc = asin(z)/dtr;
+
+         convertCoordinates (EQUJ,   2000.,    rac,   decc,
+                             tile.csys, tile.equinox, &ilon, &ilat, 0.);
+
+         offscl = 0;
+
+         wcs2pix(wcs, ilon, ilat, &oxpix, &oypix, &offscl);
+
+         fixxy(&oxpix, &oypix, &offscl);
+
+         l = (int)(oxpix + 0.5) - 1;
+         m = (int)(oypix + 0.5) - 1;
+
+         if(offscl || l < 0 || m < 0 || l >= output.naxes[0] || m >= output.naxes[1])
+            continue;
+
+         if(!found)
+         {
+            *mlo  = m;
+            *mhi  = m;
+            found = 1;
+         }
+
+         if(m < *mlo) *mlo = m;
+         if(m > *mhi) *mhi = m;
+
+         if(data != (double *)NULL && m >= mbegin && m < mend)
+            data[(m-mbegin)*output.naxes[0] + l] = pixel_value;
+      }
+   }
+
+   return found;
+}
+
+
+
+/**************************************************/
+/*                                                */
+/*  tileBin                                       */
+/*                                                */
+/*  Append each row of a block to the bins of     */
+/*  every band it reaches.                        */
+/*                                                */
+/**************************************************/
+
+void tileBin(struct Block *block)
+{
+   long    row, band;
+   double *in;
+
+   for(row=0; row<block->nrow; ++row)
+   {
+      if(block->bandlo[row] < 0)
+         continue;
+
+      in = block->in + row * tile.ninval;
+
+      for(band=block->bandlo[row]; band<=block->bandhi[row]; ++band)
+      {
+         if(tile.nbuf[band] >= tile.maxbuf[band])
+         {
+            if(tile.maxbuf[band] == 0)
+               tile.maxbuf[band] = 256;
+            else
+               tile.maxbuf[band] += tile.maxbuf[band];
+
+            tile.buf[band] = (double *)realloc(tile.buf[band], tile.maxbuf[band] * tile.ninval * sizeof(double));
+
+            if(tile.buf[band] == (double *)NULL)
+               printError("Cannot allocate tile bin");
+         }
+
+         memcpy(tile.buf[band] + tile.nbuf[band] * tile.ninval, in, tile.ninval * sizeof(double));
+
+         ++tile.nbuf[band];
+         ++tile.nbuffered;
+      }
+
+      if(tile.nbuffered * tile.ninval * (long)sizeof(double) > tile.budget / 2)
+         tileFlush();
+   }
+}
+
+
+
+/**************************************************/
+/*                                                */
+/*  tileFlush                                     */
+/*                                                */
+/*  Write every non-empty bin to the spill file   */
+/*  as one chunk and remember where it went.      */
+/*                                                */
+/**************************************************/
+
+void tileFlush()
+{
+   long band;
+
+   for(band=0; band<tile.nband; ++band)
+   {
+      if(tile.nbuf[band] == 0)
+         continue;
+
+      if(tile.nchunk[band] >= tile.maxchunk[band])
+      {
+         if(tile.maxchunk[band] == 0)
+            tile.maxchunk[band] = 16;
+         else
+            tile.maxchunk[band] += tile.maxchunk[band];
+
+         tile.chunkoff[band] = (long *)realloc(tile.chunkoff[band], tile.maxchunk[band] * sizeof(long));
+         tile.chunkcnt[band] = (long *)realloc(tile.chunkcnt[band], tile.maxchunk[band] * sizeof(long));
+
+         if(tile.chunkoff[band] == (long *)NULL || tile.chunkcnt[band] == (long *)NULL)
+            printError("Cannot allocate tile chunk list");
+      }
+
+      tile.chunkoff[band][tile.nchunk[band]] = (long)ftello(tile.spill);
+      tile.chunkcnt[band][tile.nchunk[band]] = tile.nbuf[band];
+
+      ++tile.nchunk[band];
+
+      if(fwrite(tile.buf[band], tile.ninval * sizeof(double), tile.nbuf[band], tile.spill) != tile.nbuf[band])
+         printError("Error writing tile spill file");
+
+      tile.nbuf[band] = 0;
+   }
+
+   tile.nbuffered = 0;
+}
+
+
+
+/**************************************************/
+/*                                                */
+/*  tileAccumulate                                */
+/*                                                */
+/*  Pass 2 worker: build one band at a time from  */
+/*  its spilled rows and write it when its turn   */
+/*  comes.                                        */
+/*                                                */
+/**************************************************/
+
+void *tileAccumulate(void *arg)
+{
+   long    band, mbegin, mend, nrows, chunk, nread, nleft, i;
+   long    fpixel, nelements, reclen, mlo, mhi;
+   int     fd, status;
+   double *data, *recs, *rec;
+
+   struct WorldCoor *wcs;
+
+   wcs = (struct WorldCoor *)arg;
+
+   fd = fileno(tile.spill);
+
+   reclen = tile.ninval * sizeof(double);
+
+   recs = (double *)malloc(READRECS * reclen);
+
+   if(recs == (double *)NULL)
+      printError("Cannot allocate tile read buffer");
+
+   while(1)
+   {
+      pthread_mutex_lock(&tile.mutex);
+
+      band = tile.nextband;
+
+      ++tile.nextband;
+
+      pthread_mutex_unlock(&tile.mutex);
+
+      if(band >= tile.nband)
+         break;
+
+      mbegin = band * tile.bandrows;
+      mend   = mbegin + tile.bandrows;
+
+      if(mend > output.naxes[1])
+         mend = output.naxes[1];
+
+      nrows = mend - mbegin;
+
+      data = (double *)calloc(nrows * output.naxes[0], sizeof(double));
+
+      if(data == (double *)NULL)
+         printError("Cannot allocate tile pixels");
+
+      for(chunk=0; chunk<tile.nchunk[band]; ++chunk)
+      {
+         nleft = tile.chunkcnt[band][chunk];
+
+         i = 0;
+
+         while(nleft > 0)
+         {
+            nread = nleft;
+
+            if(nread > READRECS)
+               nread = READRECS;
+
+            if(pread(fd, recs, nread * reclen, (off_t)(tile.chunkoff[band][chunk] + i * reclen))
+               != nread * reclen)
+               printError("Error reading tile spill file");
+
+            for(rec=recs; rec<recs+nread*tile.ninval; rec+=tile.ninval)
+               tileRow(wcs, rec, &mlo, &mhi, data, mbegin, mend);
+
+            i     += nread;
+            nleft -= nread;
+         }
+      }
+
+
+      /* Bands go out in order, one write each */
+
+      pthread_mutex_lock(&tile.mutex);
+
+      while(tile.nextwrite != band)
+         pthread_cond_wait(&tile.cond, &tile.mutex);
+
+      pthread_mutex_unlock(&tile.mutex);
+
+      status    = 0;
+      fpixel    = mbegin * output.naxes[0] + 1;
+      nelements = nrows  * output.naxes[0];
+
+      if (fits_write_img(output.fptr, TDOUBLE, fpixel, nelements, data, &status))
+         printFitsError(status);
+
+      if(debug >= 2)
+      {
+         printf("Tile %ld (rows %ld-%ld) written\n", band, mbegin+1, mend);
+         fflush(stdout);
+      }
+
+      free(data);
+
+      pthread_mutex_lock(&tile.mutex);
+
+      ++tile.nextwrite;
+
+      pthread_cond_broadcast(&tile.cond);
+      pthread_mutex_unlock(&tile.mutex);
+   }
+
+   free(recs);
+
+   return (void *)NULL;
+}
+
+
+
 /**************************************************/
 /*  Projections like CAR sometimes add an extra   */
 /*  360 degrees worth of pixels to the return     */
@@ -756,6 +1770,8 @@ int readTemplate(char *filename)
    header[0] = malloc(32768);
    header[1] = (char *)NULL;
 
+   strcpy(header[0], "");
+
 
    /********************************************************/
    /* Open the template file, read and parse all the lines */
@@ -871,7 +1887,7 @@ int readTemplate(char *filename)
    output.sys   = sys;
    output.epoch = epoch;
 
-   free(header[0]);
+   output.header = header[0];
 
    return 0;
 }
@@ -88,6 +88,111 @@ static char cstr[MAXLEN];
 int nextImg();
 int nextCorr();
 
+void removeFile(char *fname);
+void shrinkDone(int slot);
+void projDone  (int slot);
+void diffDone  (int slot);
+void bgDone    (int slot);
+void fitAdd    (int seq, char *line);
+
+void  bufHash       (unsigned char *buf, int n, unsigned long long *hash);
+int   fileHash      (char *fname, unsigned long long *hash);
+int   fileExists    (char *fname);
+char *copyStr       (char *str);
+void  projName      (char *infile, char *outfile);
+int   readManifest  (char *fname, char *tmplHash);
+int   writeManifest (char *fname, char *tmplHash);
+char *prevHash      (char *fname);
+void  addTouched    (char *fname);
+int   isTouched     (char *fname);
+int   listTouched   (char *tblfile);
+void  loadPrevImages(char *tblfile);
+void  loadPrevFits  (char *tblfile);
+void  loadPrevCorrs (char *tblfile);
+char *prevFit       (char *fname1, char *fname2);
+int   prevCorr      (char *fname, double *a, double *b, double *c);
+int   writeInitCorrs(char *imgtbl, char *outtbl);
+int   corrReuse     (char *fname, char *astr, char *bstr, char *cstr, double xsize, double ysize);
+
+
+/* Children run through the svc job pool.  Each running */
+/* child has an entry here, indexed by its pool slot.   */
+
+#define MDIFF     0
+#define MFITPLANE 1
+
+struct ExecJob
+{
+   int  stage;               /* MDIFF or MFITPLANE (chained jobs)       */
+   int  seq;                 /* Output order of this job's fit record   */
+   int  cntr1;
+   int  cntr2;
+   int  nocorr;              /* mBackground with no correction found    */
+   char name   [MAXLEN];     /* Table file name (for messages)          */
+   char outfile[MAXLEN];     /* Output image                            */
+   char next   [MAXLEN];     /* Command to run when this one finishes   */
+   char remove [MAXLEN];     /* File (and its _area) to delete when done */
+   char althdr [MAXLEN];     /* Per-job alternate input header          */
+};
+
+static struct ExecJob *job;
+
+static int   njobs;
+
+static int   nproject, count, failed, nooverlap, nocorrection, nimages;
+
+static char  goodFile[MAXLEN];
+
+static FILE  *ffits;             /* Fit records are written in table order */
+static char **fitLine;
+static int    nfitLine;
+static int    maxfitLine;
+static int    nextLine;
+
+
+/* Incremental mode.  The manifest lists the content hash of   */
+/* every raw image (plus one for the template and processing   */
+/* options); anything whose hash has changed, and everything   */
+/* downstream of it, is "touched" and gets rebuilt.  The rest  */
+/* is reused from the previous run's tables and files.         */
+
+#define CORRTOL 0.1
+
+struct Manifest
+{
+   char *fname;              /* Raw image file name                     */
+   char  hash[17];           /* FNV-1a hash of its contents             */
+};
+
+static struct Manifest *prev, *curr;
+static int    nprev, ncurr, maxcurr;
+
+static char **touched;           /* Projected file names to be rebuilt  */
+static int    ntouched, maxtouched;
+
+static char **prevImage;         /* Previous pimages.tbl cntr -> fname  */
+static int    nprevImage;
+
+struct PrevFit
+{
+   char *fname1;
+   char *fname2;
+   char *rest;               /* Fit record after the two cntr columns   */
+};
+
+static struct PrevFit *prevFits;
+static int    nprevFit;
+static double prevRms;           /* Average rms of the previous fits    */
+
+struct PrevCorr
+{
+   char  *fname;
+   double a, b, c;
+};
+
+static struct PrevCorr *prevCorrs;
+static int    nprevCorr;
+
 
 /*************************************************************************/
 /*                                                                       */
@@ -137,6 +242,9 @@ int nextCorr();
 /*                                 (either -f or -h must exist)          */
 /*  -n tilecount     no tiling    Make an NxM set of tiles instead of    */
 /*  -m tilecount                   one big mosaic (and no PNGs)          */
+/*  -j njobs         1            Number of mShrink, mProject, mDiff/    */
+/*                                 mFitplane or mBackground children to  */
+/*                                 run at once                           */
 /*  -s factor        1 (none)     "Shrink" the input image pixels prior  */
 /*                                 to reprojection.  Saves time if the   */
 /*                                 output is much lower resolution than  */
@@ -162,6 +270,11 @@ int nextCorr();
 /*  -O loctext       none         Location string text                   */
 /*  -M contact       none         "Contact" string text                  */
 /*  -x               0 (false)    Add a location marker to the PNG       */
+/*  -I               0 (false)    Incremental: rerun in a workspace from */
+/*                                 an earlier run, reprocessing only the */
+/*                                 images that are new or have changed   */
+/*                                 and the overlaps, corrections and     */
+/*                                 tiles they touch (implies -k)         */
 /*                                                                       */
 /*                                                                       */
 /*  So minimal calls would look like:                                    */
@@ -197,13 +310,14 @@ int nextCorr();
 
 int main(int argc, char **argv, char **envp)
 {
-   int    i, j, k, ch, index, baseCount, count, sys, ival;
-   int    ncols, ifname, failed, nocorrection, nooverlap, istat;
-   int    flag, noverlap, nimages, ntile, mtile;
+   int    i, j, k, ch, baseCount, sys, ival, slot, seq;
+   int    ncols, ifname, istat;
+   int    flag, noverlap, ntile, mtile;
    int    naxis1, naxis2, naxismax, nxtile, nytile;
    int    intan, outtan, iscale, ncell, local2MASS;
    int    keepAll, deleteAll, noSubset, infoMsg, levelOnly;
    int    ftmp, userRaw, showMarker, quickMode;
+   int    incremental, nreused, ntileAdd, redo;
 
    double val, factor, shrink;
 
@@ -235,6 +349,10 @@ int main(int argc, char **argv, char **envp)
    char   fname1     [MAXLEN];
    char   fname2     [MAXLEN];
    char   diffname   [MAXLEN];
+   char   fitline    [MAXLEN];
+   char   tmplHash   [32];
+   char   tilefile   [MAXLEN];
+   char   althdr     [MAXLEN];
    char   areafile   [MAXLEN];
    char   survey     [MAXLEN];
    char   hostName   [MAXLEN];
@@ -251,25 +369,6 @@ int main(int argc, char **argv, char **envp)
    char   locText    [MAXLEN];
    char   contactText[MAXLEN];
 
-   double a;
-   double b;
-   double c;
-   double crpix1;
-   double crpix2;
-   int    xmin;
-   int    xmax;
-   int    ymin;
-   int    ymax;
-   double xcenter;
-   double ycenter;
-   double npixel;
-   double rms;
-   double boxx;
-   double boxy;
-   double boxwidth;
-   double boxheight;
-   double boxangle;
-
    double scale;
 
    double error, maxerror;
@@ -286,7 +385,6 @@ int main(int argc, char **argv, char **envp)
    char   infile    [MAXLEN];
    char   outfile   [MAXLEN];
    char   path      [MAXLEN];
-   char   goodFile  [MAXLEN];
 
    char   locstr    [MAXLEN];
    char   radstr    [MAXLEN];
@@ -302,6 +400,10 @@ int main(int argc, char **argv, char **envp)
 
    double allowedError;
 
+   unsigned long long hash;
+
+   char  *fitrest;
+
    double ra[4], dec[4];
    double rac, decc;
    double x1, y1, z1;
@@ -359,8 +461,11 @@ int main(int argc, char **argv, char **envp)
    userRaw    = 0;
    ntile      = 0;
    mtile      = 0;
+   njobs      = 1;
    local2MASS = 0;
    quickMode  = 0;
+   incremental= 0;
+   nreused    = 0;
 
    shrink     = 1.0;
 
@@ -369,7 +474,7 @@ int main(int argc, char **argv, char **envp)
    debug  = 0;
    opterr = 0;
 
-   while ((ch = getopt(argc, argv, "ilkcaxqSh:f:o:d:D:e:r:s:n:m:L:O:M:")) != EOF)
+   while ((ch = getopt(argc, argv, "ilkcaxqSIh:f:o:d:D:e:r:s:n:m:j:L:O:M:")) != EOF)
    {
       switch (ch)
       {
@@ -413,6 +518,13 @@ int main(int argc, char **argv, char **envp)
             mtile = atoi(optarg);
             break;
 
+         case 'j':
+            njobs = atoi(optarg);
+
+            if(njobs < 1)
+               njobs = 1;
+            break;
+
          case 'e':
             allowedError = atof(optarg);
             break;
@@ -481,13 +593,29 @@ int main(int argc, char **argv, char **envp)
             local2MASS = 1;
             break;
 
+         case 'I':
+            incremental = 1;
+            break;
+
          default:
-            printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-q(uick-mode)][-r rawdir][-n ntilex][-m ntiley][-l(evel only)][-k(eep all)][-c(lean)][-s shrinkFactor][-o output.fits][-d(ebug) level][-f region.hdr | -h header] survey band [workspace-dir]\"]\n", argv[0]);
+            printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-q(uick-mode)][-I(ncremental)][-r rawdir][-n ntilex][-m ntiley][-j njobs][-l(evel only)][-k(eep all)][-c(lean)][-s shrinkFactor][-o output.fits][-d(ebug) level][-f region.hdr | -h header] survey band [workspace-dir]\"]\n", argv[0]);
             exit(1);
             break;
       }
    }
 
+   /* An incremental workspace is its own cache */
+
+   if(incremental)
+   {
+      keepAll   = 1;
+      deleteAll = 0;
+   }
+
+   svc_pool_init(njobs);
+
+   job = (struct ExecJob *)malloc(njobs * sizeof(struct ExecJob));
+
    if(infoMsg)
    {
       printf("[struct stat=\"INFO\", msg=\"Compute node: %s\"]\n",  hostName);
@@ -520,7 +648,7 @@ int main(int argc, char **argv, char **envp)
 
    if (!userRaw && argc - optind < 2)
    {
-      printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-q(uick-mode)][-r rawdir][-n ntile][-m ntiley][-l(evel only)][-k(eep all)][-c(lean)][-s shrinkFactor][-o output.fits][-d(ebug) level][-f region.hdr | -h header] survey band [workspace-dir]\"]\n", argv[0]);
+      printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-q(uick-mode)][-I(ncremental)][-r rawdir][-n ntile][-m ntiley][-l(evel only)][-k(eep all)][-c(lean)][-s shrinkFactor][-o output.fits][-d(ebug) level][-f region.hdr | -h header] survey band [workspace-dir]\"]\n", argv[0]);
       exit(1);
    }
 
@@ -714,7 +842,8 @@ int main(int argc, char **argv, char **envp)
      fprintf(fdebug, "workspace   = [%s]\n",  workspace);
      fprintf(fdebug, "levelOnly   =  %d\n",   levelOnly);
      fprintf(fdebug, "keepAll     =  %d\n",   keepAll);
-     fprintf(fdebug, "deleteAll   =  %d\n\n", deleteAll);
+     fprintf(fdebug, "deleteAll   =  %d\n",   deleteAll);
+     fprintf(fdebug, "incremental =  %d\n\n", incremental);
      fprintf(fdebug, "cwd         = [%s]\n",  cwd);
      fflush(fdebug);
    }
@@ -736,36 +865,97 @@ int main(int argc, char **argv, char **envp)
 
    if(!userRaw)
    {
-      if(mkdir(rawdir, 0775) < 0)
+      if(mkdir(rawdir, 0775) < 0 && !(incremental && errno == EEXIST))
          flag = 1;
    }
 
-   if(mkdir("projected", 0775) < 0)
+   if(mkdir("projected", 0775) < 0 && !(incremental && errno == EEXIST))
       flag = 1;
 
-   if(mkdir("diffs", 0775) < 0)
+   if(mkdir("diffs", 0775) < 0 && !(incremental && errno == EEXIST))
       flag = 1;
 
-   if(mkdir("corrected", 0775) < 0)
+   if(mkdir("corrected", 0775) < 0 && !(incremental && errno == EEXIST))
       flag = 1;
 
    if(shrink != 1)
    {
-      if(mkdir("shrunken", 0775) < 0)
+      if(mkdir("shrunken", 0775) < 0 && !(incremental && errno == EEXIST))
          flag = 1;
    }
 
    if(ntile*mtile > 1)
    {
-      if(mkdir("tiles", 0775) < 0)
+      if(mkdir("tiles", 0775) < 0 && !(incremental && errno == EEXIST))
          flag = 1;
 
-      if(mkdir("tmp", 0775) < 0)
+      if(mkdir("tmp", 0775) < 0 && !(incremental && errno == EEXIST))
          flag = 1;
    }
 
    if(flag)
       printerr("Can't create proper subdirectories in workspace (may already exist)");
+
+
+   /***************************************************/
+   /* In incremental mode, find out what the previous */
+   /* run left us.  The template hash covers the      */
+   /* header and every option that changes the        */
+   /* intermediate products; if it differs (or there  */
+   /* is no manifest) nothing can be reused and we    */
+   /* start from clean subdirectories.                */
+   /*                                                 */
+   /* The manifest is removed until this run is done, */
+   /* so an interrupted run forces a full rebuild.    */
+   /***************************************************/
+
+   if(incremental)
+   {
+      hash = 14695981039346656037ULL;
+
+      fileHash("region.hdr", &hash);
+
+      sprintf(temp, "quick=%d shrink=%-g level=%d tiles=%dx%d",
+         quickMode, shrink, levelOnly, ntile, mtile);
+
+      bufHash((unsigned char *)temp, strlen(temp), &hash);
+
+      sprintf(tmplHash, "%016llx", hash);
+
+      if(readManifest("manifest.tbl", tmplHash))
+      {
+         sprintf(cmd, "rm -rf projected/* diffs/* corrected/* shrunken/* tiles/* tmp/*");
+
+         if(debug >= 2)
+         {
+            fprintf(fdebug, "%s\n", cmd);
+            fflush(fdebug);
+         }
+
+         system(cmd);
+
+         unlink("pimages.tbl");
+         unlink("fits.tbl");
+         unlink("corrections.tbl");
+         unlink("cimages.tbl");
+         unlink("mosaic.fits");
+      }
+      else
+      {
+         rename("pimages.tbl",     "pimages_prev.tbl");
+         rename("fits.tbl",        "fits_prev.tbl");
+         rename("corrections.tbl", "corrections_prev.tbl");
+         rename("cimages.tbl",     "cimages_prev.tbl");
+      }
+
+      unlink("manifest.tbl");
+
+      if(debug >= 1)
+      {
+         fprintf(fdebug, "INCREMENTAL: %d images in previous manifest\n", nprev);
+         fflush(fdebug);
+      }
+   }
    
 
 
@@ -1313,6 +1503,101 @@ int main(int argc, char **argv, char **envp)
 
    iscale = tcol("scale");
 
+
+   /****************************************************/
+   /* Incremental: hash the raw images and compare     */
+   /* with the manifest.  Anything new or changed (or  */
+   /* gone) loses its old projected/corrected files    */
+   /* and starts out "touched".                        */
+   /****************************************************/
+
+   if(incremental)
+   {
+      ncurr   = 0;
+      maxcurr = 1024;
+
+      curr = (struct Manifest *)malloc(maxcurr * sizeof(struct Manifest));
+
+      while(1)
+      {
+         istat = tread();
+
+         if(istat < 0)
+            break;
+
+         strcpy(infile, tval(ifname));
+
+         if(strlen(infile) > 4 && strcmp(infile+strlen(infile)-4, ".bz2") == 0)
+            *(infile+strlen(infile)-4) = '\0';
+
+         hash = 14695981039346656037ULL;
+
+         if(fileHash(filePath(rawdir, infile), &hash))
+            continue;
+
+         if(ncurr >= maxcurr)
+         {
+            maxcurr += 1024;
+
+            curr = (struct Manifest *)realloc(curr, maxcurr * sizeof(struct Manifest));
+         }
+
+         curr[ncurr].fname = copyStr(infile);
+
+         sprintf(curr[ncurr].hash, "%016llx", hash);
+
+         if(prevHash(infile) == (char *)NULL
+         || strcmp(prevHash(infile), curr[ncurr].hash) != 0)
+         {
+            projName(infile, outfile);
+
+            sprintf(path, "projected/%s", outfile);
+            removeFile(path);
+
+            sprintf(path, "corrected/%s", outfile);
+            removeFile(path);
+
+            sprintf(path, "shrunken/%s", infile);
+            unlink(path);
+
+            addTouched(outfile);
+         }
+
+         ++ncurr;
+      }
+
+      tseek(0);
+
+      for(i=0; i<nprev; ++i)
+      {
+         for(j=0; j<ncurr; ++j)
+            if(strcmp(prev[i].fname, curr[j].fname) == 0)
+               break;
+
+         if(j < ncurr)
+            continue;
+
+         projName(prev[i].fname, outfile);
+
+         sprintf(path, "projected/%s", outfile);
+         removeFile(path);
+
+         sprintf(path, "corrected/%s", outfile);
+         removeFile(path);
+
+         sprintf(path, "shrunken/%s", prev[i].fname);
+         unlink(path);
+
+         addTouched(outfile);
+      }
+
+      if(debug >= 1)
+      {
+         fprintf(fdebug, "INCREMENTAL: %d images, %d new, changed or removed\n", ncurr, ntouched);
+         fflush(fdebug);
+      }
+   }
+
    time(&currtime);
 
    if(debug >= 1)
@@ -1411,6 +1696,16 @@ int main(int argc, char **argv, char **envp)
 
          strcpy ( infile, tval(ifname));
 
+         if(incremental)
+         {
+            projName(infile, outfile);
+
+            sprintf(path, "shrunken/%s", infile);
+
+            if(!isTouched(outfile) && fileExists(path))
+               continue;
+         }
+
          sprintf(cmd, "mShrink %s/%s shrunken/%s %-g", 
             rawdir, infile, infile, shrink);
 
@@ -1420,18 +1715,16 @@ int main(int argc, char **argv, char **envp)
             fflush(fdebug);
          }
 
-         svc_run(cmd);
-
-         strcpy( status, svc_value( "stat" ));
-
-         if(strcmp( status, "ERROR") == 0)
-         {
-            strcpy( msg, svc_value( "msg" ));
+         while(svc_pool_full())
+            shrinkDone(svc_pool_wait());
 
-            printerr(msg);
-         }
+         if(svc_pool_submit(cmd) < 0)
+            printerr("Cannot start mShrink");
       }
 
+      while(svc_pool_active())
+         shrinkDone(svc_pool_wait());
+
       tseek(0);
 
       strcpy(datadir, "shrunken");
@@ -1452,10 +1745,12 @@ int main(int argc, char **argv, char **envp)
    /* Read the records and call mProject/mProjectPP/mProjectQL */
    /************************************************************/ 
 
-   index     = 0;
+   nproject  = 0;
    failed    = 0;
    nooverlap = 0;
 
+   seq = 0;
+
    while(1)
    {
       istat = tread();
@@ -1468,32 +1763,28 @@ int main(int argc, char **argv, char **envp)
       if(strlen(infile) > 4 && strcmp(infile+strlen(infile)-4, ".bz2") == 0)
          *(infile+strlen(infile)-4) = '\0';
 
-      strcpy (outfile, infile);
-
-      if(strlen(outfile) > 3 && strcmp(outfile+strlen(outfile)-3, ".gz") == 0)
-         *(outfile+strlen(outfile)-3) = '\0';
+      projName(infile, outfile);
 
-      if(strlen(outfile) > 4 && strcmp(outfile+strlen(outfile)-4, ".fit") == 0)
-         strcat(outfile, "s");
 
+      /* In incremental mode an untouched image whose */
+      /* projection is still there needs nothing done */
 
-      if(strlen(outfile) > 5 &&
-         strncmp(outfile+strlen(outfile)-5, ".FITS", 5) == 0)
-            outfile[strlen(outfile)-5] = '\0';
+      if(incremental)
+      {
+         sprintf(path, "projected/%s", outfile);
 
-      else if(strlen(outfile) > 5 &&
-         strncmp(outfile+strlen(outfile)-5, ".fits", 5) == 0)
-            outfile[strlen(outfile)-5] = '\0';
+         if(!isTouched(outfile) && fileExists(path))
+         {
+            ++nproject;
+            ++nreused;
 
-      else if(strlen(outfile) > 4 &&
-         strncmp(outfile+strlen(outfile)-4, ".FIT", 4) == 0)
-            outfile[strlen(outfile)-4] = '\0';
+            strcpy(goodFile, outfile);
 
-      else if(strlen(outfile) > 4 &&
-         strncmp(outfile+strlen(outfile)-4, ".fit", 4) == 0)
-            outfile[strlen(outfile)-4] = '\0';
+            continue;
+         }
 
-      strcat(outfile, ".fits");
+         addTouched(outfile);
+      }
 
       if(iscale < 0)
          sprintf(scale_str, "1.0");
@@ -1506,6 +1797,8 @@ int main(int argc, char **argv, char **envp)
 
       intan = INTRINSIC;
 
+      sprintf(althdr, "altin_%d.hdr", seq);
+
       strcpy(path, filePath(datadir, infile));
 
       fitsstat = 0;
@@ -1555,7 +1848,7 @@ int main(int argc, char **argv, char **envp)
             printerr(msg);
          }
 
-         sprintf(cmd, "mTANHdr orig.hdr altin.hdr");
+         sprintf(cmd, "mTANHdr orig.hdr %s", althdr);
 
          if(debug >= 4)
          {
@@ -1634,12 +1927,12 @@ int main(int argc, char **argv, char **envp)
             scale_str, datadir, infile, outfile);
 
       else if(intan == COMPUTED  && outtan == COMPUTED )
-         sprintf(cmd, "mProjectPP -b 1 -i altin.hdr -o altout.hdr -x %s -X %s/%s projected/%s big_region.hdr",
-            scale_str, datadir, infile, outfile);
+         sprintf(cmd, "mProjectPP -b 1 -i %s -o altout.hdr -x %s -X %s/%s projected/%s big_region.hdr",
+            althdr, scale_str, datadir, infile, outfile);
 
       else if(intan == COMPUTED  && outtan == INTRINSIC)
-         sprintf(cmd, "mProjectPP -b 1 -i altin.hdr -x %s -X %s/%s projected/%s big_region.hdr",
-            scale_str, datadir, infile, outfile);
+         sprintf(cmd, "mProjectPP -b 1 -i %s -x %s -X %s/%s projected/%s big_region.hdr",
+            althdr, scale_str, datadir, infile, outfile);
 
       else if(intan == INTRINSIC && outtan == COMPUTED )
          sprintf(cmd, "mProjectPP -b 1 -o altout.hdr -x %s -X %s/%s projected/%s big_region.hdr",
@@ -1659,63 +1952,32 @@ int main(int argc, char **argv, char **envp)
          fflush(fdebug);
       }
 
-      svc_run(cmd);
-
-      strcpy( status, svc_value( "stat" ));
-
-      ++index;
-
-      if(strcmp( status, "ABORT") == 0)
-      {
-         strcpy( msg, svc_value( "msg" ));
-
-         printerr(msg);
-      }
-
-      else if(strcmp( status, "ERROR") == 0)
-      {
-         strcpy( msg, svc_value( "msg" ));
+      while(svc_pool_full())
+         projDone(svc_pool_wait());
 
-         if(strlen(msg) > 30)
-            msg[30] = '\0';
+      slot = svc_pool_submit(cmd);
 
-         if(strcmp( msg, "No overlap")           == 0
-         || strcmp( msg, "All pixels are blank") == 0)
-         {
-            ++nooverlap;
-            strcat(msg, ": ");
-            strcat(msg, tval(ifname));
-         }
-         else
-         {
-            ++failed;
-            strcat(msg, ": ");
-            strcat(msg, tval(ifname));
-         }
-      }
-      else
-      {
-         strcpy(goodFile, outfile);
+      if(slot < 0)
+         printerr("Cannot start mProject");
 
-         if(strlen(goodFile) > 3 && strcmp(goodFile+strlen(goodFile)-3, ".gz") == 0)
-            *(goodFile+strlen(goodFile)-3) = '\0';
+      strcpy(job[slot].name,    tval(ifname));
+      strcpy(job[slot].outfile, outfile);
+      strcpy(job[slot].althdr,  "");
+      strcpy(job[slot].remove,  "");
 
-         if(debug >= 3)
-         {
-            fprintf(fdebug, "%s took %s seconds (%3d of %3d)\n", 
-               tval(ifname), svc_value("time"), index, nimages);
-            fflush(fdebug);
-         }
-      }
+      if(intan == COMPUTED)
+         strcpy(job[slot].althdr, althdr);
 
       if(!keepAll && !userRaw)
-      {
-         strcpy(cmd, filePath(rawdir, infile));
-         unlink(cmd);
-      }
+         strcpy(job[slot].remove, filePath(rawdir, infile));
+
+      ++seq;
    }
 
-   baseCount = index - failed - nooverlap;
+   while(svc_pool_active())
+      projDone(svc_pool_wait());
+
+   baseCount = nproject - failed - nooverlap;
 
    time(&currtime);
 
@@ -1737,6 +1999,12 @@ int main(int argc, char **argv, char **envp)
 
    lasttime = currtime;
 
+   if(incremental && debug >= 1)
+   {
+      fprintf(fdebug, "INCREMENTAL: %d projections reused\n", nreused);
+      fflush(fdebug);
+   }
+
    tclose();
 
    unlink("altin.hdr");
@@ -1847,6 +2115,26 @@ int main(int argc, char **argv, char **envp)
 
 
 
+   /****************************************/ 
+   /* Incremental: load the previous run's */
+   /* fits and corrections                 */
+   /****************************************/ 
+
+   if(baseCount > 1 && incremental)
+   {
+      loadPrevImages("pimages_prev.tbl");
+      loadPrevFits  ("fits_prev.tbl");
+      loadPrevCorrs ("corrections_prev.tbl");
+
+      if(debug >= 1)
+      {
+         fprintf(fdebug, "INCREMENTAL: %d previous fits, %d previous corrections\n", nprevFit, nprevCorr);
+         fflush(fdebug);
+      }
+   }
+
+
+
    /***************************************/ 
    /* Open the difference list table file */
    /***************************************/ 
@@ -1874,9 +2162,17 @@ int main(int argc, char **argv, char **envp)
 
       count   = 0;
       failed  = 0;
+      nreused = 0;
 
       fout = fopen("fits.tbl", "w+");
 
+      ffits      = fout;
+      nfitLine   = 0;
+      nextLine   = 0;
+      maxfitLine = 1024;
+
+      fitLine = (char **)malloc(maxfitLine * sizeof(char *));
+
       fprintf(fout, "|   plus  |  minus  |         a      |        b       |        c       |    crpix1    |    crpix2    |   xmin   |   xmax   |   ymin   |   ymax   |   xcenter   |   ycenter   |    npixel   |      rms       |      boxx      |      boxy      |    boxwidth    |   boxheight    |     boxang     |\n");
       fflush(fout);
 
@@ -1903,40 +2199,32 @@ int main(int argc, char **argv, char **envp)
          strcpy(fname2,   tval(ifname2));
          strcpy(diffname, tval(idiffname));
 
-         if(quickMode)
-            sprintf(cmd, "mDiff -n projected/%s projected/%s diffs/%s big_region.hdr", fname1, fname2, diffname);
-         else
-            sprintf(cmd, "mDiff projected/%s projected/%s diffs/%s big_region.hdr", fname1, fname2, diffname);
 
-         if(debug >= 4)
+         /* In incremental mode the fit for an overlap */
+         /* between two untouched images is reused     */
+
+         if(incremental && !isTouched(fname1) && !isTouched(fname2))
          {
-            fprintf(fdebug, "[%s]\n", cmd);
-            fflush(fdebug);
-         }
+            fitrest = prevFit(fname1, fname2);
 
-         svc_run(cmd);
+            if(fitrest != (char *)NULL)
+            {
+               sprintf(fitline, " %9d %9d%s", cntr1, cntr2, fitrest);
 
-         strcpy( status, svc_value( "stat" ));
+               ++nfitLine;
 
-         if(strcmp( status, "ABORT") == 0)
-         {
-            strcpy( msg, svc_value( "msg" ));
+               fitAdd(nfitLine-1, fitline);
 
-            printf("[struct stat=\"ERROR\", msg=\"%s\"]\n", msg);
-            fflush(fdebug);
+               ++nreused;
 
-            exit(1);
+               continue;
+            }
          }
 
-         if(strcmp( status, "ERROR"  ) == 0
-         || strcmp( status, "WARNING") == 0)
-            ++failed;
-
-
-         if(levelOnly)
-            sprintf(cmd, "mFitplane -l diffs/%s", diffname);
+         if(quickMode)
+            sprintf(cmd, "mDiff -n projected/%s projected/%s diffs/%s big_region.hdr", fname1, fname2, diffname);
          else
-            sprintf(cmd, "mFitplane diffs/%s", diffname);
+            sprintf(cmd, "mDiff projected/%s projected/%s diffs/%s big_region.hdr", fname1, fname2, diffname);
 
          if(debug >= 4)
          {
@@ -1944,63 +2232,37 @@ int main(int argc, char **argv, char **envp)
             fflush(fdebug);
          }
 
-         svc_run(cmd);
-
-         strcpy( status, svc_value( "stat" ));
+         while(svc_pool_full())
+            diffDone(svc_pool_wait());
 
-         if(strcmp( status, "ABORT") == 0)
-         {
-            strcpy( msg, svc_value( "msg" ));
+         slot = svc_pool_submit(cmd);
 
-            printf("[struct stat=\"ERROR\", msg=\"%s\"]\n", msg);
-            fflush(stdout);
+         if(slot < 0)
+            printerr("Cannot start mDiff");
 
-            exit(1);
-         }
+         job[slot].stage = MDIFF;
+         job[slot].seq   = nfitLine;
+         job[slot].cntr1 = cntr1;
+         job[slot].cntr2 = cntr2;
 
-         if(strcmp( status, "ERROR")   == 0
-         || strcmp( status, "WARNING") == 0)
-            ++failed;
+         if(levelOnly)
+            sprintf(job[slot].next, "mFitplane -l diffs/%s", diffname);
          else
-         {
-            a         = atof(svc_value("a"));
-            b         = atof(svc_value("b"));
-            c         = atof(svc_value("c"));
-            crpix1    = atof(svc_value("crpix1"));
-            crpix2    = atof(svc_value("crpix2"));
-            xmin      = atoi(svc_value("xmin"));
-            xmax      = atoi(svc_value("xmax"));
-            ymin      = atoi(svc_value("ymin"));
-            ymax      = atoi(svc_value("ymax"));
-            xcenter   = atof(svc_value("xcenter"));
-            ycenter   = atof(svc_value("ycenter"));
-            npixel    = atof(svc_value("npixel"));
-            rms       = atof(svc_value("rms"));
-            boxx      = atof(svc_value("boxx"));
-            boxy      = atof(svc_value("boxy"));
-            boxwidth  = atof(svc_value("boxwidth"));
-            boxheight = atof(svc_value("boxheight"));
-            boxangle  = atof(svc_value("boxang"));
-
-            fprintf(fout, " %9d %9d %16.5e %16.5e %16.5e %14.2f %14.2f %10d %10d %10d %10d %13.2f %13.2f %13.0f %16.5e %16.1f %16.1f %16.1f %16.1f %16.1f \n",
-               cntr1, cntr2, a, b, c, crpix1, crpix2, xmin, xmax, ymin, ymax, 
-               xcenter, ycenter, npixel, rms, boxx, boxy, boxwidth, boxheight, boxangle);
-            fflush(fout);
-         }
+            sprintf(job[slot].next, "mFitplane diffs/%s", diffname);
 
-         if(!keepAll)
-         {
-            sprintf(cmd, "diffs/%s", diffname);
-            unlink(cmd);
+         if(keepAll)
+            strcpy(job[slot].remove, "");
+         else
+            sprintf(job[slot].remove, "diffs/%s", diffname);
 
-            strcpy(areafile, cmd);
-            areafile[strlen(areafile) - 5] = '\0';
-            strcat(areafile, "_area.fits");
+         fitAdd(nfitLine, (char *)NULL);
 
-            unlink(areafile);
-         }
+         ++nfitLine;
       }
 
+      while(svc_pool_active())
+         diffDone(svc_pool_wait());
+
       tclose();
 
       time(&currtime);
@@ -2010,6 +2272,9 @@ int main(int argc, char **argv, char **envp)
          fprintf(fdebug, "TIME: mDiff/mFitplane  %6d (%d diffs,  %d successful, %d failed)\n", 
             (int)(currtime - lasttime), count, count - failed,  failed);
 
+         if(incremental)
+            fprintf(fdebug, "INCREMENTAL: %d fits reused\n", nreused);
+
          fflush(fdebug);
       }
 
@@ -2028,13 +2293,26 @@ int main(int argc, char **argv, char **envp)
       else
          sprintf(cmd, "mBgModel -i 100000 pimages.tbl fits.tbl corrections.tbl");
 
-      if(debug >= 4)
-      {
-         fprintf(fdebug, "[%s]\n", cmd);
-         fflush(fdebug);
-      }
 
-      svc_run(cmd);
+      /* In incremental mode, start from the previous */
+      /* corrections (mBgModel then stops as soon as  */
+      /* they have settled)                           */
+
+      if(incremental && writeInitCorrs("pimages.tbl", "corrections_init.tbl") > 0)
+      {
+         if(levelOnly)
+            sprintf(cmd, "mBgModel -i 100000 -l -a -w corrections_init.tbl pimages.tbl fits.tbl corrections.tbl");
+         else
+            sprintf(cmd, "mBgModel -i 100000 -w corrections_init.tbl pimages.tbl fits.tbl corrections.tbl");
+      }
+
+      if(debug >= 4)
+      {
+         fprintf(fdebug, "[%s]\n", cmd);
+         fflush(fdebug);
+      }
+
+      svc_run(cmd);
 
       strcpy( status, svc_value( "stat" ));
 
@@ -2227,6 +2505,7 @@ int main(int argc, char **argv, char **envp)
       count        = 0;
       nocorrection = 0;
       failed       = 0;
+      nreused      = 0;
 
       if(nextImg())
       {
@@ -2253,6 +2532,19 @@ int main(int argc, char **argv, char **envp)
 
          if(cntr == idcorr)
          {
+            if(incremental && corrReuse(corrfile, astr, bstr, cstr, naxis1/2., naxis2/2.))
+            {
+               ++nreused;
+
+               if(nextImg())
+                  break;
+
+               if(nextCorr())
+                  break;
+
+               continue;
+            }
+
             if(quickMode)
                sprintf(cmd, "mBackground -n projected/%s corrected/%s %s %s %s", 
                   corrfile, corrfile, astr, bstr, cstr);
@@ -2266,35 +2558,20 @@ int main(int argc, char **argv, char **envp)
              fflush(fdebug);
             }
 
-            svc_run(cmd);
-
-            if(strcmp( status, "ABORT") == 0)
-            {
-               strcpy( msg, svc_value( "msg" ));
-            
-               printf("[struct stat=\"ERROR\", msg=\"%s\"]\n", msg);
-               fflush(stdout);
-            
-               exit(1);
-            }
-
-            strcpy( status, svc_value( "stat" ));
+            while(svc_pool_full())
+               bgDone(svc_pool_wait());
 
-            ++count;
-            if(strcmp( status, "ERROR") == 0)
-               ++failed;
+            slot = svc_pool_submit(cmd);
 
-            if(!keepAll)
-            {
-               sprintf(cmd, "projected/%s", corrfile);
-               unlink(cmd);
+            if(slot < 0)
+               printerr("Cannot start mBackground");
 
-               strcpy(areafile, cmd);
-               areafile[strlen(areafile) - 5] = '\0';
-               strcat(areafile, "_area.fits");
+            job[slot].nocorr = 0;
 
-               unlink(areafile);
-            }
+            if(keepAll)
+               strcpy(job[slot].remove, "");
+            else
+               sprintf(job[slot].remove, "projected/%s", corrfile);
 
             if(nextImg())
                break;
@@ -2309,6 +2586,16 @@ int main(int argc, char **argv, char **envp)
             strcpy(bstr,"0.0");
             strcpy(cstr,"0.0");
 
+            if(incremental && corrReuse(corrfile, astr, bstr, cstr, naxis1/2., naxis2/2.))
+            {
+               ++nreused;
+
+               if(nextImg())
+                  break;
+
+               continue;
+            }
+
             if(quickMode)
                sprintf(cmd, "mBackground -n projected/%s corrected/%s %s %s %s", 
                   corrfile, corrfile, astr, bstr, cstr);
@@ -2322,37 +2609,20 @@ int main(int argc, char **argv, char **envp)
              fflush(fdebug);
             }
 
-            svc_run(cmd);
-
-            if(strcmp( status, "ABORT") == 0)
-            {
-               strcpy( msg, svc_value( "msg" ));
-            
-               printf("[struct stat=\"ERROR\", msg=\"%s\"]\n", msg);
-               fflush(stdout);
-            
-               exit(1);
-            }
-
-            strcpy( status, svc_value( "stat" ));
+            while(svc_pool_full())
+               bgDone(svc_pool_wait());
 
-            ++count;
-            if(strcmp( status, "ERROR") == 0)
-               ++failed;
-            else
-               ++nocorrection;
+            slot = svc_pool_submit(cmd);
 
-            if(!keepAll)
-            {
-               sprintf(cmd, "projected/%s", corrfile);
-               unlink(cmd);
+            if(slot < 0)
+               printerr("Cannot start mBackground");
 
-               strcpy(areafile, cmd);
-               areafile[strlen(areafile) - 5] = '\0';
-               strcat(areafile, "_area.fits");
+            job[slot].nocorr = 1;
 
-               unlink(areafile);
-            }
+            if(keepAll)
+               strcpy(job[slot].remove, "");
+            else
+               sprintf(job[slot].remove, "projected/%s", corrfile);
 
             if(nextImg())
                break;
@@ -2371,6 +2641,15 @@ int main(int argc, char **argv, char **envp)
          }
       }
 
+      while(svc_pool_active())
+         bgDone(svc_pool_wait());
+
+      if(incremental)
+      {
+         unlink(imgsort);
+         unlink(corrsort);
+      }
+
       if(!keepAll)
       {
          sprintf(cmd, "projected/%s", corrfile);
@@ -2388,6 +2667,10 @@ int main(int argc, char **argv, char **envp)
       if(debug >= 1)
       {
          fprintf(fdebug, "TIME: mBackground      %6d (%d corrected)\n", (int)(currtime - lasttime), count);
+
+         if(incremental)
+            fprintf(fdebug, "INCREMENTAL: %d corrected images reused\n", nreused);
+
          fflush(fdebug);
       }
 
@@ -2429,34 +2712,62 @@ int main(int argc, char **argv, char **envp)
 
       if(ntile*mtile == 1)
       {
-         if(quickMode)
-            sprintf(cmd, "mAdd -n -p corrected cimages.tbl region.hdr mosaic.fits");
-         else
-            sprintf(cmd, "mAdd -p corrected cimages.tbl region.hdr mosaic.fits");
-
-         if(debug >= 4)
+         if(incremental
+         && !listTouched("cimages_prev.tbl")
+         && !listTouched("cimages.tbl")
+         && fileExists("mosaic.fits"))
          {
-            fprintf(fdebug, "[%s]\n", cmd);
-            fflush(fdebug);
+            if(debug >= 1)
+            {
+               fprintf(fdebug, "INCREMENTAL: no contributors changed; mosaic reused\n");
+               fflush(fdebug);
+            }
          }
+         else
+         {
+            if(quickMode)
+               sprintf(cmd, "mAdd -n -p corrected cimages.tbl region.hdr mosaic.fits");
+            else
+               sprintf(cmd, "mAdd -p corrected cimages.tbl region.hdr mosaic.fits");
 
-         svc_run(cmd);
+            if(debug >= 4)
+            {
+               fprintf(fdebug, "[%s]\n", cmd);
+               fflush(fdebug);
+            }
 
-         strcpy( status, svc_value( "stat" ));
+            svc_run(cmd);
 
-         if(strcmp( status, "ERROR") == 0)
-         {
-            strcpy( msg, svc_value( "msg" ));
+            strcpy( status, svc_value( "stat" ));
 
-            printerr(msg);
+            if(strcmp( status, "ERROR") == 0)
+            {
+               strcpy( msg, svc_value( "msg" ));
+
+               printerr(msg);
+            }
          }
       }
       else
       {
+         ntileAdd = 0;
+
          for(i=0; i<ntile; ++i)
          {
             for(j=0; j<mtile; ++j)
             {
+               /* Incremental: a tile is only redone if one of  */
+               /* its previous or current contributors changed */
+
+               redo = 1;
+
+               if(incremental)
+               {
+                  sprintf(cmd, "tmp/cimages_%d_%d.tbl", i, j);
+
+                  redo = listTouched(cmd);
+               }
+
                sprintf(cmd, "mTileHdr region.hdr tmp/region_%d_%d.hdr %d %d %d %d 100 100",
                               i, j, ntile, mtile, i, j);
 
@@ -2499,8 +2810,26 @@ int main(int argc, char **argv, char **envp)
 
                nmatches = atoi(svc_value("nmatches"));
 
-               if(nmatches > 0)
+               sprintf(tilefile, "tiles/tile_%d_%d.fits", i, j);
+
+               if(incremental && !redo && nmatches > 0)
+               {
+                  sprintf(cmd, "tmp/cimages_%d_%d.tbl", i, j);
+
+                  redo = listTouched(cmd) || !fileExists(tilefile);
+               }
+
+               if(incremental && nmatches == 0 && fileExists(tilefile))
+               {
+                  removeFile(tilefile);
+
+                  ++ntileAdd;
+               }
+
+               if(nmatches > 0 && redo)
                {
+                  ++ntileAdd;
+
                   if(quickMode)
                      sprintf(cmd, "mAdd -n -p corrected tmp/cimages_%d_%d.tbl tmp/region_%d_%d.hdr tiles/tile_%d_%d.fits",
                         i, j, i, j, i, j);
@@ -2556,27 +2885,36 @@ int main(int argc, char **argv, char **envp)
          }
 
          lasttime = currtime;
-         
-         if(quickMode)
-            sprintf(cmd, "mAdd -n -p tiles timages.tbl region.hdr mosaic.fits");
-         else
-            sprintf(cmd, "mAdd -p tiles timages.tbl region.hdr mosaic.fits");
 
-         if(debug >= 4)
+         if(incremental && debug >= 1)
          {
-            fprintf(fdebug, "[%s]\n", cmd);
+            fprintf(fdebug, "INCREMENTAL: %d of %d tiles redone\n", ntileAdd, ntile*mtile);
             fflush(fdebug);
          }
+         
+         if(!incremental || ntileAdd > 0 || !fileExists("mosaic.fits"))
+         {
+            if(quickMode)
+               sprintf(cmd, "mAdd -n -p tiles timages.tbl region.hdr mosaic.fits");
+            else
+               sprintf(cmd, "mAdd -p tiles timages.tbl region.hdr mosaic.fits");
 
-         svc_run(cmd);
+            if(debug >= 4)
+            {
+               fprintf(fdebug, "[%s]\n", cmd);
+               fflush(fdebug);
+            }
 
-         strcpy( status, svc_value( "stat" ));
+            svc_run(cmd);
 
-         if(strcmp( status, "ERROR") == 0)
-         {
-            strcpy( msg, svc_value( "msg" ));
+            strcpy( status, svc_value( "stat" ));
 
-            printerr(msg);
+            if(strcmp( status, "ERROR") == 0)
+            {
+               strcpy( msg, svc_value( "msg" ));
+
+               printerr(msg);
+            }
          }
    
          if(!keepAll)
@@ -2609,6 +2947,25 @@ int main(int argc, char **argv, char **envp)
 
 
 
+   /*********************************************/ 
+   /* Incremental: record what this run was     */
+   /* built from, for the next one              */
+   /*********************************************/ 
+
+   if(incremental)
+   {
+      if(writeManifest("manifest.tbl", tmplHash))
+         printerr("Can't write manifest file: [manifest.tbl]");
+
+      unlink("pimages_prev.tbl");
+      unlink("fits_prev.tbl");
+      unlink("corrections_prev.tbl");
+      unlink("corrections_init.tbl");
+      unlink("cimages_prev.tbl");
+   }
+
+
+
    /******************************/ 
    /* Save file if so instructed */
    /******************************/ 
@@ -3109,6 +3466,8 @@ int main(int argc, char **argv, char **envp)
 
 int printerr(char *str)
 {
+   svc_pool_close();
+
    printf("[struct stat=\"ERROR\", msg=\"%s\"]\n", str);
    fflush(stdout);
    exit(1);
@@ -3198,3 +3557,927 @@ int nextCorr()
 
    return 0;
 }
+
+
+
+/*********************************************/
+/*                                           */
+/*  Pool completion handlers.  Each checks   */
+/*  the return structure of a finished child */
+/*  (svc_value() refers to it) and does the  */
+/*  bookkeeping the serial loop used to do.  */
+/*                                           */
+/*********************************************/
+
+void removeFile(char *fname)
+{
+   char areafile[MAXLEN];
+
+   if(strlen(fname) == 0)
+      return;
+
+   unlink(fname);
+
+   strcpy(areafile, fname);
+
+   if(strlen(areafile) > 5)
+   {
+      areafile[strlen(areafile) - 5] = '\0';
+      strcat(areafile, "_area.fits");
+
+      unlink(areafile);
+   }
+}
+
+
+void shrinkDone(int slot)
+{
+   char status[MAXLEN];
+
+   if(slot < 0)
+      return;
+
+   strcpy( status, svc_value( "stat" ));
+
+   if(strcmp( status, "ERROR") == 0)
+   {
+      strcpy( msg, svc_value( "msg" ));
+
+      printerr(msg);
+   }
+}
+
+
+void projDone(int slot)
+{
+   char status[MAXLEN];
+
+   if(slot < 0)
+      return;
+
+   strcpy( status, svc_value( "stat" ));
+
+   ++nproject;
+
+   if(strcmp( status, "ABORT") == 0)
+   {
+      strcpy( msg, svc_value( "msg" ));
+
+      printerr(msg);
+   }
+
+   else if(strcmp( status, "ERROR") == 0)
+   {
+      strcpy( msg, svc_value( "msg" ));
+
+      if(strlen(msg) > 30)
+         msg[30] = '\0';
+
+      if(strcmp( msg, "No overlap")           == 0
+      || strcmp( msg, "All pixels are blank") == 0)
+      {
+         ++nooverlap;
+         strcat(msg, ": ");
+         strcat(msg, job[slot].name);
+      }
+      else
+      {
+         ++failed;
+         strcat(msg, ": ");
+         strcat(msg, job[slot].name);
+      }
+   }
+   else
+   {
+      strcpy(goodFile, job[slot].outfile);
+
+      if(strlen(goodFile) > 3 && strcmp(goodFile+strlen(goodFile)-3, ".gz") == 0)
+         *(goodFile+strlen(goodFile)-3) = '\0';
+
+      if(debug >= 3)
+      {
+         fprintf(fdebug, "%s took %s seconds (%3d of %3d)\n", 
+            job[slot].name, svc_value("time"), nproject, nimages);
+         fflush(fdebug);
+      }
+   }
+
+   if(strlen(job[slot].althdr) > 0)
+      unlink(job[slot].althdr);
+
+   if(strlen(job[slot].remove) > 0)
+      unlink(job[slot].remove);
+}
+
+
+void diffDone(int slot)
+{
+   char   status[MAXLEN];
+   char   line  [MAXLEN];
+   int    next;
+
+   double a;
+   double b;
+   double c;
+   double crpix1;
+   double crpix2;
+   int    xmin;
+   int    xmax;
+   int    ymin;
+   int    ymax;
+   double xcenter;
+   double ycenter;
+   double npixel;
+   double rms;
+   double boxx;
+   double boxy;
+   double boxwidth;
+   double boxheight;
+   double boxangle;
+
+   if(slot < 0)
+      return;
+
+   strcpy( status, svc_value( "stat" ));
+
+   if(strcmp( status, "ABORT") == 0)
+   {
+      strcpy( msg, svc_value( "msg" ));
+
+      svc_pool_close();
+
+      printf("[struct stat=\"ERROR\", msg=\"%s\"]\n", msg);
+      fflush(stdout);
+
+      exit(1);
+   }
+
+
+   /* mDiff is done; start mFitplane on the difference */
+
+   if(job[slot].stage == MDIFF)
+   {
+      if(strcmp( status, "ERROR"  ) == 0
+      || strcmp( status, "WARNING") == 0)
+         ++failed;
+
+      if(debug >= 4)
+      {
+         fprintf(fdebug, "[%s]\n", job[slot].next);
+         fflush(fdebug);
+      }
+
+      next = svc_pool_submit(job[slot].next);
+
+      if(next < 0)
+         printerr("Cannot start mFitplane");
+
+      if(next != slot)
+         job[next] = job[slot];
+
+      job[next].stage = MFITPLANE;
+
+      return;
+   }
+
+
+   /* mFitplane is done; save the fit */
+
+   strcpy(line, "");
+
+   if(strcmp( status, "ERROR")   == 0
+   || strcmp( status, "WARNING") == 0)
+      ++failed;
+   else
+   {
+      a         = atof(svc_value("a"));
+      b         = atof(svc_value("b"));
+      c         = atof(svc_value("c"));
+      crpix1    = atof(svc_value("crpix1"));
+      crpix2    = atof(svc_value("crpix2"));
+      xmin      = atoi(svc_value("xmin"));
+      xmax      = atoi(svc_value("xmax"));
+      ymin      = atoi(svc_value("ymin"));
+      ymax      = atoi(svc_value("ymax"));
+      xcenter   = atof(svc_value("xcenter"));
+      ycenter   = atof(svc_value("ycenter"));
+      npixel    = atof(svc_value("npixel"));
+      rms       = atof(svc_value("rms"));
+      boxx      = atof(svc_value("boxx"));
+      boxy      = atof(svc_value("boxy"));
+      boxwidth  = atof(svc_value("boxwidth"));
+      boxheight = atof(svc_value("boxheight"));
+      boxangle  = atof(svc_value("boxang"));
+
+      sprintf(line, " %9d %9d %16.5e %16.5e %16.5e %14.2f %14.2f %10d %10d %10d %10d %13.2f %13.2f %13.0f %16.5e %16.1f %16.1f %16.1f %16.1f %16.1f \n",
+         job[slot].cntr1, job[slot].cntr2, a, b, c, crpix1, crpix2, xmin, xmax, ymin, ymax, 
+         xcenter, ycenter, npixel, rms, boxx, boxy, boxwidth, boxheight, boxangle);
+   }
+
+   fitAdd(job[slot].seq, line);
+
+   removeFile(job[slot].remove);
+}
+
+
+void bgDone(int slot)
+{
+   char status[MAXLEN];
+
+   if(slot < 0)
+      return;
+
+   strcpy( status, svc_value( "stat" ));
+
+   if(strcmp( status, "ABORT") == 0)
+   {
+      strcpy( msg, svc_value( "msg" ));
+
+      svc_pool_close();
+
+      printf("[struct stat=\"ERROR\", msg=\"%s\"]\n", msg);
+      fflush(stdout);
+
+      exit(1);
+   }
+
+   ++count;
+
+   if(strcmp( status, "ERROR") == 0)
+      ++failed;
+
+   else if(job[slot].nocorr)
+      ++nocorrection;
+
+   removeFile(job[slot].remove);
+}
+
+
+
+/*******************************************/
+/*                                         */
+/*  Fit records arrive in completion order */
+/*  but are written to fits.tbl in table   */
+/*  order.  A NULL line reserves a place   */
+/*  for a job that hasn't finished yet.    */
+/*                                         */
+/*******************************************/
+
+void fitAdd(int seq, char *line)
+{
+   if(seq >= maxfitLine)
+   {
+      maxfitLine += 1024;
+
+      fitLine = (char **)realloc(fitLine, maxfitLine * sizeof(char *));
+   }
+
+   if(line == (char *)NULL)
+   {
+      fitLine[seq] = (char *)NULL;
+      return;
+   }
+
+   fitLine[seq] = (char *)malloc(strlen(line) + 1);
+
+   strcpy(fitLine[seq], line);
+
+   while(nextLine < nfitLine && fitLine[nextLine] != (char *)NULL)
+   {
+      if(strlen(fitLine[nextLine]) > 0)
+      {
+         fputs(fitLine[nextLine], ffits);
+         fflush(ffits);
+      }
+
+      free(fitLine[nextLine]);
+
+      fitLine[nextLine] = (char *)NULL;
+
+      ++nextLine;
+   }
+}
+
+
+
+/*******************************************/
+/*                                         */
+/*  Incremental mode support.  Content     */
+/*  hashes are 64-bit FNV-1a; they only    */
+/*  need to notice that a file changed.    */
+/*                                         */
+/*******************************************/
+
+void bufHash(unsigned char *buf, int n, unsigned long long *hash)
+{
+   int i;
+
+   for(i=0; i<n; ++i)
+   {
+      *hash ^= (unsigned long long)buf[i];
+      *hash *= 1099511628211ULL;
+   }
+}
+
+
+int fileHash(char *fname, unsigned long long *hash)
+{
+   FILE *fin;
+   int   n;
+
+   unsigned char buf[BUFSIZE];
+
+   fin = fopen(fname, "r");
+
+   if(fin == (FILE *)NULL)
+      return 1;
+
+   while(1)
+   {
+      n = fread(buf, sizeof(char), BUFSIZE, fin);
+
+      if(n <= 0)
+         break;
+
+      bufHash(buf, n, hash);
+   }
+
+   fclose(fin);
+
+   return 0;
+}
+
+
+int fileExists(char *fname)
+{
+   struct stat buf;
+
+   if(stat(fname, &buf) < 0)
+      return 0;
+
+   return 1;
+}
+
+
+char *copyStr(char *str)
+{
+   char *copy;
+
+   copy = (char *)malloc(strlen(str) + 1);
+
+   strcpy(copy, str);
+
+   return copy;
+}
+
+
+
+/*******************************************/
+/*                                         */
+/*  The projected file name for a raw      */
+/*  image (the same rules the projection   */
+/*  loop has always used).                 */
+/*                                         */
+/*******************************************/
+
+void projName(char *infile, char *outfile)
+{
+   strcpy(outfile, infile);
+
+   if(strlen(outfile) > 4 && strcmp(outfile+strlen(outfile)-4, ".bz2") == 0)
+      *(outfile+strlen(outfile)-4) = '\0';
+
+   if(strlen(outfile) > 3 && strcmp(outfile+strlen(outfile)-3, ".gz") == 0)
+      *(outfile+strlen(outfile)-3) = '\0';
+
+   if(strlen(outfile) > 4 && strcmp(outfile+strlen(outfile)-4, ".fit") == 0)
+      strcat(outfile, "s");
+
+
+   if(strlen(outfile) > 5 &&
+      strncmp(outfile+strlen(outfile)-5, ".FITS", 5) == 0)
+         outfile[strlen(outfile)-5] = '\0';
+
+   else if(strlen(outfile) > 5 &&
+      strncmp(outfile+strlen(outfile)-5, ".fits", 5) == 0)
+         outfile[strlen(outfile)-5] = '\0';
+
+   else if(strlen(outfile) > 4 &&
+      strncmp(outfile+strlen(outfile)-4, ".FIT", 4) == 0)
+         outfile[strlen(outfile)-4] = '\0';
+
+   else if(strlen(outfile) > 4 &&
+      strncmp(outfile+strlen(outfile)-4, ".fit", 4) == 0)
+         outfile[strlen(outfile)-4] = '\0';
+
+   strcat(outfile, ".fits");
+}
+
+
+
+/*******************************************/
+/*                                         */
+/*  Read the previous run's manifest.      */
+/*  Returns 0 if it exists and was made    */
+/*  with the same template and options;    */
+/*  otherwise there is nothing to reuse.   */
+/*                                         */
+/*******************************************/
+
+int readManifest(char *fname, char *tmplHash)
+{
+   FILE *fin;
+   int   match, maxprev;
+   char  line[MAXLEN];
+   char *ptr, *end;
+
+   nprev   = 0;
+   maxprev = 1024;
+   match   = 0;
+
+   prev = (struct Manifest *)malloc(maxprev * sizeof(struct Manifest));
+
+   fin = fopen(fname, "r");
+
+   if(fin == (FILE *)NULL)
+      return 1;
+
+   while(fgets(line, MAXLEN, fin) != (char *)NULL)
+   {
+      while(strlen(line) > 0 && (line[strlen(line)-1] == '\n' || line[strlen(line)-1] == '\r'))
+         line[strlen(line)-1]  = '\0';
+
+      if(line[0] == '|')
+         continue;
+
+      if(line[0] == '\\')
+      {
+         if(strncmp(line, "\\template", 9) == 0)
+         {
+            ptr = strchr(line, '"');
+
+            if(ptr != (char *)NULL && strncmp(ptr+1, tmplHash, strlen(tmplHash)) == 0)
+               match = 1;
+         }
+
+         continue;
+      }
+
+      ptr = line;
+
+      while(*ptr == ' ')
+         ++ptr;
+
+      if(strlen(ptr) < 17)
+         continue;
+
+      if(nprev >= maxprev)
+      {
+         maxprev += 1024;
+
+         prev = (struct Manifest *)realloc(prev, maxprev * sizeof(struct Manifest));
+      }
+
+      strncpy(prev[nprev].hash, ptr, 16);
+
+      prev[nprev].hash[16] = '\0';
+
+      ptr += 16;
+
+      while(*ptr == ' ')
+         ++ptr;
+
+      end = ptr + strlen(ptr) - 1;
+
+      while(end > ptr && *end == ' ')
+      {
+         *end = '\0';
+         --end;
+      }
+
+      prev[nprev].fname = copyStr(ptr);
+
+      ++nprev;
+   }
+
+   fclose(fin);
+
+   if(!match)
+   {
+      nprev = 0;
+      return 1;
+   }
+
+   return 0;
+}
+
+
+int writeManifest(char *fname, char *tmplHash)
+{
+   FILE *fout;
+   int   i, len;
+
+   fout = fopen(fname, "w+");
+
+   if(fout == (FILE *)NULL)
+      return 1;
+
+   len = 5;
+
+   for(i=0; i<ncurr; ++i)
+      if(strlen(curr[i].fname) > len)
+         len = strlen(curr[i].fname);
+
+   fprintf(fout, "\\template = \"%s\"\n", tmplHash);
+   fprintf(fout, "|       hash       | %-*s |\n", len, "fname");
+
+   for(i=0; i<ncurr; ++i)
+      fprintf(fout, "  %16s  %-*s  \n", curr[i].hash, len, curr[i].fname);
+
+   fclose(fout);
+
+   return 0;
+}
+
+
+char *prevHash(char *fname)
+{
+   int i;
+
+   for(i=0; i<nprev; ++i)
+      if(strcmp(prev[i].fname, fname) == 0)
+         return prev[i].hash;
+
+   return (char *)NULL;
+}
+
+
+
+/*******************************************/
+/*                                         */
+/*  The "touched" list: projected/         */
+/*  corrected file names that are new,     */
+/*  changed or gone in this run.           */
+/*                                         */
+/*******************************************/
+
+void addTouched(char *fname)
+{
+   if(isTouched(fname))
+      return;
+
+   if(ntouched >= maxtouched)
+   {
+      maxtouched += 1024;
+
+      touched = (char **)realloc(touched, maxtouched * sizeof(char *));
+   }
+
+   touched[ntouched] = copyStr(fname);
+
+   ++ntouched;
+}
+
+
+int isTouched(char *fname)
+{
+   int i;
+
+   for(i=0; i<ntouched; ++i)
+      if(strcmp(touched[i], fname) == 0)
+         return 1;
+
+   return 0;
+}
+
+
+/* Does an image list (e.g. a tile's contributors) */
+/* include anything touched?  A list we can't read */
+/* counts as touched.                              */
+
+int listTouched(char *tblfile)
+{
+   int ncols, ifname, found;
+
+   ncols = topen(tblfile);
+
+   if(ncols <= 0)
+      return 1;
+
+   ifname = tcol("fname");
+
+   if(ifname < 0)
+   {
+      tclose();
+      return 1;
+   }
+
+   found = 0;
+
+   while(tread() >= 0)
+   {
+      if(isTouched(tval(ifname)))
+      {
+         found = 1;
+         break;
+      }
+   }
+
+   tclose();
+
+   return found;
+}
+
+
+
+/*******************************************/
+/*                                         */
+/*  The previous run's tables, keyed by    */
+/*  file name (the cntr values change      */
+/*  whenever the image list does).         */
+/*                                         */
+/*******************************************/
+
+void loadPrevImages(char *tblfile)
+{
+   int i, ncols, icntr, ifname, id;
+
+   nprevImage = 0;
+
+   ncols = topen(tblfile);
+
+   if(ncols <= 0)
+      return;
+
+   icntr  = tcol("cntr");
+   ifname = tcol("fname");
+
+   if(icntr < 0 || ifname < 0)
+   {
+      tclose();
+      return;
+   }
+
+   while(tread() >= 0)
+   {
+      id = atoi(tval(icntr));
+
+      if(id < 0)
+         continue;
+
+      if(id >= nprevImage)
+      {
+         prevImage = (char **)realloc(prevImage, (id+1) * sizeof(char *));
+
+         for(i=nprevImage; i<=id; ++i)
+            prevImage[i] = (char *)NULL;
+
+         nprevImage = id+1;
+      }
+
+      prevImage[id] = copyStr(tval(ifname));
+   }
+
+   tclose();
+}
+
+
+void loadPrevFits(char *tblfile)
+{
+   FILE  *fin;
+   int    cntr1, cntr2, n, maxfit;
+   char   line[MAXLEN];
+   double val[13];
+
+   nprevFit = 0;
+   maxfit   = 0;
+   prevRms  = 0.;
+
+   fin = fopen(tblfile, "r");
+
+   if(fin == (FILE *)NULL)
+      return;
+
+   while(fgets(line, MAXLEN, fin) != (char *)NULL)
+   {
+      if(line[0] == '|' || line[0] == '\\')
+         continue;
+
+      if(sscanf(line, "%d %d%n", &cntr1, &cntr2, &n) != 2)
+         continue;
+
+      if(cntr1 < 0 || cntr1 >= nprevImage || prevImage[cntr1] == (char *)NULL
+      || cntr2 < 0 || cntr2 >= nprevImage || prevImage[cntr2] == (char *)NULL)
+         continue;
+
+      if(nprevFit >= maxfit)
+      {
+         maxfit += 1024;
+
+         prevFits = (struct PrevFit *)realloc(prevFits, maxfit * sizeof(struct PrevFit));
+      }
+
+      prevFits[nprevFit].fname1 = prevImage[cntr1];
+      prevFits[nprevFit].fname2 = prevImage[cntr2];
+      prevFits[nprevFit].rest   = copyStr(line+n);
+
+      if(sscanf(line+n, "%lf %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf",
+         &val[0], &val[1], &val[2], &val[3], &val[4], &val[5], &val[6], 
+         &val[7], &val[8], &val[9], &val[10], &val[11], &val[12]) == 13)
+         prevRms += val[12];
+
+      ++nprevFit;
+   }
+
+   fclose(fin);
+
+   if(nprevFit > 0)
+      prevRms = prevRms / nprevFit;
+}
+
+
+void loadPrevCorrs(char *tblfile)
+{
+   int ncols, iid, ia, ib, ic, id, maxcorr;
+
+   nprevCorr = 0;
+   maxcorr   = 0;
+
+   ncols = topen(tblfile);
+
+   if(ncols <= 0)
+      return;
+
+   iid = tcol("id");
+   ia  = tcol("a");
+   ib  = tcol("b");
+   ic  = tcol("c");
+
+   if(iid < 0 || ia < 0 || ib < 0 || ic < 0)
+   {
+      tclose();
+      return;
+   }
+
+   while(tread() >= 0)
+   {
+      id = atoi(tval(iid));
+
+      if(id < 0 || id >= nprevImage || prevImage[id] == (char *)NULL)
+         continue;
+
+      if(nprevCorr >= maxcorr)
+      {
+         maxcorr += 1024;
+
+         prevCorrs = (struct PrevCorr *)realloc(prevCorrs, maxcorr * sizeof(struct PrevCorr));
+      }
+
+      prevCorrs[nprevCorr].fname = prevImage[id];
+      prevCorrs[nprevCorr].a     = atof(tval(ia));
+      prevCorrs[nprevCorr].b     = atof(tval(ib));
+      prevCorrs[nprevCorr].c     = atof(tval(ic));
+
+      ++nprevCorr;
+   }
+
+   tclose();
+}
+
+
+char *prevFit(char *fname1, char *fname2)
+{
+   int i;
+
+   for(i=0; i<nprevFit; ++i)
+      if(strcmp(prevFits[i].fname1, fname1) == 0
+      && strcmp(prevFits[i].fname2, fname2) == 0)
+         return prevFits[i].rest;
+
+   return (char *)NULL;
+}
+
+
+int prevCorr(char *fname, double *a, double *b, double *c)
+{
+   int i;
+
+   for(i=0; i<nprevCorr; ++i)
+   {
+      if(strcmp(prevCorrs[i].fname, fname) == 0)
+      {
+         *a = prevCorrs[i].a;
+         *b = prevCorrs[i].b;
+         *c = prevCorrs[i].c;
+
+         return 1;
+      }
+   }
+
+   return 0;
+}
+
+
+
+/*******************************************/
+/*                                         */
+/*  Translate the previous corrections to  */
+/*  the current cntr values, as the        */
+/*  starting point for mBgModel.  Touched  */
+/*  images start from zero.  Returns the   */
+/*  number of images carried over.         */
+/*                                         */
+/*******************************************/
+
+int writeInitCorrs(char *imgtbl, char *outtbl)
+{
+   FILE  *fout;
+   int    ncols, icntr, ifname, n;
+   double a, b, c;
+
+   ncols = topen(imgtbl);
+
+   if(ncols <= 0)
+      return 0;
+
+   icntr  = tcol("cntr");
+   ifname = tcol("fname");
+
+   if(icntr < 0 || ifname < 0)
+   {
+      tclose();
+      return 0;
+   }
+
+   fout = fopen(outtbl, "w+");
+
+   if(fout == (FILE *)NULL)
+   {
+      tclose();
+      return 0;
+   }
+
+   fputs("|   id   |      a       |      b       |      c       |\n", fout);
+
+   n = 0;
+
+   while(tread() >= 0)
+   {
+      if(!isTouched(tval(ifname)) && prevCorr(tval(ifname), &a, &b, &c))
+      {
+         fprintf(fout, " %8d  %13.5e  %13.5e  %13.5e\n", atoi(tval(icntr)), a, b, c);
+         ++n;
+      }
+   }
+
+   fclose(fout);
+
+   tclose();
+
+   return n;
+}
+
+
+
+/*******************************************/
+/*                                         */
+/*  Can we keep the corrected image from   */
+/*  the previous run?  Only if the image   */
+/*  is untouched and its correction plane  */
+/*  (no previous correction means zero)    */
+/*  hasn't moved anywhere in the mosaic by */
+/*  more than a small fraction of the      */
+/*  typical overlap difference rms, i.e.   */
+/*  well below the noise.  If not, the     */
+/*  image is now touched.                  */
+/*                                         */
+/*******************************************/
+
+int corrReuse(char *fname, char *astr, char *bstr, char *cstr, double xsize, double ysize)
+{
+   double a, b, c, change;
+   char   path[MAXLEN];
+
+   sprintf(path, "corrected/%s", fname);
+
+   if(!prevCorr(fname, &a, &b, &c))
+   {
+      a = 0.;
+      b = 0.;
+      c = 0.;
+   }
+
+   if(!isTouched(fname) && fileExists(path))
+   {
+      change = fabs(atof(astr) - a) * xsize
+             + fabs(atof(bstr) - b) * ysize
+             + fabs(atof(cstr) - c);
+
+      if(change <= CORRTOL * prevRms)
+         return 1;
+   }
+
+   addTouched(fname);
+
+   return 0;
+}
@@ -47,6 +47,7 @@ Version  Developer        Date     Change
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <pthread.h>
 
 #include <montage.h>
 #include <cmd.h>
@@ -80,6 +81,10 @@ Version  Developer        Date     Change
 #define MAXSET        32
 #define MAXSTR      1024
 #define BIGSTR     32768
+#define MAXTHREAD     64
+
+#define TRAJSTEP     0.1   // Longest piece of a trajectory segment (degrees)
+                           // covered by a single search box
 
 
 char regionTypeStr[4][32] = {"POINT", "CONE", "BOX"};
@@ -128,6 +133,43 @@ typedef struct rectStruct
 RectInfo;
 
 
+typedef struct trajPoint
+{
+   Vec    pos;      // Unit vector; pos.t is the MJD
+   double unc;      // Position uncertainty (radians)
+}
+TrajPoint;
+
+
+typedef struct trajHit
+{
+   long   id;
+   long   seg;
+   double mjd;
+   double ra;
+   double dec;
+}
+TrajHit;
+
+
+typedef struct trajThread
+{
+   struct Node *root;
+
+   long     first;
+   long     nsearch;
+
+   long     nhit;
+   long     maxhit;
+   TrajHit *hits;
+
+   long     seg;
+   double   theta;
+   double   ta, tb;
+}
+TrajThread;
+
+
 extern char *optarg;
 extern int   optind, opterr;
 
@@ -213,6 +255,20 @@ static char *newMap;
 
 SearchHitCallback overlapCallback(long id, void* arg);
 
+int       coneOverlap       (Vec *center, double radius, double radiusDot, RectInfo *info);
+
+int       trajectoryCallback(long id, struct Rect *rect, void *arg);
+void     *trajectorySearch  (void *arg);
+void      trajInterp        (TrajPoint *p0, TrajPoint *p1, double theta, double f, Vec *pos, double *unc);
+int       trajPointCmp      (const void *a, const void *b);
+int       trajHitIdCmp      (const void *a, const void *b);
+int       trajHitTimeCmp    (const void *a, const void *b);
+
+TrajPoint *traj;
+long       ntraj;
+int        trajNthread;
+double     trajPad;
+
 int       errno;
 
 double delta = 0.0001;
@@ -300,6 +356,28 @@ int rdebug = 0;
 /*                                     to get a complete list of       */
 /*                                     images).                        */
 /*                                                                     */
+/*    For moving objects there is                                      */
+/*                                                                     */
+/*    trajectory <ephem.tbl>           Finds every image (or catalog   */
+/*       <hits.tbl> [nthread]          record) that saw the object at  */
+/*                                     some point along its track.     */
+/*                                                                     */
+/* The ephemeris table needs mjd, ra and dec columns and can have an   */
+/* 'uncertainty' column (arcsec); otherwise the 'radius' above is      */
+/* used.  The track between consecutive ephemeris points is taken to   */
+/* be a great circle traversed at a uniform rate.  Each segment is     */
+/* cut into pieces no more than TRAJSTEP long and each piece becomes   */
+/* one search box: the x,y,z range of its end points padded by the     */
+/* arc bulge and the uncertainty, and the time range of the piece.     */
+/* So the boxes follow the track in both space and time and the whole  */
+/* trajectory is covered.  The segments are searched in parallel       */
+/* (default one thread per processor).                                 */
+/*                                                                     */
+/* For each candidate, the object's position is interpolated to the    */
+/* middle of the exposure and checked against the image footprint.     */
+/* An image is reported once, with that time and position.  Records    */
+/* indexed without time information are never matched.                 */
+/*                                                                     */
 /*                                                                     */
 /* The <user.tbl> file needs to have ra and dec columns for giving     */
 /* the location for each record and mjd_obs / exptime columns giving   */
@@ -440,6 +518,13 @@ int main(int argc, char **argv)
 
    struct Node* root;
 
+   int         iunc, nthread, t;
+   int         started[MAXTHREAD];
+   long        maxtraj, nsearch, nunique;
+   TrajThread *threads;
+   TrajHit    *hits;
+   pthread_t   tid[MAXTHREAD];
+
    char   cmd[MAXSTR];
 
    int    cmdc;
@@ -2179,6 +2264,267 @@ int main(int argc, char **argv)
          break;
 
 
+      /* TRAJECTORY command (ahead of TRACE, */
+      /* which would otherwise take it)      */
+
+      else if(strncasecmp(cmd, "trajectory", 4) == 0)
+      {
+         if(cmdc < 3)
+         {
+            printf("[struct stat=\"ERROR\", msg=\"Command usage: trajectory <ephem.tbl> <hits.tbl> [nthread]\"]\n");
+            fflush(stdout);
+            continue;
+         }
+         
+         strcpy(filename, cmdv[1]);
+         strcpy(summary,  cmdv[2]);
+
+         nthread = 0;
+
+         if(cmdc > 3)
+            nthread = atoi(cmdv[3]);
+
+         if(nthread <= 0)
+            nthread = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+         if(nthread < 1)
+            nthread = 1;
+
+         if(nthread > MAXTHREAD)
+            nthread = MAXTHREAD;
+
+         ncol = topen(filename);
+
+         if(ncol <= 0)
+         {
+            printf("[struct stat=\"ERROR\", msg=\"Error opening table %s\"]\n",
+               filename);
+            fflush(stdout);
+            continue;
+         }
+
+         itime = tcol("mjd");
+
+         if(itime < 0)
+            itime = tcol("MJD");
+
+         if(itime < 0)
+            itime = tcol("mjd_obs");
+
+         if(itime < 0)
+            itime = tcol("MJD_OBS");
+
+         if(itime < 0)
+            itime = tcol("mjdobs");
+
+         if(itime < 0)
+            itime = tcol("MJDOBS");
+
+         ira  = tcol("ra");
+         idec = tcol("dec");
+
+         iunc = tcol("uncertainty");
+
+         if(iunc < 0)
+            iunc = tcol("unc");
+
+         if(itime < 0 || ira < 0 || idec < 0)
+         {
+            printf("[struct stat=\"ERROR\", msg=\"Need columns 'mjd', 'ra' and 'dec' in the ephemeris (%s)\"]\n", filename);
+            fflush(stdout);
+            tclose();
+            continue;
+         }
+
+
+         // Read the whole ephemeris first (the table
+         // library is not something to share between
+         // threads)
+
+         ntraj   = 0;
+         maxtraj = MAXRECT;
+
+         traj = (TrajPoint *)malloc(maxtraj * sizeof(TrajPoint));
+
+         while(1)
+         {
+            stat = tread();
+
+            if(stat < 0)
+               break;
+
+            if(ntraj >= maxtraj)
+            {
+               maxtraj += MAXRECT;
+
+               traj = (TrajPoint *)realloc(traj, maxtraj * sizeof(TrajPoint));
+            }
+
+            ra  = atof(tval(ira));
+            dec = atof(tval(idec));
+
+            traj[ntraj].pos.x = cos(ra*dtr) * cos(dec*dtr);
+            traj[ntraj].pos.y = sin(ra*dtr) * cos(dec*dtr);
+            traj[ntraj].pos.z = sin(dec*dtr);
+            traj[ntraj].pos.t = atof(tval(itime));
+
+            traj[ntraj].unc = atan(matchDelta);
+
+            if(iunc >= 0)
+               traj[ntraj].unc = fabs(atof(tval(iunc)))/3600. * dtr;
+
+            ++ntraj;
+         }
+
+         tclose();
+
+         if(ntraj < 2)
+         {
+            printf("[struct stat=\"ERROR\", msg=\"Need at least two ephemeris points (%s)\"]\n", filename);
+            fflush(stdout);
+            free(traj);
+            continue;
+         }
+
+         qsort(traj, ntraj, sizeof(TrajPoint), trajPointCmp);
+
+         fsum = fopen(summary, "w+");
+
+         if(fsum == (FILE *)NULL)
+         {
+            printf("[struct stat=\"ERROR\", msg=\"Cannot open trajectory output file (%s)\"]\n", summary);
+            fflush(stdout);
+            free(traj);
+            continue;
+         }
+
+
+         // Search the segments in parallel
+
+         if(nthread > ntraj-1)
+            nthread = ntraj-1;
+
+         trajNthread = nthread;
+         trajPad     = pad0;
+
+         threads = (TrajThread *)malloc(nthread * sizeof(TrajThread));
+
+         for(t=0; t<nthread; ++t)
+         {
+            threads[t].root    = root;
+            threads[t].first   = t;
+            threads[t].nsearch = 0;
+            threads[t].nhit    = 0;
+            threads[t].maxhit  = 0;
+            threads[t].hits    = (TrajHit *)NULL;
+         }
+
+         for(t=1; t<nthread; ++t)
+         {
+            started[t] = 1;
+
+            if(pthread_create(&tid[t], NULL, trajectorySearch, &threads[t]))
+            {
+               trajectorySearch(&threads[t]);
+
+               started[t] = 0;
+            }
+         }
+
+         trajectorySearch(&threads[0]);
+
+         for(t=1; t<nthread; ++t)
+         {
+            if(started[t])
+               pthread_join(tid[t], NULL);
+         }
+
+
+         // Merge the hit lists and keep one
+         // hit per image
+
+         nhits   = 0;
+         nsearch = 0;
+
+         for(t=0; t<nthread; ++t)
+         {
+            nhits   += threads[t].nhit;
+            nsearch += threads[t].nsearch;
+         }
+
+         hits = (TrajHit *)malloc((nhits+1) * sizeof(TrajHit));
+
+         nhits = 0;
+
+         for(t=0; t<nthread; ++t)
+         {
+            if(threads[t].nhit > 0)
+               memcpy(hits+nhits, threads[t].hits, threads[t].nhit * sizeof(TrajHit));
+
+            nhits += threads[t].nhit;
+
+            free(threads[t].hits);
+         }
+
+         free(threads);
+
+         qsort(hits, nhits, sizeof(TrajHit), trajHitIdCmp);
+
+         nunique = 0;
+
+         for(i=0; i<nhits; ++i)
+         {
+            if(nunique > 0 && hits[i].id == hits[nunique-1].id)
+               continue;
+
+            hits[nunique] = hits[i];
+
+            ++nunique;
+         }
+
+         qsort(hits, nunique, sizeof(TrajHit), trajHitTimeCmp);
+
+
+         // Write them out in time order
+
+         ilen = 10;
+
+         for(i=0; i<nset; ++i)
+         {
+            if(strlen(set[i].name) > ilen)
+               ilen = strlen(set[i].name);
+         }
+
+         sprintf(fmt, "|%%6s|%%%lds|%%12s|%%16s|%%12s|%%12s|%%10s|\n", ilen);
+
+         fprintf(fsum, "\\fixlen = T\n");
+         fprintf(fsum, fmt, "setid", "setname", "catoff", "mjd", "ra", "dec", "segment");
+         fprintf(fsum, fmt, "int", "char", "int", "double", "double", "double", "int");
+
+         sprintf(fmt, " %%6d %%%lds %%12ld %%16.8f %%12.7f %%12.7f %%10ld \n", ilen);
+
+         for(i=0; i<nunique; ++i)
+         {
+            id = hits[i].id;
+
+            fprintf(fsum, fmt, rectinfo[id].setid, set[rectinfo[id].setid].name, rectinfo[id].catoff,
+               hits[i].mjd, hits[i].ra, hits[i].dec, hits[i].seg);
+         }
+
+         fclose(fsum);
+
+         free(hits);
+         free(traj);
+
+         gettimeofday(&tp, &tzp);
+         searchtime = (double)tp.tv_sec + (double)tp.tv_usec/1000000.;
+
+         printf("[struct stat=\"OK\", command=\"trajectory\", table=\"%s\", outfile=\"%s\", time=\"%.4f\", npoint=\"%ld\", nsearch=\"%ld\", nthread=\"%d\", nhits=\"%ld\", count=\"%ld\"]\n",
+            filename, summary, searchtime-starttime, ntraj, nsearch, nthread, nhits, nunique);
+         fflush(stdout);
+      }
+
+
       /* TRACE command */
 
       else if(strncasecmp(cmd, "trace", 2) == 0)
@@ -4490,6 +4836,340 @@ SearchHitCallback overlapCallback(long index, void* arg)
 }
 
 
+/*********************************************************/
+/*                                                       */
+/* Does a cone (center, radius in degrees and the cosine */
+/* of the radius) overlap an image (BOX datum)?  Used by */
+/* the trajectory search only; cone searches keep their  */
+/* original test in overlapCallback().                   */
+/*                                                       */
+/*********************************************************/
+
+int coneOverlap(Vec *center, double radius, double radiusDot, RectInfo *info)
+{
+   int    i, inext;
+   Vec    X, normal, side;
+   double distDot, sinDist, sinRadius;
+
+   /* Check for image center in cone */
+
+   distDot = Dot(center, &info->center);
+
+   if(distDot > radiusDot)
+      return 1;
+   
+
+   /* Check for image corners in cone */
+
+   for(i=0; i<4; ++i)
+   {
+      if(Dot(center, &info->corner[i]) > radiusDot)
+         return 1;
+   }
+
+
+   /* Check for cone center in image */
+
+   if(pointInPolygon(center, info->corner))
+      return 1;
+
+
+   /* Check for an image edge passing through */
+   /* the cone: the cone center is within the */
+   /* radius of the edge's great circle and   */
+   /* the closest point (X) on that circle    */
+   /* lies between the two corners            */
+
+   sinRadius = sin(radius*dtr);
+
+   for(i=0; i<4; ++i)
+   {
+      inext = (i+1)%4;
+
+      if(!Cross(&info->corner[i], &info->corner[inext], &normal))
+         continue;
+
+      Normalize(&normal);
+
+      sinDist = Dot(center, &normal);
+
+      if(fabs(sinDist) > sinRadius)
+         continue;
+
+      X.x = center->x - sinDist * normal.x;
+      X.y = center->y - sinDist * normal.y;
+      X.z = center->z - sinDist * normal.z;
+
+      Normalize(&X);
+
+      Cross(&info->corner[i], &X, &side);
+
+      if(Dot(&side, &normal) < 0.)
+         continue;
+
+      Cross(&X, &info->corner[inext], &side);
+
+      if(Dot(&side, &normal) < 0.)
+         continue;
+
+      return 1;
+   }
+
+   return 0;
+}
+
+
+
+/********************************************************/
+/*                                                      */
+/* Trajectory search thread.  Each thread takes every   */
+/* trajNthread'th segment of the ephemeris, cuts it     */
+/* into pieces no longer than TRAJSTEP and searches the */
+/* R-Tree with one box per piece.  Hits go into the     */
+/* thread's own list, so nothing is shared but the      */
+/* (read-only) tree and ephemeris.                      */
+/*                                                      */
+/********************************************************/
+
+void *trajectorySearch(void *arg)
+{
+   TrajThread *thread;
+
+   long   iseg, ipiece, npiece;
+   double ua, ub, pad;
+   Vec    pa, pb;
+
+   struct Rect rect;
+
+   thread = (TrajThread *)arg;
+
+   for(iseg=thread->first; iseg<ntraj-1; iseg+=trajNthread)
+   {
+      if(traj[iseg+1].pos.t <= traj[iseg].pos.t)
+         continue;
+
+      thread->seg   = iseg;
+      thread->theta = acos(Dot(&traj[iseg].pos, &traj[iseg+1].pos));
+
+      npiece = (long)ceil(thread->theta / (TRAJSTEP*dtr));
+
+      if(npiece < 1)
+         npiece = 1;
+
+      for(ipiece=0; ipiece<npiece; ++ipiece)
+      {
+         trajInterp(&traj[iseg], &traj[iseg+1], thread->theta, (double) ipiece   /npiece, &pa, &ua);
+         trajInterp(&traj[iseg], &traj[iseg+1], thread->theta, (double)(ipiece+1)/npiece, &pb, &ub);
+
+         thread->ta = pa.t;
+         thread->tb = pb.t;
+
+
+         /* The arc between the end points bulges */
+         /* out from the chord by 1-cos(theta/2); */
+         /* any point within the uncertainty is   */
+         /* no further than its chord length      */
+
+         if(ub > ua)
+            ua = ub;
+
+         pad = 1. - cos(thread->theta/npiece/2.) + 2. * sin(ua/2.);
+
+         if(pad < trajPad)
+            pad = trajPad;
+
+         rect.boundary[0] = (pa.x < pb.x ? pa.x : pb.x) - pad;
+         rect.boundary[1] = (pa.y < pb.y ? pa.y : pb.y) - pad;
+         rect.boundary[2] = (pa.z < pb.z ? pa.z : pb.z) - pad;
+         rect.boundary[3] = pa.t;
+         rect.boundary[4] = (pa.x > pb.x ? pa.x : pb.x) + pad;
+         rect.boundary[5] = (pa.y > pb.y ? pa.y : pb.y) + pad;
+         rect.boundary[6] = (pa.z > pb.z ? pa.z : pb.z) + pad;
+         rect.boundary[7] = pb.t;
+
+         if(rdebug > 2)
+         {
+            printf("trajectorySearch(): segment %ld piece %ld/%ld  x: %.8f %.8f  y: %.8f %.8f  z: %.8f %.8f  t: %.8f %.8f\n",
+               iseg, ipiece, npiece, rect.boundary[0], rect.boundary[4], rect.boundary[1], rect.boundary[5],
+               rect.boundary[2], rect.boundary[6], rect.boundary[3], rect.boundary[7]);
+            fflush(stdout);
+         }
+
+         RTreeSearchRect(thread->root, &rect, (SearchRectCallback)trajectoryCallback, (void *)thread, storageMode);
+
+         ++thread->nsearch;
+      }
+   }
+
+   return((void *)NULL);
+}
+
+
+
+/********************************************************/
+/*                                                      */
+/* Callback for the trajectory search.  The candidate   */
+/* only counts if the middle of its exposure falls in   */
+/* the piece being searched (so every image is checked  */
+/* against the segment that really covers it) and the   */
+/* object, interpolated to that time, is in the image.  */
+/*                                                      */
+/********************************************************/
+
+int trajectoryCallback(long index, struct Rect *rect, void *arg)
+{
+   TrajThread *thread;
+   TrajPoint  *p0, *p1;
+
+   long   id;
+   int    interior;
+   double mid, f, unc, radiusDot;
+   Vec    pos;
+
+   thread = (TrajThread *)arg;
+
+   id = index - 1;
+
+   mid = (rect->boundary[3] + rect->boundary[7]) / 2.;
+
+   if(mid < thread->ta || mid > thread->tb)
+      return 1;
+
+   p0 = &traj[thread->seg];
+   p1 = &traj[thread->seg+1];
+
+   f = (mid - p0->pos.t) / (p1->pos.t - p0->pos.t);
+
+   trajInterp(p0, p1, thread->theta, f, &pos, &unc);
+
+   if(rectinfo[id].datatype == POINT)
+   {
+      radiusDot = cos(unc);
+
+      if(radiusDot > padDot)
+         radiusDot = padDot;
+
+      interior = (Dot(&pos, &rectinfo[id].center) > radiusDot);
+   }
+   else if(unc > 0.)
+      interior = coneOverlap(&pos, unc/dtr, cos(unc), &rectinfo[id]);
+   else
+      interior = pointInPolygon(&pos, rectinfo[id].corner);
+
+   if(rdebug > 1)
+   {
+      printf("trajectoryCallback(): segment %ld image %ld (record %ld in set %d) t=%.8f -> %d\n",
+         thread->seg, id, rectinfo[id].catoff, rectinfo[id].setid, mid, interior);
+      fflush(stdout);
+   }
+
+   if(!interior)
+      return 1;
+
+   if(thread->nhit >= thread->maxhit)
+   {
+      thread->maxhit += MAXRECT;
+
+      thread->hits = (TrajHit *)realloc(thread->hits, thread->maxhit * sizeof(TrajHit));
+   }
+
+   thread->hits[thread->nhit].id  = id;
+   thread->hits[thread->nhit].seg = thread->seg;
+   thread->hits[thread->nhit].mjd = mid;
+   thread->hits[thread->nhit].ra  = atan2(pos.y, pos.x)/dtr;
+   thread->hits[thread->nhit].dec = asin (pos.z)/dtr;
+
+   if(thread->hits[thread->nhit].ra < 0.)
+      thread->hits[thread->nhit].ra += 360.;
+
+   ++thread->nhit;
+
+   return 1;
+}
+
+
+
+/********************************************************/
+/*                                                      */
+/* Position (and uncertainty) a fraction f of the way   */
+/* from p0 to p1, along the great circle between them   */
+/* (theta is the angle between p0 and p1).  pos->t gets */
+/* the interpolated time.                               */
+/*                                                      */
+/********************************************************/
+
+void trajInterp(TrajPoint *p0, TrajPoint *p1, double theta, double f, Vec *pos, double *unc)
+{
+   double a, b;
+
+   if(sin(theta) < 1.e-9)
+   {
+      a = 1. - f;
+      b = f;
+   }
+   else
+   {
+      a = sin((1.-f)*theta) / sin(theta);
+      b = sin(    f *theta) / sin(theta);
+   }
+
+   pos->x = a * p0->pos.x + b * p1->pos.x;
+   pos->y = a * p0->pos.y + b * p1->pos.y;
+   pos->z = a * p0->pos.z + b * p1->pos.z;
+
+   Normalize(pos);
+
+   pos->t = p0->pos.t + f * (p1->pos.t - p0->pos.t);
+
+   *unc = p0->unc + f * (p1->unc - p0->unc);
+}
+
+
+
+/********************************************************/
+/*                                                      */
+/* qsort() comparisons: ephemeris points by time, hits  */
+/* by image (for removing duplicates) and by time (for  */
+/* the output).                                         */
+/*                                                      */
+/********************************************************/
+
+int trajPointCmp(const void *a, const void *b)
+{
+   double ta, tb;
+
+   ta = ((TrajPoint *)a)->pos.t;
+   tb = ((TrajPoint *)b)->pos.t;
+
+   return (ta > tb) - (ta < tb);
+}
+
+
+int trajHitIdCmp(const void *a, const void *b)
+{
+   long ia, ib;
+
+   ia = ((TrajHit *)a)->id;
+   ib = ((TrajHit *)b)->id;
+
+   return (ia > ib) - (ia < ib);
+}
+
+
+int trajHitTimeCmp(const void *a, const void *b)
+{
+   TrajHit *ha, *hb;
+
+   ha = (TrajHit *)a;
+   hb = (TrajHit *)b;
+
+   if(ha->mjd != hb->mjd)
+      return (ha->mjd > hb->mjd) - (ha->mjd < hb->mjd);
+
+   return (ha->id > hb->id) - (ha->id < hb->id);
+}
+
+
 /*********************************************/
 /*                                           */
 /* Check whether a point is inside a polygon */
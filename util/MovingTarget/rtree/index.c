@@ -163,6 +163,52 @@ int RTreeSearch(struct Node *N, struct Rect *R, SearchHitCallback shcb, void* cb
 }
 
 
+/*
+ * JCG: As RTreeSearch() but the callback is also given the matching
+ * data rect.  Nothing is modified, so searches may run concurrently
+ * (in separate threads) against the same tree.
+ */
+int RTreeSearchRect(struct Node *N, struct Rect *R, SearchRectCallback shcb, void* cbarg, int mode)
+{
+        register struct Node *n = N;
+        register int hitCount = 0;
+        register int i;
+
+        if(mode == ID)
+           n = &nodes[(long)N];
+
+        assert(n);
+        assert(n->level >= 0);
+        assert(R);
+
+        if (n->level > 0) /* this is an internal node in the tree */
+        {
+                for (i=0; i<NODECARD; i++)
+                {
+                        if (n->branch[i].child &&
+                            RTreeOverlap(R,&n->branch[i].rect))
+                                hitCount += RTreeSearchRect(n->branch[i].child, R, shcb, cbarg, mode);
+                }
+        }
+        else /* this is a leaf node */
+        {
+                for (i=0; i<LEAFCARD; i++)
+                {
+                        if (n->branch[i].child &&
+                            RTreeOverlap(R,&n->branch[i].rect))
+                        {
+                                hitCount++;
+
+                                if(shcb) /* call the user-provided callback */
+                                        if( ! shcb((long)n->branch[i].child, &n->branch[i].rect, cbarg))
+                                                return hitCount; /* callback wants to terminate search early */
+                        }
+                }
+        }
+        return hitCount;
+}
+
+
 int RTreeConvertToID(struct Node *N)
 {
         register struct Node *n = N;
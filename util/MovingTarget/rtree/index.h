@@ -88,7 +88,15 @@ struct ListNode
  */
 typedef int (*SearchHitCallback)(long id, void* arg);
 
+/*
+ * The same, but also given the data rect itself (e.g. so that
+ * the caller can get at the time range without storing it twice).
+ * The rect points into the tree and must not be modified.
+ */
+typedef int (*SearchRectCallback)(long id, struct Rect *rect, void* arg);
+
 extern int RTreeSearch(struct Node*, struct Rect*, SearchHitCallback, void*, int);
+extern int RTreeSearchRect(struct Node*, struct Rect*, SearchRectCallback, void*, int);
 extern int RTreeInsertRect(struct Rect*, long, struct Node**, int depth);
 extern int RTreeDeleteRect(struct Rect*, long, struct Node**);
 extern struct Node * RTreeNewIndex(void);
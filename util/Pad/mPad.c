@@ -23,6 +23,8 @@ Version  Developer        Date     Change
 #define MAXSTR  256
 #define MAXFILE 256
 
+#define PADROWS 256
+
 char input_file  [MAXSTR];
 char output_file [MAXSTR];
 
@@ -63,7 +65,7 @@ static time_t currtime, start;
 
 int main(int argc, char **argv)
 {
-   int     i, j, jnorm, joffset, status, padline;
+   int     i, j, k, j0, nrow, jnorm, joffset, status, padline, nullcnt;
    int     nowcs, haveBar, index, offset;
    double  imin, imax, jmin, jmax;
    int     left, right, top, bottom;
@@ -73,6 +75,7 @@ int main(int argc, char **argv)
    double  dataval[256];
 
    double *outbuffer;
+   double *outblock;
 
    char   *end;
    char    histfile  [1024];
@@ -399,25 +402,33 @@ int main(int argc, char **argv)
 
    /*****************************************************/ 
    /* Allocate memory for the input/output image pixels */ 
-   /* (same size as the input image)                    */ 
+   /* (blocks of PADROWS rows, so each FITS read/write  */ 
+   /* moves many rows at once).  With no left/right     */ 
+   /* padding the input rows are read directly into the */ 
+   /* output block.                                     */ 
    /*****************************************************/ 
 
-   outbuffer = (double *)malloc(output.naxes[0] * sizeof(double));
+   outblock = (double *)malloc(PADROWS * output.naxes[0] * sizeof(double));
 
    if(debug >= 1)
    {
-      printf("%ld bytes allocated for row of output image pixels\n", 
-         output.naxes[0] * sizeof(double));
+      printf("%ld bytes allocated for block of output image pixels\n", 
+         PADROWS * output.naxes[0] * sizeof(double));
       fflush(stdout);
    }
 
-   inbuffer = (double *)malloc(input.naxes[0] * sizeof(double));
+   inbuffer = outblock;
 
-   if(debug >= 1)
+   if(left != 0 || right != 0)
    {
-      printf("%ld bytes allocated for row of input image pixels\n", 
-         input.naxes[0] * sizeof(double));
-      fflush(stdout);
+      inbuffer = (double *)malloc(PADROWS * input.naxes[0] * sizeof(double));
+
+      if(debug >= 1)
+      {
+         printf("%ld bytes allocated for block of input image pixels\n", 
+            PADROWS * input.naxes[0] * sizeof(double));
+         fflush(stdout);
+      }
    }
 
 
@@ -450,50 +461,61 @@ int main(int argc, char **argv)
    if(input.flip)
       padline = top;
 
-   for(j=0; j<padline; ++j)
+   for(j0=0; j0<padline; j0+=PADROWS)
    {
-      if(debug >= 2)
+      nrow = padline - j0;
+
+      if(nrow > PADROWS)
+         nrow = PADROWS;
+
+      for(k=0; k<nrow; ++k)
       {
-         if(debug >= 3)
-            printf("\n");
+         j = j0 + k;
 
-         printf("\rPad initial row %d", j);
+         if(debug >= 2)
+         {
+            if(debug >= 3)
+               printf("\n");
 
-         if(debug >= 3)
-            printf("\n");
+            printf("\rPad initial row %d", j);
 
-         fflush(stdout);
-      }
+            if(debug >= 3)
+               printf("\n");
 
-      jnorm = j;
+            fflush(stdout);
+         }
 
-      if(input.flip)
-         jnorm = bottom + input.naxes[1] + (padline - j);
+         jnorm = j;
 
-      for (i=0; i<output.naxes[0]; ++i)
-         outbuffer[i] = NaNvalue;
+         if(input.flip)
+            jnorm = bottom + input.naxes[1] + (padline - j);
 
-      if(haveBar && jnorm >= jmin && jnorm <= jmax)
-      {
-         index = (jnorm - jmin) * 255 / (jmax - jmin);
+         outbuffer = outblock + (long)k * nelementsout;
 
-         offset = (jnorm - jmin)/50;
+         for (i=0; i<output.naxes[0]; ++i)
+            outbuffer[i] = NaNvalue;
 
-         val = dataval[index];
+         if(haveBar && jnorm >= jmin && jnorm <= jmax)
+         {
+            index = (jnorm - jmin) * 255 / (jmax - jmin);
 
-         if(debug >= 1 && offset * 50 == (jnorm - jmin))
-            printf("BAR LABEL> %d %s\n", jnorm, datavalStr[index]);
+            offset = (jnorm - jmin)/50;
 
-         for(i=imin; i<=imax; ++i)
-            outbuffer[i] = val;
-      }
+            val = dataval[index];
 
+            if(debug >= 1 && offset * 50 == (jnorm - jmin))
+               printf("BAR LABEL> %d %s\n", jnorm, datavalStr[index]);
 
-      if (fits_write_pix(output.fptr, TDOUBLE, fpixelout, nelementsout, 
-                         outbuffer, &status))
+            for(i=imin; i<=imax; ++i)
+               outbuffer[i] = val;
+         }
+      }
+
+      if (fits_write_pix(output.fptr, TDOUBLE, fpixelout, nrow * nelementsout, 
+                         outblock, &status))
          printFitsError(status);
 
-      ++fpixelout[1];
+      fpixelout[1] += nrow;
    }
 
 
@@ -503,68 +525,85 @@ int main(int argc, char **argv)
 
    status = 0;
 
-   for (j=0; j<input.naxes[1]; ++j)
+   for (j0=0; j0<input.naxes[1]; j0+=PADROWS)
    {
-      if(debug >= 2)
-      {
-         if(debug >= 3)
-            printf("\n");
+      nrow = input.naxes[1] - j0;
 
-         printf("\rProcessing input row %5d", j);
+      if(nrow > PADROWS)
+         nrow = PADROWS;
 
-         if(debug >= 3)
-            printf("\n");
 
-         fflush(stdout);
-      }
+      /* Read a block of lines from the input file */
 
-      for (i=0; i<output.naxes[0]; ++i)
-         outbuffer[i] = NaNvalue;
+      if(fits_read_pix(input.fptr, TDOUBLE, fpixelin, nrow * nelementsin, &nan,
+                       inbuffer, &nullcnt, &status))
+         printFitsError(status);
+      
 
+      /* For each input line */
 
-      /* Read a line from the input file */
+      for(k=0; k<nrow; ++k)
+      {
+         j = j0 + k;
 
-      if(fits_read_pix(input.fptr, TDOUBLE, fpixelin, nelementsin, &nan,
-                       inbuffer, NULL, &status))
-         printFitsError(status);
-      
+         if(debug >= 2)
+         {
+            if(debug >= 3)
+               printf("\n");
 
-      /* For each input pixel */
+            printf("\rProcessing input row %5d", j);
 
-      jnorm = j + bottom;
+            if(debug >= 3)
+               printf("\n");
 
-      if(input.flip)
-         jnorm = bottom + (input.naxes[1] - j);
+            fflush(stdout);
+         }
 
-      for (i=0; i<input.naxes[0]; ++i)
-         outbuffer[i+left] = inbuffer[i];
+         jnorm = j + bottom;
 
-      if(haveBar && jnorm >= jmin && jnorm <= jmax)
-      {
-         index = (jnorm - jmin) * 255 / (jmax - jmin);
+         if(input.flip)
+            jnorm = bottom + (input.naxes[1] - j);
 
-         offset = (jnorm - jmin)/50;
+         outbuffer = outblock + (long)k * nelementsout;
 
-         val = dataval[index];
+         if(inbuffer != outblock)
+         {
+            for (i=0; i<left; ++i)
+               outbuffer[i] = NaNvalue;
 
-         if(debug >= 1 && offset * 50 == (jnorm - jmin))
-            printf("BAR LABEL> %d %s\n", jnorm, datavalStr[index]);
+            memcpy(outbuffer + left, inbuffer + (long)k * nelementsin, 
+                   nelementsin * sizeof(double));
 
+            for (i=left+input.naxes[0]; i<output.naxes[0]; ++i)
+               outbuffer[i] = NaNvalue;
+         }
 
-         for(i=imin; i<=imax; ++i)
-            outbuffer[i] = val;
-      }
+         if(haveBar && jnorm >= jmin && jnorm <= jmax)
+         {
+            index = (jnorm - jmin) * 255 / (jmax - jmin);
+
+            offset = (jnorm - jmin)/50;
+
+            val = dataval[index];
+
+            if(debug >= 1 && offset * 50 == (jnorm - jmin))
+               printf("BAR LABEL> %d %s\n", jnorm, datavalStr[index]);
 
 
+            for(i=imin; i<=imax; ++i)
+               outbuffer[i] = val;
+         }
+      }
+
 
-      /* Write the output buffer */
+      /* Write the output block */
 
-      if (fits_write_pix(output.fptr, TDOUBLE, fpixelout, nelementsout, 
-                         outbuffer, &status))
+      if (fits_write_pix(output.fptr, TDOUBLE, fpixelout, nrow * nelementsout, 
+                         outblock, &status))
          printFitsError(status);
 
-      ++fpixelin [1];
-      ++fpixelout[1];
+      fpixelin [1] += nrow;
+      fpixelout[1] += nrow;
    }
 
 
@@ -576,49 +615,61 @@ int main(int argc, char **argv)
    if(input.flip)
       padline = bottom;
 
-   for(j=0; j<padline; ++j)
+   for(j0=0; j0<padline; j0+=PADROWS)
    {
-      if(debug >= 2)
+      nrow = padline - j0;
+
+      if(nrow > PADROWS)
+         nrow = PADROWS;
+
+      for(k=0; k<nrow; ++k)
       {
-         if(debug >= 3)
-            printf("\n");
+         j = j0 + k;
 
-         printf("\rPad final row %d", j);
+         if(debug >= 2)
+         {
+            if(debug >= 3)
+               printf("\n");
 
-         if(debug >= 3)
-            printf("\n");
+            printf("\rPad final row %d", j);
 
-         fflush(stdout);
-      }
+            if(debug >= 3)
+               printf("\n");
 
-      jnorm = j + bottom + input.naxes[1];
+            fflush(stdout);
+         }
 
-      if(input.flip)
-         jnorm = padline - j;
+         jnorm = j + bottom + input.naxes[1];
 
-      for (i=0; i<output.naxes[0]; ++i)
-         outbuffer[i] = NaNvalue;
+         if(input.flip)
+            jnorm = padline - j;
 
-      if(haveBar && jnorm >= jmin && jnorm <= jmax)
-      {
-         index = (jnorm - jmin) * 255 / (jmax - jmin);
+         outbuffer = outblock + (long)k * nelementsout;
+
+         for (i=0; i<output.naxes[0]; ++i)
+            outbuffer[i] = NaNvalue;
+
+         if(haveBar && jnorm >= jmin && jnorm <= jmax)
+         {
+            index = (jnorm - jmin) * 255 / (jmax - jmin);
 
-         offset = (jnorm - jmin)/50;
+            offset = (jnorm - jmin)/50;
 
-         val = dataval[index];
+            val = dataval[index];
 
-         if(debug >= 1 && offset * 50 == (jnorm - jmin))
-            printf("BAR LABEL> %d %s\n", jnorm, datavalStr[index]);
+            if(debug >= 1 && offset * 50 == (jnorm - jmin))
+               printf("BAR LABEL> %d %s\n", jnorm, datavalStr[index]);
 
-         for(i=imin; i<=imax; ++i)
-            outbuffer[i] = val;
+            for(i=imin; i<=imax; ++i)
+               outbuffer[i] = val;
+         }
       }
 
-      if (fits_write_pix(output.fptr, TDOUBLE, fpixelout, nelementsout, 
-                         outbuffer, &status))
+      if (fits_write_pix(output.fptr, TDOUBLE, fpixelout, nrow * nelementsout, 
+                         outblock, &status))
          printFitsError(status);
 
-      ++fpixelout[1];
+      fpixelout[1] += nrow;
    }
 
 
@@ -648,8 +699,10 @@ int main(int argc, char **argv)
       fflush(stdout);
    }
 
-   free(inbuffer);
-   free(outbuffer);
+   if(inbuffer != outblock)
+      free(inbuffer);
+
+   free(outblock);
 
    printf("[struct stat=\"OK\"]\n");
    fflush(stdout);
@@ -15,6 +15,7 @@ Version  Developer        Date     Change
 #include <sys/types.h>
 #include <time.h>
 #include <math.h>
+#include <pthread.h>
 #include <fitsio.h>
 #include <wcs.h>
 #include <coord.h>
@@ -25,6 +26,9 @@ Version  Developer        Date     Change
 #define MAXSTR  1024
 #define MAXFILE 1024
 
+#define NTHREAD    4     /* Default number of threads            */
+#define ROTROWS  256     /* Output rows computed/written at once */
+
 extern char *optarg;
 extern int optind, opterr;
 
@@ -43,6 +47,8 @@ int  rotInit       ();
 int  rotFwd        (double iin, double jin, double *iout, double *jout);
 int  rotRev        (double iout, double jout, double *iin, double *jin);
 
+void *rotRows      (void *ptr);
+
 int  checkHdr      (char *infile, int hdrflag, int hdu);
 int  checkWCS      (struct WorldCoor *wcs, int action);
 void fixxy         (double *x, double *y, int *offscl);
@@ -83,6 +89,30 @@ int haveCD2_1;
 int haveCD2_2;
 
 
+/* What each thread needs to fill its share of */
+/* a band of output rows                       */
+
+struct rotWork
+{
+   int       jbegin;       /* First output row (pixel coordinates) */
+   int       nrow;
+   int       start;        /* This thread does rows start,         */
+   int       stride;       /* start+stride, ...                    */
+
+   double  **indata;
+   int       inibegin, injbegin;
+   long      innelements;
+   int       inlines;
+
+   double   *xcos;         /* Per-column rotation terms */
+   double   *xsin;
+   long      outnelements;
+
+   double   *outdata;      /* nrow rows of output */
+   double    nan;
+};
+
+
 /*****************************************************/
 /*                                                   */
 /*  mRotate                                          */
@@ -95,7 +125,8 @@ int haveCD2_2;
 
 int main(int argc, char **argv)
 {
-   int       i, j, nullcnt, status, inlines;
+   int       i, j, k, t, nrow, nullcnt, status, inlines;
+   int       nthread, nthr;
    int       iin, jin, haveRegion, offscl, sys;
    int       outibegin, outiend, outjbegin, outjend;
    int       inibegin, iniend, injbegin, injend;
@@ -111,6 +142,11 @@ int main(int argc, char **argv)
 
    double  **indata;
    double   *outdata;
+   double   *xcos, *xsin;
+   double    xout;
+
+   pthread_t      *threads;
+   struct rotWork *work;
 
    char     *end;
 
@@ -142,6 +178,7 @@ int main(int argc, char **argv)
    debug    = 0;
    fstatus  = stdout;
    rotation = 0.;
+   nthread  = NTHREAD;
 
    for(i=0; i<argc; ++i)
    {
@@ -162,6 +199,8 @@ int main(int argc, char **argv)
 
          argv += 2;
          argc -= 2;
+
+         i = 0;
       }
 
       if(strcmp(argv[i], "-r") == 0)
@@ -182,6 +221,30 @@ int main(int argc, char **argv)
 
          argv += 2;
          argc -= 2;
+
+         i = 0;
+      }
+
+      if(strcmp(argv[i], "-n") == 0)
+      {
+         if(i+1 >= argc)
+         {
+            printf("[struct stat=\"ERROR\", msg=\"No thread count given\"]\n");
+            exit(1);
+         }
+
+         nthread = strtol(argv[i+1], &end, 0);
+
+         if(end - argv[i+1] < strlen(argv[i+1]) || nthread < 1)
+         {
+            printf("[struct stat=\"ERROR\", msg=\"Thread count string is invalid: '%s'\"]\n", argv[i+1]);
+            exit(1);
+         }
+
+         argv += 2;
+         argc -= 2;
+
+         i = 0;
       }
 
       if(strcmp(argv[i], "-d") == 0)
@@ -208,12 +271,14 @@ int main(int argc, char **argv)
 
          argv += 2;
          argc -= 2;
+
+         i = 0;
       }
    }
    
    if (argc < 3) 
    {
-      printf ("[struct stat=\"ERROR\", msg=\"Usage: mRotate [-d level] [-s statusfile] [-r rotang] in.fits out.fits [ra dec xsize [ysize]]\"]\n");
+      printf ("[struct stat=\"ERROR\", msg=\"Usage: mRotate [-d level] [-s statusfile] [-r rotang] [-n nthread] in.fits out.fits [ra dec xsize [ysize]]\"]\n");
       exit(1);
    }
 
@@ -662,12 +727,12 @@ int main(int argc, char **argv)
    /* Allocate memory for the output image pixels */ 
    /***********************************************/ 
 
-   outdata = (double *)malloc(outnelements * sizeof(double));
+   outdata = (double *)malloc(ROTROWS * outnelements * sizeof(double));
 
    if(debug >= 1)
    {
-      printf("%ld bytes allocated for output image pixel row\n", 
-         outnelements * sizeof(double));
+      printf("%ld bytes allocated for output image pixel rows\n", 
+         ROTROWS * outnelements * sizeof(double));
       printf("\n");
       fflush(stdout);
    }
@@ -687,7 +752,7 @@ int main(int argc, char **argv)
    if(debug >= 3)
       printf("\n");
 
-   for (j=injbegin; j<injend; ++j)
+   for (j=injbegin; j<=injend; ++j)
    {
       if(debug >= 2)
       {
@@ -816,21 +881,52 @@ int main(int argc, char **argv)
    }
 
 
-   /************************/
-   /* Write the image data */
-   /************************/
+   /***********************************************/
+   /* The rotation terms that depend only on the  */
+   /* output column are the same for every row    */
+   /***********************************************/
+
+   xcos = (double *)malloc(outnelements * sizeof(double));
+   xsin = (double *)malloc(outnelements * sizeof(double));
+
+   for(i=outibegin; i<=outiend; ++i)
+   {
+      xout = (double)i - naxis1out/2.;
+
+      xcos[i-outibegin] =  xout*cost;
+      xsin[i-outibegin] = -xout*sint;
+   }
+
+
+   /************************************************/
+   /* Write the image data, a band of rows at a    */
+   /* time.  The rows of each band are shared out  */
+   /* among the threads; they only read the input  */
+   /* so no locking is needed.                     */
+   /************************************************/
+
+   if(debug >= 3)
+      nthread = 1;
+
+   threads = (pthread_t *)     malloc(nthread * sizeof(pthread_t));
+   work    = (struct rotWork *)malloc(nthread * sizeof(struct rotWork));
 
    fpixel[0] = 1;
    fpixel[1] = 1;
 
-   for(j=outjbegin; j<=outjend; ++j)
+   for(j=outjbegin; j<=outjend; j+=nrow)
    {
+      nrow = ROTROWS;
+
+      if(j + nrow - 1 > outjend)
+         nrow = outjend - j + 1;
+
       if(debug >= 2)
       {
          if(debug >= 3)
             printf("\n");
 
-         printf("\rWriting output row %5d  ", j);
+         printf("\rWriting output rows %5d-%5d  ", j, j+nrow-1);
 
          if(debug >= 3)
             printf("\n");
@@ -838,50 +934,68 @@ int main(int argc, char **argv)
          fflush(stdout);
       }
 
-      for(i=outibegin; i<= outiend; ++i)
-      {
-         rotRev((double)i, (double)j, &xin, &yin);
+      nthr = nthread;
 
-         iin = (int)(xin + 0.5);
-         jin = (int)(yin + 0.5);
+      if(nthr > nrow)
+         nthr = nrow;
 
-         if(debug >= 3)
+      for(t=0; t<nthr; ++t)
+      {
+         work[t].jbegin       = j;
+         work[t].nrow         = nrow;
+         work[t].start        = t;
+         work[t].stride       = nthr;
+         work[t].indata       = indata;
+         work[t].inibegin     = inibegin;
+         work[t].injbegin     = injbegin;
+         work[t].innelements  = innelements;
+         work[t].inlines      = inlines;
+         work[t].xcos         = xcos;
+         work[t].xsin         = xsin;
+         work[t].outnelements = outnelements;
+         work[t].outdata      = outdata;
+         work[t].nan          = nan;
+      }
+
+      for(t=1; t<nthr; ++t)
+      {
+         if(pthread_create(&threads[t], NULL, rotRows, &work[t]))
          {
-            printf("iin = %d (0 to %ld)   jin = %d (0 to %ld) -> indata[%d][%d]\n",
-               iin, input.naxes[0], jin, input.naxes[1], 
-               jin-injbegin, iin-inibegin);
-            fflush(stdout);
-         }
+            rotRows(&work[t]);
 
-         if(iin-inibegin < 0 || iin-inibegin >= innelements
-         || jin-injbegin < 0 || jin-injbegin >= inlines)
-            outdata[i-outibegin] = nan;
-         else
-            outdata[i-outibegin] = indata[jin-injbegin][iin-inibegin];
+            work[t].nrow = -1;
+         }
+      }
 
+      rotRows(&work[0]);
 
-         if(debug >= 3)
-         {
-            printf("outdata[%d] = %-g\n", i-outibegin, outdata[i-outibegin]);
-            fflush(stdout);
-         }
+      for(t=1; t<nthr; ++t)
+      {
+         if(work[t].nrow >= 0)
+            pthread_join(threads[t], NULL);
       }
 
       if(debug >= 2)
       {
-         for(i=0; i<outnelements; ++i)
-            printf("line %d: outdata[%d] = %-g\n",
-               j, i, outdata[i]);
+         for(k=0; k<nrow; ++k)
+            for(i=0; i<outnelements; ++i)
+               printf("line %d: outdata[%d] = %-g\n",
+                  j+k, i, outdata[k*outnelements+i]);
          fflush(stdout);
       }
 
-      if (fits_write_pix(output.fptr, TDOUBLE, fpixel, outnelements, 
+      if (fits_write_pix(output.fptr, TDOUBLE, fpixel, nrow * outnelements, 
                          (void *)outdata, &status))
          printFitsError(status);
 
-      ++fpixel[1];
+      fpixel[1] += nrow;
    }
 
+   free(threads);
+   free(work);
+   free(xcos);
+   free(xsin);
+
    if(debug >= 1)
    {
       printf("Data written to FITS data image\n"); 
@@ -1100,6 +1214,67 @@ void printFitsError(int status)
 }
 
 
+/***********************************************************/
+/*                                                         */
+/*  Fill this thread's rows of a band of output.  This is  */
+/*  rotRev() for each pixel, reorganized so the terms that */
+/*  depend only on the column come from the tables (the    */
+/*  arithmetic is the same so the pixels chosen are too).  */
+/*                                                         */
+/***********************************************************/
+
+void *rotRows(void *ptr)
+{
+   int     i, k, iin, jin;
+   double  yout, ysin, ycos;
+   double  xin, yin;
+   double *out;
+
+   struct rotWork *work;
+
+   work = (struct rotWork *)ptr;
+
+   for(k=work->start; k<work->nrow; k+=work->stride)
+   {
+      yout = (double)(work->jbegin + k) - naxis2out/2.;
+
+      ysin = yout*sint;
+      ycos = yout*cost;
+
+      out = work->outdata + k * work->outnelements;
+
+      for(i=0; i<work->outnelements; ++i)
+      {
+         xin = work->xcos[i] + ysin;
+         yin = work->xsin[i] + ycos;
+
+         xin = xin + naxis1in/2.;
+         yin = yin + naxis2in/2.;
+
+         iin = (int)(xin + 0.5);
+         jin = (int)(yin + 0.5);
+
+         if(debug >= 3)
+         {
+            printf("iin = %d (0 to %ld)   jin = %d (0 to %ld) -> indata[%d][%d]\n",
+               iin, input.naxes[0], jin, input.naxes[1], 
+               jin-work->injbegin, iin-work->inibegin);
+            fflush(stdout);
+         }
+
+         if(iin-work->inibegin < 0 || iin-work->inibegin >= work->innelements
+         || jin-work->injbegin < 0 || jin-work->injbegin >= work->inlines)
+            out[i] = work->nan;
+         else
+            out[i] = work->indata[jin-work->injbegin][iin-work->inibegin];
+      }
+   }
+
+   return NULL;
+}
+
+
+
 int rotInit()
 {
    if(wcs->coorflip)
@@ -0,0 +1,1613 @@
+/* Module: mTileServer.c
+
+*/
+
+/*************************************************************************/
+/*                                                                       */
+/*  mTileServer                                                          */
+/*                                                                       */
+/*  The web viewer makes each new view of a mosaic by running mSubimage  */
+/*  and mShrink (once per color channel) and then rendering the result.  */
+/*  For very large mosaics that means reading most of the file for every */
+/*  zoom or pan.                                                         */
+/*                                                                       */
+/*  This program has two parts.  In "build" mode (-b) it reads a FITS    */
+/*  image once and writes a multi-resolution pyramid file:  level 0 is   */
+/*  the original image and each following level is a 2x2 average of the */
+/*  one before, until the whole image fits in one tile.  Every level is  */
+/*  stored as square single-precision tiles so any region can be read    */
+/*  by touching just the tiles it overlaps.                              */
+/*                                                                       */
+/*  In server mode the pyramid files are memory-mapped and kept open.    */
+/*  Commands are read one per line (from stdin, or from TCP connections  */
+/*  on a local port with -p) and answered with the usual Montage return  */
+/*  structure.  A "subimage" request picks the deepest pyramid level     */
+/*  that is no coarser than the requested shrink factor, reads only the  */
+/*  tiles it needs, does any residual (< 2x) shrinking by area weighting */
+/*  and writes a FITS file with the WCS adjusted to match, exactly what  */
+/*  the viewer would otherwise get from mSubimage + mShrink.  The        */
+/*  pyramid is single precision, so unshrunk (factor 1) cutouts are      */
+/*  read from the original FITS file instead when it is available.       */
+/*                                                                       */
+/*  Output files can only be written in the server's output directory    */
+/*  tree (-o, default the current directory): a plain file name goes in  */
+/*  that directory, and a path must lead to an existing directory inside */
+/*  it (e.g. a viewer workspace).                                        */
+/*                                                                       */
+/*  Commands:                                                            */
+/*                                                                       */
+/*     info                                                              */
+/*     subimage <image> out.fits xstart ystart xsize ysize [factor]      */
+/*     quit                                                              */
+/*                                                                       */
+/*  <image> is either the original FITS file name the pyramid was built  */
+/*  from or the pyramid index (0, 1, ...) in the server command line.    */
+/*  Pixel ranges follow the mSubimage -p convention.                     */
+/*                                                                       */
+/*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <limits.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <fitsio.h>
+#include <fitshead.h>
+#include <svc.h>
+
+#include "montage.h"
+#include "mNaN.h"
+
+#define MAXSTR     1024
+#define MAXLEVEL     32
+#define MAXPYR      256
+#define MAXARG       32
+
+#define PYR_MAGIC  "MPYRAMID"
+#define PYR_VERSION   2
+
+#define PAGESIZE   4096
+
+
+/* The pyramid file starts with this header, followed by the  */
+/* original FITS header text and then (page-aligned) tile data */
+
+typedef struct
+{
+   long long naxis1;
+   long long naxis2;
+   long long ntilex;
+   long long ntiley;
+   long long offset;
+}
+PyrLevel;
+
+typedef struct
+{
+   char      magic[8];
+   int       version;
+   int       tilesize;
+   int       nlevel;
+   int       hdrlen;
+   int       hdu;
+   long long naxis1;
+   long long naxis2;
+   char      source[MAXSTR];
+   PyrLevel  level[MAXLEVEL];
+}
+PyrHeader;
+
+
+/* An open (memory-mapped) pyramid in server mode */
+
+typedef struct
+{
+   char      file[MAXSTR];
+   int       fd;
+   size_t    size;
+   char     *map;
+   PyrHeader hdr;
+   char     *header;
+}
+Pyramid;
+
+
+int      buildPyramid  (char *infile, int hdu, char *pyrfile, int tilesize);
+int      openPyramid   (char *pyrfile, Pyramid *pyr);
+int      serveStream   (FILE *fin, FILE *fout);
+int      serveCommand  (char *cmd, FILE *fout);
+int      subimage      (Pyramid *pyr, char *outfile, double x, double y,
+                        double xsize, double ysize, double factor, char *retstr);
+int      subimageSource(Pyramid *pyr, char *outfile, long long ibegin, long long iend,
+                        long long jbegin, long long jend);
+int      outputPath    (char *name, char *path);
+int      writeHeader   (fitsfile *fptr, Pyramid *pyr, long *naxes, double scale,
+                        double xoff, double yoff, double residual, int *status);
+void     residualWeights(int nin, int nout, double r, int *start, int *count, double *wt, int maxw);
+
+static inline float pyrPixel(Pyramid *pyr, int lev, long long i, long long j);
+
+void     printFitsError(int err);
+
+Pyramid  pyramid[MAXPYR];
+int      npyramid;
+
+int      debug;
+
+char     outdir[PATH_MAX];
+
+char     errstr[MAXSTR];
+
+float    fnan;
+double   dnan;
+
+
+/*************************************************************************/
+/*                                                                       */
+/*  Main routine:  command-line handling, then either build a pyramid    */
+/*  file or load pyramids and serve requests.                            */
+/*                                                                       */
+/*************************************************************************/
+
+int main(int argc, char **argv)
+{
+   int    i, c, build, hdu, tilesize, port, opt, sock, conn;
+   char  *end;
+
+   struct stat statbuf;
+
+   struct sockaddr_in addr;
+
+   FILE  *fin, *fout;
+
+   union
+   {
+      double d;
+      char   c[8];
+   }
+   value;
+
+   union
+   {
+      float f;
+      char  c[4];
+   }
+   fvalue;
+
+   extern char *optarg;
+   extern int   optind, opterr;
+
+
+   /*****************************************/
+   /* Make NaN values to use for blank data */
+   /*****************************************/
+
+   for(i=0; i<8; ++i)
+      value.c[i] = 255;
+
+   dnan = value.d;
+
+   for(i=0; i<4; ++i)
+      fvalue.c[i] = 255;
+
+   fnan = fvalue.f;
+
+
+   /***************************************/
+   /* Process the command-line parameters */
+   /***************************************/
+
+   fstatus = stdout;
+
+   debug    = 0;
+   build    = 0;
+   hdu      = 0;
+   tilesize = 256;
+   port     = -1;
+
+   if(realpath(".", outdir) == (char *)NULL)
+      strcpy(outdir, ".");
+
+   opterr = 0;
+
+   while ((c = getopt(argc, argv, "bd:h:t:p:o:")) != EOF)
+   {
+      switch (c)
+      {
+         case 'b':
+            build = 1;
+            break;
+
+         case 'd':
+            debug = strtol(optarg, &end, 0);
+
+            if(end < optarg + strlen(optarg) || debug < 0)
+            {
+               printf("[struct stat=\"ERROR\", msg=\"Invalid debug level: '%s'\"]\n", optarg);
+               exit(1);
+            }
+            break;
+
+         case 'h':
+            hdu = strtol(optarg, &end, 0);
+
+            if(end < optarg + strlen(optarg) || hdu < 0)
+            {
+               printf("[struct stat=\"ERROR\", msg=\"HDU value (%s) must be a non-negative integer\"]\n", optarg);
+               exit(1);
+            }
+            break;
+
+         case 't':
+            tilesize = strtol(optarg, &end, 0);
+
+            if(end < optarg + strlen(optarg) || tilesize < 16)
+            {
+               printf("[struct stat=\"ERROR\", msg=\"Tile size (%s) must be an integer of at least 16\"]\n", optarg);
+               exit(1);
+            }
+            break;
+
+         case 'p':
+            port = strtol(optarg, &end, 0);
+
+            if(end < optarg + strlen(optarg) || port <= 0 || port > 65535)
+            {
+               printf("[struct stat=\"ERROR\", msg=\"Invalid port number: '%s'\"]\n", optarg);
+               exit(1);
+            }
+            break;
+
+         case 'o':
+            if(stat(optarg, &statbuf) != 0 || !S_ISDIR(statbuf.st_mode)
+            || realpath(optarg, outdir) == (char *)NULL)
+            {
+               printf("[struct stat=\"ERROR\", msg=\"Output directory '%s' does not exist\"]\n", optarg);
+               exit(1);
+            }
+            break;
+
+         default:
+            printf("[struct stat=\"ERROR\", msg=\"Usage: %s -b [-d level][-h hdu][-t tilesize] in.fits out.pyr | %s [-d level][-p port][-o outdir] in.pyr [in2.pyr ...]\"]\n", argv[0], argv[0]);
+            exit(1);
+            break;
+      }
+   }
+
+
+   /*************************************/
+   /* Build mode: make the pyramid file */
+   /*************************************/
+
+   if(build)
+   {
+      if(argc - optind < 2)
+      {
+         printf("[struct stat=\"ERROR\", msg=\"Usage: %s -b [-d level][-h hdu][-t tilesize] in.fits out.pyr\"]\n", argv[0]);
+         exit(1);
+      }
+
+      if(buildPyramid(argv[optind], hdu, argv[optind+1], tilesize))
+      {
+         printf("[struct stat=\"ERROR\", msg=\"%s\"]\n", errstr);
+         exit(1);
+      }
+
+      printf("[struct stat=\"OK\", nlevel=%d, tilesize=%d, naxis1=%lld, naxis2=%lld]\n",
+         pyramid[0].hdr.nlevel, pyramid[0].hdr.tilesize,
+         pyramid[0].hdr.naxis1, pyramid[0].hdr.naxis2);
+      fflush(stdout);
+      exit(0);
+   }
+
+
+   /*********************************************/
+   /* Server mode: map the pyramids (read-only) */
+   /*********************************************/
+
+   if(argc - optind < 1)
+   {
+      printf("[struct stat=\"ERROR\", msg=\"Usage: %s [-d level][-p port][-o outdir] in.pyr [in2.pyr ...]\"]\n", argv[0]);
+      exit(1);
+   }
+
+   npyramid = 0;
+
+   for(i=optind; i<argc; ++i)
+   {
+      if(npyramid >= MAXPYR)
+      {
+         printf("[struct stat=\"ERROR\", msg=\"Too many pyramid files (max %d)\"]\n", MAXPYR);
+         exit(1);
+      }
+
+      if(openPyramid(argv[i], &pyramid[npyramid]))
+      {
+         printf("[struct stat=\"ERROR\", msg=\"%s\"]\n", errstr);
+         exit(1);
+      }
+
+      ++npyramid;
+   }
+
+
+   /*******************************************/
+   /* Without a port we talk over stdin/stdout */
+   /* (e.g. as an svc_init() child process)    */
+   /*******************************************/
+
+   if(port < 0)
+   {
+      serveStream(stdin, stdout);
+      exit(0);
+   }
+
+
+   /*******************************************/
+   /* Otherwise listen on a local TCP port and */
+   /* give each connection its own process;    */
+   /* the mapped pages are shared by all.      */
+   /*******************************************/
+
+   signal(SIGCHLD, SIG_IGN);
+   signal(SIGPIPE, SIG_IGN);
+
+   sock = socket(AF_INET, SOCK_STREAM, 0);
+
+   if(sock < 0)
+   {
+      printf("[struct stat=\"ERROR\", msg=\"Cannot create socket: %s\"]\n", strerror(errno));
+      exit(1);
+   }
+
+   opt = 1;
+   setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (char *)&opt, sizeof(opt));
+
+   memset((void *)&addr, 0, sizeof(addr));
+
+   addr.sin_family      = AF_INET;
+   addr.sin_port        = htons(port);
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   if(bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+   {
+      printf("[struct stat=\"ERROR\", msg=\"Cannot bind to port %d: %s\"]\n", port, strerror(errno));
+      exit(1);
+   }
+
+   if(listen(sock, 64) < 0)
+   {
+      printf("[struct stat=\"ERROR\", msg=\"Cannot listen on port %d: %s\"]\n", port, strerror(errno));
+      exit(1);
+   }
+
+   printf("[struct stat=\"OK\", port=%d, npyramid=%d]\n", port, npyramid);
+   fflush(stdout);
+
+   while(1)
+   {
+      conn = accept(sock, (struct sockaddr *)NULL, NULL);
+
+      if(conn < 0)
+      {
+         if(errno == EINTR)
+            continue;
+
+         break;
+      }
+
+      if(fork() == 0)
+      {
+         close(sock);
+
+         fin  = fdopen(conn, "r");
+         fout = fdopen(dup(conn), "w");
+
+         serveStream(fin, fout);
+
+         fclose(fin);
+         fclose(fout);
+
+         exit(0);
+      }
+
+      close(conn);
+   }
+
+   exit(0);
+}
+
+
+
+/*************************************************************************/
+/*                                                                       */
+/*  Read the input image a band of "tilesize" lines at a time and write  */
+/*  level 0 tiles into the (mapped) pyramid file.  Each further level    */
+/*  is then averaged down from the one before it in the file.            */
+/*                                                                       */
+/*************************************************************************/
+
+int buildPyramid(char *infile, int hdu, char *pyrfile, int tilesize)
+{
+   int        i, j, ii, jj, lev, nkeys, status, nullcnt, fd, n;
+   long long  naxis1, naxis2, tx, ty, row, nrow, datastart;
+   long long  oi, oj, pi, pj;
+   long long  size, tilepix;
+   long       naxes[2], fpixel[4];
+   double    *buffer;
+   float     *tile, *src, val, sum;
+   char      *header, *map;
+
+   fitsfile  *fptr;
+
+   PyrHeader *hdr;
+   PyrLevel  *L, *P;
+
+
+   /*****************************************/
+   /* Open the image and get its dimensions */
+   /*****************************************/
+
+   status = 0;
+
+   if(fits_open_file(&fptr, infile, READONLY, &status))
+   {
+      sprintf(errstr, "Image file %s missing or invalid FITS", infile);
+      return 1;
+   }
+
+   if(hdu > 0)
+   {
+      if(fits_movabs_hdu(fptr, hdu+1, NULL, &status))
+      {
+         printFitsError(status);
+         return 1;
+      }
+   }
+
+   if(fits_get_img_size(fptr, 2, naxes, &status))
+   {
+      printFitsError(status);
+      return 1;
+   }
+
+   if(fits_hdr2str(fptr, 0, NULL, 0, &header, &nkeys, &status))
+   {
+      printFitsError(status);
+      return 1;
+   }
+
+   naxis1 = naxes[0];
+   naxis2 = naxes[1];
+
+
+   /*********************************************/
+   /* Work out the level sizes and file offsets */
+   /*********************************************/
+
+   hdr = &pyramid[0].hdr;
+
+   memset((void *)hdr, 0, sizeof(PyrHeader));
+
+   memcpy(hdr->magic, PYR_MAGIC, 8);
+   strncpy(hdr->source, infile, MAXSTR-1);
+
+   hdr->version  = PYR_VERSION;
+   hdr->tilesize = tilesize;
+   hdr->hdrlen   = strlen(header) + 1;
+   hdr->hdu      = hdu;
+   hdr->naxis1   = naxis1;
+   hdr->naxis2   = naxis2;
+
+   tilepix = (long long)tilesize * tilesize;
+
+   datastart = sizeof(PyrHeader) + hdr->hdrlen;
+   datastart = ((datastart + PAGESIZE - 1) / PAGESIZE) * PAGESIZE;
+
+   size = datastart;
+
+   lev = 0;
+
+   while(1)
+   {
+      if(lev >= MAXLEVEL)
+      {
+         sprintf(errstr, "Image too large for %d pyramid levels", MAXLEVEL);
+         return 1;
+      }
+
+      L = &hdr->level[lev];
+
+      L->naxis1 = naxis1;
+      L->naxis2 = naxis2;
+      L->ntilex = (naxis1 + tilesize - 1) / tilesize;
+      L->ntiley = (naxis2 + tilesize - 1) / tilesize;
+      L->offset = size;
+
+      size += L->ntilex * L->ntiley * tilepix * sizeof(float);
+
+      ++lev;
+
+      if(naxis1 <= tilesize && naxis2 <= tilesize)
+         break;
+
+      naxis1 = (naxis1 + 1) / 2;
+      naxis2 = (naxis2 + 1) / 2;
+   }
+
+   hdr->nlevel = lev;
+
+   if(debug >= 1)
+   {
+      printf("DEBUG> %d levels, tilesize %d, file size %lld\n", hdr->nlevel, tilesize, size);
+
+      for(lev=0; lev<hdr->nlevel; ++lev)
+         printf("DEBUG> level %2d: %lld x %lld (%lld x %lld tiles) at offset %lld\n", lev,
+            hdr->level[lev].naxis1, hdr->level[lev].naxis2,
+            hdr->level[lev].ntilex, hdr->level[lev].ntiley, hdr->level[lev].offset);
+
+      fflush(stdout);
+   }
+
+
+   /**********************************/
+   /* Create and map the output file */
+   /**********************************/
+
+   fd = open(pyrfile, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+   if(fd < 0)
+   {
+      sprintf(errstr, "Cannot create pyramid file %s", pyrfile);
+      return 1;
+   }
+
+   if(ftruncate(fd, (off_t)size) < 0)
+   {
+      sprintf(errstr, "Cannot allocate %lld bytes for pyramid file %s", size, pyrfile);
+      return 1;
+   }
+
+   map = (char *)mmap(0, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+   if(map == MAP_FAILED)
+   {
+      sprintf(errstr, "Cannot memory map pyramid file %s", pyrfile);
+      return 1;
+   }
+
+   memcpy(map, (void *)hdr, sizeof(PyrHeader));
+   memcpy(map + sizeof(PyrHeader), header, hdr->hdrlen);
+
+   free(header);
+
+
+   /******************************************/
+   /* Level 0: copy the image, one band of   */
+   /* tiles at a time, padding with NaNs     */
+   /******************************************/
+
+   L = &hdr->level[0];
+
+   buffer = (double *)malloc(tilesize * L->naxis1 * sizeof(double));
+
+   if(buffer == (double *)NULL)
+   {
+      sprintf(errstr, "Cannot allocate input line buffer");
+      return 1;
+   }
+
+   fpixel[0] = 1;
+   fpixel[1] = 1;
+   fpixel[2] = 1;
+   fpixel[3] = 1;
+
+   for(ty=0; ty<L->ntiley; ++ty)
+   {
+      row  = ty * tilesize;
+      nrow = L->naxis2 - row;
+
+      if(nrow > tilesize)
+         nrow = tilesize;
+
+      fpixel[1] = row + 1;
+
+      if(fits_read_pix(fptr, TDOUBLE, fpixel, nrow * L->naxis1, &dnan,
+                       buffer, &nullcnt, &status))
+      {
+         printFitsError(status);
+         return 1;
+      }
+
+      for(tx=0; tx<L->ntilex; ++tx)
+      {
+         tile = (float *)(map + L->offset + (ty * L->ntilex + tx) * tilepix * sizeof(float));
+
+         for(j=0; j<tilesize; ++j)
+         {
+            for(i=0; i<tilesize; ++i)
+            {
+               ii = tx * tilesize + i;
+
+               if(j >= nrow || ii >= L->naxis1)
+                  tile[j*tilesize + i] = fnan;
+               else
+                  tile[j*tilesize + i] = (float)buffer[(long long)j * L->naxis1 + ii];
+            }
+         }
+      }
+
+      if(debug >= 2)
+      {
+         printf("DEBUG> level 0 tile row %lld done\n", ty);
+         fflush(stdout);
+      }
+   }
+
+   free(buffer);
+
+   fits_close_file(fptr, &status);
+
+
+   /*************************************************/
+   /* Higher levels: blank-aware 2x2 block average  */
+   /*************************************************/
+
+   for(lev=1; lev<hdr->nlevel; ++lev)
+   {
+      L = &hdr->level[lev];
+      P = &hdr->level[lev-1];
+
+      for(ty=0; ty<L->ntiley; ++ty)
+      {
+         for(tx=0; tx<L->ntilex; ++tx)
+         {
+            tile = (float *)(map + L->offset + (ty * L->ntilex + tx) * tilepix * sizeof(float));
+
+            for(j=0; j<tilesize; ++j)
+            {
+               for(i=0; i<tilesize; ++i)
+               {
+                  oi = tx * tilesize + i;
+                  oj = ty * tilesize + j;
+
+                  tile[j*tilesize + i] = fnan;
+
+                  if(oi >= L->naxis1 || oj >= L->naxis2)
+                     continue;
+
+                  sum = 0.;
+                  n   = 0;
+
+                  for(jj=0; jj<2; ++jj)
+                  {
+                     pj = 2*oj + jj;
+
+                     if(pj >= P->naxis2)
+                        continue;
+
+                     for(ii=0; ii<2; ++ii)
+                     {
+                        pi = 2*oi + ii;
+
+                        if(pi >= P->naxis1)
+                           continue;
+
+                        src = (float *)(map + P->offset
+                            + ((pj / tilesize) * P->ntilex + pi / tilesize) * tilepix * sizeof(float));
+
+                        val = src[(pj % tilesize) * tilesize + pi % tilesize];
+
+                        if(!mNaN(val))
+                        {
+                           sum += val;
+                           ++n;
+                        }
+                     }
+                  }
+
+                  if(n > 0)
+                     tile[j*tilesize + i] = sum / n;
+               }
+            }
+         }
+      }
+
+      if(debug >= 1)
+      {
+         printf("DEBUG> level %d done\n", lev);
+         fflush(stdout);
+      }
+   }
+
+   if(msync(map, (size_t)size, MS_SYNC) < 0)
+   {
+      sprintf(errstr, "Error writing pyramid file %s", pyrfile);
+      return 1;
+   }
+
+   munmap(map, (size_t)size);
+   close(fd);
+
+   return 0;
+}
+
+
+
+/*************************************************************************/
+/*                                                                       */
+/*  Map an existing pyramid file read-only and check its header.         */
+/*                                                                       */
+/*************************************************************************/
+
+int openPyramid(char *pyrfile, Pyramid *pyr)
+{
+   struct stat buf;
+
+   strncpy(pyr->file, pyrfile, MAXSTR-1);
+
+   pyr->fd = open(pyrfile, O_RDONLY);
+
+   if(pyr->fd < 0)
+   {
+      sprintf(errstr, "Cannot open pyramid file %s", pyrfile);
+      return 1;
+   }
+
+   if(fstat(pyr->fd, &buf) < 0 || buf.st_size < sizeof(PyrHeader))
+   {
+      sprintf(errstr, "Invalid pyramid file %s", pyrfile);
+      return 1;
+   }
+
+   pyr->size = (size_t)buf.st_size;
+
+   pyr->map = (char *)mmap(0, pyr->size, PROT_READ, MAP_SHARED, pyr->fd, 0);
+
+   if(pyr->map == MAP_FAILED)
+   {
+      sprintf(errstr, "Cannot memory map pyramid file %s", pyrfile);
+      return 1;
+   }
+
+   memcpy((void *)&pyr->hdr, pyr->map, sizeof(PyrHeader));
+
+   if(strncmp(pyr->hdr.magic, PYR_MAGIC, 8) != 0
+   || pyr->hdr.version != PYR_VERSION
+   || pyr->hdr.nlevel  <  1
+   || pyr->hdr.nlevel  >  MAXLEVEL)
+   {
+      sprintf(errstr, "File %s is not a Montage pyramid file", pyrfile);
+      return 1;
+   }
+
+   pyr->header = pyr->map + sizeof(PyrHeader);
+
+   if(debug >= 1)
+   {
+      printf("DEBUG> mapped %s (%s): %lld x %lld, %d levels\n",
+         pyrfile, pyr->hdr.source, pyr->hdr.naxis1, pyr->hdr.naxis2, pyr->hdr.nlevel);
+      fflush(stdout);
+   }
+
+   return 0;
+}
+
+
+
+/*************************************************************************/
+/*                                                                       */
+/*  Read commands from a stream until EOF or "quit", answering each one  */
+/*  with a single-line return structure.                                 */
+/*                                                                       */
+/*************************************************************************/
+
+int serveStream(FILE *fin, FILE *fout)
+{
+   int  len;
+   char line[MAXSTR];
+
+   while(fgets(line, MAXSTR, fin) != (char *)NULL)
+   {
+      len = strlen(line);
+
+      while(len > 0 && (line[len-1] == '\n' || line[len-1] == '\r'))
+      {
+         line[len-1] = '\0';
+         --len;
+      }
+
+      if(len == 0)
+         continue;
+
+      if(serveCommand(line, fout))
+         break;
+
+      fflush(fout);
+   }
+
+   fflush(fout);
+
+   return 0;
+}
+
+
+
+/*************************************************************************/
+/*                                                                       */
+/*  Process a single command.  Returns 1 if the server should stop       */
+/*  reading from this stream.                                            */
+/*                                                                       */
+/*************************************************************************/
+
+int serveCommand(char *cmd, FILE *fout)
+{
+   int    i, cmdc, index;
+   char  *cmdv[MAXARG], *end;
+   char   retstr[MAXSTR];
+   char   outfile[MAXSTR];
+   double x, y, xsize, ysize, factor;
+
+   if(debug >= 1)
+   {
+      printf("DEBUG> command: [%s]\n", cmd);
+      fflush(stdout);
+   }
+
+   cmdc = svc_getargs(cmd, cmdv);
+
+   if(cmdc < 1)
+      return 0;
+
+   if(strcasecmp(cmdv[0], "quit") == 0)
+   {
+      fprintf(fout, "[struct stat=\"OK\"]\n");
+      return 1;
+   }
+
+   else if(strcasecmp(cmdv[0], "info") == 0)
+   {
+      fprintf(fout, "[struct stat=\"OK\", npyramid=%d", npyramid);
+
+      for(i=0; i<npyramid; ++i)
+         fprintf(fout, ", source%d=\"%s\", naxis1_%d=%lld, naxis2_%d=%lld, nlevel%d=%d",
+            i, pyramid[i].hdr.source, i, pyramid[i].hdr.naxis1, i, pyramid[i].hdr.naxis2, i, pyramid[i].hdr.nlevel);
+
+      fprintf(fout, "]\n");
+      return 0;
+   }
+
+   else if(strcasecmp(cmdv[0], "subimage") == 0)
+   {
+      if(cmdc < 7)
+      {
+         fprintf(fout, "[struct stat=\"ERROR\", msg=\"Usage: subimage <image> out.fits xstart ystart xsize ysize [factor]\"]\n");
+         return 0;
+      }
+
+
+      /* Find the pyramid, by source file name or index */
+
+      index = -1;
+
+      for(i=0; i<npyramid; ++i)
+      {
+         if(strcmp(cmdv[1], pyramid[i].hdr.source) == 0
+         || strcmp(cmdv[1], pyramid[i].file)       == 0)
+         {
+            index = i;
+            break;
+         }
+      }
+
+      if(index < 0)
+      {
+         index = strtol(cmdv[1], &end, 0);
+
+         if(end < cmdv[1] + strlen(cmdv[1]) || index < 0 || index >= npyramid)
+         {
+            fprintf(fout, "[struct stat=\"ERROR\", msg=\"No pyramid loaded for image '%s'\"]\n", cmdv[1]);
+            return 0;
+         }
+      }
+
+      x      = strtod(cmdv[3], &end);
+      y      = strtod(cmdv[4], &end);
+      xsize  = strtod(cmdv[5], &end);
+      ysize  = strtod(cmdv[6], &end);
+      factor = 1.;
+
+      if(cmdc > 7)
+         factor = strtod(cmdv[7], &end);
+
+      if(xsize <= 0. || ysize <= 0. || factor <= 0.)
+      {
+         fprintf(fout, "[struct stat=\"ERROR\", msg=\"Sizes and shrink factor must be positive\"]\n");
+         return 0;
+      }
+
+      if(outputPath(cmdv[2], outfile))
+      {
+         fprintf(fout, "[struct stat=\"ERROR\", msg=\"Invalid output file (must be a plain name in the output directory tree)\"]\n");
+         return 0;
+      }
+
+      if(subimage(&pyramid[index], outfile, x, y, xsize, ysize, factor, retstr))
+      {
+         fprintf(fout, "[struct stat=\"ERROR\", msg=\"%s\"]\n", errstr);
+         return 0;
+      }
+
+      fprintf(fout, "[struct stat=\"OK\", %s]\n", retstr);
+      return 0;
+   }
+
+   fprintf(fout, "[struct stat=\"ERROR\", msg=\"Invalid command '%s'\"]\n", cmdv[0]);
+   return 0;
+}
+
+
+
+/*************************************************************************/
+/*                                                                       */
+/*  Look up a single pixel at a given level (0-based pixel indices).     */
+/*                                                                       */
+/*************************************************************************/
+
+static inline float pyrPixel(Pyramid *pyr, int lev, long long i, long long j)
+{
+   int       ts;
+   long long tile;
+
+   PyrLevel *L;
+
+   L  = &pyr->hdr.level[lev];
+   ts = pyr->hdr.tilesize;
+
+   if(i < 0 || j < 0 || i >= L->naxis1 || j >= L->naxis2)
+      return fnan;
+
+   tile = (j / ts) * L->ntilex + i / ts;
+
+   return ((float *)(pyr->map + L->offset))[tile * ts * ts + (j % ts) * ts + i % ts];
+}
+
+
+
+/*************************************************************************/
+/*                                                                       */
+/*  Check the output file a client asked for and return its full path.   */
+/*  The file name itself must be plain (no hidden files and none of the  */
+/*  CFITSIO file name syntax: "!", "[...]", ...).  Without a directory   */
+/*  it goes in the output directory; otherwise the directory (relative   */
+/*  ones are taken from the output directory) must exist and resolve to  */
+/*  somewhere inside the output directory tree.                          */
+/*                                                                       */
+/*************************************************************************/
+
+int outputPath(char *name, char *path)
+{
+   int   i, len;
+   char  dir[MAXSTR], resolved[PATH_MAX];
+   char *base;
+
+   if(strlen(name) >= MAXSTR)
+      return 1;
+
+   base = strrchr(name, '/');
+
+   if(base)
+      ++base;
+   else
+      base = name;
+
+   len = strlen(base);
+
+   if(len == 0 || len > 255 || base[0] == '.' || base[0] == '-')
+      return 1;
+
+   for(i=0; i<len; ++i)
+   {
+      if(!isalnum((unsigned char)base[i])
+      && base[i] != '.' && base[i] != '_' && base[i] != '-')
+         return 1;
+   }
+
+   if(base == name)
+   {
+      snprintf(path, MAXSTR, "%s/%s", outdir, base);
+      return 0;
+   }
+
+   if(name[0] == '/')
+      snprintf(dir, MAXSTR, "%.*s", (int)(base - name), name);
+   else
+      snprintf(dir, MAXSTR, "%s/%.*s", outdir, (int)(base - name), name);
+
+   if(realpath(dir, resolved) == (char *)NULL)
+      return 1;
+
+   len = strlen(outdir);
+
+   if(strncmp(resolved, outdir, len) != 0
+   || (resolved[len] != '\0' && resolved[len] != '/' && strcmp(outdir, "/") != 0))
+      return 1;
+
+   if(snprintf(path, MAXSTR, "%s/%s", resolved, base) >= MAXSTR)
+      return 1;
+
+   return 0;
+}
+
+
+
+/*************************************************************************/
+/*                                                                       */
+/*  Cut out a region of the image at (approximately) the given shrink    */
+/*  factor and write it as a FITS file.  The region is given in level 0  */
+/*  pixel coordinates, using the same conventions as mSubimage -p.       */
+/*                                                                       */
+/*************************************************************************/
+
+int subimage(Pyramid *pyr, char *outfile, double x, double y,
+             double xsize, double ysize, double factor, char *retstr)
+{
+   int       lev, scale, status, maxw, ii, jj, rtn;
+   long long ibegin, iend, jbegin, jend;
+   long long li0, li1, lj0, lj1, nin1, nin2, i, j;
+   long      naxes[2], fpixel[2];
+   double    residual, flux, area, val;
+   double   *colwt, *rowwt;
+   int      *colstart, *colcount, *rowstart, *rowcount;
+   float    *outdata;
+
+   fitsfile *fptr;
+
+   PyrLevel *L;
+
+
+   /* Everything below that can fail goes to the */
+   /* single cleanup path at the end              */
+
+   colstart = (int    *)NULL;
+   colcount = (int    *)NULL;
+   colwt    = (double *)NULL;
+   rowstart = (int    *)NULL;
+   rowcount = (int    *)NULL;
+   rowwt    = (double *)NULL;
+   outdata  = (float  *)NULL;
+
+   fptr = (fitsfile *)NULL;
+
+   status = 0;
+
+   rtn = 1;
+
+
+   /*************************************************/
+   /* Full-resolution pixel range (mSubimage rules) */
+   /*************************************************/
+
+   ibegin = (long long)x;
+   iend   = (long long)(x + xsize + 0.5);
+   jbegin = (long long)y;
+   jend   = (long long)(y + ysize + 0.5);
+
+   if(ibegin < 1)              ibegin = 1;
+   if(ibegin > pyr->hdr.naxis1) ibegin = pyr->hdr.naxis1;
+   if(iend   > pyr->hdr.naxis1) iend   = pyr->hdr.naxis1;
+   if(iend   < 1)              iend   = 1;
+
+   if(jbegin < 1)              jbegin = 1;
+   if(jbegin > pyr->hdr.naxis2) jbegin = pyr->hdr.naxis2;
+   if(jend   > pyr->hdr.naxis2) jend   = pyr->hdr.naxis2;
+   if(jend   < 1)              jend   = 1;
+
+
+   /*****************************************************/
+   /* Pick the deepest level no coarser than the factor */
+   /*****************************************************/
+
+   lev   = 0;
+   scale = 1;
+
+   while(lev+1 < pyr->hdr.nlevel && 2.*scale <= factor)
+   {
+      ++lev;
+      scale *= 2;
+   }
+
+   residual = factor / scale;
+
+   if(residual < 1.)
+      residual = 1.;
+
+   L = &pyr->hdr.level[lev];
+
+
+   /* Same region in level pixels (0-based, inclusive) */
+
+   li0 = (ibegin - 1) / scale;
+   li1 = (iend   - 1) / scale;
+   lj0 = (jbegin - 1) / scale;
+   lj1 = (jend   - 1) / scale;
+
+   if(li1 >= L->naxis1) li1 = L->naxis1 - 1;
+   if(lj1 >= L->naxis2) lj1 = L->naxis2 - 1;
+
+   nin1 = li1 - li0 + 1;
+   nin2 = lj1 - lj0 + 1;
+
+   naxes[0] = floor((double)nin1 / residual);
+   naxes[1] = floor((double)nin2 / residual);
+
+   if(naxes[0] < 1) naxes[0] = 1;
+   if(naxes[1] < 1) naxes[1] = 1;
+
+   if(debug >= 1)
+   {
+      printf("DEBUG> region [%lld:%lld, %lld:%lld] -> level %d [%lld:%lld, %lld:%lld], residual %-g -> %ld x %ld\n",
+         ibegin, iend, jbegin, jend, lev, li0, li1, lj0, lj1, residual, naxes[0], naxes[1]);
+      fflush(stdout);
+   }
+
+
+   /*********************************************/
+   /* Unshrunk cutouts come straight from the   */
+   /* original image, at its own BITPIX, if we  */
+   /* can still get at it                       */
+   /*********************************************/
+
+   remove(outfile);
+
+   if(lev == 0 && residual == 1.)
+   {
+      switch(subimageSource(pyr, outfile, ibegin, iend, jbegin, jend))
+      {
+         case 0:
+            sprintf(retstr, "level=0, factor=1.000000, naxis1=%ld, naxis2=%ld, exact=1",
+               naxes[0], naxes[1]);
+            return 0;
+
+         case 1:
+            break;
+
+         default:
+            return 1;
+      }
+   }
+
+
+   /************************************************/
+   /* Area weights for the residual (< 2x) shrink  */
+   /************************************************/
+
+   maxw = (int)ceil(residual) + 2;
+
+   colstart = (int    *)malloc(naxes[0] * sizeof(int));
+   colcount = (int    *)malloc(naxes[0] * sizeof(int));
+   colwt    = (double *)malloc(naxes[0] * maxw * sizeof(double));
+   rowstart = (int    *)malloc(naxes[1] * sizeof(int));
+   rowcount = (int    *)malloc(naxes[1] * sizeof(int));
+   rowwt    = (double *)malloc(naxes[1] * maxw * sizeof(double));
+   outdata  = (float  *)malloc(naxes[0] * sizeof(float));
+
+   if(colstart == (int *)NULL || colcount == (int *)NULL || colwt == (double *)NULL
+   || rowstart == (int *)NULL || rowcount == (int *)NULL || rowwt == (double *)NULL
+   || outdata  == (float *)NULL)
+   {
+      sprintf(errstr, "Cannot allocate output buffers");
+      goto failed;
+   }
+
+   residualWeights((int)nin1, (int)naxes[0], residual, colstart, colcount, colwt, maxw);
+   residualWeights((int)nin2, (int)naxes[1], residual, rowstart, rowcount, rowwt, maxw);
+
+
+   /**************************/
+   /* Create the output file */
+   /**************************/
+
+   if(fits_create_file(&fptr, outfile, &status))
+   {
+      fptr = (fitsfile *)NULL;
+      printFitsError(status);
+      goto failed;
+   }
+
+   if(fits_create_img(fptr, FLOAT_IMG, 2, naxes, &status))
+   {
+      printFitsError(status);
+      goto failed;
+   }
+
+   if(writeHeader(fptr, pyr, naxes, (double)scale, (double)li0, (double)lj0, residual, &status))
+   {
+      printFitsError(status);
+      goto failed;
+   }
+
+
+   /*********************************************/
+   /* Fill and write the output a line at a time */
+   /*********************************************/
+
+   fpixel[0] = 1;
+
+   for(j=0; j<naxes[1]; ++j)
+   {
+      for(i=0; i<naxes[0]; ++i)
+      {
+         flux = 0.;
+         area = 0.;
+
+         for(jj=0; jj<rowcount[j]; ++jj)
+         {
+            for(ii=0; ii<colcount[i]; ++ii)
+            {
+               val = pyrPixel(pyr, lev, li0 + colstart[i] + ii, lj0 + rowstart[j] + jj);
+
+               if(mNaN(val))
+                  continue;
+
+               flux += val * colwt[i*maxw + ii] * rowwt[j*maxw + jj];
+               area +=       colwt[i*maxw + ii] * rowwt[j*maxw + jj];
+            }
+         }
+
+         if(area > 0.)
+            outdata[i] = flux / area;
+         else
+            outdata[i] = fnan;
+      }
+
+      fpixel[1] = j + 1;
+
+      if(fits_write_pix(fptr, TFLOAT, fpixel, naxes[0], (void *)outdata, &status))
+      {
+         printFitsError(status);
+         goto failed;
+      }
+   }
+
+   if(fits_close_file(fptr, &status))
+   {
+      fptr = (fitsfile *)NULL;
+      printFitsError(status);
+      goto failed;
+   }
+
+   fptr = (fitsfile *)NULL;
+
+   sprintf(retstr, "level=%d, factor=%.6f, naxis1=%ld, naxis2=%ld, exact=0",
+      lev, scale * residual, naxes[0], naxes[1]);
+
+   rtn = 0;
+
+failed:
+
+   if(fptr)
+   {
+      status = 0;
+      fits_close_file(fptr, &status);
+      remove(outfile);
+   }
+
+   free(colstart);
+   free(colcount);
+   free(colwt);
+   free(rowstart);
+   free(rowcount);
+   free(rowwt);
+   free(outdata);
+
+   return rtn;
+}
+
+
+
+/*************************************************************************/
+/*                                                                       */
+/*  Write an unshrunk cutout from the original FITS file (the HDU the    */
+/*  pyramid was built from).  The stored values are copied unchanged,    */
+/*  with the original BITPIX, BSCALE, BZERO and BLANK.  Returns 0 if the */
+/*  file was written, 1 if the original image can't be read (the caller  */
+/*  then uses pyramid level 0) and -1 on output errors (errstr is set).  */
+/*                                                                       */
+/*************************************************************************/
+
+int subimageSource(Pyramid *pyr, char *outfile, long long ibegin, long long iend,
+                   long long jbegin, long long jend)
+{
+   int       i, status, bitpix, datatype, nullcnt, rtn;
+   long      naxes[2], inaxes[2], fpixel[2], opixel[2];
+   char      card[FLEN_CARD];
+   void     *buffer;
+
+   char     *scalekey[] = {"BSCALE", "BZERO", "BLANK"};
+
+   fitsfile *infptr, *fptr;
+
+   status = 0;
+
+   if(fits_open_file(&infptr, pyr->hdr.source, READONLY, &status))
+      return 1;
+
+   if(fits_movabs_hdu(infptr, pyr->hdr.hdu + 1, NULL, &status)
+   || fits_get_img_size(infptr, 2, inaxes, &status)
+   || fits_get_img_type(infptr, &bitpix, &status)
+   || inaxes[0] != pyr->hdr.naxis1 || inaxes[1] != pyr->hdr.naxis2)
+   {
+      status = 0;
+      fits_close_file(infptr, &status);
+      return 1;
+   }
+
+   naxes[0] = iend - ibegin + 1;
+   naxes[1] = jend - jbegin + 1;
+
+   datatype = (bitpix > 0) ? TLONGLONG : TDOUBLE;
+
+   buffer = malloc(naxes[0] * 8);
+
+   fptr = (fitsfile *)NULL;
+
+   rtn = -1;
+
+   if(buffer == (void *)NULL)
+   {
+      sprintf(errstr, "Cannot allocate output buffers");
+      goto failed;
+   }
+
+   if(fits_create_file(&fptr, outfile, &status))
+   {
+      fptr = (fitsfile *)NULL;
+      printFitsError(status);
+      goto failed;
+   }
+
+   if(fits_create_img(fptr, bitpix, 2, naxes, &status)
+   || writeHeader(fptr, pyr, naxes, 1., (double)(ibegin-1), (double)(jbegin-1), 1., &status))
+   {
+      printFitsError(status);
+      goto failed;
+   }
+
+   for(i=0; i<3; ++i)
+   {
+      if(fits_read_card(infptr, scalekey[i], card, &status))
+      {
+         status = 0;
+         continue;
+      }
+
+      if(fits_write_record(fptr, card, &status))
+      {
+         printFitsError(status);
+         goto failed;
+      }
+   }
+
+
+   /* Copy the stored values without applying the scaling */
+
+   fits_set_hdustruc(fptr, &status);
+
+   fits_set_bscale(infptr, 1., 0., &status);
+   fits_set_bscale(fptr,   1., 0., &status);
+
+   fpixel[0] = ibegin;
+   opixel[0] = 1;
+
+   for(fpixel[1]=jbegin; fpixel[1]<=jend; ++fpixel[1])
+   {
+      opixel[1] = fpixel[1] - jbegin + 1;
+
+      if(fits_read_pix (infptr, datatype, fpixel, naxes[0], NULL, buffer, &nullcnt, &status)
+      || fits_write_pix(fptr,   datatype, opixel, naxes[0], buffer, &status))
+      {
+         printFitsError(status);
+         goto failed;
+      }
+   }
+
+   if(fits_close_file(fptr, &status))
+   {
+      fptr = (fitsfile *)NULL;
+      printFitsError(status);
+      goto failed;
+   }
+
+   fptr = (fitsfile *)NULL;
+
+   rtn = 0;
+
+failed:
+
+   if(fptr)
+   {
+      status = 0;
+      fits_close_file(fptr, &status);
+      remove(outfile);
+   }
+
+   status = 0;
+   fits_close_file(infptr, &status);
+
+   free(buffer);
+
+   return rtn;
+}
+
+
+
+/*************************************************************************/
+/*                                                                       */
+/*  For a 1D shrink of "nin" pixels by factor r into "nout" pixels,      */
+/*  find for each output pixel the first input pixel it overlaps, how    */
+/*  many it overlaps and the fractional overlap for each.                */
+/*                                                                       */
+/*************************************************************************/
+
+void residualWeights(int nin, int nout, double r, int *start, int *count, double *wt, int maxw)
+{
+   int    k, i, imin, imax;
+   double obegin, oend, lo, hi;
+
+   for(k=0; k<nout; ++k)
+   {
+      obegin =  (double)k     * r;
+      oend   = ((double)k+1.) * r;
+
+      imin = floor(obegin);
+      imax = ceil (oend) - 1;
+
+      if(imax >= nin)
+         imax = nin - 1;
+
+      if(imax - imin + 1 > maxw)
+         imax = imin + maxw - 1;
+
+      start[k] = imin;
+      count[k] = imax - imin + 1;
+
+      for(i=imin; i<=imax; ++i)
+      {
+         lo = (i   > obegin) ? i   : obegin;
+         hi = (i+1 < oend  ) ? i+1 : oend;
+
+         wt[k*maxw + i-imin] = (hi > lo) ? hi - lo : 0.;
+      }
+   }
+}
+
+
+
+/*************************************************************************/
+/*                                                                       */
+/*  Copy the original header keywords to the output, then reset the     */
+/*  size and WCS scale/reference keywords for the level, offset and      */
+/*  residual shrink actually used.                                       */
+/*                                                                       */
+/*************************************************************************/
+
+int writeHeader(fitsfile *fptr, Pyramid *pyr, long *naxes, double scale,
+                double xoff, double yoff, double residual, int *status)
+{
+   int    i, j, ncard, found;
+   double val, f;
+   char   card[81], key[9];
+
+   char  *skip[] = {"SIMPLE", "BITPIX", "NAXIS", "NAXIS1", "NAXIS2", "NAXIS3", "NAXIS4",
+                    "EXTEND", "BSCALE", "BZERO", "BLANK", "END", "PCOUNT", "GCOUNT",
+                    "XTENSION", "CHECKSUM", "DATASUM"};
+
+   int    nskip = sizeof(skip) / sizeof(char *);
+
+   ncard = strlen(pyr->header) / 80;
+
+   for(i=0; i<ncard; ++i)
+   {
+      strncpy(card, pyr->header + 80*i, 80);
+      card[80] = '\0';
+
+      strncpy(key, card, 8);
+      key[8] = '\0';
+
+      while(strlen(key) > 0 && key[strlen(key)-1] == ' ')
+         key[strlen(key)-1] = '\0';
+
+      if(strlen(key) == 0)
+         continue;
+
+      found = 0;
+
+      for(j=0; j<nskip; ++j)
+      {
+         if(strcmp(key, skip[j]) == 0)
+         {
+            found = 1;
+            break;
+         }
+      }
+
+      if(found)
+         continue;
+
+      if(fits_write_record(fptr, card, status))
+         return 1;
+   }
+
+   f = scale * residual;
+
+   if(hgetr8(pyr->header, "CRPIX1", &val))
+   {
+      val = ((val - 0.5) / scale + 0.5) - xoff;
+      val = (val - 0.5) / residual + 0.5;
+
+      if(fits_update_key_dbl(fptr, "CRPIX1", val, -14, (char *)NULL, status))
+         return 1;
+   }
+
+   if(hgetr8(pyr->header, "CRPIX2", &val))
+   {
+      val = ((val - 0.5) / scale + 0.5) - yoff;
+      val = (val - 0.5) / residual + 0.5;
+
+      if(fits_update_key_dbl(fptr, "CRPIX2", val, -14, (char *)NULL, status))
+         return 1;
+   }
+
+   if(hgetr8(pyr->header, "CDELT1", &val))
+      if(fits_update_key_dbl(fptr, "CDELT1", val * f, -14, (char *)NULL, status))
+         return 1;
+
+   if(hgetr8(pyr->header, "CDELT2", &val))
+      if(fits_update_key_dbl(fptr, "CDELT2", val * f, -14, (char *)NULL, status))
+         return 1;
+
+   if(hgetr8(pyr->header, "CD1_1", &val))
+      if(fits_update_key_dbl(fptr, "CD1_1", val * f, -14, (char *)NULL, status))
+         return 1;
+
+   if(hgetr8(pyr->header, "CD1_2", &val))
+      if(fits_update_key_dbl(fptr, "CD1_2", val * f, -14, (char *)NULL, status))
+         return 1;
+
+   if(hgetr8(pyr->header, "CD2_1", &val))
+      if(fits_update_key_dbl(fptr, "CD2_1", val * f, -14, (char *)NULL, status))
+         return 1;
+
+   if(hgetr8(pyr->header, "CD2_2", &val))
+      if(fits_update_key_dbl(fptr, "CD2_2", val * f, -14, (char *)NULL, status))
+         return 1;
+
+   return 0;
+}
+
+
+
+/***********************************/
+/*                                 */
+/*  Print out FITS library errors  */
+/*                                 */
+/***********************************/
+
+void printFitsError(int status)
+{
+   fits_get_errstatus(status, errstr);
+}
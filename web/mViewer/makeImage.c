@@ -3,6 +3,7 @@ Theme: This routine makes a JPEG image using montage depot's
 
     mSubimage -- to cutout the portion of image to zoom,
     mShrink   -- to resize the image to fit the canvas,
+                 (or mTileServer, if a pyramid server is running),
     mViewer   -- to make the JPEG image.
 
 Input: 
@@ -35,6 +36,8 @@ int getFitshdr (char *fname, struct FitsHdr *hdr);
 int fileCopy (char *frompath, char *toparah, char *errmsg);
 int hexLookup (char *color, char *colorstr, char *errmsg);
 int str2Integer (char *str, int *intval, char *errmsg);
+int tileServerSubimage (char *impath, char *outpath, double ss, double sl,
+    double ns, double nl, double factor, char *errmsg);
 
 
 static char ColortblVal[][30] = {
@@ -414,50 +417,59 @@ int makeImage (struct Mviewer *param)
 	        fflush (fdebug);
             }
   
-            sprintf (cmd, "mShrink %s %s %.6f", impath, shrunkimpath, factor);
+	    istatus = tileServerSubimage (impath, shrunkimpath, 1.0, 1.0,
+	        (double)param->ns, (double)param->nl, factor, param->errmsg);
+
+	    if (istatus < 0)
+	        return (-1);
+
+	    if (istatus > 0) {
+
+		sprintf (cmd, "mShrink %s %s %.6f", impath, shrunkimpath, factor);
            
-            if ((debugfile) && (fdebug != (FILE *)NULL)) {
-	        fprintf (fdebug, "mShrink cmd= [%s]\n", cmd);
-	        fflush (fdebug);
-            }
+		if ((debugfile) && (fdebug != (FILE *)NULL)) {
+		    fprintf (fdebug, "mShrink cmd= [%s]\n", cmd);
+		    fflush (fdebug);
+		}
   
-            istatus = svc_run (cmd);
+		istatus = svc_run (cmd);
                 
-	    if ((debugfile) && (fdebug != (FILE *)NULL)) {
-	        fprintf (fdebug, "returned mShrink: istatus= [%d]\n", istatus);
-	        fflush (fdebug);
-            }
+		if ((debugfile) && (fdebug != (FILE *)NULL)) {
+		    fprintf (fdebug, "returned mShrink: istatus= [%d]\n", istatus);
+		    fflush (fdebug);
+		}
   
-            if (istatus < 0) {
-	        sprintf (param->errmsg, 
-		    "Failed to run mShrink: cmd= [%s]", cmd);
-	        return (-1);
-            }
+		if (istatus < 0) {
+		    sprintf (param->errmsg, 
+			"Failed to run mShrink: cmd= [%s]", cmd);
+		    return (-1);
+		}
 		
-	    if (svc_value("stat") == (char *)NULL) {
-	        sprintf (param->errmsg, 
-	            "Failed to run mShrink: cmd= [%s]", cmd);
-	        return (-1);
-            }
+		if (svc_value("stat") == (char *)NULL) {
+		    sprintf (param->errmsg, 
+			"Failed to run mShrink: cmd= [%s]", cmd);
+		    return (-1);
+		}
 	            
-	    strcpy (status, svc_value("stat"));
+		strcpy (status, svc_value("stat"));
 
-            if ((debugfile) && (fdebug != (FILE *)NULL)) {
-	        fprintf (fdebug, "status= [%s]\n", status);
-	        fflush (fdebug);
-            }
+		if ((debugfile) && (fdebug != (FILE *)NULL)) {
+		    fprintf (fdebug, "status= [%s]\n", status);
+		    fflush (fdebug);
+		}
 
-            if (strcasecmp (status, "ok") != 0) {
+		if (strcasecmp (status, "ok") != 0) {
 
-	        sprintf (param->errmsg, 
-	            "Failed to run mShrink: [%s]\n", svc_value("msg"));
+		    sprintf (param->errmsg, 
+			"Failed to run mShrink: [%s]\n", svc_value("msg"));
         
-	        if ((debugfile) && (fdebug != (FILE *)NULL)) {
-	            fprintf (fdebug, "errmsg= [%s]\n", param->errmsg);
-	            fflush (fdebug);
-	        }
-	        return (-1);
-            }
+		    if ((debugfile) && (fdebug != (FILE *)NULL)) {
+			fprintf (fdebug, "errmsg= [%s]\n", param->errmsg);
+			fflush (fdebug);
+		    }
+		    return (-1);
+		}
+	    }
 
 	}
 	else {
@@ -479,48 +491,57 @@ int makeImage (struct Mviewer *param)
                     param->refzoomfactor = 1./factor;
 	        }
 
-                sprintf (cmd, "mShrink %s %s %.6f", redpath, shrunkredpath, 
-		    factor);
+		istatus = tileServerSubimage (redpath, shrunkredpath, 1.0, 1.0,
+		    (double)param->ns, (double)param->nl, factor, param->errmsg);
+
+		if (istatus < 0)
+		    return (-1);
+
+		if (istatus > 0) {
+
+		    sprintf (cmd, "mShrink %s %s %.6f", redpath, shrunkredpath, 
+			factor);
            
-                if ((debugfile) && (fdebug != (FILE *)NULL)) {
-	            fprintf (fdebug, "mShrink cmd= [%s]\n", cmd);
-	            fflush (fdebug);
-                }
+		    if ((debugfile) && (fdebug != (FILE *)NULL)) {
+			fprintf (fdebug, "mShrink cmd= [%s]\n", cmd);
+			fflush (fdebug);
+		    }
   
-                istatus = svc_run (cmd);
+		    istatus = svc_run (cmd);
                 
-		if ((debugfile) && (fdebug != (FILE *)NULL)) {
-	            fprintf (fdebug, 
-		        "returned svc_run (mShrink): istatus= [%d]\n", istatus);
-	            fflush (fdebug);
-                }
+		    if ((debugfile) && (fdebug != (FILE *)NULL)) {
+			fprintf (fdebug, 
+			    "returned svc_run (mShrink): istatus= [%d]\n", istatus);
+			fflush (fdebug);
+		    }
   
-                if (istatus < 0) {
-	            sprintf (param->errmsg, 
-		        "Failed to run mShrink: cmd= [%s]", cmd);
-	            return (-1);
-                }
+		    if (istatus < 0) {
+			sprintf (param->errmsg, 
+			    "Failed to run mShrink: cmd= [%s]", cmd);
+			return (-1);
+		    }
 		
-	        if (svc_value("stat") == (char *)NULL) {
-	            sprintf (param->errmsg, 
-	                "Failed to run mShrink: cmd= [%s]", cmd);
-	            return (-1);
-                }
+		    if (svc_value("stat") == (char *)NULL) {
+			sprintf (param->errmsg, 
+			    "Failed to run mShrink: cmd= [%s]", cmd);
+			return (-1);
+		    }
 	            
-	        strcpy (status, svc_value("stat"));
+		    strcpy (status, svc_value("stat"));
 
-                if (strcasecmp (status, "ok") != 0) {
+		    if (strcasecmp (status, "ok") != 0) {
 
-	            sprintf (param->errmsg, 
-	                "Failed to run mShrink for red image: [%s]\n", 
-			    svc_value("msg"));
+			sprintf (param->errmsg, 
+			    "Failed to run mShrink for red image: [%s]\n", 
+				svc_value("msg"));
         
-	            if ((debugfile) && (fdebug != (FILE *)NULL)) {
-	                fprintf (fdebug, "errmsg= [%s]\n", param->errmsg);
-	                fflush (fdebug);
-	            }
-	            return (-1);
-                }
+			if ((debugfile) && (fdebug != (FILE *)NULL)) {
+			    fprintf (fdebug, "errmsg= [%s]\n", param->errmsg);
+			    fflush (fdebug);
+			}
+			return (-1);
+		    }
+		}
 	    }
 
             if ((int)strlen(param->greenFile) > 0) {
@@ -536,47 +557,56 @@ int makeImage (struct Mviewer *param)
                     param->refzoomfactor = 1./factor;
 	        }
 
-                sprintf (cmd, "mShrink %s %s %.6f", grnpath, shrunkgrnpath, 
-		    factor);
+		istatus = tileServerSubimage (grnpath, shrunkgrnpath, 1.0, 1.0,
+		    (double)param->ns, (double)param->nl, factor, param->errmsg);
+
+		if (istatus < 0)
+		    return (-1);
+
+		if (istatus > 0) {
+
+		    sprintf (cmd, "mShrink %s %s %.6f", grnpath, shrunkgrnpath, 
+			factor);
            
-                if ((debugfile) && (fdebug != (FILE *)NULL)) {
-	            fprintf (fdebug, "mShrink cmd= [%s]\n", cmd);
-	            fflush (fdebug);
-                }
+		    if ((debugfile) && (fdebug != (FILE *)NULL)) {
+			fprintf (fdebug, "mShrink cmd= [%s]\n", cmd);
+			fflush (fdebug);
+		    }
   
-                istatus = svc_run (cmd);
-		if ((debugfile) && (fdebug != (FILE *)NULL)) {
-	            fprintf (fdebug, 
-		        "returned svc_run (mShrink): istatus= [%d]\n", istatus);
-	            fflush (fdebug);
-                }
+		    istatus = svc_run (cmd);
+		    if ((debugfile) && (fdebug != (FILE *)NULL)) {
+			fprintf (fdebug, 
+			    "returned svc_run (mShrink): istatus= [%d]\n", istatus);
+			fflush (fdebug);
+		    }
   
-                if (istatus < 0) {
-	            sprintf (param->errmsg, 
-		        "Failed to run mShrink: cmd= [%s]", cmd);
-	            return (-1);
-                }
+		    if (istatus < 0) {
+			sprintf (param->errmsg, 
+			    "Failed to run mShrink: cmd= [%s]", cmd);
+			return (-1);
+		    }
 		
-	        if (svc_value("stat") == (char *)NULL) {
-	            sprintf (param->errmsg, 
-	                "Failed to run mShrink: cmd= [%s]", cmd);
-	            return (-1);
-                }
+		    if (svc_value("stat") == (char *)NULL) {
+			sprintf (param->errmsg, 
+			    "Failed to run mShrink: cmd= [%s]", cmd);
+			return (-1);
+		    }
 	            
-	        strcpy (status, svc_value("stat"));
+		    strcpy (status, svc_value("stat"));
 
-                if (strcasecmp (status, "ok") != 0) {
+		    if (strcasecmp (status, "ok") != 0) {
 
-	            sprintf (param->errmsg, 
-	                "Failed to run mShrink for grn image: [%s]\n", 
-			    svc_value("msg"));
+			sprintf (param->errmsg, 
+			    "Failed to run mShrink for grn image: [%s]\n", 
+				svc_value("msg"));
         
-	            if ((debugfile) && (fdebug != (FILE *)NULL)) {
-	                fprintf (fdebug, "errmsg= [%s]\n", param->errmsg);
-	                fflush (fdebug);
-	            }
-	            return (-1);
-                }
+			if ((debugfile) && (fdebug != (FILE *)NULL)) {
+			    fprintf (fdebug, "errmsg= [%s]\n", param->errmsg);
+			    fflush (fdebug);
+			}
+			return (-1);
+		    }
+		}
 	    }
 
             if ((int)strlen(param->blueFile) > 0) {
@@ -592,47 +622,56 @@ int makeImage (struct Mviewer *param)
                     param->refzoomfactor = 1./factor;
 	        }
 
-                sprintf (cmd, "mShrink %s %s %.6f", bluepath, shrunkbluepath, 
-		    factor);
+		istatus = tileServerSubimage (bluepath, shrunkbluepath, 1.0, 1.0,
+		    (double)param->ns, (double)param->nl, factor, param->errmsg);
+
+		if (istatus < 0)
+		    return (-1);
+
+		if (istatus > 0) {
+
+		    sprintf (cmd, "mShrink %s %s %.6f", bluepath, shrunkbluepath, 
+			factor);
            
-                if ((debugfile) && (fdebug != (FILE *)NULL)) {
-	            fprintf (fdebug, "mShrink cmd= [%s]\n", cmd);
-	            fflush (fdebug);
-                }
+		    if ((debugfile) && (fdebug != (FILE *)NULL)) {
+			fprintf (fdebug, "mShrink cmd= [%s]\n", cmd);
+			fflush (fdebug);
+		    }
   
-                istatus = svc_run (cmd);
-		if ((debugfile) && (fdebug != (FILE *)NULL)) {
-	            fprintf (fdebug, 
-		        "returned svc_run (mShrink): istatus= [%d]\n", istatus);
-	            fflush (fdebug);
-                }
+		    istatus = svc_run (cmd);
+		    if ((debugfile) && (fdebug != (FILE *)NULL)) {
+			fprintf (fdebug, 
+			    "returned svc_run (mShrink): istatus= [%d]\n", istatus);
+			fflush (fdebug);
+		    }
   
-                if (istatus < 0) {
-	            sprintf (param->errmsg, 
-		        "Failed to run mShrink: cmd= [%s]", cmd);
-	            return (-1);
-                }
+		    if (istatus < 0) {
+			sprintf (param->errmsg, 
+			    "Failed to run mShrink: cmd= [%s]", cmd);
+			return (-1);
+		    }
 		
-	        if (svc_value("stat") == (char *)NULL) {
-	            sprintf (param->errmsg, 
-	                "Failed to run mShrink: cmd= [%s]", cmd);
-	            return (-1);
-                }
+		    if (svc_value("stat") == (char *)NULL) {
+			sprintf (param->errmsg, 
+			    "Failed to run mShrink: cmd= [%s]", cmd);
+			return (-1);
+		    }
 	            
-	        strcpy (status, svc_value("stat"));
+		    strcpy (status, svc_value("stat"));
 
-                if (strcasecmp (status, "ok") != 0) {
+		    if (strcasecmp (status, "ok") != 0) {
 
-	            sprintf (param->errmsg, 
-	                "Failed to run mShrink for blue image: [%s]\n", 
-			    svc_value("msg"));
+			sprintf (param->errmsg, 
+			    "Failed to run mShrink for blue image: [%s]\n", 
+				svc_value("msg"));
         
-	            if ((debugfile) && (fdebug != (FILE *)NULL)) {
-	                fprintf (fdebug, "errmsg= [%s]\n", param->errmsg);
-	                fflush (fdebug);
-	            }
-	            return (-1);
-                }
+			if ((debugfile) && (fdebug != (FILE *)NULL)) {
+			    fprintf (fdebug, "errmsg= [%s]\n", param->errmsg);
+			    fflush (fdebug);
+			}
+			return (-1);
+		    }
+		}
 	    }
         }
     }
@@ -21,6 +21,9 @@ Written: January 26, 2011 (Mihseh Kong)
 
 extern FILE *fdebug;
 
+int tileServerSubimage (char *impath, char *outpath, double ss, double sl,
+    double ns, double nl, double factor, char *errmsg);
+
 int subsetImage (char *impath, int ns, int nl, int xflip, int yflip, int nowcs,
     char *subsetPath, double sx, double sy, double ns_subset, double nl_subset, 
     char *errmsg)
@@ -66,6 +69,23 @@ int subsetImage (char *impath, int ns, int nl, int xflip, int yflip, int nowcs,
 
     
 
+/*
+    If a pyramid server has this image, it can cut out the region
+    from the tiles it already has mapped.
+*/
+    if (!nowcs) {
+
+        istatus = tileServerSubimage (impath, subsetPath, ss, sl, 
+	    ns_subset, nl_subset, 1.0, errmsg);
+
+        if (istatus == 0)
+            return (0);
+        
+	if (istatus < 0)
+            return (-1);
+    }
+
+
 /*
     use mSubimage to make cutouts
 */
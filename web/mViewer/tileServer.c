@@ -0,0 +1,134 @@
+/*
+Theme:  Hand image cutout and shrink requests to a running mTileServer
+    (memory-mapped multi-resolution pyramid server) instead of running
+    mSubimage/mShrink as child processes for every zoom and pan.
+
+    The server is found through the MVIEWER_TILESERVER environment
+    variable, which holds the local port it is listening on.  If the
+    variable is not set, the server is not running or it has no pyramid
+    for the requested image, the caller is told to fall back to the
+    command-line tools.
+
+Return:
+    0  -- output file made by the server,
+    1  -- server not available for this image (use mSubimage/mShrink),
+   -1  -- server error (errmsg set).
+*/
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <svc.h>
+
+extern FILE *fdebug;
+
+
+int tileServerSubimage (char *impath, char *outpath, double ss, double sl,
+    double ns, double nl, double factor, char *errmsg)
+{
+    char   *portstr;
+    char   *end;
+    char   cmd[4096], retstr[4096], status[40], msg[1024];
+
+    int    port;
+    int    sock;
+
+    FILE   *fp;
+
+    struct sockaddr_in addr;
+
+    int   debugfile = 1;
+
+
+    portstr = getenv ("MVIEWER_TILESERVER");
+
+    if ((portstr == (char *)NULL) || ((int)strlen(portstr) == 0))
+        return (1);
+
+    port = (int)strtol (portstr, &end, 10);
+
+    if ((end < portstr + strlen(portstr)) || (port <= 0))
+        return (1);
+
+/*
+    The pyramid levels are all reductions; let mShrink handle expansion.
+*/
+    if (factor < 1.0)
+        return (1);
+
+
+    sock = socket (AF_INET, SOCK_STREAM, 0);
+
+    if (sock < 0)
+        return (1);
+
+    memset ((void *)&addr, 0, sizeof(addr));
+
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (connect (sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+
+	if ((debugfile) && (fdebug != (FILE *)NULL)) {
+	    fprintf (fdebug, "tileServer: cannot connect to port %d: %s\n",
+	        port, strerror(errno));
+	    fflush (fdebug);
+	}
+        close (sock);
+        return (1);
+    }
+
+    fp = fdopen (sock, "r+");
+
+    if (fp == (FILE *)NULL) {
+        close (sock);
+        return (1);
+    }
+
+    sprintf (cmd, "subimage \"%s\" \"%s\" %15.8f %15.8f %.2f %.2f %.6f",
+        impath, outpath, ss, sl, ns, nl, factor);
+
+    if ((debugfile) && (fdebug != (FILE *)NULL)) {
+	fprintf (fdebug, "tileServer cmd= [%s]\n", cmd);
+	fflush (fdebug);
+    }
+
+    fprintf (fp, "%s\nquit\n", cmd);
+    fflush (fp);
+
+    if (fgets (retstr, 4096, fp) == (char *)NULL) {
+        fclose (fp);
+        return (1);
+    }
+
+    fclose (fp);
+
+    if ((debugfile) && (fdebug != (FILE *)NULL)) {
+	fprintf (fdebug, "tileServer return= [%s]\n", retstr);
+	fflush (fdebug);
+    }
+
+    if (svc_val (retstr, "stat", status) == (char *)NULL)
+        return (1);
+
+    if (strcasecmp (status, "OK") == 0)
+        return (0);
+
+    strcpy (msg, "");
+    svc_val (retstr, "msg", msg);
+
+    if (strncmp (msg, "No pyramid loaded", 17) == 0)
+        return (1);
+
+    sprintf (errmsg, "mTileServer: %s", msg);
+    return (-1);
+}